@@ -14,12 +14,50 @@
     }
   ]],
   'targets': [{
+    'target_name': 'abpcodecache',
+    'type': 'executable',
+    'dependencies': [
+      'libadblockplus.gyp:libadblockplus'
+    ],
+    'sources': [
+      'shell/src/CodeCacheMain.cpp',
+    ],
+    'msvs_settings': {
+      'VCLinkerTool': {
+        'SubSystem': '1',   # Console
+      }
+    },
+    'xcode_settings': {
+      'OTHER_LDFLAGS': ['-stdlib=libstdc++'],
+    },
+  },
+  {
+    'target_name': 'abpprecompile',
+    'type': 'executable',
+    'dependencies': [
+      'libadblockplus.gyp:libadblockplus'
+    ],
+    'sources': [
+      'shell/src/PrecompileMain.cpp',
+    ],
+    'msvs_settings': {
+      'VCLinkerTool': {
+        'SubSystem': '1',   # Console
+      }
+    },
+    'xcode_settings': {
+      'OTHER_LDFLAGS': ['-stdlib=libstdc++'],
+    },
+  },
+  {
     'target_name': 'abpshell',
     'type': 'executable',
     'dependencies': [
       'libadblockplus.gyp:libadblockplus'
     ],
     'sources': [
+      'shell/src/BenchCommand.cpp',
+      'shell/src/BenchCommand.h',
       'shell/src/Command.cpp',
       'shell/src/Command.h',
       'shell/src/FiltersCommand.cpp',
@@ -31,6 +69,10 @@
       'shell/src/Main.cpp',
       'shell/src/MatchesCommand.cpp',
       'shell/src/MatchesCommand.h',
+      'shell/src/ProfileCommand.cpp',
+      'shell/src/ProfileCommand.h',
+      'shell/src/StatsCommand.cpp',
+      'shell/src/StatsCommand.h',
       'shell/src/SubscriptionsCommand.cpp',
       'shell/src/SubscriptionsCommand.h',
       'shell/src/WebRequestCurl.cpp',
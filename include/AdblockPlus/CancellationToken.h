@@ -0,0 +1,67 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+namespace AdblockPlus
+{
+  /**
+   * Tells long running work that its result is no longer wanted, e.g.
+   * because the platform is shutting down. Copies refer to the same state.
+   *
+   * Work checks IsCancelled() where it can give up early and delivers its
+   * result through Run(), so that nothing is delivered after Cancel() has
+   * returned.
+   */
+  class CancellationToken
+  {
+  public:
+    /**
+     * Creates a token which is never cancelled.
+     */
+    CancellationToken() = default;
+
+    /**
+     * Creates a token which can be cancelled.
+     */
+    static CancellationToken Create();
+
+    /**
+     * Cancels the token and waits for the calls of Run() which are in
+     * progress to return. Must not be called from within Run().
+     */
+    void Cancel() const;
+
+    /**
+     * @return `true` once Cancel() has been called.
+     */
+    bool IsCancelled() const;
+
+    /**
+     * Calls `call` unless the token has been cancelled.
+     * @return `false` if `call` was dropped.
+     */
+    bool Run(const std::function<void()>& call) const;
+
+  private:
+    struct State;
+    std::shared_ptr<State> state;
+  };
+}
@@ -35,6 +35,7 @@ namespace AdblockPlus
     std::string GetRaw() const;
     const IFilterImplementation* Implementation() const;
     bool operator==(const Filter& filter) const;
+    size_t GetHash() const;
     Filter& operator=(const Filter& filter);
     Filter& operator=(Filter&& filter);
     Filter(const Filter& other);
@@ -45,3 +46,17 @@ namespace AdblockPlus
     std::unique_ptr<IFilterImplementation> implementation;
   };
 }
+
+namespace std
+{
+  /**
+   * Allows using `AdblockPlus::Filter` as a key of unordered containers.
+   */
+  template<> struct hash<AdblockPlus::Filter>
+  {
+    size_t operator()(const AdblockPlus::Filter& filter) const
+    {
+      return filter.GetHash();
+    }
+  };
+}
@@ -17,11 +17,15 @@
 
 #pragma once
 
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <string>
 #include <unordered_map>
 
 #include <AdblockPlus/IFilterEngine.h>
+#include <AdblockPlus/SharedFilterPool.h>
+#include <AdblockPlus/ThreadOptions.h>
 
 namespace AdblockPlus
 {
@@ -76,6 +80,15 @@ namespace AdblockPlus
      */
     struct CreationParameters
     {
+      CreationParameters()
+          : matchCacheSize(0), styleSheetCacheSize(16), snippetScriptCacheSize(16),
+            idleGcDelay(0), lowMemoryNotificationInterval(10000), binaryFilterStorage(false),
+            compressFilterStorage(false), lazyDisabledSubscriptions(false), prefsSaveDelay(1000),
+            filterHitsFlushInterval(60000), warmedDomainCount(0), cacheWarmingDelay(5000),
+            compactStyleSheets(false)
+      {
+      }
+
       /**
        * `AdblockPlus::FilterEngineFactory::Prefs` name - value list of preconfigured
        * prefs.
@@ -97,6 +110,145 @@ namespace AdblockPlus
        * on the current connection.
        */
       IsConnectionAllowedAsyncCallback isSubscriptionDownloadAllowedCallback;
+
+      /**
+       * Maximum number of results of `AdblockPlus::IFilterEngine::Matches()` to
+       * keep in an LRU cache, the cache is flushed on every filter or
+       * subscription change. The default 0 disables the cache.
+       */
+      size_t matchCacheSize;
+
+      /**
+       * Maximum number of results of
+       * `AdblockPlus::IFilterEngine::GetElementHidingStyleSheet()` to keep in
+       * an LRU cache, one per domain and `specificOnly` value. The same number
+       * of results of `GetElementHidingEmulationSelectors()` is kept, one per
+       * domain. The caches are flushed on every filter or subscription
+       * change, 0 disables them.
+       * Default: 16
+       */
+      size_t styleSheetCacheSize;
+
+      /**
+       * Maximum number of scripts compiled by
+       * `AdblockPlus::IFilterEngine::GetSnippetScript()` for a registered
+       * snippet library to keep in an LRU cache, one per document host and
+       * library. The cache is flushed whenever snippet filters change, 0
+       * disables it.
+       * Default: 16
+       */
+      size_t snippetScriptCacheSize;
+
+      /**
+       * Time without any matching after which V8 is given idle time for
+       * garbage collection. Critical collections, e.g. after the filter lists
+       * were saved, wait for that time as well, so that they don't slow down
+       * page loads. 0 disables idle time collections.
+       * Default: 0
+       */
+      std::chrono::milliseconds idleGcDelay;
+
+      /**
+       * Minimal time between two critical collections, requests made in the
+       * meantime are merged into one deferred collection.
+       * Default: 10 seconds
+       */
+      std::chrono::milliseconds lowMemoryNotificationInterval;
+
+      /**
+       * Whether the filter lists are saved in a compact binary format, in
+       * which filters shared by several subscriptions are stored only once.
+       * Saved filter lists are read in either format, so the setting can be
+       * changed between runs. Older versions of the library only read text.
+       * Default: false
+       */
+      bool binaryFilterStorage;
+
+      /**
+       * Whether the filter lists, including the downloaded subscriptions,
+       * are saved gzip compressed, which makes the file several times
+       * smaller. It can be combined with `binaryFilterStorage` and is
+       * ignored if the library is built without zlib. Saved filter lists
+       * are read compressed or not.
+       * Default: false
+       */
+      bool compressFilterStorage;
+
+      /**
+       * Whether the filters of disabled subscriptions are kept as text
+       * while they are disabled, instead of being loaded on startup. They
+       * are loaded once the subscription is enabled; until then its filter
+       * count is 0.
+       * Default: false
+       */
+      bool lazyDisabledSubscriptions;
+
+      /**
+       * Time to wait after a pref was changed before the prefs are saved,
+       * further changes in the meantime are saved along in one write.
+       * Pending changes are saved when the filter engine is destroyed.
+       * Default: 1 second
+       */
+      std::chrono::milliseconds prefsSaveDelay;
+
+      /**
+       * Time after the first filter hit at which the hits recorded while the
+       * `savestats` pref is set are added to the hit counts of the filters,
+       * all at once with a single save of the filter lists.
+       * Default: 1 minute
+       */
+      std::chrono::milliseconds filterHitsFlushInterval;
+
+      /**
+       * Pool of parsed URL filters to share with the other filter engines
+       * of the process which are given the same pool, e.g. the ones of
+       * other browser profiles subscribed to the same filter lists. Every
+       * engine still has its own `Platform`, JS engine, subscriptions and
+       * prefs, only the native copies of the filters they have in common
+       * are stored once.
+       * Default: nullptr, nothing is shared
+       */
+      std::shared_ptr<SharedFilterPool> sharedFilterPool;
+
+      /**
+       * Number of the most visited sites whose style sheets, snippet scripts
+       * and document allowlisting are computed ahead of their next visit,
+       * after filters changed and on startup. Sites are ranked by the
+       * top-level documents passed to `CreateFrameContext()` and
+       * `PrepareForDocument()`, the ranking is saved in the file
+       * `topdomains.txt`. 0 disables it.
+       * Default: 0
+       */
+      size_t warmedDomainCount;
+
+      /**
+       * Time without any matching after which sites are warmed up and the
+       * ranking is saved, so that page loads aren't slowed down by it.
+       * Default: 5 seconds
+       */
+      std::chrono::milliseconds cacheWarmingDelay;
+
+      /**
+       * Whether the element hiding style sheets are written without
+       * duplicate selectors, without selectors which hide a subset of the
+       * elements of another selector applying to the document, e.g.
+       * `div.ad` next to `.ad`, and without optional whitespace. Every
+       * selector still gets a rule of its own, see
+       * `IFilterEngine::GetCompactStyleSheetStats()` for the savings.
+       * Default: false
+       */
+      bool compactStyleSheets;
+
+      /**
+       * Scheduling settings of the thread which the filter engine starts
+       * for the `...Async()` methods of `IFilterEngine` and for
+       * `PrepareForDocument()`, i.e. the matching which page loads wait
+       * for, e.g. `ThreadOptions::Priority::INTERACTIVE` and the big cores
+       * of a big.LITTLE system. Calls made on other threads still use
+       * these threads.
+       * Default: inherited from the thread creating the filter engine
+       */
+      ThreadOptions asyncCallThread;
     };
 
     /**
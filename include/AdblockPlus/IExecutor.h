@@ -17,13 +17,62 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstddef>
 #include <functional>
 
+#include <AdblockPlus/CancellationToken.h>
+#include <AdblockPlus/LatencyHistogram.h>
+
 namespace AdblockPlus
 {
   class IExecutor
   {
   public:
+    /**
+     * Kind of a task, executors may use it to order or to separate tasks.
+     */
+    enum class TaskClass
+    {
+      /**
+       * Short task which something is waiting for, e.g. a file read while
+       * the filter engine is being created.
+       */
+      CRITICAL,
+      /**
+       * Short task which nothing is waiting for, e.g. a file write.
+       */
+      BACKGROUND,
+      /**
+       * Task which may take long, e.g. a download.
+       */
+      NETWORK
+    };
+
+    /**
+     * Snapshot of the task queue, see GetStats().
+     */
+    struct Stats
+    {
+      /**
+       * Number of tasks which were dispatched but have not started yet.
+       */
+      size_t queuedTasks;
+      /**
+       * Number of threads which are executing a task.
+       */
+      size_t activeThreads;
+      /**
+       * Time from dispatching a task until it starts.
+       */
+      LatencyHistogram waitTime;
+      /**
+       * Time a task takes to execute, its count is the number of executed
+       * tasks.
+       */
+      LatencyHistogram runTime;
+    };
+
     virtual ~IExecutor() = default;
 
     /**
@@ -32,9 +81,49 @@ namespace AdblockPlus
      */
     virtual void Dispatch(const std::function<void()>& task) = 0;
 
+    /**
+     * Same as `Dispatch(task)` but tells what kind of task it is. The
+     * default implementation ignores `taskClass`.
+     */
+    virtual void Dispatch(const std::function<void()>& task, TaskClass taskClass)
+    {
+      Dispatch(task);
+    }
+
     /**
      * Stop accepting tasks.
      */
     virtual void Stop() = 0;
+
+    /**
+     * Same as Stop() but gives up waiting for the running tasks after
+     * `timeout`, their threads are left to finish on their own. The default
+     * implementation calls Stop().
+     */
+    virtual void StopWithin(std::chrono::milliseconds timeout)
+    {
+      Stop();
+    }
+
+    /**
+     * @return Token which is cancelled when the executor is stopped. Tasks
+     *         pass it to the work they wait for and deliver their results
+     *         through CancellationToken::Run(), so that nothing is delivered
+     *         once the executor is stopped. The default implementation
+     *         returns a token which is never cancelled.
+     */
+    virtual CancellationToken GetCancellationToken()
+    {
+      return CancellationToken();
+    }
+
+    /**
+     * @return Current statistics of the executor. The default implementation
+     *         returns zeros.
+     */
+    virtual Stats GetStats()
+    {
+      return Stats{};
+    }
   };
 }
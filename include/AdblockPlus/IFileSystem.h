@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <istream>
@@ -73,6 +74,26 @@ namespace AdblockPlus
      */
     typedef std::function<void(IOBuffer&&)> ReadCallback;
 
+    /**
+     * Read-only file content, see ReadView(). Implementations may refer to
+     * a memory mapping of the file instead of a copy.
+     */
+    struct ContentView
+    {
+      const uint8_t* data;
+      size_t size;
+      /**
+       * Keeps `data` valid, the mapping or buffer is released with the last
+       * copy of it.
+       */
+      std::shared_ptr<const void> owner;
+    };
+
+    /**
+     * Callback type for the asynchronous ReadView call.
+     */
+    typedef std::function<void(const ContentView&)> ReadViewCallback;
+
     /**
      * Reads from a file.
      * @param fileName File name.
@@ -85,6 +106,26 @@ namespace AdblockPlus
                       const ReadCallback& doneCallback,
                       const Callback& errorCallback) const = 0;
 
+    /**
+     * Same as Read() but the content doesn't have to be copied into an
+     * `IOBuffer`. The default implementation calls Read().
+     * @param fileName File name.
+     * @param doneCallback The function called on completion with the
+     *   content, it may keep `ContentView::owner` to use the content later.
+     * @param errorCallback The function called if an error occured.
+     */
+    virtual void ReadView(const std::string& fileName,
+                          const ReadViewCallback& doneCallback,
+                          const Callback& errorCallback) const
+    {
+      Read(fileName,
+           [doneCallback](IOBuffer&& content) {
+             auto buffer = std::make_shared<const IOBuffer>(std::move(content));
+             doneCallback(ContentView{buffer->data(), buffer->size(), buffer});
+           },
+           errorCallback);
+    }
+
     /**
      * Writes to a file.
      * @param fileName File name.
@@ -94,6 +135,40 @@ namespace AdblockPlus
     virtual void
     Write(const std::string& fileName, const IOBuffer& data, const Callback& callback) = 0;
 
+    /**
+     * Receives the content of a file piece by piece, see OpenWriter().
+     */
+    class IFileWriter
+    {
+    public:
+      virtual ~IFileWriter()
+      {
+      }
+
+      /**
+       * Appends to the content.
+       * @param chunk The data to append.
+       */
+      virtual void Append(IOBuffer&& chunk) = 0;
+
+      /**
+       * Replaces the file with the appended content. The writer may be
+       * destroyed right after the call.
+       * @param callback The function called on completion.
+       */
+      virtual void Commit(const Callback& callback) = 0;
+    };
+
+    /**
+     * Starts writing a file whose content is produced in pieces, so that it
+     * doesn't have to be kept in memory at once. The file only changes on
+     * IFileWriter::Commit(), a writer destroyed before that leaves it alone.
+     * The default implementation collects the content and calls Write().
+     * @param fileName File name.
+     * @return The writer.
+     */
+    virtual std::unique_ptr<IFileWriter> OpenWriter(const std::string& fileName);
+
     /**
      * Moves a file (i.e. renames it).
      * @param fromFileName Current file name.
@@ -104,6 +179,17 @@ namespace AdblockPlus
                       const std::string& toFileName,
                       const Callback& callback) = 0;
 
+    /**
+     * Copies a file, replacing the target if it exists. The default
+     * implementation reads the file and writes its content.
+     * @param fromFileName File to copy.
+     * @param toFileName Name of the copy.
+     * @param callback The function called on completion.
+     */
+    virtual void Copy(const std::string& fromFileName,
+                      const std::string& toFileName,
+                      const Callback& callback);
+
     /**
      * Removes a file.
      * @param fileName File name.
@@ -124,6 +210,24 @@ namespace AdblockPlus
      * @param callback The function called on completion.
      */
     virtual void Stat(const std::string& fileName, const StatCallback& callback) const = 0;
+
+    /**
+     * Callback type for the asynchronous StatMany call.
+     * @param the StatResult data of the files.
+     * @param error strings of the files, empty if no error.
+     */
+    typedef std::function<void(const std::vector<StatResult>&, const std::vector<std::string>&)>
+        StatManyCallback;
+
+    /**
+     * Retrieves information about several files at once. The default
+     * implementation calls Stat() for each file.
+     * @param fileNames File names.
+     * @param callback The function called on completion, with the results in
+     *        the order of `fileNames`.
+     */
+    virtual void StatMany(const std::vector<std::string>& fileNames,
+                          const StatManyCallback& callback) const;
   };
 
   /**
@@ -17,14 +17,18 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <functional>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <AdblockPlus/Filter.h>
 #include <AdblockPlus/IElement.h>
 #include <AdblockPlus/JsValue.h>
+#include <AdblockPlus/LatencyHistogram.h>
 #include <AdblockPlus/Subscription.h>
 
 namespace AdblockPlus
@@ -102,6 +106,27 @@ namespace AdblockPlus
     class EventObserver
     {
     public:
+      /**
+       * Mask selecting all the events.
+       */
+      static const uint32_t ALL_EVENTS = 0xFFFFFFFF;
+
+      /**
+       * @return Bit of the event in GetFilterEventMask().
+       */
+      static uint32_t EventMask(FilterEvent event)
+      {
+        return 1u << static_cast<uint32_t>(event);
+      }
+
+      /**
+       * @return Bit of the event in GetSubscriptionEventMask().
+       */
+      static uint32_t EventMask(SubscriptionEvent event)
+      {
+        return 1u << static_cast<uint32_t>(event);
+      }
+
       virtual ~EventObserver() = default;
       virtual void OnFilterEvent(FilterEvent, const Filter&)
       {
@@ -110,6 +135,68 @@ namespace AdblockPlus
       virtual void OnSubscriptionEvent(SubscriptionEvent, const Subscription&)
       {
       }
+
+      /**
+       * Called instead of OnFilterEvent() for batching observers, with
+       * consecutive events of the same type.
+       * @see IsBatching()
+       */
+      virtual void OnFilterEvents(FilterEvent, const std::vector<Filter>&)
+      {
+      }
+
+      /**
+       * Called instead of OnSubscriptionEvent() for batching observers, with
+       * consecutive events of the same type.
+       * @see IsBatching()
+       */
+      virtual void OnSubscriptionEvents(SubscriptionEvent, const std::vector<Subscription>&)
+      {
+      }
+
+      /**
+       * Whether events are collected and delivered through OnFilterEvents()
+       * and OnSubscriptionEvents(), in the order they occurred. Queried once
+       * by AddEventObserver(). Events which are still pending when the
+       * observer is removed are dropped.
+       * @return `false` by default.
+       */
+      virtual bool IsBatching() const
+      {
+        return false;
+      }
+
+      /**
+       * Time for which a batching observer collects events before they are
+       * delivered, zero delivers all events of a JS task together. Queried
+       * once by AddEventObserver().
+       * @return Zero by default.
+       */
+      virtual std::chrono::milliseconds GetBatchWindow() const
+      {
+        return std::chrono::milliseconds(0);
+      }
+
+      /**
+       * Selects the filter events passed to OnFilterEvent(). It is queried
+       * once by AddEventObserver(), events which no observer is interested
+       * in are dropped without creating a `Filter` for them.
+       * @return Combination of EventMask() values, all events by default.
+       */
+      virtual uint32_t GetFilterEventMask() const
+      {
+        return ALL_EVENTS;
+      }
+
+      /**
+       * Selects the subscription events passed to OnSubscriptionEvent(), see
+       * GetFilterEventMask().
+       * @return Combination of EventMask() values, all events by default.
+       */
+      virtual uint32_t GetSubscriptionEventMask() const
+      {
+        return ALL_EVENTS;
+      }
     };
 
     /**
@@ -128,6 +215,356 @@ namespace AdblockPlus
       std::string text;
     };
 
+    /**
+     * Plain copy of a filter which can be kept without referring to the JS
+     * engine, see GetListedFilters(size_t, size_t).
+     */
+    struct FilterInfo
+    {
+      std::string text;
+      Filter::Type type;
+    };
+
+    /**
+     * Plain copy of a subscription which can be kept without referring to
+     * the JS engine, see GetSubscriptionInfo() and
+     * GetListedSubscriptions(size_t, size_t). The fields hold what the
+     * `Subscription` getters of the same name return.
+     */
+    struct SubscriptionInfo
+    {
+      SubscriptionInfo()
+          : filterCount(0),
+            lastDownloadAttemptTime(0),
+            lastDownloadSuccessTime(0),
+            version(0),
+            disabled(false),
+            updating(false),
+            aa(false)
+      {
+      }
+
+      std::string url;
+      std::string title;
+      std::string homepage;
+      std::string author;
+      std::vector<std::string> languages;
+      int filterCount;
+      std::string synchronizationStatus;
+      int lastDownloadAttemptTime;
+      int lastDownloadSuccessTime;
+      int version;
+      bool disabled;
+      bool updating;
+      bool aa;
+    };
+
+    /**
+     * Subscription recommended by the build, see GetRecommendations().
+     */
+    struct Recommendation
+    {
+      std::string url;
+      std::string title;
+      std::string homepage;
+      /// Kind of the subscription, e.g. `ads` or `circumvention`.
+      std::string type;
+      std::vector<std::string> languages;
+    };
+
+    /**
+     * What happens when the queue of an asynchronous observer is full, see
+     * AsyncObserverOptions.
+     */
+    enum class OverflowPolicy
+    {
+      /// The new event is dropped.
+      DROP,
+      /// The new event replaces a queued one of the same type for the same
+      /// filter or subscription, if there is none the oldest queued event is
+      /// dropped.
+      COALESCE,
+      /// The JS thread waits until the observer catches up. The observer must
+      /// not call the filter engine then.
+      BLOCK
+    };
+
+    /**
+     * Options of StartTraceRecording().
+     */
+    struct TraceRecordingOptions
+    {
+      TraceRecordingOptions()
+          : fileName("adblock_trace.log"), samplingRatio(1.0), maxRecordsPerSecond(100),
+            maxRecords(100000)
+      {
+      }
+
+      /// File to write, relative to the base path of the file system.
+      std::string fileName;
+      /// Share of the calls which are recorded, between 0 and 1.
+      double samplingRatio;
+      /// Calls beyond that many in a second are skipped, 0 for no limit.
+      size_t maxRecordsPerSecond;
+      /// Recording stops after that many records, 0 for no limit.
+      size_t maxRecords;
+    };
+
+    /**
+     * Called when a trace recording is written, with an error message or an
+     * empty string on success.
+     */
+    typedef std::function<void(const std::string&)> TraceRecordingCallback;
+
+    /**
+     * Options of AddAsyncEventObserver().
+     */
+    struct AsyncObserverOptions
+    {
+      AsyncObserverOptions() : queueSize(1024), overflowPolicy(OverflowPolicy::DROP)
+      {
+      }
+
+      /// Maximal number of events waiting for delivery.
+      size_t queueSize;
+      OverflowPolicy overflowPolicy;
+    };
+
+    /**
+     * Observer notified on a thread of its own, with plain copies of the
+     * filters and subscriptions, see AddAsyncEventObserver().
+     */
+    class AsyncEventObserver
+    {
+    public:
+      virtual ~AsyncEventObserver() = default;
+      virtual void OnFilterEvent(FilterEvent, const FilterInfo&)
+      {
+      }
+
+      virtual void OnSubscriptionEvent(SubscriptionEvent, const SubscriptionInfo&)
+      {
+      }
+
+      /**
+       * @see EventObserver::GetFilterEventMask()
+       */
+      virtual uint32_t GetFilterEventMask() const
+      {
+        return EventObserver::ALL_EVENTS;
+      }
+
+      /**
+       * @see EventObserver::GetSubscriptionEventMask()
+       */
+      virtual uint32_t GetSubscriptionEventMask() const
+      {
+        return EventObserver::ALL_EVENTS;
+      }
+    };
+
+    /**
+     * Callback type invoked by VisitListedFilters() for each filter.
+     * Returning `false` stops the iteration.
+     */
+    typedef std::function<bool(const FilterInfo&)> FilterVisitor;
+
+    /**
+     * Callback type invoked by VisitListedSubscriptions() and
+     * VisitAvailableSubscriptions() for each subscription. Returning `false`
+     * stops the iteration.
+     */
+    typedef std::function<bool(const SubscriptionInfo&)> SubscriptionVisitor;
+
+    /**
+     * Handle of a snippet library, see RegisterSnippetLibrary().
+     */
+    typedef int32_t SnippetLibrary;
+
+    /**
+     * Single entry of a MatchesBatch() call, the fields have the same meaning
+     * as the parameters of Matches().
+     */
+    struct MatchRequest
+    {
+      std::string url;
+      ContentTypeMask contentTypeMask;
+      std::string documentUrl;
+      std::string siteKey;
+      bool specificOnly;
+    };
+
+    /**
+     * Counters of the match result cache, see
+     * `FilterEngineFactory::CreationParameters::matchCacheSize`. Hits of
+     * the small cache which each thread keeps in front of it for
+     * GetMatchResult() are counted as hits as well.
+     */
+    struct MatchCacheStats
+    {
+      size_t hits;
+      size_t misses;
+      size_t size;
+      size_t capacity;
+    };
+
+    /**
+     * Counters of the element hiding style sheet cache, see
+     * `FilterEngineFactory::CreationParameters::styleSheetCacheSize`.
+     */
+    typedef MatchCacheStats StyleSheetCacheStats;
+
+    /**
+     * Approximate memory held by the filters of a subscription, see
+     * GetSubscriptionMemoryUsage(). Sizes are in bytes.
+     */
+    struct SubscriptionMemoryUsage
+    {
+      SubscriptionMemoryUsage() : filterCount(0), jsHeapSize(0), nativeSize(0)
+      {
+      }
+
+      std::string url;
+      size_t filterCount;
+      /// Estimate of the filter texts and objects in the V8 heap.
+      size_t jsHeapSize;
+      /// Memory of the native URL filter index.
+      size_t nativeSize;
+    };
+
+    /**
+     * Filters which are in several subscriptions, see
+     * GetFilterDeduplicationStats(). Sizes are in bytes.
+     */
+    struct FilterDeduplicationStats
+    {
+      FilterDeduplicationStats()
+          : sharedFilterCount(0), duplicateCount(0), jsHeapSize(0), nativeSize(0)
+      {
+      }
+
+      /// Number of filters which are in more than one subscription.
+      size_t sharedFilterCount;
+      /// Number of times these filters are listed besides the first time.
+      size_t duplicateCount;
+      /// Estimate of the V8 heap which is saved by storing their texts and
+      /// objects once.
+      size_t jsHeapSize;
+      /// Memory of the native URL filter index which is saved the same way.
+      size_t nativeSize;
+    };
+
+    /**
+     * Savings of the compact element hiding style sheets, see
+     * GetCompactStyleSheetStats(). Sizes are in bytes.
+     */
+    struct CompactStyleSheetStats
+    {
+      CompactStyleSheetStats() : styleSheetCount(0), size(0), savedSize(0)
+      {
+      }
+
+      /// Number of style sheets written in compact form.
+      size_t styleSheetCount;
+      /// Total size of these style sheets.
+      size_t size;
+      /// Bytes which the regular form would have taken in addition.
+      size_t savedSize;
+    };
+
+    /**
+     * Latency distribution, see GetPerformanceStats().
+     */
+    typedef AdblockPlus::LatencyHistogram LatencyHistogram;
+
+    /**
+     * Call count and latencies of a method, see GetPerformanceStats().
+     */
+    struct CallStats
+    {
+      uint64_t calls;
+      /**
+       * Time spent waiting for the JS engine to become available, i.e. while
+       * another thread executed JavaScript.
+       */
+      LatencyHistogram lockWait;
+      /**
+       * Time spent in the method apart from waiting for the JS engine.
+       */
+      LatencyHistogram execution;
+    };
+
+    /**
+     * Statistics by method name, e.g. `Matches`.
+     */
+    typedef std::map<std::string, CallStats> PerformanceStats;
+
+    /**
+     * Result of GetMatchResult(). Unlike `Filter` it is a plain value which
+     * can be copied and destroyed without entering the JS engine.
+     */
+    struct MatchResult
+    {
+      enum Decision
+      {
+        NO_MATCH,
+        BLOCKED,
+        ALLOWLISTED
+      };
+
+      MatchResult() : decision(NO_MATCH), type(Filter::Type::TYPE_INVALID)
+      {
+      }
+
+      bool IsMatched() const
+      {
+        return decision != NO_MATCH;
+      }
+
+      Decision decision;
+
+      /**
+       * Type of the matching filter, `TYPE_INVALID` if there is none.
+       */
+      Filter::Type type;
+
+      /**
+       * Text of the matching filter, shared with the filter engine, `nullptr`
+       * if there is none. Pass it to GetFilter() to get the full `Filter`.
+       */
+      std::shared_ptr<const std::string> filterText;
+    };
+
+    /**
+     * Frame of a document, shared by the requests which the frame issues,
+     * see CreateFrameContext(). It can be used by several threads at once.
+     */
+    class FrameContext
+    {
+    public:
+      virtual ~FrameContext() = default;
+
+      /**
+       * @return Chain of URLs passed to CreateFrameContext().
+       */
+      virtual const std::vector<std::string>& GetDocumentUrls() const = 0;
+
+      /**
+       * @return Sitekey passed to CreateFrameContext().
+       */
+      virtual const std::string& GetSiteKey() const = 0;
+    };
+
+    /**
+     * Keeps the engine locked for the thread which created it, see
+     * CreateEngineSession().
+     */
+    class EngineSession
+    {
+    public:
+      virtual ~EngineSession() = default;
+    };
+
     virtual ~IFilterEngine() = default;
 
     /**
@@ -153,24 +590,121 @@ namespace AdblockPlus
      */
     virtual std::vector<Subscription> GetSubscriptionsFromFilter(const Filter& filter) const = 0;
 
+    /**
+     * Retrieves the URLs of the subscriptions which contain a filter, in the
+     * order of GetSubscriptionsFromFilter(). The answer comes from a native
+     * index which the first call builds and the filter and subscription
+     * events keep up to date, so later calls don't enter the JS engine.
+     * @param filterText Normalized filter text.
+     * @return URLs of the subscriptions containing the filter.
+     */
+    virtual std::vector<std::string>
+    GetSubscriptionUrlsFromFilter(const std::string& filterText) const = 0;
+
     /**
      * Retrieves the list of custom filters.
      * @return List of custom filters.
      */
     virtual std::vector<Filter> GetListedFilters() const = 0;
 
+    /**
+     * Retrieves the number of custom filters without retrieving them.
+     * @return Number of custom filters.
+     */
+    virtual size_t GetListedFilterCount() const = 0;
+
+    /**
+     * Retrieves a range of the custom filters, in the order of
+     * GetListedFilters().
+     * @param offset Index of the first filter to retrieve.
+     * @param limit Maximum number of filters to retrieve.
+     * @return Custom filters, empty if `offset` is past the end.
+     */
+    virtual std::vector<FilterInfo> GetListedFilters(size_t offset, size_t limit) const = 0;
+
+    /**
+     * Calls `visitor` for each custom filter. The filters are retrieved in
+     * pages, the JS engine is not locked while `visitor` runs, so changes in
+     * between can make it skip or repeat filters.
+     * @param visitor Callback, returning `false` stops the iteration.
+     */
+    virtual void VisitListedFilters(const FilterVisitor& visitor) const = 0;
+
     /**
      * Retrieves all subscriptions.
      * @return List of subscriptions.
      */
     virtual std::vector<Subscription> GetListedSubscriptions() const = 0;
 
+    /**
+     * Retrieves all properties of a subscription at once, instead of one
+     * call into the JS engine per `Subscription` getter.
+     * @param subscription Subscription to describe.
+     * @return Snapshot of the subscription's properties.
+     */
+    virtual SubscriptionInfo GetSubscriptionInfo(const Subscription& subscription) const = 0;
+
+    /**
+     * Retrieves the number of subscriptions without retrieving them.
+     * @return Number of subscriptions.
+     */
+    virtual size_t GetListedSubscriptionCount() const = 0;
+
+    /**
+     * Retrieves a range of the subscriptions, in the order of
+     * GetListedSubscriptions().
+     * @param offset Index of the first subscription to retrieve.
+     * @param limit Maximum number of subscriptions to retrieve.
+     * @return Subscriptions, empty if `offset` is past the end.
+     */
+    virtual std::vector<SubscriptionInfo> GetListedSubscriptions(size_t offset,
+                                                                 size_t limit) const = 0;
+
+    /**
+     * Calls `visitor` for each subscription, see VisitListedFilters().
+     * @param visitor Callback, returning `false` stops the iteration.
+     */
+    virtual void VisitListedSubscriptions(const SubscriptionVisitor& visitor) const = 0;
+
     /**
      * Retrieves all recommended subscriptions.
      * @return List of recommended subscriptions.
      */
     virtual std::vector<Subscription> FetchAvailableSubscriptions() const = 0;
 
+    /**
+     * Retrieves the number of recommended subscriptions without retrieving
+     * them.
+     * @return Number of recommended subscriptions.
+     */
+    virtual size_t GetAvailableSubscriptionCount() const = 0;
+
+    /**
+     * Retrieves a range of the recommended subscriptions, in the order of
+     * FetchAvailableSubscriptions().
+     * @param offset Index of the first subscription to retrieve.
+     * @param limit Maximum number of subscriptions to retrieve.
+     * @return Recommended subscriptions, empty if `offset` is past the end.
+     */
+    virtual std::vector<SubscriptionInfo> FetchAvailableSubscriptions(size_t offset,
+                                                                      size_t limit) const = 0;
+
+    /**
+     * Calls `visitor` for each recommended subscription, see
+     * VisitListedFilters().
+     * @param visitor Callback, returning `false` stops the iteration.
+     */
+    virtual void VisitAvailableSubscriptions(const SubscriptionVisitor& visitor) const = 0;
+
+    /**
+     * Retrieves the recommended subscriptions as plain structures, in the
+     * order of FetchAvailableSubscriptions(). The recommendations don't
+     * change for a given build, so only the first call enters the JS engine.
+     * Unlike SubscriptionInfo they carry no state of the subscriptions.
+     * @return Immutable list of recommended subscriptions.
+     */
+    virtual std::shared_ptr<const std::vector<Recommendation>> GetRecommendations() const = 0;
+
     /**
      * Ensures that the Acceptable Ads subscription is enabled or disabled.
      * @param enabled
@@ -214,6 +748,29 @@ namespace AdblockPlus
                            const std::string& siteKey = "",
                            bool specificOnly = false) const = 0;
 
+    /**
+     * Batch variant of Matches(), checks all the requests in a single call
+     * into the JavaScript engine. It is meant for bursts of subresource
+     * requests, e.g. during a page load.
+     * @param requests List of requests to match.
+     * @return List of the same size as `requests`, every item is either the
+     *         matching filter for the request with the same index or an
+     *         invalid filter if there was no match.
+     * @see Matches()
+     */
+    virtual std::vector<Filter> MatchesBatch(const std::vector<MatchRequest>& requests) const = 0;
+
+    /**
+     * Same as Matches() but returns a plain value instead of a `Filter`, which
+     * is cheaper when only the block or allow decision is needed.
+     * @see Matches()
+     */
+    virtual MatchResult GetMatchResult(const std::string& url,
+                                       ContentTypeMask contentTypeMask,
+                                       const std::string& documentUrl,
+                                       const std::string& siteKey = "",
+                                       bool specificOnly = false) const = 0;
+
     /**
      * Checks whether the resource at the supplied URL is allowlisted.
      * @param url URL of the resource.
@@ -229,6 +786,208 @@ namespace AdblockPlus
                                       const std::vector<std::string>& documentUrls,
                                       const std::string& sitekey = "") const = 0;
 
+    /**
+     * Creates a handle of a frame to be passed to Matches() and
+     * GetMatchResult() instead of the document URL. Whether the frame is
+     * allowlisted by `$document` and `$genericblock` filters is only looked
+     * up once and remembered until filters change, so create one handle per
+     * frame and reuse it for all of its subresources.
+     * @param documentUrls Chain of URLs of the frame, starting with the frame
+     *        itself, ending with the top-level frame, see
+     *        IsContentAllowlisted(). Empty for top-level requests.
+     * @param siteKey
+     *        Optional: public key provided by the document.
+     * @return Frame context, only to be used with this filter engine.
+     */
+    virtual std::shared_ptr<const FrameContext>
+    CreateFrameContext(const std::vector<std::string>& documentUrls,
+                       const std::string& siteKey = "") const = 0;
+
+    /**
+     * Same as Matches() but for a request issued by a frame, taking the
+     * allowlisting of the frame into account: if the frame is allowlisted
+     * by a `$document` filter, that filter is returned, if it is allowlisted
+     * by a `$genericblock` filter, generic filters are skipped.
+     * @param url URL to match.
+     * @param contentTypeMask Content type mask of the requested resource.
+     * @param frame Frame issuing the request, see CreateFrameContext().
+     * @param specificOnly Optional: if set to `true` then skips generic filters.
+     * @return Matching filter, or an invalid filter if there was no match.
+     */
+    virtual Filter Matches(const std::string& url,
+                           ContentTypeMask contentTypeMask,
+                           const FrameContext& frame,
+                           bool specificOnly = false) const = 0;
+
+    /**
+     * Same as Matches() with a frame context, but returns a plain value.
+     * @see GetMatchResult()
+     */
+    virtual MatchResult GetMatchResult(const std::string& url,
+                                       ContentTypeMask contentTypeMask,
+                                       const FrameContext& frame,
+                                       bool specificOnly = false) const = 0;
+
+    /**
+     * Decision of CheckPopup().
+     */
+    enum class PopupBlockResult
+    {
+      // No filter applies, the popup is allowed.
+      NO_RULE,
+      // Blocked by a `$popup` filter.
+      BLOCK_RULE,
+      // Allowed by an allowlisting `$popup` filter.
+      ALLOW_RULE,
+      // The opener is allowlisted by a `$document` filter.
+      DISABLED
+    };
+
+    /**
+     * Decides whether to block a popup in one call, taking the
+     * allowlisting of its opener into account like GetMatchResult() does.
+     * @param url URL of the popup.
+     * @param opener Frame which opened the popup, see CreateFrameContext().
+     *        Its allowlisting is only looked up once, so keep the context
+     *        of a frame around and pass it for all of its popups.
+     * @return Decision.
+     */
+    virtual PopupBlockResult CheckPopup(const std::string& url,
+                                        const FrameContext& opener) const = 0;
+
+    /**
+     * Same as CheckPopup() with a frame context created for the call.
+     * @param url URL of the popup.
+     * @param openerUrls Chain of URLs of the opener, starting with the
+     *        opener itself, see IsContentAllowlisted().
+     * @param sitekey Optional: public key provided by the opener.
+     * @return Decision.
+     */
+    virtual PopupBlockResult CheckPopup(const std::string& url,
+                                        const std::vector<std::string>& openerUrls,
+                                        const std::string& sitekey = "") const = 0;
+
+    /**
+     * Retrieves the hit and miss counters of the cache in front of Matches()
+     * and IsContentAllowlisted(). Can be used to size the cache.
+     * @return Counters since the engine was created, all zero if the cache
+     *         is disabled.
+     */
+    virtual MatchCacheStats GetMatchCacheStats() const = 0;
+
+    /**
+     * Retrieves the hit and miss counters of the cache in front of
+     * GetElementHidingStyleSheet() and GetElementHidingDomainStyleSheet().
+     * The generic style sheet is kept apart and not counted.
+     * @return Counters since the engine was created, all zero if the cache
+     *         is disabled.
+     */
+    virtual StyleSheetCacheStats GetStyleSheetCacheStats() const = 0;
+
+    /**
+     * Estimates the memory held by the filters of every listed subscription,
+     * including the disabled ones and the one of the user's filters. Unlike
+     * the filter count it takes the length of the filters into account,
+     * and filters which aren't matched natively take no native memory.
+     * Filters which are in several subscriptions are stored once, their
+     * memory is split evenly between them, so that the sizes add up.
+     * Walks all filters, don't call it for every request.
+     * @return Estimates by subscription URL, in the order in which the
+     *         subscriptions were added.
+     */
+    virtual std::vector<SubscriptionMemoryUsage> GetSubscriptionMemoryUsage() const = 0;
+
+    /**
+     * Reports how much memory is saved by keeping filters which are in
+     * several subscriptions once, both in JS and in the native index.
+     * Walks all filters, don't call it for every request.
+     * @return Counts and estimates of the saved memory.
+     */
+    virtual FilterDeduplicationStats GetFilterDeduplicationStats() const = 0;
+
+    /**
+     * Reports how much smaller the element hiding style sheets are in
+     * compact form, see
+     * `FilterEngineFactory::CreationParameters::compactStyleSheets`. Style
+     * sheets are counted when they are written, not when they are served
+     * from the cache.
+     * @return Totals since the engine was created, all 0 unless enabled.
+     */
+    virtual CompactStyleSheetStats GetCompactStyleSheetStats() const = 0;
+
+    /**
+     * Serializes the URL filters and the element hiding style sheets of all
+     * domains for the secondary processes of a multi-process host, see
+     * SharedFilterData::Attach(). Walks all filters, call it again after
+     * filter changes rather than for every process.
+     * @return Data to be put into a shared memory segment.
+     * @throw std::runtime_error if an element hiding filter has a wildcard
+     *        domain, its domains cannot be enumerated.
+     */
+    virtual std::vector<uint8_t> SerializeSharedFilterData() const = 0;
+
+    /**
+     * Converts the active URL filters into rules of the `declarativeNetRequest`
+     * API of Chrome, for a host which can match such rules in its network
+     * stack, and only needs to ask Matches() for the remaining requests. The
+     * sitekey and `$rewrite` filters, regular expressions and other filters
+     * which cannot be expressed as a rule are left out, so are generic
+     * blocking filters if a `$genericblock` filter exists.
+     *
+     * The rules are only converted again after filter changes. A filter
+     * keeps the `id` of its rule as long as it is active, so the rules which
+     * changed since the previous call can be passed to `updateDynamicRules()`.
+     * @return JSON array of rules, ordered by filter text.
+     */
+    virtual std::string GetDeclarativeNetRequestRules() const = 0;
+
+    /**
+     * Retrieves call counts and latencies of the methods which are called
+     * for every request or page load: Matches(), MatchesBatch(),
+     * GetMatchResult(), IsContentAllowlisted(), the
+     * `GetElementHiding...()` methods, GetSnippetScript(),
+     * ComposeFilterSuggestions() and ComposeFilterSuggestionsBatch(),
+     * including their `...Shared()` variants.
+     * A method which is called by another one is only accounted for the
+     * outer one.
+     * @return Snapshot of the statistics since the engine was created, only
+     *         containing the methods which were called.
+     */
+    virtual PerformanceStats GetPerformanceStats() const = 0;
+
+    /**
+     * While the `savestats` pref is set, the filters found by Matches(),
+     * MatchesBatch(), GetMatchResult() and IsContentAllowlisted() are
+     * counted natively and their hit counts are updated in batches, see
+     * `FilterEngineFactory::CreationParameters::filterHitsFlushInterval`.
+     * This updates them right away, e.g. before the app goes to the
+     * background.
+     */
+    virtual void FlushFilterHits() = 0;
+
+    /**
+     * Starts recording calls in the format of the `data/rec_*.log` files
+     * which `HarnessTest` replays, one JSON object per line: Matches() and
+     * GetMatchResult() as `check-filter-match`, or as `block-popup` for
+     * popups, GetElementHidingStyleSheet() and
+     * GetElementHidingDomainStyleSheet() as `generate-js-css`. The Chromium
+     * process and frame ids, which the engine doesn't know, are written as
+     * 0, and calls which don't pass a frame context get their document URL
+     * as the only referrer. A recording which is in progress is written and
+     * replaced by a new one.
+     * @param options Where to write and how many calls to record.
+     */
+    virtual void StartTraceRecording(const TraceRecordingOptions& options) = 0;
+
+    /**
+     * Stops recording calls and writes the file, which doesn't change
+     * before.
+     * @param callback Optional: called once the file is written, right away
+     *        if nothing was being recorded.
+     */
+    virtual void
+    StopTraceRecording(const TraceRecordingCallback& callback = TraceRecordingCallback()) = 0;
+
     /**
      * Retrieves CSS style sheet for all element hiding filters active on the
      * supplied domain.
@@ -240,6 +999,68 @@ namespace AdblockPlus
     virtual std::string GetElementHidingStyleSheet(const std::string& url,
                                                    bool specificOnly = false) const = 0;
 
+    /**
+     * Same as GetElementHidingStyleSheet(), but returns the style sheet which
+     * the engine keeps cached instead of a copy of it.
+     * @param url Url for the domain of which to retrieve CSS style sheet for.
+     * @param specificOnly true if generic filters should not apply.
+     * @return Immutable CSS style sheet, never `nullptr`.
+     */
+    virtual std::shared_ptr<const std::string>
+    GetElementHidingStyleSheetShared(const std::string& url, bool specificOnly = false) const = 0;
+
+    /**
+     * Retrieves the CSS style sheet for the element hiding filters which are
+     * active on every domain. Together with GetElementHidingDomainStyleSheet()
+     * it hides the same elements as GetElementHidingStyleSheet(), but it can be
+     * injected once and shared by all pages.
+     * @param[out] version Optional: receives a token which changes whenever the
+     *             returned style sheet changes, see
+     *             GetElementHidingGenericStyleSheetVersion().
+     * @return CSS style sheet, empty if there are no such filters.
+     */
+    virtual std::string GetElementHidingGenericStyleSheet(uint64_t* version = nullptr) const = 0;
+
+    /**
+     * Same as GetElementHidingGenericStyleSheet(), but without copying the
+     * style sheet.
+     * @param[out] version Optional: receives the version token.
+     * @return Immutable CSS style sheet, never `nullptr`.
+     */
+    virtual std::shared_ptr<const std::string>
+    GetElementHidingGenericStyleSheetShared(uint64_t* version = nullptr) const = 0;
+
+    /**
+     * Retrieves the version token of the style sheet returned by
+     * GetElementHidingGenericStyleSheet(), so that callers keeping a copy can
+     * check whether it is still current.
+     * @return Version token.
+     */
+    virtual uint64_t GetElementHidingGenericStyleSheetVersion() const = 0;
+
+    /**
+     * Retrieves the CSS style sheet for the element hiding filters active on
+     * the supplied domain which are not in the generic style sheet, see
+     * GetElementHidingGenericStyleSheet().
+     * @param url Url for the domain of which to retrieve CSS style sheet for.
+     * @param specificOnly true if generic filters should not apply, the
+     *        generic style sheet must not be injected then either.
+     * @return CSS style sheet or empty string if domain does not match available filters.
+     */
+    virtual std::string GetElementHidingDomainStyleSheet(const std::string& url,
+                                                         bool specificOnly = false) const = 0;
+
+    /**
+     * Same as GetElementHidingDomainStyleSheet(), but without copying the
+     * style sheet.
+     * @param url Url for the domain of which to retrieve CSS style sheet for.
+     * @param specificOnly true if generic filters should not apply.
+     * @return Immutable CSS style sheet, never `nullptr`.
+     */
+    virtual std::shared_ptr<const std::string>
+    GetElementHidingDomainStyleSheetShared(const std::string& url,
+                                           bool specificOnly = false) const = 0;
+
     /**
      * Retrieves CSS selectors for all element hiding emulation filters active on the
      * supplied domain.
@@ -251,8 +1072,90 @@ namespace AdblockPlus
     virtual std::vector<EmulationSelector>
     GetElementHidingEmulationSelectors(const std::string& url) const = 0;
 
+    /**
+     * Same as GetElementHidingEmulationSelectors(), but without copying the
+     * selectors.
+     * @param url Url for the domain of which to retrieve CSS selectors for.
+     * @return Immutable list of CSS selectors, never `nullptr`.
+     */
+    virtual std::shared_ptr<const std::vector<EmulationSelector>>
+    GetElementHidingEmulationSelectorsShared(const std::string& url) const = 0;
+
+    /**
+     * Callbacks of the `...Async()` methods. They are called on a thread of
+     * the filter engine, which executes the calls one after another, so they
+     * should return quickly. They may call the filter engine.
+     */
+    typedef std::function<void(const MatchResult&)> MatchResultCallback;
+    typedef std::function<void(bool)> AllowlistedCallback;
+    typedef std::function<void(const std::shared_ptr<const std::string>&)> StyleSheetCallback;
+    typedef std::function<void(const std::shared_ptr<const std::vector<EmulationSelector>>&)>
+        EmulationSelectorsCallback;
+
+    /**
+     * Asynchronous variant of GetMatchResult(), which doesn't block the
+     * calling thread while another one uses the JS engine. A request which
+     * is equal to one that is still queued is not matched again, both
+     * callbacks get the same result.
+     * @param request Request to match, see Matches().
+     * @param callback Receives the result.
+     */
+    virtual void MatchesAsync(const MatchRequest& request,
+                              const MatchResultCallback& callback) const = 0;
+
+    /**
+     * Asynchronous variant of IsContentAllowlisted(), equal queued requests
+     * are coalesced.
+     * @param callback Receives `true` iff the URL is allowlisted.
+     * @see IsContentAllowlisted()
+     */
+    virtual void IsContentAllowlistedAsync(const std::string& url,
+                                           ContentTypeMask contentTypeMask,
+                                           const std::vector<std::string>& documentUrls,
+                                           const std::string& sitekey,
+                                           const AllowlistedCallback& callback) const = 0;
+
+    /**
+     * Asynchronous variant of GetElementHidingStyleSheetShared(), equal
+     * queued requests are coalesced.
+     * @param callback Receives the style sheet, never `nullptr`.
+     * @see GetElementHidingStyleSheet()
+     */
+    virtual void GetElementHidingStyleSheetAsync(const std::string& url,
+                                                 bool specificOnly,
+                                                 const StyleSheetCallback& callback) const = 0;
+
+    /**
+     * Asynchronous variant of GetElementHidingEmulationSelectorsShared(),
+     * equal queued requests are coalesced.
+     * @param callback Receives the selectors, never `nullptr`.
+     * @see GetElementHidingEmulationSelectors()
+     */
+    virtual void
+    GetElementHidingEmulationSelectorsAsync(const std::string& url,
+                                            const EmulationSelectorsCallback& callback) const = 0;
+
+    /**
+     * Looks up everything a document needs on the thread of the
+     * `...Async()` methods, so that it is cached by the time it is asked
+     * for: the `$document`, `$elemhide` and `$generichide` allowlisting, the
+     * element hiding style sheet, the emulation selectors and the snippet
+     * scripts of the registered libraries. Call it as soon as a top-level
+     * navigation starts.
+     * @param url URL of the document.
+     * @param siteKey
+     *        Optional: public key provided by the document.
+     * @return Frame context of the document, see CreateFrameContext(). Its
+     *         allowlisting is looked up in the background too.
+     */
+    virtual std::shared_ptr<const FrameContext>
+    PrepareForDocument(const std::string& url, const std::string& siteKey = "") = 0;
+
     /**
      * Adds the observer to be notified on various events applying to filters and subscriptions.
+     * Observers are called without any lock of the filter engine held, so
+     * they may add and remove observers themselves; the change applies to
+     * the next event.
      *
      * @param observer Observer to add.
      * @see EventObserver
@@ -262,12 +1165,35 @@ namespace AdblockPlus
     virtual void AddEventObserver(EventObserver* observer) = 0;
 
     /**
-     * Removes the event observer.
+     * Removes the event observer. Waits for notifications which are in
+     * progress on other threads, so that the observer can be destroyed
+     * afterwards.
      *
      * @param observer the observer previously added with AddEventObserver()
      */
     virtual void RemoveEventObserver(EventObserver* observer) = 0;
 
+    /**
+     * Adds an observer which is notified on a dedicated thread, so that it
+     * never delays filter loading or matching. Events are queued with
+     * snapshots of the filter or subscription taken when they occurred.
+     *
+     * @param observer Observer to add.
+     * @param options Size of the queue and what happens when it is full.
+     */
+    virtual void
+    AddAsyncEventObserver(AsyncEventObserver* observer,
+                          const AsyncObserverOptions& options = AsyncObserverOptions()) = 0;
+
+    /**
+     * Removes an observer added with AddAsyncEventObserver(). Queued events
+     * are dropped, the call waits for the event which is being delivered. It
+     * must not be made by the observer itself.
+     *
+     * @param observer Observer to remove.
+     */
+    virtual void RemoveAsyncEventObserver(AsyncEventObserver* observer) = 0;
+
     /**
      * Stores the value indicating what connection types are allowed, it is
      * passed to CreateParameters::isConnectionAllowed callback.
@@ -308,6 +1234,17 @@ namespace AdblockPlus
      */
     virtual std::vector<std::string> ComposeFilterSuggestions(const IElement* element) const = 0;
 
+    /**
+     * Same as ComposeFilterSuggestions() for many elements, e.g. all the
+     * elements of a subtree picked by the user, at the cost of a single
+     * call into the JS engine. An element for which composing fails, e.g.
+     * because of an invalid document location, gets no suggestions.
+     * @param elements Target DOM elements.
+     * @return Suggested filters for each element, in the same order.
+     */
+    virtual std::vector<std::vector<std::string>>
+    ComposeFilterSuggestionsBatch(const std::vector<const IElement*>& elements) const = 0;
+
     /**
      * Adds this subscription to the list of subscriptions.
      */
@@ -328,6 +1265,50 @@ namespace AdblockPlus
      */
     virtual void RemoveFilter(const Filter& filter) = 0;
 
+    /**
+     * Adds several filters to the list of custom filters in one call, as a
+     * single update, see BeginUpdate(). Invalid filters are skipped.
+     * @param filters Filters to add.
+     */
+    virtual void AddFilters(const std::vector<Filter>& filters) = 0;
+
+    /**
+     * Removes several filters from the list of custom filters in one call,
+     * as a single update, see BeginUpdate(). Invalid filters are skipped.
+     * @param filters Filters to remove.
+     */
+    virtual void RemoveFilters(const std::vector<Filter>& filters) = 0;
+
+    /**
+     * Starts an update of filters and subscriptions. Until the matching
+     * CommitUpdate() call, filter and subscription events are held back and
+     * the filter storage is not saved, so that importing many filters costs
+     * one index rebuild and one save. Matching calls made during an update
+     * may or may not see the changes made so far. Updates can be nested,
+     * only the outermost CommitUpdate() takes effect.
+     */
+    virtual void BeginUpdate() = 0;
+
+    /**
+     * Finishes an update started with BeginUpdate(). Observers receive the
+     * held back events in the order they occurred and the filter storage is
+     * saved if it was changed.
+     */
+    virtual void CommitUpdate() = 0;
+
+    /**
+     * Locks the engine for the calling thread until the returned session is
+     * destroyed. The calls which that thread makes meanwhile reuse the lock
+     * instead of taking it one by one, and no other thread can use or change
+     * the engine in between, e.g. while matching a request, checking the
+     * allowlisting and getting the style sheet for one frame. Other threads
+     * wait for the session to end, so keep it short, and don't wait for
+     * asynchronous results or anything else which needs the engine while it
+     * exists. The session must be destroyed on the thread which created it.
+     * @return The session.
+     */
+    virtual std::unique_ptr<EngineSession> CreateEngineSession() const = 0;
+
     /**
      * Starts the subscription update timer. After some delay, it will check to see if there are any
      * outdated subscriptions. This check is performed regularly thereafter. For exact timeouts
@@ -359,6 +1340,62 @@ namespace AdblockPlus
                                          const std::string& injectedSource,
                                          const std::vector<std::string>& injectedList) = 0;
 
+    /**
+     * Same as GetSnippetScript(), but returns an immutable script which can
+     * be passed on without copying it.
+     * @param documentUrl url of the tab
+     * @param isolatedSource snippet library source for the isolated world.
+     * @param injectedSource snippet library source for the main world.
+     * @param injectedList names of the snippets from `injectedSource`.
+     * @return Script to inject, never `nullptr`.
+     */
+    virtual std::shared_ptr<const std::string>
+    GetSnippetScriptShared(const std::string& documentUrl,
+                           const std::string& isolatedSource,
+                           const std::string& injectedSource,
+                           const std::vector<std::string>& injectedList) = 0;
+
+    /**
+     * Passes a snippet library to the JS engine once, so that scripts can be
+     * compiled for it without converting its sources on every call.
+     * @param isolatedSource snippet library source for the isolated world.
+     * @param injectedSource snippet library source for the main world.
+     * @param injectedList names of the snippets from `injectedSource`.
+     * @return Handle to pass to GetSnippetScript().
+     */
+    virtual SnippetLibrary RegisterSnippetLibrary(const std::string& isolatedSource,
+                                                  const std::string& injectedSource,
+                                                  const std::vector<std::string>& injectedList) = 0;
+
+    /**
+     * Releases a snippet library registered with RegisterSnippetLibrary().
+     * @param library Handle of the library, unknown handles are ignored.
+     */
+    virtual void UnregisterSnippetLibrary(SnippetLibrary library) = 0;
+
+    /**
+     * Compiles the script to inject into a document with a registered snippet
+     * library, see the other overload. Results are cached per document host,
+     * see `FilterEngineFactory::CreationParameters::snippetScriptCacheSize`.
+     * @param documentUrl url of the tab
+     * @param library handle returned by RegisterSnippetLibrary().
+     * @return Script to inject, can be empty.
+     * @throw `std::invalid_argument` if the library is not registered.
+     */
+    virtual std::string GetSnippetScript(const std::string& documentUrl,
+                                         SnippetLibrary library) = 0;
+
+    /**
+     * Same as GetSnippetScript() with a registered library, but returns the
+     * cached script instead of a copy of it.
+     * @param documentUrl url of the tab
+     * @param library handle returned by RegisterSnippetLibrary().
+     * @return Script to inject, never `nullptr`.
+     * @throw `std::invalid_argument` if the library is not registered.
+     */
+    virtual std::shared_ptr<const std::string> GetSnippetScriptShared(const std::string& documentUrl,
+                                                                      SnippetLibrary library) = 0;
+
     /**
      * Retrieves the `ContentType` for the supplied string.
      * @param contentType Content type string.
@@ -17,7 +17,9 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <string>
 
 namespace AdblockPlus
 {
@@ -55,6 +57,15 @@ namespace AdblockPlus
 
     virtual bool operator==(const IFilterImplementation& filter) const = 0;
 
+    /**
+     * Hash of the filter, equal for filters which compare equal.
+     * @return Hash of the unparsed filter.
+     */
+    virtual size_t GetHash() const
+    {
+      return std::hash<std::string>()(GetRaw());
+    }
+
     virtual std::unique_ptr<IFilterImplementation> Clone() const = 0;
   };
 }
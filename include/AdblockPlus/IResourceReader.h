@@ -23,6 +23,8 @@
 #include <string>
 #include <vector>
 
+#include <AdblockPlus/IFileSystem.h>
+
 namespace AdblockPlus
 {
   class IPreloadedFilterResponse
@@ -64,6 +66,39 @@ namespace AdblockPlus
     std::string data;
   };
 
+  /**
+   * Filter list mapped into memory from a file, e.g. one bundled with the
+   * application. The mapping is handed to JS as an external string, so
+   * registering the list doesn't copy it, unless it contains non-ASCII
+   * characters which V8 has to convert.
+   */
+  class MappedPreloadedFilterResponse : public IPreloadedFilterResponse
+  {
+  public:
+    /**
+     * Maps a file. The file must be replaced rather than rewritten while
+     * the response is in use.
+     * @param path Path of the file.
+     * @throw std::runtime_error if the file cannot be opened or mapped.
+     */
+    explicit MappedPreloadedFilterResponse(const std::string& path);
+
+    /**
+     * Takes content which is already mapped, e.g. by IFileSystem::ReadView().
+     * exists will mean view.size != 0
+     */
+    explicit MappedPreloadedFilterResponse(IFileSystem::ContentView view);
+    MappedPreloadedFilterResponse(const MappedPreloadedFilterResponse&) = delete;
+    MappedPreloadedFilterResponse& operator=(const MappedPreloadedFilterResponse&) = delete;
+
+    bool exists() const override;
+    const char* content() const override;
+    size_t size() const override;
+
+  private:
+    IFileSystem::ContentView view;
+  };
+
   /**
    * Required to get an access to preloaded subscriptions.
    */
@@ -82,5 +117,17 @@ namespace AdblockPlus
      */
     virtual void ReadPreloadedFilterList(const std::string& url,
                                          const ReadCallback& doneCallback) const = 0;
+
+    /**
+     * Gives possibility for the embedder to provide the filter storage created
+     * by `abpprecompile` from the preloaded filter lists. It is installed on
+     * the first run, when there is no filter storage yet, so that the lists
+     * are not parsed again. The default implementation provides nothing.
+     * @param fileName `patterns.ini` or `patterns.ini.matcher`.
+     * @param doneCallback The function to be called on completion, with a
+     *        response which doesn't exist if there is no such file.
+     */
+    virtual void ReadPrecompiledFilterStorage(const std::string& fileName,
+                                              const ReadCallback& doneCallback) const;
   };
 }
@@ -17,12 +17,70 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
 
+#include <AdblockPlus/LatencyHistogram.h>
+
 namespace AdblockPlus
 {
+  /**
+   * Handle of a timer set by `ITimer::SetCancellableTimer()`. Copies refer to
+   * the same timer.
+   */
+  class TimerHandle
+  {
+  public:
+    /**
+     * Creates a handle which does not refer to any timer.
+     */
+    TimerHandle() = default;
+
+    /**
+     * Creates a handle of a pending timer, for `ITimer` implementations.
+     */
+    static TimerHandle Create();
+
+    /**
+     * Prevents the callback of the timer from being called.
+     * @return `true` if the timer was still pending.
+     */
+    bool Cancel() const;
+
+    /**
+     * @return `true` until the timer has fired or has been cancelled.
+     */
+    bool IsPending() const;
+
+    /**
+     * @return `true` if the timer has been cancelled before it fired.
+     */
+    bool IsCancelled() const;
+
+    /**
+     * To be called by `ITimer` implementations right before they call the
+     * callback of the timer.
+     * @return `false` if the timer was cancelled, then the callback must not
+     *         be called. Always `true` for a handle which does not refer to
+     *         any timer.
+     */
+    bool Fire() const;
+
+  private:
+    enum State
+    {
+      PENDING,
+      FIRED,
+      CANCELLED
+    };
+
+    std::shared_ptr<std::atomic<int>> state;
+  };
+
   /**
    * Timer manager interface.
    */
@@ -32,6 +90,31 @@ namespace AdblockPlus
      * Callback type invoked after elapsing of timer timeout.
      */
     typedef std::function<void()> TimerCallback;
+
+    /**
+     * Snapshot of the timer queue, see GetStats().
+     */
+    struct Stats
+    {
+      /**
+       * Number of timers which are neither fired nor cancelled.
+       */
+      size_t pendingTimers;
+      /**
+       * Number of times the timer woke up and called at least one callback.
+       */
+      uint64_t wakeups;
+      /**
+       * Time from when a timer is due until its callback is called,
+       * including the tolerance the timer was set with.
+       */
+      LatencyHistogram delay;
+      /**
+       * Time a callback takes to execute.
+       */
+      LatencyHistogram runTime;
+    };
+
     virtual ~ITimer()
     {
     }
@@ -43,6 +126,31 @@ namespace AdblockPlus
      */
     virtual void SetTimer(const std::chrono::milliseconds& timeout,
                           const TimerCallback& timerCallback) = 0;
+
+    /**
+     * Sets a timer which can be cancelled.
+     * The default implementation wraps SetTimer(), so a cancelled timer is
+     * only dropped once it is due.
+     * @param timeout A timer callback will be called after that interval.
+     * @param timerCallback The callback which is called after timeout.
+     * @param tolerance How much later than after `timeout` the callback may
+     *        be called. Allows the implementation to call the callbacks of
+     *        timers which are due at about the same time on a single wakeup.
+     * @return Handle to cancel the timer.
+     */
+    virtual TimerHandle
+    SetCancellableTimer(const std::chrono::milliseconds& timeout,
+                        const TimerCallback& timerCallback,
+                        const std::chrono::milliseconds& tolerance = std::chrono::milliseconds(0));
+
+    /**
+     * @return Current statistics of the timer. The default implementation
+     *         returns zeros.
+     */
+    virtual Stats GetStats()
+    {
+      return Stats{};
+    }
   };
 
   /**
@@ -99,6 +99,13 @@ namespace AdblockPlus
      * The parameter is the server response.
      */
     typedef std::function<void(const ServerResponse&)> RequestCallback;
+
+    /**
+     * Callback type invoked with a piece of the response body. The pieces
+     * are passed in order and before the `RequestCallback` is invoked.
+     */
+    typedef std::function<void(const char* data, size_t size)> DataCallback;
+
     virtual ~IWebRequest()
     {
     }
@@ -113,6 +120,21 @@ namespace AdblockPlus
                      const HeaderList& requestHeaders,
                      const RequestCallback& requestCallback) = 0;
 
+    /**
+     * Performs a GET request and passes the response body on in pieces as
+     * they arrive, `ServerResponse::responseText` stays empty. Implementations
+     * which can stream the body should override it, the default one
+     * performs a regular GET request and passes the whole body at once.
+     * @param url Request URL.
+     * @param requestHeaders Request headers.
+     * @param dataCallback to invoke with each piece of the response body.
+     * @param requestCallback to invoke when the server response is complete.
+     */
+    virtual void StreamGET(const std::string& url,
+                           const HeaderList& requestHeaders,
+                           const DataCallback& dataCallback,
+                           const RequestCallback& requestCallback);
+
     /**
      * Performs a HEAD request.
      * @param url Request URL.
@@ -0,0 +1,127 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace AdblockPlus
+{
+  /**
+   * Trade-off between speed and memory footprint of the engine.
+   */
+  enum class MemoryProfile
+  {
+    /**
+     * V8 and cache defaults.
+     */
+    DEFAULT,
+    /**
+     * For low-end devices: V8 runs without the optimizing compilers, the
+     * heap is capped, native caches are shrunk and filters of disabled
+     * subscriptions are loaded lazily. Matching gets slower in exchange for
+     * a considerably smaller resident footprint.
+     */
+    LOW_MEMORY
+  };
+
+  /**
+   * How badly the system needs memory, see Platform::NotifyMemoryPressure().
+   * On Android the `ComponentCallbacks2.onTrimMemory()` levels
+   * `TRIM_MEMORY_RUNNING_MODERATE`, `TRIM_MEMORY_RUNNING_LOW`,
+   * `TRIM_MEMORY_UI_HIDDEN` and `TRIM_MEMORY_BACKGROUND` map to `MODERATE`,
+   * `TRIM_MEMORY_RUNNING_CRITICAL`, `TRIM_MEMORY_MODERATE` and
+   * `TRIM_MEMORY_COMPLETE` to `CRITICAL`.
+   */
+  enum class MemoryPressureLevel
+  {
+    /**
+     * Native caches shrink to a fraction of their size, V8 collects garbage
+     * when it sees fit.
+     */
+    MODERATE,
+    /**
+     * Native caches are emptied and V8 collects garbage right away.
+     */
+    CRITICAL
+  };
+
+  /**
+   * Heap budget of the V8 isolate created by the JS engine. Sizes are in
+   * bytes, 0 leaves the V8 default in place.
+   */
+  struct JsHeapLimits
+  {
+    JsHeapLimits()
+        : initialOldGenerationSize(0), maxOldGenerationSize(0), initialYoungGenerationSize(0),
+          maxYoungGenerationSize(0)
+    {
+    }
+
+    size_t initialOldGenerationSize;
+    size_t maxOldGenerationSize;
+    size_t initialYoungGenerationSize;
+    size_t maxYoungGenerationSize;
+  };
+
+  /**
+   * Statistics of one V8 heap space, sizes are in bytes.
+   */
+  struct JsHeapSpaceStatistics
+  {
+    JsHeapSpaceStatistics() : size(0), usedSize(0), availableSize(0), physicalSize(0)
+    {
+    }
+
+    std::string name;
+    size_t size;
+    size_t usedSize;
+    size_t availableSize;
+    size_t physicalSize;
+  };
+
+  /**
+   * Statistics of the V8 heap of the JS engine, sizes are in bytes.
+   */
+  struct JsHeapStatistics
+  {
+    JsHeapStatistics()
+        : totalHeapSize(0), totalHeapSizeExecutable(0), totalPhysicalSize(0),
+          totalAvailableSize(0), usedHeapSize(0), heapSizeLimit(0), mallocedMemory(0),
+          externalMemory(0)
+    {
+    }
+
+    size_t totalHeapSize;
+    size_t totalHeapSizeExecutable;
+    size_t totalPhysicalSize;
+    size_t totalAvailableSize;
+    size_t usedHeapSize;
+    size_t heapSizeLimit;
+    /**
+     * Memory allocated by V8 outside of the heap.
+     */
+    size_t mallocedMemory;
+    /**
+     * Memory of external objects, e.g. array buffers, which V8 was told about.
+     */
+    size_t externalMemory;
+    std::vector<JsHeapSpaceStatistics> spaces;
+  };
+}
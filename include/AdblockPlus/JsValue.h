@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <stdint.h>
 #include <string>
@@ -38,6 +39,32 @@ namespace AdblockPlus
    */
   typedef std::vector<AdblockPlus::JsValue> JsValueList;
 
+  /**
+   * Fields of a single object or record passed to the visitor of
+   * JsValue::VisitObjects() and JsValue::VisitRecords(). The reader is only
+   * valid during the call of the visitor, the getters convert the field like
+   * the `JsValue` methods of the same name.
+   */
+  class JsFieldReader
+  {
+    friend class JsValue;
+
+  public:
+    size_t GetFieldCount() const;
+    bool IsNull(size_t index) const;
+    std::string AsString(size_t index) const;
+    int64_t AsInt(size_t index) const;
+    bool AsBool(size_t index) const;
+    double AsDouble(size_t index) const;
+
+  private:
+    JsFieldReader(v8::Isolate* isolate, v8::Local<v8::Context> context);
+
+    v8::Isolate* isolate_;
+    v8::Local<v8::Context> context_;
+    std::vector<v8::Local<v8::Value>> fields_;
+  };
+
   /**
    * Wrapper for JavaScript values.
    * See `JsEngine` for creating `JsValue` objects.
@@ -69,6 +96,56 @@ namespace AdblockPlus
     double AsDouble() const;
     JsValueList AsList() const;
 
+    /**
+     * Converts an array of strings without creating a `JsValue` per element.
+     * @return Elements converted like AsString() does it.
+     */
+    std::vector<std::string> AsStringVector() const;
+
+    /**
+     * Converts an array of numbers without creating a `JsValue` per element.
+     * @return Elements converted like AsInt() does it.
+     */
+    std::vector<int64_t> AsInt64Vector() const;
+
+    /**
+     * Field visitor of VisitObjects() and VisitRecords().
+     */
+    typedef std::function<void(const JsFieldReader& fields)> FieldVisitor;
+
+    /**
+     * Reads the given properties of each object in an array, in the order of
+     * `properties`.
+     * @param properties Names of the properties to read.
+     * @param visitor Called for each element.
+     */
+    void VisitObjects(const std::vector<std::string>& properties,
+                      const FieldVisitor& visitor) const;
+
+    /**
+     * Splits a flat array into records of `fieldCount` consecutive elements,
+     * an incomplete record at the end is ignored.
+     * @param fieldCount Number of elements per record.
+     * @param visitor Called for each record.
+     */
+    void VisitRecords(size_t fieldCount, const FieldVisitor& visitor) const;
+
+    /**
+     * Maps an array of objects to plain structures, see VisitObjects().
+     * @param properties Names of the properties to read.
+     * @param map Creates the structure from the fields of an element.
+     * @return One structure per element.
+     */
+    template<typename T>
+    std::vector<T> MapObjects(const std::vector<std::string>& properties,
+                              const std::function<T(const JsFieldReader&)>& map) const
+    {
+      std::vector<T> result;
+      VisitObjects(properties,
+                   [&result, &map](const JsFieldReader& fields) { result.push_back(map(fields)); });
+      return result;
+    }
+
     /**
      * Returns a list of property names if this is an object (see `IsObject()`).
      * @return List of property names.
@@ -0,0 +1,55 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace AdblockPlus
+{
+  /**
+   * Latency distribution with logarithmic buckets.
+   */
+  struct LatencyHistogram
+  {
+    /**
+     * Bucket 0 counts durations below one microsecond, bucket `i` the ones
+     * of at least 2^(i-1) and less than 2^i microseconds. The last bucket
+     * also counts everything longer.
+     */
+    static const size_t BUCKET_COUNT = 32;
+
+    std::array<uint64_t, BUCKET_COUNT> buckets;
+    uint64_t totalMicroseconds;
+    uint64_t maxMicroseconds;
+
+    /**
+     * @return Number of recorded durations.
+     */
+    uint64_t GetCount() const;
+
+    /**
+     * Estimates a percentile of the durations.
+     * @param percentile Percentile between 0 and 100, e.g. 99.
+     * @return Upper bound in microseconds of the bucket containing the
+     *         percentile, 0 if nothing was recorded.
+     */
+    uint64_t GetPercentile(double percentile) const;
+  };
+}
@@ -53,6 +53,29 @@ namespace AdblockPlus
      */
     virtual void
     operator()(LogLevel logLevel, const std::string& message, const std::string& source) = 0;
+
+    /**
+     * Messages below this level are dropped by the callers before they are
+     * formatted, e.g. the arguments of `console.log()` aren't even converted
+     * to strings. Everything is logged by default.
+     * @return Minimum log level.
+     */
+    virtual LogLevel GetMinLogLevel() const
+    {
+      return LOG_LEVEL_TRACE;
+    }
+
+    /**
+     * Receives a measure recorded by `performance.measure()` in JavaScript,
+     * e.g. by the profiler of adblockpluscore. Does nothing by default.
+     * @param name Name of the measure.
+     * @param startTime Start of the measure in milliseconds, relative to
+     *        the time the JavaScript `performance` object was created.
+     * @param duration Duration of the measure in milliseconds.
+     */
+    virtual void OnPerformanceMeasure(const std::string& name, double startTime, double duration)
+    {
+    }
   };
 
   /**
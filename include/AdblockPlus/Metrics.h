@@ -0,0 +1,87 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <AdblockPlus/IExecutor.h>
+#include <AdblockPlus/IFilterEngine.h>
+#include <AdblockPlus/ITimer.h>
+#include <AdblockPlus/JsHeap.h>
+#include <AdblockPlus/LatencyHistogram.h>
+
+namespace AdblockPlus
+{
+  /**
+   * Counters and histograms of all subsystems, collected at the same time,
+   * see Platform::GetMetrics().
+   */
+  struct MetricsSnapshot
+  {
+    MetricsSnapshot()
+        : timestamp(0), hasFilterEngine(false), matchCache(), styleSheetCache(), executor(),
+          timer(), webRequests()
+    {
+    }
+
+    /**
+     * Time of the snapshot in milliseconds since the epoch.
+     */
+    int64_t timestamp;
+    JsHeapStatistics heap;
+    /**
+     * Whether the filter engine was created, the fields below up to
+     * `apiCalls` are empty otherwise.
+     */
+    bool hasFilterEngine;
+    IFilterEngine::MatchCacheStats matchCache;
+    IFilterEngine::StyleSheetCacheStats styleSheetCache;
+    IFilterEngine::PerformanceStats apiCalls;
+    IExecutor::Stats executor;
+    ITimer::Stats timer;
+    /**
+     * Duration of the web requests of the JS code, i.e. of the filter list
+     * downloads and the synchronization requests.
+     */
+    LatencyHistogram webRequests;
+  };
+
+  /**
+   * Receives snapshots periodically, see Platform::SetMetricsObserver().
+   */
+  class MetricsObserver
+  {
+  public:
+    virtual ~MetricsObserver() = default;
+
+    /**
+     * Called on the thread of the timer.
+     * @param snapshot Current metrics.
+     */
+    virtual void OnMetrics(const MetricsSnapshot& snapshot) = 0;
+  };
+
+  /**
+   * Renders metrics in the OpenMetrics text format, e.g. to be served to a
+   * scraper. Metric names start with `abp_`, histograms have the buckets of
+   * `LatencyHistogram` in seconds.
+   * @param snapshot Metrics to render.
+   * @return Exposition ending with `# EOF`.
+   */
+  std::string FormatOpenMetrics(const MetricsSnapshot& snapshot);
+}
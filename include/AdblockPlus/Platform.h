@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <functional>
 #include <future>
 #include <memory>
@@ -30,7 +31,9 @@
 #include <AdblockPlus/IResourceReader.h>
 #include <AdblockPlus/ITimer.h>
 #include <AdblockPlus/IWebRequest.h>
+#include <AdblockPlus/JsHeap.h>
 #include <AdblockPlus/LogSystem.h>
+#include <AdblockPlus/Metrics.h>
 
 namespace AdblockPlus
 {
@@ -85,10 +88,54 @@ namespace AdblockPlus
      * a dead lock.
      */
     virtual IFilterEngine& GetFilterEngine() = 0;
+
+    /**
+     * Non-blocking equivalent of `GetFilterEngine`, e.g. for the UI thread,
+     * which uses a fallback policy of its own until the engine is ready.
+     * @return The filter engine or `nullptr` if it isn't created yet.
+     */
+    virtual IFilterEngine* TryGetFilterEngine() = 0;
+
+    /**
+     * Calls `callback` once IFilterEngine is ready for use, right away if
+     * it is already. Unlike the callback of `CreateFilterEngineAsync` it
+     * doesn't start creating the engine and any number of them can be
+     * added.
+     * @param callback Callback called on the thread which finished creating
+     *        the engine or on the calling one.
+     */
+    virtual void AddFilterEngineReadyCallback(const OnFilterEngineCreatedCallback& callback) = 0;
+
     virtual ITimer& GetTimer() const = 0;
     virtual IFileSystem& GetFileSystem() const = 0;
     virtual IWebRequest& GetWebRequest() const = 0;
     virtual LogSystem& GetLogSystem() const = 0;
     virtual IResourceReader& GetResourceReader() const = 0;
+
+    /**
+     * Collects the current metrics of the JS engine, the filter engine if it
+     * was created, the executor, the timer and the web requests.
+     */
+    virtual MetricsSnapshot GetMetrics() = 0;
+
+    /**
+     * Passes a snapshot of GetMetrics() to an observer every `interval`,
+     * replacing the previous observer. Snapshots are taken on the thread of
+     * the timer.
+     * @param observer Observer to call, nullptr stops the reports.
+     * @param interval Time between two snapshots.
+     */
+    virtual void SetMetricsObserver(std::shared_ptr<MetricsObserver> observer,
+                                    std::chrono::milliseconds interval) = 0;
+
+    /**
+     * Releases memory when the system runs low on it: V8 collects garbage
+     * and the native caches of the filter engine shrink or are emptied,
+     * depending on the level. They grow back as they are used. Does
+     * nothing before the JS engine is created.
+     * @param level Memory pressure level, e.g. mapped from the level passed
+     *        to `onTrimMemory()` on Android.
+     */
+    virtual void NotifyMemoryPressure(MemoryPressureLevel level) = 0;
   };
 }
@@ -17,8 +17,12 @@
 
 #pragma once
 
+#include <chrono>
+
 #include <AdblockPlus/IExecutor.h>
+#include <AdblockPlus/JsHeap.h>
 #include <AdblockPlus/Platform.h>
+#include <AdblockPlus/ThreadOptions.h>
 
 namespace AdblockPlus
 {
@@ -32,6 +36,13 @@ namespace AdblockPlus
      */
     struct CreationParameters
     {
+      CreationParameters()
+          : persistentCodeCache(false), memoryProfile(MemoryProfile::DEFAULT),
+            shutdownTimeout(std::chrono::milliseconds::max()), backgroundInitialization(false),
+            deferredJsValueRelease(false)
+      {
+      }
+
       LogSystemPtr logSystem;
       TimerPtr timer;
       WebRequestPtr webRequest;
@@ -46,6 +57,68 @@ namespace AdblockPlus
        * subsystems is not provided.
        */
       std::unique_ptr<IExecutor> executor;
+      /**
+       * Optional V8 code cache of the JavaScript files, as written by the
+       * `abpcodecache` tool for the same build. Saves parsing and compiling
+       * the scripts when the filter engine is created.
+       */
+      IFileSystem::IOBuffer codeCache;
+      /**
+       * Whether the V8 code cache of the JavaScript files is to be kept in
+       * the file system, so that only the first start after an update
+       * compiles them. It takes precedence over `codeCache` once written.
+       */
+      bool persistentCodeCache;
+      /**
+       * Optional heap budget of the JavaScript engine, only applied if
+       * Platform::SetUp() isn't passed an isolate provider.
+       */
+      JsHeapLimits heapLimits;
+      /**
+       * Memory profile of the JavaScript engine and the filter engine. With
+       * `MemoryProfile::LOW_MEMORY` the V8 flags and heap caps only apply if
+       * Platform::SetUp() isn't passed an isolate provider, limits set in
+       * `heapLimits` take precedence. The caches requested in
+       * FilterEngineFactory::CreationParameters are capped and filters of
+       * disabled subscriptions are loaded lazily.
+       * Default: MemoryProfile::DEFAULT
+       */
+      MemoryProfile memoryProfile;
+      /**
+       * How long the destructor of `Platform` waits for running tasks of the
+       * executor, see IExecutor::StopWithin(). Results of the tasks are
+       * dropped either way. By default it waits until they are finished.
+       */
+      std::chrono::milliseconds shutdownTimeout;
+      /**
+       * Whether the platform is to be set up and the filter engine created
+       * right away on a thread of the executor, with `appInfo` and
+       * `filterEngineParameters`, so that the caller's thread never spends
+       * time creating the V8 isolate and evaluating the scripts. Parameters
+       * passed later to Platform::SetUp() and
+       * Platform::CreateFilterEngineAsync() are ignored then, use
+       * Platform::TryGetFilterEngine() or
+       * Platform::AddFilterEngineReadyCallback() to find out when the engine
+       * is ready.
+       * Default: false
+       */
+      bool backgroundInitialization;
+      /**
+       * Information about the app for `backgroundInitialization`.
+       */
+      AppInfo appInfo;
+      /**
+       * Filter engine parameters for `backgroundInitialization`.
+       */
+      FilterEngineFactory::CreationParameters filterEngineParameters;
+      /**
+       * Whether `JsValue`, `Filter` and `Subscription` objects destroyed on
+       * a thread which isn't running JS code at the time are to be released
+       * by the next thread entering the JS engine, so that e.g. dropping a
+       * match result on a network thread never waits for the engine.
+       * Default: false
+       */
+      bool deferredJsValueRelease;
     };
 
     /**
@@ -55,6 +128,42 @@ namespace AdblockPlus
     static std::unique_ptr<Platform>
     CreatePlatform(CreationParameters&& parameters = CreationParameters());
 
+    /**
+     * Creates the default executor, which starts a new thread for each task.
+     */
     static std::unique_ptr<IExecutor> CreateExecutor();
+
+    /**
+     * Creates an executor which runs the tasks on a pool of reused threads,
+     * e.g. to be passed as `CreationParameters::executor`.
+     * @param maxConcurrency Maximum number of tasks executed at the same
+     *        time, further tasks wait in a queue. Tasks of the default
+     *        implementations don't wait for each other, so any value of at
+     *        least one works with them.
+     */
+    static std::unique_ptr<IExecutor> CreateExecutor(size_t maxConcurrency);
+
+    /**
+     * Same as CreateExecutor(maxConcurrency), but with scheduling settings
+     * for the threads of the pool. They run the downloads and the parsing
+     * of the downloaded filter lists, i.e. the background work, so
+     * `ThreadOptions::Priority::BACKGROUND` and the little cores of a
+     * big.LITTLE system are the typical choice, see also
+     * `FilterEngineFactory::CreationParameters::asyncCallThread`.
+     */
+    static std::unique_ptr<IExecutor> CreateExecutor(size_t maxConcurrency,
+                                                     const ThreadOptions& threadOptions);
+
+    /**
+     * Wraps a log system so that messages are passed to it on a thread of
+     * its own, e.g. to be passed as `CreationParameters::logSystem` when
+     * writing the messages is slow. The messages wait in a ring buffer, if
+     * it is full the oldest ones are dropped and a warning says how many.
+     * Pending messages are written when the returned instance is destroyed.
+     * @param logSystem Log system to write the messages, its minimum log
+     *        level applies.
+     * @param bufferSize Maximum number of pending messages.
+     */
+    static LogSystemPtr CreateAsyncLogSystem(LogSystemPtr logSystem, size_t bufferSize = 1024);
   };
 }
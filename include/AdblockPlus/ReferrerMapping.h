@@ -17,9 +17,11 @@
 
 #pragma once
 
-#include <list>
-#include <map>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace AdblockPlus
@@ -38,11 +40,19 @@ namespace AdblockPlus
      * @param maxCachedUrls Number of URL mappings to store. The higher the
      *        better - clients typically cache requests, and a single cached
      *        request will break the referrer chain.
+     * @param threadSafe Whether Add() and BuildReferrerChain() may be called
+     *        concurrently, e.g. from the network thread and while matching.
+     *        Without it the caller is responsible for locking.
      */
-    ReferrerMapping(const int maxCachedUrls = 5000);
+    ReferrerMapping(const int maxCachedUrls = 5000, bool threadSafe = false);
+
+    ReferrerMapping(const ReferrerMapping&) = delete;
+    ReferrerMapping& operator=(const ReferrerMapping&) = delete;
 
     /**
-     * Records the refferer for a URL.
+     * Records the refferer for a URL. Recording a URL again replaces its
+     * referrer and makes it the most recently recorded one, when the
+     * mapping is full the least recently recorded URL is dropped.
      * @param url Request URL.
      * @param referrer Request referrer.
      */
@@ -57,8 +67,49 @@ namespace AdblockPlus
     std::vector<std::string> BuildReferrerChain(const std::string& url) const;
 
   private:
-    const int maxCachedUrls;
-    std::map<std::string, std::string> mapping;
-    std::list<std::string> cachedUrls;
+    typedef std::shared_ptr<const std::string> SharedString;
+
+    // Frames issue many requests, so the same referrer is kept only once:
+    // a referrer which is a recorded URL itself shares the string of that
+    // entry.
+    struct Entry
+    {
+      SharedString url;
+      SharedString referrer;
+      // Neighbours in the order of recording, `older` of the oldest one is
+      // `nullptr`.
+      Entry* older = nullptr;
+      Entry* newer = nullptr;
+    };
+
+    struct StringPtrHash
+    {
+      size_t operator()(const std::string* str) const
+      {
+        return std::hash<std::string>()(*str);
+      }
+    };
+
+    struct StringPtrEqual
+    {
+      bool operator()(const std::string* a, const std::string* b) const
+      {
+        return *a == *b;
+      }
+    };
+
+    SharedString Intern(const std::string& str) const;
+    void Unlink(Entry* entry);
+    void Append(Entry* entry);
+
+    const size_t maxCachedUrls;
+    const bool threadSafe;
+    mutable std::mutex mutex;
+    // Keyed by `Entry::url`, which outlives the key.
+    std::unordered_map<const std::string*, std::unique_ptr<Entry>, StringPtrHash, StringPtrEqual>
+        mapping;
+    Entry* oldest = nullptr;
+    Entry* newest = nullptr;
+    SharedString emptyString;
   };
 }
@@ -0,0 +1,125 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <AdblockPlus/IFilterEngine.h>
+
+namespace AdblockPlus
+{
+  class NativeMatcher;
+
+  /**
+   * Read-only filter data for the secondary processes of a multi-process
+   * host, which answer requests and element hiding queries without a
+   * `Platform` or JS engine of their own.
+   *
+   * The primary process writes the data with
+   * IFilterEngine::SerializeSharedFilterData() into a shared memory segment,
+   * the host takes care of mapping it into the other processes and of
+   * replacing it after filter changes. The element hiding style sheets are
+   * read from the segment in place, only the URL filter index is built in
+   * the memory of each process.
+   *
+   * The methods are thread safe.
+   */
+  class SharedFilterData
+  {
+  public:
+    enum class Result
+    {
+      NO_MATCH,
+      MATCH,
+      UNKNOWN
+    };
+
+    ~SharedFilterData();
+
+    /**
+     * Attaches to data written by IFilterEngine::SerializeSharedFilterData().
+     * @param data Start of the data, it has to stay mapped as long as the
+     *        returned instance exists.
+     * @param size Size of the data in bytes.
+     * @return nullptr if the data is corrupt or was written by another
+     *         version.
+     */
+    static std::unique_ptr<SharedFilterData> Attach(const uint8_t* data, size_t size);
+
+    /**
+     * Looks up a URL filter matching the request, see IFilterEngine::Matches().
+     * @param url Request URL.
+     * @param contentTypeMask Content type mask of the request.
+     * @param documentUrl URL of the document which issued the request.
+     * @param specificOnly Whether generic blocking filters are to be skipped.
+     * @param[out] filterText Text of the matching filter, starting with `@@`
+     *             for allowlisting ones. Only set if `Result::MATCH` is
+     *             returned.
+     * @return `Result::UNKNOWN` if the request may be matched by a filter
+     *         which only the JS engine can evaluate, the request is to be
+     *         passed on to the primary process then.
+     */
+    Result Match(const std::string& url,
+                 IFilterEngine::ContentTypeMask contentTypeMask,
+                 const std::string& documentUrl,
+                 bool specificOnly,
+                 std::string* filterText) const;
+
+    /**
+     * Same as IFilterEngine::GetElementHidingStyleSheet(), the selectors are
+     * grouped differently, but the same elements are hidden.
+     * @param domain Domain name or URL of the document.
+     * @param specificOnly Whether only domain specific selectors are to be
+     *        included.
+     * @return Style sheet.
+     */
+    std::string GetElementHidingStyleSheet(const std::string& domain,
+                                           bool specificOnly = false) const;
+
+  private:
+    // Offsets and lengths of strings in the data.
+    struct DomainEntry
+    {
+      uint32_t domainOffset;
+      uint32_t domainLength;
+      uint32_t domainStyleSheetOffset;
+      uint32_t domainStyleSheetLength;
+      uint32_t specificStyleSheetOffset;
+      uint32_t specificStyleSheetLength;
+    };
+
+    SharedFilterData();
+
+    DomainEntry ReadDomainEntry(uint32_t index) const;
+    // Looks up the longest parent domain of `host` which has style sheets.
+    bool FindDomain(const std::string& host, DomainEntry* entry) const;
+    std::string ReadString(uint32_t offset, uint32_t length) const;
+
+    std::unique_ptr<NativeMatcher> matcher_;
+    const uint8_t* data_;
+    size_t size_;
+    uint32_t genericOffset_;
+    uint32_t genericLength_;
+    uint32_t defaultOffset_;
+    uint32_t defaultLength_;
+    uint32_t domainCount_;
+    size_t domainTableOffset_;
+  };
+}
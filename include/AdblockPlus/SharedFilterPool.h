@@ -0,0 +1,57 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+namespace AdblockPlus
+{
+  class NativeFilterPool;
+
+  /**
+   * Natively parsed URL filters shared by several filter engines in one
+   * process, e.g. one per browser profile, see
+   * FilterEngineFactory::CreationParameters::sharedFilterPool.
+   *
+   * Each filter engine keeps its own JS engine, subscriptions, custom
+   * filters and prefs, only the parsed form of the filters which the
+   * engines have in common, typically the ones of the same filter lists, is
+   * stored once. A filter is dropped from the pool once no engine has it
+   * anymore.
+   *
+   * The methods are thread safe.
+   */
+  class SharedFilterPool
+  {
+    friend class DefaultFilterEngine;
+
+  public:
+    SharedFilterPool();
+    ~SharedFilterPool();
+    SharedFilterPool(const SharedFilterPool&) = delete;
+    SharedFilterPool& operator=(const SharedFilterPool&) = delete;
+
+    /**
+     * @return Number of filters which at least one filter engine has.
+     */
+    size_t GetFilterCount() const;
+
+  private:
+    std::unique_ptr<NativeFilterPool> pool_;
+  };
+}
@@ -0,0 +1,70 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace AdblockPlus
+{
+  /**
+   * Scheduling settings of a thread started by the library, applied as far
+   * as the system and the permissions of the process allow.
+   */
+  struct ThreadOptions
+  {
+    /**
+     * What the OS is told about the work of the thread.
+     */
+    enum class Priority
+    {
+      /**
+       * Inherited from the thread which started it.
+       */
+      DEFAULT,
+      /**
+       * Latency-critical work, e.g. matching requests of a page load: the
+       * `USER_INTERACTIVE` QoS class on Apple platforms, a nice value of -4
+       * (`THREAD_PRIORITY_DISPLAY` on Android) on Linux, above normal on
+       * Windows.
+       */
+      INTERACTIVE,
+      /**
+       * Work nobody waits for, e.g. parsing a downloaded filter list: the
+       * `UTILITY` QoS class on Apple platforms, a nice value of 10
+       * (`THREAD_PRIORITY_BACKGROUND` on Android) on Linux, below normal on
+       * Windows.
+       */
+      BACKGROUND
+    };
+
+    ThreadOptions() : priority(Priority::DEFAULT)
+    {
+    }
+
+    Priority priority;
+
+    /**
+     * Indices of the CPUs which the thread may run on, e.g. the big cores
+     * of a big.LITTLE system, empty for any. Ignored on Apple platforms,
+     * which don't support affinities.
+     */
+    std::vector<size_t> cpus;
+  };
+}
@@ -0,0 +1,93 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace AdblockPlus
+{
+  /**
+   * Parts of a URL which the filter engine uses for matching, extracted the
+   * same way as the JS code does it. Parse a URL once per request and reuse
+   * the result instead of extracting the host again and again.
+   */
+  class URLInfo
+  {
+  public:
+    /**
+     * Creates an invalid instance, see IsValid().
+     */
+    URLInfo();
+
+    /**
+     * Parses a URL.
+     * @param url URL to parse, UTF-8 encoded.
+     * @return Parsed URL, invalid if `url` has no scheme or no host, or if
+     *         the host cannot be converted to ASCII.
+     */
+    static URLInfo Parse(const std::string& url);
+
+    /**
+     * Extracts the host part of a URL, without converting it to ASCII.
+     * @param url URL to extract the host from, UTF-8 encoded.
+     * @return Host or an empty string for invalid URLs.
+     */
+    static std::string ExtractHost(const std::string& url);
+
+    /**
+     * Converts a host name to its ASCII form, encoding the labels which
+     * contain non-ASCII characters with Punycode, see RFC 3492.
+     * @param host UTF-8 encoded host name.
+     * @param[out] asciiHost Receives the converted host name.
+     * @return `false` if the host name cannot be encoded.
+     */
+    static bool HostToASCII(const std::string& host, std::string* asciiHost);
+
+    /**
+     * @return `true` if the URL could be parsed.
+     */
+    bool IsValid() const;
+
+    /**
+     * @return The URL as passed to Parse().
+     */
+    const std::string& GetHref() const;
+
+    /**
+     * @return Lower-cased scheme followed by a colon, e.g. `https:`.
+     */
+    const std::string& GetProtocol() const;
+
+    /**
+     * @return Host as it appears in the URL, e.g. `www.bücher.de`.
+     */
+    const std::string& GetHost() const;
+
+    /**
+     * @return ASCII form of the host, e.g. `www.xn--bcher-kva.de`.
+     */
+    const std::string& GetHostname() const;
+
+  private:
+    bool valid;
+    std::string href;
+    std::string protocol;
+    std::string host;
+    std::string hostname;
+  };
+}
@@ -19,43 +19,241 @@
 
 let API = (() =>
 {
-  const {Filter} = require("filterClasses");
+  const {Filter, RegExpFilter, ContentFilter, ElemHideFilter} = require("filterClasses");
   const {Subscription} = require("subscriptionClasses");
   const {SpecialSubscription, DownloadableSubscription} = require("subscriptionClasses");
   const {filterStorage} = require("filterStorage");
+  const {filterState} = require("filterState");
   const {defaultMatcher} = require("matcher");
-  const {elemHide} = require("elemHide");
+  const {elemHide, createStyleSheet} = require("elemHide");
+  const {elemHideExceptions} = require("elemHideExceptions");
+  const {filterNotifier} = require("filterNotifier");
   const {elemHideEmulation} = require("elemHideEmulation");
   const {synchronizer} = require("synchronizer");
   const {Prefs} = require("prefs");
   const {visibleRecommendations} = require("recommendations");
-  const SignatureVerifier = require("rsa");
   const {parseURL} = require("url");
   const {composeFilterSuggestions} = require("compose");
   const {registerSubscription} = require("init");
+  const {beginUpdate, commitUpdate} = require("filterUpdateRegistration");
   const {snippets, compileScript} = require("snippets");
 
-  function getURLInfo(url)
+  function makeURLInfo(href, protocol, hostname)
   {
     // Parse the minimum URL to get a URLInfo instance.
     let urlInfo = parseURL("http://a.com/");
 
+    // Note: There is currently no way to update the URLInfo object other
+    // than to set the private properties directly.
+    urlInfo._href = href;
+    urlInfo._protocol = protocol;
+    urlInfo._hostname = hostname;
+    return urlInfo;
+  }
+
+  function getURLInfo(url)
+  {
     try
     {
       let uri = new URI(url);
-
-      // Note: There is currently no way to update the URLInfo object other
-      // than to set the private properties directly.
-      urlInfo._href = url;
-      urlInfo._protocol = uri.scheme + ":";
-      urlInfo._hostname = uri.asciiHost;
+      return makeURLInfo(url, uri.scheme + ":", uri.asciiHost);
     }
     catch (error)
     {
-      urlInfo = null;
+      return null;
     }
+  }
 
-    return urlInfo;
+  // Selectors of the element hiding filters which apply on every domain and
+  // the text of the custom filters, collected on demand.
+  let unconditionalSelectors = null;
+  let listedFilterText = null;
+
+  for (let event of ["load", "filter.added", "filter.removed", "filter.disabled",
+                     "filter.moved", "subscription.added", "subscription.removed",
+                     "subscription.disabled", "subscription.updated"])
+  {
+    filterNotifier.on(event, () =>
+    {
+      unconditionalSelectors = null;
+      listedFilterText = null;
+    });
+  }
+
+  function getListedFilterText()
+  {
+    if (!listedFilterText)
+    {
+      let filterText = new Set();
+      for (let subscription of filterStorage.subscriptions())
+      {
+        if (subscription instanceof SpecialSubscription)
+        {
+          for (let text of subscription.filterText())
+            filterText.add(text);
+        }
+      }
+      listedFilterText = [...filterText];
+    }
+    return listedFilterText;
+  }
+
+  function getListedSubscriptions()
+  {
+    let subscriptions = [];
+    for (let subscription of filterStorage.subscriptions())
+    {
+      if (!(subscription instanceof SpecialSubscription))
+        subscriptions.push(subscription);
+    }
+    return subscriptions;
+  }
+
+  function getRecommendedSubscriptions()
+  {
+    let result = [];
+    for (let {url, title, homepage, languages} of visibleRecommendations())
+    {
+      let subscription = Subscription.fromURL(url);
+      subscription.title = title;
+      subscription.homepage = homepage;
+
+      // This isn't normally a property of a Subscription object
+      if (languages.length > 0)
+        subscription.prefixes = languages.join(",");
+
+      result.push(subscription);
+    }
+    return result;
+  }
+
+  // The fields of IFilterEngine::SubscriptionInfo, in the order in which
+  // DefaultFilterEngine reads them.
+  function getSubscriptionInfoFields(subscription)
+  {
+    return [
+      subscription.url,
+      subscription.title || "",
+      subscription.homepage || "",
+      subscription.author || "",
+      subscription.prefixes || "",
+      subscription.filterCount || 0,
+      subscription.downloadStatus || "",
+      subscription.lastDownload || 0,
+      subscription.lastSuccess || 0,
+      subscription.version || 0,
+      !!subscription.disabled,
+      synchronizer.isExecuting(subscription.url),
+      subscription.url === Prefs.subscriptions_exceptionsurl
+    ];
+  }
+
+  // Flattens the fields of several subscriptions into a single list.
+  function getSubscriptionInfo(subscriptions, offset, limit)
+  {
+    let result = [];
+    for (let subscription of subscriptions.slice(offset, offset + limit))
+      result.push(...getSubscriptionInfoFields(subscription));
+    return result;
+  }
+
+  function getUnconditionalSelectors()
+  {
+    if (!unconditionalSelectors)
+    {
+      unconditionalSelectors = new Set();
+      for (let subscription of filterStorage.subscriptions())
+      {
+        if (subscription.disabled)
+          continue;
+
+        for (let text of subscription.filterText())
+        {
+          let filter = Filter.fromText(text);
+          if (filter instanceof ElemHideFilter && !filter.domains &&
+              filterState.isEnabled(text) &&
+              !elemHideExceptions.hasExceptions(filter.selector))
+            unconditionalSelectors.add(filter.selector);
+        }
+      }
+    }
+    return unconditionalSelectors;
+  }
+
+  // Style sheets written in compact form, see
+  // FilterEngineFactory::CreationParameters::compactStyleSheets, their
+  // total size and the bytes saved compared to createStyleSheet().
+  let compactStyleSheetStats = {count: 0, size: 0, savedSize: 0};
+
+  // createStyleSheet() writes one rule per selector, so that an invalid
+  // selector doesn't take others along, the compact form keeps that.
+  const ruleSuffix = " {display: none !important;}\n";
+  const compactRuleSuffix = "{display:none!important}";
+
+  // Whether another selector hides all elements which `selector` hides, e.g.
+  // ".ad" for "div.ad" or "#main .ad". Selectors with attributes, pseudo
+  // classes, strings or escapes are taken as they are.
+  function isSubsumed(selector, selectors, covering)
+  {
+    if (/["'()[\]\\:,@]/.test(selector))
+      return false;
+
+    let compound = selector.split(/[\s>+~]+/).pop();
+    let match = /^([a-zA-Z][\w-]*)?((?:[.#][\w-]+)*)$/.exec(compound);
+    if (!match)
+      return false;
+
+    let candidates = match[2].match(/[.#][\w-]+/g) || [];
+    if (match[1])
+      candidates.push(match[1]);
+    if (compound != selector)
+      candidates.push(compound);
+    return candidates.some(candidate => candidate != selector &&
+                           (selectors.has(candidate) ||
+                            (covering && covering.has(candidate))));
+  }
+
+  // Same as createStyleSheet(), but without duplicates, selectors subsumed
+  // by others of the same style sheet or of `covering`, which the page gets
+  // along, and optional whitespace.
+  function createCompactStyleSheet(selectors, covering)
+  {
+    let unique = new Set(selectors);
+    let styleSheet = "";
+    let originalSize = 0;
+    for (let selector of selectors)
+      originalSize += selector.length + ruleSuffix.length;
+    for (let selector of unique)
+    {
+      if (!isSubsumed(selector, unique, covering))
+        styleSheet += selector + compactRuleSuffix;
+    }
+
+    compactStyleSheetStats.count++;
+    compactStyleSheetStats.size += styleSheet.length;
+    compactStyleSheetStats.savedSize += originalSize - styleSheet.length;
+    return styleSheet;
+  }
+
+  function createElementHidingStyleSheet(selectors, covering = null)
+  {
+    if (typeof _compactStyleSheets != "undefined" && _compactStyleSheets)
+      return createCompactStyleSheet(selectors, covering);
+    return createStyleSheet(selectors);
+  }
+
+  // Snippet libraries passed by registerSnippetLibrary(), by handle.
+  let snippetLibraries = new Map();
+
+  function getSnippetsScript(documentUrl, isolatedSrc, injectedSrc, injectedList)
+  {
+    let documentHost = extractHostFromURL(documentUrl);
+    let scripts = snippets.getFilters(documentHost).map(it => it.script);
+
+    if (!scripts.length)
+      return "";
+
+    return compileScript(scripts, isolatedSrc, injectedSrc, injectedList, {});
   }
 
   return {
@@ -77,18 +275,89 @@ let API = (() =>
       filterStorage.removeFilter(filter);
     },
 
-    getListedFilters()
+    addFiltersToList(filters)
     {
-      let filterText = new Set();
-      for (let subscription of filterStorage.subscriptions())
+      beginUpdate();
+      try
       {
-        if (subscription instanceof SpecialSubscription)
+        for (let filter of filters)
+          filterStorage.addFilter(filter);
+      }
+      finally
+      {
+        commitUpdate();
+      }
+    },
+
+    removeFiltersFromList(filters)
+    {
+      beginUpdate();
+      try
+      {
+        for (let filter of filters)
+          filterStorage.removeFilter(filter);
+      }
+      finally
+      {
+        commitUpdate();
+      }
+    },
+
+    beginUpdate,
+
+    commitUpdate,
+
+    addFilterHits(packedHits)
+    {
+      // Lines of hit count, time of the last hit and filter text, see
+      // HitCounter.h.
+      let lines = packedHits.split("\n");
+      beginUpdate();
+      try
+      {
+        for (let i = 0; i + 2 < lines.length; i += 3)
         {
-          for (let text of subscription.filterText())
-            filterText.add(text);
+          let count = parseInt(lines[i], 10);
+          let lastHit = parseInt(lines[i + 1], 10);
+          let text = lines[i + 2];
+          if (typeof filterState.setHitCount == "function")
+          {
+            filterState.setHitCount(text, filterState.getHitCount(text) + count);
+            filterState.setLastHit(text,
+                                   Math.max(filterState.getLastHit(text), lastHit));
+          }
+          else
+          {
+            let filter = Filter.fromText(text);
+            if ("hitCount" in filter)
+            {
+              filter.hitCount += count;
+              filter.lastHit = Math.max(filter.lastHit, lastHit);
+            }
+          }
         }
       }
-      return [...filterText].map(Filter.fromText);
+      finally
+      {
+        commitUpdate();
+      }
+    },
+
+    getListedFilters()
+    {
+      return getListedFilterText().map(Filter.fromText);
+    },
+
+    getListedFilterCount()
+    {
+      return getListedFilterText().length;
+    },
+
+    getPackedListedFilters(offset, limit)
+    {
+      return getListedFilterText().slice(offset, offset + limit).map(
+        text => Filter.fromText(text).constructor.name + "\n" + text
+      ).join("\n");
     },
 
     getSubscriptionFromUrl(url)
@@ -107,6 +376,19 @@ let API = (() =>
       return result;
     },
 
+    getSubscriptionFilters()
+    {
+      let result = [];
+      for (let subscription of filterStorage.subscriptions())
+        result.push([subscription.url, ...subscription.filterText()].join("\n"));
+      return result;
+    },
+
+    getSubscriptionFilterText(subscription)
+    {
+      return [...subscription.filterText()].join("\n");
+    },
+
     addSubscriptionToList(subscription)
     {
       registerSubscription(subscription).catch(e => { throw e; });
@@ -128,33 +410,35 @@ let API = (() =>
       return synchronizer.isExecuting(subscription.url);
     },
 
-    getListedSubscriptions()
+    getListedSubscriptions,
+
+    getSubscriptionInfo: getSubscriptionInfoFields,
+
+    getListedSubscriptionCount()
     {
-      let subscriptions = [];
-      for (let subscription of filterStorage.subscriptions())
-      {
-        if (!(subscription instanceof SpecialSubscription))
-          subscriptions.push(subscription);
-      }
-      return subscriptions;
+      return getListedSubscriptions().length;
     },
 
-    getRecommendedSubscriptions()
+    getListedSubscriptionInfo(offset, limit)
     {
-      let result = [];
-      for (let {url, title, homepage, languages} of visibleRecommendations())
-      {
-        let subscription = Subscription.fromURL(url);
-        subscription.title = title;
-        subscription.homepage = homepage;
+      return getSubscriptionInfo(getListedSubscriptions(), offset, limit);
+    },
 
-        // This isn't normally a property of a Subscription object
-        if (languages.length > 0)
-          subscription.prefixes = languages.join(",");
+    getRecommendedSubscriptions,
 
-        result.push(subscription);
-      }
-      return result;
+    getRecommendations()
+    {
+      return [...visibleRecommendations()].map(
+        ({url, title, homepage, type, languages}) => ({
+          url, title: title || "", homepage: homepage || "", type: type || "",
+          languages: languages.join(",")
+        })
+      );
+    },
+
+    getRecommendedSubscriptionInfo(offset, limit)
+    {
+      return getSubscriptionInfo(getRecommendedSubscriptions(), offset, limit);
     },
 
     isAASubscription(subscription)
@@ -217,10 +501,189 @@ let API = (() =>
                                   siteKey, specificOnly);
     },
 
+    // Same as checkFilterMatch() but with the URLs already parsed by the
+    // native URLInfo class, so that neither URI nor punycode are needed.
+    checkParsedFilterMatch(href, protocol, hostname, contentTypeMask,
+                           documentHost, siteKey, specificOnly)
+    {
+      return defaultMatcher.match(makeURLInfo(href, protocol, hostname),
+                                  contentTypeMask >>> 0, documentHost,
+                                  siteKey, specificOnly);
+    },
+
+    checkFilterMatches(requests)
+    {
+      return requests.map(({href, protocol, hostname, contentTypeMask,
+                            documentHost, siteKey, specificOnly}) =>
+        API.checkParsedFilterMatch(href, protocol, hostname, contentTypeMask,
+                                   documentHost, siteKey, specificOnly));
+    },
+
+    // Same as WebExt's frame walk: every frame is checked against its parent,
+    // the top-level one against itself. The frames are parsed natively like
+    // for checkParsedFilterMatch(), invalid ones are false. Returns the first
+    // match along with the index of the frame which it was found for.
+    checkAllowlistingMatch(frames, contentTypeMask, siteKey)
+    {
+      for (let i = 0; i < frames.length; i++)
+      {
+        let frame = frames[i];
+        if (!frame)
+          continue;
+        let filter = API.checkParsedFilterMatch(
+          frame.href, frame.protocol, frame.hostname, contentTypeMask,
+          frame.documentHost, siteKey, false
+        );
+        if (filter)
+          return {index: i, filter};
+      }
+      return null;
+    },
+
+    // Mirrors filterListener: URL filters which are enabled and belong to at
+    // least one enabled subscription end up in defaultMatcher.
+    isActiveURLFilter(text)
+    {
+      if (!filterState.isEnabled(text) ||
+          !(Filter.fromText(text) instanceof RegExpFilter))
+        return false;
+
+      for (let subscription of filterStorage.subscriptions(text))
+      {
+        if (!subscription.disabled)
+          return true;
+      }
+      return false;
+    },
+
+    getActiveURLFilters()
+    {
+      let filterText = new Set();
+      for (let subscription of filterStorage.subscriptions())
+      {
+        if (subscription.disabled)
+          continue;
+
+        for (let text of subscription.filterText())
+        {
+          if (!filterText.has(text) && filterState.isEnabled(text) &&
+              Filter.fromText(text) instanceof RegExpFilter)
+            filterText.add(text);
+        }
+      }
+      return [...filterText];
+    },
+
+    // Domains of the active element hiding, element hiding emulation and
+    // snippet filters, one line each per type for ContentFilterDomains. A
+    // "*" stands for filters which apply on other or wildcard domains too.
+    getContentFilterDomains()
+    {
+      let types = ["elemhide", "elemhideemulation", "snippet"];
+      let domains = types.map(() => new Set());
+      for (let subscription of filterStorage.subscriptions())
+      {
+        if (subscription.disabled)
+          continue;
+
+        for (let text of subscription.filterText())
+        {
+          let filter = Filter.fromText(text);
+          let index = types.indexOf(filter.type);
+          if (index == -1 || !(filter instanceof ContentFilter) ||
+              !filterState.isEnabled(text))
+            continue;
+
+          if (!filter.domains)
+          {
+            domains[index].add("*");
+            continue;
+          }
+          for (let [domain, include] of filter.domains)
+          {
+            if (include)
+              domains[index].add(domain == "" || domain.includes("*") ? "*" : domain);
+          }
+        }
+      }
+      return domains.map(set => [...set].join("\n"));
+    },
+
     getElementHidingStyleSheet(url, specificOnly)
     {
       let host = url.indexOf(':') != -1 ? extractHostFromURL(url) : url;
-      return elemHide.getStyleSheet(host, specificOnly).code;
+      if (typeof _compactStyleSheets == "undefined" || !_compactStyleSheets)
+        return elemHide.getStyleSheet(host, specificOnly).code;
+      let {selectors} = elemHide.getStyleSheet(host, specificOnly, true);
+      return createCompactStyleSheet(selectors, null);
+    },
+
+    getElementHidingGenericStyleSheet()
+    {
+      return createElementHidingStyleSheet([...getUnconditionalSelectors()]);
+    },
+
+    getElementHidingDomainStyleSheet(url)
+    {
+      let host = url.indexOf(':') != -1 ? extractHostFromURL(url) : url;
+      let unconditional = getUnconditionalSelectors();
+      let {selectors} = elemHide.getStyleSheet(host, false, true);
+      return createElementHidingStyleSheet(
+        selectors.filter(selector => !unconditional.has(selector)), unconditional
+      );
+    },
+
+    getCompactStyleSheetStats()
+    {
+      let {count, size, savedSize} = compactStyleSheetStats;
+      return [count, size, savedSize];
+    },
+
+    getSharedElementHiding()
+    {
+      // Filters apply on a host if they do on its longest parent domain
+      // which any filter mentions, so only those domains need style sheets.
+      let domains = new Set();
+      for (let subscription of filterStorage.subscriptions())
+      {
+        if (subscription.disabled)
+          continue;
+
+        for (let text of subscription.filterText())
+        {
+          let filter = Filter.fromText(text);
+          if ((filter.type != "elemhide" && filter.type != "elemhideexception") ||
+              !filter.domains || !filterState.isEnabled(text))
+            continue;
+
+          for (let domain of filter.domains.keys())
+          {
+            if (domain.includes("*"))
+              throw new Error("Filters with wildcard domains cannot be shared");
+            if (domain)
+              domains.add(domain);
+          }
+        }
+      }
+
+      let unconditional = getUnconditionalSelectors();
+      let getDomainStyleSheet = host =>
+      {
+        let {selectors} = elemHide.getStyleSheet(host, false, true);
+        return createElementHidingStyleSheet(
+          selectors.filter(selector => !unconditional.has(selector)), unconditional
+        );
+      };
+      let result = [createElementHidingStyleSheet([...unconditional]),
+                    getDomainStyleSheet("")];
+      for (let domain of domains)
+      {
+        result.push(domain, getDomainStyleSheet(domain),
+                    createElementHidingStyleSheet(
+                      elemHide.getStyleSheet(domain, true, true).selectors
+                    ));
+      }
+      return result;
     },
 
     getElementHidingEmulationSelectors(url)
@@ -229,6 +692,15 @@ let API = (() =>
       return elemHideEmulation.getFilters(host);
     },
 
+    getPackedElementHidingEmulationSelectors(url)
+    {
+      let host = url.indexOf(':') != -1 ? extractHostFromURL(url) : url;
+      let result = [];
+      for (let {selector, text} of elemHideEmulation.getFilters(host))
+        result.push(selector, text);
+      return result.join("\n");
+    },
+
     getPref(pref)
     {
       return Prefs[pref];
@@ -239,9 +711,9 @@ let API = (() =>
       Prefs[pref] = value;
     },
 
-    verifySignature(key, signature, uri, host, userAgent)
+    flushPrefs()
     {
-      return SignatureVerifier.verifySignature(key, signature, uri + "\0" + host + "\0" + userAgent);
+      Prefs.flush();
     },
 
     composeFilterSuggestions(baseUrl, tagName, id, src, style, classes, relatedUrls)
@@ -249,6 +721,30 @@ let API = (() =>
       return composeFilterSuggestions(baseUrl, tagName, id, src, style, classes, relatedUrls);
     },
 
+    composeFilterSuggestionsBatch(packedElements)
+    {
+      let fields = packedElements.split("\0");
+      let result = [];
+      // The packed string ends with a separator, which leaves an empty field.
+      for (let i = 0; i + 7 < fields.length;)
+      {
+        let [baseUrl, tagName, id, src, style, classes] = fields.slice(i, i + 6);
+        let urlCount = parseInt(fields[i + 6], 10);
+        let relatedUrls = fields.slice(i + 7, i + 7 + urlCount);
+        i += 7 + urlCount;
+        try
+        {
+          result.push(composeFilterSuggestions(baseUrl, tagName, id, src, style, classes,
+                                               relatedUrls));
+        }
+        catch (e)
+        {
+          result.push([]);
+        }
+      }
+      return result;
+    },
+
     startSynchronization()
     {
       synchronizer.start();
@@ -261,15 +757,22 @@ let API = (() =>
       Prefs.synchronization_enabled = false;
     },
 
-    getSnippetsScript(documentUrl, isolatedSrc, injectedSrc, injectedList)
+    getSnippetsScript,
+
+    registerSnippetLibrary(handle, isolatedSrc, injectedSrc, injectedList)
     {
-      let documentHost = extractHostFromURL(documentUrl);
-      let scripts = snippets.getFilters(documentHost).map(it => it.script);
+      snippetLibraries.set(handle, {isolatedSrc, injectedSrc, injectedList});
+    },
 
-      if (!scripts.length)
-        return "";
+    unregisterSnippetLibrary(handle)
+    {
+      snippetLibraries.delete(handle);
+    },
 
-      return compileScript(scripts, isolatedSrc, injectedSrc, injectedList, {});
+    getRegisteredSnippetsScript(documentUrl, handle)
+    {
+      let {isolatedSrc, injectedSrc, injectedList} = snippetLibraries.get(handle);
+      return getSnippetsScript(documentUrl, isolatedSrc, injectedSrc, injectedList);
     },
   };
 })();
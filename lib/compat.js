@@ -313,6 +313,11 @@ function fetch(url, initObj)
     {
       request = new XMLHttpRequest();
       request.open(initObj.method, url);
+      if (initObj.headers)
+      {
+        for (let name of Object.keys(initObj.headers))
+          request.setRequestHeader(name, initObj.headers[name]);
+      }
     }
     catch (error)
     {
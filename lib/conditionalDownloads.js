@@ -0,0 +1,223 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+"use strict";
+
+/**
+ * @fileOverview Conditional requests for the subscription downloads. The
+ * validators of the last successful download are stored per subscription and
+ * sent along with the next one, a 304 response then only renews the
+ * expiration of the subscription without parsing and storing its filters
+ * again.
+ */
+
+const {Prefs} = require("prefs");
+const {Subscription} = require("subscriptionClasses");
+const {synchronizer} = require("synchronizer");
+const {MILLIS_IN_SECOND, MILLIS_IN_HOUR, MILLIS_IN_DAY} = require("time");
+
+// Number of lines searched for the Expires header of a filter list.
+const HEADER_LINES = 20;
+
+// Subscription URLs by the URL they are being downloaded from.
+let downloading = new Map();
+// Validators of the responses which are being processed, by subscription URL.
+let received = new Map();
+
+function takeDownload(url)
+{
+  for (let [downloadURL, subscriptionURL] of downloading)
+  {
+    if (url == downloadURL || url.startsWith(downloadURL + "?") ||
+        url.startsWith(downloadURL + "&"))
+    {
+      downloading.delete(downloadURL);
+      return subscriptionURL;
+    }
+  }
+  return null;
+}
+
+function forgetDownload(subscriptionURL)
+{
+  for (let [downloadURL, url] of downloading)
+  {
+    if (url == subscriptionURL)
+      downloading.delete(downloadURL);
+  }
+  received.delete(subscriptionURL);
+}
+
+function storeValidators(subscriptionURL, validators)
+{
+  let stored = Prefs.subscriptions_validators;
+  if (JSON.stringify(stored[subscriptionURL]) == JSON.stringify(validators))
+    return;
+
+  let all = Object.assign({}, stored);
+  if (validators)
+    all[subscriptionURL] = validators;
+  else
+    delete all[subscriptionURL];
+  Prefs.subscriptions_validators = all;
+}
+
+/**
+ * Looks up a header of a filter list, e.g. `! Expires: 4 days`.
+ * @param {string} responseText The filter list.
+ * @param {string} keyword The lower-cased name of the header.
+ * @return {?string} The value of the header.
+ */
+let findHeader = exports.findHeader = function(responseText, keyword)
+{
+  let lines = responseText.split(/[\r\n]+/, HEADER_LINES);
+  for (let i = 1; i < lines.length; i++)
+  {
+    let match = /^\s*!\s*(.*?)\s*:\s*(.*)/.exec(lines[i]);
+    if (!match)
+      break;
+    if (match[1].toLowerCase() == keyword)
+      return match[2];
+  }
+  return null;
+};
+
+/**
+ * @param {string} responseText The filter list.
+ * @return {number} The expiration interval of the filter list in
+ *   milliseconds, taken from its Expires header.
+ */
+let parseExpirationInterval = exports.parseExpirationInterval =
+function(responseText)
+{
+  let match = /^(\d+)\s*(h)?/.exec(findHeader(responseText, "expires") || "");
+  if (!match)
+    return Prefs.subscriptions_default_expiration_interval;
+
+  let interval = parseInt(match[1], 10);
+  return match[2] ? interval * MILLIS_IN_HOUR : interval * MILLIS_IN_DAY;
+};
+
+/**
+ * Marks a subscription as up to date until it expires again, without
+ * touching its filters.
+ * @param {Subscription} subscription
+ * @param {number} expirationInterval In milliseconds.
+ */
+let renewSubscription = exports.renewSubscription =
+function(subscription, expirationInterval)
+{
+  // lastDownload is left alone so that the filter storage isn't written
+  // again, after a restart the subscription is checked once more instead.
+  let [softExpiration, hardExpiration] =
+    synchronizer._downloader.processExpirationInterval(expirationInterval);
+  subscription.softExpiration = Math.round(softExpiration / MILLIS_IN_SECOND);
+  subscription.expires = Math.round(hardExpiration / MILLIS_IN_SECOND);
+  if (subscription.downloadStatus != "synchronize_ok")
+    subscription.downloadStatus = "synchronize_ok";
+  if (subscription.errors)
+    subscription.errors = 0;
+};
+
+function conditionalFetch(originalFetch, url, initObj)
+{
+  let subscriptionURL = takeDownload(url);
+  if (!subscriptionURL)
+    return originalFetch(url, initObj);
+
+  let validators = Prefs.subscriptions_validators[subscriptionURL];
+  if (validators)
+  {
+    let headers = Object.assign({}, initObj && initObj.headers);
+    if (validators.etag)
+      headers["If-None-Match"] = validators.etag;
+    if (validators.lastModified)
+      headers["If-Modified-Since"] = validators.lastModified;
+    initObj = Object.assign({}, initObj, {headers});
+  }
+
+  return originalFetch(url, initObj).then(response =>
+  {
+    if (response.status == 200)
+    {
+      received.set(subscriptionURL, {
+        etag: response.headers.get("etag") || null,
+        lastModified: response.headers.get("last-modified") || null
+      });
+    }
+    return response;
+  });
+}
+
+/**
+ * Makes the synchronizer send conditional requests, by wrapping fetch() and
+ * the callbacks of its downloader.
+ */
+exports.enableConditionalDownloads = function()
+{
+  let downloader = synchronizer._downloader;
+
+  let originalFetch = window.fetch;
+  window.fetch = (url, initObj) => conditionalFetch(originalFetch, url, initObj);
+
+  let download = downloader._download;
+  downloader._download = function(downloadable, redirects)
+  {
+    // Redirected downloads are requested unconditionally.
+    if (!redirects)
+      downloading.set(downloadable.redirectURL || downloadable.url, downloadable.url);
+    return download.call(this, downloadable, redirects);
+  };
+
+  let onDownloadSuccess = downloader.onDownloadSuccess;
+  downloader.onDownloadSuccess = function(downloadable, responseText, ...args)
+  {
+    let validators = received.get(downloadable.url);
+    forgetDownload(downloadable.url);
+    let result = onDownloadSuccess.call(this, downloadable, responseText, ...args);
+    return Promise.resolve(result).then(() =>
+    {
+      let subscription = Subscription.fromURL(downloadable.url);
+      if (subscription.downloadStatus == "synchronize_ok" && validators &&
+          (validators.etag || validators.lastModified))
+      {
+        validators.expirationInterval = parseExpirationInterval(responseText);
+        storeValidators(downloadable.url, validators);
+      }
+      else
+        storeValidators(downloadable.url, undefined);
+      return result;
+    });
+  };
+
+  let onDownloadError = downloader.onDownloadError;
+  downloader.onDownloadError = function(downloadable, downloadURL, error,
+                                        responseStatus, ...args)
+  {
+    forgetDownload(downloadable.url);
+    let validators = Prefs.subscriptions_validators[downloadable.url];
+    if (responseStatus == 304 && validators)
+    {
+      renewSubscription(Subscription.fromURL(downloadable.url),
+                        validators.expirationInterval);
+      return;
+    }
+    return onDownloadError.call(this, downloadable, downloadURL, error,
+                                responseStatus, ...args);
+  };
+};
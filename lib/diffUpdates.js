@@ -0,0 +1,177 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+"use strict";
+
+/**
+ * @fileOverview Incremental updates of subscriptions. A filter list can name
+ * the URL of its diffs in a header like
+ * `! Diff-URL: https://example.com/easylist/diff/%VERSION%.json`, where
+ * `%VERSION%` stands for the version of the list which the client has. The
+ * diff is a JSON object like
+ * `{"version": "202601011200", "added": [...], "removed": [...]}`. It is
+ * applied filter by filter, the whole list is only downloaded again if the
+ * diff cannot be retrieved or is invalid.
+ */
+
+const {Filter} = require("filterClasses");
+const {filterStorage} = require("filterStorage");
+const {Prefs} = require("prefs");
+const {Subscription} = require("subscriptionClasses");
+const {synchronizer} = require("synchronizer");
+const {MILLIS_IN_SECOND} = require("time");
+const {findHeader, parseExpirationInterval, renewSubscription} =
+  require("conditionalDownloads");
+
+// URLs of the subscriptions which are being updated from a diff.
+let updating = new Set();
+
+function storeDiffInfo(subscriptionURL, info)
+{
+  let stored = Prefs.subscriptions_diffs;
+  if (JSON.stringify(stored[subscriptionURL]) == JSON.stringify(info))
+    return;
+
+  let all = Object.assign({}, stored);
+  if (info)
+    all[subscriptionURL] = info;
+  else
+    delete all[subscriptionURL];
+  Prefs.subscriptions_diffs = all;
+}
+
+function isValidDiff(diff)
+{
+  let isTextList = list => Array.isArray(list) &&
+    list.every(text => typeof text == "string");
+  return diff != null && typeof diff == "object" &&
+    typeof diff.version == "string" && diff.version != "" &&
+    isTextList(diff.added) && isTextList(diff.removed);
+}
+
+async function fetchDiff(url)
+{
+  try
+  {
+    let response = await fetch(url, {method: "GET"});
+    if (response.status != 200)
+      return null;
+    let diff = JSON.parse(await response.text());
+    return isValidDiff(diff) ? diff : null;
+  }
+  catch (error)
+  {
+    return null;
+  }
+}
+
+function applyDiff(subscription, diff)
+{
+  let texts = new Set(subscription.filterText());
+  for (let text of diff.removed)
+  {
+    text = Filter.normalize(text);
+    if (texts.delete(text))
+      filterStorage.removeFilter(Filter.fromText(text), subscription);
+  }
+  for (let text of diff.added)
+  {
+    text = Filter.normalize(text);
+    if (text && !texts.has(text))
+    {
+      texts.add(text);
+      filterStorage.addFilter(Filter.fromText(text), subscription);
+    }
+  }
+}
+
+/**
+ * Updates a subscription from the diff to its current version.
+ * @param {Subscription} subscription
+ * @param {Object} info The diff URL and expiration interval of the list.
+ * @return {Promise.<boolean>} Whether the subscription is up to date now.
+ */
+async function updateFromDiff(subscription, info)
+{
+  if (!subscription.version)
+    return false;
+
+  let url = info.diffURL.replace("%VERSION%",
+                                 encodeURIComponent(subscription.version));
+  let diff = await fetchDiff(url);
+  if (!diff)
+    return false;
+
+  if (diff.version != subscription.version)
+  {
+    applyDiff(subscription, diff);
+    subscription.version = diff.version;
+  }
+  renewSubscription(subscription, info.expirationInterval);
+  subscription.lastDownload = subscription.lastSuccess =
+    Math.round(Date.now() / MILLIS_IN_SECOND);
+  return true;
+}
+
+/**
+ * Makes the synchronizer update subscriptions from diffs where their lists
+ * offer them.
+ */
+exports.enableDiffUpdates = function()
+{
+  let downloader = synchronizer._downloader;
+
+  let download = downloader._download;
+  downloader._download = function(downloadable, redirects)
+  {
+    let info = Prefs.subscriptions_diffs[downloadable.url];
+    if (redirects || !info || updating.has(downloadable.url))
+      return download.call(this, downloadable, redirects);
+
+    updating.add(downloadable.url);
+    let subscription = Subscription.fromURL(downloadable.url);
+    return updateFromDiff(subscription, info).then(updated =>
+    {
+      updating.delete(downloadable.url);
+      if (!updated)
+        return download.call(this, downloadable, redirects);
+    });
+  };
+
+  let onDownloadSuccess = downloader.onDownloadSuccess;
+  downloader.onDownloadSuccess = function(downloadable, responseText, ...args)
+  {
+    let result = onDownloadSuccess.call(this, downloadable, responseText,
+                                        ...args);
+    return Promise.resolve(result).then(() =>
+    {
+      let subscription = Subscription.fromURL(downloadable.url);
+      let diffURL = findHeader(responseText, "diff-url");
+      if (subscription.downloadStatus == "synchronize_ok" && diffURL)
+      {
+        storeDiffInfo(downloadable.url, {
+          diffURL,
+          expirationInterval: parseExpirationInterval(responseText)
+        });
+      }
+      else
+        storeDiffInfo(downloadable.url, undefined);
+      return result;
+    });
+  };
+};
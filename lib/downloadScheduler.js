@@ -0,0 +1,196 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+"use strict";
+
+/**
+ * @fileOverview Limits the number of subscription downloads which run at the
+ * same time, in total and per host. Waiting downloads start in the order of
+ * their priority: the Acceptable Ads list first, then the recommended ad
+ * blocking lists, then everything else. After a connection error the other
+ * downloads from the same host are held back for a jittered, exponentially
+ * growing interval.
+ */
+
+const {Prefs} = require("prefs");
+const {visibleRecommendations} = require("recommendations");
+const {Subscription} = require("subscriptionClasses");
+const {synchronizer} = require("synchronizer");
+const {MILLIS_IN_MINUTE, MILLIS_IN_HOUR} = require("time");
+
+const BACKOFF_MIN = MILLIS_IN_MINUTE;
+const BACKOFF_MAX = MILLIS_IN_HOUR;
+
+const PRIORITY_ACCEPTABLE_ADS = 0;
+const PRIORITY_PRIMARY = 1;
+const PRIORITY_DEFAULT = 2;
+
+// Waiting downloads, sorted by priority.
+let queue = [];
+let activeCount = 0;
+let activeByHost = new Map();
+// Host -> {errors, retryTime}
+let backoffs = new Map();
+let primaryURLs = null;
+let wakeUpTimer = null;
+
+function getHost(url)
+{
+  try
+  {
+    return new URL(url).hostname;
+  }
+  catch (error)
+  {
+    return "";
+  }
+}
+
+function getPriority(url)
+{
+  if (url == Prefs.subscriptions_exceptionsurl)
+    return PRIORITY_ACCEPTABLE_ADS;
+
+  if (!primaryURLs)
+  {
+    primaryURLs = new Set();
+    for (let {type, url: recommendedURL} of visibleRecommendations())
+    {
+      if (type == "ads")
+        primaryURLs.add(recommendedURL);
+    }
+  }
+  return primaryURLs.has(url) ? PRIORITY_PRIMARY : PRIORITY_DEFAULT;
+}
+
+function enqueue(entry)
+{
+  let index = queue.findIndex(queued => queued.priority > entry.priority);
+  queue.splice(index < 0 ? queue.length : index, 0, entry);
+}
+
+function recordResult(entry)
+{
+  let subscription = Subscription.fromURL(entry.downloadable.url);
+  if (subscription.downloadStatus != "synchronize_connection_error")
+  {
+    backoffs.delete(entry.host);
+    return;
+  }
+
+  let errors = (backoffs.has(entry.host) ? backoffs.get(entry.host).errors : 0) + 1;
+  let interval = Math.min(BACKOFF_MIN * 2 ** (errors - 1), BACKOFF_MAX);
+  // Spread the retries of many clients which failed at the same time.
+  interval *= 0.5 + Math.random();
+  backoffs.set(entry.host, {errors, retryTime: Date.now() + interval});
+}
+
+function start(entry, download)
+{
+  activeCount++;
+  activeByHost.set(entry.host, (activeByHost.get(entry.host) || 0) + 1);
+
+  let finish = () =>
+  {
+    activeCount--;
+    let hostCount = activeByHost.get(entry.host) - 1;
+    if (hostCount)
+      activeByHost.set(entry.host, hostCount);
+    else
+      activeByHost.delete(entry.host);
+    recordResult(entry);
+    processQueue(download);
+  };
+
+  let result;
+  try
+  {
+    result = Promise.resolve(download.call(entry.downloader,
+                                           entry.downloadable, 0));
+  }
+  catch (error)
+  {
+    result = Promise.reject(error);
+  }
+  result.then(finish, finish);
+  entry.resolve(result);
+}
+
+function processQueue(download)
+{
+  let now = Date.now();
+  let nextRetryTime = Infinity;
+  for (let i = 0; i < queue.length &&
+       activeCount < Prefs.subscriptions_max_downloads;)
+  {
+    let entry = queue[i];
+    let backoff = backoffs.get(entry.host);
+    if (backoff && backoff.retryTime > now)
+    {
+      nextRetryTime = Math.min(nextRetryTime, backoff.retryTime);
+      i++;
+    }
+    else if ((activeByHost.get(entry.host) || 0) >=
+             Prefs.subscriptions_max_downloads_per_host)
+    {
+      i++;
+    }
+    else
+    {
+      queue.splice(i, 1);
+      start(entry, download);
+    }
+  }
+
+  if (nextRetryTime < Infinity && !wakeUpTimer)
+  {
+    wakeUpTimer = setTimeout(() =>
+    {
+      wakeUpTimer = null;
+      processQueue(download);
+    }, nextRetryTime - now);
+  }
+}
+
+/**
+ * Makes the downloads of the synchronizer wait for a free slot.
+ */
+exports.enableDownloadScheduler = function()
+{
+  let downloader = synchronizer._downloader;
+
+  let download = downloader._download;
+  downloader._download = function(downloadable, redirects)
+  {
+    // Redirects continue a download which already has its slot.
+    if (redirects)
+      return download.call(this, downloadable, redirects);
+
+    return new Promise(resolve =>
+    {
+      enqueue({
+        downloader: this,
+        downloadable,
+        host: getHost(downloadable.redirectURL || downloadable.url),
+        priority: getPriority(downloadable.url),
+        resolve
+      });
+      processQueue(download);
+    });
+  };
+};
@@ -0,0 +1,53 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+"use strict";
+
+/**
+ * @fileOverview Makes subscriptions which list the same filter share its
+ * text. The lines of a downloaded list are strings of their own, the text of
+ * a filter which is known already takes their place, so that overlapping
+ * lists like EasyList, its regional supplements and the exception list keep
+ * a single copy of what they have in common. Filter objects are shared by
+ * Filter.fromText() anyway.
+ */
+
+const {Filter} = require("filterClasses");
+const {filterStorage} = require("filterStorage");
+
+function shareFilterText(filterText)
+{
+  return Array.from(filterText, text =>
+  {
+    let filter = Filter.knownFilters.get(text);
+    return filter ? filter.text : text;
+  });
+}
+
+/**
+ * Makes the filter storage share the text of known filters between
+ * subscriptions when their filters are replaced.
+ */
+exports.enableFilterDeduplication = function()
+{
+  let updateSubscriptionFilters = filterStorage.updateSubscriptionFilters;
+  filterStorage.updateSubscriptionFilters = function(subscription, filterText)
+  {
+    return updateSubscriptionFilters.call(this, subscription,
+                                          shareFilterText(filterText));
+  };
+};
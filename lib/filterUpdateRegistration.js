@@ -18,6 +18,8 @@
 "use strict";
 
 const {filterNotifier} = require("filterNotifier");
+const {filterStorage} = require("filterStorage");
+const {Subscription} = require("subscriptionClasses");
 
 let events = [
   "elemhideupdate",
@@ -43,7 +45,74 @@ let events = [
   "subscription.updated",
 ];
 
+// Nesting depth of beginUpdate() calls. While an update is in progress the
+// events are held back and saving the filter storage is postponed.
+let updateDepth = 0;
+let pendingIds = [];
+let pendingItems = [];
+let pendingUrls = [];
+let savePending = false;
+
 // Until we change libadblockplus API we need to listen to all the
-// notification.
-for (let event of events)
-  filterNotifier.on(event, item => _triggerEvent("filterChange", event, item));
+// notification. The event is passed by its index in the list, which
+// DefaultFilterEngine::ChangeEvent mirrors. Filter events come with the URL
+// of the subscription which the filter was added to or removed from.
+events.forEach((event, id) =>
+{
+  filterNotifier.on(event, (item, source) =>
+  {
+    let url = source instanceof Subscription ? source.url : "";
+    if (updateDepth)
+    {
+      pendingIds.push(id);
+      pendingItems.push(item);
+      pendingUrls.push(url);
+    }
+    else
+      _triggerEvent("filterChange", id, item, url);
+  });
+});
+
+let saveToDisk = filterStorage.saveToDisk;
+filterStorage.saveToDisk = function(...args)
+{
+  if (updateDepth)
+  {
+    savePending = true;
+    return Promise.resolve();
+  }
+  return saveToDisk.apply(this, args);
+};
+
+/**
+ * Starts an update of the filter storage, calls can be nested.
+ */
+exports.beginUpdate = function()
+{
+  updateDepth++;
+};
+
+/**
+ * Finishes the outermost update: the held back events are passed on in one
+ * call and the filter storage is saved once if anything asked for it.
+ */
+exports.commitUpdate = function()
+{
+  if (!updateDepth || --updateDepth)
+    return;
+
+  let ids = pendingIds;
+  let items = pendingItems;
+  let urls = pendingUrls;
+  pendingIds = [];
+  pendingItems = [];
+  pendingUrls = [];
+  if (ids.length)
+    _triggerEvent("filterChanges", ids, items, urls);
+
+  if (savePending)
+  {
+    savePending = false;
+    filterStorage.saveToDisk();
+  }
+};
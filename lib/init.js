@@ -24,6 +24,11 @@ const {synchronizer, addSubscriptionFilters} = require("synchronizer");
 const {filterStorage} = require("filterStorage");
 const {Subscription} = require("subscriptionClasses");
 const {Utils} = require("utils");
+const {enableConditionalDownloads} = require("conditionalDownloads");
+const {enableDiffUpdates} = require("diffUpdates");
+const {enableDownloadScheduler} = require("downloadScheduler");
+const {enableFilterDeduplication} = require("filterDeduplication");
+const {enableLazySubscriptions} = require("lazySubscriptions");
 const {MILLIS_IN_SECOND, MILLIS_IN_HOUR, MILLIS_IN_DAY} = require("time");
 
 function* matchLines(text)
@@ -136,6 +141,10 @@ function injectPreload(subscription, preloadInfo)
 
 function preload(subscription)
 {
+  // Already there, e.g. from the precompiled filter storage.
+  if (subscription.filterCount)
+    return Promise.resolve();
+
   return new Promise((resolve, reject) =>
       _resourceReader.readPreloadedFilterList(subscription.url, resolve, reject))
     .then(info =>
@@ -186,6 +195,17 @@ async function startEngine()
     Prefs.first_run = false;
 }
 
+async function installPrecompiledFilterStorage()
+{
+  if (!Prefs.first_run)
+    return;
+
+  let installed = await new Promise((resolve, reject) =>
+    _resourceReader.installPrecompiledFilterStorage(resolve, reject));
+  if (installed)
+    _triggerEvent("_precompiledFilterStorage");
+}
+
 async function initializeEngine()
 {
   // This is a workaround due to the issue adblockpluscore#285. Please
@@ -193,8 +213,18 @@ async function initializeEngine()
   synchronizer._downloader.download = function(downloadable) {
     synchronizer._downloader._download(downloadable, 0);
   };
+  enableConditionalDownloads();
+  enableDiffUpdates();
+  enableDownloadScheduler();
+  enableFilterDeduplication();
+  if (typeof _lazyDisabledSubscriptions != "undefined" &&
+      _lazyDisabledSubscriptions)
+    enableLazySubscriptions();
 
   await initializePrefs();
+  _triggerEvent("_saveStats", Prefs.savestats);
+  Prefs.on("savestats", () => _triggerEvent("_saveStats", Prefs.savestats));
+  await installPrecompiledFilterStorage();
   await filterEngine.initialize();
   await startEngine();
 
@@ -17,24 +17,29 @@
 
 "use strict";
 
-function readFileAsync(fileName)
-{
-  return new Promise((resolve, reject) =>
-  {
-    _fileSystem.read(fileName, resolve, reject);
-  });
-}
+// Number of lines passed from the native code to JS at once by readFromFile.
+const READ_BATCH_SIZE = 1000;
+// Number of characters after which writeToFile passes the lines produced so
+// far to the native code.
+const WRITE_CHUNK_LENGTH = 64 * 1024;
+
+// Files to stat which were requested while the same script ran, they are
+// passed to the native code at once.
+let pendingStats = [];
 
-function writeFileAsync(fileName, content)
+function statPendingFiles()
 {
-  return new Promise((resolve, reject) =>
+  let stats = pendingStats;
+  pendingStats = [];
+  _fileSystem.statMany(stats.map(stat => stat.fileName), results =>
   {
-    _fileSystem.write(fileName, content, (error) =>
+    for (let i = 0; i < stats.length; i++)
     {
-      if (error)
-        return reject(error);
-      resolve();
-    });
+      if (results[i].error)
+        stats[i].reject(results[i].error);
+      else
+        stats[i].resolve(results[i]);
+    }
   });
 }
 
@@ -42,24 +47,89 @@ exports.IO =
 {
   lineBreak: "\n",
 
-  readFromFile(fileName, listener)
+  /**
+   * @param {string} fileName
+   * @param {function} listener Called with each line.
+   * @param {boolean} [deferDisabled] Whether the filters of disabled
+   *   subscriptions are left out, the promise is resolved with an object
+   *   mapping subscription URLs to their lines, see lazySubscriptions.js.
+   * @return {Promise}
+   */
+  readFromFile(fileName, listener, deferDisabled)
   {
     return new Promise((resolve, reject) =>
     {
-      _fileSystem.readFromFile(fileName, listener, resolve, reject);
+      _fileSystem.readFromFile(fileName, lines =>
+      {
+        for (let line of lines)
+          listener(line);
+      }, resolve, reject, READ_BATCH_SIZE, !!deferDisabled);
     });
   },
 
   writeToFile(fileName, generator)
   {
-    let content = Array.from(generator).join(this.lineBreak) + this.lineBreak;
-    return writeFileAsync(fileName, content);
+    // Only the filter storage writes files line by line, and it reads them
+    // back through readFromFile() which understands all formats.
+    let writer = _fileSystem.openWriter(
+      fileName,
+      typeof _binaryFilterStorage != "undefined" && _binaryFilterStorage,
+      typeof _compressFilterStorage != "undefined" && _compressFilterStorage
+    );
+    try
+    {
+      let lines = [];
+      let length = 0;
+      let appended = false;
+      let append = () =>
+      {
+        _fileSystem.appendToWriter(writer,
+                                   lines.join(this.lineBreak) + this.lineBreak);
+        lines = [];
+        length = 0;
+        appended = true;
+      };
+      for (let line of generator)
+      {
+        lines.push(line);
+        length += line.length + this.lineBreak.length;
+        if (length >= WRITE_CHUNK_LENGTH)
+          append();
+      }
+      // Even without any lines the file consists of a line break.
+      if (lines.length > 0 || !appended)
+        append();
+    }
+    catch (e)
+    {
+      _fileSystem.abortWriter(writer);
+      return Promise.reject(e);
+    }
+
+    // Lets the filter engine know which state the file is going to reflect.
+    _triggerEvent("_fileWrite", fileName);
+    return new Promise((resolve, reject) =>
+    {
+      _fileSystem.commitWriter(writer, (error) =>
+      {
+        if (error)
+          return reject(error);
+        resolve();
+      });
+    });
   },
 
   copyFile(fromFileName, toFileName)
   {
-    return readFileAsync(fromFileName).then(
-      content => writeFileAsync(toFileName, content));
+    return new Promise((resolve, reject) =>
+    {
+      _fileSystem.copy(fromFileName, toFileName, (error) =>
+      {
+        if (error)
+          return reject(error);
+        resolve();
+      });
+    });
   },
 
   renameFile(fromFileName, newNameFile)
@@ -92,12 +162,14 @@ exports.IO =
   {
     return new Promise((resolve, reject) =>
     {
-      _fileSystem.stat(fileName, (result) =>
-      {
-        if (result.error)
-          return reject(result.error);
-        resolve(result);
-      });
+      if (pendingStats.length == 0)
+        Promise.resolve().then(statPendingFiles);
+      pendingStats.push({fileName, resolve, reject});
     });
+  },
+
+  statFiles(fileNames)
+  {
+    return Promise.all(fileNames.map(fileName => this.statFile(fileName)));
   }
 };
@@ -0,0 +1,117 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+"use strict";
+
+/**
+ * @fileOverview Keeps the filters of disabled subscriptions out of the
+ * filter storage while they are disabled. On load their filter lines are
+ * taken as one string per subscription instead of filter objects, they are
+ * parsed once the subscription is enabled and written back unchanged as long
+ * as it isn't.
+ */
+
+const {IO} = require("io");
+const {filterNotifier} = require("filterNotifier");
+const {addSubscriptionFilters} = require("synchronizer");
+
+const FILTERS_HEADER = "[Subscription filters]";
+
+// Filter lines by subscription URL, with `[` escaped like in the storage.
+let deferred = new Map();
+
+function* mergeDeferred(lines)
+{
+  let pending = null;
+  let inSubscription = false;
+  for (let line of lines)
+  {
+    if (line.startsWith("["))
+    {
+      if (pending)
+      {
+        yield FILTERS_HEADER;
+        yield* pending.split("\n").filter(filter => filter);
+        pending = null;
+        // The subscription has no filters of its own while deferred.
+        if (line == FILTERS_HEADER)
+          continue;
+      }
+      inSubscription = line == "[Subscription]";
+    }
+    else if (inSubscription && line.startsWith("url="))
+    {
+      let url = line.substr(4);
+      if (deferred.has(url))
+        pending = deferred.get(url);
+    }
+    yield line;
+  }
+  if (pending)
+  {
+    yield FILTERS_HEADER;
+    yield* pending.split("\n").filter(filter => filter);
+  }
+}
+
+function loadDeferred(subscription)
+{
+  let text = deferred.get(subscription.url);
+  deferred.delete(subscription.url);
+  let list = "[Adblock Plus 2.0]\n" + text.replace(/\\\[/g, "[");
+  addSubscriptionFilters(subscription, list, error =>
+  {
+    console.warn(`Failed to load filters of ${subscription.url}: ${error.error}`);
+  });
+}
+
+/**
+ * Makes the filter storage defer the filters of disabled subscriptions.
+ */
+exports.enableLazySubscriptions = function()
+{
+  let readFromFile = IO.readFromFile;
+  IO.readFromFile = function(fileName, listener)
+  {
+    return readFromFile.call(this, fileName, listener, true).then(result =>
+    {
+      deferred = new Map(Object.entries(result || {}));
+    });
+  };
+
+  let writeToFile = IO.writeToFile;
+  IO.writeToFile = function(fileName, generator)
+  {
+    return writeToFile.call(this, fileName,
+                            deferred.size ? mergeDeferred(generator) : generator);
+  };
+
+  filterNotifier.on("subscription.disabled", subscription =>
+  {
+    if (!subscription.disabled && deferred.has(subscription.url))
+      loadDeferred(subscription);
+  });
+  // Filters which were downloaded or removed replace the deferred ones.
+  for (let event of ["subscription.removed", "subscription.updated"])
+  {
+    filterNotifier.on(event, subscription =>
+    {
+      deferred.delete(subscription.url);
+    });
+  }
+};
@@ -15,35 +15,177 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-// Stubs for performance and PerformanceObserver used in lib/profiler.js (core)
+// Implementation of performance and PerformanceObserver used in
+// lib/profiler.js (core), a subset of the Node.js perf_hooks module. Time is
+// taken from a monotonic native clock and measures are also passed to the
+// LogSystem of the embedder.
 
 "use strict";
 
-let observers = {};
 const observableTypes = [
-  'mark',
-  'measure'
+  "mark",
+  "measure"
 ];
 
+let observers = new Set();
+let pendingObservers = new Set();
+let deliveryScheduled = false;
+
+function deliverEntries()
+{
+  deliveryScheduled = false;
+  let notified = pendingObservers;
+  pendingObservers = new Set();
+  for (let observer of notified)
+  {
+    let entries = observer._buffer;
+    observer._buffer = [];
+    if (observers.has(observer))
+      observer._callback(new PerformanceObserverEntryList(entries), observer);
+  }
+}
+
+function enqueueEntry(entry)
+{
+  for (let observer of observers)
+  {
+    if (!observer._entryTypes.has(entry.entryType))
+      continue;
+    observer._buffer.push(entry);
+    pendingObservers.add(observer);
+  }
+  if (pendingObservers.size > 0 && !deliveryScheduled)
+  {
+    deliveryScheduled = true;
+    setTimeout(deliverEntries, 0);
+  }
+}
+
+class PerformanceEntry
+{
+  constructor(name, entryType, startTime, duration)
+  {
+    this.name = name;
+    this.entryType = entryType;
+    this.startTime = startTime;
+    this.duration = duration;
+  }
+
+  toJSON()
+  {
+    return {
+      name: this.name,
+      entryType: this.entryType,
+      startTime: this.startTime,
+      duration: this.duration
+    };
+  }
+}
+
+class PerformanceObserverEntryList
+{
+  constructor(entries)
+  {
+    this._entries = entries;
+  }
+
+  getEntries()
+  {
+    return this._entries.slice();
+  }
+
+  getEntriesByType(type)
+  {
+    return this._entries.filter(entry => entry.entryType == type);
+  }
+
+  getEntriesByName(name, type)
+  {
+    return this._entries.filter(
+      entry => entry.name == name && (type === undefined || entry.entryType == type)
+    );
+  }
+}
+
 class Performance
 {
+  constructor()
+  {
+    this.timeOrigin = _performance.now();
+    this._marks = new Map();
+  }
+
+  now()
+  {
+    return _performance.now() - this.timeOrigin;
+  }
+
   mark(name)
   {
+    let entry = new PerformanceEntry(String(name), "mark", this.now(), 0);
+    this._marks.set(entry.name, entry);
+    enqueueEntry(entry);
+    return entry;
   }
 
   measure(name, startMark, endMark)
   {
+    let startTime = startMark === undefined ? 0 : this._getMarkTime(startMark);
+    let endTime = endMark === undefined ? this.now() : this._getMarkTime(endMark);
+    let entry = new PerformanceEntry(String(name), "measure", startTime,
+                                     endTime - startTime);
+    _performance.measure(entry.name, entry.startTime, entry.duration);
+    enqueueEntry(entry);
+    return entry;
+  }
+
+  clearMarks(name)
+  {
+    if (name === undefined)
+      this._marks.clear();
+    else
+      this._marks.delete(String(name));
+  }
+
+  _getMarkTime(name)
+  {
+    let entry = this._marks.get(String(name));
+    if (!entry)
+      throw new SyntaxError(`The "${name}" performance mark does not exist`);
+    return entry.startTime;
   }
 }
 
 class PerformanceObserver
 {
+  constructor(callback)
+  {
+    if (typeof callback != "function")
+      throw new TypeError("PerformanceObserver callback must be a function");
+    this._callback = callback;
+    this._entryTypes = new Set();
+    this._buffer = [];
+  }
+
   disconnect()
   {
+    observers.delete(this);
+    pendingObservers.delete(this);
+    this._buffer = [];
   }
 
   observe(options)
   {
+    let entryTypes = options && options.entryTypes;
+    if (!Array.isArray(entryTypes))
+      throw new TypeError("options.entryTypes must be an array");
+    this._entryTypes = new Set(
+      entryTypes.filter(type => observableTypes.includes(type))
+    );
+    if (this._entryTypes.size == 0)
+      this.disconnect();
+    else
+      observers.add(this);
   }
 }
 
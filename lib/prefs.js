@@ -35,10 +35,18 @@ let defaults = {
   subscriptions_fallbackerrors: 5,
   subscriptions_fallbackurl: "https://adblockplus.org/getSubscription?version=%VERSION%&url=%SUBSCRIPTION%&downloadURL=%URL%&error=%ERROR%&responseStatus=%RESPONSESTATUS%",
   subscriptions_autoupdate: true,
+  subscriptions_max_downloads: 4,
+  subscriptions_max_downloads_per_host: 2,
   subscriptions_exceptionsurl: "https://easylist-downloads.adblockplus.org/exceptionrules.txt",
   documentation_link: "https://adblockplus.org/redirect?link=%LINK%&lang=%LANG%",
   currentVersion: "0.0",
   notificationdata: {},
+  // Validators of the last download by subscription URL, see
+  // conditionalDownloads.js.
+  subscriptions_validators: {},
+  // Diff URLs and expiration intervals by subscription URL, see
+  // diffUpdates.js.
+  subscriptions_diffs: {},
   first_run_subscription_auto_select: true,
   allowed_connection_type: "",
   synchronization_enabled: true,
@@ -59,6 +67,11 @@ let listeners = [];
 let specificListeners = new Map();
 let isDirty = false;
 let isSaving = false;
+let isFlushing = false;
+let saveTimeout = null;
+// Milliseconds to wait after a change before prefs.json is written, changes
+// made in the meantime are written along.
+let saveDelay = typeof _prefsSaveDelay != "undefined" ? _prefsSaveDelay : 0;
 
 function defineProperty(key)
 {
@@ -120,18 +133,28 @@ let initializePrefs = exports.initializePrefs = function()
 
 function save()
 {
-  if (isSaving)
-  {
-    isDirty = true;
+  isDirty = true;
+  if (!isSaving && saveTimeout == null)
+    saveTimeout = setTimeout(write, saveDelay);
+}
+
+function write()
+{
+  saveTimeout = null;
+  if (isSaving || !isDirty)
     return;
-  }
 
   isDirty = false;
   isSaving = true;
   _fileSystem.write(prefsFileName, JSON.stringify(values), () =>
   {
     isSaving = false;
-    if (isDirty)
+    if (isFlushing)
+    {
+      isFlushing = false;
+      write();
+    }
+    else if (isDirty)
       save();
   });
 }
@@ -139,6 +162,23 @@ function save()
 let Prefs = exports.Prefs = {
   initialized: false,
 
+  /**
+   * Writes pending changes right away instead of after the save delay,
+   * e.g. before shutting down.
+   */
+  flush()
+  {
+    if (saveTimeout != null)
+    {
+      clearTimeout(saveTimeout);
+      saveTimeout = null;
+    }
+    if (isSaving)
+      isFlushing = isDirty;
+    else
+      write();
+  },
+
   addListener(listener)
   {
     if (listeners.indexOf(listener) < 0)
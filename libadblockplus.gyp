@@ -1,5 +1,19 @@
 {
   'includes': ['v8.gypi'],
+  'conditions': [[
+    # zlib is part of the system everywhere but on Windows
+    'OS=="win"',
+    {
+      'variables': {
+        'have_zlib%': 0
+      }
+    },
+    {
+      'variables': {
+        'have_zlib%': 1
+      }
+    }
+  ]],
   'variables': {
     'library_files': [
       'lib/info.js',
@@ -38,6 +52,11 @@
       'adblockpluscore/lib/filterEngine.js',
       'adblockpluscore/lib/synchronizer.js',
       'lib/filterUpdateRegistration.js',
+      'lib/conditionalDownloads.js',
+      'lib/diffUpdates.js',
+      'lib/downloadScheduler.js',
+      'lib/lazySubscriptions.js',
+      'lib/filterDeduplication.js',
       'lib/compose.js',
       'adblockpluscore/lib/jsbn.js',
       'adblockpluscore/lib/rusha.js',
@@ -68,6 +87,7 @@
     ],
     'sources': [
       'include/AdblockPlus/AppInfo.h',
+      'include/AdblockPlus/CancellationToken.h',
       'include/AdblockPlus/Filter.h',
       'include/AdblockPlus/FilterEngineFactory.h',
       'include/AdblockPlus/IElement.h',
@@ -81,18 +101,44 @@
       'include/AdblockPlus/IV8IsolateProvider.h',
       'include/AdblockPlus/IWebRequest.h',
       'include/AdblockPlus/JSValue.h',
+      'include/AdblockPlus/JsHeap.h',
+      'include/AdblockPlus/LatencyHistogram.h',
+      'include/AdblockPlus/Metrics.h',
       'include/AdblockPlus/Platform.h',
       'include/AdblockPlus/PlatformFactory.h',
       'include/AdblockPlus/ReferrerMapping.h',
+      'include/AdblockPlus/SharedFilterData.h',
+      'include/AdblockPlus/SharedFilterPool.h',
       'include/AdblockPlus/Subscription.h',
+      'include/AdblockPlus/ThreadOptions.h',
+      'include/AdblockPlus/URLInfo.h',
       'src/ActiveObject.cpp',
       'src/ActiveObject.h',
+      'src/ApiCallStats.cpp',
+      'src/ApiCallStats.h',
+      'src/AsyncEventDispatcher.cpp',
+      'src/AsyncEventDispatcher.h',
       'src/AsyncExecutor.cpp',
       'src/AsyncExecutor.h',
+      'src/AsyncLogSystem.cpp',
+      'src/AsyncLogSystem.h',
+      'src/BinaryStorage.cpp',
+      'src/BinaryStorage.h',
       'src/AppInfoJsObject.cpp',
       'src/AppInfoJsObject.h',
+      'src/CacheWarmer.cpp',
+      'src/CacheWarmer.h',
+      'src/CancellationToken.cpp',
+      'src/CoalescedCalls.h',
+      'src/Compression.cpp',
+      'src/Compression.h',
       'src/ConsoleJsObject.cpp',
       'src/ConsoleJsObject.h',
+      'src/ContentFilterDomains.cpp',
+      'src/ContentFilterDomains.h',
+      'src/CopyOnWriteMap.h',
+      'src/DeclarativeRulesWriter.cpp',
+      'src/DeclarativeRulesWriter.h',
       'src/DefaultFileSystem.cpp',
       'src/DefaultFileSystem.h',
       'src/DefaultFilterEngine.cpp',
@@ -111,15 +157,32 @@
       'src/DefaultTimer.h',
       'src/DefaultWebRequest.cpp',
       'src/DefaultWebRequest.h',
+      'src/DeferredRelease.cpp',
+      'src/DeferredRelease.h',
       'src/FileSystemJsObject.cpp',
       'src/FileSystemJsObject.h',
       'src/Filter.cpp',
       'src/FilterEngineFactory.cpp',
+      'src/FilterEventBatch.cpp',
+      'src/FilterEventBatch.h',
+      'src/FilterSubscriptionIndex.cpp',
+      'src/FilterSubscriptionIndex.h',
+      'src/GcScheduler.cpp',
+      'src/GcScheduler.h',
       'src/GlobalJsObject.cpp',
       'src/GlobalJsObject.h',
+      'src/HitCounter.cpp',
+      'src/HitCounter.h',
+      'src/HostCache.cpp',
+      'src/HostCache.h',
       'src/ElementUtils.cpp',
       'src/ElementUtils.h',
+      'src/IFileSystem.cpp',
       'src/IFilterEngine.cpp',
+      'src/ITimer.cpp',
+      'src/IWebRequest.cpp',
+      'src/InteractivePriority.cpp',
+      'src/InteractivePriority.h',
       'src/JsContext.cpp',
       'src/JsContext.h',
       'src/JsEngine.cpp',
@@ -127,14 +190,38 @@
       'src/JsError.cpp',
       'src/JsError.h',
       'src/JsValue.cpp',
+      'src/LatencyRecorder.cpp',
+      'src/LatencyRecorder.h',
+      'src/LruCache.h',
+      'src/Metrics.cpp',
+      'src/MpscQueue.h',
+      'src/NativeMatcher.cpp',
+      'src/NativeMatcher.h',
+      'src/NativeRegExp.cpp',
+      'src/NativeRegExp.h',
+      'src/PerformanceJsObject.cpp',
+      'src/PerformanceJsObject.h',
       'src/PlatformFactory.cpp',
       'src/ReferrerMapping.cpp',
       'src/ResourceReaderJsObject.cpp',
       'src/ResourceReaderJsObject.h',
+      'src/SharedFilterData.cpp',
+      'src/SharedFilterDataWriter.h',
+      'src/SharedFilterPool.cpp',
+      'src/SignatureVerifier.cpp',
+      'src/SignatureVerifier.h',
+      'src/SingleFlight.h',
+      'src/StringPool.cpp',
+      'src/StringPool.h',
       'src/Subscription.cpp',
       'src/SynchronizedCollection.h',
       'src/Thread.cpp',
       'src/Thread.h',
+      'src/TraceRecorder.cpp',
+      'src/TraceRecorder.h',
+      'src/URLInfo.cpp',
+      'src/URLTokenizer.cpp',
+      'src/URLTokenizer.h',
       'src/Utils.cpp',
       'src/Utils.h',
       'src/WebRequestJsObject.cpp',
@@ -178,6 +265,15 @@
     'conditions': [
       ['OS=="android"', {
         'standalone_static_library': 1, # disable thin archives
+      }],
+      ['have_zlib==1', {
+        'defines': ['HAVE_ZLIB'],
+        'direct_dependent_settings': {
+          'defines': ['HAVE_ZLIB'],
+        },
+        'link_settings': {
+          'libraries': ['-lz'],
+        },
       }]
     ],
     'actions': [{
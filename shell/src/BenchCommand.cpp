@@ -0,0 +1,288 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "BenchCommand.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "../src/JsEngine.h"
+
+namespace
+{
+  typedef std::chrono::duration<double, std::micro> Microseconds;
+
+  bool IsRecording(const std::string& fileName)
+  {
+    return fileName.compare(0, 4, "rec_") == 0 && fileName.size() > 8 &&
+           fileName.compare(fileName.size() - 4, 4, ".log") == 0;
+  }
+
+  // The `rec_*.log` files of a directory, sorted, or nothing if `path` isn't
+  // a directory.
+  std::vector<std::string> ListRecordings(const std::string& path)
+  {
+    std::vector<std::string> files;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE handle = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (handle == INVALID_HANDLE_VALUE)
+      return files;
+    do
+    {
+      if (IsRecording(data.cFileName))
+        files.push_back(path + "\\" + data.cFileName);
+    } while (FindNextFileA(handle, &data));
+    FindClose(handle);
+#else
+    DIR* dir = opendir(path.c_str());
+    if (!dir)
+      return files;
+    while (dirent* entry = readdir(dir))
+    {
+      if (IsRecording(entry->d_name))
+        files.push_back(path + "/" + entry->d_name);
+    }
+    closedir(dir);
+#endif
+    std::sort(files.begin(), files.end());
+    return files;
+  }
+
+  std::vector<std::string> ToList(const AdblockPlus::JsValue& value)
+  {
+    std::vector<std::string> list;
+    if (!value.IsArray())
+      return list;
+    for (const auto& item : value.AsList())
+      list.push_back(item.AsString());
+    return list;
+  }
+
+  // Nearest-rank percentile of sorted measurements.
+  double Percentile(const std::vector<double>& sorted, double percentile)
+  {
+    const auto rank = static_cast<size_t>(std::ceil(percentile / 100 * sorted.size()));
+    return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+  }
+}
+
+BenchCommand::BenchCommand(AdblockPlus::IFilterEngine& filterEngine,
+                           AdblockPlus::JsEngine& jsEngine)
+    : Command("bench"), filterEngine(filterEngine), jsEngine(jsEngine)
+{
+}
+
+void BenchCommand::operator()(const std::string& arguments)
+{
+  std::istringstream argumentStream(arguments);
+  std::string path;
+  argumentStream >> path;
+  int runs = 1;
+  argumentStream >> runs;
+  if (!path.size() || runs < 1)
+  {
+    ShowUsage();
+    return;
+  }
+
+  std::vector<std::string> files = ListRecordings(path);
+  if (files.empty())
+    files.push_back(path);
+  std::vector<std::vector<RecordedCall>> recordings;
+  for (const auto& file : files)
+  {
+    recordings.push_back(ReadRecording(file));
+    if (recordings.back().empty())
+    {
+      std::cout << "No calls recorded in " << file << std::endl;
+      return;
+    }
+  }
+
+  std::map<std::string, Stats> stats;
+  for (int run = 0; run < runs; ++run)
+  {
+    for (const auto& recording : recordings)
+    {
+      for (const auto& call : recording)
+        Replay(call, &stats);
+    }
+  }
+
+  std::cout << std::left << std::setw(20) << "Name"
+            << " ; Median(us) ;   Mean(us) ;    P90(us) ;    P99(us) ;    Max(us) ;      Count"
+               " ; Mismatches"
+            << std::endl
+            << std::fixed << std::setprecision(3);
+  for (auto& it : stats)
+  {
+    auto& measurements = it.second.measurements;
+    std::sort(measurements.begin(), measurements.end());
+    const double mean =
+        std::accumulate(measurements.begin(), measurements.end(), 0.0) / measurements.size();
+    std::cout << std::left << std::setw(20) << it.first << std::right;
+    for (double value : {Percentile(measurements, 50),
+                         mean,
+                         Percentile(measurements, 90),
+                         Percentile(measurements, 99),
+                         measurements.back()})
+      std::cout << " ; " << std::setw(10) << value;
+    std::cout << " ; " << std::setw(10) << measurements.size() << " ; " << std::setw(10)
+              << it.second.mismatches << std::endl;
+  }
+}
+
+std::string BenchCommand::GetDescription() const
+{
+  return "Replays recorded calls and prints their latency, mismatches are calls "
+         "resulting differently than recorded, e.g. because of other subscriptions";
+}
+
+std::string BenchCommand::GetUsage() const
+{
+  return name + " RECORDING_FILE|RECORDINGS_DIRECTORY [RUNS]";
+}
+
+std::vector<BenchCommand::RecordedCall> BenchCommand::ReadRecording(const std::string& file)
+{
+  std::vector<RecordedCall> recording;
+  std::ifstream stream(file);
+  if (!stream.is_open())
+  {
+    std::cout << "Cannot read " << file << std::endl;
+    return recording;
+  }
+
+  const AdblockPlus::JsValue parse = jsEngine.Evaluate("str => JSON.parse(str)");
+  std::string line;
+  while (std::getline(stream, line))
+  {
+    if (line.empty())
+      continue;
+    const AdblockPlus::JsValue callInfo = parse.Call(jsEngine.NewValue(line));
+    RecordedCall call;
+    call.fn = callInfo.GetProperty("_fn").AsString();
+    if (call.fn == "check-filter-match")
+    {
+      call.url = callInfo.GetProperty("request_url").AsString();
+      call.documentUrls = ToList(callInfo.GetProperty("referrers"));
+      call.sitekey = callInfo.GetProperty("sitekey").AsString();
+      call.contentTypeMask = static_cast<AdblockPlus::IFilterEngine::ContentTypeMask>(
+          callInfo.GetProperty("adblock_resource_type").AsInt());
+      call.blocked = callInfo.GetProperty("_res").AsInt() != 0;
+    }
+    else if (call.fn == "block-popup")
+    {
+      call.url = callInfo.GetProperty("url").AsString();
+      call.opener = callInfo.GetProperty("opener").AsString();
+      call.blocked = callInfo.GetProperty("_res").AsInt() != 0;
+    }
+    else if (call.fn == "generate-js-css")
+    {
+      call.url = callInfo.GetProperty("gurl").AsString();
+      call.hasFrame = callInfo.GetProperty("process_id").AsInt() >= 0 &&
+                      callInfo.GetProperty("frame_id").AsInt() >= 0;
+      call.documentUrls = ToList(callInfo.GetProperty("referrers"));
+      call.sitekey = callInfo.GetProperty("sitekey").AsString();
+    }
+    else
+      continue;
+    recording.push_back(std::move(call));
+  }
+  return recording;
+}
+
+void BenchCommand::Replay(const RecordedCall& call, std::map<std::string, Stats>* stats) const
+{
+  Stats& callStats = (*stats)[call.fn];
+  const auto start = std::chrono::steady_clock::now();
+  bool blocked = call.blocked;
+  if (call.fn == "check-filter-match")
+    blocked = CheckFilterMatch(call);
+  else if (call.fn == "block-popup")
+    blocked = BlockPopup(call);
+  else
+    GenerateJsCss(call);
+  callStats.measurements.push_back(Microseconds(std::chrono::steady_clock::now() - start).count());
+  if (blocked != call.blocked)
+    ++callStats.mismatches;
+}
+
+// Same calls as HarnessTest::CheckFilterMatch().
+bool BenchCommand::CheckFilterMatch(const RecordedCall& call) const
+{
+  const auto& documentUrls = call.documentUrls;
+  bool specificOnly = false;
+  if (!documentUrls.empty())
+    specificOnly = filterEngine.IsContentAllowlisted(
+        call.url,
+        AdblockPlus::IFilterEngine::ContentType::CONTENT_TYPE_GENERICBLOCK,
+        documentUrls,
+        call.sitekey);
+
+  const AdblockPlus::Filter filter =
+      filterEngine.Matches(call.url,
+                           call.contentTypeMask,
+                           documentUrls.empty() ? "" : documentUrls.front(),
+                           call.sitekey,
+                           specificOnly);
+  return filter.IsValid() && filter.GetType() != AdblockPlus::Filter::Type::TYPE_EXCEPTION &&
+         !filterEngine.IsContentAllowlisted(
+             call.url,
+             AdblockPlus::IFilterEngine::ContentType::CONTENT_TYPE_DOCUMENT,
+             documentUrls,
+             call.sitekey);
+}
+
+bool BenchCommand::BlockPopup(const RecordedCall& call) const
+{
+  const AdblockPlus::Filter filter = filterEngine.Matches(
+      call.url, AdblockPlus::IFilterEngine::ContentType::CONTENT_TYPE_POPUP, call.opener);
+  return filter.IsValid() && filter.GetType() != AdblockPlus::Filter::Type::TYPE_EXCEPTION;
+}
+
+// Same calls as HarnessTest::GenerateJsCss().
+void BenchCommand::GenerateJsCss(const RecordedCall& call) const
+{
+  const auto& url = call.url;
+  const auto& documentUrls = call.documentUrls;
+  if (url.compare(0, 5, "http:") != 0 && url.compare(0, 6, "https:") != 0)
+    return;
+  if (filterEngine.IsContentAllowlisted(
+          url, AdblockPlus::IFilterEngine::CONTENT_TYPE_DOCUMENT, documentUrls, call.sitekey) ||
+      filterEngine.IsContentAllowlisted(
+          url, AdblockPlus::IFilterEngine::CONTENT_TYPE_ELEMHIDE, documentUrls, call.sitekey) ||
+      !call.hasFrame)
+    return;
+  filterEngine.GetElementHidingEmulationSelectors(url);
+  filterEngine.GetElementHidingStyleSheet(
+      url,
+      filterEngine.IsContentAllowlisted(
+          url, AdblockPlus::IFilterEngine::CONTENT_TYPE_GENERICHIDE, documentUrls));
+}
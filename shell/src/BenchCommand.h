@@ -0,0 +1,64 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <AdblockPlus.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Command.h"
+
+class BenchCommand : public Command
+{
+public:
+  BenchCommand(AdblockPlus::IFilterEngine& filterEngine, AdblockPlus::JsEngine& jsEngine);
+  void operator()(const std::string& arguments);
+  std::string GetDescription() const;
+  std::string GetUsage() const;
+
+private:
+  struct RecordedCall
+  {
+    std::string fn;
+    std::string url;
+    std::string opener;
+    std::vector<std::string> documentUrls;
+    std::string sitekey;
+    AdblockPlus::IFilterEngine::ContentTypeMask contentTypeMask = 0;
+    bool hasFrame = false;
+    bool blocked = false;
+  };
+
+  // Microseconds of every call and the number of calls whose result differs
+  // from the recorded one, by call type.
+  struct Stats
+  {
+    std::vector<double> measurements;
+    size_t mismatches = 0;
+  };
+
+  AdblockPlus::IFilterEngine& filterEngine;
+  AdblockPlus::JsEngine& jsEngine;
+
+  std::vector<RecordedCall> ReadRecording(const std::string& file);
+  void Replay(const RecordedCall& call, std::map<std::string, Stats>* stats) const;
+  bool CheckFilterMatch(const RecordedCall& call) const;
+  bool BlockPopup(const RecordedCall& call) const;
+  void GenerateJsCss(const RecordedCall& call) const;
+};
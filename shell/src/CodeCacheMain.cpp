@@ -0,0 +1,79 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <AdblockPlus.h>
+#include <fstream>
+#include <iostream>
+
+#include "../src/DefaultPlatform.h"
+#include "../src/JsEngine.h"
+
+// Creates a filter engine and writes the V8 code cache of all evaluated
+// JavaScript files, to be passed as PlatformFactory::CreationParameters::codeCache.
+// The data is only valid for the V8 build and flags it was created with.
+int main(int argc, char* argv[])
+{
+  if (argc != 3)
+  {
+    std::cerr << "Usage: " << argv[0] << " <output file> <scratch directory>" << std::endl;
+    return 1;
+  }
+
+  try
+  {
+    AdblockPlus::AppInfo appInfo;
+    appInfo.version = "1.0";
+    appInfo.name = "abpcodecache";
+    appInfo.application = "standalone";
+    appInfo.applicationVersion = "1.0";
+    appInfo.locale = "en-US";
+
+    AdblockPlus::PlatformFactory::CreationParameters params;
+    params.basePath = argv[2];
+    auto platform = AdblockPlus::PlatformFactory::CreatePlatform(std::move(params));
+    platform->SetUp(appInfo);
+    AdblockPlus::JsEngine& jsEngine =
+        static_cast<AdblockPlus::DefaultPlatform*>(platform.get())->GetJsEngine();
+    jsEngine.SetCodeCache(AdblockPlus::JsEngine::CodeCache(), true);
+
+    AdblockPlus::FilterEngineFactory::CreationParameters filterEngineParams;
+    filterEngineParams.preconfiguredPrefs.booleanPrefs.emplace(
+        AdblockPlus::FilterEngineFactory::BooleanPrefName::FirstRunSubscriptionAutoselect,
+        false);
+    filterEngineParams.preconfiguredPrefs.booleanPrefs.emplace(
+        AdblockPlus::FilterEngineFactory::BooleanPrefName::SynchronizationEnabled, false);
+    platform->CreateFilterEngineAsync(filterEngineParams);
+    platform->GetFilterEngine();
+
+    const auto data = AdblockPlus::JsEngine::SerializeCodeCache(jsEngine.GetCodeCache());
+    std::ofstream output(argv[1], std::ios_base::out | std::ios_base::binary);
+    output.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!output)
+    {
+      std::cerr << "Failed to write " << argv[1] << std::endl;
+      return 1;
+    }
+    std::cout << "Wrote " << jsEngine.GetCodeCache().size() << " entries to " << argv[1]
+              << std::endl;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
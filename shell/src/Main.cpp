@@ -21,10 +21,13 @@
 
 #include "../src/DefaultPlatform.h"
 #include "../src/JsEngine.h"
+#include "BenchCommand.h"
 #include "FiltersCommand.h"
 #include "GcCommand.h"
 #include "HelpCommand.h"
 #include "MatchesCommand.h"
+#include "ProfileCommand.h"
+#include "StatsCommand.h"
 #include "SubscriptionsCommand.h"
 
 #ifdef HAVE_CURL
@@ -67,9 +70,11 @@ int main()
     appInfo.locale = "en-US";
 
     AdblockPlus::PlatformFactory::CreationParameters params;
+    // Kept for the stats command, the platform only exposes it to the filter engine.
+    params.executor = AdblockPlus::PlatformFactory::CreateExecutor();
+    AdblockPlus::IExecutor& executor = *params.executor;
 
 #ifdef HAVE_CURL
-    params.executor = AdblockPlus::PlatformFactory::CreateExecutor();
     params.webRequest.reset(
         new AdblockPlus::DefaultWebRequest(*params.executor, std::make_unique<WebRequestCurl>()));
 #endif // HAVE_CURL
@@ -86,6 +91,10 @@ int main()
     Add(commands, std::make_unique<FiltersCommand>(filterEngine));
     Add(commands, std::make_unique<SubscriptionsCommand>(filterEngine));
     Add(commands, std::make_unique<MatchesCommand>(filterEngine));
+    Add(commands, std::make_unique<BenchCommand>(filterEngine, jsEngine));
+    Add(commands, std::make_unique<ProfileCommand>(jsEngine));
+    Add(commands,
+        std::make_unique<StatsCommand>(filterEngine, jsEngine, platform->GetTimer(), executor));
 
     std::string commandLine;
     while (ReadCommandLine(commandLine))
@@ -17,9 +17,59 @@
 
 #include "MatchesCommand.h"
 
+#include <fstream>
 #include <iostream>
 #include <sstream>
 
+#include "../src/Utils.h"
+
+namespace
+{
+  // Number of requests passed to MatchesBatch() at once, the results are
+  // written after each batch.
+  const size_t BATCH_SIZE = 1000;
+
+  struct BatchEntry
+  {
+    AdblockPlus::IFilterEngine::MatchRequest request;
+    std::string contentType;
+    std::string error;
+  };
+
+  // Parses `URL<TAB>CONTENT_TYPE[<TAB>DOCUMENT_URL[<TAB>SITEKEY]]`, where
+  // CONTENT_TYPE may list several types separated by commas.
+  BatchEntry ParseBatchLine(const std::string& line)
+  {
+    BatchEntry entry;
+    entry.request.contentTypeMask = 0;
+    entry.request.specificOnly = false;
+    std::istringstream lineStream(line);
+    std::getline(lineStream, entry.request.url, '\t');
+    std::getline(lineStream, entry.contentType, '\t');
+    std::getline(lineStream, entry.request.documentUrl, '\t');
+    std::getline(lineStream, entry.request.siteKey, '\t');
+
+    std::istringstream typeStream(entry.contentType);
+    std::string type;
+    while (std::getline(typeStream, type, ','))
+    {
+      try
+      {
+        entry.request.contentTypeMask |= AdblockPlus::IFilterEngine::StringToContentType(type);
+      }
+      catch (std::invalid_argument&)
+      {
+        entry.error = "unknown content type " + type;
+      }
+    }
+    if (entry.request.url.empty())
+      entry.error = "missing URL";
+    else if (!entry.request.contentTypeMask && entry.error.empty())
+      entry.error = "missing content type";
+    return entry;
+  }
+}
+
 MatchesCommand::MatchesCommand(AdblockPlus::IFilterEngine& filterEngine)
     : Command("matches"), filterEngine(filterEngine)
 {
@@ -30,6 +80,31 @@ void MatchesCommand::operator()(const std::string& arguments)
   std::istringstream argumentStream(arguments);
   std::string url;
   argumentStream >> url;
+  if (url == "batch")
+  {
+    std::string file;
+    argumentStream >> file;
+    std::string format = "tsv";
+    argumentStream >> format;
+    if (!file.size() || (format != "tsv" && format != "json"))
+    {
+      ShowUsage();
+      return;
+    }
+    if (file == "-")
+    {
+      MatchBatch(std::cin, format == "json");
+      return;
+    }
+    std::ifstream stream(file);
+    if (!stream.is_open())
+    {
+      std::cout << "Cannot read " << file << std::endl;
+      return;
+    }
+    MatchBatch(stream, format == "json");
+    return;
+  }
   std::string contentTypeStr;
   argumentStream >> contentTypeStr;
   std::string documentUrl;
@@ -65,10 +140,71 @@ void MatchesCommand::operator()(const std::string& arguments)
 
 std::string MatchesCommand::GetDescription() const
 {
-  return "Returns the first filter that matches the supplied URL";
+  return "Returns the first filter that matches the supplied URL, or with batch the ones "
+         "matching the requests of a file or of the standard input up to a line with a single "
+         "dot, one per line as URL, CONTENT_TYPE[,CONTENT_TYPE...], DOCUMENT_URL and SITEKEY "
+         "separated by tabs";
 }
 
 std::string MatchesCommand::GetUsage() const
 {
-  return name + " URL CONTENT_TYPE DOCUMENT_URL [SITEKEY]";
+  return name + " URL CONTENT_TYPE DOCUMENT_URL [SITEKEY] | " + name + " batch FILE|- [tsv|json]";
+}
+
+void MatchesCommand::MatchBatch(std::istream& input, bool json)
+{
+  std::vector<BatchEntry> entries;
+  std::string line;
+  bool done = false;
+  while (!done)
+  {
+    done = !std::getline(input, line) || line == ".";
+    if (!done && (line.empty() || line[0] == '#'))
+      continue;
+    if (!done)
+      entries.push_back(ParseBatchLine(line));
+    if (entries.empty() || (!done && entries.size() < BATCH_SIZE))
+      continue;
+
+    std::vector<AdblockPlus::IFilterEngine::MatchRequest> requests;
+    for (const auto& entry : entries)
+    {
+      if (entry.error.empty())
+        requests.push_back(entry.request);
+    }
+    const std::vector<AdblockPlus::Filter> matches = filterEngine.MatchesBatch(requests);
+    auto match = matches.begin();
+    for (const auto& entry : entries)
+    {
+      std::string result = "error";
+      std::string details = entry.error;
+      if (entry.error.empty())
+      {
+        result = !match->IsValid() ? "none"
+                 : match->GetType() == AdblockPlus::IFilterImplementation::TYPE_EXCEPTION
+                     ? "allowlisted"
+                     : "blocked";
+        details = match->IsValid() ? match->GetRaw() : "";
+        ++match;
+      }
+      if (json)
+      {
+        std::string line = "{\"url\": ";
+        AdblockPlus::Utils::AppendJsonString(entry.request.url, &line);
+        line += ", \"contentType\": ";
+        AdblockPlus::Utils::AppendJsonString(entry.contentType, &line);
+        line += ", \"documentUrl\": ";
+        AdblockPlus::Utils::AppendJsonString(entry.request.documentUrl, &line);
+        line += ", \"result\": \"" + result + "\", ";
+        line += entry.error.empty() ? "\"filter\": " : "\"error\": ";
+        AdblockPlus::Utils::AppendJsonString(details, &line);
+        std::cout << line << "}\n";
+      }
+      else
+        std::cout << entry.request.url << '\t' << entry.contentType << '\t'
+                  << entry.request.documentUrl << '\t' << result << '\t' << details << '\n';
+    }
+    std::cout.flush();
+    entries.clear();
+  }
 }
@@ -18,6 +18,7 @@
 #pragma once
 
 #include <AdblockPlus.h>
+#include <istream>
 
 #include "Command.h"
 
@@ -31,4 +32,6 @@ public:
 
 private:
   AdblockPlus::IFilterEngine& filterEngine;
+
+  void MatchBatch(std::istream& input, bool json);
 };
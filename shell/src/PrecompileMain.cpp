@@ -0,0 +1,154 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <AdblockPlus.h>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <thread>
+
+#include "../src/DefaultPlatform.h"
+#include "../src/JsEngine.h"
+
+namespace
+{
+  const std::chrono::milliseconds POLL_INTERVAL(100);
+  const std::chrono::seconds TIMEOUT(120);
+
+  class FileResourceReader : public AdblockPlus::IResourceReader
+  {
+  public:
+    explicit FileResourceReader(std::map<std::string, std::string> files) : files(std::move(files))
+    {
+    }
+
+    void ReadPreloadedFilterList(const std::string& url,
+                                 const ReadCallback& doneCallback) const override
+    {
+      auto it = files.find(url);
+      if (it == files.end())
+        doneCallback(std::make_unique<AdblockPlus::StringPreloadedFilterResponse>());
+      else
+        doneCallback(std::make_unique<AdblockPlus::MappedPreloadedFilterResponse>(it->second));
+    }
+
+  private:
+    std::map<std::string, std::string> files;
+  };
+
+  bool WaitFor(const std::function<bool()>& condition)
+  {
+    const auto deadline = std::chrono::steady_clock::now() + TIMEOUT;
+    while (!condition())
+    {
+      if (std::chrono::steady_clock::now() > deadline)
+        return false;
+      std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+    return true;
+  }
+
+  bool FileExists(const std::string& path)
+  {
+    return std::ifstream(path).good();
+  }
+}
+
+// Creates a filter engine with the given filter lists as preloaded
+// subscriptions and lets it save them, to be returned by
+// IResourceReader::ReadPrecompiledFilterStorage(). The filter storage is
+// written in the binary format along with the index of the native matcher,
+// so the first run neither parses the lists nor builds the index.
+int main(int argc, char* argv[])
+{
+  if (argc < 4 || argc % 2)
+  {
+    std::cerr << "Usage: " << argv[0]
+              << " <empty output directory> <subscription URL> <filter list file>..."
+              << std::endl;
+    return 1;
+  }
+
+  try
+  {
+    const std::string outputDirectory = argv[1];
+    std::map<std::string, std::string> files;
+    for (int i = 2; i < argc; i += 2)
+      files[argv[i]] = argv[i + 1];
+
+    AdblockPlus::AppInfo appInfo;
+    appInfo.version = "1.0";
+    appInfo.name = "abpprecompile";
+    appInfo.application = "standalone";
+    appInfo.applicationVersion = "1.0";
+    appInfo.locale = "en-US";
+
+    AdblockPlus::PlatformFactory::CreationParameters params;
+    params.basePath = outputDirectory;
+    params.resourceReader.reset(new FileResourceReader(files));
+    auto platform = AdblockPlus::PlatformFactory::CreatePlatform(std::move(params));
+    platform->SetUp(appInfo);
+    AdblockPlus::JsEngine& jsEngine =
+        static_cast<AdblockPlus::DefaultPlatform*>(platform.get())->GetJsEngine();
+
+    AdblockPlus::FilterEngineFactory::CreationParameters filterEngineParams;
+    filterEngineParams.preconfiguredPrefs.booleanPrefs.emplace(
+        AdblockPlus::FilterEngineFactory::BooleanPrefName::FirstRunSubscriptionAutoselect,
+        false);
+    filterEngineParams.preconfiguredPrefs.booleanPrefs.emplace(
+        AdblockPlus::FilterEngineFactory::BooleanPrefName::SynchronizationEnabled, false);
+    filterEngineParams.binaryFilterStorage = true;
+    platform->CreateFilterEngineAsync(filterEngineParams);
+    auto& filterEngine = platform->GetFilterEngine();
+
+    for (const auto& file : files)
+      filterEngine.AddSubscription(filterEngine.GetSubscription(file.first));
+    const bool loaded = WaitFor([&filterEngine, &files] {
+      for (const auto& file : files)
+      {
+        if (filterEngine.GetSubscription(file.first).GetFilterCount() == 0)
+          return false;
+      }
+      return true;
+    });
+    if (!loaded)
+    {
+      std::cerr << "Failed to load the filter lists, are they empty?" << std::endl;
+      return 1;
+    }
+
+    jsEngine.Evaluate("require('filterStorage').filterStorage.saveToDisk()");
+    const std::string patternsFile = outputDirectory + "/patterns.ini";
+    const std::string indexFile = patternsFile + ".matcher";
+    if (!WaitFor([&patternsFile, &indexFile] {
+          return FileExists(patternsFile) && FileExists(indexFile);
+        }))
+    {
+      std::cerr << "Failed to write " << indexFile << std::endl;
+      return 1;
+    }
+    std::cout << "Wrote " << patternsFile << " and " << indexFile << std::endl;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ProfileCommand.h"
+
+#include <future>
+#include <iostream>
+#include <sstream>
+
+#include "../src/JsEngine.h"
+
+ProfileCommand::ProfileCommand(AdblockPlus::JsEngine& jsEngine)
+    : Command("profile"), jsEngine(jsEngine)
+{
+}
+
+void ProfileCommand::operator()(const std::string& arguments)
+{
+  std::istringstream argumentStream(arguments);
+  std::string action;
+  argumentStream >> action;
+  std::string fileName;
+  argumentStream >> fileName;
+  if (action.empty())
+  {
+    ShowUsage();
+    return;
+  }
+
+  if (action == "start")
+  {
+    if (fileName.empty())
+      ShowUsage();
+    else if (jsEngine.StartCpuProfile(fileName))
+      profileName = fileName;
+    else
+      std::cerr << "A CPU profile is being recorded already" << std::endl;
+  }
+  else if (action == "stop")
+  {
+    Wait(profileName + ".cpuprofile", [this](const AdblockPlus::IFileSystem::Callback& callback) {
+      jsEngine.StopCpuProfile(callback);
+    });
+  }
+  else if (action == "heap")
+  {
+    if (fileName.empty())
+    {
+      ShowUsage();
+      return;
+    }
+    Wait(fileName, [this, fileName](const AdblockPlus::IFileSystem::Callback& callback) {
+      jsEngine.TakeHeapSnapshot(fileName, callback);
+    });
+  }
+  else
+    throw NoSuchCommandError(name + " " + action);
+}
+
+std::string ProfileCommand::GetDescription() const
+{
+  return "Records a V8 CPU profile to NAME.cpuprofile or writes a heap snapshot";
+}
+
+std::string ProfileCommand::GetUsage() const
+{
+  return name + " start NAME|stop|heap FILE";
+}
+
+void ProfileCommand::Wait(
+    const std::string& fileName,
+    const std::function<void(const AdblockPlus::IFileSystem::Callback&)>& operation) const
+{
+  auto promise = std::make_shared<std::promise<std::string>>();
+  auto future = promise->get_future();
+  operation([promise](const std::string& error) { promise->set_value(error); });
+  const std::string error = future.get();
+  if (error.empty())
+    std::cout << "Wrote " << fileName << std::endl;
+  else
+    std::cerr << "Failed: " << error << std::endl;
+}
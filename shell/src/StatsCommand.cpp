@@ -0,0 +1,161 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StatsCommand.h"
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "../src/JsEngine.h"
+
+namespace
+{
+  std::string FormatHitRate(size_t hits, size_t misses)
+  {
+    if (hits + misses == 0)
+      return "-";
+    std::ostringstream rate;
+    rate << std::fixed << std::setprecision(1) << 100.0 * hits / (hits + misses) << "%";
+    return rate.str();
+  }
+
+  void ShowCache(const std::string& name, const AdblockPlus::IFilterEngine::MatchCacheStats& stats)
+  {
+    std::cout << name << ": " << stats.size << "/" << stats.capacity << " entries, " << stats.hits
+              << " hits, " << stats.misses << " misses, hit rate "
+              << FormatHitRate(stats.hits, stats.misses) << std::endl;
+  }
+
+  // Count and percentiles in microseconds, which are upper bounds of the
+  // histogram buckets.
+  void ShowHistogram(const std::string& name, const AdblockPlus::LatencyHistogram& histogram)
+  {
+    const uint64_t count = histogram.GetCount();
+    std::cout << std::left << std::setw(44) << name << std::right << std::setw(10) << count;
+    for (double percentile : {50.0, 90.0, 99.0})
+      std::cout << std::setw(10) << histogram.GetPercentile(percentile);
+    std::cout << std::setw(10) << histogram.maxMicroseconds << std::setw(10)
+              << (count ? histogram.totalMicroseconds / count : 0) << std::endl;
+  }
+}
+
+StatsCommand::StatsCommand(AdblockPlus::IFilterEngine& filterEngine,
+                           AdblockPlus::JsEngine& jsEngine,
+                           AdblockPlus::ITimer& timer,
+                           AdblockPlus::IExecutor& executor)
+    : Command("stats"), filterEngine(filterEngine), jsEngine(jsEngine), timer(timer),
+      executor(executor)
+{
+}
+
+void StatsCommand::operator()(const std::string& arguments)
+{
+  std::istringstream argumentStream(arguments);
+  std::string section;
+  argumentStream >> section;
+  if (section.empty() || section == "heap")
+    ShowHeap();
+  if (section.empty() || section == "engine")
+    ShowEngine();
+  if (section.empty() || section == "queues")
+    ShowQueues();
+  if (section.empty() || section == "latency")
+    ShowLatencies();
+  if (section.empty() || section == "subscriptions")
+    ShowSubscriptions();
+  if (!section.empty() && section != "heap" && section != "engine" && section != "queues" &&
+      section != "latency" && section != "subscriptions")
+    throw NoSuchCommandError(name + " " + section);
+}
+
+std::string StatsCommand::GetDescription() const
+{
+  return "Shows the V8 heap, filter and cache counters, queue depths, API latencies and the "
+         "memory held by each subscription";
+}
+
+std::string StatsCommand::GetUsage() const
+{
+  return name + " [heap|engine|queues|latency|subscriptions]";
+}
+
+void StatsCommand::ShowHeap() const
+{
+  const AdblockPlus::JsHeapStatistics heap = jsEngine.GetHeapStatistics();
+  std::cout << "V8 heap: " << heap.usedHeapSize / 1024 << " KB used of "
+            << heap.totalHeapSize / 1024 << " KB, limit " << heap.heapSizeLimit / 1024
+            << " KB, external " << heap.externalMemory / 1024 << " KB, malloced "
+            << heap.mallocedMemory / 1024 << " KB" << std::endl;
+  for (const auto& space : heap.spaces)
+    std::cout << "  " << std::left << std::setw(28) << space.name << std::right << std::setw(10)
+              << space.usedSize / 1024 << " KB used of " << space.size / 1024 << " KB"
+              << std::endl;
+}
+
+void StatsCommand::ShowEngine() const
+{
+  std::cout << "Filters: " << filterEngine.GetListedFilterCount() << " listed, subscriptions: "
+            << filterEngine.GetListedSubscriptionCount() << " listed" << std::endl;
+  ShowCache("Match cache", filterEngine.GetMatchCacheStats());
+  ShowCache("Style sheet cache", filterEngine.GetStyleSheetCacheStats());
+}
+
+void StatsCommand::ShowQueues() const
+{
+  const AdblockPlus::IExecutor::Stats executorStats = executor.GetStats();
+  std::cout << "Executor: " << executorStats.queuedTasks << " queued tasks, "
+            << executorStats.activeThreads << " active threads" << std::endl;
+  const AdblockPlus::ITimer::Stats timerStats = timer.GetStats();
+  std::cout << "Timer: " << timerStats.pendingTimers << " pending timers, "
+            << timerStats.wakeups << " wakeups" << std::endl;
+  std::cout << std::left << std::setw(44) << "Latency (us)" << std::right << std::setw(10)
+            << "Count" << std::setw(10) << "P50" << std::setw(10) << "P90" << std::setw(10)
+            << "P99" << std::setw(10) << "Max" << std::setw(10) << "Mean" << std::endl;
+  ShowHistogram("executor wait", executorStats.waitTime);
+  ShowHistogram("executor run", executorStats.runTime);
+  ShowHistogram("timer delay", timerStats.delay);
+  ShowHistogram("timer run", timerStats.runTime);
+}
+
+void StatsCommand::ShowLatencies() const
+{
+  const AdblockPlus::IFilterEngine::PerformanceStats stats = filterEngine.GetPerformanceStats();
+  if (stats.empty())
+  {
+    std::cout << "No API calls yet" << std::endl;
+    return;
+  }
+  std::cout << std::left << std::setw(44) << "API latency (us)" << std::right << std::setw(10)
+            << "Count" << std::setw(10) << "P50" << std::setw(10) << "P90" << std::setw(10)
+            << "P99" << std::setw(10) << "Max" << std::setw(10) << "Mean" << std::endl;
+  for (const auto& it : stats)
+  {
+    ShowHistogram(it.first, it.second.execution);
+    ShowHistogram(it.first + " lock wait", it.second.lockWait);
+  }
+}
+
+void StatsCommand::ShowSubscriptions() const
+{
+  std::cout << std::left << std::setw(60) << "Subscription" << std::right << std::setw(10)
+            << "filters" << std::setw(12) << "JS KB" << std::setw(12) << "native KB" << std::endl;
+  for (const auto& usage : filterEngine.GetSubscriptionMemoryUsage())
+    std::cout << std::left << std::setw(60) << usage.url << std::right << std::setw(10)
+              << usage.filterCount << std::setw(12) << usage.jsHeapSize / 1024 << std::setw(12)
+              << usage.nativeSize / 1024 << std::endl;
+}
@@ -0,0 +1,47 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <AdblockPlus.h>
+#include <string>
+
+#include "Command.h"
+
+class StatsCommand : public Command
+{
+public:
+  StatsCommand(AdblockPlus::IFilterEngine& filterEngine,
+               AdblockPlus::JsEngine& jsEngine,
+               AdblockPlus::ITimer& timer,
+               AdblockPlus::IExecutor& executor);
+  void operator()(const std::string& arguments);
+  std::string GetDescription() const;
+  std::string GetUsage() const;
+
+private:
+  AdblockPlus::IFilterEngine& filterEngine;
+  AdblockPlus::JsEngine& jsEngine;
+  AdblockPlus::ITimer& timer;
+  AdblockPlus::IExecutor& executor;
+
+  void ShowHeap() const;
+  void ShowEngine() const;
+  void ShowQueues() const;
+  void ShowLatencies() const;
+  void ShowSubscriptions() const;
+};
@@ -22,10 +22,21 @@
 #include <algorithm>
 #include <cctype>
 #include <curl/curl.h>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <thread>
 
 namespace
 {
+  // More connections to a host are only opened for HTTP/1 hosts.
+  const long MAX_HOST_CONNECTIONS = 6;
+  // The longest time the transfers are left alone, the cancellation of a
+  // request is noticed within it.
+  const int POLL_TIMEOUT_MS = 1000;
+
   struct HeaderData
   {
     int status;
@@ -76,8 +87,8 @@ namespace
 
   size_t ReceiveData(char* ptr, size_t size, size_t nmemb, void* userdata)
   {
-    std::stringstream* stream = static_cast<std::stringstream*>(userdata);
-    stream->write(ptr, size * nmemb);
+    const auto* dataCallback = static_cast<const AdblockPlus::IWebRequest::DataCallback*>(userdata);
+    (*dataCallback)(ptr, size * nmemb);
     return nmemb;
   }
 
@@ -122,10 +133,198 @@ namespace
     }
     return nmemb;
   }
+
+  int CheckCancelled(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+  {
+    // A non-zero value aborts the transfer.
+    return static_cast<const AdblockPlus::CancellationToken*>(clientp)->IsCancelled() ? 1 : 0;
+  }
+}
+
+/**
+ * Runs the transfers of all requests on a thread of its own, the threads
+ * issuing the requests wait for their transfer to complete.
+ */
+class WebRequestCurl::Transfers
+{
+public:
+  Transfers() : multi(nullptr), share(nullptr), stopping(false)
+  {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    // The multi handle keeps the connections and the share handle the DNS
+    // entries and the TLS sessions, the easy handles are created per request.
+    share = curl_share_init();
+    if (share)
+    {
+      curl_share_setopt(share, CURLSHOPT_LOCKFUNC, Lock);
+      curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, Unlock);
+      curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+      curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+      curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+    multi = curl_multi_init();
+    if (multi)
+    {
+      curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+      curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, MAX_HOST_CONNECTIONS);
+      worker = std::thread([this] { Run(); });
+    }
+  }
+
+  ~Transfers()
+  {
+    if (worker.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      curl_multi_wakeup(multi);
+      worker.join();
+    }
+    if (multi)
+      curl_multi_cleanup(multi);
+    if (share)
+      curl_share_cleanup(share);
+    curl_global_cleanup();
+  }
+
+  CURLcode Perform(CURL* curl)
+  {
+    if (share)
+      curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    if (!multi)
+      return curl_easy_perform(curl);
+
+    Transfer transfer;
+    transfer.curl = curl;
+    auto done = transfer.done.get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (stopping)
+        return CURLE_FAILED_INIT;
+      queued.push_back(&transfer);
+    }
+    curl_multi_wakeup(multi);
+    return done.get();
+  }
+
+private:
+  struct Transfer
+  {
+    CURL* curl;
+    std::promise<CURLcode> done;
+  };
+
+  static void Lock(CURL*, curl_lock_data data, curl_lock_access, void* userptr)
+  {
+    static_cast<Transfers*>(userptr)->shareMutexes[data].lock();
+  }
+
+  static void Unlock(CURL*, curl_lock_data data, void* userptr)
+  {
+    static_cast<Transfers*>(userptr)->shareMutexes[data].unlock();
+  }
+
+  void Run()
+  {
+    std::set<Transfer*> active;
+    for (;;)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+          break;
+        for (Transfer* transfer : queued)
+        {
+          curl_easy_setopt(transfer->curl, CURLOPT_PRIVATE, transfer);
+          if (curl_multi_add_handle(multi, transfer->curl) == CURLM_OK)
+            active.insert(transfer);
+          else
+            transfer->done.set_value(CURLE_FAILED_INIT);
+        }
+        queued.clear();
+      }
+
+      int running = 0;
+      curl_multi_perform(multi, &running);
+      int remaining = 0;
+      while (CURLMsg* message = curl_multi_info_read(multi, &remaining))
+      {
+        if (message->msg != CURLMSG_DONE)
+          continue;
+        char* data = nullptr;
+        curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &data);
+        Transfer* transfer = reinterpret_cast<Transfer*>(data);
+        // The message is gone once the handle is removed.
+        const CURLcode code = message->data.result;
+        curl_multi_remove_handle(multi, transfer->curl);
+        active.erase(transfer);
+        transfer->done.set_value(code);
+      }
+      curl_multi_poll(multi, nullptr, 0, POLL_TIMEOUT_MS, nullptr);
+    }
+
+    for (Transfer* transfer : active)
+    {
+      curl_multi_remove_handle(multi, transfer->curl);
+      transfer->done.set_value(CURLE_ABORTED_BY_CALLBACK);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Transfer* transfer : queued)
+      transfer->done.set_value(CURLE_ABORTED_BY_CALLBACK);
+    queued.clear();
+  }
+
+  CURLM* multi;
+  CURLSH* share;
+  std::mutex shareMutexes[CURL_LOCK_DATA_LAST];
+  std::thread worker;
+  // Guards the members below.
+  std::mutex mutex;
+  bool stopping;
+  std::deque<Transfer*> queued;
+};
+
+WebRequestCurl::WebRequestCurl() : transfers(new Transfers())
+{
+}
+
+WebRequestCurl::~WebRequestCurl()
+{
 }
 
 AdblockPlus::ServerResponse WebRequestCurl::GET(const std::string& url,
                                                 const AdblockPlus::HeaderList& requestHeaders) const
+{
+  return GET(url, requestHeaders, AdblockPlus::CancellationToken());
+}
+
+AdblockPlus::ServerResponse
+WebRequestCurl::HEAD(const std::string& url, const AdblockPlus::HeaderList& requestHeaders) const
+{
+  return HEAD(url, requestHeaders, AdblockPlus::CancellationToken());
+}
+
+AdblockPlus::ServerResponse
+WebRequestCurl::GET(const std::string& url,
+                    const AdblockPlus::HeaderList& requestHeaders,
+                    const AdblockPlus::CancellationToken& cancellation) const
+{
+  std::string responseText;
+  auto result =
+      StreamGET(url, requestHeaders, cancellation, [&responseText](const char* data, size_t size) {
+        responseText.append(data, size);
+      });
+  result.responseText = std::move(responseText);
+  return result;
+}
+
+AdblockPlus::ServerResponse
+WebRequestCurl::StreamGET(const std::string& url,
+                          const AdblockPlus::HeaderList& requestHeaders,
+                          const AdblockPlus::CancellationToken& cancellation,
+                          const AdblockPlus::IWebRequest::DataCallback& dataCallback) const
 {
   AdblockPlus::ServerResponse result;
   result.status = AdblockPlus::IWebRequest::NS_ERROR_NOT_INITIALIZED;
@@ -134,7 +333,7 @@ AdblockPlus::ServerResponse WebRequestCurl::GET(const std::string& url,
   CURL* curl = curl_easy_init();
   if (curl)
   {
-    execute(curl, url, requestHeaders, result);
+    execute(curl, url, requestHeaders, cancellation, dataCallback, result);
     curl_easy_cleanup(curl);
   }
 
@@ -142,7 +341,9 @@ AdblockPlus::ServerResponse WebRequestCurl::GET(const std::string& url,
 }
 
 AdblockPlus::ServerResponse
-WebRequestCurl::HEAD(const std::string& url, const AdblockPlus::HeaderList& requestHeaders) const
+WebRequestCurl::HEAD(const std::string& url,
+                     const AdblockPlus::HeaderList& requestHeaders,
+                     const AdblockPlus::CancellationToken& cancellation) const
 {
   AdblockPlus::ServerResponse result;
   result.status = AdblockPlus::IWebRequest::NS_ERROR_NOT_INITIALIZED;
@@ -152,7 +353,7 @@ WebRequestCurl::HEAD(const std::string& url, const AdblockPlus::HeaderList& requ
   if (curl)
   {
     curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
-    execute(curl, url, requestHeaders, result);
+    execute(curl, url, requestHeaders, cancellation, [](const char*, size_t) {}, result);
     curl_easy_cleanup(curl);
   }
 
@@ -162,18 +363,29 @@ WebRequestCurl::HEAD(const std::string& url, const AdblockPlus::HeaderList& requ
 void WebRequestCurl::execute(CURL* curl,
                              const std::string& url,
                              const AdblockPlus::HeaderList& requestHeaders,
+                             const AdblockPlus::CancellationToken& cancellation,
+                             const AdblockPlus::IWebRequest::DataCallback& dataCallback,
                              AdblockPlus::ServerResponse& result) const
 {
-  std::stringstream responseText;
   HeaderData headerData;
   curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
   curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ReceiveData);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseText);
+  curl_easy_setopt(
+      curl, CURLOPT_WRITEDATA, const_cast<AdblockPlus::IWebRequest::DataCallback*>(&dataCallback));
   // Request compressed data. Using any supported aglorithm
   curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
   curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, ReceiveHeader);
   curl_easy_setopt(curl, CURLOPT_HEADERDATA, &headerData);
+  curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, CheckCancelled);
+  curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &cancellation);
+  curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+  // The transfers run on another thread.
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  // Wait for a connection to the host which is being set up, it might turn
+  // out to support multiplexing, rather than opening one more.
+  curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
 
   struct curl_slist* headerList = 0;
   for (const auto& header : requestHeaders)
@@ -183,9 +395,8 @@ void WebRequestCurl::execute(CURL* curl,
   if (headerList)
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerList);
 
-  result.status = ConvertErrorCode(curl_easy_perform(curl));
+  result.status = ConvertErrorCode(transfers->Perform(curl));
   result.responseStatus = headerData.status;
-  result.responseText = responseText.str();
 
   for (const auto& header : headerData.headers)
   {
@@ -2,20 +2,50 @@
 
 #ifdef HAVE_CURL
 
+#include <memory>
+
 #include "../src/DefaultWebRequest.h"
 
+/**
+ * Web request implementation using libcurl. The requests of all threads are
+ * driven by one multi handle, so connections to a host are kept open and
+ * reused, and requests to an HTTP/2 host are multiplexed over one connection.
+ * DNS lookups and TLS sessions are cached across requests too.
+ */
 class WebRequestCurl : public AdblockPlus::IWebRequestSync
 {
 public:
+  WebRequestCurl();
+  ~WebRequestCurl();
+
   AdblockPlus::ServerResponse GET(const std::string& url,
                                   const AdblockPlus::HeaderList& requestHeaders) const override;
   AdblockPlus::ServerResponse HEAD(const std::string& url,
                                    const AdblockPlus::HeaderList& requestHeaders) const override;
+  AdblockPlus::ServerResponse
+  GET(const std::string& url,
+      const AdblockPlus::HeaderList& requestHeaders,
+      const AdblockPlus::CancellationToken& cancellation) const override;
+  AdblockPlus::ServerResponse
+  HEAD(const std::string& url,
+       const AdblockPlus::HeaderList& requestHeaders,
+       const AdblockPlus::CancellationToken& cancellation) const override;
+  AdblockPlus::ServerResponse
+  StreamGET(const std::string& url,
+            const AdblockPlus::HeaderList& requestHeaders,
+            const AdblockPlus::CancellationToken& cancellation,
+            const AdblockPlus::IWebRequest::DataCallback& dataCallback) const override;
 
 private:
+  class Transfers;
+
+  std::unique_ptr<Transfers> transfers;
+
   void execute(void* curl,
                const std::string& url,
                const AdblockPlus::HeaderList& requestHeaders,
+               const AdblockPlus::CancellationToken& cancellation,
+               const AdblockPlus::IWebRequest::DataCallback& dataCallback,
                AdblockPlus::ServerResponse& result) const;
 };
 
@@ -16,11 +16,14 @@
  */
 #include "ActiveObject.h"
 
+#include "Thread.h"
+
 using namespace AdblockPlus;
 
-ActiveObject::ActiveObject() : isRunning(true)
+ActiveObject::ActiveObject(const ThreadOptions& threadOptions) : isRunning(true)
 {
-  thread = std::thread([this] {
+  thread = std::thread([this, threadOptions] {
+    ApplyThreadOptions(threadOptions);
     ThreadFunc();
   });
 }
@@ -37,28 +40,33 @@ void ActiveObject::Post(const Call& call)
 {
   if (!call)
     return;
-  calls.push_back(call);
+  calls.Push(call);
 }
 
 void ActiveObject::Post(Call&& call)
 {
   if (!call)
     return;
-  calls.push_back(std::move(call));
+  calls.Push(std::move(call));
 }
 
 void ActiveObject::ThreadFunc()
 {
+  std::vector<Call> pending;
   while (isRunning)
   {
-    Call call = calls.pop_front();
-    try
-    {
-      call();
-    }
-    catch (...)
+    calls.PopAll(&pending);
+    for (auto it = pending.begin(); it != pending.end() && isRunning; ++it)
     {
-      // do nothing, but the thread will be alive.
+      try
+      {
+        (*it)();
+      }
+      catch (...)
+      {
+        // do nothing, but the thread will be alive.
+      }
     }
+    pending.clear();
   }
 }
@@ -16,10 +16,11 @@
  */
 #pragma once
 #include <functional>
-#include <list>
 #include <thread>
 
-#include "SynchronizedCollection.h"
+#include <AdblockPlus/ThreadOptions.h>
+
+#include "MpscQueue.h"
 
 namespace AdblockPlus
 {
@@ -38,8 +39,9 @@ namespace AdblockPlus
 
     /**
      * Constructor, the background thread is started after finishing this call.
+     * @param threadOptions Scheduling settings of the background thread.
      */
-    ActiveObject();
+    explicit ActiveObject(const ThreadOptions& threadOptions = ThreadOptions());
 
     /**
      * Destructor, it waits for finishing of all already posted calls.
@@ -58,7 +60,7 @@ namespace AdblockPlus
 
   private:
     bool isRunning;
-    SynchronizedCollection<std::list<Call>> calls;
+    MpscQueue<Call> calls;
     std::thread thread;
   };
 }
\ No newline at end of file
@@ -0,0 +1,63 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ApiCallStats.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  thread_local ScopedApiCall* currentCall = nullptr;
+}
+
+IFilterEngine::CallStats ApiCallRecorder::GetSnapshot() const
+{
+  return {calls.load(std::memory_order_relaxed), lockWait.GetSnapshot(), execution.GetSnapshot()};
+}
+
+ScopedApiCall::ScopedApiCall(ApiCallRecorder& recorder)
+    : recorder_(currentCall ? nullptr : &recorder), lockWait_(0)
+{
+  if (!recorder_)
+    return;
+  currentCall = this;
+  start_ = std::chrono::steady_clock::now();
+}
+
+ScopedApiCall::~ScopedApiCall()
+{
+  if (!recorder_)
+    return;
+  const auto elapsed = std::chrono::steady_clock::now() - start_;
+  currentCall = nullptr;
+  recorder_->calls.fetch_add(1, std::memory_order_relaxed);
+  recorder_->lockWait.Record(lockWait_);
+  recorder_->execution.Record(elapsed - lockWait_);
+}
+
+// static
+bool ScopedApiCall::IsActive()
+{
+  return currentCall != nullptr;
+}
+
+// static
+void ScopedApiCall::AddLockWait(std::chrono::steady_clock::duration wait)
+{
+  if (currentCall)
+    currentCall->lockWait_ += wait;
+}
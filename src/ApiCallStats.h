@@ -0,0 +1,75 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include <AdblockPlus/IFilterEngine.h>
+
+#include "LatencyRecorder.h"
+
+namespace AdblockPlus
+{
+  /**
+   * Call count and latencies of a method.
+   */
+  struct ApiCallRecorder
+  {
+    ApiCallRecorder() : calls(0)
+    {
+    }
+
+    IFilterEngine::CallStats GetSnapshot() const;
+
+    std::atomic<uint64_t> calls;
+    LatencyRecorder lockWait;
+    LatencyRecorder execution;
+  };
+
+  /**
+   * Records a call in an `ApiCallRecorder` when going out of scope. Each
+   * JsContext created on the same thread in the meantime adds the time it
+   * waited for the engine lock. Nested calls on the same thread are not
+   * recorded separately, they count towards the outermost one.
+   */
+  class ScopedApiCall
+  {
+  public:
+    explicit ScopedApiCall(ApiCallRecorder& recorder);
+    ~ScopedApiCall();
+    ScopedApiCall(const ScopedApiCall&) = delete;
+    ScopedApiCall& operator=(const ScopedApiCall&) = delete;
+
+    /**
+     * @return `true` if a call is being recorded on the current thread.
+     */
+    static bool IsActive();
+
+    /**
+     * Adds to the lock wait time of the call recorded on the current thread,
+     * if any.
+     */
+    static void AddLockWait(std::chrono::steady_clock::duration wait);
+
+  private:
+    ApiCallRecorder* recorder_;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::duration lockWait_;
+  };
+}
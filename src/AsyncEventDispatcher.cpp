@@ -0,0 +1,143 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "AsyncEventDispatcher.h"
+
+#include <algorithm>
+
+using namespace AdblockPlus;
+
+AsyncEventDispatcher::AsyncEventDispatcher(Observer* observer, const Options& options)
+    : observer_(observer), options_(options)
+{
+  thread_ = std::thread([this] { ThreadFunc(); });
+}
+
+AsyncEventDispatcher::~AsyncEventDispatcher()
+{
+  Stop();
+}
+
+void AsyncEventDispatcher::Post(FilterEvent event, IFilterEngine::FilterInfo&& filter)
+{
+  Event queued;
+  queued.isFilterEvent = true;
+  queued.filterEvent = event;
+  queued.filter = std::move(filter);
+  Push(std::move(queued));
+}
+
+void AsyncEventDispatcher::Post(SubscriptionEvent event,
+                                IFilterEngine::SubscriptionInfo&& subscription)
+{
+  Event queued;
+  queued.isFilterEvent = false;
+  queued.subscriptionEvent = event;
+  queued.subscription = std::move(subscription);
+  Push(std::move(queued));
+}
+
+void AsyncEventDispatcher::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    queue_.clear();
+  }
+  notEmpty_.notify_one();
+  notFull_.notify_all();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+bool AsyncEventDispatcher::Event::Supersedes(const Event& other) const
+{
+  if (isFilterEvent != other.isFilterEvent)
+    return false;
+  if (isFilterEvent)
+    return filterEvent == other.filterEvent && filter.text == other.filter.text;
+  return subscriptionEvent == other.subscriptionEvent &&
+         subscription.url == other.subscription.url;
+}
+
+void AsyncEventDispatcher::Push(Event&& event)
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopping_)
+      return;
+    if (queue_.size() >= std::max<size_t>(options_.queueSize, 1))
+    {
+      switch (options_.overflowPolicy)
+      {
+      case IFilterEngine::OverflowPolicy::DROP:
+        return;
+      case IFilterEngine::OverflowPolicy::COALESCE:
+      {
+        auto superseded = std::find_if(queue_.begin(), queue_.end(), [&event](const Event& queued) {
+          return event.Supersedes(queued);
+        });
+        if (superseded != queue_.end())
+        {
+          *superseded = std::move(event);
+          return;
+        }
+        queue_.pop_front();
+        break;
+      }
+      case IFilterEngine::OverflowPolicy::BLOCK:
+        notFull_.wait(lock, [this]() {
+          return stopping_ || queue_.size() < std::max<size_t>(options_.queueSize, 1);
+        });
+        if (stopping_)
+          return;
+        break;
+      }
+    }
+    queue_.push_back(std::move(event));
+  }
+  notEmpty_.notify_one();
+}
+
+void AsyncEventDispatcher::ThreadFunc()
+{
+  while (true)
+  {
+    Event event;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      notEmpty_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      if (stopping_)
+        return;
+      event = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    notFull_.notify_one();
+    try
+    {
+      if (event.isFilterEvent)
+        observer_->OnFilterEvent(event.filterEvent, event.filter);
+      else
+        observer_->OnSubscriptionEvent(event.subscriptionEvent, event.subscription);
+    }
+    catch (...)
+    {
+      // do nothing, but the thread will be alive.
+    }
+  }
+}
@@ -0,0 +1,94 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <AdblockPlus/IFilterEngine.h>
+
+namespace AdblockPlus
+{
+  /**
+   * Delivers events to an IFilterEngine::AsyncEventObserver on a thread of
+   * its own, in the spirit of ActiveObject but with a bounded queue, see
+   * IFilterEngine::AddAsyncEventObserver().
+   *
+   * Post() may be called from any thread, typically with the engine locked.
+   * The observer is called without any lock held.
+   */
+  class AsyncEventDispatcher
+  {
+  public:
+    typedef IFilterEngine::AsyncEventObserver Observer;
+    typedef IFilterEngine::AsyncObserverOptions Options;
+    typedef IFilterEngine::FilterEvent FilterEvent;
+    typedef IFilterEngine::SubscriptionEvent SubscriptionEvent;
+
+    /**
+     * Starts the thread.
+     * @param observer Observer receiving the events.
+     * @param options Queue size and overflow policy.
+     */
+    AsyncEventDispatcher(Observer* observer, const Options& options);
+
+    /**
+     * Calls Stop().
+     */
+    ~AsyncEventDispatcher();
+
+    void Post(FilterEvent event, IFilterEngine::FilterInfo&& filter);
+    void Post(SubscriptionEvent event, IFilterEngine::SubscriptionInfo&& subscription);
+
+    /**
+     * Drops the queued events and waits for the thread, which may still be
+     * delivering an event, to finish. Must not be called by the observer.
+     */
+    void Stop();
+
+  private:
+    AsyncEventDispatcher(const AsyncEventDispatcher&) = delete;
+    AsyncEventDispatcher& operator=(const AsyncEventDispatcher&) = delete;
+
+    struct Event
+    {
+      bool isFilterEvent;
+      FilterEvent filterEvent;
+      SubscriptionEvent subscriptionEvent;
+      IFilterEngine::FilterInfo filter;
+      IFilterEngine::SubscriptionInfo subscription;
+
+      bool Supersedes(const Event& other) const;
+    };
+
+    void Push(Event&& event);
+    void ThreadFunc();
+
+    Observer* const observer_;
+    const Options options_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<Event> queue_;
+    bool stopping_ = false;
+    std::thread thread_;
+  };
+}
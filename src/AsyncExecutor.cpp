@@ -17,8 +17,29 @@
 
 #include "AsyncExecutor.h"
 
+#include <algorithm>
+#include <future>
+
+#include "Thread.h"
+
 using namespace AdblockPlus;
 
+namespace
+{
+  typedef std::chrono::steady_clock Clock;
+
+  void RunTask(const std::function<void()>& task,
+               Clock::time_point dispatchedAt,
+               LatencyRecorder& waitTime,
+               LatencyRecorder& runTime)
+  {
+    const auto startedAt = Clock::now();
+    waitTime.Record(startedAt - dispatchedAt);
+    task();
+    runTime.Record(Clock::now() - startedAt);
+  }
+}
+
 void AsyncExecutor::SyncThreads::SpawnThread(std::function<void(iterator)>&& task)
 {
   std::lock_guard<std::mutex> lock(mutex);
@@ -47,6 +68,29 @@ void AsyncExecutor::SyncThreads::WaitUtilEmpty()
   });
 }
 
+bool AsyncExecutor::SyncThreads::WaitUtilEmpty(std::chrono::steady_clock::time_point deadline)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  return conditionVar.wait_until(lock, deadline, [this]() -> bool {
+    return collection.empty();
+  });
+}
+
+void AsyncExecutor::SyncThreads::DetachAll()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto& thread : collection)
+  {
+    if (thread.joinable())
+      thread.detach();
+  }
+  collection.clear();
+}
+
+AsyncExecutor::AsyncExecutor() : abandonment(std::make_shared<Abandonment>())
+{
+}
+
 AsyncExecutor::~AsyncExecutor()
 {
   threads.WaitUtilEmpty();
@@ -56,10 +100,232 @@ void AsyncExecutor::Dispatch(const std::function<void()>& call)
 {
   if (!call)
     return;
-  threads.SpawnThread([this, call](SyncThreads::iterator threadIterator) {
+  const auto dispatchedAt = Clock::now();
+  ++startingTasks;
+  auto state = abandonment;
+  threads.SpawnThread([this, state, call, dispatchedAt](
+                          SyncThreads::iterator threadIterator) {
+    Clock::time_point startedAt;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (state->abandoned)
+        return;
+      --startingTasks;
+      ++runningTasks;
+      startedAt = Clock::now();
+      waitTime.Record(startedAt - dispatchedAt);
+    }
     call();
+    const auto ranFor = Clock::now() - startedAt;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->abandoned)
+      return;
+    runTime.Record(ranFor);
+    --runningTasks;
     threadCollector.Post([this, threadIterator] {
       threads.TakeOut(threadIterator).join();
     });
   });
 }
+
+void AsyncExecutor::Abandon(std::chrono::milliseconds timeout)
+{
+  const auto now = Clock::now();
+  // Avoid overflowing for huge timeouts, e.g. `milliseconds::max()`.
+  const auto remaining =
+      std::chrono::duration_cast<std::chrono::milliseconds>(Clock::time_point::max() - now);
+  const auto deadline = timeout < remaining ? now + timeout : Clock::time_point::max();
+  if (threads.WaitUtilEmpty(deadline))
+    return;
+  {
+    std::lock_guard<std::mutex> lock(abandonment->mutex);
+    abandonment->abandoned = true;
+  }
+  // Join the threads which were handed over to the collector before.
+  std::promise<void> collected;
+  threadCollector.Post([&collected] { collected.set_value(); });
+  collected.get_future().wait();
+  threads.DetachAll();
+}
+
+IExecutor::Stats AsyncExecutor::GetStats() const
+{
+  return {startingTasks.load(), runningTasks.load(), waitTime.GetSnapshot(), runTime.GetSnapshot()};
+}
+
+ThreadPoolExecutor::State::State(size_t maxNetworkThreads,
+                                 std::chrono::milliseconds idleTimeout,
+                                 const ThreadOptions& threadOptions)
+    : maxNetworkThreads(maxNetworkThreads), idleTimeout(idleTimeout), threadOptions(threadOptions),
+      networkThreads(0), runningTasks(0), idleThreads(0), stopped(false)
+{
+}
+
+ThreadPoolExecutor::ThreadPoolExecutor(size_t maxThreads,
+                                       std::chrono::milliseconds idleTimeout,
+                                       const ThreadOptions& threadOptions)
+    : maxThreads(std::max<size_t>(maxThreads, 1)), cancellation(CancellationToken::Create()),
+      state(std::make_shared<State>(
+          std::max<size_t>(this->maxThreads - 1, 1), idleTimeout, threadOptions))
+{
+}
+
+ThreadPoolExecutor::~ThreadPoolExecutor()
+{
+  Shutdown(false);
+}
+
+void ThreadPoolExecutor::Dispatch(const std::function<void()>& call)
+{
+  Dispatch(call, TaskClass::BACKGROUND);
+}
+
+void ThreadPoolExecutor::Dispatch(const std::function<void()>& call, TaskClass taskClass)
+{
+  if (!call)
+    return;
+  std::vector<std::thread> exited;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->stopped)
+      return;
+    state->tasks[static_cast<size_t>(taskClass)].push_back({call, Clock::now()});
+    exited.swap(state->exitedThreads);
+    // A notified thread might not have taken its task yet, so compare with
+    // the number of queued tasks instead of checking for any idle thread.
+    if (state->idleThreads >= state->GetQueuedTaskCount() || state->threads.size() >= maxThreads)
+      state->taskAdded.notify_one();
+    else
+    {
+      auto threadIterator = state->threads.emplace(state->threads.end());
+      auto sharedState = state;
+      *threadIterator =
+          std::thread([sharedState, threadIterator] { sharedState->ThreadFunc(threadIterator); });
+    }
+  }
+  for (auto& thread : exited)
+    thread.join();
+}
+
+void ThreadPoolExecutor::Stop()
+{
+  cancellation.Cancel();
+  Shutdown(true);
+}
+
+CancellationToken ThreadPoolExecutor::GetCancellationToken()
+{
+  return cancellation;
+}
+
+void ThreadPoolExecutor::Shutdown(bool dropTasks)
+{
+  Threads stoppedThreads;
+  std::vector<std::thread> exited;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->stopped = true;
+    if (dropTasks)
+    {
+      for (auto& queue : state->tasks)
+        queue.clear();
+    }
+    stoppedThreads.swap(state->threads);
+    exited.swap(state->exitedThreads);
+  }
+  state->taskAdded.notify_all();
+  for (auto& thread : exited)
+    thread.join();
+  for (auto& thread : stoppedThreads)
+  {
+    // Stopping from within a task must not join the thread running it, the
+    // thread only uses the state, which it co-owns, afterwards.
+    if (thread.get_id() == std::this_thread::get_id())
+      thread.detach();
+    else
+      thread.join();
+  }
+}
+
+size_t ThreadPoolExecutor::GetThreadCount()
+{
+  std::lock_guard<std::mutex> lock(state->mutex);
+  return state->threads.size();
+}
+
+IExecutor::Stats ThreadPoolExecutor::GetStats()
+{
+  std::lock_guard<std::mutex> lock(state->mutex);
+  return {state->GetQueuedTaskCount(),
+          state->runningTasks,
+          state->waitTime.GetSnapshot(),
+          state->runTime.GetSnapshot()};
+}
+
+ThreadPoolExecutor::Tasks* ThreadPoolExecutor::State::GetRunnableTasks()
+{
+  for (auto& queue : tasks)
+  {
+    if (queue.empty())
+      continue;
+    if (&queue == &tasks[static_cast<size_t>(TaskClass::NETWORK)] &&
+        networkThreads >= maxNetworkThreads)
+      return nullptr;
+    return &queue;
+  }
+  return nullptr;
+}
+
+size_t ThreadPoolExecutor::State::GetQueuedTaskCount() const
+{
+  size_t count = 0;
+  for (const auto& queue : tasks)
+    count += queue.size();
+  return count;
+}
+
+void ThreadPoolExecutor::State::ThreadFunc(Threads::iterator self)
+{
+  ApplyThreadOptions(threadOptions);
+  std::unique_lock<std::mutex> lock(mutex);
+  // Once stopped the remaining tasks are still executed, unless dropped.
+  while (!stopped || GetQueuedTaskCount() != 0)
+  {
+    if (Tasks* queue = GetRunnableTasks())
+    {
+      const bool network = queue == &tasks[static_cast<size_t>(TaskClass::NETWORK)];
+      auto task = std::move(queue->front());
+      queue->pop_front();
+      if (network)
+        ++networkThreads;
+      ++runningTasks;
+      lock.unlock();
+      RunTask(task.call, task.dispatchedAt, waitTime, runTime);
+      task.call = nullptr;
+      lock.lock();
+      --runningTasks;
+      if (network)
+      {
+        --networkThreads;
+        // Another thread might wait for a network task to become runnable.
+        taskAdded.notify_all();
+      }
+      continue;
+    }
+    ++idleThreads;
+    const bool hasWork = taskAdded.wait_for(lock, idleTimeout, [this]() -> bool {
+      return GetRunnableTasks() || (stopped && GetQueuedTaskCount() == 0);
+    });
+    --idleThreads;
+    if (!hasWork)
+    {
+      // After stopping the thread is joined by Shutdown().
+      if (!stopped)
+      {
+        exitedThreads.push_back(std::move(*self));
+        threads.erase(self);
+      }
+      return;
+    }
+  }
+}
@@ -16,9 +16,19 @@
  */
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <vector>
+
 #include <AdblockPlus/IExecutor.h>
+#include <AdblockPlus/ThreadOptions.h>
 
 #include "ActiveObject.h"
+#include "LatencyRecorder.h"
 
 namespace AdblockPlus
 {
@@ -44,6 +54,9 @@ namespace AdblockPlus
       void SpawnThread(std::function<void(iterator)>&& task);
       std::thread TakeOut(iterator pos);
       void WaitUtilEmpty();
+      // Returns `false` if there are still threads at `deadline`.
+      bool WaitUtilEmpty(std::chrono::steady_clock::time_point deadline);
+      void DetachAll();
 
     protected:
       Threads collection;
@@ -51,9 +64,20 @@ namespace AdblockPlus
       std::condition_variable conditionVar;
     };
 
+    // Lets the threads find out whether the executor has given up on them,
+    // they must not access it anymore then.
+    struct Abandonment
+    {
+      std::mutex mutex;
+      bool abandoned = false;
+    };
+
   public:
+    AsyncExecutor();
+
     /**
-     * Destructor, it waits for finishing of all already dispatched tasks.
+     * Destructor, it waits for finishing of all already dispatched tasks
+     * unless `Abandon` had been called.
      */
     ~AsyncExecutor();
 
@@ -65,7 +89,26 @@ namespace AdblockPlus
      */
     void Dispatch(const std::function<void()>& call);
 
+    /**
+     * @return Current statistics, tasks are queued while their thread is
+     *         being started.
+     */
+    IExecutor::Stats GetStats() const;
+
+    /**
+     * Waits up to `timeout` for finishing of the dispatched tasks, then the
+     * threads of the running ones are detached and the ones which have not
+     * started yet are dropped. Tasks must not access anything which might
+     * be gone by then once their cancellation token is cancelled.
+     */
+    void Abandon(std::chrono::milliseconds timeout);
+
   private:
+    std::shared_ptr<Abandonment> abandonment;
+    std::atomic<size_t> startingTasks{0};
+    std::atomic<size_t> runningTasks{0};
+    LatencyRecorder waitTime;
+    LatencyRecorder runTime;
     SyncThreads threads;
     ActiveObject threadCollector;
   };
@@ -84,7 +127,8 @@ namespace AdblockPlus
      *
      * Initially constructed the class behaves as `AsyncExecutor`.
      */
-    OptionalAsyncExecutor() : executor(new AsyncExecutor())
+    OptionalAsyncExecutor()
+        : executor(new AsyncExecutor()), cancellation(CancellationToken::Create())
     {
     }
 
@@ -103,20 +147,172 @@ namespace AdblockPlus
     }
 
     /**
-     * Destroys internally held `AsyncExecutor`, any subsequent calls of
-     * `Dispatch` have no effect.
+     * Cancels the cancellation token and destroys internally held
+     * `AsyncExecutor`, any subsequent calls of `Dispatch` have no effect.
      */
     void Stop() override
+    {
+      std::unique_ptr<AsyncExecutor> tmp = TakeExecutor();
+    }
+
+    /**
+     * Same as `Stop` but waits at most `timeout` for the running tasks, see
+     * `AsyncExecutor::Abandon`.
+     */
+    void StopWithin(std::chrono::milliseconds timeout) override
+    {
+      std::unique_ptr<AsyncExecutor> tmp = TakeExecutor();
+      if (tmp)
+        tmp->Abandon(timeout);
+    }
+
+    CancellationToken GetCancellationToken() override
+    {
+      return cancellation;
+    }
+
+    /**
+     * @return Statistics of the internally held `AsyncExecutor`, zeros after
+     *         `Stop` had been called.
+     */
+    Stats GetStats() override
+    {
+      std::lock_guard<std::mutex> lock(asyncExecutorMutex);
+      if (!executor)
+        return Stats{};
+      return executor->GetStats();
+    }
+
+  private:
+    std::unique_ptr<AsyncExecutor> TakeExecutor()
     {
       std::unique_ptr<AsyncExecutor> tmp;
       {
         std::lock_guard<std::mutex> lock(asyncExecutorMutex);
         tmp = move(executor);
       }
+      // Outside of the lock, results being delivered might dispatch tasks.
+      cancellation.Cancel();
+      return tmp;
     }
 
-  private:
     std::mutex asyncExecutorMutex;
     std::unique_ptr<AsyncExecutor> executor;
+    CancellationToken cancellation;
+  };
+
+  /**
+   * Executes tasks on a pool of worker threads. Threads are started on
+   * demand, up to the given maximum, and reused for the subsequent tasks.
+   * A thread which has been idle for a while exits, so the pool shrinks
+   * again when there is nothing to do. Tasks which are dispatched while all
+   * threads are busy are queued, hence a task must not wait for another
+   * dispatched one.
+   *
+   * Queued tasks are taken by their `TaskClass`: critical ones first, then
+   * background ones, tasks dispatched without a class among them, and then
+   * network ones. Network tasks never occupy all the threads of a pool of
+   * more than one, so that a slow download cannot hold up file reads.
+   */
+  class ThreadPoolExecutor : public IExecutor
+  {
+    typedef std::list<std::thread> Threads;
+
+  public:
+    /**
+     * Constructor.
+     * @param maxThreads Maximum number of tasks executed at the same time,
+     *        at least one.
+     * @param idleTimeout Time after which an idle thread exits.
+     * @param threadOptions Scheduling settings of the worker threads.
+     */
+    explicit ThreadPoolExecutor(size_t maxThreads,
+                                std::chrono::milliseconds idleTimeout = std::chrono::seconds(10),
+                                const ThreadOptions& threadOptions = ThreadOptions());
+
+    /**
+     * Destructor, it waits for finishing of all already dispatched tasks.
+     * When called from within a task, the thread running it is left to
+     * execute the remaining ones afterwards.
+     */
+    ~ThreadPoolExecutor();
+
+    /**
+     * Executes `call` on a worker thread. There is no effect if `call` is
+     * empty or if `Stop()` had been already called.
+     */
+    void Dispatch(const std::function<void()>& call) override;
+
+    /**
+     * Same as `Dispatch(call)`, `taskClass` determines when a queued task
+     * is executed.
+     */
+    void Dispatch(const std::function<void()>& call, TaskClass taskClass) override;
+
+    /**
+     * Cancels the cancellation token, drops the queued tasks and waits for
+     * finishing of the running ones, any subsequent calls of `Dispatch` have
+     * no effect.
+     */
+    void Stop() override;
+
+    CancellationToken GetCancellationToken() override;
+
+    /**
+     * @return Number of worker threads which are currently running.
+     */
+    size_t GetThreadCount();
+
+    /**
+     * @return Current statistics, a running task counts as an active thread.
+     */
+    Stats GetStats() override;
+
+  private:
+    struct QueuedTask
+    {
+      std::function<void()> call;
+      std::chrono::steady_clock::time_point dispatchedAt;
+    };
+    typedef std::deque<QueuedTask> Tasks;
+
+    // Owned by the pool and its threads together. A thread which destroys
+    // or stops the pool from within a task is detached then, and it keeps
+    // the state alive until it exits.
+    struct State
+    {
+      State(size_t maxNetworkThreads,
+            std::chrono::milliseconds idleTimeout,
+            const ThreadOptions& threadOptions);
+
+      void ThreadFunc(Threads::iterator self);
+      // Returns the queue to take the next task from, `nullptr` if no queued
+      // task can be executed now.
+      Tasks* GetRunnableTasks();
+      size_t GetQueuedTaskCount() const;
+
+      const size_t maxNetworkThreads;
+      const std::chrono::milliseconds idleTimeout;
+      const ThreadOptions threadOptions;
+      std::mutex mutex;
+      std::condition_variable taskAdded;
+      // Indexed by TaskClass, in the order in which they are taken.
+      Tasks tasks[3];
+      size_t networkThreads;
+      size_t runningTasks;
+      LatencyRecorder waitTime;
+      LatencyRecorder runTime;
+      Threads threads;
+      // Threads which exited after being idle, joined by the next Dispatch().
+      std::vector<std::thread> exitedThreads;
+      size_t idleThreads;
+      bool stopped;
+    };
+
+    void Shutdown(bool dropTasks);
+
+    const size_t maxThreads;
+    const CancellationToken cancellation;
+    const std::shared_ptr<State> state;
   };
 }
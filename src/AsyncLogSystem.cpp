@@ -0,0 +1,122 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "AsyncLogSystem.h"
+
+#include <algorithm>
+
+using namespace AdblockPlus;
+
+AsyncLogSystem::AsyncLogSystem(LogSystemPtr logSystem, size_t bufferSize)
+    : logSystem(std::move(logSystem)), minLogLevel(this->logSystem->GetMinLogLevel()),
+      buffer(std::max<size_t>(bufferSize, 1)), head(0), size(0), dropped(0),
+      shouldThreadStop(false)
+{
+  thread = std::thread([this] { ThreadFunc(); });
+}
+
+AsyncLogSystem::~AsyncLogSystem()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    shouldThreadStop = true;
+  }
+  conditionVariable.notify_one();
+  if (thread.joinable())
+    thread.join();
+}
+
+void AsyncLogSystem::operator()(LogLevel logLevel,
+                                const std::string& message,
+                                const std::string& source)
+{
+  if (logLevel >= minLogLevel)
+    Push(Entry{false, logLevel, message, source, 0, 0});
+}
+
+LogSystem::LogLevel AsyncLogSystem::GetMinLogLevel() const
+{
+  return minLogLevel;
+}
+
+void AsyncLogSystem::OnPerformanceMeasure(const std::string& name,
+                                          double startTime,
+                                          double duration)
+{
+  Push(Entry{true, LOG_LEVEL_LOG, name, std::string(), startTime, duration});
+}
+
+void AsyncLogSystem::Push(Entry&& entry)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (size == buffer.size())
+    {
+      // Drop the oldest entry to make room.
+      head = (head + 1) % buffer.size();
+      --size;
+      ++dropped;
+    }
+    buffer[(head + size) % buffer.size()] = std::move(entry);
+    ++size;
+  }
+  conditionVariable.notify_one();
+}
+
+void AsyncLogSystem::ThreadFunc()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    conditionVariable.wait(lock, [this]() { return shouldThreadStop || size > 0 || dropped; });
+    if (!size && !dropped)
+      return;
+
+    // Take everything at once so that the callers aren't blocked while the
+    // messages are written.
+    std::vector<Entry> entries;
+    entries.reserve(size + 1);
+    if (dropped)
+    {
+      entries.push_back(Entry{false,
+                              LOG_LEVEL_WARN,
+                              std::to_string(dropped) + " log messages dropped, the buffer is full",
+                              "AsyncLogSystem",
+                              0,
+                              0});
+      dropped = 0;
+    }
+    for (; size > 0; --size, head = (head + 1) % buffer.size())
+      entries.push_back(std::move(buffer[head]));
+    lock.unlock();
+
+    for (const auto& entry : entries)
+    {
+      try
+      {
+        if (entry.isMeasure)
+          logSystem->OnPerformanceMeasure(entry.message, entry.startTime, entry.duration);
+        else
+          (*logSystem)(entry.logLevel, entry.message, entry.source);
+      }
+      catch (...)
+      {
+        // Keep the thread alive.
+      }
+    }
+    lock.lock();
+  }
+}
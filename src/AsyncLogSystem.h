@@ -0,0 +1,71 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <AdblockPlus/LogSystem.h>
+
+namespace AdblockPlus
+{
+  /**
+   * Decorator of a `LogSystem` which queues the messages in a ring buffer
+   * and writes them on a background thread, see
+   * PlatformFactory::CreateAsyncLogSystem().
+   */
+  class AsyncLogSystem : public LogSystem
+  {
+  public:
+    AsyncLogSystem(LogSystemPtr logSystem, size_t bufferSize);
+    ~AsyncLogSystem();
+
+    void operator()(LogLevel logLevel, const std::string& message, const std::string& source) final;
+    LogLevel GetMinLogLevel() const final;
+    void OnPerformanceMeasure(const std::string& name, double startTime, double duration) final;
+
+  private:
+    struct Entry
+    {
+      bool isMeasure;
+      LogLevel logLevel;
+      // Name of the measure for measures.
+      std::string message;
+      std::string source;
+      double startTime;
+      double duration;
+    };
+
+    void Push(Entry&& entry);
+    void ThreadFunc();
+
+    const LogSystemPtr logSystem;
+    const LogLevel minLogLevel;
+    std::mutex mutex;
+    std::condition_variable conditionVariable;
+    std::vector<Entry> buffer;
+    size_t head;
+    size_t size;
+    uint64_t dropped;
+    bool shouldThreadStop;
+    std::thread thread;
+  };
+}
@@ -0,0 +1,386 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "BinaryStorage.h"
+
+#include <algorithm>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  const uint8_t HEADER[] = {'\0', 'A', 'B', 'P', 'B', 1};
+  const size_t HEADER_SIZE = sizeof(HEADER);
+  const size_t TRAILER_SIZE = 8;
+  // A reference to a shorter string wouldn't take less space than the string.
+  const size_t MIN_SHARED_LENGTH = 4;
+
+  const uint8_t LINE = 'L';
+  const uint8_t PAIR = 'P';
+  const uint8_t SECTION = 'S';
+
+  const uint64_t DISABLED_SUBSCRIPTION = 1;
+
+  bool IsEndOfLine(char c)
+  {
+    return c == '\n' || c == '\r';
+  }
+
+  bool IsLetter(char c)
+  {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+  }
+
+  void AppendNumber(uint64_t value, IFileSystem::IOBuffer* out)
+  {
+    while (value >= 0x80)
+    {
+      out->push_back(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    out->push_back(static_cast<uint8_t>(value));
+  }
+
+  class Writer : public IFileSystem::IFileWriter
+  {
+  public:
+    explicit Writer(std::unique_ptr<IFileSystem::IFileWriter> writer)
+        : writer(std::move(writer)), written(0)
+    {
+    }
+
+    void Append(IFileSystem::IOBuffer&& chunk) override
+    {
+      IFileSystem::IOBuffer out;
+      const char* next = reinterpret_cast<const char*>(chunk.data());
+      const char* chunkEnd = next + chunk.size();
+      while (next != chunkEnd)
+      {
+        const char* lineEnd = std::find_if(next, chunkEnd, IsEndOfLine);
+        if (lineEnd == chunkEnd)
+        {
+          partialLine.append(next, lineEnd);
+          break;
+        }
+        if (partialLine.empty())
+          EncodeLine(next, lineEnd - next, &out);
+        else
+        {
+          partialLine.append(next, lineEnd);
+          EncodeLine(partialLine.data(), partialLine.size(), &out);
+          partialLine.clear();
+        }
+        next = lineEnd + 1;
+      }
+      Flush(&out);
+    }
+
+    void Commit(const IFileSystem::Callback& callback) override
+    {
+      IFileSystem::IOBuffer out;
+      EncodeLine(partialLine.data(), partialLine.size(), &out);
+      WriteHeader(&out);
+
+      const uint64_t indexOffset = written + out.size();
+      AppendNumber(sections.size(), &out);
+      for (const auto& section : sections)
+      {
+        AppendNumber(section.offset, &out);
+        AppendNumber(section.disabled ? DISABLED_SUBSCRIPTION : 0, &out);
+        AppendString(section.url.data(), section.url.size(), &out);
+      }
+      for (size_t i = 0; i < TRAILER_SIZE; i++)
+        out.push_back(static_cast<uint8_t>(indexOffset >> (8 * i)));
+      Flush(&out);
+      writer->Commit(callback);
+    }
+
+  private:
+    struct Section
+    {
+      uint64_t offset;
+      std::string url;
+      bool disabled;
+      bool isSubscription;
+    };
+
+    void WriteHeader(IFileSystem::IOBuffer* out)
+    {
+      if (written == 0 && out->empty())
+        out->assign(HEADER, HEADER + HEADER_SIZE);
+    }
+
+    void Flush(IFileSystem::IOBuffer* out)
+    {
+      if (out->empty())
+        return;
+      written += out->size();
+      writer->Append(std::move(*out));
+      out->clear();
+    }
+
+    void EncodeLine(const char* line, size_t length, IFileSystem::IOBuffer* out)
+    {
+      if (length == 0)
+        return;
+      WriteHeader(out);
+
+      if (line[0] == '[' && line[length - 1] == ']')
+      {
+        const std::string header(line, length);
+        Section section{written + out->size(), std::string(), false, false};
+        section.isSubscription = header == "[Subscription]";
+        // The filters of a subscription follow its own section.
+        if (header == "[Subscription filters]" && !sections.empty() &&
+            sections.back().isSubscription)
+        {
+          section.url = sections.back().url;
+          section.disabled = sections.back().disabled;
+        }
+        sections.push_back(section);
+        out->push_back(SECTION);
+        AppendString(line, length, out);
+        return;
+      }
+
+      const char* lineEnd = line + length;
+      const char* separator = std::find(line, lineEnd, '=');
+      if (separator == line || separator == lineEnd || !std::all_of(line, separator, IsLetter))
+      {
+        out->push_back(LINE);
+        AppendString(line, length, out);
+        return;
+      }
+
+      const size_t keyLength = separator - line;
+      const char* value = separator + 1;
+      const size_t valueLength = lineEnd - value;
+      if (!sections.empty() && sections.back().isSubscription)
+      {
+        const std::string key(line, keyLength);
+        if (key == "url")
+          sections.back().url.assign(value, valueLength);
+        else if (key == "disabled")
+          sections.back().disabled = std::string(value, valueLength) == "true";
+      }
+      out->push_back(PAIR);
+      AppendString(line, keyLength, out);
+      AppendString(value, valueLength, out);
+    }
+
+    void AppendString(const char* str, size_t length, IFileSystem::IOBuffer* out)
+    {
+      if (length >= MIN_SHARED_LENGTH)
+      {
+        std::string key(str, length);
+        auto it = strings.find(key);
+        if (it != strings.end())
+        {
+          AppendNumber(it->second << 1 | 1, out);
+          return;
+        }
+        strings.emplace(std::move(key), written + out->size());
+      }
+      AppendNumber(static_cast<uint64_t>(length) << 1, out);
+      out->insert(out->end(), str, str + length);
+    }
+
+    std::unique_ptr<IFileSystem::IFileWriter> writer;
+    // Number of bytes passed to the writer so far.
+    uint64_t written;
+    std::string partialLine;
+    // Offsets of the strings stored so far.
+    std::unordered_map<std::string, uint64_t> strings;
+    std::vector<Section> sections;
+  };
+}
+
+bool BinaryStorage::IsBinaryStorage(const uint8_t* data, size_t size)
+{
+  return size >= HEADER_SIZE && std::equal(HEADER, HEADER + HEADER_SIZE, data);
+}
+
+std::unique_ptr<IFileSystem::IFileWriter>
+BinaryStorage::CreateWriter(std::unique_ptr<IFileSystem::IFileWriter> writer)
+{
+  return std::unique_ptr<IFileSystem::IFileWriter>(new Writer(std::move(writer)));
+}
+
+BinaryStorage::Reader::Reader(const uint8_t* data, size_t size)
+    : data(data), size(size), valid(false), recordsEnd(0), position(0), end(0)
+{
+  if (!IsBinaryStorage(data, size) || size < HEADER_SIZE + TRAILER_SIZE)
+    return;
+
+  uint64_t indexOffset = 0;
+  for (size_t i = 0; i < TRAILER_SIZE; i++)
+    indexOffset |= static_cast<uint64_t>(data[size - TRAILER_SIZE + i]) << (8 * i);
+  if (indexOffset < HEADER_SIZE || indexOffset > size - TRAILER_SIZE)
+    return;
+  recordsEnd = static_cast<size_t>(indexOffset);
+
+  size_t indexPosition = recordsEnd;
+  const size_t indexEnd = size - TRAILER_SIZE;
+  uint64_t count = 0;
+  // Every entry takes at least three bytes.
+  if (!ReadNumber(&indexPosition, indexEnd, &count) || count > indexEnd - indexPosition)
+    return;
+  sections.reserve(static_cast<size_t>(count));
+  for (uint64_t i = 0; i < count; i++)
+  {
+    uint64_t offset = 0;
+    uint64_t flags = 0;
+    const char* url = nullptr;
+    size_t urlLength = 0;
+    if (!ReadNumber(&indexPosition, indexEnd, &offset) ||
+        !ReadNumber(&indexPosition, indexEnd, &flags) ||
+        !ReadString(&indexPosition, indexEnd, &url, &urlLength))
+      return;
+    // Sections are in the order of the file and start with their header.
+    if (offset < HEADER_SIZE || offset >= recordsEnd || data[offset] != SECTION ||
+        (!sections.empty() && offset <= sections.back().begin))
+      return;
+
+    size_t headerPosition = static_cast<size_t>(offset) + 1;
+    const char* header = nullptr;
+    size_t headerLength = 0;
+    if (!ReadString(&headerPosition, recordsEnd, &header, &headerLength))
+      return;
+    if (!sections.empty())
+      sections.back().end = static_cast<size_t>(offset);
+    sections.push_back(Section{std::string(header, headerLength),
+                               std::string(url, urlLength),
+                               (flags & DISABLED_SUBSCRIPTION) != 0,
+                               static_cast<size_t>(offset),
+                               recordsEnd});
+  }
+
+  valid = true;
+  position = HEADER_SIZE;
+  end = recordsEnd;
+}
+
+bool BinaryStorage::Reader::IsValid() const
+{
+  return valid;
+}
+
+const std::vector<BinaryStorage::Reader::Section>& BinaryStorage::Reader::GetSections() const
+{
+  return sections;
+}
+
+bool BinaryStorage::Reader::SeekToSubscription(const std::string& url)
+{
+  if (url.empty())
+    return false;
+  auto first = std::find_if(sections.begin(), sections.end(), [&url](const Section& section) {
+    return section.url == url;
+  });
+  if (first == sections.end())
+    return false;
+  auto last = first;
+  while (last + 1 != sections.end() && (last + 1)->url == url)
+    ++last;
+  position = first->begin;
+  end = last->end;
+  return true;
+}
+
+bool BinaryStorage::Reader::ReadLine(const char** line, size_t* length)
+{
+  if (!valid || position >= end)
+    return false;
+
+  const uint8_t type = data[position++];
+  if (type == LINE || type == SECTION)
+  {
+    if (ReadString(&position, recordsEnd, line, length))
+      return true;
+  }
+  else if (type == PAIR)
+  {
+    const char* key = nullptr;
+    size_t keyLength = 0;
+    const char* value = nullptr;
+    size_t valueLength = 0;
+    if (ReadString(&position, recordsEnd, &key, &keyLength) &&
+        ReadString(&position, recordsEnd, &value, &valueLength))
+    {
+      pair.assign(key, keyLength);
+      pair.push_back('=');
+      pair.append(value, valueLength);
+      *line = pair.data();
+      *length = pair.size();
+      return true;
+    }
+  }
+  valid = false;
+  return false;
+}
+
+bool BinaryStorage::Reader::ReadNumber(size_t* numberPosition,
+                                       size_t numberEnd,
+                                       uint64_t* value) const
+{
+  *value = 0;
+  for (unsigned shift = 0; shift < 64 && *numberPosition < numberEnd; shift += 7)
+  {
+    const uint8_t byte = data[(*numberPosition)++];
+    *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool BinaryStorage::Reader::ReadString(size_t* stringPosition,
+                                       size_t stringEnd,
+                                       const char** str,
+                                       size_t* length) const
+{
+  const size_t tagPosition = *stringPosition;
+  uint64_t tag = 0;
+  if (!ReadNumber(stringPosition, stringEnd, &tag))
+    return false;
+
+  size_t begin = *stringPosition;
+  uint64_t stringLength = tag >> 1;
+  if (tag & 1)
+  {
+    // References only point backwards, so they cannot form a cycle.
+    const uint64_t offset = tag >> 1;
+    if (offset < HEADER_SIZE || offset >= tagPosition || offset >= recordsEnd)
+      return false;
+    begin = static_cast<size_t>(offset);
+    uint64_t referencedTag = 0;
+    if (!ReadNumber(&begin, recordsEnd, &referencedTag) || (referencedTag & 1))
+      return false;
+    stringLength = referencedTag >> 1;
+    if (stringLength > recordsEnd - begin)
+      return false;
+  }
+  else
+  {
+    if (stringLength > stringEnd - begin)
+      return false;
+    *stringPosition = begin + static_cast<size_t>(stringLength);
+  }
+  *str = reinterpret_cast<const char*>(data + begin);
+  *length = static_cast<size_t>(stringLength);
+  return true;
+}
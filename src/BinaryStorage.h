@@ -0,0 +1,130 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <AdblockPlus/IFileSystem.h>
+
+namespace AdblockPlus
+{
+  /**
+   * Binary form of the INI like files written by the filter storage, e.g.
+   * `patterns.ini`, which can be read without tokenizing the text.
+   *
+   * The file starts with a header, followed by one record per non-empty line,
+   * an index of the sections and the offset of the index. Strings are stored
+   * once and referred to by their offset afterwards, so a filter which is in
+   * several subscriptions and in a `[Filter]` section takes its space only
+   * once. All numbers are LEB128 encoded:
+   *
+   * - header: `\0ABPB` followed by the version byte
+   * - line: `L` string
+   * - `key=value` line with a key consisting of letters: `P` string string
+   * - section header like `[Subscription]`: `S` string
+   * - string: `length << 1` followed by the UTF-8 bytes, or
+   *   `offset << 1 | 1` with the offset of a string stored before
+   * - index: number of sections, each with the offset of its header record,
+   *   flags (1 for a disabled subscription) and the subscription URL as
+   *   string, empty for sections which don't belong to a subscription
+   * - trailer: offset of the index as 8 bytes little endian
+   */
+  namespace BinaryStorage
+  {
+    /**
+     * @return `true` if the content starts like a binary storage file, text
+     *         files never do.
+     */
+    bool IsBinaryStorage(const uint8_t* data, size_t size);
+
+    /**
+     * Encodes the lines appended as text and passes the binary form on to
+     * another writer.
+     * @param writer The writer of the binary file.
+     * @return The writer receiving the text.
+     */
+    std::unique_ptr<IFileSystem::IFileWriter>
+    CreateWriter(std::unique_ptr<IFileSystem::IFileWriter> writer);
+
+    /**
+     * Reads the lines of a binary storage file.
+     */
+    class Reader
+    {
+    public:
+      struct Section
+      {
+        std::string header;
+        std::string url;
+        bool disabled;
+        size_t begin;
+        size_t end;
+      };
+
+      /**
+       * @param data The content, it has to remain valid while the reader is used.
+       * @param size Size of the content.
+       */
+      Reader(const uint8_t* data, size_t size);
+
+      /**
+       * @return `false` if the content is corrupt.
+       */
+      bool IsValid() const;
+
+      /**
+       * @return The sections in the order of the file.
+       */
+      const std::vector<Section>& GetSections() const;
+
+      /**
+       * Makes ReadLine() return only the lines of the sections of a
+       * subscription, e.g. `[Subscription]` and `[Subscription filters]`.
+       * @param url URL of the subscription.
+       * @return `false` if there is no subscription with that URL.
+       */
+      bool SeekToSubscription(const std::string& url);
+
+      /**
+       * Reads the next line.
+       * @param[out] line Receives the line, valid until the next call.
+       * @param[out] length Receives the length of the line.
+       * @return `false` at the end or if the content is corrupt.
+       */
+      bool ReadLine(const char** line, size_t* length);
+
+    private:
+      bool ReadNumber(size_t* position, size_t end, uint64_t* value) const;
+      bool ReadString(size_t* position, size_t end, const char** str, size_t* length) const;
+
+      const uint8_t* data;
+      size_t size;
+      bool valid;
+      // Records are between the header and the index.
+      size_t recordsEnd;
+      size_t position;
+      size_t end;
+      std::vector<Section> sections;
+      std::string pair;
+    };
+  }
+}
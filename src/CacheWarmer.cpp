@@ -0,0 +1,196 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "CacheWarmer.h"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  // Hosts tracked for every host warmed up, so that new favorites can climb
+  // the ranking.
+  const size_t TRACKED_DOMAINS_PER_DOMAIN = 4;
+}
+
+CacheWarmer::CacheWarmer(ITimer& timer,
+                         const WarmUpCallback& warmUp,
+                         const SaveCallback& save,
+                         size_t domainCount,
+                         std::chrono::milliseconds idleDelay,
+                         const NowCallback& now)
+    : timer_(timer), warmUp_(warmUp), save_(save), domainCount_(domainCount),
+      maxTrackedDomains_(domainCount * TRACKED_DOMAINS_PER_DOMAIN), idleDelay_(idleDelay),
+      now_(now), lastActivity_(Clock::time_point::min().time_since_epoch().count())
+{
+}
+
+void CacheWarmer::Load(const std::string& ranking)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::istringstream lines(ranking);
+  std::string line;
+  while (std::getline(lines, line))
+  {
+    std::istringstream fields(line);
+    int64_t count = 0;
+    std::string host;
+    if (!(fields >> count >> host) || count <= 0)
+      continue;
+    auto& visits = visits_[host];
+    visits = static_cast<uint32_t>(std::min<int64_t>(
+        static_cast<int64_t>(visits) + count, std::numeric_limits<uint32_t>::max()));
+  }
+  while (visits_.size() > maxTrackedDomains_)
+    MakeRoom();
+  warmUpPending_ = true;
+  ScheduleCheck(idleDelay_);
+}
+
+void CacheWarmer::RecordVisit(const std::string& host)
+{
+  if (host.empty() || domainCount_ == 0)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = visits_.find(host);
+  if (it == visits_.end())
+  {
+    if (visits_.size() >= maxTrackedDomains_)
+      MakeRoom();
+    it = visits_.emplace(host, 0).first;
+  }
+  if (it->second < std::numeric_limits<uint32_t>::max())
+    ++it->second;
+  changed_ = true;
+  ScheduleCheck(idleDelay_);
+}
+
+void CacheWarmer::NotifyActivity()
+{
+  lastActivity_.store(now_().time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+void CacheWarmer::RequestWarmUp()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  warmUpPending_ = true;
+  ScheduleCheck(idleDelay_);
+}
+
+std::vector<std::string> CacheWarmer::GetTopDomains() const
+{
+  std::vector<std::string> hosts;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& entry : Rank(domainCount_))
+    hosts.push_back(std::move(entry.first));
+  return hosts;
+}
+
+CacheWarmer::Ranking CacheWarmer::Rank(size_t count) const
+{
+  Ranking ranking(visits_.begin(), visits_.end());
+  count = std::min(count, ranking.size());
+  std::partial_sort(ranking.begin(),
+                    ranking.begin() + count,
+                    ranking.end(),
+                    [](const Ranking::value_type& a, const Ranking::value_type& b) {
+                      return a.second != b.second ? a.second > b.second : a.first < b.first;
+                    });
+  ranking.resize(count);
+  return ranking;
+}
+
+std::string CacheWarmer::Serialize() const
+{
+  std::string result;
+  for (const auto& entry : Rank(visits_.size()))
+    result += std::to_string(entry.second) + ' ' + entry.first + '\n';
+  return result;
+}
+
+void CacheWarmer::MakeRoom()
+{
+  for (auto it = visits_.begin(); it != visits_.end();)
+  {
+    it->second /= 2;
+    if (it->second == 0)
+      it = visits_.erase(it);
+    else
+      ++it;
+  }
+  // Only hosts with several visits are left, keep the top half of them.
+  if (visits_.size() >= maxTrackedDomains_)
+  {
+    const auto ranking = Rank(maxTrackedDomains_ / 2);
+    visits_ = decltype(visits_)(ranking.begin(), ranking.end());
+  }
+}
+
+void CacheWarmer::ScheduleCheck(Clock::duration delay)
+{
+  // A pending check reschedules itself if it fires too early.
+  if (timerPending_)
+    return;
+  timerPending_ = true;
+  std::weak_ptr<CacheWarmer> weakSelf = shared_from_this();
+  timer_.SetTimer(std::chrono::duration_cast<std::chrono::milliseconds>(delay) +
+                      std::chrono::milliseconds(1),
+                  [weakSelf]() {
+                    if (auto self = weakSelf.lock())
+                      self->OnTimer();
+                  });
+}
+
+void CacheWarmer::OnTimer()
+{
+  std::vector<std::string> hosts;
+  std::string ranking;
+  bool save = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timerPending_ = false;
+    const auto now = now_();
+    const auto due =
+        Clock::time_point(Clock::duration(lastActivity_.load(std::memory_order_relaxed))) +
+        idleDelay_;
+    if (due > now)
+    {
+      ScheduleCheck(due - now);
+      return;
+    }
+    if (warmUpPending_)
+    {
+      warmUpPending_ = false;
+      for (auto& entry : Rank(domainCount_))
+        hosts.push_back(std::move(entry.first));
+    }
+    if (changed_)
+    {
+      changed_ = false;
+      ranking = Serialize();
+      save = true;
+    }
+  }
+  if (!hosts.empty())
+    warmUp_(hosts);
+  if (save)
+    save_(ranking);
+}
@@ -0,0 +1,131 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <AdblockPlus/ITimer.h>
+
+namespace AdblockPlus
+{
+  /**
+   * Ranks the hosts of the visited documents by the number of visits and
+   * warms the caches for the top ones once filters changed, e.g. after a
+   * filter list update or on startup, so that the first visit of a favorite
+   * site afterwards doesn't pay the cold cost.
+   *
+   * Warming up and saving the ranking wait until nothing was matched for
+   * `idleDelay`, see NotifyActivity(). To let other sites in, the ranking
+   * tracks a few times more hosts than it warms up, and once it is full all
+   * counts are halved and the hosts without visits left are dropped.
+   *
+   * The methods are thread safe. The callbacks are invoked by a timer
+   * without the warmer being locked. Instances have to be owned by a
+   * `std::shared_ptr`.
+   */
+  class CacheWarmer : public std::enable_shared_from_this<CacheWarmer>
+  {
+  public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<Clock::time_point()> NowCallback;
+    typedef std::function<void(const std::vector<std::string>& hosts)> WarmUpCallback;
+    typedef std::function<void(const std::string& ranking)> SaveCallback;
+
+    /**
+     * @param timer Timer used to wait for idle time.
+     * @param warmUp Fills the caches for the hosts, most visited first.
+     * @param save Persists the ranking, to be passed to Load() on the next
+     *        start.
+     * @param domainCount Number of hosts to warm up.
+     * @param idleDelay Time without matching after which the callbacks are
+     *        invoked.
+     * @param now Source of the current time.
+     */
+    CacheWarmer(ITimer& timer,
+                const WarmUpCallback& warmUp,
+                const SaveCallback& save,
+                size_t domainCount,
+                std::chrono::milliseconds idleDelay,
+                const NowCallback& now = Clock::now);
+
+    /**
+     * Adds the visits of a saved ranking and warms up the top hosts, lines
+     * which cannot be parsed are skipped.
+     * @param ranking Ranking passed to the save callback.
+     */
+    void Load(const std::string& ranking);
+
+    /**
+     * Records a visit of a top-level document.
+     * @param host Host of the document, ignored if empty.
+     */
+    void RecordVisit(const std::string& host);
+
+    /**
+     * Records that a request was matched, cheap enough for every request.
+     */
+    void NotifyActivity();
+
+    /**
+     * Warms up the top hosts at the next idle time, the caches were flushed.
+     */
+    void RequestWarmUp();
+
+    /**
+     * @return Up to `domainCount` hosts, most visited first, hosts with the
+     *         same number of visits in alphabetical order.
+     */
+    std::vector<std::string> GetTopDomains() const;
+
+  private:
+    typedef std::vector<std::pair<std::string, uint32_t>> Ranking;
+
+    // Sorted by visits, the top `count` entries at least.
+    Ranking Rank(size_t count) const;
+    std::string Serialize() const;
+    void MakeRoom();
+    void ScheduleCheck(Clock::duration delay);
+    void OnTimer();
+
+    ITimer& timer_;
+    const WarmUpCallback warmUp_;
+    const SaveCallback save_;
+    const size_t domainCount_;
+    const size_t maxTrackedDomains_;
+    const Clock::duration idleDelay_;
+    const NowCallback now_;
+
+    std::atomic<Clock::rep> lastActivity_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, uint32_t> visits_;
+    bool timerPending_ = false;
+    bool warmUpPending_ = false;
+    // Whether visits were recorded since the last save.
+    bool changed_ = false;
+  };
+}
@@ -0,0 +1,87 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <AdblockPlus/CancellationToken.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+using namespace AdblockPlus;
+
+struct CancellationToken::State
+{
+  std::mutex mutex;
+  std::condition_variable idle;
+  bool cancelled = false;
+  size_t runningCalls = 0;
+};
+
+// static
+CancellationToken CancellationToken::Create()
+{
+  CancellationToken token;
+  token.state = std::make_shared<State>();
+  return token;
+}
+
+void CancellationToken::Cancel() const
+{
+  if (!state)
+    return;
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cancelled = true;
+  state->idle.wait(lock, [this]() -> bool {
+    return state->runningCalls == 0;
+  });
+}
+
+bool CancellationToken::IsCancelled() const
+{
+  if (!state)
+    return false;
+  std::lock_guard<std::mutex> lock(state->mutex);
+  return state->cancelled;
+}
+
+bool CancellationToken::Run(const std::function<void()>& call) const
+{
+  if (!state)
+  {
+    call();
+    return true;
+  }
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->cancelled)
+      return false;
+    ++state->runningCalls;
+  }
+  // Also leaves if `call` throws.
+  struct Leave
+  {
+    ~Leave()
+    {
+      std::lock_guard<std::mutex> lock(tokenState->mutex);
+      if (--tokenState->runningCalls == 0)
+        tokenState->idle.notify_all();
+    }
+    State* tokenState;
+  } leave{state.get()};
+  call();
+  return true;
+}
@@ -0,0 +1,82 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace AdblockPlus
+{
+  /**
+   * Callbacks of asynchronous calls by key, so that a call which is posted
+   * while an equal one is still queued doesn't get executed again but
+   * completes along with the queued one.
+   */
+  template<class Result> class CoalescedCalls
+  {
+  public:
+    typedef std::function<void(const Result&)> Callback;
+
+    /**
+     * Adds a callback waiting for the call with the key.
+     * @return `true` if no such call is queued, the caller has to queue one
+     *         which calls Take() and then Complete().
+     */
+    bool Add(const std::string& key, const Callback& callback)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto& callbacks = pending[key];
+      callbacks.push_back(callback);
+      return callbacks.size() == 1;
+    }
+
+    /**
+     * Removes the callbacks waiting for the call with the key, to be called
+     * when the call starts. Callbacks added later wait for a new call, which
+     * sees the changes made meanwhile.
+     */
+    std::vector<Callback> Take(const std::string& key)
+    {
+      std::vector<Callback> callbacks;
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = pending.find(key);
+      if (it != pending.end())
+      {
+        callbacks.swap(it->second);
+        pending.erase(it);
+      }
+      return callbacks;
+    }
+
+    /**
+     * Passes the result to the callbacks returned by Take().
+     */
+    static void Complete(const std::vector<Callback>& callbacks, const Result& result)
+    {
+      for (const auto& callback : callbacks)
+        callback(result);
+    }
+
+  private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::vector<Callback>> pending;
+  };
+}
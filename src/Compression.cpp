@@ -0,0 +1,216 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Compression.h"
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace AdblockPlus;
+
+namespace
+{
+  const uint8_t GZIP_MAGIC[] = {0x1F, 0x8B};
+  // Also the size of the pieces passed on to the next writer.
+  const size_t CHUNK_SIZE = 64 * 1024;
+  // Window bits selecting the gzip wrapper instead of the zlib one.
+  const int GZIP_WINDOW_BITS = 15 + 16;
+  const int MEMORY_LEVEL = 8;
+
+#ifdef HAVE_ZLIB
+  class Writer : public IFileSystem::IFileWriter
+  {
+  public:
+    explicit Writer(std::unique_ptr<IFileSystem::IFileWriter> writer)
+        : writer(std::move(writer)), stream(), status(Z_OK)
+    {
+      status = deflateInit2(&stream,
+                            Z_DEFAULT_COMPRESSION,
+                            Z_DEFLATED,
+                            GZIP_WINDOW_BITS,
+                            MEMORY_LEVEL,
+                            Z_DEFAULT_STRATEGY);
+      isInitialized = status == Z_OK;
+    }
+
+    ~Writer()
+    {
+      if (isInitialized)
+        deflateEnd(&stream);
+    }
+
+    void Append(IFileSystem::IOBuffer&& chunk) override
+    {
+      Deflate(chunk.data(), chunk.size(), Z_NO_FLUSH);
+    }
+
+    void Commit(const IFileSystem::Callback& callback) override
+    {
+      Deflate(nullptr, 0, Z_FINISH);
+      if (status != Z_STREAM_END)
+      {
+        // Dropping the writer without committing leaves the file untouched.
+        writer.reset();
+        callback("Failed to compress the content");
+        return;
+      }
+      if (!out.empty())
+        writer->Append(std::move(out));
+      writer->Commit(callback);
+    }
+
+  private:
+    void Deflate(const uint8_t* data, size_t size, int flush)
+    {
+      if (size == 0 && flush == Z_NO_FLUSH)
+        return;
+      // The chunks of the filter storage are far below the 4 GB zlib takes
+      // at once.
+      stream.next_in = const_cast<Bytef*>(data);
+      stream.avail_in = static_cast<uInt>(size);
+      while (status == Z_OK)
+      {
+        if (out.size() == CHUNK_SIZE)
+        {
+          writer->Append(std::move(out));
+          out.clear();
+        }
+        const size_t outSize = out.size();
+        out.resize(CHUNK_SIZE);
+        stream.next_out = out.data() + outSize;
+        stream.avail_out = static_cast<uInt>(CHUNK_SIZE - outSize);
+        status = deflate(&stream, flush);
+        out.resize(CHUNK_SIZE - stream.avail_out);
+        // Space left in the output means that all input was taken.
+        if (flush == Z_NO_FLUSH && stream.avail_out > 0)
+          break;
+      }
+    }
+
+    std::unique_ptr<IFileSystem::IFileWriter> writer;
+    z_stream stream;
+    int status;
+    bool isInitialized;
+    IFileSystem::IOBuffer out;
+  };
+#endif
+}
+
+#ifdef HAVE_ZLIB
+struct Compression::Inflater::State
+{
+  z_stream stream;
+  const uint8_t* next;
+  size_t remaining;
+  bool isFinished;
+  std::vector<uint8_t> buffer;
+};
+#else
+struct Compression::Inflater::State
+{
+};
+#endif
+
+bool Compression::IsSupported()
+{
+#ifdef HAVE_ZLIB
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool Compression::IsCompressed(const uint8_t* data, size_t size)
+{
+  return size >= sizeof(GZIP_MAGIC) &&
+         std::equal(GZIP_MAGIC, GZIP_MAGIC + sizeof(GZIP_MAGIC), data);
+}
+
+std::unique_ptr<IFileSystem::IFileWriter>
+Compression::CreateWriter(std::unique_ptr<IFileSystem::IFileWriter> writer)
+{
+#ifdef HAVE_ZLIB
+  return std::unique_ptr<IFileSystem::IFileWriter>(new Writer(std::move(writer)));
+#else
+  return writer;
+#endif
+}
+
+Compression::Inflater::Inflater(const uint8_t* data, size_t size)
+    : state(new State()), valid(false)
+{
+#ifdef HAVE_ZLIB
+  state->next = data;
+  state->remaining = size;
+  state->isFinished = false;
+  valid = inflateInit2(&state->stream, GZIP_WINDOW_BITS) == Z_OK;
+#endif
+}
+
+Compression::Inflater::~Inflater()
+{
+#ifdef HAVE_ZLIB
+  if (valid)
+    inflateEnd(&state->stream);
+#endif
+}
+
+bool Compression::Inflater::IsValid() const
+{
+  return valid;
+}
+
+bool Compression::Inflater::Read(const uint8_t** chunk, size_t* size)
+{
+#ifdef HAVE_ZLIB
+  state->buffer.resize(CHUNK_SIZE);
+  while (valid && !state->isFinished)
+  {
+    if (state->stream.avail_in == 0)
+    {
+      const size_t input = std::min<size_t>(state->remaining, UINT_MAX);
+      state->stream.next_in = const_cast<Bytef*>(state->next);
+      state->stream.avail_in = static_cast<uInt>(input);
+      state->next += input;
+      state->remaining -= input;
+    }
+    state->stream.next_out = state->buffer.data();
+    state->stream.avail_out = static_cast<uInt>(state->buffer.size());
+    const int status = inflate(&state->stream, Z_NO_FLUSH);
+    if (status == Z_STREAM_END)
+      state->isFinished = true;
+    else if (status != Z_OK)
+    {
+      // Also a truncated file, there is no progress without more input.
+      inflateEnd(&state->stream);
+      valid = false;
+    }
+    *size = state->buffer.size() - state->stream.avail_out;
+    if (valid && *size > 0)
+    {
+      *chunk = state->buffer.data();
+      return true;
+    }
+  }
+#endif
+  return false;
+}
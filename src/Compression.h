@@ -0,0 +1,88 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <AdblockPlus/IFileSystem.h>
+
+namespace AdblockPlus
+{
+  /**
+   * gzip compression of the files written by the filter storage. It is only
+   * available if the library is built with zlib, see IsSupported(), but
+   * compressed files are always recognized.
+   */
+  namespace Compression
+  {
+    /**
+     * @return `true` if the library is built with zlib.
+     */
+    bool IsSupported();
+
+    /**
+     * @return `true` if the content starts like a gzip file, text files and
+     *         binary storage files never do.
+     */
+    bool IsCompressed(const uint8_t* data, size_t size);
+
+    /**
+     * Compresses the appended content on the fly and passes it on to
+     * another writer, requires IsSupported().
+     * @param writer The writer of the compressed file.
+     * @return The writer receiving the uncompressed content.
+     */
+    std::unique_ptr<IFileSystem::IFileWriter>
+    CreateWriter(std::unique_ptr<IFileSystem::IFileWriter> writer);
+
+    /**
+     * Decompresses gzip content piece by piece, so that it can be processed
+     * without holding all of it in memory.
+     */
+    class Inflater
+    {
+    public:
+      /**
+       * @param data The compressed content, it has to remain valid while the
+       *        inflater is used.
+       * @param size Size of the compressed content.
+       */
+      Inflater(const uint8_t* data, size_t size);
+      ~Inflater();
+
+      /**
+       * @return `false` if the content is corrupt or zlib isn't available.
+       */
+      bool IsValid() const;
+
+      /**
+       * Decompresses the next piece of the content.
+       * @param[out] chunk Receives the piece, valid until the next call.
+       * @param[out] size Receives the size of the piece, never 0.
+       * @return `false` at the end or if the content is corrupt.
+       */
+      bool Read(const uint8_t** chunk, size_t* size);
+
+    private:
+      struct State;
+      std::unique_ptr<State> state;
+      bool valid;
+    };
+  }
+}
@@ -32,6 +32,8 @@ namespace
              const v8::FunctionCallbackInfo<v8::Value>& arguments)
   {
     AdblockPlus::JsEngine* jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
+    if (logLevel < jsEngine->GetLogSystem().GetMinLogLevel())
+      return;
     const AdblockPlus::JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
     AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
 
@@ -81,6 +83,8 @@ namespace
   void TraceCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
   {
     AdblockPlus::JsEngine* jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
+    if (AdblockPlus::LogSystem::LOG_LEVEL_TRACE < jsEngine->GetLogSystem().GetMinLogLevel())
+      return;
     const AdblockPlus::JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
     AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
 
@@ -0,0 +1,149 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ContentFilterDomains.h"
+
+#include <algorithm>
+
+#include "HostCache.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  // About 0.1% false positives with six probes.
+  const size_t BITS_PER_DOMAIN = 16;
+  const size_t PROBE_COUNT = 6;
+
+  std::string ToLower(const std::string& str)
+  {
+    std::string result(str);
+    for (auto& c : result)
+    {
+      if (c >= 'A' && c <= 'Z')
+        c = static_cast<char>(c - 'A' + 'a');
+    }
+    return result;
+  }
+
+  // FNV-1a followed by the MurmurHash3 finalizer, the two halves of the
+  // result seed the probes.
+  uint64_t Hash(const std::string& str)
+  {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (char c : str)
+    {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 0x100000001B3ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+  }
+
+  // Hosts which the URL parser of JS might normalize differently, like
+  // IP addresses or percent-encoded and international names, are better
+  // left to JS.
+  bool IsPlainHost(const std::string& host)
+  {
+    if (!std::all_of(host.begin(), host.end(), [](char c) {
+          return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                 c == '.' || c == '-' || c == '_';
+        }))
+      return false;
+    const size_t end = host.find_last_not_of('.');
+    if (end == std::string::npos)
+      return false;
+    const size_t lastLabel = host.rfind('.', end);
+    const char first = host[lastLabel == std::string::npos ? 0 : lastLabel + 1];
+    return first < '0' || first > '9';
+  }
+}
+
+void ContentFilterDomains::SetDomains(Type type, const std::vector<std::string>& domains)
+{
+  Bloom& bloom = blooms_[static_cast<size_t>(type)];
+  bloom.everywhere = std::find(domains.begin(), domains.end(), "*") != domains.end();
+  size_t wordCount = 1;
+  while (wordCount * 64 < domains.size() * BITS_PER_DOMAIN)
+    wordCount *= 2;
+  bloom.bits.assign(wordCount, 0);
+  for (const auto& domain : domains)
+  {
+    if (!domain.empty())
+      bloom.Add(ToLower(domain));
+  }
+}
+
+bool ContentFilterDomains::MayApply(Type type, const std::string& host) const
+{
+  const Bloom& bloom = blooms_[static_cast<size_t>(type)];
+  if (bloom.everywhere)
+    return true;
+  if (bloom.bits.empty())
+    return false;
+  if (!IsPlainHost(host))
+    return true;
+
+  // Filters match on the host and all its parent domains. The host is
+  // tried with and without trailing dots, JS may strip them or not.
+  if (host.back() == '.')
+  {
+    const std::string lowerHost = ToLower(host);
+    for (size_t start = 0; start < lowerHost.size();)
+    {
+      if (bloom.MayContain(lowerHost.substr(start)))
+        return true;
+      const size_t dot = lowerHost.find('.', start);
+      if (dot == std::string::npos)
+        break;
+      start = dot + 1;
+    }
+  }
+  for (const auto& domain : HostCache::Get(host)->domains)
+  {
+    if (bloom.MayContain(domain))
+      return true;
+  }
+  return false;
+}
+
+void ContentFilterDomains::Bloom::Add(const std::string& domain)
+{
+  const uint64_t hash = Hash(domain);
+  const uint64_t mask = bits.size() * 64 - 1;
+  uint64_t probe = hash & 0xFFFFFFFF;
+  const uint64_t step = (hash >> 32) | 1;
+  for (size_t i = 0; i < PROBE_COUNT; ++i, probe += step)
+    bits[(probe & mask) / 64] |= uint64_t(1) << (probe % 64);
+}
+
+bool ContentFilterDomains::Bloom::MayContain(const std::string& domain) const
+{
+  const uint64_t hash = Hash(domain);
+  const uint64_t mask = bits.size() * 64 - 1;
+  uint64_t probe = hash & 0xFFFFFFFF;
+  const uint64_t step = (hash >> 32) | 1;
+  for (size_t i = 0; i < PROBE_COUNT; ++i, probe += step)
+  {
+    if (!(bits[(probe & mask) / 64] & (uint64_t(1) << (probe % 64))))
+      return false;
+  }
+  return true;
+}
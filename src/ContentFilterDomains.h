@@ -0,0 +1,74 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace AdblockPlus
+{
+  /**
+   * Bloom filters of the domains which domain specific element hiding,
+   * element hiding emulation and snippet filters are restricted to. They
+   * tell whether any such filter can apply on a host without asking JS, the
+   * answer is `true` for false positives and whenever in doubt.
+   *
+   * The class is not thread safe, but lookups don't modify it.
+   */
+  class ContentFilterDomains
+  {
+  public:
+    enum class Type
+    {
+      ELEMHIDE,
+      EMULATION,
+      SNIPPET,
+      COUNT
+    };
+
+    /**
+     * Replaces the domains of a filter type.
+     * @param type Filter type.
+     * @param domains Domains of the active filters of that type. A `*`
+     *        stands for filters which apply on other domains too, or on
+     *        wildcard ones, every lookup for the type yields `true` then.
+     */
+    void SetDomains(Type type, const std::vector<std::string>& domains);
+
+    /**
+     * @param type Filter type.
+     * @param host Host name, either from a URL or as passed by the caller.
+     * @return `false` if no filter of the type applies on the host or any of
+     *         its parent domains.
+     */
+    bool MayApply(Type type, const std::string& host) const;
+
+  private:
+    struct Bloom
+    {
+      std::vector<uint64_t> bits;
+      bool everywhere = false;
+
+      void Add(const std::string& domain);
+      bool MayContain(const std::string& domain) const;
+    };
+
+    Bloom blooms_[static_cast<size_t>(Type::COUNT)];
+  };
+}
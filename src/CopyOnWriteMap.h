@@ -0,0 +1,149 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+namespace AdblockPlus
+{
+  /**
+   * Hash map which is cheap to copy. The entries are spread over a fixed
+   * number of shards, which the copies share until one of them is modified,
+   * then only the shard of the modified entry is copied. Values which are
+   * expensive to copy can be shared further by storing them as pointers.
+   *
+   * Not thread safe. Copies sharing shards may be read by different threads
+   * while one of them, e.g. the original, keeps being modified.
+   */
+  template<class Key, class Value, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>>
+  class CopyOnWriteMap
+  {
+  public:
+    typedef std::unordered_map<Key, Value, Hash, Equal> Shard;
+    static const size_t SHARD_COUNT = 64;
+
+    size_t Size() const
+    {
+      return size;
+    }
+
+    /**
+     * @return Pointer to the value, valid until the map is modified, or
+     *         `nullptr` if there is none.
+     */
+    const Value* Find(const Key& key) const
+    {
+      const auto& shard = shards[ShardIndex(key)];
+      if (!shard)
+        return nullptr;
+      auto it = shard->find(key);
+      return it == shard->end() ? nullptr : &it->second;
+    }
+
+    bool Contains(const Key& key) const
+    {
+      return Find(key) != nullptr;
+    }
+
+    /**
+     * Same as Find(), but the value may be modified.
+     */
+    Value* FindMutable(const Key& key)
+    {
+      if (!Find(key))
+        return nullptr;
+      return &Unshare(key).find(key)->second;
+    }
+
+    /**
+     * Looks up a value, a default-constructed one is inserted if there is
+     * none.
+     */
+    Value& operator[](const Key& key)
+    {
+      auto inserted = Unshare(key).emplace(key, Value());
+      if (inserted.second)
+        ++size;
+      return inserted.first->second;
+    }
+
+    /**
+     * Inserts a value unless there is one for the key already.
+     * @return `true` if the value was inserted.
+     */
+    template<class... Args> bool Emplace(const Key& key, Args&&... args)
+    {
+      if (!Unshare(key).emplace(key, std::forward<Args>(args)...).second)
+        return false;
+      ++size;
+      return true;
+    }
+
+    void Erase(const Key& key)
+    {
+      if (!Find(key))
+        return;
+      Unshare(key).erase(key);
+      --size;
+    }
+
+    void Clear()
+    {
+      for (auto& shard : shards)
+        shard.reset();
+      size = 0;
+    }
+
+    /**
+     * Calls `visit(key, value)` for every entry, in no particular order.
+     */
+    template<class Visit> void ForEach(Visit visit) const
+    {
+      for (const auto& shard : shards)
+      {
+        if (!shard)
+          continue;
+        for (const auto& entry : *shard)
+          visit(entry.first, entry.second);
+      }
+    }
+
+  private:
+    static size_t ShardIndex(const Key& key)
+    {
+      return Hash()(key) % SHARD_COUNT;
+    }
+
+    Shard& Unshare(const Key& key)
+    {
+      auto& shard = shards[ShardIndex(key)];
+      if (!shard)
+        shard = std::make_shared<Shard>();
+      else if (shard.use_count() > 1)
+        shard = std::make_shared<Shard>(*shard);
+      return *shard;
+    }
+
+    std::array<std::shared_ptr<Shard>, SHARD_COUNT> shards;
+    size_t size = 0;
+  };
+}
@@ -0,0 +1,111 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DeclarativeRulesWriter.h"
+
+#include "Utils.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  // Allowlisting rules win over blocking ones, like in matcher.js.
+  const int BLOCKING_PRIORITY = 1;
+  const int ALLOWING_PRIORITY = 2;
+
+  const struct
+  {
+    IFilterEngine::ContentType type;
+    const char* name;
+  } RESOURCE_TYPES[] = {{IFilterEngine::CONTENT_TYPE_OTHER, "other"},
+                        {IFilterEngine::CONTENT_TYPE_SCRIPT, "script"},
+                        {IFilterEngine::CONTENT_TYPE_IMAGE, "image"},
+                        {IFilterEngine::CONTENT_TYPE_STYLESHEET, "stylesheet"},
+                        {IFilterEngine::CONTENT_TYPE_OBJECT, "object"},
+                        {IFilterEngine::CONTENT_TYPE_SUBDOCUMENT, "sub_frame"},
+                        {IFilterEngine::CONTENT_TYPE_WEBSOCKET, "websocket"},
+                        {IFilterEngine::CONTENT_TYPE_PING, "ping"},
+                        {IFilterEngine::CONTENT_TYPE_XMLHTTPREQUEST, "xmlhttprequest"},
+                        {IFilterEngine::CONTENT_TYPE_MEDIA, "media"},
+                        {IFilterEngine::CONTENT_TYPE_FONT, "font"}};
+
+  void AppendStringArray(const char* name,
+                         const std::vector<std::string>& values,
+                         std::string* json)
+  {
+    json->append(",\"").append(name).append("\":[");
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+      if (i > 0)
+        json->push_back(',');
+      Utils::AppendJsonString(values[i], json);
+    }
+    json->push_back(']');
+  }
+
+  void AppendRule(const NativeMatcher::DeclarativeRule& rule, uint32_t id, std::string* json)
+  {
+    json->append("{\"id\":").append(std::to_string(id));
+    json->append(",\"priority\":")
+        .append(std::to_string(rule.allowing ? ALLOWING_PRIORITY : BLOCKING_PRIORITY));
+    json->append(",\"action\":{\"type\":\"")
+        .append(rule.document ? "allowAllRequests" : rule.allowing ? "allow" : "block")
+        .append("\"},\"condition\":{\"isUrlFilterCaseSensitive\":")
+        .append(rule.matchCase ? "true" : "false");
+    if (!rule.urlFilter.empty())
+    {
+      json->append(",\"urlFilter\":");
+      Utils::AppendJsonString(rule.urlFilter, json);
+    }
+
+    std::vector<std::string> resourceTypes;
+    if (rule.document)
+      resourceTypes = {"main_frame", "sub_frame"};
+    for (const auto& type : RESOURCE_TYPES)
+    {
+      if (rule.contentType & type.type)
+        resourceTypes.push_back(type.name);
+    }
+    if (!resourceTypes.empty())
+      AppendStringArray("resourceTypes", resourceTypes, json);
+
+    if (rule.thirdPartyOnly)
+      json->append(",\"domainType\":\"thirdParty\"");
+    else if (rule.firstPartyOnly)
+      json->append(",\"domainType\":\"firstParty\"");
+    if (!rule.includedDomains.empty())
+      AppendStringArray("initiatorDomains", rule.includedDomains, json);
+    if (!rule.excludedDomains.empty())
+      AppendStringArray("excludedInitiatorDomains", rule.excludedDomains, json);
+    json->append("}}");
+  }
+}
+
+std::string AdblockPlus::WriteDeclarativeNetRequestRules(
+    const std::vector<NativeMatcher::DeclarativeRule>& rules,
+    const std::function<uint32_t(const std::string&)>& getRuleId)
+{
+  std::string json = "[";
+  for (const auto& rule : rules)
+  {
+    if (json.size() > 1)
+      json.push_back(',');
+    AppendRule(rule, getRuleId(*rule.filterText), &json);
+  }
+  json.push_back(']');
+  return json;
+}
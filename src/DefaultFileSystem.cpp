@@ -17,9 +17,13 @@
 
 #include "DefaultFileSystem.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <sstream>
 #include <stdexcept>
 #include <sys/types.h>
@@ -31,7 +35,13 @@
 #include <windows.h>
 #else
 #include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #endif
 
 #include "../src/Utils.h"
@@ -40,6 +50,10 @@ using namespace AdblockPlus;
 
 namespace
 {
+  const size_t COPY_BUFFER_SIZE = 64 * 1024;
+  // Smallest page size of the supported platforms.
+  const size_t PREFETCH_PAGE_SIZE = 4096;
+
   class RuntimeErrorWithErrno : public std::runtime_error
   {
   public:
@@ -49,6 +63,16 @@ namespace
     }
   };
 
+  // Temporary files which exist already, e.g. the one of a concurrent
+  // write of the same file, are skipped.
+  const int MAX_TEMP_FILE_ATTEMPTS = 100;
+  std::atomic<unsigned> tempFileCounter(0);
+
+  std::string MakeTempPath(const std::string& path)
+  {
+    return path + ".tmp" + std::to_string(tempFileCounter++);
+  }
+
 #ifdef WIN32
   // Paths need to be converted from UTF-8 to UTF-16 on Windows.
   std::wstring NormalizePath(const std::string& path)
@@ -91,10 +115,294 @@ IFileSystem::IOBuffer DefaultFileSystemSync::Read(const std::string& path) const
   return data;
 }
 
+IFileSystem::ContentView DefaultFileSystemSync::ReadView(const std::string& path) const
+{
+  IFileSystem::ContentView view{nullptr, 0, nullptr};
+#ifdef WIN32
+  HANDLE file = CreateFileW(NormalizePath(path).c_str(),
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            nullptr,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    throw RuntimeErrorWithErrno("Failed to open " + path);
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size))
+  {
+    CloseHandle(file);
+    throw RuntimeErrorWithErrno("Failed to get the size of " + path);
+  }
+  // Empty files cannot be mapped.
+  if (size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return view;
+  }
+  HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (!mapping)
+    throw RuntimeErrorWithErrno("Failed to map " + path);
+  void* address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  // The view keeps the mapping alive.
+  CloseHandle(mapping);
+  if (!address)
+    throw RuntimeErrorWithErrno("Failed to map " + path);
+  view.owner.reset(address, [](const void* mapped) { UnmapViewOfFile(mapped); });
+  view.size = static_cast<size_t>(size.QuadPart);
+#else
+  const int file = open(NormalizePath(path).c_str(), O_RDONLY | O_CLOEXEC);
+  if (file < 0)
+    throw RuntimeErrorWithErrno("Failed to open " + path);
+  struct stat nativeStat;
+  if (fstat(file, &nativeStat))
+  {
+    close(file);
+    throw RuntimeErrorWithErrno("Failed to get the size of " + path);
+  }
+  // Empty files cannot be mapped.
+  const size_t size = static_cast<size_t>(nativeStat.st_size);
+  if (size == 0)
+  {
+    close(file);
+    return view;
+  }
+  void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+  // The mapping stays valid after closing the file.
+  close(file);
+  if (address == MAP_FAILED)
+    throw RuntimeErrorWithErrno("Failed to map " + path);
+  view.owner.reset(address,
+                   [size](const void* mapped) { munmap(const_cast<void*>(mapped), size); });
+  view.size = size;
+#endif
+  view.data = static_cast<const uint8_t*>(view.owner.get());
+  return view;
+}
+
+DefaultFileSystemSync::FileWriter::FileWriter(const std::string& path)
+    : path(path), isOpen(false)
+{
+  // The content goes to a temporary file first, which replaces the target
+  // only once it is on the disk, so that a crash or a power loss leaves
+  // either the old or the new content behind. Every writer creates its own
+  // one, concurrent writes of a file must not write into the same.
+  for (int attempt = 1;; ++attempt)
+  {
+    tempPath = MakeTempPath(path);
+#ifdef WIN32
+    file = CreateFileW(NormalizePath(tempPath).c_str(),
+                       GENERIC_WRITE,
+                       0,
+                       nullptr,
+                       CREATE_NEW,
+                       FILE_ATTRIBUTE_NORMAL,
+                       nullptr);
+    if (file != INVALID_HANDLE_VALUE)
+      break;
+    if (GetLastError() != ERROR_FILE_EXISTS || attempt == MAX_TEMP_FILE_ATTEMPTS)
+      throw RuntimeErrorWithErrno("Failed to open " + tempPath);
+#else
+    file = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (file >= 0)
+      break;
+    if (errno != EEXIST || attempt == MAX_TEMP_FILE_ATTEMPTS)
+      throw RuntimeErrorWithErrno("Failed to open " + tempPath);
+#endif
+  }
+  isOpen = true;
+}
+
+DefaultFileSystemSync::FileWriter::~FileWriter()
+{
+  if (!isOpen)
+    return;
+#ifdef WIN32
+  CloseHandle(file);
+  DeleteFileW(NormalizePath(tempPath).c_str());
+#else
+  close(file);
+  unlink(tempPath.c_str());
+#endif
+}
+
+void DefaultFileSystemSync::FileWriter::Append(const uint8_t* data, size_t size)
+{
+  while (size > 0)
+  {
+#ifdef WIN32
+    DWORD written = 0;
+    const DWORD chunkSize = static_cast<DWORD>(std::min<size_t>(size, 1 << 30));
+    if (!WriteFile(file, data, chunkSize, &written, nullptr))
+      throw RuntimeErrorWithErrno("Failed to write " + tempPath);
+#else
+    const ssize_t written = write(file, data, size);
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throw RuntimeErrorWithErrno("Failed to write " + tempPath);
+    }
+#endif
+    data += written;
+    size -= written;
+  }
+}
+
+void DefaultFileSystemSync::FileWriter::AppendFile(const std::string& sourcePath)
+{
+  std::vector<uint8_t> buffer;
+#ifdef WIN32
+  // CopyFileW() cannot write into the temporary file, the data is copied
+  // through a buffer instead.
+  HANDLE source = CreateFileW(NormalizePath(sourcePath).c_str(),
+                              GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr);
+  if (source == INVALID_HANDLE_VALUE)
+    throw RuntimeErrorWithErrno("Failed to open " + sourcePath);
+  buffer.resize(COPY_BUFFER_SIZE);
+  DWORD count = 0;
+  BOOL succeeded;
+  while ((succeeded = ReadFile(
+              source, buffer.data(), static_cast<DWORD>(buffer.size()), &count, nullptr)) &&
+         count > 0)
+  {
+    try
+    {
+      Append(buffer.data(), count);
+    }
+    catch (...)
+    {
+      CloseHandle(source);
+      throw;
+    }
+  }
+  CloseHandle(source);
+  if (!succeeded)
+    throw RuntimeErrorWithErrno("Failed to read " + sourcePath);
+#else
+  const int source = open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (source < 0)
+    throw RuntimeErrorWithErrno("Failed to open " + sourcePath);
+  int error = 0;
+  bool copied = false;
+#ifdef __linux__
+  // The kernel copies the data without passing it through user space.
+  struct stat sourceStat;
+  if (fstat(source, &sourceStat) == 0)
+  {
+    copied = true;
+    off_t offset = 0;
+    while (offset < sourceStat.st_size)
+    {
+      const ssize_t sent = sendfile(file, source, &offset, sourceStat.st_size - offset);
+      if (sent == 0)
+        break;
+      if (sent < 0 && errno != EINTR)
+      {
+        // Not every kind of file supports sendfile().
+        if (offset == 0 && (errno == EINVAL || errno == ENOSYS))
+          copied = false;
+        else
+          error = errno;
+        break;
+      }
+    }
+  }
+#endif
+  if (!copied && !error)
+  {
+    buffer.resize(COPY_BUFFER_SIZE);
+    for (;;)
+    {
+      const ssize_t count = read(source, buffer.data(), buffer.size());
+      if (count == 0)
+        break;
+      if (count < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        error = errno;
+        break;
+      }
+      try
+      {
+        Append(buffer.data(), count);
+      }
+      catch (...)
+      {
+        close(source);
+        throw;
+      }
+    }
+  }
+  close(source);
+  if (error)
+  {
+    errno = error;
+    throw RuntimeErrorWithErrno("Failed to copy " + sourcePath);
+  }
+#endif
+}
+
+void DefaultFileSystemSync::FileWriter::Commit()
+{
+  isOpen = false;
+#ifdef WIN32
+  const std::wstring nativeTempPath = NormalizePath(tempPath);
+  const bool flushed = FlushFileBuffers(file) != 0;
+  CloseHandle(file);
+  if (!flushed || !MoveFileExW(nativeTempPath.c_str(),
+                               NormalizePath(path).c_str(),
+                               MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+  {
+    DeleteFileW(nativeTempPath.c_str());
+    throw RuntimeErrorWithErrno("Failed to replace " + path);
+  }
+#else
+  int error = fsync(file) ? errno : 0;
+  if (close(file) && !error)
+    error = errno;
+  if (!error && rename(tempPath.c_str(), path.c_str()))
+    error = errno;
+  if (error)
+  {
+    unlink(tempPath.c_str());
+    errno = error;
+    throw RuntimeErrorWithErrno("Failed to replace " + path);
+  }
+
+  // Makes the rename itself durable, failing here doesn't lose any data.
+  const size_t separator = path.rfind(PATH_SEPARATOR);
+  const std::string directory = separator == std::string::npos
+                                    ? std::string(".")
+                                    : path.substr(0, std::max<size_t>(separator, 1));
+  const int directoryFile = open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+  if (directoryFile >= 0)
+  {
+    fsync(directoryFile);
+    close(directoryFile);
+  }
+#endif
+}
+
 void DefaultFileSystemSync::Write(const std::string& path, const IFileSystem::IOBuffer& data)
 {
-  std::ofstream file(NormalizePath(path).c_str(), std::ios_base::out | std::ios_base::binary);
-  file.write(reinterpret_cast<const std::ofstream::char_type*>(data.data()), data.size());
+  FileWriter writer(path);
+  writer.Append(data.data(), data.size());
+  writer.Commit();
+}
+
+void DefaultFileSystemSync::Copy(const std::string& fromPath, const std::string& toPath)
+{
+  FileWriter writer(toPath);
+  writer.AppendFile(fromPath);
+  writer.Commit();
 }
 
 void DefaultFileSystemSync::Move(const std::string& fromPath, const std::string& toPath)
@@ -187,130 +495,617 @@ std::string DefaultFileSystemSync::Resolve(const std::string& path) const
   }
 }
 
+namespace
+{
+  // Writes the chunks in background tasks, each of which writes all the
+  // chunks appended so far, so the file is written in order even if the
+  // executor runs the tasks concurrently.
+  class DefaultFileWriter : public IFileSystem::IFileWriter
+  {
+  public:
+    DefaultFileWriter(IExecutor& executor,
+                      const std::shared_ptr<DefaultFileSystemSync>& sync,
+                      const std::string& fileName,
+                      const std::function<void()>& committed)
+        : executor(executor), state(std::make_shared<State>())
+    {
+      state->sync = sync;
+      state->fileName = fileName;
+      state->cancellation = executor.GetCancellationToken();
+      state->committed = committed;
+    }
+
+    void Append(IFileSystem::IOBuffer&& chunk) override
+    {
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->chunks.push_back(std::move(chunk));
+      }
+      Dispatch();
+    }
+
+    void Commit(const IFileSystem::Callback& callback) override
+    {
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->callback = callback;
+      }
+      Dispatch();
+    }
+
+  private:
+    struct State
+    {
+      std::shared_ptr<DefaultFileSystemSync> sync;
+      std::string fileName;
+      CancellationToken cancellation;
+      // Called once the file is replaced.
+      std::function<void()> committed;
+      // Taken by the tasks, guards the file and the error.
+      std::mutex writeMutex;
+      std::unique_ptr<DefaultFileSystemSync::FileWriter> file;
+      std::string error;
+      // Guards the chunks and the callback.
+      std::mutex mutex;
+      std::deque<IFileSystem::IOBuffer> chunks;
+      IFileSystem::Callback callback;
+    };
+
+    void Dispatch()
+    {
+      auto taskState = state;
+      executor.Dispatch([taskState] { WriteChunks(*taskState); },
+                        IExecutor::TaskClass::BACKGROUND);
+    }
+
+    static void WriteChunks(State& state)
+    {
+      std::lock_guard<std::mutex> writeLock(state.writeMutex);
+      for (;;)
+      {
+        IFileSystem::IOBuffer chunk;
+        IFileSystem::Callback callback;
+        {
+          std::lock_guard<std::mutex> lock(state.mutex);
+          if (!state.chunks.empty())
+          {
+            chunk = std::move(state.chunks.front());
+            state.chunks.pop_front();
+          }
+          else if (state.callback)
+            callback = std::move(state.callback);
+          else
+            return;
+        }
+
+        if (state.error.empty())
+        {
+          try
+          {
+            if (!state.file)
+              state.file.reset(
+                  new DefaultFileSystemSync::FileWriter(state.sync->Resolve(state.fileName)));
+            if (callback)
+            {
+              state.file->Commit();
+              state.committed();
+            }
+            else
+              state.file->Append(chunk.data(), chunk.size());
+          }
+          catch (std::exception& e)
+          {
+            state.error = e.what();
+          }
+          catch (...)
+          {
+            state.error = "Unknown error while writing to " + state.fileName;
+          }
+        }
+
+        if (callback)
+        {
+          state.file.reset();
+          state.cancellation.Run([&] { callback(state.error); });
+          return;
+        }
+      }
+    }
+
+    IExecutor& executor;
+    std::shared_ptr<State> state;
+  };
+}
+
 DefaultFileSystem::DefaultFileSystem(IExecutor& executor,
                                      std::unique_ptr<DefaultFileSystemSync> syncImpl)
-    : executor(executor), syncImpl(std::move(syncImpl))
+    : executor(executor), syncImpl(std::move(syncImpl)), pendingWrites(new PendingWrites()),
+      statCache(new StatCache()), prefetchCache(new PrefetchCache())
 {
 }
 
-void DefaultFileSystem::Read(const std::string& fileName,
-                             const ReadCallback& doneCallback,
-                             const Callback& errorCallback) const
+void DefaultFileSystem::PendingWrites::Close(const std::string& fileName)
 {
-  executor.Dispatch([this, fileName, doneCallback, errorCallback] {
-    std::string error;
-    try
-    {
-      doneCallback(syncImpl->Read(Resolve(fileName)));
-      return;
-    }
-    catch (std::exception& e)
+  std::lock_guard<std::mutex> lock(mutex);
+  byFileName.erase(fileName);
+}
+
+bool DefaultFileSystem::StatCache::Find(const std::string& fileName, StatResult* result)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = byFileName.find(fileName);
+  if (it == byFileName.end())
+    return false;
+  *result = it->second;
+  return true;
+}
+
+uint64_t DefaultFileSystem::StatCache::GetGeneration()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return generation;
+}
+
+void DefaultFileSystem::StatCache::Store(const std::string& fileName,
+                                         const StatResult& result,
+                                         uint64_t takenAt)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (takenAt == generation)
+    byFileName[fileName] = result;
+}
+
+void DefaultFileSystem::StatCache::Invalidate(const std::string& fileName)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  ++generation;
+  byFileName.erase(fileName);
+}
+
+std::shared_ptr<DefaultFileSystem::PrefetchedFile>
+DefaultFileSystem::PrefetchCache::Take(const std::string& fileName)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = byFileName.find(fileName);
+  if (it == byFileName.end())
+    return nullptr;
+  auto file = std::move(it->second);
+  byFileName.erase(it);
+  return file;
+}
+
+void DefaultFileSystem::Prefetch(const std::vector<std::string>& fileNames)
+{
+  for (const auto& fileName : fileNames)
+  {
+    auto file = std::make_shared<PrefetchedFile>();
     {
-      error = e.what();
+      std::lock_guard<std::mutex> lock(prefetchCache->mutex);
+      if (!prefetchCache->byFileName.emplace(fileName, file).second)
+        continue;
     }
-    catch (...)
+    auto sync = syncImpl;
+    auto cache = prefetchCache;
+    executor.Dispatch(
+        [sync, cache, file, fileName] {
+          ContentView content = {};
+          std::string error;
+          try
+          {
+            content = sync->ReadView(sync->Resolve(fileName));
+            // Faults the pages of a mapping in now rather than on first use.
+            volatile uint8_t touched = 0;
+            for (size_t i = 0; i < content.size; i += PREFETCH_PAGE_SIZE)
+              touched ^= content.data[i];
+          }
+          catch (std::exception& e)
+          {
+            error = e.what();
+          }
+          catch (...)
+          {
+            error = "Unknown error while reading from " + fileName + " as " +
+                    sync->Resolve(fileName);
+          }
+
+          std::vector<std::function<void()>> waiters;
+          {
+            std::lock_guard<std::mutex> lock(cache->mutex);
+            file->content = content;
+            file->error = error;
+            file->done = true;
+            waiters.swap(file->waiters);
+          }
+          for (const auto& waiter : waiters)
+            waiter();
+        },
+        IExecutor::TaskClass::CRITICAL);
+  }
+}
+
+bool DefaultFileSystem::ReadPrefetched(const std::string& fileName,
+                                       const ReadViewCallback& doneCallback,
+                                       const Callback& errorCallback) const
+{
+  auto file = prefetchCache->Take(fileName);
+  if (!file)
+    return false;
+
+  auto cancellation = executor.GetCancellationToken();
+  // Only called once the file is done, it doesn't change after that.
+  auto deliver = [file, cancellation, fileName, doneCallback, errorCallback] {
+    std::string error = file->error;
+    if (error.empty())
     {
-      error = "Unknown error while reading from " + fileName + " as " + Resolve(fileName);
+      try
+      {
+        cancellation.Run([&] { doneCallback(file->content); });
+        return;
+      }
+      catch (std::exception& e)
+      {
+        error = e.what();
+      }
+      catch (...)
+      {
+        error = "Unknown error while reading from " + fileName;
+      }
     }
 
     try
     {
-      errorCallback(error);
+      cancellation.Run([&] { errorCallback(error); });
     }
     catch (...)
     {
       // there is no way to catch an exception thrown from the error callback.
     }
-  });
+  };
+
+  {
+    std::lock_guard<std::mutex> lock(prefetchCache->mutex);
+    if (!file->done)
+    {
+      file->waiters.push_back(deliver);
+      return true;
+    }
+  }
+  // Like any other read, the callbacks are called asynchronously.
+  executor.Dispatch(deliver, IExecutor::TaskClass::CRITICAL);
+  return true;
+}
+
+void DefaultFileSystem::Read(const std::string& fileName,
+                             const ReadCallback& doneCallback,
+                             const Callback& errorCallback) const
+{
+  pendingWrites->Close(fileName);
+  if (ReadPrefetched(
+          fileName,
+          [doneCallback](const ContentView& content) {
+            doneCallback(IOBuffer(content.data, content.data + content.size));
+          },
+          errorCallback))
+    return;
+  auto sync = syncImpl;
+  auto cancellation = executor.GetCancellationToken();
+  executor.Dispatch(
+      [sync, cancellation, fileName, doneCallback, errorCallback] {
+        std::string error;
+        try
+        {
+          cancellation.Run([&] { doneCallback(sync->Read(sync->Resolve(fileName))); });
+          return;
+        }
+        catch (std::exception& e)
+        {
+          error = e.what();
+        }
+        catch (...)
+        {
+          error = "Unknown error while reading from " + fileName + " as " +
+                  sync->Resolve(fileName);
+        }
+
+        try
+        {
+          cancellation.Run([&] { errorCallback(error); });
+        }
+        catch (...)
+        {
+          // there is no way to catch an exception thrown from the error callback.
+        }
+      },
+      IExecutor::TaskClass::CRITICAL);
+}
+
+void DefaultFileSystem::ReadView(const std::string& fileName,
+                                 const ReadViewCallback& doneCallback,
+                                 const Callback& errorCallback) const
+{
+  pendingWrites->Close(fileName);
+  if (ReadPrefetched(fileName, doneCallback, errorCallback))
+    return;
+  auto sync = syncImpl;
+  auto cancellation = executor.GetCancellationToken();
+  executor.Dispatch(
+      [sync, cancellation, fileName, doneCallback, errorCallback] {
+        std::string error;
+        try
+        {
+          cancellation.Run([&] { doneCallback(sync->ReadView(sync->Resolve(fileName))); });
+          return;
+        }
+        catch (std::exception& e)
+        {
+          error = e.what();
+        }
+        catch (...)
+        {
+          error = "Unknown error while reading from " + fileName + " as " +
+                  sync->Resolve(fileName);
+        }
+
+        try
+        {
+          cancellation.Run([&] { errorCallback(error); });
+        }
+        catch (...)
+        {
+          // there is no way to catch an exception thrown from the error callback.
+        }
+      },
+      IExecutor::TaskClass::CRITICAL);
 }
 
 void DefaultFileSystem::Write(const std::string& fileName,
                               const IOBuffer& data,
                               const Callback& callback)
 {
-  executor.Dispatch([this, fileName, data, callback] {
-    std::string error;
-    try
-    {
-      syncImpl->Write(Resolve(fileName), data);
-    }
-    catch (std::exception& e)
-    {
-      error = e.what();
-    }
-    catch (...)
+  auto writes = pendingWrites;
+  std::shared_ptr<PendingWrite> write;
+  {
+    std::lock_guard<std::mutex> lock(writes->mutex);
+    auto& pending = writes->byFileName[fileName];
+    if (pending)
     {
-      error = "Unknown error while writing to " + fileName + " as " + Resolve(fileName);
+      pending->data = data;
+      pending->callbacks.push_back(callback);
+      return;
     }
-    callback(error);
-  });
+    pending.reset(new PendingWrite{data, {callback}});
+    write = pending;
+  }
+
+  statCache->Invalidate(fileName);
+  prefetchCache->Take(fileName);
+  auto sync = syncImpl;
+  auto cache = statCache;
+  auto cancellation = executor.GetCancellationToken();
+  executor.Dispatch(
+      [sync, cache, writes, write, cancellation, fileName] {
+        IOBuffer content;
+        std::vector<Callback> callbacks;
+        {
+          std::lock_guard<std::mutex> lock(writes->mutex);
+          auto it = writes->byFileName.find(fileName);
+          if (it != writes->byFileName.end() && it->second == write)
+            writes->byFileName.erase(it);
+          content = std::move(write->data);
+          callbacks = std::move(write->callbacks);
+        }
+
+        std::string error;
+        try
+        {
+          sync->Write(sync->Resolve(fileName), content);
+        }
+        catch (std::exception& e)
+        {
+          error = e.what();
+        }
+        catch (...)
+        {
+          error = "Unknown error while writing to " + fileName + " as " + sync->Resolve(fileName);
+        }
+        cache->Invalidate(fileName);
+        for (const auto& writeCallback : callbacks)
+          cancellation.Run([&] { writeCallback(error); });
+      },
+      IExecutor::TaskClass::BACKGROUND);
+}
+
+std::unique_ptr<IFileSystem::IFileWriter>
+DefaultFileSystem::OpenWriter(const std::string& fileName)
+{
+  pendingWrites->Close(fileName);
+  prefetchCache->Take(fileName);
+  auto cache = statCache;
+  return std::unique_ptr<IFileWriter>(new DefaultFileWriter(
+      executor, syncImpl, fileName, [cache, fileName] { cache->Invalidate(fileName); }));
 }
 
 void DefaultFileSystem::Move(const std::string& fromFileName,
                              const std::string& toFileName,
                              const Callback& callback)
 {
-  executor.Dispatch([this, fromFileName, toFileName, callback] {
-    std::string error;
-    try
-    {
-      syncImpl->Move(Resolve(fromFileName), Resolve(toFileName));
-    }
-    catch (std::exception& e)
-    {
-      error = e.what();
-    }
-    catch (...)
-    {
-      error = "Unknown error while moving " + fromFileName + " to " + toFileName;
-    }
-    callback(error);
-  });
+  pendingWrites->Close(fromFileName);
+  pendingWrites->Close(toFileName);
+  prefetchCache->Take(fromFileName);
+  prefetchCache->Take(toFileName);
+  auto sync = syncImpl;
+  auto cache = statCache;
+  auto cancellation = executor.GetCancellationToken();
+  executor.Dispatch(
+      [sync, cache, cancellation, fromFileName, toFileName, callback] {
+        std::string error;
+        try
+        {
+          sync->Move(sync->Resolve(fromFileName), sync->Resolve(toFileName));
+        }
+        catch (std::exception& e)
+        {
+          error = e.what();
+        }
+        catch (...)
+        {
+          error = "Unknown error while moving " + fromFileName + " to " + toFileName;
+        }
+        cache->Invalidate(fromFileName);
+        cache->Invalidate(toFileName);
+        cancellation.Run([&] { callback(error); });
+      },
+      IExecutor::TaskClass::BACKGROUND);
+}
+
+void DefaultFileSystem::Copy(const std::string& fromFileName,
+                             const std::string& toFileName,
+                             const Callback& callback)
+{
+  pendingWrites->Close(fromFileName);
+  pendingWrites->Close(toFileName);
+  prefetchCache->Take(toFileName);
+  auto sync = syncImpl;
+  auto cache = statCache;
+  auto cancellation = executor.GetCancellationToken();
+  executor.Dispatch(
+      [sync, cache, cancellation, fromFileName, toFileName, callback] {
+        std::string error;
+        try
+        {
+          sync->Copy(sync->Resolve(fromFileName), sync->Resolve(toFileName));
+        }
+        catch (std::exception& e)
+        {
+          error = e.what();
+        }
+        catch (...)
+        {
+          error = "Unknown error while copying " + fromFileName + " to " + toFileName;
+        }
+        cache->Invalidate(toFileName);
+        cancellation.Run([&] { callback(error); });
+      },
+      IExecutor::TaskClass::BACKGROUND);
 }
 
 void DefaultFileSystem::Remove(const std::string& fileName, const Callback& callback)
 {
-  executor.Dispatch([this, fileName, callback] {
-    std::string error;
-    try
-    {
-      syncImpl->Remove(Resolve(fileName));
-    }
-    catch (std::exception& e)
-    {
-      error = e.what();
-    }
-    catch (...)
-    {
-      error = "Unknown error while removing " + fileName + " as " + Resolve(fileName);
-    }
-    callback(error);
-  });
+  pendingWrites->Close(fileName);
+  prefetchCache->Take(fileName);
+  auto sync = syncImpl;
+  auto cache = statCache;
+  auto cancellation = executor.GetCancellationToken();
+  executor.Dispatch(
+      [sync, cache, cancellation, fileName, callback] {
+        std::string error;
+        try
+        {
+          sync->Remove(sync->Resolve(fileName));
+        }
+        catch (std::exception& e)
+        {
+          error = e.what();
+        }
+        catch (...)
+        {
+          error = "Unknown error while removing " + fileName + " as " + sync->Resolve(fileName);
+        }
+        cache->Invalidate(fileName);
+        cancellation.Run([&] { callback(error); });
+      },
+      IExecutor::TaskClass::BACKGROUND);
 }
 
 void DefaultFileSystem::Stat(const std::string& fileName, const StatCallback& callback) const
 {
-  executor.Dispatch([this, fileName, callback] {
-    std::string error;
-    try
-    {
-      auto result = syncImpl->Stat(Resolve(fileName));
-      callback(result, error);
-      return;
-    }
-    catch (std::exception& e)
-    {
-      error = e.what();
-    }
-    catch (...)
-    {
-      error = "Unknown error while calling stat on " + fileName + " as " + Resolve(fileName);
-    }
-    callback(StatResult(), error);
-  });
+  pendingWrites->Close(fileName);
+  StatResult cachedResult;
+  if (statCache->Find(fileName, &cachedResult))
+  {
+    callback(cachedResult, "");
+    return;
+  }
+
+  auto sync = syncImpl;
+  auto cache = statCache;
+  const uint64_t generation = cache->GetGeneration();
+  auto cancellation = executor.GetCancellationToken();
+  executor.Dispatch(
+      [sync, cache, generation, cancellation, fileName, callback] {
+        std::string error;
+        try
+        {
+          auto result = sync->Stat(sync->Resolve(fileName));
+          cache->Store(fileName, result, generation);
+          cancellation.Run([&] { callback(result, error); });
+          return;
+        }
+        catch (std::exception& e)
+        {
+          error = e.what();
+        }
+        catch (...)
+        {
+          error = "Unknown error while calling stat on " + fileName + " as " +
+                  sync->Resolve(fileName);
+        }
+        cancellation.Run([&] { callback(StatResult(), error); });
+      },
+      IExecutor::TaskClass::CRITICAL);
 }
 
-std::string DefaultFileSystem::Resolve(const std::string& fileName) const
+void DefaultFileSystem::StatMany(const std::vector<std::string>& fileNames,
+                                 const StatManyCallback& callback) const
 {
-  return syncImpl->Resolve(fileName);
+  std::vector<StatResult> results(fileNames.size());
+  std::vector<std::string> errors(fileNames.size());
+  std::vector<size_t> missing;
+  for (size_t i = 0; i < fileNames.size(); i++)
+  {
+    pendingWrites->Close(fileNames[i]);
+    if (!statCache->Find(fileNames[i], &results[i]))
+      missing.push_back(i);
+  }
+  if (missing.empty())
+  {
+    callback(results, errors);
+    return;
+  }
+
+  // The files which aren't cached are all handled by one task.
+  auto sync = syncImpl;
+  auto cache = statCache;
+  const uint64_t generation = cache->GetGeneration();
+  auto cancellation = executor.GetCancellationToken();
+  executor.Dispatch(
+      [sync,
+       cache,
+       generation,
+       cancellation,
+       fileNames,
+       missing,
+       callback,
+       results,
+       errors]() mutable {
+        for (size_t i : missing)
+        {
+          try
+          {
+            results[i] = sync->Stat(sync->Resolve(fileNames[i]));
+            cache->Store(fileNames[i], results[i], generation);
+          }
+          catch (std::exception& e)
+          {
+            errors[i] = e.what();
+          }
+          catch (...)
+          {
+            errors[i] = "Unknown error while calling stat on " + fileNames[i] + " as " +
+                        sync->Resolve(fileNames[i]);
+          }
+        }
+        cancellation.Run([&] { callback(results, errors); });
+      },
+      IExecutor::TaskClass::CRITICAL);
 }
@@ -17,6 +17,13 @@
 
 #pragma once
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include <AdblockPlus/IExecutor.h>
 #include <AdblockPlus/IFileSystem.h>
 
@@ -39,8 +46,45 @@ namespace AdblockPlus
   public:
     explicit DefaultFileSystemSync(const std::string& basePath);
     IFileSystem::IOBuffer Read(const std::string& path) const;
+    // Maps the file into memory, so it must be replaced rather than
+    // rewritten while the view is in use.
+    IFileSystem::ContentView ReadView(const std::string& path) const;
+    /**
+     * Writes a file incrementally. The content goes to a temporary file,
+     * which is flushed to the disk and replaces the target on Commit(), so
+     * the file keeps its old content if writing fails half way. Every writer
+     * has a temporary file of its own, so concurrent writes of the same file
+     * don't mix. Destroying the writer before removes the temporary file.
+     */
+    class FileWriter
+    {
+    public:
+      explicit FileWriter(const std::string& path);
+      ~FileWriter();
+      FileWriter(const FileWriter&) = delete;
+      FileWriter& operator=(const FileWriter&) = delete;
+
+      void Append(const uint8_t* data, size_t size);
+      // Appends the content of another file.
+      void AppendFile(const std::string& sourcePath);
+      void Commit();
+
+    private:
+      std::string path;
+      std::string tempPath;
+      bool isOpen;
+#ifdef _WIN32
+      void* file;
+#else
+      int file;
+#endif
+    };
+
+    // Same as writing the data with a FileWriter.
     void Write(const std::string& path, const IFileSystem::IOBuffer& data);
     void Move(const std::string& fromPath, const std::string& toPath);
+    // Same as writing the content of the source with a FileWriter.
+    void Copy(const std::string& fromPath, const std::string& toPath);
     void Remove(const std::string& path);
     IFileSystem::StatResult Stat(const std::string& path) const;
     std::string Resolve(const std::string& fileName) const;
@@ -49,6 +93,18 @@ namespace AdblockPlus
     std::string basePath;
   };
 
+  /**
+   * Dispatches the calls of DefaultFileSystemSync to an executor.
+   * A write to a file which still waits for an earlier write to it takes the
+   * place of the earlier one, so a burst of writes ends up on the disk once.
+   * Any other operation on the file lets the waiting write go unchanged.
+   * Stat results are cached until the file is changed through this object,
+   * so the files must not be changed by anyone else, and a cached result is
+   * passed to the callback before Stat() returns.
+   * Files passed to Prefetch() are read ahead, the first Read() or
+   * ReadView() of each gets the content read then, unless the file was
+   * changed through this object meanwhile.
+   */
   class DefaultFileSystem : public IFileSystem
   {
   public:
@@ -56,18 +112,89 @@ namespace AdblockPlus
     void Read(const std::string& fileName,
               const ReadCallback& doneCallback,
               const Callback& errorCallback) const override;
+    void ReadView(const std::string& fileName,
+                  const ReadViewCallback& doneCallback,
+                  const Callback& errorCallback) const override;
     void
     Write(const std::string& fileName, const IOBuffer& data, const Callback& callback) override;
     void Move(const std::string& fromFileName,
               const std::string& toFileName,
               const Callback& callback) override;
+    void Copy(const std::string& fromFileName,
+              const std::string& toFileName,
+              const Callback& callback) override;
     void Remove(const std::string& fileName, const Callback& callback) override;
     void Stat(const std::string& fileName, const StatCallback& callback) const override;
+    void StatMany(const std::vector<std::string>& fileNames,
+                  const StatManyCallback& callback) const override;
+    std::unique_ptr<IFileWriter> OpenWriter(const std::string& fileName) override;
+
+    /**
+     * Starts reading files which are going to be read soon, e.g. while the
+     * scripts which read them are still being evaluated. Files which were
+     * mapped into memory are paged in as well.
+     * @param fileNames Files to read.
+     */
+    void Prefetch(const std::vector<std::string>& fileNames);
 
   private:
-    // Returns the absolute path to a file.
-    std::string Resolve(const std::string& fileName) const;
+    struct PendingWrite
+    {
+      IOBuffer data;
+      std::vector<Callback> callbacks;
+    };
+
+    struct PendingWrites
+    {
+      std::mutex mutex;
+      std::map<std::string, std::shared_ptr<PendingWrite>> byFileName;
+
+      // Keeps later writes from being merged into the waiting one.
+      void Close(const std::string& fileName);
+    };
+
+    struct StatCache
+    {
+      std::mutex mutex;
+      std::map<std::string, StatResult> byFileName;
+      // Increased on every change, results taken before aren't stored.
+      uint64_t generation = 0;
+
+      bool Find(const std::string& fileName, StatResult* result);
+      uint64_t GetGeneration();
+      void Store(const std::string& fileName, const StatResult& result, uint64_t takenAt);
+      void Invalidate(const std::string& fileName);
+    };
+
+    struct PrefetchedFile
+    {
+      // Guarded by the mutex of the cache.
+      bool done = false;
+      ContentView content = {};
+      std::string error;
+      // Called once done.
+      std::vector<std::function<void()>> waiters;
+    };
+
+    struct PrefetchCache
+    {
+      std::mutex mutex;
+      std::map<std::string, std::shared_ptr<PrefetchedFile>> byFileName;
+
+      // Removes the file, so that only the first read gets the prefetched
+      // content.
+      std::shared_ptr<PrefetchedFile> Take(const std::string& fileName);
+    };
+
+    bool ReadPrefetched(const std::string& fileName,
+                        const ReadViewCallback& doneCallback,
+                        const Callback& errorCallback) const;
+
     IExecutor& executor;
-    std::unique_ptr<DefaultFileSystemSync> syncImpl;
+    // Shared with the dispatched tasks, which might outlive this object.
+    std::shared_ptr<DefaultFileSystemSync> syncImpl;
+    std::shared_ptr<PendingWrites> pendingWrites;
+    std::shared_ptr<StatCache> statCache;
+    std::shared_ptr<PrefetchCache> prefetchCache;
   };
 }
@@ -19,38 +19,350 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <functional>
+#include <stdexcept>
 #include <string>
 
+#include <AdblockPlus/URLInfo.h>
+
+#include "ApiCallStats.h"
+#include "DeclarativeRulesWriter.h"
 #include "DefaultFilterImplementation.h"
 #include "DefaultSubscriptionImplementation.h"
 #include "ElementUtils.h"
+#include "HostCache.h"
 #include "JsContext.h"
+#include "SharedFilterDataWriter.h"
+#include "SignatureVerifier.h"
+#include "Utils.h"
 
 using namespace AdblockPlus;
 
-DefaultFilterEngine::DefaultFilterEngine(JsEngine& jsEngine) : jsEngine(jsEngine)
+namespace
+{
+  IFilterEngine::MatchResult MakeMatchResult(std::shared_ptr<const std::string> filterText)
+  {
+    IFilterEngine::MatchResult result;
+    if (filterText->compare(0, 2, "@@") == 0)
+    {
+      result.decision = IFilterEngine::MatchResult::ALLOWLISTED;
+      result.type = Filter::Type::TYPE_EXCEPTION;
+    }
+    else
+    {
+      result.decision = IFilterEngine::MatchResult::BLOCKED;
+      result.type = Filter::Type::TYPE_BLOCKING;
+    }
+    result.filterText = std::move(filterText);
+    return result;
+  }
+
+  const char* PATTERNS_FILE = "patterns.ini";
+  const std::chrono::milliseconds IDLE_GC_BUDGET(10);
+  const char* MATCHER_INDEX_FILE = "patterns.ini.matcher";
+  const char* TOP_DOMAINS_FILE = "topdomains.txt";
+
+  // FNV-1a, only used to detect changes of patterns.ini.
+  uint64_t Checksum(const IFileSystem::IOBuffer& data)
+  {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (uint8_t byte : data)
+    {
+      hash ^= byte;
+      hash *= 0x100000001b3;
+    }
+    return hash;
+  }
+
+  const std::string& GetParentUrl(const std::vector<std::string>& documentUrls, size_t frame)
+  {
+    // The top of the frame hierarchy is passed as its own parent. This is
+    // consistent with WebExt ("|| frame.url.hostname"):
+    // https://gitlab.com/eyeo/adblockplus/adblockpluschrome/-/blob/6a345b830841052c09cfce6faf77eb8e682d7b7a/lib/allowlisting.js#L53
+    if (frame + 1 < documentUrls.size() && !documentUrls[frame + 1].empty())
+      return documentUrls[frame + 1];
+    return documentUrls[frame];
+  }
+
+  // Number of filters or subscriptions retrieved at once by the Visit*()
+  // methods.
+  const size_t VISIT_PAGE_SIZE = 1000;
+
+  // Number of values per subscription returned by "getSubscriptionInfo".
+  const size_t SUBSCRIPTION_INFO_FIELDS = 13;
+
+  // Sitekey signatures remembered by VerifySignature(), a page load checks
+  // the same one for the document and its frames.
+  const size_t SIGNATURE_CACHE_SIZE = 64;
+
+  // Moderate memory pressure shrinks the caches to this fraction of their
+  // capacity.
+  const size_t MEMORY_PRESSURE_CACHE_DIVISOR = 4;
+
+  // Slots of the match cache of each thread, a power of two. Network threads
+  // mostly repeat the requests they have just matched.
+  const size_t THREAD_MATCH_CACHE_SIZE = 64;
+
+  std::atomic<uint64_t> nextEngineId(1);
+
+  // Rough sizes of V8 objects on 64-bit builds, used by
+  // GetSubscriptionMemoryUsage(): the header of a sequential string, the
+  // slot referencing a filter text in a subscription and a parsed filter.
+  const size_t JS_STRING_HEADER_SIZE = 16;
+  const size_t JS_FILTER_SLOT_SIZE = 8;
+  const size_t JS_FILTER_OBJECT_SIZE = 64;
+
+  // Runs on the timer thread, a failure must not take it down.
+  void AddFilterHits(JsEngine& jsEngine, const std::vector<HitCounter::FilterHits>& hits)
+  {
+    std::string packedHits;
+    for (const auto& filterHits : hits)
+    {
+      if (!packedHits.empty())
+        packedHits += '\n';
+      packedHits += std::to_string(filterHits.count) + '\n' +
+                    std::to_string(filterHits.lastHit) + '\n' + *filterHits.filterText;
+    }
+    try
+    {
+      jsEngine.GetApiFunction("addFilterHits").Call(jsEngine.NewValue(packedHits));
+    }
+    catch (const std::exception& e)
+    {
+      jsEngine.GetLogSystem()(LogSystem::LOG_LEVEL_ERROR,
+                              std::string("Failed to add filter hits: ") + e.what(),
+                              "DefaultFilterEngine");
+    }
+  }
+
+  size_t EstimateJsStringSize(const std::string& str)
+  {
+    // Strings with non-ASCII characters are stored with two bytes per
+    // character, which is at most the length in UTF-8.
+    const bool oneByte = std::all_of(
+        str.begin(), str.end(), [](char c) { return static_cast<unsigned char>(c) < 0x80; });
+    const size_t size = JS_STRING_HEADER_SIZE + (oneByte ? str.size() : 2 * str.size());
+    return (size + 7) & ~static_cast<size_t>(7);
+  }
+
+  IFilterEngine::SubscriptionInfo ReadSubscriptionInfo(const JsFieldReader& fields)
+  {
+    IFilterEngine::SubscriptionInfo info;
+    info.url = fields.AsString(0);
+    info.title = fields.AsString(1);
+    info.homepage = fields.AsString(2);
+    info.author = fields.AsString(3);
+    info.languages = Utils::SplitString(fields.AsString(4), ',');
+    info.filterCount = fields.AsInt(5);
+    info.synchronizationStatus = fields.AsString(6);
+    info.lastDownloadAttemptTime = fields.AsInt(7);
+    info.lastDownloadSuccessTime = fields.AsInt(8);
+    info.version = fields.AsInt(9);
+    info.disabled = fields.AsBool(10);
+    info.updating = fields.AsBool(11);
+    info.aa = fields.AsBool(12);
+    return info;
+  }
+
+  // In the order of DefaultFilterEngine::ApiCall.
+  const char* const API_CALL_NAMES[] = {"Matches",
+                                        "MatchesBatch",
+                                        "GetMatchResult",
+                                        "CheckPopup",
+                                        "IsContentAllowlisted",
+                                        "GetElementHidingStyleSheet",
+                                        "GetElementHidingGenericStyleSheet",
+                                        "GetElementHidingDomainStyleSheet",
+                                        "GetElementHidingEmulationSelectors",
+                                        "GetSnippetScript",
+                                        "ComposeFilterSuggestions",
+                                        "ComposeFilterSuggestionsBatch"};
+
+  // Parses the URL filters of a downloaded filter list in advance, with
+  // the same normalization as Filter.normalize() in adblockpluscore, so that
+  // rebuilding the native matcher after the update only has to index them.
+  bool PrepareFilterList(const std::string& body,
+                         NativeMatcher::PreparedFilters* prepared,
+                         NativeFilterPool* pool)
+  {
+    static const char HEADER[] = "[adblock";
+    const size_t headerLength = sizeof(HEADER) - 1;
+    if (body.size() < headerLength ||
+        !std::equal(HEADER, HEADER + headerLength, body.begin(), [](char a, char b) {
+          return a == std::tolower(static_cast<unsigned char>(b));
+        }))
+      return false;
+
+    std::string text;
+    for (size_t start = 0; start < body.size();)
+    {
+      size_t end = body.find_first_of("\r\n", start);
+      if (end == std::string::npos)
+        end = body.size();
+      text.clear();
+      for (size_t i = start; i < end; ++i)
+      {
+        if (!std::isspace(static_cast<unsigned char>(body[i])))
+          text.push_back(body[i]);
+      }
+      start = end + 1;
+      // Comments, headers and element hiding filters.
+      if (text.empty() || text[0] == '!' || text[0] == '[' ||
+          text.find("##") != std::string::npos || text.find("#@#") != std::string::npos ||
+          text.find("#?#") != std::string::npos || text.find("#$#") != std::string::npos)
+        continue;
+      NativeMatcher::Prepare(text, prepared, pool);
+    }
+    return true;
+  }
+
+  // Holds the lock of the engine along with the scopes, which the JsContext
+  // instances of the calls made meanwhile nest into.
+  class DefaultEngineSession : public IFilterEngine::EngineSession
+  {
+  public:
+    explicit DefaultEngineSession(JsEngine& jsEngine)
+        : context(jsEngine.GetIsolate(), *jsEngine.GetContext())
+    {
+    }
+
+  private:
+    // Before the context, so that the lock is requested with priority.
+    const InteractivePriority::ExclusiveScope exclusive;
+    const JsContext context;
+  };
+
+  // Same as in "API.getElementHidingStyleSheet", only the host matters.
+  std::string GetElementHidingHost(const std::string& domain)
+  {
+    return domain.find(':') != std::string::npos ? URLInfo::ExtractHost(domain) : domain;
+  }
+
+  // Referrers of a call which only passes the document URL.
+  std::vector<std::string> ToDocumentUrls(const std::string& documentUrl)
+  {
+    return documentUrl.empty() ? std::vector<std::string>()
+                               : std::vector<std::string>{documentUrl};
+  }
+
+  void TraceRequest(TraceRecorder& recorder,
+                    const std::string& url,
+                    IFilterEngine::ContentTypeMask contentTypeMask,
+                    const std::vector<std::string>& documentUrls,
+                    const std::string& siteKey,
+                    const IFilterEngine::MatchResult& result)
+  {
+    const bool blocked = result.decision == IFilterEngine::MatchResult::BLOCKED;
+    if (contentTypeMask == IFilterEngine::CONTENT_TYPE_POPUP)
+      recorder.RecordPopup(url, documentUrls.empty() ? "" : documentUrls.front(), blocked);
+    else
+      recorder.RecordFilterMatch(url, contentTypeMask, documentUrls, siteKey, blocked);
+  }
+}
+
+DefaultFilterEngine::DefaultFilterEngine(JsEngine& jsEngine,
+                                         const FilterEngineFactory::CreationParameters& parameters)
+    : jsEngine(jsEngine),
+      gcScheduler_(std::make_shared<GcScheduler>(
+          jsEngine.GetTimer(),
+          [&jsEngine]() { jsEngine.NotifyLowMemory(); },
+          [&jsEngine]() { jsEngine.NotifyIdle(IDLE_GC_BUDGET); },
+          parameters.idleGcDelay,
+          parameters.lowMemoryNotificationInterval)),
+      hitCounter_(std::make_shared<HitCounter>(
+          jsEngine.GetTimer(),
+          [&jsEngine](std::vector<HitCounter::FilterHits>&& hits) {
+            AddFilterHits(jsEngine, hits);
+          },
+          parameters.filterHitsFlushInterval)),
+      matcherIndex_(std::make_shared<MatcherIndexState>()),
+      matchCache_(parameters.matchCacheSize), matchCacheGeneration_(0), engineId_(nextEngineId++),
+      threadMatchCacheHits_(0), styleSheetCache_(parameters.styleSheetCacheSize),
+      emulationSelectorsCache_(parameters.styleSheetCacheSize),
+      snippetScriptCache_(parameters.snippetScriptCacheSize),
+      signatureCache_(SIGNATURE_CACHE_SIZE), asyncCallThread_(parameters.asyncCallThread)
 {
+  if (parameters.sharedFilterPool)
+  {
+    matcherIndex_->filterPool = parameters.sharedFilterPool->pool_.get();
+    matcherIndex_->sharedFilterPool = parameters.sharedFilterPool;
+  }
+  if (parameters.warmedDomainCount != 0)
+  {
+    cacheWarmer_ = std::make_shared<CacheWarmer>(
+        jsEngine.GetTimer(),
+        [this](const std::vector<std::string>& hosts) { this->WarmUpCaches(hosts); },
+        [&jsEngine](const std::string& ranking) {
+          jsEngine.GetFileSystem().Write(TOP_DOMAINS_FILE,
+                                         IFileSystem::IOBuffer(ranking.begin(), ranking.end()),
+                                         [](const std::string&) {});
+        },
+        parameters.warmedDomainCount,
+        parameters.cacheWarmingDelay);
+    std::weak_ptr<CacheWarmer> weakWarmer = cacheWarmer_;
+    jsEngine.GetFileSystem().Read(
+        TOP_DOMAINS_FILE,
+        [weakWarmer](IFileSystem::IOBuffer&& ranking) {
+          if (auto warmer = weakWarmer.lock())
+            warmer->Load(std::string(ranking.begin(), ranking.end()));
+        },
+        [](const std::string&) {});
+  }
   jsEngine.SetEventCallback("filterChange", [this](JsValueList&& params) {
     this->OnSubscriptionOrFilterChanged(move(params));
   });
+  jsEngine.SetEventCallback("filterChanges", [this](JsValueList&& params) {
+    this->OnSubscriptionOrFilterChanges(move(params));
+  });
+  jsEngine.SetEventCallback("_fileWrite",
+                            [this](JsValueList&& params) { this->OnFileWrite(move(params)); });
+  jsEngine.SetEventCallback("_saveStats", [this](JsValueList&& params) {
+    hitCounter_->SetEnabled(!params.empty() && params[0].AsBool());
+  });
+  // The index which came with it replaces the one read on start.
+  jsEngine.SetEventCallback("_precompiledFilterStorage",
+                            [this](JsValueList&&) { this->RestoreNativeMatcher(); });
+  auto state = matcherIndex_;
+  jsEngine.SetMemoryPressureObserver(
+      [this](MemoryPressureLevel level) { this->OnMemoryPressure(level); });
+  jsEngine.SetResponseBodyObserver([state](const std::string&, const std::string& body) {
+    NativeMatcher::PreparedFilters prepared;
+    if (!PrepareFilterList(body, &prepared, state->filterPool))
+      return;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->prepared.empty())
+      state->prepared.swap(prepared);
+    else
+      state->prepared.insert(prepared.begin(), prepared.end());
+  });
 }
 
 DefaultFilterEngine::~DefaultFilterEngine()
 {
+  cacheWarmer_.reset();
+  asyncCalls_.reset();
+  jsEngine.SetResponseBodyObserver(JsEngine::ResponseBodyObserver());
+  jsEngine.SetMemoryPressureObserver(JsEngine::MemoryPressureObserver());
+  jsEngine.RemoveEventCallback("_precompiledFilterStorage");
+  jsEngine.RemoveEventCallback("_saveStats");
+  jsEngine.RemoveEventCallback("_fileWrite");
+  jsEngine.RemoveEventCallback("filterChanges");
   jsEngine.RemoveEventCallback("filterChange");
+  // No change can schedule another rebuild now.
+  nativeMatcherRebuilds_.reset();
 }
 
 Filter DefaultFilterEngine::GetFilter(const std::string& text) const
 {
-  JsValue func = jsEngine.Evaluate("API.getFilterFromText");
+  JsValue func = jsEngine.GetApiFunction("getFilterFromText");
   return Filter(
       std::make_unique<DefaultFilterImplementation>(func.Call(jsEngine.NewValue(text)), &jsEngine));
 }
 
 Subscription DefaultFilterEngine::GetSubscription(const std::string& url) const
 {
-  JsValue func = jsEngine.Evaluate("API.getSubscriptionFromUrl");
+  JsValue func = jsEngine.GetApiFunction("getSubscriptionFromUrl");
   return Subscription(std::make_unique<DefaultSubscriptionImplementation>(
       func.Call(jsEngine.NewValue(url)), &jsEngine));
 }
@@ -58,29 +370,53 @@ Subscription DefaultFilterEngine::GetSubscription(const std::string& url) const
 std::vector<Subscription>
 DefaultFilterEngine::GetSubscriptionsFromFilter(const Filter& filter) const
 {
-  JsValue func = jsEngine.Evaluate("API.getSubscriptionsFromFilter");
-  auto subscriptions = func.Call(jsEngine.NewValue(filter.GetRaw()));
-  if (subscriptions.IsNull() || subscriptions.IsUndefined())
+  const auto urls = GetSubscriptionUrlsFromFilter(filter.GetRaw());
+  std::vector<Subscription> result;
+  result.reserve(urls.size());
+  for (const auto& url : urls)
+    result.push_back(GetSubscription(url));
+  return result;
+}
+
+std::vector<std::string>
+DefaultFilterEngine::GetSubscriptionUrlsFromFilter(const std::string& filterText) const
+{
+  BuildSubscriptionIndex();
+  std::lock_guard<std::mutex> lock(subscriptionIndexMutex_);
+  return subscriptionIndex_.Find(filterText);
+}
+
+void DefaultFilterEngine::BuildSubscriptionIndex() const
+{
   {
-    return {};
+    std::lock_guard<std::mutex> lock(subscriptionIndexMutex_);
+    if (subscriptionIndexBuilt_)
+      return;
   }
 
-  assert(subscriptions.IsArray());
-  auto subscriptions_values = subscriptions.AsList();
-  std::vector<Subscription> result;
-  result.reserve(subscriptions_values.size());
-  for (auto value : subscriptions_values)
+  // No event can change the filters before the index is complete.
+  const JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+  if (subscriptionIndexBuilt_)
+    return;
+  JsValue func = jsEngine.GetApiFunction("getSubscriptionFilters");
+  FilterSubscriptionIndex index;
+  for (const auto& subscription : func.Call().AsList())
   {
-    result.push_back(Subscription(
-        std::make_unique<DefaultSubscriptionImplementation>(std::move(value), &jsEngine)));
+    auto lines = Utils::SplitString(subscription.AsString(), '\n');
+    if (lines.empty())
+      continue;
+    const std::string url = std::move(lines.front());
+    lines.erase(lines.begin());
+    index.SetFilters(url, lines);
   }
-
-  return result;
+  std::lock_guard<std::mutex> lock(subscriptionIndexMutex_);
+  subscriptionIndex_ = std::move(index);
+  subscriptionIndexBuilt_ = true;
 }
 
 std::vector<Filter> DefaultFilterEngine::GetListedFilters() const
 {
-  JsValue func = jsEngine.Evaluate("API.getListedFilters");
+  JsValue func = jsEngine.GetApiFunction("getListedFilters");
   JsValueList values = func.Call().AsList();
   std::vector<Filter> result;
   for (auto& value : values)
@@ -89,9 +425,45 @@ std::vector<Filter> DefaultFilterEngine::GetListedFilters() const
   return result;
 }
 
+size_t DefaultFilterEngine::GetListedFilterCount() const
+{
+  return jsEngine.GetApiFunction("getListedFilterCount").Call().AsInt();
+}
+
+std::vector<IFilterEngine::FilterInfo> DefaultFilterEngine::GetListedFilters(size_t offset,
+                                                                             size_t limit) const
+{
+  JsValueList params;
+  params.push_back(jsEngine.NewValue(static_cast<double>(offset)));
+  params.push_back(jsEngine.NewValue(static_cast<double>(limit)));
+  JsValue func = jsEngine.GetApiFunction("getPackedListedFilters");
+  // Class names and filter texts alternate, separated by line breaks.
+  const auto fields = Utils::SplitString(func.Call(params).AsString(), '\n');
+  std::vector<FilterInfo> result;
+  result.reserve(fields.size() / 2);
+  for (size_t i = 0; i + 1 < fields.size(); i += 2)
+    result.push_back({fields[i + 1], DefaultFilterImplementation::TypeFromClassName(fields[i])});
+  return result;
+}
+
+void DefaultFilterEngine::VisitListedFilters(const FilterVisitor& visitor) const
+{
+  for (size_t offset = 0;; offset += VISIT_PAGE_SIZE)
+  {
+    const auto filters = GetListedFilters(offset, VISIT_PAGE_SIZE);
+    for (const auto& filter : filters)
+    {
+      if (!visitor(filter))
+        return;
+    }
+    if (filters.size() < VISIT_PAGE_SIZE)
+      return;
+  }
+}
+
 std::vector<Subscription> DefaultFilterEngine::GetListedSubscriptions() const
 {
-  JsValue func = jsEngine.Evaluate("API.getListedSubscriptions");
+  JsValue func = jsEngine.GetApiFunction("getListedSubscriptions");
   JsValueList values = func.Call().AsList();
   std::vector<Subscription> result;
   for (auto& value : values)
@@ -100,9 +472,41 @@ std::vector<Subscription> DefaultFilterEngine::GetListedSubscriptions() const
   return result;
 }
 
+IFilterEngine::SubscriptionInfo
+DefaultFilterEngine::GetSubscriptionInfo(const Subscription& subscription) const
+{
+  const auto* impl =
+      static_cast<const DefaultSubscriptionImplementation*>(subscription.Implementation());
+  JsValue func = jsEngine.GetApiFunction("getSubscriptionInfo");
+  std::vector<SubscriptionInfo> result;
+  func.Call(impl->jsObject)
+      .VisitRecords(SUBSCRIPTION_INFO_FIELDS, [&result](const JsFieldReader& fields) {
+        result.push_back(ReadSubscriptionInfo(fields));
+      });
+  if (result.empty())
+    throw std::runtime_error("Unexpected subscription info");
+  return result.front();
+}
+
+size_t DefaultFilterEngine::GetListedSubscriptionCount() const
+{
+  return jsEngine.GetApiFunction("getListedSubscriptionCount").Call().AsInt();
+}
+
+std::vector<IFilterEngine::SubscriptionInfo>
+DefaultFilterEngine::GetListedSubscriptions(size_t offset, size_t limit) const
+{
+  return GetSubscriptionInfo("getListedSubscriptionInfo", offset, limit);
+}
+
+void DefaultFilterEngine::VisitListedSubscriptions(const SubscriptionVisitor& visitor) const
+{
+  VisitSubscriptionInfo("getListedSubscriptionInfo", visitor);
+}
+
 std::vector<Subscription> DefaultFilterEngine::FetchAvailableSubscriptions() const
 {
-  JsValue func = jsEngine.Evaluate("API.getRecommendedSubscriptions");
+  JsValue func = jsEngine.GetApiFunction("getRecommendedSubscriptions");
   JsValueList values = func.Call().AsList();
   std::vector<Subscription> result;
   for (auto& value : values)
@@ -111,14 +515,86 @@ std::vector<Subscription> DefaultFilterEngine::FetchAvailableSubscriptions() con
   return result;
 }
 
+size_t DefaultFilterEngine::GetAvailableSubscriptionCount() const
+{
+  return GetRecommendations()->size();
+}
+
+std::vector<IFilterEngine::SubscriptionInfo>
+DefaultFilterEngine::FetchAvailableSubscriptions(size_t offset, size_t limit) const
+{
+  return GetSubscriptionInfo("getRecommendedSubscriptionInfo", offset, limit);
+}
+
+void DefaultFilterEngine::VisitAvailableSubscriptions(const SubscriptionVisitor& visitor) const
+{
+  VisitSubscriptionInfo("getRecommendedSubscriptionInfo", visitor);
+}
+
+std::shared_ptr<const std::vector<IFilterEngine::Recommendation>>
+DefaultFilterEngine::GetRecommendations() const
+{
+  if (auto recommendations = std::atomic_load(&recommendations_))
+    return recommendations;
+
+  // Concurrent first calls read the same list, whichever is stored wins.
+  JsValue func = jsEngine.GetApiFunction("getRecommendations");
+  std::shared_ptr<const std::vector<Recommendation>> recommendations =
+      std::make_shared<const std::vector<Recommendation>>(func.Call().MapObjects<Recommendation>(
+          {"url", "title", "homepage", "type", "languages"}, [](const JsFieldReader& fields) {
+            Recommendation recommendation;
+            recommendation.url = fields.AsString(0);
+            recommendation.title = fields.AsString(1);
+            recommendation.homepage = fields.AsString(2);
+            recommendation.type = fields.AsString(3);
+            recommendation.languages = Utils::SplitString(fields.AsString(4), ',');
+            return recommendation;
+          }));
+  std::atomic_store(&recommendations_, recommendations);
+  return recommendations;
+}
+
+std::vector<IFilterEngine::SubscriptionInfo> DefaultFilterEngine::GetSubscriptionInfo(
+    const std::string& apiFunction, size_t offset, size_t limit) const
+{
+  JsValueList params;
+  params.push_back(jsEngine.NewValue(static_cast<double>(offset)));
+  params.push_back(jsEngine.NewValue(static_cast<double>(limit)));
+  // The fields of all subscriptions in a single list, see
+  // "getSubscriptionInfo" in api.js.
+  std::vector<SubscriptionInfo> result;
+  jsEngine.GetApiFunction(apiFunction)
+      .Call(params)
+      .VisitRecords(SUBSCRIPTION_INFO_FIELDS, [&result](const JsFieldReader& fields) {
+        result.push_back(ReadSubscriptionInfo(fields));
+      });
+  return result;
+}
+
+void DefaultFilterEngine::VisitSubscriptionInfo(const std::string& apiFunction,
+                                                const SubscriptionVisitor& visitor) const
+{
+  for (size_t offset = 0;; offset += VISIT_PAGE_SIZE)
+  {
+    const auto subscriptions = GetSubscriptionInfo(apiFunction, offset, VISIT_PAGE_SIZE);
+    for (const auto& subscription : subscriptions)
+    {
+      if (!visitor(subscription))
+        return;
+    }
+    if (subscriptions.size() < VISIT_PAGE_SIZE)
+      return;
+  }
+}
+
 void DefaultFilterEngine::SetAAEnabled(bool enabled)
 {
-  jsEngine.Evaluate("API.setAASubscriptionEnabled").Call(jsEngine.NewValue(enabled));
+  jsEngine.GetApiFunction("setAASubscriptionEnabled").Call(jsEngine.NewValue(enabled));
 }
 
 bool DefaultFilterEngine::IsAAEnabled() const
 {
-  return jsEngine.Evaluate("API.isAASubscriptionEnabled()").AsBool();
+  return jsEngine.GetApiFunction("isAASubscriptionEnabled").Call().AsBool();
 }
 
 std::string DefaultFilterEngine::GetAAUrl() const
@@ -132,12 +608,118 @@ Filter DefaultFilterEngine::Matches(const std::string& url,
                                     const std::string& siteKey,
                                     bool specificOnly) const
 {
-  if (documentUrl.empty())
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::MATCHES));
+  NotifyActivity();
+  // An empty document URL means that we are at the top of the frame hierarchy.
+  Filter filter = CheckFilterMatch(url, contentTypeMask, documentUrl, siteKey, specificOnly);
+  RecordHit(filter);
+  if (auto recorder = std::atomic_load(&traceRecorder_))
+    TraceRequest(*recorder,
+                 url,
+                 contentTypeMask,
+                 ToDocumentUrls(documentUrl),
+                 siteKey,
+                 ToMatchResult(filter));
+  return filter;
+}
+
+std::vector<Filter>
+DefaultFilterEngine::MatchesBatch(const std::vector<MatchRequest>& requests) const
+{
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::MATCHES_BATCH));
+  NotifyActivity();
+  std::vector<Filter> result = CheckFilterMatches(requests);
+  for (const auto& filter : result)
+    RecordHit(filter);
+  if (auto recorder = std::atomic_load(&traceRecorder_))
+  {
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+      if (!requests[i].url.empty())
+        TraceRequest(*recorder,
+                     requests[i].url,
+                     requests[i].contentTypeMask,
+                     ToDocumentUrls(requests[i].documentUrl),
+                     requests[i].siteKey,
+                     ToMatchResult(result[i]));
+    }
+  }
+  return result;
+}
+
+std::vector<Filter>
+DefaultFilterEngine::CheckFilterMatches(const std::vector<MatchRequest>& requests) const
+{
+  std::vector<Filter> result(requests.size());
+  if (requests.empty())
+    return result;
+
+  auto nativeMatcher = GetNativeMatcherForLookup();
+
+  // Only the requests which the native matcher can't answer go to JS.
+  std::vector<size_t> jsIndices;
+  for (size_t i = 0; i < requests.size(); ++i)
+  {
+    const auto& request = requests[i];
+    if (request.url.empty())
+      continue;
+    std::shared_ptr<const std::string> filterText;
+    switch (nativeMatcher->Match(request.url,
+                                 request.contentTypeMask,
+                                 request.documentUrl,
+                                 request.specificOnly,
+                                 &filterText))
+    {
+    case NativeMatcher::Result::MATCH:
+      result[i] = GetFilter(*filterText);
+      break;
+    case NativeMatcher::Result::UNKNOWN:
+      jsIndices.push_back(i);
+      break;
+    case NativeMatcher::Result::NO_MATCH:
+      break;
+    }
+  }
+  if (jsIndices.empty())
+    return result;
+
+  // Keep the engine locked for the whole batch instead of for every request.
+  const JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+  JsValueList jsRequests;
+  jsRequests.reserve(jsIndices.size());
+  for (auto it = jsIndices.begin(); it != jsIndices.end();)
   {
-    // We must be at the top of the frame hierarchy.
-    return CheckFilterMatch(url, contentTypeMask, "", siteKey, specificOnly);
+    const auto& request = requests[*it];
+    URLInfo urlInfo = URLInfo::Parse(request.url);
+    if (!urlInfo.IsValid())
+    {
+      it = jsIndices.erase(it);
+      continue;
+    }
+    JsValue jsRequest = jsEngine.NewObject();
+    jsRequest.SetProperty("href", urlInfo.GetHref());
+    jsRequest.SetProperty("protocol", urlInfo.GetProtocol());
+    jsRequest.SetProperty("hostname", urlInfo.GetHostname());
+    jsRequest.SetProperty("contentTypeMask", request.contentTypeMask);
+    jsRequest.SetProperty("documentHost", URLInfo::ExtractHost(request.documentUrl));
+    jsRequest.SetProperty("siteKey", request.siteKey);
+    jsRequest.SetProperty("specificOnly", request.specificOnly);
+    jsRequests.push_back(std::move(jsRequest));
+    ++it;
+  }
+  if (jsRequests.empty())
+    return result;
+
+  JsValue func = jsEngine.GetApiFunction("checkFilterMatches");
+  JsValueList matches = func.Call(jsEngine.NewValueArray(jsRequests)).AsList();
+  assert(matches.size() == jsIndices.size());
+  for (size_t i = 0; i < matches.size() && i < jsIndices.size(); ++i)
+  {
+    if (!matches[i].IsNull())
+      result[jsIndices[i]] =
+          Filter(std::make_unique<DefaultFilterImplementation>(std::move(matches[i]), &jsEngine));
   }
-  return CheckFilterMatch(url, contentTypeMask, documentUrl, siteKey, specificOnly);
+  return result;
 }
 
 bool DefaultFilterEngine::IsContentAllowlisted(const std::string& url,
@@ -145,10 +727,368 @@ bool DefaultFilterEngine::IsContentAllowlisted(const std::string& url,
                                                const std::vector<std::string>& documentUrls,
                                                const std::string& sitekey) const
 {
-  return GetAllowlistingFilter(url, contentTypeMask, documentUrls, sitekey).IsValid();
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::IS_CONTENT_ALLOWLISTED));
+  const Filter filter = GetAllowlistingFilter(url, contentTypeMask, documentUrls, sitekey);
+  RecordHit(filter);
+  return filter.IsValid();
+}
+
+DefaultFilterEngine::DefaultFrameContext::DefaultFrameContext(
+    const std::vector<std::string>& documentUrls, const std::string& siteKey)
+    : documentUrls(documentUrls), siteKey(siteKey)
+{
+}
+
+const std::vector<std::string>& DefaultFilterEngine::DefaultFrameContext::GetDocumentUrls() const
+{
+  return documentUrls;
+}
+
+const std::string& DefaultFilterEngine::DefaultFrameContext::GetSiteKey() const
+{
+  return siteKey;
+}
+
+const std::string& DefaultFilterEngine::DefaultFrameContext::GetDocumentUrl() const
+{
+  static const std::string topLevel;
+  return documentUrls.empty() ? topLevel : documentUrls.front();
+}
+
+std::shared_ptr<const IFilterEngine::FrameContext>
+DefaultFilterEngine::CreateFrameContext(const std::vector<std::string>& documentUrls,
+                                        const std::string& siteKey) const
+{
+  if (cacheWarmer_ && documentUrls.size() == 1)
+    cacheWarmer_->RecordVisit(URLInfo::ExtractHost(documentUrls.front()));
+  return std::make_shared<const DefaultFrameContext>(documentUrls, siteKey);
+}
+
+Filter DefaultFilterEngine::Matches(const std::string& url,
+                                    ContentTypeMask contentTypeMask,
+                                    const FrameContext& frame,
+                                    bool specificOnly) const
+{
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::MATCHES));
+  NotifyActivity();
+  if (url.empty())
+    return Filter();
+  const auto& context = static_cast<const DefaultFrameContext&>(frame);
+  const auto allowlisting = GetFrameAllowlisting(context);
+  Filter filter = allowlisting.document.IsMatched()
+                      ? GetFilter(*allowlisting.document.filterText)
+                      : CheckFilterMatch(url,
+                                         contentTypeMask,
+                                         context.GetDocumentUrl(),
+                                         context.GetSiteKey(),
+                                         specificOnly || allowlisting.genericblock);
+  RecordHit(filter);
+  if (auto recorder = std::atomic_load(&traceRecorder_))
+    TraceRequest(*recorder,
+                 url,
+                 contentTypeMask,
+                 context.GetDocumentUrls(),
+                 context.GetSiteKey(),
+                 ToMatchResult(filter));
+  return filter;
+}
+
+IFilterEngine::MatchResult DefaultFilterEngine::GetMatchResult(const std::string& url,
+                                                               ContentTypeMask contentTypeMask,
+                                                               const FrameContext& frame,
+                                                               bool specificOnly) const
+{
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::GET_MATCH_RESULT));
+  NotifyActivity();
+  if (url.empty())
+    return MatchResult();
+  const auto& context = static_cast<const DefaultFrameContext&>(frame);
+  auto allowlisting = GetFrameAllowlisting(context);
+  MatchResult result = allowlisting.document.IsMatched()
+                           ? std::move(allowlisting.document)
+                           : GetMatchResultCached(url,
+                                                  contentTypeMask,
+                                                  context.GetDocumentUrl(),
+                                                  context.GetSiteKey(),
+                                                  specificOnly || allowlisting.genericblock);
+  RecordHit(result);
+  if (auto recorder = std::atomic_load(&traceRecorder_))
+    TraceRequest(
+        *recorder, url, contentTypeMask, context.GetDocumentUrls(), context.GetSiteKey(), result);
+  return result;
+}
+
+IFilterEngine::PopupBlockResult DefaultFilterEngine::CheckPopup(const std::string& url,
+                                                                const FrameContext& opener) const
+{
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::CHECK_POPUP));
+  NotifyActivity();
+  const auto& context = static_cast<const DefaultFrameContext&>(opener);
+  auto allowlisting = GetFrameAllowlisting(context);
+  if (allowlisting.document.IsMatched())
+  {
+    RecordHit(allowlisting.document);
+    return PopupBlockResult::DISABLED;
+  }
+  if (url.empty())
+    return PopupBlockResult::NO_RULE;
+
+  const MatchResult result = GetMatchResultCached(url,
+                                                  CONTENT_TYPE_POPUP,
+                                                  context.GetDocumentUrl(),
+                                                  context.GetSiteKey(),
+                                                  allowlisting.genericblock);
+  RecordHit(result);
+  if (auto recorder = std::atomic_load(&traceRecorder_))
+    TraceRequest(*recorder,
+                 url,
+                 CONTENT_TYPE_POPUP,
+                 context.GetDocumentUrls(),
+                 context.GetSiteKey(),
+                 result);
+  switch (result.decision)
+  {
+  case MatchResult::BLOCKED:
+    return PopupBlockResult::BLOCK_RULE;
+  case MatchResult::ALLOWLISTED:
+    return PopupBlockResult::ALLOW_RULE;
+  default:
+    return PopupBlockResult::NO_RULE;
+  }
+}
+
+IFilterEngine::PopupBlockResult
+DefaultFilterEngine::CheckPopup(const std::string& url,
+                                const std::vector<std::string>& openerUrls,
+                                const std::string& sitekey) const
+{
+  // The allowlisting of the opener still comes from the match cache.
+  return CheckPopup(url, DefaultFrameContext(openerUrls, sitekey));
+}
+
+DefaultFilterEngine::FrameAllowlisting
+DefaultFilterEngine::GetFrameAllowlisting(const DefaultFrameContext& frame) const
+{
+  uint64_t generation = 0;
+  {
+    std::lock_guard<std::mutex> lock(matchCacheMutex_);
+    generation = matchCacheGeneration_;
+  }
+  {
+    std::lock_guard<std::mutex> lock(frame.mutex);
+    if (frame.known && frame.generation == generation)
+      return frame.allowlisting;
+  }
+
+  // If filters change meanwhile the result is stored with the old
+  // generation and looked up again on the next call.
+  FrameAllowlisting allowlisting;
+  const auto& documentUrls = frame.GetDocumentUrls();
+  if (!documentUrls.empty())
+  {
+    allowlisting.document = ToMatchResult(GetAllowlistingFilter(
+        documentUrls.front(), CONTENT_TYPE_DOCUMENT, documentUrls, frame.GetSiteKey()));
+    if (!allowlisting.document.IsMatched())
+      allowlisting.genericblock = GetAllowlistingFilter(documentUrls.front(),
+                                                        CONTENT_TYPE_GENERICBLOCK,
+                                                        documentUrls,
+                                                        frame.GetSiteKey())
+                                      .IsValid();
+  }
+
+  std::lock_guard<std::mutex> lock(frame.mutex);
+  frame.allowlisting = allowlisting;
+  frame.generation = generation;
+  frame.known = true;
+  return allowlisting;
+}
+
+IFilterEngine::MatchCacheStats DefaultFilterEngine::GetMatchCacheStats() const
+{
+  std::lock_guard<std::mutex> lock(matchCacheMutex_);
+  return {matchCacheHits_ + threadMatchCacheHits_,
+          matchCacheMisses_,
+          matchCache_.Size(),
+          matchCache_.Capacity()};
+}
+
+IFilterEngine::StyleSheetCacheStats DefaultFilterEngine::GetStyleSheetCacheStats() const
+{
+  std::lock_guard<std::mutex> lock(styleSheetCacheMutex_);
+  return {styleSheetCacheHits_,
+          styleSheetCacheMisses_,
+          styleSheetCache_.Size(),
+          styleSheetCache_.Capacity()};
+}
+
+std::vector<uint8_t> DefaultFilterEngine::SerializeSharedFilterData() const
+{
+  const auto nativeMatcher = GetNativeMatcher();
+  return WriteSharedFilterData(
+      *nativeMatcher, jsEngine.GetApiFunction("getSharedElementHiding").Call().AsStringVector());
+}
+
+std::string DefaultFilterEngine::GetDeclarativeNetRequestRules() const
+{
+  const auto nativeMatcher = GetNativeMatcher();
+  std::lock_guard<std::mutex> lock(declarativeRulesMutex_);
+  if (declarativeRulesMatcher_.lock() == nativeMatcher)
+    return declarativeRules_;
+
+  const auto rules = nativeMatcher->GetDeclarativeRules();
+  // IDs of filters which are gone aren't used again, the host may still
+  // have their rules.
+  std::unordered_map<std::string, uint32_t> ruleIds;
+  declarativeRules_ =
+      WriteDeclarativeNetRequestRules(rules, [this, &ruleIds](const std::string& text) {
+        auto it = declarativeRuleIds_.find(text);
+        const uint32_t id =
+            it == declarativeRuleIds_.end() ? nextDeclarativeRuleId_++ : it->second;
+        ruleIds.emplace(text, id);
+        return id;
+      });
+  declarativeRuleIds_.swap(ruleIds);
+  declarativeRulesMatcher_ = nativeMatcher;
+  return declarativeRules_;
+}
+
+std::vector<IFilterEngine::SubscriptionMemoryUsage>
+DefaultFilterEngine::GetSubscriptionMemoryUsage() const
+{
+  const auto nativeMatcher = GetNativeMatcher();
+  BuildSubscriptionIndex();
+  std::vector<SubscriptionMemoryUsage> result;
+  std::lock_guard<std::mutex> lock(subscriptionIndexMutex_);
+  subscriptionIndex_.VisitSubscriptions(
+      [this, &nativeMatcher, &result](const std::string& url,
+                                      const std::vector<const std::string*>& filters) {
+        SubscriptionMemoryUsage usage;
+        usage.url = url;
+        usage.filterCount = filters.size();
+        for (const auto* filter : filters)
+        {
+          const size_t shares =
+              std::max<size_t>(subscriptionIndex_.GetSubscriptionCount(*filter), 1);
+          usage.jsHeapSize += JS_FILTER_SLOT_SIZE +
+                              (EstimateJsStringSize(*filter) + JS_FILTER_OBJECT_SIZE) / shares;
+          usage.nativeSize += nativeMatcher->GetMemoryUsage(*filter) / shares;
+        }
+        result.push_back(std::move(usage));
+      });
+  return result;
+}
+
+IFilterEngine::FilterDeduplicationStats DefaultFilterEngine::GetFilterDeduplicationStats() const
+{
+  const auto nativeMatcher = GetNativeMatcher();
+  BuildSubscriptionIndex();
+  FilterDeduplicationStats stats;
+  std::lock_guard<std::mutex> lock(subscriptionIndexMutex_);
+  subscriptionIndex_.VisitSharedFilters(
+      [&nativeMatcher, &stats](const std::string& filter, size_t subscriptionCount) {
+        const size_t duplicates = subscriptionCount - 1;
+        ++stats.sharedFilterCount;
+        stats.duplicateCount += duplicates;
+        stats.jsHeapSize +=
+            duplicates * (EstimateJsStringSize(filter) + JS_FILTER_OBJECT_SIZE);
+        stats.nativeSize += duplicates * nativeMatcher->GetMemoryUsage(filter);
+      });
+  return stats;
+}
+
+IFilterEngine::CompactStyleSheetStats DefaultFilterEngine::GetCompactStyleSheetStats() const
+{
+  const JsValueList fields = jsEngine.GetApiFunction("getCompactStyleSheetStats").Call().AsList();
+  CompactStyleSheetStats stats;
+  if (fields.size() == 3)
+  {
+    stats.styleSheetCount = static_cast<size_t>(fields[0].AsInt());
+    stats.size = static_cast<size_t>(fields[1].AsInt());
+    stats.savedSize = static_cast<size_t>(fields[2].AsInt());
+  }
+  return stats;
+}
+
+IFilterEngine::PerformanceStats DefaultFilterEngine::GetPerformanceStats() const
+{
+  static_assert(sizeof(API_CALL_NAMES) / sizeof(API_CALL_NAMES[0]) ==
+                    static_cast<size_t>(ApiCall::COUNT),
+                "API_CALL_NAMES has to list all calls");
+  PerformanceStats stats;
+  for (size_t i = 0; i < static_cast<size_t>(ApiCall::COUNT); ++i)
+  {
+    CallStats callStats = apiCalls_[i].GetSnapshot();
+    if (callStats.calls != 0)
+      stats.emplace(API_CALL_NAMES[i], std::move(callStats));
+  }
+  return stats;
+}
+
+void DefaultFilterEngine::FlushFilterHits()
+{
+  hitCounter_->Flush();
+}
+
+void DefaultFilterEngine::NotifyActivity() const
+{
+  gcScheduler_->NotifyActivity();
+  if (cacheWarmer_)
+    cacheWarmer_->NotifyActivity();
+}
+
+void DefaultFilterEngine::RecordHit(const Filter& filter) const
+{
+  if (!hitCounter_->IsEnabled() || !filter.IsValid())
+    return;
+  hitCounter_->RecordHit(
+      static_cast<const DefaultFilterImplementation*>(filter.Implementation())->text);
+}
+
+void DefaultFilterEngine::RecordHit(const MatchResult& result) const
+{
+  if (hitCounter_->IsEnabled() && result.IsMatched())
+    hitCounter_->RecordHit(result.filterText);
+}
+
+void DefaultFilterEngine::StartTraceRecording(const TraceRecordingOptions& options)
+{
+  auto recorder = std::make_shared<TraceRecorder>(jsEngine.GetFileSystem(), options);
+  if (auto previous = std::atomic_exchange(&traceRecorder_, recorder))
+    previous->Commit(TraceRecordingCallback());
+}
+
+void DefaultFilterEngine::StopTraceRecording(const TraceRecordingCallback& callback)
+{
+  auto recorder = std::atomic_exchange(&traceRecorder_, std::shared_ptr<TraceRecorder>());
+  if (recorder)
+    recorder->Commit(callback);
+  else if (callback)
+    callback("");
+}
+
+ApiCallRecorder& DefaultFilterEngine::GetApiCallRecorder(ApiCall call) const
+{
+  return apiCalls_[static_cast<size_t>(call)];
+}
+
+bool DefaultFilterEngine::MatchCacheKey::operator==(const MatchCacheKey& other) const
+{
+  return url == other.url && contentTypeMask == other.contentTypeMask &&
+         documentHost == other.documentHost && siteKey == other.siteKey &&
+         specificOnly == other.specificOnly;
+}
+
+size_t DefaultFilterEngine::MatchCacheKeyHash::operator()(const MatchCacheKey& key) const
+{
+  size_t result = std::hash<std::string>()(key.url);
+  for (size_t value : {static_cast<size_t>(key.documentHost),
+                       static_cast<size_t>(key.siteKey),
+                       static_cast<size_t>(static_cast<uint32_t>(key.contentTypeMask)),
+                       static_cast<size_t>(key.specificOnly)})
+    result ^= value + 0x9e3779b9 + (result << 6) + (result >> 2);
+  return result;
 }
 
-// |documentUrl| gets converted to a hostname (domain) within "API.checkFilterMatch".
 Filter DefaultFilterEngine::CheckFilterMatch(const std::string& url,
                                              ContentTypeMask contentTypeMask,
                                              const std::string& documentUrl,
@@ -157,11 +1097,292 @@ Filter DefaultFilterEngine::CheckFilterMatch(const std::string& url,
 {
   if (url.empty())
     return Filter();
-  JsValue func = jsEngine.Evaluate("API.checkFilterMatch");
+  if (matchCache_.Capacity() == 0)
+    return CheckFilterMatchUncached(url, contentTypeMask, documentUrl, siteKey, specificOnly);
+
+  // Only the host of |documentUrl| is taken into account by the matcher.
+  MatchCacheKey key{url,
+                    contentTypeMask,
+                    StringPool::Shared().Intern(URLInfo::ExtractHost(documentUrl)),
+                    StringPool::Shared().Intern(siteKey),
+                    specificOnly};
+  CachedMatch cached;
+  uint64_t generation = 0;
+  if (LookUpMatchCache(key, &cached, &generation))
+  {
+    if (cached.filter)
+      return *cached.filter;
+    // Stored by GetMatchResult(), which doesn't create Filter objects.
+    if (!cached.result.IsMatched())
+      return Filter();
+    return GetFilter(*cached.result.filterText);
+  }
+
+  auto filter = std::make_shared<const Filter>(
+      CheckFilterMatchUncached(url, contentTypeMask, documentUrl, siteKey, specificOnly));
+  StoreInMatchCache(key, CachedMatch{ToMatchResult(*filter), filter}, generation);
+  return *filter;
+}
+
+IFilterEngine::MatchResult DefaultFilterEngine::GetMatchResult(const std::string& url,
+                                                               ContentTypeMask contentTypeMask,
+                                                               const std::string& documentUrl,
+                                                               const std::string& siteKey,
+                                                               bool specificOnly) const
+{
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::GET_MATCH_RESULT));
+  NotifyActivity();
+  if (url.empty())
+    return MatchResult();
+  MatchResult result =
+      GetMatchResultCached(url, contentTypeMask, documentUrl, siteKey, specificOnly);
+  RecordHit(result);
+  if (auto recorder = std::atomic_load(&traceRecorder_))
+    TraceRequest(
+        *recorder, url, contentTypeMask, ToDocumentUrls(documentUrl), siteKey, result);
+  return result;
+}
+
+template<class Result, class Compute>
+Result DefaultFilterEngine::ComputeOnce(SingleFlight<Result>& flights,
+                                        const std::string& key,
+                                        Compute compute) const
+{
+  if (v8::Locker::IsLocked(jsEngine.GetIsolate()))
+    return compute();
+  return flights.Do(key, compute);
+}
+
+IFilterEngine::MatchResult
+DefaultFilterEngine::GetMatchResultCached(const std::string& url,
+                                          ContentTypeMask contentTypeMask,
+                                          const std::string& documentUrl,
+                                          const std::string& siteKey,
+                                          bool specificOnly) const
+{
+  if (matchCache_.Capacity() == 0)
+    return GetMatchResultUncached(url, contentTypeMask, documentUrl, siteKey, specificOnly);
+
+  MatchCacheKey key{url,
+                    contentTypeMask,
+                    StringPool::Shared().Intern(URLInfo::ExtractHost(documentUrl)),
+                    StringPool::Shared().Intern(siteKey),
+                    specificOnly};
+  const size_t keyHash = MatchCacheKeyHash()(key);
+  MatchResult result;
+  if (LookUpThreadMatchCache(key, keyHash, &result))
+    return result;
+
+  CachedMatch cached;
+  uint64_t generation = 0;
+  if (LookUpMatchCache(key, &cached, &generation))
+    result = cached.result;
+  else
+  {
+    const std::string flightKey = url + '\0' + std::to_string(contentTypeMask) + '\0' +
+                                  std::to_string(key.documentHost) + '\0' +
+                                  std::to_string(key.siteKey) + '\0' +
+                                  (specificOnly ? '1' : '0') + '\0' + std::to_string(generation);
+    result = ComputeOnce(matchesInFlight_, flightKey, [&]() {
+      MatchResult computed =
+          GetMatchResultUncached(url, contentTypeMask, documentUrl, siteKey, specificOnly);
+      StoreInMatchCache(key, CachedMatch{computed, nullptr}, generation);
+      return computed;
+    });
+  }
+
+  auto& slot = GetThreadMatchCacheSlot(keyHash);
+  slot.engineId = engineId_;
+  slot.generation = generation;
+  slot.key = std::move(key);
+  slot.result = result;
+  return result;
+}
+
+// static
+DefaultFilterEngine::ThreadMatchCacheSlot&
+DefaultFilterEngine::GetThreadMatchCacheSlot(size_t keyHash)
+{
+  static thread_local ThreadMatchCacheSlot slots[THREAD_MATCH_CACHE_SIZE];
+  return slots[keyHash & (THREAD_MATCH_CACHE_SIZE - 1)];
+}
+
+bool DefaultFilterEngine::LookUpThreadMatchCache(const MatchCacheKey& key,
+                                                 size_t keyHash,
+                                                 MatchResult* result) const
+{
+  const auto& slot = GetThreadMatchCacheSlot(keyHash);
+  // A flush of the match cache invalidates the slots of all threads.
+  if (slot.engineId != engineId_ || slot.generation != matchCacheGeneration_ || !(slot.key == key))
+    return false;
+  threadMatchCacheHits_.fetch_add(1, std::memory_order_relaxed);
+  *result = slot.result;
+  return true;
+}
+
+bool DefaultFilterEngine::LookUpMatchCache(const MatchCacheKey& key,
+                                           CachedMatch* cached,
+                                           uint64_t* generation) const
+{
+  std::lock_guard<std::mutex> lock(matchCacheMutex_);
+  *generation = matchCacheGeneration_;
+  if (const auto* value = matchCache_.Get(key))
+  {
+    ++matchCacheHits_;
+    *cached = *value;
+    return true;
+  }
+  ++matchCacheMisses_;
+  return false;
+}
+
+void DefaultFilterEngine::StoreInMatchCache(const MatchCacheKey& key,
+                                            CachedMatch&& cached,
+                                            uint64_t generation) const
+{
+  MatchCache::Entries evicted;
+  std::lock_guard<std::mutex> lock(matchCacheMutex_);
+  // Don't store a result computed against filters which changed meanwhile.
+  if (generation == matchCacheGeneration_)
+    matchCache_.Put(key, std::move(cached), &evicted);
+}
+
+void DefaultFilterEngine::FlushMatchCache() const
+{
+  MatchCache::Entries removed;
+  std::lock_guard<std::mutex> lock(matchCacheMutex_);
+  matchCache_.Clear(&removed);
+  ++matchCacheGeneration_;
+}
+
+void DefaultFilterEngine::OnMemoryPressure(MemoryPressureLevel level) const
+{
+  if (level == MemoryPressureLevel::CRITICAL)
+  {
+    FlushMatchCache();
+    FlushStyleSheetCache();
+    FlushSnippetScriptCache();
+    HostCache::Clear();
+    StringPool::Shared().Clear();
+    LruCache<std::string, bool>::Entries removed;
+    std::shared_ptr<const std::string> genericStyleSheet;
+    {
+      std::lock_guard<std::mutex> lock(styleSheetCacheMutex_);
+      // Its version may change once more when it is read again, which only
+      // makes callers apply the same style sheet again.
+      genericStyleSheet = std::move(genericStyleSheet_);
+      genericStyleSheet_.reset();
+    }
+    std::lock_guard<std::mutex> lock(signatureCacheMutex_);
+    signatureCache_.Clear(&removed);
+    return;
+  }
+
+  // The most recently used entries stay, without invalidating lookups in
+  // progress.
+  MatchCache::Entries removedMatches;
+  StyleSheetCache::Entries removedStyleSheets;
+  EmulationSelectorsCache::Entries removedSelectors;
+  SnippetScriptCache::Entries removedScripts;
+  LruCache<std::string, bool>::Entries removedSignatures;
+  {
+    std::lock_guard<std::mutex> lock(matchCacheMutex_);
+    matchCache_.Trim(matchCache_.Capacity() / MEMORY_PRESSURE_CACHE_DIVISOR, &removedMatches);
+  }
+  {
+    std::lock_guard<std::mutex> lock(styleSheetCacheMutex_);
+    styleSheetCache_.Trim(styleSheetCache_.Capacity() / MEMORY_PRESSURE_CACHE_DIVISOR,
+                          &removedStyleSheets);
+    emulationSelectorsCache_.Trim(
+        emulationSelectorsCache_.Capacity() / MEMORY_PRESSURE_CACHE_DIVISOR, &removedSelectors);
+  }
+  {
+    std::lock_guard<std::mutex> lock(snippetMutex_);
+    snippetScriptCache_.Trim(snippetScriptCache_.Capacity() / MEMORY_PRESSURE_CACHE_DIVISOR,
+                             &removedScripts);
+  }
+  std::lock_guard<std::mutex> lock(signatureCacheMutex_);
+  signatureCache_.Trim(signatureCache_.Capacity() / MEMORY_PRESSURE_CACHE_DIVISOR,
+                       &removedSignatures);
+}
+
+Filter DefaultFilterEngine::CheckFilterMatchUncached(const std::string& url,
+                                                     ContentTypeMask contentTypeMask,
+                                                     const std::string& documentUrl,
+                                                     const std::string& siteKey,
+                                                     bool specificOnly) const
+{
+  std::shared_ptr<const std::string> filterText;
+  switch (GetNativeMatcherForLookup()->Match(
+      url, contentTypeMask, documentUrl, specificOnly, &filterText))
+  {
+  case NativeMatcher::Result::MATCH:
+    return GetFilter(*filterText);
+  case NativeMatcher::Result::NO_MATCH:
+    return Filter();
+  case NativeMatcher::Result::UNKNOWN:
+    break;
+  }
+  return CheckFilterMatchInJs(url, contentTypeMask, documentUrl, siteKey, specificOnly);
+}
+
+IFilterEngine::MatchResult
+DefaultFilterEngine::GetMatchResultUncached(const std::string& url,
+                                            ContentTypeMask contentTypeMask,
+                                            const std::string& documentUrl,
+                                            const std::string& siteKey,
+                                            bool specificOnly) const
+{
+  std::shared_ptr<const std::string> filterText;
+  switch (GetNativeMatcherForLookup()->Match(
+      url, contentTypeMask, documentUrl, specificOnly, &filterText))
+  {
+  case NativeMatcher::Result::MATCH:
+    return MakeMatchResult(std::move(filterText));
+  case NativeMatcher::Result::NO_MATCH:
+    return MatchResult();
+  case NativeMatcher::Result::UNKNOWN:
+    break;
+  }
+
+  // The Filter is only needed to read the result and goes away with the
+  // engine still locked.
+  const JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+  return ToMatchResult(
+      CheckFilterMatchInJs(url, contentTypeMask, documentUrl, siteKey, specificOnly));
+}
+
+IFilterEngine::MatchResult DefaultFilterEngine::ToMatchResult(const Filter& filter) const
+{
+  MatchResult result;
+  if (!filter.IsValid())
+    return result;
+  result.type = filter.GetType();
+  result.decision = result.type == Filter::Type::TYPE_EXCEPTION ? MatchResult::ALLOWLISTED
+                                                                 : MatchResult::BLOCKED;
+  result.filterText = GetNativeMatcherForLookup()->Intern(filter.GetRaw());
+  return result;
+}
+
+// Both URLs are parsed natively, only the parts which the matcher uses are
+// passed to "API.checkParsedFilterMatch".
+Filter DefaultFilterEngine::CheckFilterMatchInJs(const std::string& url,
+                                                 ContentTypeMask contentTypeMask,
+                                                 const std::string& documentUrl,
+                                                 const std::string& siteKey,
+                                                 bool specificOnly) const
+{
+  URLInfo urlInfo = URLInfo::Parse(url);
+  if (!urlInfo.IsValid())
+    return Filter();
+
+  JsValue func = jsEngine.GetApiFunction("checkParsedFilterMatch");
   JsValueList params;
-  params.push_back(jsEngine.NewValue(url));
+  params.push_back(jsEngine.NewValue(urlInfo.GetHref()));
+  params.push_back(jsEngine.NewValue(urlInfo.GetProtocol()));
+  params.push_back(jsEngine.NewValue(urlInfo.GetHostname()));
   params.push_back(jsEngine.NewValue(contentTypeMask));
-  params.push_back(jsEngine.NewValue(documentUrl));
+  params.push_back(jsEngine.NewValue(URLInfo::ExtractHost(documentUrl)));
   params.push_back(jsEngine.NewValue(siteKey));
   params.push_back(jsEngine.NewValue(specificOnly));
   JsValue result = func.Call(params);
@@ -171,37 +1392,653 @@ Filter DefaultFilterEngine::CheckFilterMatch(const std::string& url,
     return Filter();
 }
 
-std::string DefaultFilterEngine::GetElementHidingStyleSheet(const std::string& domain,
-                                                            bool specificOnly) const
+std::shared_ptr<const NativeMatcher> DefaultFilterEngine::GetNativeMatcher() const
+{
+  auto snapshot = std::atomic_load(&nativeMatcherSnapshot_);
+  if (snapshot)
+    return snapshot;
+
+  // Filter changes are only triggered while the engine is locked, so neither
+  // the snapshot nor the list of filters can become stale meanwhile.
+  const JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+  snapshot = std::atomic_load(&nativeMatcherSnapshot_);
+  if (snapshot)
+    return snapshot;
+  if (nativeMatcherDirty_)
+  {
+    const auto filters = jsEngine.GetApiFunction("getActiveURLFilters").Call().AsStringVector();
+    NativeMatcher::PreparedFilters prepared;
+    {
+      std::lock_guard<std::mutex> lock(matcherIndex_->mutex);
+      prepared.swap(matcherIndex_->prepared);
+    }
+    nativeMatcher_.Clear();
+    for (const auto& filter : filters)
+      nativeMatcher_.Add(filter, prepared, matcherIndex_->filterPool);
+    nativeMatcherDirty_ = false;
+  }
+  snapshot = std::make_shared<const NativeMatcher>(nativeMatcher_);
+  std::atomic_store(&nativeMatcherSnapshot_, snapshot);
+  return snapshot;
+}
+
+std::shared_ptr<const NativeMatcher> DefaultFilterEngine::GetNativeMatcherForLookup() const
+{
+  // JS already has the new filters, and the rebuild only locks the engine
+  // to take them and to swap the matcher.
+  static const std::shared_ptr<const NativeMatcher> delegating = []() {
+    auto matcher = std::make_shared<NativeMatcher>();
+    matcher->DelegateAll();
+    return matcher;
+  }();
+  auto snapshot = std::atomic_load(&nativeMatcherSnapshot_);
+  if (snapshot)
+    return snapshot;
+  if (nativeMatcherRebuilding_)
+    return delegating;
+  return GetNativeMatcher();
+}
+
+// static
+bool DefaultFilterEngine::AffectsMatching(ChangeEvent event)
+{
+  switch (event)
+  {
+  case ChangeEvent::LOAD:
+  case ChangeEvent::FILTER_ADDED:
+  case ChangeEvent::FILTER_REMOVED:
+  case ChangeEvent::FILTER_DISABLED:
+  case ChangeEvent::SUBSCRIPTION_ADDED:
+  case ChangeEvent::SUBSCRIPTION_REMOVED:
+  case ChangeEvent::SUBSCRIPTION_DISABLED:
+  case ChangeEvent::SUBSCRIPTION_UPDATED:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// static
+bool DefaultFilterEngine::IsFilterChange(ChangeEvent event)
+{
+  return event >= ChangeEvent::FILTER_ADDED && event <= ChangeEvent::FILTER_REMOVED;
+}
+
+void DefaultFilterEngine::UpdateNativeMatcher(ChangeEvent event, const JsValue& item) const
+{
+  if (!AffectsMatching(event))
+    return;
+
+  // Threads which already hold the previous snapshot may finish their
+  // lookups with it, everybody else waits for the change to be applied or
+  // asks JS while the matcher is rebuilt.
+  const auto previous =
+      std::atomic_exchange(&nativeMatcherSnapshot_, std::shared_ptr<const NativeMatcher>());
+
+  std::unique_ptr<NativeMatcher> restored;
+  {
+    std::lock_guard<std::mutex> lock(matcherIndex_->mutex);
+    ++matcherIndex_->generation;
+    if (event == ChangeEvent::LOAD)
+    {
+      matcherIndex_->loaded = true;
+      restored = std::move(matcherIndex_->restored);
+    }
+  }
+  if (restored)
+  {
+    // Built from the very patterns.ini which JS has just loaded.
+    nativeMatcher_ = std::move(*restored);
+    nativeMatcherDirty_ = false;
+    nativeMatcherRebuilding_ = false;
+    return;
+  }
+  // Without the filter, e.g. for changes held back by an update, all the
+  // filters are taken again. That is done in the background once lookups
+  // have been made, before that the next lookup rebuilds everything.
+  if (!IsFilterChange(event) || !item.IsObject())
+  {
+    nativeMatcherDirty_ = true;
+    if (previous || nativeMatcherRebuilding_)
+      ScheduleNativeMatcherRebuild();
+    return;
+  }
+  // Taken by the rebuild anyway.
+  if (nativeMatcherDirty_)
+    return;
+
+  std::string text = item.GetProperty("text").AsString();
+  if (jsEngine.GetApiFunction("isActiveURLFilter").Call(jsEngine.NewValue(text)).AsBool())
+    nativeMatcher_.Add(text, matcherIndex_->filterPool);
+  else
+    nativeMatcher_.Remove(text);
+}
+
+void DefaultFilterEngine::ScheduleNativeMatcherRebuild() const
+{
+  if (nativeMatcherRebuilding_.exchange(true))
+    return;
+  if (!nativeMatcherRebuilds_)
+  {
+    ThreadOptions threadOptions;
+    threadOptions.priority = ThreadOptions::Priority::BACKGROUND;
+    nativeMatcherRebuilds_.reset(new ActiveObject(threadOptions));
+  }
+  nativeMatcherRebuilds_->Post([this]() { RebuildNativeMatcher(); });
+}
+
+void DefaultFilterEngine::RebuildNativeMatcher() const
+{
+  for (;;)
+  {
+    std::vector<std::string> filters;
+    NativeMatcher::PreparedFilters prepared;
+    uint64_t generation = 0;
+    {
+      const JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+      // Rebuilt by GetNativeMatcher() or restored meanwhile.
+      if (!nativeMatcherDirty_)
+      {
+        nativeMatcherRebuilding_ = false;
+        return;
+      }
+      // Taken first, so that a change made while JS lists the filters
+      // can't be counted without being among them.
+      {
+        std::lock_guard<std::mutex> lock(matcherIndex_->mutex);
+        generation = matcherIndex_->generation;
+      }
+      filters = jsEngine.GetApiFunction("getActiveURLFilters").Call().AsStringVector();
+      std::lock_guard<std::mutex> lock(matcherIndex_->mutex);
+      if (matcherIndex_->generation != generation)
+        continue;
+      prepared.swap(matcherIndex_->prepared);
+    }
+
+    // Indexing is what takes long, it is done without blocking anybody.
+    NativeMatcher matcher;
+    for (const auto& filter : filters)
+      matcher.Add(filter, prepared, matcherIndex_->filterPool);
+    auto snapshot = std::make_shared<const NativeMatcher>(matcher);
+
+    const JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+    if (!nativeMatcherDirty_)
+    {
+      nativeMatcherRebuilding_ = false;
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(matcherIndex_->mutex);
+      // Filters changed meanwhile, they are taken again.
+      if (matcherIndex_->generation != generation)
+      {
+        matcherIndex_->prepared.insert(prepared.begin(), prepared.end());
+        continue;
+      }
+    }
+    // Lookups made meanwhile were answered by JS, so the match cache holds
+    // no stale results.
+    nativeMatcher_ = std::move(matcher);
+    nativeMatcherDirty_ = false;
+    std::atomic_store(&nativeMatcherSnapshot_, std::shared_ptr<const NativeMatcher>(snapshot));
+    nativeMatcherRebuilding_ = false;
+    // Skipped by a save during the rebuild.
+    SaveNativeMatcher();
+    return;
+  }
+}
+
+void DefaultFilterEngine::RestoreNativeMatcher()
+{
+  auto state = matcherIndex_;
+  IFileSystem& fileSystem = jsEngine.GetFileSystem();
+  fileSystem.Read(
+      MATCHER_INDEX_FILE,
+      [state, &fileSystem](IFileSystem::IOBuffer&& index) {
+        auto sharedIndex = std::make_shared<IFileSystem::IOBuffer>(std::move(index));
+        fileSystem.Read(
+            PATTERNS_FILE,
+            [state, sharedIndex](IFileSystem::IOBuffer&& patterns) {
+              std::unique_ptr<NativeMatcher> matcher(new NativeMatcher());
+              if (!matcher->Deserialize(*sharedIndex, Checksum(patterns), state->filterPool))
+                return;
+              std::lock_guard<std::mutex> lock(state->mutex);
+              // Too late, the matcher is built from JS then.
+              if (!state->loaded)
+                state->restored = std::move(matcher);
+            },
+            [](const std::string&) {});
+      },
+      [](const std::string&) {});
+}
+
+void DefaultFilterEngine::SaveNativeMatcher() const
+{
+  // Written once the rebuilt matcher is swapped in.
+  if (nativeMatcherRebuilding_)
+    return;
+  auto state = matcherIndex_;
+  uint64_t generation = 0;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    // Filters changed after patterns.ini had been serialized, the next save
+    // is going to write both again.
+    if (state->serializedGeneration != state->generation)
+      return;
+    generation = state->generation;
+  }
+
+  auto matcher = GetNativeMatcher();
+  IFileSystem& fileSystem = jsEngine.GetFileSystem();
+  fileSystem.Read(
+      PATTERNS_FILE,
+      [state, matcher, generation, &fileSystem](IFileSystem::IOBuffer&& patterns) {
+        {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          if (state->generation != generation)
+            return;
+        }
+        fileSystem.Write(
+            MATCHER_INDEX_FILE, matcher->Serialize(Checksum(patterns)), [](const std::string&) {});
+      },
+      [](const std::string&) {});
+}
+
+void DefaultFilterEngine::OnFileWrite(JsValueList&& params)
+{
+  if (params.empty() || params[0].AsString() != PATTERNS_FILE)
+    return;
+  std::lock_guard<std::mutex> lock(matcherIndex_->mutex);
+  matcherIndex_->serializedGeneration = matcherIndex_->generation;
+}
+
+std::string DefaultFilterEngine::GetElementHidingStyleSheet(const std::string& domain,
+                                                            bool specificOnly) const
+{
+  return *GetElementHidingStyleSheetShared(domain, specificOnly);
+}
+
+std::shared_ptr<const std::string>
+DefaultFilterEngine::GetElementHidingStyleSheetShared(const std::string& domain,
+                                                      bool specificOnly) const
+{
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::GET_ELEMENT_HIDING_STYLE_SHEET));
+  if (auto recorder = std::atomic_load(&traceRecorder_))
+    recorder->RecordElementHiding(domain, ToDocumentUrls(domain), "");
+  return GetCachedStyleSheet("getElementHidingStyleSheet", domain, specificOnly, false);
+}
+
+std::string DefaultFilterEngine::GetElementHidingGenericStyleSheet(uint64_t* version) const
+{
+  return *GetElementHidingGenericStyleSheetShared(version);
+}
+
+uint64_t DefaultFilterEngine::GetElementHidingGenericStyleSheetVersion() const
+{
+  uint64_t version = 0;
+  GetElementHidingGenericStyleSheetShared(&version);
+  return version;
+}
+
+std::string DefaultFilterEngine::GetElementHidingDomainStyleSheet(const std::string& domain,
+                                                                  bool specificOnly) const
+{
+  return *GetElementHidingDomainStyleSheetShared(domain, specificOnly);
+}
+
+std::shared_ptr<const std::string>
+DefaultFilterEngine::GetElementHidingDomainStyleSheetShared(const std::string& domain,
+                                                            bool specificOnly) const
+{
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::GET_ELEMENT_HIDING_DOMAIN_STYLE_SHEET));
+  if (auto recorder = std::atomic_load(&traceRecorder_))
+    recorder->RecordElementHiding(domain, ToDocumentUrls(domain), "");
+  // Nothing generic applies then, so the complete style sheet is the delta.
+  if (specificOnly)
+    return GetCachedStyleSheet("getElementHidingStyleSheet", domain, true, false);
+  return GetCachedStyleSheet("getElementHidingDomainStyleSheet", domain, false, true);
+}
+
+std::shared_ptr<const std::string>
+DefaultFilterEngine::GetCachedStyleSheet(const std::string& apiFunction,
+                                         const std::string& domain,
+                                         bool specificOnly,
+                                         bool domainOnly) const
+{
+  StyleSheetCacheKey key;
+  uint64_t generation = 0;
+  if (styleSheetCache_.Capacity() != 0)
+  {
+    key = {GetElementHidingHost(domain), specificOnly, domainOnly};
+    std::shared_ptr<const std::string> styleSheet;
+    {
+      std::lock_guard<std::mutex> lock(styleSheetCacheMutex_);
+      if (const auto* cached = styleSheetCache_.Get(key))
+        styleSheet = *cached;
+      ++(styleSheet ? styleSheetCacheHits_ : styleSheetCacheMisses_);
+      generation = styleSheetCacheGeneration_;
+    }
+    if (styleSheet)
+      return styleSheet;
+  }
+
+  if (specificOnly && !domainOnly &&
+      !MayHaveContentFilters(ContentFilterDomains::Type::ELEMHIDE, GetElementHidingHost(domain)))
+    return std::make_shared<const std::string>();
+
+  auto compute = [&]() {
+    JsValueList params;
+    params.push_back(jsEngine.NewValue(domain));
+    params.push_back(jsEngine.NewValue(specificOnly));
+    JsValue func = jsEngine.GetApiFunction(apiFunction);
+    auto styleSheet = std::make_shared<const std::string>(func.Call(params).AsString());
+    if (styleSheetCache_.Capacity() != 0)
+    {
+      StyleSheetCache::Entries evicted;
+      std::lock_guard<std::mutex> lock(styleSheetCacheMutex_);
+      if (generation == styleSheetCacheGeneration_)
+        styleSheetCache_.Put(key, styleSheet, &evicted);
+    }
+    return styleSheet;
+  };
+  if (styleSheetCache_.Capacity() == 0)
+    return compute();
+  const std::string flightKey = apiFunction + '\0' + key.domain + '\0' +
+                                (specificOnly ? '1' : '0') + (domainOnly ? '1' : '0') + '\0' +
+                                std::to_string(generation);
+  return ComputeOnce(styleSheetsInFlight_, flightKey, compute);
+}
+
+std::shared_ptr<const std::string>
+DefaultFilterEngine::GetElementHidingGenericStyleSheetShared(uint64_t* version) const
+{
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::GET_ELEMENT_HIDING_GENERIC_STYLE_SHEET));
+  uint64_t generation = 0;
+  {
+    std::lock_guard<std::mutex> lock(styleSheetCacheMutex_);
+    if (!genericStyleSheetStale_)
+    {
+      if (version)
+        *version = genericStyleSheetVersion_;
+      return genericStyleSheet_;
+    }
+    generation = styleSheetCacheGeneration_;
+  }
+
+  JsValue func = jsEngine.GetApiFunction("getElementHidingGenericStyleSheet");
+  auto styleSheet = std::make_shared<const std::string>(func.Call().AsString());
+
+  std::shared_ptr<const std::string> previous;
+  std::lock_guard<std::mutex> lock(styleSheetCacheMutex_);
+  if (genericStyleSheet_ ? *genericStyleSheet_ != *styleSheet : !styleSheet->empty())
+    ++genericStyleSheetVersion_;
+  previous = std::move(genericStyleSheet_);
+  genericStyleSheet_ = styleSheet;
+  // A change during the call will be picked up by the next one.
+  genericStyleSheetStale_ = generation != styleSheetCacheGeneration_;
+  if (version)
+    *version = genericStyleSheetVersion_;
+  return styleSheet;
+}
+
+void DefaultFilterEngine::FlushStyleSheetCache() const
+{
+  StyleSheetCache::Entries removed;
+  EmulationSelectorsCache::Entries removedSelectors;
+  std::lock_guard<std::mutex> lock(styleSheetCacheMutex_);
+  styleSheetCache_.Clear(&removed);
+  emulationSelectorsCache_.Clear(&removedSelectors);
+  ++styleSheetCacheGeneration_;
+  genericStyleSheetStale_ = true;
+  contentFilterDomains_.reset();
+}
+
+bool DefaultFilterEngine::MayHaveContentFilters(ContentFilterDomains::Type type,
+                                                const std::string& host) const
+{
+  std::shared_ptr<const ContentFilterDomains> domains;
+  uint64_t generation = 0;
+  {
+    std::lock_guard<std::mutex> lock(styleSheetCacheMutex_);
+    domains = contentFilterDomains_;
+    generation = styleSheetCacheGeneration_;
+  }
+
+  if (!domains)
+  {
+    JsValue func = jsEngine.GetApiFunction("getContentFilterDomains");
+    const JsValueList lists = func.Call().AsList();
+    const size_t typeCount = static_cast<size_t>(ContentFilterDomains::Type::COUNT);
+    auto newDomains = std::make_shared<ContentFilterDomains>();
+    for (size_t i = 0; i < lists.size() && i < typeCount; ++i)
+    {
+      newDomains->SetDomains(static_cast<ContentFilterDomains::Type>(i),
+                             Utils::SplitString(lists[i].AsString(), '\n'));
+    }
+    domains = newDomains;
+    std::lock_guard<std::mutex> lock(styleSheetCacheMutex_);
+    if (generation == styleSheetCacheGeneration_)
+      contentFilterDomains_ = domains;
+  }
+  return domains->MayApply(type, host);
+}
+
+bool DefaultFilterEngine::StyleSheetCacheKey::operator==(const StyleSheetCacheKey& other) const
+{
+  return specificOnly == other.specificOnly && domainOnly == other.domainOnly &&
+         domain == other.domain;
+}
+
+size_t DefaultFilterEngine::StyleSheetCacheKeyHash::operator()(const StyleSheetCacheKey& key) const
+{
+  return std::hash<std::string>()(key.domain) ^ static_cast<size_t>(key.specificOnly) ^
+         (static_cast<size_t>(key.domainOnly) << 1);
+}
+
+std::vector<IFilterEngine::EmulationSelector>
+DefaultFilterEngine::GetElementHidingEmulationSelectors(const std::string& domain) const
+{
+  return *GetElementHidingEmulationSelectorsShared(domain);
+}
+
+std::shared_ptr<const std::vector<IFilterEngine::EmulationSelector>>
+DefaultFilterEngine::GetElementHidingEmulationSelectorsShared(const std::string& domain) const
+{
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::GET_ELEMENT_HIDING_EMULATION_SELECTORS));
+  std::string host;
+  uint64_t generation = 0;
+  if (emulationSelectorsCache_.Capacity() != 0)
+  {
+    host = GetElementHidingHost(domain);
+    std::lock_guard<std::mutex> lock(styleSheetCacheMutex_);
+    if (const auto* cached = emulationSelectorsCache_.Get(host))
+      return *cached;
+    generation = styleSheetCacheGeneration_;
+  }
+
+  if (!MayHaveContentFilters(ContentFilterDomains::Type::EMULATION, GetElementHidingHost(domain)))
+    return std::make_shared<const std::vector<IFilterEngine::EmulationSelector>>();
+
+  auto compute = [&]() -> std::shared_ptr<const std::vector<IFilterEngine::EmulationSelector>> {
+    // Selectors and filter texts come in a single string, alternating and
+    // separated by line breaks, which filters cannot contain.
+    JsValue func = jsEngine.GetApiFunction("getPackedElementHidingEmulationSelectors");
+    const std::string packed = func.Call(jsEngine.NewValue(domain)).AsString();
+    auto selectors = std::make_shared<std::vector<IFilterEngine::EmulationSelector>>();
+    for (size_t start = 0; start < packed.size();)
+    {
+      size_t selectorEnd = packed.find('\n', start);
+      if (selectorEnd == std::string::npos)
+        break;
+      size_t textEnd = packed.find('\n', selectorEnd + 1);
+      if (textEnd == std::string::npos)
+        textEnd = packed.size();
+      selectors->push_back({packed.substr(start, selectorEnd - start),
+                            packed.substr(selectorEnd + 1, textEnd - selectorEnd - 1)});
+      start = textEnd + 1;
+    }
+
+    if (emulationSelectorsCache_.Capacity() != 0)
+    {
+      EmulationSelectorsCache::Entries evicted;
+      std::lock_guard<std::mutex> lock(styleSheetCacheMutex_);
+      if (generation == styleSheetCacheGeneration_)
+        emulationSelectorsCache_.Put(host, selectors, &evicted);
+    }
+    return selectors;
+  };
+  if (emulationSelectorsCache_.Capacity() == 0)
+    return compute();
+  return ComputeOnce(
+      emulationSelectorsInFlight_, host + '\0' + std::to_string(generation), compute);
+}
+
+ActiveObject& DefaultFilterEngine::GetAsyncCalls() const
+{
+  std::call_once(asyncCallsStarted_,
+                 [this]() { asyncCalls_.reset(new ActiveObject(asyncCallThread_)); });
+  return *asyncCalls_;
+}
+
+template<class Result>
+void DefaultFilterEngine::PostAsync(CoalescedCalls<Result>& calls,
+                                    const std::string& key,
+                                    const std::function<Result()>& call,
+                                    const typename CoalescedCalls<Result>::Callback& callback) const
+{
+  if (!calls.Add(key, callback))
+    return;
+  GetAsyncCalls().Post([&calls, key, call]() {
+    const auto callbacks = calls.Take(key);
+    CoalescedCalls<Result>::Complete(callbacks, call());
+  });
+}
+
+void DefaultFilterEngine::MatchesAsync(const MatchRequest& request,
+                                       const MatchResultCallback& callback) const
+{
+  const std::string key = request.url + '\0' + std::to_string(request.contentTypeMask) + '\0' +
+                          URLInfo::ExtractHost(request.documentUrl) + '\0' + request.siteKey +
+                          '\0' + (request.specificOnly ? '1' : '0');
+  PostAsync<MatchResult>(
+      pendingMatches_,
+      key,
+      [this, request]() {
+        return GetMatchResult(request.url,
+                              request.contentTypeMask,
+                              request.documentUrl,
+                              request.siteKey,
+                              request.specificOnly);
+      },
+      callback);
+}
+
+void DefaultFilterEngine::IsContentAllowlistedAsync(const std::string& url,
+                                                    ContentTypeMask contentTypeMask,
+                                                    const std::vector<std::string>& documentUrls,
+                                                    const std::string& sitekey,
+                                                    const AllowlistedCallback& callback) const
+{
+  std::string key = url + '\0' + std::to_string(contentTypeMask) + '\0' + sitekey;
+  for (const auto& documentUrl : documentUrls)
+    key += '\0' + documentUrl;
+  PostAsync<bool>(
+      pendingAllowlisting_,
+      key,
+      [this, url, contentTypeMask, documentUrls, sitekey]() {
+        return IsContentAllowlisted(url, contentTypeMask, documentUrls, sitekey);
+      },
+      callback);
+}
+
+void DefaultFilterEngine::GetElementHidingStyleSheetAsync(const std::string& url,
+                                                          bool specificOnly,
+                                                          const StyleSheetCallback& callback) const
+{
+  // Only the host matters, so pages of a site share a call.
+  PostAsync<std::shared_ptr<const std::string>>(
+      pendingStyleSheets_,
+      GetElementHidingHost(url) + '\0' + (specificOnly ? '1' : '0'),
+      [this, url, specificOnly]() { return GetElementHidingStyleSheetShared(url, specificOnly); },
+      callback);
+}
+
+void DefaultFilterEngine::GetElementHidingEmulationSelectorsAsync(
+    const std::string& url, const EmulationSelectorsCallback& callback) const
+{
+  PostAsync<std::shared_ptr<const std::vector<EmulationSelector>>>(
+      pendingEmulationSelectors_,
+      GetElementHidingHost(url),
+      [this, url]() { return GetElementHidingEmulationSelectorsShared(url); },
+      callback);
+}
+
+std::shared_ptr<const IFilterEngine::FrameContext>
+DefaultFilterEngine::PrepareForDocument(const std::string& url, const std::string& siteKey)
 {
-  JsValueList params;
-  params.push_back(jsEngine.NewValue(domain));
-  params.push_back(jsEngine.NewValue(specificOnly));
-  JsValue func = jsEngine.Evaluate("API.getElementHidingStyleSheet");
-  return func.Call(params).AsString();
+  if (cacheWarmer_)
+    cacheWarmer_->RecordVisit(URLInfo::ExtractHost(url));
+  auto frame = std::make_shared<const DefaultFrameContext>(std::vector<std::string>{url}, siteKey);
+  GetAsyncCalls().Post([this, frame]() { PrepareDocument(*frame); });
+  return frame;
 }
 
-std::vector<IFilterEngine::EmulationSelector>
-DefaultFilterEngine::GetElementHidingEmulationSelectors(const std::string& domain) const
+void DefaultFilterEngine::WarmUpCaches(const std::vector<std::string>& hosts)
 {
-  JsValue func = jsEngine.Evaluate("API.getElementHidingEmulationSelectors");
-  JsValueList result = func.Call(jsEngine.NewValue(domain)).AsList();
-  std::vector<IFilterEngine::EmulationSelector> selectors;
-  selectors.reserve(result.size());
-  for (const auto& r : result)
-    selectors.push_back({r.GetProperty("selector").AsString(), r.GetProperty("text").AsString()});
-  return selectors;
+  // One call per host, so that the calls of the host aren't held up by all
+  // of them.
+  for (const auto& host : hosts)
+  {
+    auto frame = std::make_shared<const DefaultFrameContext>(
+        std::vector<std::string>{"https://" + host + "/"}, "");
+    GetAsyncCalls().Post([this, frame]() { PrepareDocument(*frame); });
+  }
+}
+
+void DefaultFilterEngine::PrepareDocument(const DefaultFrameContext& frame)
+{
+  // Same order as a navigation asks for it, so that the host can already
+  // use the first results while the rest is still being prepared.
+  if (GetFrameAllowlisting(frame).document.IsMatched())
+    return;
+  const auto& url = frame.GetDocumentUrl();
+  const auto& siteKey = frame.GetSiteKey();
+  const auto& documentUrls = frame.GetDocumentUrls();
+  if (!IsContentAllowlisted(url, CONTENT_TYPE_ELEMHIDE, documentUrls, siteKey))
+  {
+    const bool specificOnly =
+        IsContentAllowlisted(url, CONTENT_TYPE_GENERICHIDE, documentUrls, siteKey);
+    GetElementHidingStyleSheetShared(url, specificOnly);
+    GetElementHidingEmulationSelectorsShared(url);
+  }
+
+  std::vector<SnippetLibrary> libraries;
+  {
+    std::lock_guard<std::mutex> lock(snippetMutex_);
+    libraries.assign(snippetLibraries_.begin(), snippetLibraries_.end());
+  }
+  for (const auto library : libraries)
+  {
+    try
+    {
+      GetSnippetScriptShared(url, library);
+    }
+    catch (const std::invalid_argument&)
+    {
+      // Unregistered meanwhile.
+    }
+  }
 }
 
 JsValue DefaultFilterEngine::GetPref(const std::string& pref) const
 {
-  JsValue func = jsEngine.Evaluate("API.getPref");
+  JsValue func = jsEngine.GetApiFunction("getPref");
   return func.Call(jsEngine.NewValue(pref));
 }
 
 void DefaultFilterEngine::SetPref(const std::string& pref, const JsValue& value)
 {
-  JsValue func = jsEngine.Evaluate("API.setPref");
+  JsValue func = jsEngine.GetApiFunction("setPref");
   JsValueList params;
   params.push_back(jsEngine.NewValue(pref));
   params.push_back(value);
@@ -210,17 +2047,103 @@ void DefaultFilterEngine::SetPref(const std::string& pref, const JsValue& value)
 
 void DefaultFilterEngine::AddEventObserver(EventObserver* observer)
 {
-  std::unique_lock<std::mutex> lock(callbacksMutex_);
-  assert(std::find(observers_.begin(), observers_.end(), observer) == observers_.end());
-  observers_.push_back(observer);
+  const RegisteredObserver registered{
+      observer,
+      observer->GetFilterEventMask(),
+      observer->GetSubscriptionEventMask(),
+      observer->IsBatching()
+          ? std::make_shared<FilterEventBatch>(jsEngine, observer, observer->GetBatchWindow())
+          : nullptr};
+  UpdateObservers([&registered](ObserverList& list) {
+    assert(std::none_of(
+        list.observers.begin(), list.observers.end(), [&registered](const RegisteredObserver& r) {
+          return r.observer == registered.observer;
+        }));
+    list.observers.push_back(registered);
+  });
 }
 
 void DefaultFilterEngine::RemoveEventObserver(EventObserver* observer)
 {
-  std::unique_lock<std::mutex> lock(callbacksMutex_);
-  auto registered = std::find(observers_.begin(), observers_.end(), observer);
-  assert(registered != observers_.end());
-  observers_.erase(registered);
+  // Events are dispatched with the engine locked, so holding the lock makes
+  // sure that no other thread is still calling the observer.
+  const JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+  UpdateObservers([observer](ObserverList& list) {
+    auto registered = std::find_if(
+        list.observers.begin(), list.observers.end(), [observer](const RegisteredObserver& r) {
+          return r.observer == observer;
+        });
+    assert(registered != list.observers.end());
+    if (registered->batch)
+      registered->batch->Discard();
+    list.observers.erase(registered);
+  });
+}
+
+void DefaultFilterEngine::AddAsyncEventObserver(AsyncEventObserver* observer,
+                                                const AsyncObserverOptions& options)
+{
+  const RegisteredAsyncObserver registered{
+      observer,
+      observer->GetFilterEventMask(),
+      observer->GetSubscriptionEventMask(),
+      std::make_shared<AsyncEventDispatcher>(observer, options)};
+  UpdateObservers([&registered](ObserverList& list) {
+    assert(std::none_of(list.asyncObservers.begin(),
+                        list.asyncObservers.end(),
+                        [&registered](const RegisteredAsyncObserver& r) {
+                          return r.observer == registered.observer;
+                        }));
+    list.asyncObservers.push_back(registered);
+  });
+}
+
+void DefaultFilterEngine::RemoveAsyncEventObserver(AsyncEventObserver* observer)
+{
+  std::shared_ptr<AsyncEventDispatcher> dispatcher;
+  {
+    // No dispatch can still be posting to it once the engine is locked.
+    const JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+    UpdateObservers([observer, &dispatcher](ObserverList& list) {
+      auto registered = std::find_if(list.asyncObservers.begin(),
+                                     list.asyncObservers.end(),
+                                     [observer](const RegisteredAsyncObserver& r) {
+                                       return r.observer == observer;
+                                     });
+      assert(registered != list.asyncObservers.end());
+      dispatcher = registered->dispatcher;
+      list.asyncObservers.erase(registered);
+    });
+  }
+  // Outside of the engine lock, the observer may be waiting for it.
+  if (dispatcher)
+    dispatcher->Stop();
+}
+
+void DefaultFilterEngine::UpdateObservers(const std::function<void(ObserverList&)>& update)
+{
+  std::lock_guard<std::mutex> lock(callbacksMutex_);
+  auto list = std::make_shared<ObserverList>(*std::atomic_load(&observers_));
+  update(*list);
+  UpdateEventMasks(*list);
+  std::atomic_store(&observers_, std::shared_ptr<const ObserverList>(std::move(list)));
+}
+
+// static
+void DefaultFilterEngine::UpdateEventMasks(ObserverList& list)
+{
+  list.filterEventMask = 0;
+  list.subscriptionEventMask = 0;
+  for (const auto& registered : list.observers)
+  {
+    list.filterEventMask |= registered.filterEventMask;
+    list.subscriptionEventMask |= registered.subscriptionEventMask;
+  }
+  for (const auto& registered : list.asyncObservers)
+  {
+    list.filterEventMask |= registered.filterEventMask;
+    list.subscriptionEventMask |= registered.subscriptionEventMask;
+  }
 }
 
 void DefaultFilterEngine::SetAllowedConnectionType(const std::string* value)
@@ -229,135 +2152,83 @@ void DefaultFilterEngine::SetAllowedConnectionType(const std::string* value)
 }
 
 // static
-bool DefaultFilterEngine::Transform(const std::string& eventStr, FilterEvent* event)
+bool DefaultFilterEngine::Transform(ChangeEvent changeEvent, FilterEvent* event)
 {
-  if (eventStr == "load")
+  switch (changeEvent)
   {
+  case ChangeEvent::LOAD:
     *event = FilterEvent::FILTERS_LOAD;
     return true;
-  }
-
-  if (eventStr == "save")
-  {
+  case ChangeEvent::SAVE:
     *event = FilterEvent::FILTERS_SAVE;
     return true;
-  }
-
-  if (eventStr == "filter.added")
-  {
+  case ChangeEvent::FILTER_ADDED:
     *event = FilterEvent::FILTER_ADDED;
     return true;
-  }
-
-  if (eventStr == "filter.removed")
-  {
+  case ChangeEvent::FILTER_REMOVED:
     *event = FilterEvent::FILTER_REMOVED;
     return true;
-  }
-
-  if (eventStr == "filter.moved")
-  {
+  case ChangeEvent::FILTER_MOVED:
     *event = FilterEvent::FILTER_MOVED;
     return true;
-  }
-
-  if (eventStr == "filter.disabled")
-  {
+  case ChangeEvent::FILTER_DISABLED:
     *event = FilterEvent::FILTER_DISABLED;
     return true;
-  }
-
-  if (eventStr == "filter.hitCount")
-  {
+  case ChangeEvent::FILTER_HITCOUNT:
     *event = FilterEvent::FILTER_HITCOUNT;
     return true;
-  }
-
-  if (eventStr == "filter.lastHit")
-  {
+  case ChangeEvent::FILTER_LASTHIT:
     *event = FilterEvent::FILTER_LASTHIT;
     return true;
+  default:
+    return false;
   }
-
-  return false;
 }
 
 // static
-bool DefaultFilterEngine::Transform(const std::string& eventStr, SubscriptionEvent* event)
+bool DefaultFilterEngine::Transform(ChangeEvent changeEvent, SubscriptionEvent* event)
 {
-  if (eventStr == "subscription.added")
+  switch (changeEvent)
   {
+  case ChangeEvent::SUBSCRIPTION_ADDED:
     *event = SubscriptionEvent::SUBSCRIPTION_ADDED;
     return true;
-  }
-
-  if (eventStr == "subscription.removed")
-  {
+  case ChangeEvent::SUBSCRIPTION_REMOVED:
     *event = SubscriptionEvent::SUBSCRIPTION_REMOVED;
     return true;
-  }
-
-  if (eventStr == "subscription.disabled")
-  {
+  case ChangeEvent::SUBSCRIPTION_DISABLED:
     *event = SubscriptionEvent::SUBSCRIPTION_DISABLED;
     return true;
-  }
-
-  if (eventStr == "subscription.downloading")
-  {
+  case ChangeEvent::SUBSCRIPTION_DOWNLOADING:
     *event = SubscriptionEvent::SUBSCRIPTION_DOWNLOADING;
     return true;
-  }
-
-  if (eventStr == "subscription.downloadStatus")
-  {
+  case ChangeEvent::SUBSCRIPTION_DOWNLOADSTATUS:
     *event = SubscriptionEvent::SUBSCRIPTION_DOWNLOADSTATUS;
     return true;
-  }
-
-  if (eventStr == "subscription.errors")
-  {
+  case ChangeEvent::SUBSCRIPTION_ERRORS:
     *event = SubscriptionEvent::SUBSCRIPTION_ERRORS;
     return true;
-  }
-
-  if (eventStr == "subscription.fixedTitle")
-  {
+  case ChangeEvent::SUBSCRIPTION_FIXEDTITLE:
     *event = SubscriptionEvent::SUBSCRIPTION_FIXEDTITLE;
     return true;
-  }
-
-  if (eventStr == "subscription.title")
-  {
+  case ChangeEvent::SUBSCRIPTION_TITLE:
     *event = SubscriptionEvent::SUBSCRIPTION_TITLE;
     return true;
-  }
-
-  if (eventStr == "subscription.homepage")
-  {
+  case ChangeEvent::SUBSCRIPTION_HOMEPAGE:
     *event = SubscriptionEvent::SUBSCRIPTION_HOMEPAGE;
     return true;
-  }
-
-  if (eventStr == "subscription.lastCheck")
-  {
+  case ChangeEvent::SUBSCRIPTION_LASTCHECK:
     *event = SubscriptionEvent::SUBSCRIPTION_LASTCHECK;
     return true;
-  }
-
-  if (eventStr == "subscription.lastDownload")
-  {
+  case ChangeEvent::SUBSCRIPTION_LASTDOWNLOAD:
     *event = SubscriptionEvent::SUBSCRIPTION_LASTDOWNLOAD;
     return true;
-  }
-
-  if (eventStr == "subscription.updated")
-  {
+  case ChangeEvent::SUBSCRIPTION_UPDATED:
     *event = SubscriptionEvent::SUBSCRIPTION_UPDATED;
     return true;
+  default:
+    return false;
   }
-
-  return false;
 }
 
 std::unique_ptr<std::string> DefaultFilterEngine::GetAllowedConnectionType() const
@@ -370,32 +2241,221 @@ std::unique_ptr<std::string> DefaultFilterEngine::GetAllowedConnectionType() con
 
 void DefaultFilterEngine::OnSubscriptionOrFilterChanged(JsValueList&& params) const
 {
-  std::string action(params.size() >= 1 && !params[0].IsNull() ? params[0].AsString() : "");
+  if (params.empty() || !params[0].IsNumber())
+    return;
+  const int64_t id = params[0].AsInt();
+  if (id < 0 || id >= static_cast<int64_t>(ChangeEvent::COUNT))
+    return;
+  const auto event = static_cast<ChangeEvent>(id);
   JsValue item(params.size() >= 2 ? params[1] : jsEngine.NewValue(false));
+  const std::string subscriptionUrl =
+      params.size() >= 3 && params[2].IsString() ? params[2].AsString() : "";
+
+  UpdateNativeMatcher(event, item);
+  UpdateSubscriptionIndex(event, item, subscriptionUrl);
+  if (AffectsMatching(event))
+    FlushMatchCache();
+  if (AffectsMatching(event) || event == ChangeEvent::ELEMHIDEUPDATE)
+  {
+    FlushStyleSheetCache();
+    if (cacheWarmer_)
+      cacheWarmer_->RequestWarmUp();
+  }
+  if (AffectsSnippets(event, item))
+    FlushSnippetScriptCache();
+  if (event == ChangeEvent::SAVE)
+    SaveNativeMatcher();
+
+  NotifyObservers(event, std::move(item));
+}
+
+void DefaultFilterEngine::OnSubscriptionOrFilterChanges(JsValueList&& params) const
+{
+  if (params.size() < 2 || !params[0].IsArray() || !params[1].IsArray())
+    return;
+  const JsValueList ids = params[0].AsList();
+  JsValueList items = params[1].AsList();
+  if (ids.size() != items.size())
+    return;
+  const JsValueList urls =
+      params.size() >= 3 && params[2].IsArray() ? params[2].AsList() : JsValueList();
+
+  std::vector<ChangeEvent> events;
+  events.reserve(ids.size());
+  bool affectsMatching = false;
+  bool affectsElemHide = false;
+  bool filtersChanged = false;
+  bool save = false;
+  for (const auto& jsId : ids)
+  {
+    const int64_t id = jsId.IsNumber() ? jsId.AsInt() : -1;
+    const auto event = id >= 0 && id < static_cast<int64_t>(ChangeEvent::COUNT)
+                           ? static_cast<ChangeEvent>(id)
+                           : ChangeEvent::COUNT;
+    events.push_back(event);
+    if (event == ChangeEvent::COUNT || !AffectsMatching(event))
+    {
+      affectsElemHide |= event == ChangeEvent::ELEMHIDEUPDATE;
+      save |= event == ChangeEvent::SAVE;
+      continue;
+    }
+    affectsMatching = true;
+    if (IsFilterChange(event))
+      filtersChanged = true;
+    else
+      UpdateNativeMatcher(event, items[events.size() - 1]);
+  }
+
+  // One rebuild instead of updating the native matcher filter by filter.
+  if (filtersChanged)
+    UpdateNativeMatcher(ChangeEvent::FILTER_ADDED, jsEngine.NewValue(false));
+  if (affectsMatching)
+  {
+    FlushMatchCache();
+    FlushSnippetScriptCache();
+  }
+  if (affectsMatching || affectsElemHide)
+  {
+    FlushStyleSheetCache();
+    if (cacheWarmer_)
+      cacheWarmer_->RequestWarmUp();
+  }
+  if (save)
+    SaveNativeMatcher();
+
+  for (size_t i = 0; i < events.size(); ++i)
+  {
+    if (events[i] == ChangeEvent::COUNT)
+      continue;
+    UpdateSubscriptionIndex(
+        events[i], items[i], i < urls.size() && urls[i].IsString() ? urls[i].AsString() : "");
+    NotifyObservers(events[i], std::move(items[i]));
+  }
+}
 
-  std::unique_lock<std::mutex> lock(callbacksMutex_);
+void DefaultFilterEngine::UpdateSubscriptionIndex(ChangeEvent event,
+                                                  const JsValue& item,
+                                                  const std::string& subscriptionUrl) const
+{
+  if (!subscriptionIndexBuilt_)
+    return;
+
+  switch (event)
+  {
+  case ChangeEvent::LOAD:
+  {
+    // Built again from the loaded filter storage on the next lookup.
+    std::lock_guard<std::mutex> lock(subscriptionIndexMutex_);
+    subscriptionIndex_.Clear();
+    subscriptionIndexBuilt_ = false;
+    break;
+  }
+  case ChangeEvent::FILTER_ADDED:
+  case ChangeEvent::FILTER_REMOVED:
+  {
+    if (subscriptionUrl.empty() || !item.IsObject())
+      break;
+    const std::string text = item.GetProperty("text").AsString();
+    std::lock_guard<std::mutex> lock(subscriptionIndexMutex_);
+    if (event == ChangeEvent::FILTER_ADDED)
+      subscriptionIndex_.AddFilter(subscriptionUrl, text);
+    else
+      subscriptionIndex_.RemoveFilter(subscriptionUrl, text);
+    break;
+  }
+  case ChangeEvent::SUBSCRIPTION_ADDED:
+  case ChangeEvent::SUBSCRIPTION_UPDATED:
+  {
+    if (!item.IsObject())
+      break;
+    const std::string url = item.GetProperty("url").AsString();
+    JsValue func = jsEngine.GetApiFunction("getSubscriptionFilterText");
+    const auto filters = Utils::SplitString(func.Call(item).AsString(), '\n');
+    std::lock_guard<std::mutex> lock(subscriptionIndexMutex_);
+    subscriptionIndex_.SetFilters(url, filters);
+    break;
+  }
+  case ChangeEvent::SUBSCRIPTION_REMOVED:
+  {
+    if (!item.IsObject())
+      break;
+    const std::string url = item.GetProperty("url").AsString();
+    std::lock_guard<std::mutex> lock(subscriptionIndexMutex_);
+    subscriptionIndex_.RemoveSubscription(url);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void DefaultFilterEngine::NotifyObservers(ChangeEvent event, JsValue&& item) const
+{
+  // Observers may add or remove observers, they are called with a snapshot.
+  const auto observers = std::atomic_load(&observers_);
 
   FilterEvent filterEvent;
   SubscriptionEvent subscriptionEvent;
-  if (Transform(action, &filterEvent))
+  if (Transform(event, &filterEvent))
   {
+    const uint32_t mask = EventObserver::EventMask(filterEvent);
+    if (!(observers->filterEventMask & mask))
+      return;
     Filter filter(item.IsObject()
                       ? std::make_unique<DefaultFilterImplementation>(std::move(item), &jsEngine)
                       : nullptr);
-    for (auto* observer : observers_)
+    if (!observers->asyncObservers.empty())
     {
-      observer->OnFilterEvent(filterEvent, filter);
+      FilterInfo info;
+      info.type = Filter::Type::TYPE_INVALID;
+      if (filter.IsValid())
+      {
+        info.text = filter.GetRaw();
+        info.type = filter.GetType();
+      }
+      for (const auto& registered : observers->asyncObservers)
+      {
+        if (registered.filterEventMask & mask)
+          registered.dispatcher->Post(filterEvent, FilterInfo(info));
+      }
+    }
+    for (const auto& registered : observers->observers)
+    {
+      if (!(registered.filterEventMask & mask))
+        continue;
+      if (registered.batch)
+        registered.batch->Add(filterEvent, filter);
+      else
+        registered.observer->OnFilterEvent(filterEvent, filter);
     }
   }
-  else if (Transform(action, &subscriptionEvent))
+  else if (Transform(event, &subscriptionEvent))
   {
+    const uint32_t mask = EventObserver::EventMask(subscriptionEvent);
+    if (!(observers->subscriptionEventMask & mask))
+      return;
     Subscription subscription(item.IsObject() ? std::make_unique<DefaultSubscriptionImplementation>(
                                                     std::move(item), &jsEngine)
                                               : nullptr);
+    if (!observers->asyncObservers.empty())
+    {
+      const SubscriptionInfo info =
+          subscription.Implementation() ? GetSubscriptionInfo(subscription) : SubscriptionInfo();
+      for (const auto& registered : observers->asyncObservers)
+      {
+        if (registered.subscriptionEventMask & mask)
+          registered.dispatcher->Post(subscriptionEvent, SubscriptionInfo(info));
+      }
+    }
 
-    for (auto* observer : observers_)
+    for (const auto& registered : observers->observers)
     {
-      observer->OnSubscriptionEvent(subscriptionEvent, subscription);
+      if (!(registered.subscriptionEventMask & mask))
+        continue;
+      if (registered.batch)
+        registered.batch->Add(subscriptionEvent, subscription);
+      else
+        registered.observer->OnSubscriptionEvent(subscriptionEvent, subscription);
     }
   }
 }
@@ -406,19 +2466,26 @@ bool DefaultFilterEngine::VerifySignature(const std::string& key,
                                           const std::string& host,
                                           const std::string& userAgent) const
 {
-  JsValueList params;
-  params.push_back(jsEngine.NewValue(key));
-  params.push_back(jsEngine.NewValue(signature));
-  params.push_back(jsEngine.NewValue(uri));
-  params.push_back(jsEngine.NewValue(host));
-  params.push_back(jsEngine.NewValue(userAgent));
-  JsValue func = jsEngine.Evaluate("API.verifySignature");
-  return func.Call(params).AsBool();
+  // Neither can contain a null character, which keeps the cache keys apart.
+  if (key.find('\0') != std::string::npos || signature.find('\0') != std::string::npos)
+    return false;
+  const std::string data = uri + '\0' + host + '\0' + userAgent;
+  const std::string cacheKey = key + '\0' + signature + '\0' + data;
+  {
+    std::lock_guard<std::mutex> lock(signatureCacheMutex_);
+    if (const bool* valid = signatureCache_.Get(cacheKey))
+      return *valid;
+  }
+  const bool valid = SignatureVerifier::Verify(key, signature, data);
+  std::lock_guard<std::mutex> lock(signatureCacheMutex_);
+  signatureCache_.Put(cacheKey, valid);
+  return valid;
 }
 
 std::vector<std::string>
 DefaultFilterEngine::ComposeFilterSuggestions(const IElement* element) const
 {
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::COMPOSE_FILTER_SUGGESTIONS));
   JsValueList params;
 
   params.push_back(jsEngine.NewValue(element->GetDocumentLocation()));
@@ -429,15 +2496,42 @@ DefaultFilterEngine::ComposeFilterSuggestions(const IElement* element) const
   params.push_back(jsEngine.NewValue(element->GetAttribute("class")));
   params.push_back(jsEngine.NewArray(Utils::GetAssociatedUrls(element)));
 
-  JsValue func = jsEngine.Evaluate("API.composeFilterSuggestions");
-  JsValueList suggestions = func.Call(params).AsList();
-  std::vector<std::string> res;
-  res.reserve(suggestions.size());
+  JsValue func = jsEngine.GetApiFunction("composeFilterSuggestions");
+  return func.Call(params).AsStringVector();
+}
 
-  for (const auto& cur : suggestions)
-    res.push_back(cur.AsString());
+std::vector<std::vector<std::string>> DefaultFilterEngine::ComposeFilterSuggestionsBatch(
+    const std::vector<const IElement*>& elements) const
+{
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::COMPOSE_FILTER_SUGGESTIONS_BATCH));
+  // Fields are separated by NUL characters, which HTML parsers never leave
+  // in attribute values. The associated URLs follow their count.
+  std::string packed;
+  const auto append = [&packed](const std::string& field) {
+    packed += field;
+    packed += '\0';
+  };
+  for (const auto* element : elements)
+  {
+    append(element->GetDocumentLocation());
+    append(element->GetLocalName());
+    append(element->GetAttribute("id"));
+    append(element->GetAttribute("src"));
+    append(element->GetAttribute("style"));
+    append(element->GetAttribute("class"));
+    const auto urls = Utils::GetAssociatedUrls(element);
+    append(std::to_string(urls.size()));
+    for (const auto& url : urls)
+      append(url);
+  }
 
-  return res;
+  JsValue func = jsEngine.GetApiFunction("composeFilterSuggestionsBatch");
+  const JsValueList lists = func.Call(jsEngine.NewValue(packed)).AsList();
+  std::vector<std::vector<std::string>> suggestions;
+  suggestions.reserve(lists.size());
+  for (const auto& list : lists)
+    suggestions.push_back(list.AsStringVector());
+  return suggestions;
 }
 
 Filter DefaultFilterEngine::GetAllowlistingFilter(const std::string& url,
@@ -447,30 +2541,121 @@ Filter DefaultFilterEngine::GetAllowlistingFilter(const std::string& url,
 {
   // WebExt finds allow filters by iterating through parent frames of |url|.
   // https://gitlab.com/eyeo/adblockplus/adblockpluschrome/-/blob/6a345b830841052c09cfce6faf77eb8e682d7b7a/lib/allowlisting.js#L84
-  for (auto it = documentUrls.begin(); it != documentUrls.end(); ++it)
+  // Frames are answered by the match cache and the native matcher as long as
+  // possible, the rest of the chain is passed to JS in a single call.
+  NotifyActivity();
+  auto nativeMatcher = GetNativeMatcherForLookup();
+  const bool useCache = matchCache_.Capacity() != 0;
+  uint64_t generation = 0;
+  bool missed = false;
+  const StringPool::Id sitekeyId = StringPool::Shared().Intern(sitekey);
+  auto getKey = [&](size_t frame) {
+    return MatchCacheKey{
+        documentUrls[frame],
+        contentTypeMask,
+        StringPool::Shared().Intern(URLInfo::ExtractHost(GetParentUrl(documentUrls, frame))),
+        sitekeyId,
+        false};
+  };
+
+  size_t frame = 0;
+  for (; frame < documentUrls.size(); ++frame)
+  {
+    const auto& currentUrl = documentUrls[frame];
+    if (currentUrl.empty())
+      continue;
+    if (useCache)
+    {
+      CachedMatch cached;
+      uint64_t keyGeneration = 0;
+      if (LookUpMatchCache(getKey(frame), &cached, &keyGeneration))
+      {
+        if (cached.filter)
+          return *cached.filter;
+        if (cached.result.IsMatched())
+          return GetFilter(*cached.result.filterText);
+        continue;
+      }
+      if (!missed)
+        generation = keyGeneration;
+      missed = true;
+    }
+
+    std::shared_ptr<const std::string> filterText;
+    auto match = nativeMatcher->Match(
+        currentUrl, contentTypeMask, GetParentUrl(documentUrls, frame), false, &filterText);
+    if (match == NativeMatcher::Result::UNKNOWN)
+      break;
+    if (match == NativeMatcher::Result::NO_MATCH)
+    {
+      if (useCache)
+        StoreInMatchCache(getKey(frame), CachedMatch(), generation);
+      continue;
+    }
+    if (useCache)
+      StoreInMatchCache(
+          getKey(frame), CachedMatch{MakeMatchResult(filterText), nullptr}, generation);
+    return GetFilter(*filterText);
+  }
+  if (frame == documentUrls.size())
+    return Filter();
+
+  const JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+  JsValue func = jsEngine.GetApiFunction("checkAllowlistingMatch");
+  JsValueList frames;
+  for (size_t i = frame; i < documentUrls.size(); ++i)
   {
-    const auto& currentUrl = *it;
-    const auto parentIterator = std::next(it);
-    auto parentUrl = parentIterator != documentUrls.end() ? *parentIterator : "";
-    if (parentUrl.empty())
+    URLInfo urlInfo = URLInfo::Parse(documentUrls[i]);
+    if (!urlInfo.IsValid())
     {
-      // This is the top of the frame hierarchy, pass currentUrl as parent.
-      // This is consistent with WebExt ("|| frame.url.hostname"):
-      // https://gitlab.com/eyeo/adblockplus/adblockpluschrome/-/blob/6a345b830841052c09cfce6faf77eb8e682d7b7a/lib/allowlisting.js#L53
-      parentUrl = currentUrl;
+      frames.push_back(jsEngine.NewValue(false));
+      continue;
     }
-    auto match = CheckFilterMatch(currentUrl, contentTypeMask, parentUrl, sitekey, false);
-    if (match.IsValid())
-      return match;
+    JsValue jsFrame = jsEngine.NewObject();
+    jsFrame.SetProperty("href", urlInfo.GetHref());
+    jsFrame.SetProperty("protocol", urlInfo.GetProtocol());
+    jsFrame.SetProperty("hostname", urlInfo.GetHostname());
+    jsFrame.SetProperty("documentHost",
+                        URLInfo::ExtractHost(GetParentUrl(documentUrls, i)));
+    frames.push_back(std::move(jsFrame));
+  }
+  JsValueList params;
+  params.push_back(jsEngine.NewValueArray(frames));
+  params.push_back(jsEngine.NewValue(contentTypeMask));
+  params.push_back(jsEngine.NewValue(sitekey));
+  JsValue match = func.Call(params);
+
+  size_t matchedFrame = documentUrls.size();
+  Filter filter;
+  if (!match.IsNull())
+  {
+    matchedFrame = frame + static_cast<size_t>(match.GetProperty("index").AsInt());
+    filter = Filter(
+        std::make_unique<DefaultFilterImplementation>(match.GetProperty("filter"), &jsEngine));
+  }
+  if (!useCache)
+    return filter;
+
+  // JS went through the frames up to the matching one, remember all of them.
+  for (; frame < documentUrls.size() && frame < matchedFrame; ++frame)
+  {
+    if (!documentUrls[frame].empty())
+      StoreInMatchCache(getKey(frame), CachedMatch(), generation);
   }
-  return Filter();
+  if (filter.IsValid())
+  {
+    auto shared = std::make_shared<const Filter>(filter);
+    StoreInMatchCache(
+        getKey(matchedFrame), CachedMatch{ToMatchResult(*shared), shared}, generation);
+  }
+  return filter;
 }
 
 void DefaultFilterEngine::AddSubscription(const Subscription& subscription)
 {
   const auto* impl =
       static_cast<const DefaultSubscriptionImplementation*>(subscription.Implementation());
-  JsValue func = jsEngine.Evaluate("API.addSubscriptionToList");
+  JsValue func = jsEngine.GetApiFunction("addSubscriptionToList");
   func.Call(impl->jsObject);
 }
 
@@ -478,7 +2663,7 @@ void DefaultFilterEngine::RemoveSubscription(const Subscription& subscription)
 {
   const auto* impl =
       static_cast<const DefaultSubscriptionImplementation*>(subscription.Implementation());
-  JsValue func = jsEngine.Evaluate("API.removeSubscriptionFromList");
+  JsValue func = jsEngine.GetApiFunction("removeSubscriptionFromList");
   func.Call(impl->jsObject);
 }
 
@@ -487,7 +2672,7 @@ void DefaultFilterEngine::AddFilter(const Filter& filter)
   if (!filter.IsValid())
     return;
   const auto* impl = static_cast<const DefaultFilterImplementation*>(filter.Implementation());
-  JsValue func = jsEngine.Evaluate("API.addFilterToList");
+  JsValue func = jsEngine.GetApiFunction("addFilterToList");
   func.Call(impl->jsObject);
 }
 
@@ -496,31 +2681,109 @@ void DefaultFilterEngine::RemoveFilter(const Filter& filter)
   if (!filter.IsValid())
     return;
   const auto* impl = static_cast<const DefaultFilterImplementation*>(filter.Implementation());
-  JsValue func = jsEngine.Evaluate("API.removeFilterFromList");
+  JsValue func = jsEngine.GetApiFunction("removeFilterFromList");
   func.Call(impl->jsObject);
 }
 
+void DefaultFilterEngine::AddFilters(const std::vector<Filter>& filters)
+{
+  ChangeFilters("addFiltersToList", filters);
+}
+
+void DefaultFilterEngine::RemoveFilters(const std::vector<Filter>& filters)
+{
+  ChangeFilters("removeFiltersFromList", filters);
+}
+
+void DefaultFilterEngine::ChangeFilters(const std::string& apiFunction,
+                                        const std::vector<Filter>& filters)
+{
+  const JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+  JsValueList jsFilters;
+  jsFilters.reserve(filters.size());
+  for (const auto& filter : filters)
+  {
+    if (filter.IsValid())
+      jsFilters.push_back(
+          static_cast<const DefaultFilterImplementation*>(filter.Implementation())->jsObject);
+  }
+  if (jsFilters.empty())
+    return;
+  JsValue func = jsEngine.GetApiFunction(apiFunction);
+  func.Call(jsEngine.NewValueArray(jsFilters));
+}
+
+void DefaultFilterEngine::BeginUpdate()
+{
+  JsValue func = jsEngine.GetApiFunction("beginUpdate");
+  func.Call();
+}
+
+void DefaultFilterEngine::CommitUpdate()
+{
+  JsValue func = jsEngine.GetApiFunction("commitUpdate");
+  func.Call();
+}
+
+std::unique_ptr<IFilterEngine::EngineSession> DefaultFilterEngine::CreateEngineSession() const
+{
+  return std::make_unique<DefaultEngineSession>(jsEngine);
+}
+
 void DefaultFilterEngine::StartSynchronization()
 {
-  JsValue func = jsEngine.Evaluate("API.startSynchronization");
+  JsValue func = jsEngine.GetApiFunction("startSynchronization");
   func.Call();
 }
 
 void DefaultFilterEngine::StopSynchronization()
 {
-  JsValue func = jsEngine.Evaluate("API.stopSynchronization");
+  JsValue func = jsEngine.GetApiFunction("stopSynchronization");
   func.Call();
 }
 
 void DefaultFilterEngine::StartObservingEvents()
 {
   AddEventObserver(&observer_);
+  RestoreNativeMatcher();
 }
 
 void DefaultFilterEngine::Observer::OnFilterEvent(FilterEvent event, const Filter&)
 {
   if (event == IFilterEngine::FilterEvent::FILTERS_SAVE)
-    jsEngine.NotifyLowMemory();
+    gcScheduler.RequestCriticalCollection();
+}
+
+uint32_t DefaultFilterEngine::Observer::GetFilterEventMask() const
+{
+  return EventMask(IFilterEngine::FilterEvent::FILTERS_SAVE);
+}
+
+uint32_t DefaultFilterEngine::Observer::GetSubscriptionEventMask() const
+{
+  return 0;
+}
+
+
+std::shared_ptr<const std::string>
+AdblockPlus::DefaultFilterEngine::GetSnippetScriptShared(const std::string& documentUrl,
+                                                        const std::string& isolatedSource,
+                                                        const std::string& injectedSource,
+                                                        const std::vector<std::string>& injectedList)
+{
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::GET_SNIPPET_SCRIPT));
+  if (!MayHaveContentFilters(ContentFilterDomains::Type::SNIPPET,
+                             URLInfo::ExtractHost(documentUrl)))
+    return std::make_shared<const std::string>();
+
+  JsValueList params;
+  params.push_back(jsEngine.NewValue(documentUrl));
+  params.push_back(jsEngine.NewValue(isolatedSource));
+  params.push_back(jsEngine.NewValue(injectedSource));
+  params.push_back(jsEngine.NewArray(injectedList));
+
+  JsValue func = jsEngine.GetApiFunction("getSnippetsScript");
+  return std::make_shared<const std::string>(func.Call(params).AsString());
 }
 
 std::string AdblockPlus::DefaultFilterEngine::GetSnippetScript(const std::string& documentUrl,
@@ -528,12 +2791,113 @@ std::string AdblockPlus::DefaultFilterEngine::GetSnippetScript(const std::string
                                                                const std::string& injectedSource,
                                                                const std::vector<std::string>& injectedList)
 {
+  return *GetSnippetScriptShared(documentUrl, isolatedSource, injectedSource, injectedList);
+}
+
+IFilterEngine::SnippetLibrary
+DefaultFilterEngine::RegisterSnippetLibrary(const std::string& isolatedSource,
+                                            const std::string& injectedSource,
+                                            const std::vector<std::string>& injectedList)
+{
+  SnippetLibrary library;
+  {
+    std::lock_guard<std::mutex> lock(snippetMutex_);
+    library = nextSnippetLibrary_++;
+  }
+
   JsValueList params;
-  params.push_back(jsEngine.NewValue(documentUrl));
+  params.push_back(jsEngine.NewValue(library));
   params.push_back(jsEngine.NewValue(isolatedSource));
   params.push_back(jsEngine.NewValue(injectedSource));
   params.push_back(jsEngine.NewArray(injectedList));
+  jsEngine.GetApiFunction("registerSnippetLibrary").Call(params);
+
+  std::lock_guard<std::mutex> lock(snippetMutex_);
+  snippetLibraries_.insert(library);
+  return library;
+}
+
+void DefaultFilterEngine::UnregisterSnippetLibrary(SnippetLibrary library)
+{
+  {
+    std::lock_guard<std::mutex> lock(snippetMutex_);
+    if (!snippetLibraries_.erase(library))
+      return;
+  }
+  jsEngine.GetApiFunction("unregisterSnippetLibrary").Call(jsEngine.NewValue(library));
+  // Handles are not reused, stale entries just age out of the cache.
+}
+
+std::string DefaultFilterEngine::GetSnippetScript(const std::string& documentUrl,
+                                                  SnippetLibrary library)
+{
+  return *GetSnippetScriptShared(documentUrl, library);
+}
+
+std::shared_ptr<const std::string>
+DefaultFilterEngine::GetSnippetScriptShared(const std::string& documentUrl, SnippetLibrary library)
+{
+  const ScopedApiCall apiCall(GetApiCallRecorder(ApiCall::GET_SNIPPET_SCRIPT));
+  // Same as in "API.getSnippetsScript", only the host matters.
+  SnippetScriptCacheKey key{URLInfo::ExtractHost(documentUrl), library};
+  const bool cacheable = snippetScriptCache_.Capacity() != 0 && !key.host.empty();
+  uint64_t generation = 0;
+  {
+    std::lock_guard<std::mutex> lock(snippetMutex_);
+    if (!snippetLibraries_.count(library))
+      throw std::invalid_argument("Unknown snippet library");
+    if (cacheable)
+    {
+      if (const auto* cached = snippetScriptCache_.Get(key))
+        return *cached;
+      generation = snippetScriptCacheGeneration_;
+    }
+  }
+
+  if (!MayHaveContentFilters(ContentFilterDomains::Type::SNIPPET, key.host))
+    return std::make_shared<const std::string>();
+
+  JsValueList params;
+  params.push_back(jsEngine.NewValue(documentUrl));
+  params.push_back(jsEngine.NewValue(library));
+  JsValue func = jsEngine.GetApiFunction("getRegisteredSnippetsScript");
+  auto script = std::make_shared<const std::string>(func.Call(params).AsString());
+  if (cacheable)
+  {
+    SnippetScriptCache::Entries evicted;
+    std::lock_guard<std::mutex> lock(snippetMutex_);
+    if (generation == snippetScriptCacheGeneration_)
+      snippetScriptCache_.Put(key, script, &evicted);
+  }
+  return script;
+}
+
+// static
+bool DefaultFilterEngine::AffectsSnippets(ChangeEvent event, const JsValue& item)
+{
+  if (!AffectsMatching(event))
+    return false;
+  if (!IsFilterChange(event) || !item.IsObject())
+    return true;
+  return item.GetProperty("text").AsString().find("#$#") != std::string::npos;
+}
+
+void DefaultFilterEngine::FlushSnippetScriptCache() const
+{
+  SnippetScriptCache::Entries removed;
+  std::lock_guard<std::mutex> lock(snippetMutex_);
+  snippetScriptCache_.Clear(&removed);
+  ++snippetScriptCacheGeneration_;
+}
 
-  JsValue func = jsEngine.Evaluate("API.getSnippetsScript");
-  return func.Call(params).AsString();
+bool DefaultFilterEngine::SnippetScriptCacheKey::operator==(
+    const SnippetScriptCacheKey& other) const
+{
+  return library == other.library && host == other.host;
+}
+
+size_t
+DefaultFilterEngine::SnippetScriptCacheKeyHash::operator()(const SnippetScriptCacheKey& key) const
+{
+  return std::hash<std::string>()(key.host) ^ std::hash<SnippetLibrary>()(key.library);
 }
@@ -17,26 +17,70 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <AdblockPlus/FilterEngineFactory.h>
 #include <AdblockPlus/IFilterEngine.h>
+#include <AdblockPlus/JsHeap.h>
+#include <AdblockPlus/SharedFilterPool.h>
+
+#include "ActiveObject.h"
+#include "ApiCallStats.h"
+#include "AsyncEventDispatcher.h"
+#include "CacheWarmer.h"
+#include "CoalescedCalls.h"
+#include "ContentFilterDomains.h"
+#include "FilterEventBatch.h"
+#include "FilterSubscriptionIndex.h"
+#include "GcScheduler.h"
+#include "HitCounter.h"
+#include "LruCache.h"
+#include "NativeMatcher.h"
+#include "SingleFlight.h"
+#include "StringPool.h"
+#include "TraceRecorder.h"
 
 namespace AdblockPlus
 {
   class DefaultFilterEngine : public IFilterEngine
   {
   public:
-    explicit DefaultFilterEngine(JsEngine& jsEngine);
+    // Only the settings of the engine itself are taken from `parameters`,
+    // the prefs and callbacks are left to FilterEngineFactory.
+    DefaultFilterEngine(JsEngine& jsEngine,
+                        const FilterEngineFactory::CreationParameters& parameters);
     ~DefaultFilterEngine();
 
     Filter GetFilter(const std::string& text) const final;
 
     Subscription GetSubscription(const std::string& url) const final;
     std::vector<Subscription> GetSubscriptionsFromFilter(const Filter& filter) const final;
+    std::vector<std::string>
+    GetSubscriptionUrlsFromFilter(const std::string& filterText) const final;
 
     std::vector<Filter> GetListedFilters() const final;
+    size_t GetListedFilterCount() const final;
+    std::vector<FilterInfo> GetListedFilters(size_t offset, size_t limit) const final;
+    void VisitListedFilters(const FilterVisitor& visitor) const final;
 
     std::vector<Subscription> GetListedSubscriptions() const final;
+    SubscriptionInfo GetSubscriptionInfo(const Subscription& subscription) const final;
+    size_t GetListedSubscriptionCount() const final;
+    std::vector<SubscriptionInfo> GetListedSubscriptions(size_t offset, size_t limit) const final;
+    void VisitListedSubscriptions(const SubscriptionVisitor& visitor) const final;
 
     std::vector<Subscription> FetchAvailableSubscriptions() const final;
+    size_t GetAvailableSubscriptionCount() const final;
+    std::vector<SubscriptionInfo> FetchAvailableSubscriptions(size_t offset,
+                                                              size_t limit) const final;
+    void VisitAvailableSubscriptions(const SubscriptionVisitor& visitor) const final;
+    std::shared_ptr<const std::vector<Recommendation>> GetRecommendations() const final;
 
     void SetAAEnabled(bool enabled) final;
 
@@ -50,19 +94,100 @@ namespace AdblockPlus
                    const std::string& siteKey = "",
                    bool specificOnly = false) const final;
 
+    std::vector<Filter> MatchesBatch(const std::vector<MatchRequest>& requests) const final;
+
+    MatchResult GetMatchResult(const std::string& url,
+                               ContentTypeMask contentTypeMask,
+                               const std::string& documentUrl,
+                               const std::string& siteKey = "",
+                               bool specificOnly = false) const final;
+
     bool IsContentAllowlisted(const std::string& url,
                               ContentTypeMask contentTypeMask,
                               const std::vector<std::string>& documentUrls,
                               const std::string& sitekey = "") const final;
 
+    std::shared_ptr<const FrameContext>
+    CreateFrameContext(const std::vector<std::string>& documentUrls,
+                       const std::string& siteKey = "") const final;
+
+    Filter Matches(const std::string& url,
+                   ContentTypeMask contentTypeMask,
+                   const FrameContext& frame,
+                   bool specificOnly = false) const final;
+
+    MatchResult GetMatchResult(const std::string& url,
+                               ContentTypeMask contentTypeMask,
+                               const FrameContext& frame,
+                               bool specificOnly = false) const final;
+
+    PopupBlockResult CheckPopup(const std::string& url, const FrameContext& opener) const final;
+
+    PopupBlockResult CheckPopup(const std::string& url,
+                                const std::vector<std::string>& openerUrls,
+                                const std::string& sitekey = "") const final;
+
+    MatchCacheStats GetMatchCacheStats() const final;
+    StyleSheetCacheStats GetStyleSheetCacheStats() const final;
+    std::vector<SubscriptionMemoryUsage> GetSubscriptionMemoryUsage() const final;
+    FilterDeduplicationStats GetFilterDeduplicationStats() const final;
+    CompactStyleSheetStats GetCompactStyleSheetStats() const final;
+    std::vector<uint8_t> SerializeSharedFilterData() const final;
+    std::string GetDeclarativeNetRequestRules() const final;
+    PerformanceStats GetPerformanceStats() const final;
+    void FlushFilterHits() final;
+    void StartTraceRecording(const TraceRecordingOptions& options) final;
+    void StopTraceRecording(
+        const TraceRecordingCallback& callback = TraceRecordingCallback()) final;
+
     std::string GetElementHidingStyleSheet(const std::string& domain,
                                            bool specificOnly = false) const final;
 
+    std::shared_ptr<const std::string>
+    GetElementHidingStyleSheetShared(const std::string& domain,
+                                     bool specificOnly = false) const final;
+
+    std::string GetElementHidingGenericStyleSheet(uint64_t* version = nullptr) const final;
+
+    std::shared_ptr<const std::string>
+    GetElementHidingGenericStyleSheetShared(uint64_t* version = nullptr) const final;
+
+    uint64_t GetElementHidingGenericStyleSheetVersion() const final;
+
+    std::string GetElementHidingDomainStyleSheet(const std::string& domain,
+                                                 bool specificOnly = false) const final;
+
+    std::shared_ptr<const std::string>
+    GetElementHidingDomainStyleSheetShared(const std::string& domain,
+                                           bool specificOnly = false) const final;
+
     std::vector<EmulationSelector>
     GetElementHidingEmulationSelectors(const std::string& domain) const final;
 
+    std::shared_ptr<const std::vector<EmulationSelector>>
+    GetElementHidingEmulationSelectorsShared(const std::string& domain) const final;
+
+    void MatchesAsync(const MatchRequest& request,
+                      const MatchResultCallback& callback) const final;
+    void IsContentAllowlistedAsync(const std::string& url,
+                                   ContentTypeMask contentTypeMask,
+                                   const std::vector<std::string>& documentUrls,
+                                   const std::string& sitekey,
+                                   const AllowlistedCallback& callback) const final;
+    void GetElementHidingStyleSheetAsync(const std::string& url,
+                                         bool specificOnly,
+                                         const StyleSheetCallback& callback) const final;
+    std::shared_ptr<const FrameContext> PrepareForDocument(const std::string& url,
+                                                           const std::string& siteKey = "") final;
+
+    void GetElementHidingEmulationSelectorsAsync(
+        const std::string& url, const EmulationSelectorsCallback& callback) const final;
+
     void AddEventObserver(EventObserver* observer) final;
     void RemoveEventObserver(EventObserver* observer) final;
+    void AddAsyncEventObserver(AsyncEventObserver* observer,
+                               const AsyncObserverOptions& options) final;
+    void RemoveAsyncEventObserver(AsyncEventObserver* observer) final;
 
     void SetAllowedConnectionType(const std::string* value) final;
 
@@ -75,11 +200,18 @@ namespace AdblockPlus
                          const std::string& userAgent) const final;
 
     std::vector<std::string> ComposeFilterSuggestions(const IElement* element) const final;
+    std::vector<std::vector<std::string>>
+    ComposeFilterSuggestionsBatch(const std::vector<const IElement*>& elements) const final;
 
     void AddSubscription(const Subscription& subscripton) final;
     void RemoveSubscription(const Subscription& subscription) final;
     void AddFilter(const Filter& filter) final;
     void RemoveFilter(const Filter& filter) final;
+    void AddFilters(const std::vector<Filter>& filters) final;
+    void RemoveFilters(const std::vector<Filter>& filters) final;
+    void BeginUpdate() final;
+    void CommitUpdate() final;
+    std::unique_ptr<EngineSession> CreateEngineSession() const final;
     void StartSynchronization() final;
     void StopSynchronization() final;
     std::string GetSnippetScript(const std::string& documentUrl,
@@ -87,22 +219,96 @@ namespace AdblockPlus
                                  const std::string& injectedSource,
                                  const std::vector<std::string>& injectedList) final;
 
+    std::shared_ptr<const std::string>
+    GetSnippetScriptShared(const std::string& documentUrl,
+                           const std::string& isolatedSource,
+                           const std::string& injectedSource,
+                           const std::vector<std::string>& injectedList) final;
+
+    SnippetLibrary RegisterSnippetLibrary(const std::string& isolatedSource,
+                                          const std::string& injectedSource,
+                                          const std::vector<std::string>& injectedList) final;
+
+    void UnregisterSnippetLibrary(SnippetLibrary library) final;
+
+    std::string GetSnippetScript(const std::string& documentUrl, SnippetLibrary library) final;
+
+    std::shared_ptr<const std::string> GetSnippetScriptShared(const std::string& documentUrl,
+                                                              SnippetLibrary library) final;
+
     void StartObservingEvents();
 
   private:
     class Observer : public EventObserver
     {
     public:
-      explicit Observer(JsEngine& engine) : jsEngine(engine)
+      explicit Observer(GcScheduler& scheduler) : gcScheduler(scheduler)
       {
       }
 
       ~Observer() override = default;
 
       void OnFilterEvent(FilterEvent, const Filter&) override;
+      uint32_t GetFilterEventMask() const override;
+      uint32_t GetSubscriptionEventMask() const override;
 
     private:
-      JsEngine& jsEngine;
+      GcScheduler& gcScheduler;
+    };
+
+    // Events in the order of the `events` list in filterUpdateRegistration.js,
+    // which passes the index to the "filterChange" callback.
+    enum class ChangeEvent
+    {
+      ELEMHIDEUPDATE,
+      LOAD,
+      SAVE,
+      FILTER_ADDED,
+      FILTER_DISABLED,
+      FILTER_HITCOUNT,
+      FILTER_LASTHIT,
+      FILTER_MOVED,
+      FILTER_REMOVED,
+      SUBSCRIPTION_ADDED,
+      SUBSCRIPTION_DISABLED,
+      SUBSCRIPTION_DOWNLOADING,
+      SUBSCRIPTION_DOWNLOADSTATUS,
+      SUBSCRIPTION_ERRORS,
+      SUBSCRIPTION_FIXEDTITLE,
+      SUBSCRIPTION_HOMEPAGE,
+      SUBSCRIPTION_LASTCHECK,
+      SUBSCRIPTION_LASTDOWNLOAD,
+      SUBSCRIPTION_REMOVED,
+      SUBSCRIPTION_TITLE,
+      SUBSCRIPTION_UPDATED,
+      COUNT
+    };
+
+    struct RegisteredObserver
+    {
+      EventObserver* observer;
+      uint32_t filterEventMask;
+      uint32_t subscriptionEventMask;
+      // Set for batching observers.
+      std::shared_ptr<FilterEventBatch> batch;
+    };
+
+    struct RegisteredAsyncObserver
+    {
+      AsyncEventObserver* observer;
+      uint32_t filterEventMask;
+      uint32_t subscriptionEventMask;
+      std::shared_ptr<AsyncEventDispatcher> dispatcher;
+    };
+
+    // Immutable, replaced as a whole when observers are added or removed.
+    struct ObserverList
+    {
+      std::vector<RegisteredObserver> observers;
+      std::vector<RegisteredAsyncObserver> asyncObservers;
+      // Union of the masks of all observers.
+      uint32_t filterEventMask = 0;
+      uint32_t subscriptionEventMask = 0;
     };
 
     JsEngine& jsEngine;
@@ -115,17 +321,371 @@ namespace AdblockPlus
                             const std::string& documentUrl,
                             const std::string& siteKey,
                             bool specificOnly) const;
+    Filter CheckFilterMatchUncached(const std::string& url,
+                                    ContentTypeMask contentTypeMask,
+                                    const std::string& documentUrl,
+                                    const std::string& siteKey,
+                                    bool specificOnly) const;
+    Filter CheckFilterMatchInJs(const std::string& url,
+                                ContentTypeMask contentTypeMask,
+                                const std::string& documentUrl,
+                                const std::string& siteKey,
+                                bool specificOnly) const;
+    std::vector<Filter> CheckFilterMatches(const std::vector<MatchRequest>& requests) const;
+    MatchResult GetMatchResultCached(const std::string& url,
+                                     ContentTypeMask contentTypeMask,
+                                     const std::string& documentUrl,
+                                     const std::string& siteKey,
+                                     bool specificOnly) const;
+    MatchResult GetMatchResultUncached(const std::string& url,
+                                       ContentTypeMask contentTypeMask,
+                                       const std::string& documentUrl,
+                                       const std::string& siteKey,
+                                       bool specificOnly) const;
+    MatchResult ToMatchResult(const Filter& filter) const;
+    void NotifyActivity() const;
+    void RecordHit(const Filter& filter) const;
+    void RecordHit(const MatchResult& result) const;
+
+    std::shared_ptr<const NativeMatcher> GetNativeMatcher() const;
+    // Same as GetNativeMatcher(), but doesn't wait for a rebuild in the
+    // background, the matcher returned meanwhile leaves every lookup to JS.
+    std::shared_ptr<const NativeMatcher> GetNativeMatcherForLookup() const;
+    void UpdateNativeMatcher(ChangeEvent event, const JsValue& item) const;
+    void ScheduleNativeMatcherRebuild() const;
+    void RebuildNativeMatcher() const;
 
     void OnSubscriptionOrFilterChanged(JsValueList&& params) const;
+    void OnSubscriptionOrFilterChanges(JsValueList&& params) const;
+    void NotifyObservers(ChangeEvent event, JsValue&& item) const;
+    void BuildSubscriptionIndex() const;
+    void UpdateSubscriptionIndex(ChangeEvent event,
+                                 const JsValue& item,
+                                 const std::string& subscriptionUrl) const;
+    void ChangeFilters(const std::string& apiFunction, const std::vector<Filter>& filters);
     Filter GetAllowlistingFilter(const std::string& url,
                                  ContentTypeMask contentTypeMask,
                                  const std::vector<std::string>& documentUrls,
                                  const std::string& sitekey) const;
-    static bool Transform(const std::string& str, FilterEvent* event);
-    static bool Transform(const std::string& str, SubscriptionEvent* event);
+    void UpdateObservers(const std::function<void(ObserverList&)>& update);
+    static void UpdateEventMasks(ObserverList& list);
+    static bool AffectsMatching(ChangeEvent event);
+    static bool IsFilterChange(ChangeEvent event);
+    static bool Transform(ChangeEvent changeEvent, FilterEvent* event);
+    static bool Transform(ChangeEvent changeEvent, SubscriptionEvent* event);
+
+    // Serializes the modifications of observers_, which is read with
+    // std::atomic_load() when dispatching events.
+    std::mutex callbacksMutex_;
+    std::shared_ptr<GcScheduler> gcScheduler_;
+    Observer observer_{*gcScheduler_};
+    // Set if favorite sites are warmed up, see warmedDomainCount.
+    std::shared_ptr<CacheWarmer> cacheWarmer_;
+    // Enabled by the "savestats" pref.
+    std::shared_ptr<HitCounter> hitCounter_;
+    std::shared_ptr<const ObserverList> observers_ = std::make_shared<const ObserverList>();
+
+    // Simple URL filters mirrored from JS, rebuilt on subscription changes
+    // and updated incrementally on filter changes. Only accessed with the
+    // engine locked, except by the rebuild which builds a new one unlocked.
+    mutable NativeMatcher nativeMatcher_;
+    mutable bool nativeMatcherDirty_ = true;
+    // Immutable copy of nativeMatcher_ which is queried without any lock.
+    // Reset on every filter change and published again on the next lookup,
+    // always use std::atomic_load() and std::atomic_store().
+    mutable std::shared_ptr<const NativeMatcher> nativeMatcherSnapshot_;
+    // Set from a subscription change until nativeMatcherRebuilds_ swaps in
+    // the rebuilt matcher, only changed with the engine locked. Started on
+    // first use and stopped in the destructor like asyncCalls_.
+    mutable std::atomic<bool> nativeMatcherRebuilding_{false};
+    mutable std::unique_ptr<ActiveObject> nativeMatcherRebuilds_;
+
+    // Rules converted from the snapshot which declarativeRulesMatcher_
+    // refers to. The rule IDs by filter text are kept between conversions.
+    mutable std::mutex declarativeRulesMutex_;
+    mutable std::weak_ptr<const NativeMatcher> declarativeRulesMatcher_;
+    mutable std::string declarativeRules_;
+    mutable std::unordered_map<std::string, uint32_t> declarativeRuleIds_;
+    mutable uint32_t nextDeclarativeRuleId_ = 1;
+
+    // The native matcher is stored next to patterns.ini on every save and
+    // restored on startup, unless patterns.ini changed meanwhile. The state
+    // is shared with file system callbacks, which can outlive the engine.
+    struct MatcherIndexState
+    {
+      std::mutex mutex;
+      // Restored from disk and waiting for the "load" event.
+      std::unique_ptr<NativeMatcher> restored;
+      bool loaded = false;
+      // Incremented on every change of the filters.
+      uint64_t generation = 0;
+      // Value of generation when patterns.ini was last serialized.
+      uint64_t serializedGeneration = 0;
+      // URL filters of downloaded filter lists, parsed on the thread which
+      // downloaded them and taken by the next rebuild of the native matcher.
+      NativeMatcher::PreparedFilters prepared;
+      // Parsed filters shared with other engines, none by default. The pool
+      // is thread safe, so it is used without `mutex`.
+      std::shared_ptr<SharedFilterPool> sharedFilterPool;
+      NativeFilterPool* filterPool = nullptr;
+    };
+
+    void RestoreNativeMatcher();
+    void SaveNativeMatcher() const;
+    void OnFileWrite(JsValueList&& params);
+
+    std::shared_ptr<MatcherIndexState> matcherIndex_;
+
+    // Subscriptions by filter, built on the first lookup and kept up to date
+    // by the events. It is only modified with the engine locked, so a
+    // thread which holds that lock may read subscriptionIndexBuilt_ without
+    // the mutex.
+    mutable std::mutex subscriptionIndexMutex_;
+    mutable FilterSubscriptionIndex subscriptionIndex_;
+    mutable bool subscriptionIndexBuilt_ = false;
+
+    // Read on the first GetRecommendations() call, always use
+    // std::atomic_load() and std::atomic_store().
+    mutable std::shared_ptr<const std::vector<Recommendation>> recommendations_;
+
+    // The few document hosts and sitekeys which the entries have in common
+    // are interned in StringPool::Shared().
+    struct MatchCacheKey
+    {
+      std::string url;
+      ContentTypeMask contentTypeMask;
+      StringPool::Id documentHost;
+      StringPool::Id siteKey;
+      bool specificOnly;
+
+      bool operator==(const MatchCacheKey& other) const;
+    };
+
+    struct MatchCacheKeyHash
+    {
+      size_t operator()(const MatchCacheKey& key) const;
+    };
+
+    // The filter is shared so that it is copied and destroyed, which requires
+    // the engine lock, outside of matchCacheMutex_. It is not set for entries
+    // stored by GetMatchResult().
+    struct CachedMatch
+    {
+      MatchResult result;
+      std::shared_ptr<const Filter> filter;
+    };
+
+    typedef LruCache<MatchCacheKey, CachedMatch, MatchCacheKeyHash> MatchCache;
+
+    bool LookUpMatchCache(const MatchCacheKey& key,
+                          CachedMatch* cached,
+                          uint64_t* generation) const;
+    void StoreInMatchCache(const MatchCacheKey& key,
+                           CachedMatch&& cached,
+                           uint64_t generation) const;
+    void FlushMatchCache() const;
+    void OnMemoryPressure(MemoryPressureLevel level) const;
+
+    // Slot of the small direct-mapped cache which each thread keeps in front
+    // of matchCache_ for GetMatchResultCached(). A slot is valid while the
+    // engine and matchCacheGeneration_ are the same as when it was stored.
+    // It holds no Filter, so that it can outlive the engine.
+    struct ThreadMatchCacheSlot
+    {
+      uint64_t engineId = 0;
+      uint64_t generation = 0;
+      MatchCacheKey key;
+      MatchResult result;
+    };
+
+    static ThreadMatchCacheSlot& GetThreadMatchCacheSlot(size_t keyHash);
+    bool LookUpThreadMatchCache(const MatchCacheKey& key,
+                                size_t keyHash,
+                                MatchResult* result) const;
+
+    // Allowlisting of a frame by `$document` and `$genericblock` filters.
+    struct FrameAllowlisting
+    {
+      MatchResult document;
+      bool genericblock = false;
+    };
+
+    class DefaultFrameContext : public FrameContext
+    {
+    public:
+      DefaultFrameContext(const std::vector<std::string>& documentUrls,
+                          const std::string& siteKey);
+
+      const std::vector<std::string>& GetDocumentUrls() const final;
+      const std::string& GetSiteKey() const final;
+      // The frame itself, empty for top-level requests.
+      const std::string& GetDocumentUrl() const;
+
+      // Looked up on first use and again once matchCacheGeneration_ changed.
+      mutable std::mutex mutex;
+      mutable bool known = false;
+      mutable uint64_t generation = 0;
+      mutable FrameAllowlisting allowlisting;
+
+    private:
+      const std::vector<std::string> documentUrls;
+      const std::string siteKey;
+    };
+
+    FrameAllowlisting GetFrameAllowlisting(const DefaultFrameContext& frame) const;
+
+    mutable std::mutex matchCacheMutex_;
+    mutable MatchCache matchCache_;
+    // Only changed with matchCacheMutex_ held, read without it by
+    // LookUpThreadMatchCache().
+    mutable std::atomic<uint64_t> matchCacheGeneration_;
+    mutable size_t matchCacheHits_ = 0;
+    mutable size_t matchCacheMisses_ = 0;
+    // Tells the slots of the thread caches apart from the ones of an engine
+    // created before at the same address.
+    const uint64_t engineId_;
+    mutable std::atomic<size_t> threadMatchCacheHits_;
+
+    // Methods which GetPerformanceStats() reports on, the `...Shared()`
+    // variants are recorded as the plain ones.
+    enum class ApiCall
+    {
+      MATCHES,
+      MATCHES_BATCH,
+      GET_MATCH_RESULT,
+      CHECK_POPUP,
+      IS_CONTENT_ALLOWLISTED,
+      GET_ELEMENT_HIDING_STYLE_SHEET,
+      GET_ELEMENT_HIDING_GENERIC_STYLE_SHEET,
+      GET_ELEMENT_HIDING_DOMAIN_STYLE_SHEET,
+      GET_ELEMENT_HIDING_EMULATION_SELECTORS,
+      GET_SNIPPET_SCRIPT,
+      COMPOSE_FILTER_SUGGESTIONS,
+      COMPOSE_FILTER_SUGGESTIONS_BATCH,
+      COUNT
+    };
+
+    ApiCallRecorder& GetApiCallRecorder(ApiCall call) const;
+
+    mutable ApiCallRecorder apiCalls_[static_cast<size_t>(ApiCall::COUNT)];
+
+    // Set by StartTraceRecording(), always use std::atomic_load() and
+    // std::atomic_exchange().
+    std::shared_ptr<TraceRecorder> traceRecorder_;
+
+    struct StyleSheetCacheKey
+    {
+      std::string domain;
+      bool specificOnly;
+      // Without the generic style sheet.
+      bool domainOnly;
+
+      bool operator==(const StyleSheetCacheKey& other) const;
+    };
+
+    struct StyleSheetCacheKeyHash
+    {
+      size_t operator()(const StyleSheetCacheKey& key) const;
+    };
+
+    typedef LruCache<StyleSheetCacheKey,
+                     std::shared_ptr<const std::string>,
+                     StyleSheetCacheKeyHash>
+        StyleSheetCache;
+
+    std::vector<SubscriptionInfo>
+    GetSubscriptionInfo(const std::string& apiFunction, size_t offset, size_t limit) const;
+    void VisitSubscriptionInfo(const std::string& apiFunction,
+                               const SubscriptionVisitor& visitor) const;
+
+    std::shared_ptr<const std::string> GetCachedStyleSheet(const std::string& apiFunction,
+                                                           const std::string& domain,
+                                                           bool specificOnly,
+                                                           bool domainOnly) const;
+    typedef LruCache<std::string, std::shared_ptr<const std::vector<EmulationSelector>>>
+        EmulationSelectorsCache;
+
+    void FlushStyleSheetCache() const;
+    bool MayHaveContentFilters(ContentFilterDomains::Type type, const std::string& host) const;
+
+    // Style sheets are shared so that large ones are copied outside of the
+    // lock. Emulation selectors live and are flushed along with them.
+    mutable std::mutex styleSheetCacheMutex_;
+    mutable StyleSheetCache styleSheetCache_;
+    mutable EmulationSelectorsCache emulationSelectorsCache_;
+    mutable uint64_t styleSheetCacheGeneration_ = 0;
+    mutable size_t styleSheetCacheHits_ = 0;
+    mutable size_t styleSheetCacheMisses_ = 0;
+    // Read from JS on the first lookup after a flush of the style sheets.
+    mutable std::shared_ptr<const ContentFilterDomains> contentFilterDomains_;
+    // The generic style sheet is kept regardless of the cache size, its
+    // version only changes when the text does.
+    mutable std::shared_ptr<const std::string> genericStyleSheet_;
+    mutable uint64_t genericStyleSheetVersion_ = 0;
+    mutable bool genericStyleSheetStale_ = true;
+
+    struct SnippetScriptCacheKey
+    {
+      std::string host;
+      SnippetLibrary library;
+
+      bool operator==(const SnippetScriptCacheKey& other) const;
+    };
+
+    struct SnippetScriptCacheKeyHash
+    {
+      size_t operator()(const SnippetScriptCacheKey& key) const;
+    };
+
+    typedef LruCache<SnippetScriptCacheKey,
+                     std::shared_ptr<const std::string>,
+                     SnippetScriptCacheKeyHash>
+        SnippetScriptCache;
+
+    static bool AffectsSnippets(ChangeEvent event, const JsValue& item);
+    void FlushSnippetScriptCache() const;
+
+    mutable std::mutex snippetMutex_;
+    std::unordered_set<SnippetLibrary> snippetLibraries_;
+    SnippetLibrary nextSnippetLibrary_ = 1;
+    mutable SnippetScriptCache snippetScriptCache_;
+    mutable uint64_t snippetScriptCacheGeneration_ = 0;
+
+    // Results of VerifySignature() by key, signature and signed data.
+    mutable std::mutex signatureCacheMutex_;
+    mutable LruCache<std::string, bool> signatureCache_;
+
+    ActiveObject& GetAsyncCalls() const;
+    template<class Result>
+    void PostAsync(CoalescedCalls<Result>& calls,
+                   const std::string& key,
+                   const std::function<Result()>& call,
+                   const typename CoalescedCalls<Result>::Callback& callback) const;
+    void PrepareDocument(const DefaultFrameContext& frame);
+    void WarmUpCaches(const std::vector<std::string>& hosts);
+
+    // Threads asking for the same result while it is computed wait for it,
+    // keyed by the cache generation so that filter changes aren't missed.
+    // Calls made with the isolate locked compute their own, as the thread
+    // computing it might wait for that lock.
+    template<class Result, class Compute>
+    Result ComputeOnce(SingleFlight<Result>& flights,
+                       const std::string& key,
+                       Compute compute) const;
+    mutable SingleFlight<MatchResult> matchesInFlight_;
+    mutable SingleFlight<std::shared_ptr<const std::string>> styleSheetsInFlight_;
+    mutable SingleFlight<std::shared_ptr<const std::vector<EmulationSelector>>>
+        emulationSelectorsInFlight_;
 
-    mutable std::mutex callbacksMutex_;
-    Observer observer_{jsEngine};
-    std::vector<IFilterEngine::EventObserver*> observers_;
+    // Thread of the `...Async()` methods, started on first use and stopped
+    // first thing in the destructor, after completing the queued calls.
+    const ThreadOptions asyncCallThread_;
+    mutable std::once_flag asyncCallsStarted_;
+    mutable std::unique_ptr<ActiveObject> asyncCalls_;
+    mutable CoalescedCalls<MatchResult> pendingMatches_;
+    mutable CoalescedCalls<bool> pendingAllowlisting_;
+    mutable CoalescedCalls<std::shared_ptr<const std::string>> pendingStyleSheets_;
+    mutable CoalescedCalls<std::shared_ptr<const std::vector<EmulationSelector>>>
+        pendingEmulationSelectors_;
   };
 }
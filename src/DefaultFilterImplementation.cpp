@@ -16,23 +16,93 @@
  */
 #include "DefaultFilterImplementation.h"
 
+#include <algorithm>
 #include <exception>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 #include "JsEngine.h"
 
 using namespace AdblockPlus;
 
+namespace
+{
+  const size_t MIN_PURGE_THRESHOLD = 1024;
+
+  // Filter texts shared by all filter objects alive, so that every filter
+  // is stored once no matter how many Filter instances refer to it.
+  class FilterTextPool
+  {
+  public:
+    std::shared_ptr<const std::string> Intern(std::string&& text, size_t hash)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto range = texts.equal_range(hash);
+      for (auto it = range.first; it != range.second; ++it)
+      {
+        auto existing = it->second.lock();
+        if (existing && *existing == text)
+          return existing;
+      }
+
+      if (texts.size() >= purgeThreshold)
+        Purge();
+      auto interned = std::make_shared<const std::string>(std::move(text));
+      texts.emplace(hash, interned);
+      return interned;
+    }
+
+  private:
+    void Purge()
+    {
+      for (auto it = texts.begin(); it != texts.end();)
+        it = it->second.expired() ? texts.erase(it) : std::next(it);
+      purgeThreshold = std::max(MIN_PURGE_THRESHOLD, 2 * texts.size());
+    }
+
+    std::mutex mutex;
+    std::unordered_multimap<size_t, std::weak_ptr<const std::string>> texts;
+    size_t purgeThreshold = MIN_PURGE_THRESHOLD;
+  };
+
+  FilterTextPool& GetFilterTextPool()
+  {
+    static FilterTextPool pool;
+    return pool;
+  }
+}
+
 DefaultFilterImplementation::DefaultFilterImplementation(JsValue&& value, JsEngine* engine)
     : jsObject(std::move(value)), jsEngine(engine)
 {
   if (!jsObject.IsObject())
     throw std::runtime_error("JavaScript value is not an object");
+
+  std::string raw = GetStringProperty("text");
+  hash = std::hash<std::string>()(raw);
+  text = GetFilterTextPool().Intern(std::move(raw), hash);
+  type = TypeFromClassName(jsObject.GetClass());
+}
+
+DefaultFilterImplementation::DefaultFilterImplementation(const DefaultFilterImplementation& other)
+    : jsObject(other.jsObject),
+      jsEngine(other.jsEngine),
+      text(other.text),
+      hash(other.hash),
+      type(other.type)
+{
 }
 
 IFilterImplementation::Type DefaultFilterImplementation::GetType() const
 {
-  std::string className = jsObject.GetClass();
+  return type;
+}
+
+// static
+IFilterImplementation::Type
+DefaultFilterImplementation::TypeFromClassName(const std::string& className)
+{
   if (className == "BlockingFilter")
     return TYPE_BLOCKING;
   else if (className == "AllowingFilter")
@@ -51,12 +121,17 @@ IFilterImplementation::Type DefaultFilterImplementation::GetType() const
 
 std::string DefaultFilterImplementation::GetRaw() const
 {
-  return GetStringProperty("text");
+  return *text;
 }
 
 bool DefaultFilterImplementation::operator==(const IFilterImplementation& filter) const
 {
-  return GetRaw() == filter.GetRaw();
+  return hash == filter.GetHash() && *text == filter.GetRaw();
+}
+
+size_t DefaultFilterImplementation::GetHash() const
+{
+  return hash;
 }
 
 std::string DefaultFilterImplementation::GetStringProperty(const std::string& name) const
@@ -67,6 +142,5 @@ std::string DefaultFilterImplementation::GetStringProperty(const std::string& na
 
 std::unique_ptr<IFilterImplementation> DefaultFilterImplementation::Clone() const
 {
-  auto copyObject = jsObject;
-  return std::make_unique<DefaultFilterImplementation>(std::move(copyObject), jsEngine);
+  return std::unique_ptr<IFilterImplementation>(new DefaultFilterImplementation(*this));
 }
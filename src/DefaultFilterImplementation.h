@@ -17,6 +17,9 @@
 
 #pragma once
 
+#include <memory>
+#include <string>
+
 #include <AdblockPlus/IFilterImplementation.h>
 #include <AdblockPlus/JsValue.h>
 
@@ -37,13 +40,27 @@ namespace AdblockPlus
     IFilterImplementation::Type GetType() const final;
     std::string GetRaw() const final;
     bool operator==(const IFilterImplementation& filter) const final;
+    size_t GetHash() const final;
     std::unique_ptr<IFilterImplementation> Clone() const final;
 
+    /**
+     * Maps the class name of a JavaScript filter object to its type.
+     * @param className Constructor name, e.g. `BlockingFilter`.
+     * @return Filter type, `TYPE_INVALID` for unknown classes.
+     */
+    static Type TypeFromClassName(const std::string& className);
+
   private:
     friend class DefaultFilterEngine;
+    DefaultFilterImplementation(const DefaultFilterImplementation& other);
     std::string GetStringProperty(const std::string& name) const;
 
     JsValue jsObject;
     JsEngine* jsEngine;
+    // Filters are immutable, so these are read once. The text is interned,
+    // all instances for the same filter share it.
+    std::shared_ptr<const std::string> text;
+    size_t hash;
+    Type type;
   };
 }
@@ -15,9 +15,11 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cassert>
 
 #include "DefaultPlatform.h"
+#include "JsContext.h"
 #include "JsEngine.h"
 
 using namespace AdblockPlus;
@@ -26,6 +28,12 @@ extern std::string jsSources[];
 
 namespace
 {
+  const char* CODE_CACHE_FILE = "v8codecache.bin";
+  // Cache caps of MemoryProfile::LOW_MEMORY.
+  const size_t LOW_MEMORY_MATCH_CACHE_SIZE = 64;
+  const size_t LOW_MEMORY_STYLE_SHEET_CACHE_SIZE = 2;
+  const size_t LOW_MEMORY_SNIPPET_SCRIPT_CACHE_SIZE = 2;
+
   template<typename T>
   void ValidatePlatformCreationParameter(const std::unique_ptr<T>& param, const char* paramName)
   {
@@ -35,6 +43,7 @@ namespace
 }
 
 DefaultPlatform::DefaultPlatform(PlatformFactory::CreationParameters&& creationParameters)
+    : metricsReporting_(std::make_shared<MetricsReporting>())
 {
 #define ASSIGN_PLATFORM_PARAM(param)                                                               \
   ValidatePlatformCreationParameter(param = std::move(creationParameters.param), #param)
@@ -47,11 +56,40 @@ DefaultPlatform::DefaultPlatform(PlatformFactory::CreationParameters&& creationP
   ASSIGN_PLATFORM_PARAM(executor);
 
 #undef ASSIGN_PLATFORM_PARAM
+  codeCache = std::move(creationParameters.codeCache);
+  persistentCodeCache = creationParameters.persistentCodeCache;
+  heapLimits = creationParameters.heapLimits;
+  memoryProfile = creationParameters.memoryProfile;
+  shutdownTimeout = creationParameters.shutdownTimeout;
+  deferredJsValueRelease = creationParameters.deferredJsValueRelease;
+  metricsReporting_->platform = this;
 }
 
 DefaultPlatform::~DefaultPlatform()
 {
-  executor->Stop();
+  {
+    // Waits for a snapshot which is being taken.
+    std::lock_guard<std::mutex> lock(metricsReporting_->mutex);
+    metricsReporting_->platform = nullptr;
+    metricsReporting_->timer.Cancel();
+  }
+  // Prefs waiting for the save delay are written while the executor still
+  // takes tasks.
+  if (filterEngine_.valid() &&
+      filterEngine_.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+  {
+    try
+    {
+      jsEngine->GetApiFunction("flushPrefs").Call();
+    }
+    catch (const std::exception& e)
+    {
+      (*logSystem)(LogSystem::LOG_LEVEL_ERROR,
+                   std::string("Failed to save prefs: ") + e.what(),
+                   "DefaultPlatform");
+    }
+  }
+  executor->StopWithin(shutdownTimeout);
 }
 
 JsEngine& DefaultPlatform::GetJsEngine()
@@ -66,7 +104,18 @@ void DefaultPlatform::SetUp(const AppInfo& appInfo, std::unique_ptr<IV8IsolatePr
   if (jsEngine)
     return;
   JsEngine::Interfaces interfaces{*timer, *fileSystem, *webRequest, *logSystem, *resourceReader};
-  jsEngine = JsEngine::New(appInfo, interfaces, std::move(isolate));
+  jsEngine = JsEngine::New(appInfo, interfaces, std::move(isolate), heapLimits, memoryProfile);
+  if (deferredJsValueRelease)
+    jsEngine->EnableDeferredValueRelease();
+  if (!codeCache.empty() && !persistentCodeCache)
+  {
+    JsEngine::CodeCache restoredCodeCache;
+    if (JsEngine::DeserializeCodeCache(codeCache, &restoredCodeCache))
+      jsEngine->SetCodeCache(std::move(restoredCodeCache));
+    else
+      (*logSystem)(LogSystem::LOG_LEVEL_WARN, "Ignoring invalid code cache", "DefaultPlatform");
+    IFileSystem::IOBuffer().swap(codeCache);
+  }
 }
 
 void DefaultPlatform::CreateFilterEngineAsync(
@@ -83,16 +132,19 @@ void DefaultPlatform::CreateFilterEngineAsync(
   }
 
   GetJsEngine(); // ensures that JsEngine is instantiated
-  FilterEngineFactory::CreateAsync(
-      *jsEngine,
-      GetEvaluateCallback(),
-      [onCreated, filterEnginePromise](std::unique_ptr<IFilterEngine> filterEngine) {
-        const auto& filterEngineRef = *filterEngine;
-        filterEnginePromise->set_value(std::move(filterEngine));
-        if (onCreated)
-          onCreated(filterEngineRef);
+  if (!persistentCodeCache)
+  {
+    CreateFilterEngine(parameters, onCreated, IFileSystem::IOBuffer(), filterEnginePromise);
+    return;
+  }
+  fileSystem->Read(
+      CODE_CACHE_FILE,
+      [this, parameters, onCreated, filterEnginePromise](IFileSystem::IOBuffer&& content) {
+        CreateFilterEngine(parameters, onCreated, content, filterEnginePromise);
       },
-      parameters);
+      [this, parameters, onCreated, filterEnginePromise](const std::string&) {
+        CreateFilterEngine(parameters, onCreated, IFileSystem::IOBuffer(), filterEnginePromise);
+      });
 }
 
 IFilterEngine& DefaultPlatform::GetFilterEngine()
@@ -101,6 +153,63 @@ IFilterEngine& DefaultPlatform::GetFilterEngine()
   return *filterEngine_.get().get();
 }
 
+IFilterEngine* DefaultPlatform::TryGetFilterEngine()
+{
+  std::lock_guard<std::mutex> lock(modulesMutex_);
+  if (!filterEngine_.valid() ||
+      filterEngine_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    return nullptr;
+  return filterEngine_.get().get();
+}
+
+void DefaultPlatform::AddFilterEngineReadyCallback(const OnFilterEngineCreatedCallback& callback)
+{
+  IFilterEngine* filterEngine = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(modulesMutex_);
+    if (!filterEngine_.valid() ||
+        filterEngine_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      readyCallbacks_.push_back(callback);
+      return;
+    }
+    filterEngine = filterEngine_.get().get();
+  }
+  callback(*filterEngine);
+}
+
+void DefaultPlatform::InitializeInBackground(
+    const AppInfo& appInfo, const FilterEngineFactory::CreationParameters& parameters)
+{
+  executor->Dispatch(
+      [this, appInfo, parameters]() {
+        try
+        {
+          SetUp(appInfo);
+          CreateFilterEngineAsync(parameters);
+        }
+        catch (const std::exception& e)
+        {
+          // The next call of SetUp() on the host's side tries again.
+          (*logSystem)(LogSystem::LOG_LEVEL_ERROR,
+                       std::string("Background initialization failed: ") + e.what(),
+                       "DefaultPlatform");
+        }
+      },
+      IExecutor::TaskClass::CRITICAL);
+}
+
+void DefaultPlatform::OnFilterEngineReady(const IFilterEngine& filterEngine)
+{
+  std::vector<OnFilterEngineCreatedCallback> callbacks;
+  {
+    std::lock_guard<std::mutex> lock(modulesMutex_);
+    callbacks.swap(readyCallbacks_);
+  }
+  for (const auto& callback : callbacks)
+    callback(filterEngine);
+}
+
 ITimer& DefaultPlatform::GetTimer() const
 {
   return *timer;
@@ -126,6 +235,149 @@ IResourceReader& DefaultPlatform::GetResourceReader() const
   return *resourceReader;
 }
 
+MetricsSnapshot DefaultPlatform::GetMetrics()
+{
+  MetricsSnapshot snapshot;
+  snapshot.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+  JsEngine* engine = nullptr;
+  std::shared_future<std::unique_ptr<IFilterEngine>> filterEngine;
+  {
+    std::lock_guard<std::mutex> lock(modulesMutex_);
+    engine = jsEngine.get();
+    filterEngine = filterEngine_;
+  }
+  // Taking a snapshot must not create anything.
+  if (engine)
+  {
+    snapshot.heap = engine->GetHeapStatistics();
+    snapshot.webRequests = engine->GetWebRequestStats();
+  }
+  if (filterEngine.valid() &&
+      filterEngine.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+  {
+    const IFilterEngine& engineRef = *filterEngine.get();
+    snapshot.hasFilterEngine = true;
+    snapshot.matchCache = engineRef.GetMatchCacheStats();
+    snapshot.styleSheetCache = engineRef.GetStyleSheetCacheStats();
+    snapshot.apiCalls = engineRef.GetPerformanceStats();
+  }
+  snapshot.executor = executor->GetStats();
+  snapshot.timer = timer->GetStats();
+  return snapshot;
+}
+
+void DefaultPlatform::SetMetricsObserver(std::shared_ptr<MetricsObserver> observer,
+                                         std::chrono::milliseconds interval)
+{
+  std::lock_guard<std::mutex> lock(metricsReporting_->mutex);
+  metricsReporting_->timer.Cancel();
+  metricsReporting_->timer = TimerHandle();
+  metricsReporting_->observer = std::move(observer);
+  metricsReporting_->interval = interval;
+  const uint64_t generation = ++metricsReporting_->generation;
+  if (!metricsReporting_->observer)
+    return;
+  auto reporting = metricsReporting_;
+  metricsReporting_->timer = timer->SetCancellableTimer(
+      interval, [reporting, generation]() { ReportMetrics(reporting, generation); });
+}
+
+void DefaultPlatform::NotifyMemoryPressure(MemoryPressureLevel level)
+{
+  JsEngine* engine = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(modulesMutex_);
+    engine = jsEngine.get();
+  }
+  // Creating the engine would only take more memory.
+  if (engine)
+    engine->NotifyMemoryPressure(level);
+}
+
+// static
+void DefaultPlatform::ReportMetrics(const std::shared_ptr<MetricsReporting>& reporting,
+                                    uint64_t generation)
+{
+  MetricsSnapshot snapshot;
+  std::shared_ptr<MetricsObserver> observer;
+  {
+    std::lock_guard<std::mutex> lock(reporting->mutex);
+    if (!reporting->platform || reporting->generation != generation)
+      return;
+    snapshot = reporting->platform->GetMetrics();
+    observer = reporting->observer;
+  }
+  // Without the lock, so that the observer may replace itself.
+  observer->OnMetrics(snapshot);
+
+  std::lock_guard<std::mutex> lock(reporting->mutex);
+  if (!reporting->platform || reporting->generation != generation)
+    return;
+  reporting->timer = reporting->platform->timer->SetCancellableTimer(
+      reporting->interval, [reporting, generation]() { ReportMetrics(reporting, generation); });
+}
+
+void DefaultPlatform::CreateFilterEngine(
+    const FilterEngineFactory::CreationParameters& parameters,
+    const Platform::OnFilterEngineCreatedCallback& onCreated,
+    const IFileSystem::IOBuffer& storedCodeCache,
+    const std::shared_ptr<std::promise<std::unique_ptr<IFilterEngine>>>& filterEnginePromise)
+{
+  if (persistentCodeCache)
+  {
+    // Entries which V8 accepts are kept, so that the file only changes
+    // when a script or V8 does.
+    JsEngine::CodeCache restoredCodeCache;
+    if (!JsEngine::DeserializeCodeCache(storedCodeCache, &restoredCodeCache))
+      JsEngine::DeserializeCodeCache(codeCache, &restoredCodeCache);
+    jsEngine->SetCodeCache(std::move(restoredCodeCache), true);
+    IFileSystem::IOBuffer().swap(codeCache);
+  }
+
+  FilterEngineFactory::CreationParameters profileParameters = parameters;
+  if (memoryProfile == MemoryProfile::LOW_MEMORY)
+  {
+    profileParameters.matchCacheSize =
+        std::min(profileParameters.matchCacheSize, LOW_MEMORY_MATCH_CACHE_SIZE);
+    profileParameters.styleSheetCacheSize =
+        std::min(profileParameters.styleSheetCacheSize, LOW_MEMORY_STYLE_SHEET_CACHE_SIZE);
+    profileParameters.snippetScriptCacheSize =
+        std::min(profileParameters.snippetScriptCacheSize, LOW_MEMORY_SNIPPET_SCRIPT_CACHE_SIZE);
+    profileParameters.lazyDisabledSubscriptions = true;
+  }
+  FilterEngineFactory::CreateAsync(
+      *jsEngine,
+      GetEvaluateCallback(),
+      [this, onCreated, filterEnginePromise](std::unique_ptr<IFilterEngine> filterEngine) {
+        const auto& filterEngineRef = *filterEngine;
+        filterEnginePromise->set_value(std::move(filterEngine));
+        if (onCreated)
+          onCreated(filterEngineRef);
+        OnFilterEngineReady(filterEngineRef);
+      },
+      profileParameters);
+
+  if (!persistentCodeCache)
+    return;
+  // All the scripts are evaluated by now, the entries are not needed any more.
+  IFileSystem::IOBuffer data;
+  {
+    const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
+    if (jsEngine->IsCodeCacheModified())
+      data = JsEngine::SerializeCodeCache(jsEngine->GetCodeCache());
+    jsEngine->SetCodeCache(JsEngine::CodeCache());
+  }
+  if (data.empty())
+    return;
+  fileSystem->Write(CODE_CACHE_FILE, data, [this](const std::string& error) {
+    if (!error.empty())
+      (*logSystem)(LogSystem::LOG_LEVEL_WARN, "Failed to store code cache: " + error,
+                   "DefaultPlatform");
+  });
+}
+
 std::function<void(const std::string&)> DefaultPlatform::GetEvaluateCallback()
 {
   // GetEvaluateCallback() method assumes that jsEngine is already created
@@ -39,11 +39,24 @@ namespace AdblockPlus
         const OnFilterEngineCreatedCallback& onCreated = OnFilterEngineCreatedCallback()) override;
 
     IFilterEngine& GetFilterEngine() override;
+    IFilterEngine* TryGetFilterEngine() override;
+    void AddFilterEngineReadyCallback(const OnFilterEngineCreatedCallback& callback) override;
+
+    /**
+     * Sets up the platform and creates the filter engine on a thread of the
+     * executor, see `PlatformFactory::CreationParameters::backgroundInitialization`.
+     */
+    void InitializeInBackground(const AppInfo& appInfo,
+                                const FilterEngineFactory::CreationParameters& parameters);
     ITimer& GetTimer() const override;
     IFileSystem& GetFileSystem() const override;
     IWebRequest& GetWebRequest() const override;
     LogSystem& GetLogSystem() const override;
     IResourceReader& GetResourceReader() const override;
+    MetricsSnapshot GetMetrics() override;
+    void SetMetricsObserver(std::shared_ptr<MetricsObserver> observer,
+                            std::chrono::milliseconds interval) override;
+    void NotifyMemoryPressure(MemoryPressureLevel level) override;
 
   private:
     std::unique_ptr<JsEngine> jsEngine;
@@ -57,12 +70,43 @@ namespace AdblockPlus
 
   private:
     std::unique_ptr<IExecutor> executor;
+    // Serialized code cache, applied once the JsEngine is created.
+    IFileSystem::IOBuffer codeCache;
+    bool persistentCodeCache;
+    JsHeapLimits heapLimits;
+    MemoryProfile memoryProfile;
+    std::chrono::milliseconds shutdownTimeout;
+    bool deferredJsValueRelease;
     // used for creation and deletion of modules.
     std::mutex modulesMutex_;
     std::shared_future<std::unique_ptr<IFilterEngine>> filterEngine_;
+    // Added by AddFilterEngineReadyCallback() while the engine is created,
+    // guarded by modulesMutex_ as well.
+    std::vector<OnFilterEngineCreatedCallback> readyCallbacks_;
     std::set<std::string> evaluatedJsSources_;
     std::mutex evaluatedJsSourcesMutex_;
 
+    // Shared with the timer callbacks, which stop once `platform` is reset.
+    struct MetricsReporting
+    {
+      std::mutex mutex;
+      DefaultPlatform* platform;
+      std::shared_ptr<MetricsObserver> observer;
+      std::chrono::milliseconds interval;
+      // Incremented when the observer is replaced.
+      uint64_t generation = 0;
+      TimerHandle timer;
+    };
+    std::shared_ptr<MetricsReporting> metricsReporting_;
+
+    static void ReportMetrics(const std::shared_ptr<MetricsReporting>& reporting,
+                              uint64_t generation);
     std::function<void(const std::string&)> GetEvaluateCallback();
+    void OnFilterEngineReady(const IFilterEngine& filterEngine);
+    void CreateFilterEngine(const FilterEngineFactory::CreationParameters& parameters,
+                            const Platform::OnFilterEngineCreatedCallback& onCreated,
+                            const IFileSystem::IOBuffer& storedCodeCache,
+                            const std::shared_ptr<std::promise<std::unique_ptr<IFilterEngine>>>&
+                                filterEnginePromise);
   };
 }
@@ -17,6 +17,8 @@
 
 #include "DefaultResourceReader.h"
 
+#include "DefaultFileSystem.h"
+
 using namespace AdblockPlus;
 
 StringPreloadedFilterResponse::StringPreloadedFilterResponse(std::string data)
@@ -39,6 +41,37 @@ size_t StringPreloadedFilterResponse::size() const
   return data.size();
 }
 
+MappedPreloadedFilterResponse::MappedPreloadedFilterResponse(const std::string& path)
+    : MappedPreloadedFilterResponse(DefaultFileSystemSync("").ReadView(path))
+{
+}
+
+MappedPreloadedFilterResponse::MappedPreloadedFilterResponse(IFileSystem::ContentView view)
+    : view(std::move(view))
+{
+}
+
+bool MappedPreloadedFilterResponse::exists() const
+{
+  return view.size != 0;
+}
+
+const char* MappedPreloadedFilterResponse::content() const
+{
+  return view.data ? reinterpret_cast<const char*>(view.data) : "";
+}
+
+size_t MappedPreloadedFilterResponse::size() const
+{
+  return view.size;
+}
+
+void IResourceReader::ReadPrecompiledFilterStorage(const std::string& fileName,
+                                                   const ReadCallback& doneCallback) const
+{
+  doneCallback(std::make_unique<StringPreloadedFilterResponse>());
+}
+
 void DefaultResourceReader::ReadPreloadedFilterList(const std::string& url,
                                                     const ReadCallback& doneCallback) const
 {
@@ -45,19 +45,19 @@ void DefaultSubscriptionImplementation::SetDisabled(bool value)
 
 void DefaultSubscriptionImplementation::UpdateFilters()
 {
-  JsValue func = jsEngine->Evaluate("API.updateSubscription");
+  JsValue func = jsEngine->GetApiFunction("updateSubscription");
   func.Call(jsObject);
 }
 
 bool DefaultSubscriptionImplementation::IsUpdating() const
 {
-  JsValue func = jsEngine->Evaluate("API.isSubscriptionUpdating");
+  JsValue func = jsEngine->GetApiFunction("isSubscriptionUpdating");
   return func.Call(jsObject).AsBool();
 }
 
 bool DefaultSubscriptionImplementation::IsAA() const
 {
-  return jsEngine->Evaluate("API.isAASubscription").Call(jsObject).AsBool();
+  return jsEngine->GetApiFunction("isAASubscription").Call(jsObject).AsBool();
 }
 
 std::string DefaultSubscriptionImplementation::GetTitle() const
@@ -17,9 +17,11 @@
 
 #include "DefaultTimer.h"
 
+#include <algorithm>
+
 using AdblockPlus::DefaultTimer;
 
-DefaultTimer::DefaultTimer() : shouldThreadStop(false)
+DefaultTimer::DefaultTimer() : wakeups(0), shouldThreadStop(false)
 {
   m_thread = std::thread([this] {
     ThreadFunc();
@@ -39,41 +41,106 @@ DefaultTimer::~DefaultTimer()
 
 void DefaultTimer::SetTimer(const std::chrono::milliseconds& timeout,
                             const TimerCallback& timerCallback)
+{
+  AddTimer(timeout, std::chrono::milliseconds(0), timerCallback, TimerHandle());
+}
+
+AdblockPlus::TimerHandle
+DefaultTimer::SetCancellableTimer(const std::chrono::milliseconds& timeout,
+                                  const TimerCallback& timerCallback,
+                                  const std::chrono::milliseconds& tolerance)
+{
+  if (!timerCallback)
+    return TimerHandle();
+  TimerHandle handle = TimerHandle::Create();
+  AddTimer(timeout, tolerance, timerCallback, handle);
+  return handle;
+}
+
+AdblockPlus::ITimer::Stats DefaultTimer::GetStats()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  const size_t pendingTimers = std::count_if(timers.begin(), timers.end(), [](const auto& timer) {
+    return !timer.second.handle.IsCancelled();
+  });
+  return {pendingTimers, wakeups, delay.GetSnapshot(), runTime.GetSnapshot()};
+}
+
+void DefaultTimer::AddTimer(const std::chrono::milliseconds& timeout,
+                            const std::chrono::milliseconds& tolerance,
+                            const TimerCallback& timerCallback,
+                            const TimerHandle& handle)
 {
   if (!timerCallback)
     return;
+  bool isEarliest = false;
   {
     std::lock_guard<std::mutex> lock(mutex);
-    TimerUnit timer = {std::chrono::steady_clock::now() + timeout, timerCallback};
-    timers.push(timer);
+    const TimePoint fireAt = std::chrono::steady_clock::now() + timeout;
+    const TimePoint latestFireAt = fireAt + std::max(tolerance, std::chrono::milliseconds(0));
+    auto timer = timers.emplace(fireAt, TimerUnit{latestFireAt, timerCallback, handle});
+    auto deadline = deadlines.emplace(latestFireAt, timer);
+    isEarliest = deadline == deadlines.begin();
   }
-  conditionVariable.notify_one();
+  // Otherwise the thread wakes up early enough anyway.
+  if (isEarliest)
+    conditionVariable.notify_one();
+}
+
+void DefaultTimer::Erase(TimerUnits::iterator timer)
+{
+  auto range = deadlines.equal_range(timer->second.latestFireAt);
+  for (auto it = range.first; it != range.second; ++it)
+  {
+    if (it->second == timer)
+    {
+      deadlines.erase(it);
+      break;
+    }
+  }
+  timers.erase(timer);
 }
 
 void DefaultTimer::ThreadFunc()
 {
-  while (true)
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!shouldThreadStop)
   {
-    std::unique_lock<std::mutex> lock(mutex);
-    if (timers.empty())
+    // Don't wake up for timers which were cancelled in the meantime.
+    while (!deadlines.empty() && deadlines.begin()->second->second.handle.IsCancelled())
+      Erase(deadlines.begin()->second);
+    if (deadlines.empty())
     {
       conditionVariable.wait(lock, [this]() -> bool {
-        return shouldThreadStop || !timers.empty();
+        return shouldThreadStop || !deadlines.empty();
       });
     }
     else
     {
-      auto fireAt = timers.top().fireAt;
-      conditionVariable.wait_until(lock, fireAt);
+      const TimePoint wakeUpAt = deadlines.begin()->first;
+      conditionVariable.wait_until(lock, wakeUpAt);
     }
     // execute all expired timers and remove them
+    bool woken = false;
     while (!shouldThreadStop && !timers.empty() &&
-           timers.top().fireAt <= std::chrono::steady_clock::now())
+           timers.begin()->first <= std::chrono::steady_clock::now())
     {
-      auto callback = timers.top().callback;
-      timers.pop();
+      auto timer = timers.begin();
+      const TimePoint fireAt = timer->first;
+      TimerCallback callback = std::move(timer->second.callback);
+      TimerHandle handle = std::move(timer->second.handle);
+      Erase(timer);
+      if (!handle.Fire())
+        continue;
+      if (!woken)
+      {
+        woken = true;
+        ++wakeups;
+      }
       // allow to put new timers while this timer is being processed
       lock.unlock();
+      const TimePoint startedAt = std::chrono::steady_clock::now();
+      delay.Record(startedAt - fireAt);
       try
       {
         callback();
@@ -82,9 +149,8 @@ void DefaultTimer::ThreadFunc()
       {
         // do nothing, but the thread will be alive.
       }
+      runTime.Record(std::chrono::steady_clock::now() - startedAt);
       lock.lock();
     }
-    if (shouldThreadStop)
-      return;
   }
 }
@@ -18,44 +18,64 @@
 #pragma once
 
 #include <condition_variable>
+#include <map>
 #include <mutex>
-#include <queue>
 #include <thread>
 
 #include <AdblockPlus/ITimer.h>
 
+#include "LatencyRecorder.h"
+
 namespace AdblockPlus
 {
+  /**
+   * Calls the timer callbacks on its own thread. The thread wakes up at the
+   * latest time which the tolerance of the earliest timer allows and then
+   * calls all the callbacks which are due, so timers close to each other
+   * share a wakeup. Cancelled timers are dropped without waking up for them
+   * unless they are the next to fire.
+   */
   class DefaultTimer : public ITimer
   {
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
     struct TimerUnit
     {
-      std::chrono::steady_clock::time_point fireAt;
+      TimePoint latestFireAt;
       TimerCallback callback;
+      TimerHandle handle;
     };
-    struct TimerUnitComparator
-    {
-      bool operator()(const TimerUnit& t1, const TimerUnit& t2) const
-      {
-        // pay attention 2 < 1 because we need the smallest time at the top.
-        return t2.fireAt < t1.fireAt;
-      }
-    };
-    typedef std::priority_queue<TimerUnit, std::vector<TimerUnit>, TimerUnitComparator> TimerUnits;
+    // By the time the timer is due.
+    typedef std::multimap<TimePoint, TimerUnit> TimerUnits;
+    // By the latest time the timer is allowed to fire.
+    typedef std::multimap<TimePoint, TimerUnits::iterator> Deadlines;
 
   public:
     DefaultTimer();
     ~DefaultTimer();
     void SetTimer(const std::chrono::milliseconds& timeout,
                   const TimerCallback& timerCallback) override;
+    TimerHandle SetCancellableTimer(const std::chrono::milliseconds& timeout,
+                                    const TimerCallback& timerCallback,
+                                    const std::chrono::milliseconds& tolerance) override;
+    Stats GetStats() override;
 
   private:
+    void AddTimer(const std::chrono::milliseconds& timeout,
+                  const std::chrono::milliseconds& tolerance,
+                  const TimerCallback& timerCallback,
+                  const TimerHandle& handle);
+    void Erase(TimerUnits::iterator timer);
     void ThreadFunc();
 
   private:
     std::mutex mutex;
     std::condition_variable conditionVariable;
     TimerUnits timers;
+    Deadlines deadlines;
+    uint64_t wakeups;
+    LatencyRecorder delay;
+    LatencyRecorder runTime;
     bool shouldThreadStop;
     std::thread m_thread;
   };
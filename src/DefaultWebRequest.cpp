@@ -54,16 +54,44 @@ void DefaultWebRequest::GET(const std::string& url,
                             const HeaderList& requestHeaders,
                             const RequestCallback& requestCallback)
 {
-  executor.Dispatch([this, url, requestHeaders, requestCallback] {
-    requestCallback(this->syncImpl->GET(url, requestHeaders));
-  });
+  auto sync = syncImpl;
+  auto cancellation = executor.GetCancellationToken();
+  executor.Dispatch(
+      [sync, cancellation, url, requestHeaders, requestCallback] {
+        const auto response = sync->GET(url, requestHeaders, cancellation);
+        cancellation.Run([&] { requestCallback(response); });
+      },
+      IExecutor::TaskClass::NETWORK);
+}
+
+void DefaultWebRequest::StreamGET(const std::string& url,
+                                  const HeaderList& requestHeaders,
+                                  const DataCallback& dataCallback,
+                                  const RequestCallback& requestCallback)
+{
+  auto sync = syncImpl;
+  auto cancellation = executor.GetCancellationToken();
+  executor.Dispatch(
+      [sync, cancellation, url, requestHeaders, dataCallback, requestCallback] {
+        const auto response =
+            sync->StreamGET(url, requestHeaders, cancellation, [&](const char* data, size_t size) {
+              cancellation.Run([&] { dataCallback(data, size); });
+            });
+        cancellation.Run([&] { requestCallback(response); });
+      },
+      IExecutor::TaskClass::NETWORK);
 }
 
 void DefaultWebRequest::HEAD(const std::string& url,
                              const HeaderList& requestHeaders,
                              const RequestCallback& requestCallback)
 {
-  executor.Dispatch([this, url, requestHeaders, requestCallback] {
-    requestCallback(this->syncImpl->HEAD(url, requestHeaders));
-  });
+  auto sync = syncImpl;
+  auto cancellation = executor.GetCancellationToken();
+  executor.Dispatch(
+      [sync, cancellation, url, requestHeaders, requestCallback] {
+        const auto response = sync->HEAD(url, requestHeaders, cancellation);
+        cancellation.Run([&] { requestCallback(response); });
+      },
+      IExecutor::TaskClass::NETWORK);
 }
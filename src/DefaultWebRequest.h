@@ -31,6 +31,46 @@ namespace AdblockPlus
     virtual ~IWebRequestSync() = default;
     virtual ServerResponse GET(const std::string& url, const HeaderList& requestHeaders) const = 0;
     virtual ServerResponse HEAD(const std::string& url, const HeaderList& requestHeaders) const = 0;
+
+    /**
+     * Same as `GET(url, requestHeaders)`, implementations which can abort a
+     * request should do so once `cancellation` is cancelled, its response is
+     * dropped anyway. The default implementation ignores `cancellation`.
+     */
+    virtual ServerResponse GET(const std::string& url,
+                               const HeaderList& requestHeaders,
+                               const CancellationToken& cancellation) const
+    {
+      return GET(url, requestHeaders);
+    }
+
+    /**
+     * Same as `HEAD(url, requestHeaders)`, see the `GET` overload taking a
+     * `CancellationToken`.
+     */
+    virtual ServerResponse HEAD(const std::string& url,
+                                const HeaderList& requestHeaders,
+                                const CancellationToken& cancellation) const
+    {
+      return HEAD(url, requestHeaders);
+    }
+
+    /**
+     * Same as the `GET` overload taking a `CancellationToken`, but passes the
+     * response body on in pieces, see `IWebRequest::DataCallback`. The
+     * default implementation passes the whole body at once.
+     */
+    virtual ServerResponse StreamGET(const std::string& url,
+                                     const HeaderList& requestHeaders,
+                                     const CancellationToken& cancellation,
+                                     const IWebRequest::DataCallback& dataCallback) const
+    {
+      ServerResponse response = GET(url, requestHeaders, cancellation);
+      if (!response.responseText.empty())
+        dataCallback(response.responseText.data(), response.responseText.size());
+      std::string().swap(response.responseText);
+      return response;
+    }
   };
 
   typedef std::unique_ptr<IWebRequestSync> WebRequestSyncPtr;
@@ -38,12 +78,17 @@ namespace AdblockPlus
   class DefaultWebRequestSync : public IWebRequestSync
   {
   public:
+    using IWebRequestSync::GET;
+    using IWebRequestSync::HEAD;
     ServerResponse GET(const std::string& url, const HeaderList& requestHeaders) const override;
     ServerResponse HEAD(const std::string& url, const HeaderList& requestHeaders) const override;
   };
 
   /**
    * Asynchronous web request, implemented as a wrapper of a synchronous one.
+   * Requests get the cancellation token of the executor and their callbacks
+   * are not called once it is cancelled. A request which is still running
+   * then keeps the synchronous implementation alive on its own.
    */
   class DefaultWebRequest : public IWebRequest
   {
@@ -55,11 +100,16 @@ namespace AdblockPlus
              const HeaderList& requestHeaders,
              const RequestCallback& requestCallback) override;
 
+    void StreamGET(const std::string& url,
+                   const HeaderList& requestHeaders,
+                   const DataCallback& dataCallback,
+                   const RequestCallback& requestCallback) override;
+
     void HEAD(const std::string& url,
               const HeaderList& requestHeaders,
               const RequestCallback& requestCallback) override;
   private:
     IExecutor& executor;
-    WebRequestSyncPtr syncImpl;
+    std::shared_ptr<IWebRequestSync> syncImpl;
   };
 }
@@ -0,0 +1,102 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DeferredRelease.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "MpscQueue.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  typedef MpscQueue<v8::Global<v8::Value>> ReleaseQueue;
+
+  // Handles are pushed with the mutex held, so that none is pushed once
+  // Disable() took the queue out.
+  std::mutex queuesMutex;
+  std::unordered_map<v8::Isolate*, std::shared_ptr<ReleaseQueue>> queues;
+  // Lets Drain() return right away unless an isolate defers releases.
+  std::atomic<size_t> enabledCount(0);
+
+  void ResetAll(ReleaseQueue& queue)
+  {
+    std::vector<v8::Global<v8::Value>> pending;
+    queue.TryPopAll(&pending);
+    for (auto& value : pending)
+      value.Reset();
+  }
+}
+
+// static
+void DeferredRelease::Enable(v8::Isolate* isolate)
+{
+  std::lock_guard<std::mutex> lock(queuesMutex);
+  if (queues.emplace(isolate, std::make_shared<ReleaseQueue>()).second)
+    ++enabledCount;
+}
+
+// static
+void DeferredRelease::Disable(v8::Isolate* isolate)
+{
+  std::shared_ptr<ReleaseQueue> queue;
+  {
+    std::lock_guard<std::mutex> lock(queuesMutex);
+    auto it = queues.find(isolate);
+    if (it == queues.end())
+      return;
+    queue = std::move(it->second);
+    queues.erase(it);
+    --enabledCount;
+  }
+  ResetAll(*queue);
+}
+
+// static
+bool DeferredRelease::Defer(v8::Isolate* isolate, v8::Global<v8::Value>* value)
+{
+  if (enabledCount.load(std::memory_order_relaxed) == 0)
+    return false;
+  std::lock_guard<std::mutex> lock(queuesMutex);
+  auto it = queues.find(isolate);
+  if (it == queues.end())
+    return false;
+  it->second->Push(std::move(*value));
+  return true;
+}
+
+// static
+void DeferredRelease::Drain(v8::Isolate* isolate)
+{
+  if (enabledCount.load(std::memory_order_relaxed) == 0)
+    return;
+  std::shared_ptr<ReleaseQueue> queue;
+  {
+    std::lock_guard<std::mutex> lock(queuesMutex);
+    auto it = queues.find(isolate);
+    if (it == queues.end())
+      return;
+    queue = it->second;
+  }
+  ResetAll(*queue);
+}
@@ -0,0 +1,62 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <v8.h>
+
+namespace AdblockPlus
+{
+  /**
+   * Lets threads which don't hold the lock of an isolate drop their handles
+   * without waiting for it, e.g. a network thread dropping a match result.
+   * The handles are pushed onto a lock-free queue and reset by the next
+   * thread which locks the isolate, see JsContext.
+   *
+   * Isolates which were not passed to Enable() aren't affected.
+   */
+  class DeferredRelease
+  {
+  public:
+    /**
+     * Starts deferring the release of handles of an isolate.
+     * @param isolate Isolate.
+     */
+    static void Enable(v8::Isolate* isolate);
+
+    /**
+     * Stops deferring and resets the pending handles, must be called with
+     * the isolate locked and before it is disposed.
+     * @param isolate Isolate.
+     */
+    static void Disable(v8::Isolate* isolate);
+
+    /**
+     * Takes a handle over if the release is deferred for the isolate.
+     * @param isolate Isolate of the handle.
+     * @param value Handle, left alone if `false` is returned.
+     * @return `false` if the caller has to reset the handle itself.
+     */
+    static bool Defer(v8::Isolate* isolate, v8::Global<v8::Value>* value);
+
+    /**
+     * Resets the pending handles, must be called with the isolate locked.
+     * @param isolate Isolate.
+     */
+    static void Drain(v8::Isolate* isolate);
+  };
+}
@@ -17,6 +17,9 @@
 
 #include "FileSystemJsObject.h"
 
+#include <algorithm>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <vector>
@@ -25,6 +28,8 @@
 #include <AdblockPlus/JsValue.h>
 #include <AdblockPlus/Platform.h>
 
+#include "BinaryStorage.h"
+#include "Compression.h"
 #include "JsContext.h"
 #include "JsError.h"
 #include "Utils.h"
@@ -34,6 +39,21 @@ using AdblockPlus::Utils::ThrowExceptionInJS;
 
 namespace
 {
+  // Passes the error of an operation, if any, to the JS callback.
+  IFileSystem::Callback CompletionCallback(JsEngine* jsEngine,
+                                           const JsEngine::ScopedWeakValues& weakCallbackValue)
+  {
+    return [jsEngine, weakCallbackValue](const std::string& error) {
+      jsEngine->PostCompletion([jsEngine, weakCallbackValue, error] {
+        const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
+        JsValueList params;
+        if (!error.empty())
+          params.push_back(jsEngine->NewValue(error));
+        weakCallbackValue.Values()[0].Call(params);
+      });
+    };
+  }
+
   namespace ReadCallback
   {
     static void V8Callback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
@@ -56,15 +76,21 @@ namespace
       jsEngine->GetFileSystem().Read(
           fileName,
           [jsEngine, resolveWeakCallbackValue](IFileSystem::IOBuffer&& content) {
-            const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
-            auto result = jsEngine->NewObject();
-            result.SetStringBufferProperty("content", content);
-            resolveWeakCallbackValue.Values()[0].Call(result);
+            auto buffer = std::make_shared<IFileSystem::IOBuffer>(std::move(content));
+            jsEngine->PostCompletion([jsEngine, resolveWeakCallbackValue, buffer] {
+              const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
+              auto result = jsEngine->NewObject();
+              result.SetProperty("content", jsEngine->NewExternalValue(std::move(*buffer)));
+              resolveWeakCallbackValue.Values()[0].Call(result);
+            });
           },
           [jsEngine, rejectWeakCallbackValue](const std::string& error) {
-            const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
-            if (!error.empty())
+            if (error.empty())
+              return;
+            jsEngine->PostCompletion([jsEngine, rejectWeakCallbackValue, error] {
+              const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
               rejectWeakCallbackValue.Values()[0].Call(jsEngine->NewValue(error));
+            });
           });
     } // V8Callback
   }   // namespace ReadCallback
@@ -76,30 +102,196 @@ namespace
       return c == 10 || c == 13;
     }
 
-    inline StringBuffer::const_iterator SkipEndOfLine(StringBuffer::const_iterator ii,
-                                                      StringBuffer::const_iterator end)
+    inline const char* SkipEndOfLine(const char* ii, const char* end)
     {
       while (ii != end && IsEndOfLine(*ii))
         ++ii;
       return ii;
     }
 
-    inline StringBuffer::const_iterator AdvanceToEndOfLine(StringBuffer::const_iterator ii,
-                                                           StringBuffer::const_iterator end)
+    inline const char* AdvanceToEndOfLine(const char* ii, const char* end)
     {
       while (ii != end && !IsEndOfLine(*ii))
         ++ii;
       return ii;
     }
 
+    // Non-empty lines of a file in any of the formats written by the filter
+    // storage. Text is scanned in place, compressed text is split into lines
+    // while it is being decompressed.
+    class LineSource
+    {
+    public:
+      explicit LineSource(const IFileSystem::ContentView& content)
+          : chunkBegin(reinterpret_cast<const char*>(content.data)),
+            chunkEnd(chunkBegin + content.size)
+      {
+        const uint8_t* data = content.data;
+        size_t size = content.size;
+        if (Compression::IsCompressed(data, size))
+        {
+          inflater.reset(new Compression::Inflater(data, size));
+          chunkBegin = chunkEnd = nullptr;
+          // The binary format needs all of the content.
+          if (NextChunk() &&
+              BinaryStorage::IsBinaryStorage(reinterpret_cast<const uint8_t*>(chunkBegin),
+                                             chunkEnd - chunkBegin))
+          {
+            do
+              decompressed.insert(decompressed.end(), chunkBegin, chunkEnd);
+            while (NextChunk());
+            data = decompressed.data();
+            size = decompressed.size();
+          }
+        }
+        if (BinaryStorage::IsBinaryStorage(data, size))
+          reader.reset(new BinaryStorage::Reader(data, size));
+      }
+
+      std::string GetError() const
+      {
+        if (inflater && !inflater->IsValid())
+        {
+          return Compression::IsSupported()
+                     ? "Corrupt compressed filter storage"
+                     : "Compressed filter storage is not supported by this build";
+        }
+        if (reader && !reader->IsValid())
+          return "Corrupt binary filter storage";
+        return "";
+      }
+
+      // The line remains valid until the next call.
+      bool Next(const char** line, size_t* length)
+      {
+        if (reader)
+          return reader->ReadLine(line, length);
+
+        partialLine.clear();
+        while (true)
+        {
+          if (partialLine.empty())
+            chunkBegin = SkipEndOfLine(chunkBegin, chunkEnd);
+          if (chunkBegin == chunkEnd)
+          {
+            if (NextChunk())
+              continue;
+            *line = partialLine.data();
+            *length = partialLine.size();
+            return !partialLine.empty();
+          }
+
+          auto lineEnd = AdvanceToEndOfLine(chunkBegin, chunkEnd);
+          if (lineEnd == chunkEnd && inflater)
+          {
+            // The line continues in the next chunk.
+            partialLine.append(chunkBegin, lineEnd);
+            chunkBegin = lineEnd;
+            continue;
+          }
+          if (partialLine.empty())
+          {
+            *line = chunkBegin;
+            *length = lineEnd - chunkBegin;
+          }
+          else
+          {
+            partialLine.append(chunkBegin, lineEnd);
+            *line = partialLine.data();
+            *length = partialLine.size();
+          }
+          chunkBegin = lineEnd;
+          return true;
+        }
+      }
+
+    private:
+      bool NextChunk()
+      {
+        const uint8_t* chunk = nullptr;
+        size_t size = 0;
+        if (!inflater || !inflater->Read(&chunk, &size))
+          return false;
+        chunkBegin = reinterpret_cast<const char*>(chunk);
+        chunkEnd = chunkBegin + size;
+        return true;
+      }
+
+      const char* chunkBegin;
+      const char* chunkEnd;
+      std::unique_ptr<Compression::Inflater> inflater;
+      IFileSystem::IOBuffer decompressed;
+      std::unique_ptr<BinaryStorage::Reader> reader;
+      std::string partialLine;
+    };
+
+    // Takes the filters of disabled subscriptions out of the lines of the
+    // filter storage, they are kept as one string per subscription instead.
+    class DisabledFiltersDeferrer
+    {
+    public:
+      DisabledFiltersDeferrer() : inSubscription(false), disabled(false), current(nullptr)
+      {
+      }
+
+      // Returns `false` if the line was deferred.
+      bool Pass(const char* line, size_t length)
+      {
+        // Filters starting with `[` are escaped, so this is a section header.
+        if (length > 0 && line[0] == '[')
+        {
+          const std::string header(line, length);
+          const bool defer =
+              inSubscription && disabled && !url.empty() && header == "[Subscription filters]";
+          inSubscription = header == "[Subscription]";
+          if (inSubscription)
+          {
+            url.clear();
+            disabled = false;
+          }
+          current = defer ? &deferred[url] : nullptr;
+          return !defer;
+        }
+        if (current)
+        {
+          current->append(line, length);
+          current->push_back('\n');
+          return false;
+        }
+        if (inSubscription)
+        {
+          const std::string keyValue(line, length);
+          if (keyValue.compare(0, 4, "url=") == 0)
+            url = keyValue.substr(4);
+          else if (keyValue == "disabled=true")
+            disabled = true;
+        }
+        return true;
+      }
+
+      // Filter lines by subscription URL, separated by line breaks.
+      std::map<std::string, std::string>& GetDeferred()
+      {
+        return deferred;
+      }
+
+    private:
+      bool inSubscription;
+      bool disabled;
+      std::string url;
+      std::string* current;
+      std::map<std::string, std::string> deferred;
+    };
+
     void V8Callback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
     {
       AdblockPlus::JsEngine* jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
       AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
 
       v8::Isolate* isolate = arguments.GetIsolate();
-      if (converted.size() != 4)
-        return ThrowExceptionInJS(isolate, "_fileSystem.readFromFile requires 4 parameters");
+      if (converted.size() < 4 || converted.size() > 6)
+        return ThrowExceptionInJS(isolate,
+                                  "_fileSystem.readFromFile requires 4 to 6 parameters");
       if (!converted[1].IsFunction())
         return ThrowExceptionInJS(
             isolate,
@@ -112,15 +304,36 @@ namespace
         return ThrowExceptionInJS(
             isolate,
             "Third argument to _fileSystem.readFromFile must be a function (error callback)");
+      // With a batch size the listener gets arrays of up to that many lines,
+      // which saves most of the calls into JS for large files.
+      size_t batchSize = 0;
+      if (converted.size() >= 5)
+      {
+        if (!converted[4].IsNumber() || converted[4].AsInt() <= 0)
+          return ThrowExceptionInJS(
+              isolate,
+              "Fifth argument to _fileSystem.readFromFile must be a positive number (batch size)");
+        batchSize = static_cast<size_t>(converted[4].AsInt());
+      }
+      // With the sixth argument set, the filters of disabled subscriptions
+      // are not passed to the listener, the done callback gets them as an
+      // object mapping subscription URLs to their filter lines.
+      const bool deferDisabled = converted.size() == 6 && converted[5].AsBool();
 
       JsEngine::ScopedWeakValues listenerWeakCallbackValue(jsEngine, {converted[1]});
       JsEngine::ScopedWeakValues resolveWeakCallbackValue(jsEngine, {converted[2]});
       JsEngine::ScopedWeakValues rejectWeakCallbackValue(jsEngine, {converted[3]});
       auto fileName = converted[0].AsString();
-      jsEngine->GetFileSystem().Read(
+      // Filter lists are large, so they are scanned in place instead of
+      // being copied into a buffer and then once more line by line.
+      jsEngine->GetFileSystem().ReadView(
           fileName,
-          [jsEngine, listenerWeakCallbackValue, resolveWeakCallbackValue](
-              IFileSystem::IOBuffer&& content) {
+          [jsEngine,
+           batchSize,
+           deferDisabled,
+           listenerWeakCallbackValue,
+           resolveWeakCallbackValue,
+           rejectWeakCallbackValue](const IFileSystem::ContentView& content) {
             const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
             auto processFunc =
                 listenerWeakCallbackValue.Values()[0].UnwrapValue().As<v8::Function>();
@@ -130,30 +343,79 @@ namespace
 
             auto isolate = jsEngine->GetIsolate();
             const v8::TryCatch tryCatch(isolate);
-            const auto contentEnd = content.cend();
-            auto stringBegin = SkipEndOfLine(content.begin(), contentEnd);
-            auto v8Context = isolate->GetCurrentContext();
-            do
+            // Files written with the binary or compressed filter storage
+            // enabled are read back the same way as text files, the listener
+            // sees no difference.
+            LineSource source(content);
+            if (!source.GetError().empty())
             {
-              auto stringEnd = AdvanceToEndOfLine(stringBegin, contentEnd);
-              auto jsLine =
-                  CHECKED_TO_LOCAL_WITH_TRY_CATCH(
-                      isolate,
-                      Utils::StringBufferToV8String(isolate, StringBuffer(stringBegin, stringEnd)),
-                      tryCatch)
-                      .As<v8::Value>();
+              rejectWeakCallbackValue.Values()[0].Call(jsEngine->NewValue(source.GetError()));
+              return;
+            }
 
+            auto v8Context = isolate->GetCurrentContext();
+            const size_t linesPerCall = std::max<size_t>(batchSize, 1);
+            std::vector<v8::Local<v8::Value>> lines;
+            lines.reserve(linesPerCall);
+            const char* line = "";
+            size_t lineLength = 0;
+            std::unique_ptr<DisabledFiltersDeferrer> deferrer;
+            if (deferDisabled)
+              deferrer.reset(new DisabledFiltersDeferrer());
+            auto nextLine = [&source, &deferrer, &line, &lineLength] {
+              while (source.Next(&line, &lineLength))
+              {
+                if (!deferrer || deferrer->Pass(line, lineLength))
+                  return true;
+              }
+              return false;
+            };
+            bool hasLine = nextLine();
+            // An empty file is passed on as a single empty line.
+            if (!hasLine && source.GetError().empty())
+              hasLine = true;
+            while (hasLine)
+            {
+              // Handles of the lines passed to JS are released batch by batch.
+              const v8::HandleScope batchScope(isolate);
+              lines.clear();
+              do
+              {
+                auto lineBegin = reinterpret_cast<const uint8_t*>(line);
+                lines.push_back(CHECKED_TO_LOCAL_WITH_TRY_CATCH(
+                                    isolate,
+                                    Utils::StringBufferToV8String(isolate, lineBegin, lineLength),
+                                    tryCatch)
+                                    .As<v8::Value>());
+                hasLine = nextLine();
+              } while (hasLine && lines.size() < linesPerCall);
+
+              auto argument =
+                  batchSize ? v8::Array::New(isolate, lines.data(), lines.size()).As<v8::Value>()
+                            : lines[0];
               CHECKED_TO_LOCAL_WITH_TRY_CATCH(
-                  isolate, processFunc->Call(v8Context, globalContext, 1, &jsLine), tryCatch);
-
-              stringBegin = SkipEndOfLine(stringEnd, contentEnd);
-            } while (stringBegin != contentEnd);
-            resolveWeakCallbackValue.Values()[0].Call();
+                  isolate, processFunc->Call(v8Context, globalContext, 1, &argument), tryCatch);
+            }
+            if (!source.GetError().empty())
+              rejectWeakCallbackValue.Values()[0].Call(jsEngine->NewValue(source.GetError()));
+            else if (deferrer)
+            {
+              auto deferred = jsEngine->NewObject();
+              for (auto& filters : deferrer->GetDeferred())
+                deferred.SetProperty(filters.first,
+                                     jsEngine->NewExternalValue(std::move(filters.second)));
+              resolveWeakCallbackValue.Values()[0].Call(deferred);
+            }
+            else
+              resolveWeakCallbackValue.Values()[0].Call();
           },
           [jsEngine, rejectWeakCallbackValue](const std::string& error) {
-            const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
-            if (!error.empty())
+            if (error.empty())
+              return;
+            jsEngine->PostCompletion([jsEngine, rejectWeakCallbackValue, error] {
+              const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
               rejectWeakCallbackValue.Values()[0].Call(jsEngine->NewValue(error));
+            });
           });
     } // V8Callback
   }   // namespace ReadFromFileCallback
@@ -173,13 +435,72 @@ namespace
     auto content = converted[1].AsStringBuffer();
     auto fileName = converted[0].AsString();
     jsEngine->GetFileSystem().Write(
-        fileName, content, [jsEngine, weakCallbackValue](const std::string& error) {
-          const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
-          JsValueList params;
-          if (!error.empty())
-            params.push_back(jsEngine->NewValue(error));
-          weakCallbackValue.Values()[0].Call(params);
-        });
+        fileName, content, CompletionCallback(jsEngine, weakCallbackValue));
+  }
+
+  void OpenWriterCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  {
+    AdblockPlus::JsEngine* jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
+    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
+
+    v8::Isolate* isolate = arguments.GetIsolate();
+    if (converted.size() < 1 || converted.size() > 3)
+      return ThrowExceptionInJS(isolate, "_fileSystem.openWriter requires 1 to 3 parameters");
+
+    auto writer = jsEngine->GetFileSystem().OpenWriter(converted[0].AsString());
+    // The optional parameters request the binary storage format and gzip
+    // compression of the file, the latter is ignored without zlib.
+    if (converted.size() == 3 && converted[2].AsBool() && Compression::IsSupported())
+      writer = Compression::CreateWriter(std::move(writer));
+    if (converted.size() >= 2 && converted[1].AsBool())
+      writer = BinaryStorage::CreateWriter(std::move(writer));
+    const uint32_t writerID = jsEngine->StoreFileWriter(std::move(writer));
+    arguments.GetReturnValue().Set(writerID);
+  }
+
+  void AppendToWriterCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  {
+    AdblockPlus::JsEngine* jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
+    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
+
+    v8::Isolate* isolate = arguments.GetIsolate();
+    if (converted.size() != 2)
+      return ThrowExceptionInJS(isolate, "_fileSystem.appendToWriter requires 2 parameters");
+    auto writer = jsEngine->GetFileWriter(static_cast<uint32_t>(converted[0].AsInt()));
+    if (!writer)
+      return ThrowExceptionInJS(isolate, "_fileSystem.appendToWriter requires an open writer");
+
+    writer->Append(converted[1].AsStringBuffer());
+  }
+
+  void CommitWriterCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  {
+    AdblockPlus::JsEngine* jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
+    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
+
+    v8::Isolate* isolate = arguments.GetIsolate();
+    if (converted.size() != 2)
+      return ThrowExceptionInJS(isolate, "_fileSystem.commitWriter requires 2 parameters");
+    if (!converted[1].IsFunction())
+      return ThrowExceptionInJS(isolate,
+                                "Second argument to _fileSystem.commitWriter must be a function");
+    auto writer = jsEngine->TakeFileWriter(static_cast<uint32_t>(converted[0].AsInt()));
+    if (!writer)
+      return ThrowExceptionInJS(isolate, "_fileSystem.commitWriter requires an open writer");
+
+    JsEngine::ScopedWeakValues weakCallbackValue(jsEngine, {converted[1]});
+    writer->Commit(CompletionCallback(jsEngine, weakCallbackValue));
+  }
+
+  void AbortWriterCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  {
+    AdblockPlus::JsEngine* jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
+    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
+
+    v8::Isolate* isolate = arguments.GetIsolate();
+    if (converted.size() != 1)
+      return ThrowExceptionInJS(isolate, "_fileSystem.abortWriter requires 1 parameter");
+    jsEngine->TakeFileWriter(static_cast<uint32_t>(converted[0].AsInt()));
   }
 
   void MoveCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
@@ -196,14 +517,24 @@ namespace
     JsEngine::ScopedWeakValues weakCallbackValue(jsEngine, {converted[2]});
     auto from = converted[0].AsString();
     auto to = converted[1].AsString();
-    jsEngine->GetFileSystem().Move(
-        from, to, [jsEngine, weakCallbackValue](const std::string& error) {
-          const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
-          JsValueList params;
-          if (!error.empty())
-            params.push_back(jsEngine->NewValue(error));
-          weakCallbackValue.Values()[0].Call(params);
-        });
+    jsEngine->GetFileSystem().Move(from, to, CompletionCallback(jsEngine, weakCallbackValue));
+  }
+
+  void CopyCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  {
+    AdblockPlus::JsEngine* jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
+    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
+
+    v8::Isolate* isolate = arguments.GetIsolate();
+    if (converted.size() != 3)
+      return ThrowExceptionInJS(isolate, "_fileSystem.copy requires 3 parameters");
+    if (!converted[2].IsFunction())
+      return ThrowExceptionInJS(isolate, "Third argument to _fileSystem.copy must be a function");
+
+    JsEngine::ScopedWeakValues weakCallbackValue(jsEngine, {converted[2]});
+    auto from = converted[0].AsString();
+    auto to = converted[1].AsString();
+    jsEngine->GetFileSystem().Copy(from, to, CompletionCallback(jsEngine, weakCallbackValue));
   }
 
   void RemoveCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
@@ -220,14 +551,7 @@ namespace
 
     JsEngine::ScopedWeakValues weakCallbackValue(jsEngine, {converted[1]});
     auto fileName = converted[0].AsString();
-    jsEngine->GetFileSystem().Remove(
-        fileName, [jsEngine, weakCallbackValue](const std::string& error) {
-          const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
-          JsValueList params;
-          if (!error.empty())
-            params.push_back(jsEngine->NewValue(error));
-          weakCallbackValue.Values()[0].Call(params);
-        });
+    jsEngine->GetFileSystem().Remove(fileName, CompletionCallback(jsEngine, weakCallbackValue));
   }
 
   void StatCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
@@ -247,17 +571,59 @@ namespace
         fileName,
         [jsEngine, weakCallbackValue](const IFileSystem::StatResult& statResult,
                                       const std::string& error) {
-          const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
-          auto result = jsEngine->NewObject();
+          jsEngine->PostCompletion([jsEngine, weakCallbackValue, statResult, error] {
+            const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
+            auto result = jsEngine->NewObject();
+
+            result.SetProperty("exists", statResult.exists);
+            result.SetProperty("lastModified", statResult.lastModified);
+            if (!error.empty())
+              result.SetProperty("error", error);
 
-          result.SetProperty("exists", statResult.exists);
-          result.SetProperty("lastModified", statResult.lastModified);
-          if (!error.empty())
-            result.SetProperty("error", error);
+            JsValueList params;
+            params.push_back(result);
+            weakCallbackValue.Values()[0].Call(params);
+          });
+        });
+  }
 
-          JsValueList params;
-          params.push_back(result);
-          weakCallbackValue.Values()[0].Call(params);
+  void StatManyCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  {
+    AdblockPlus::JsEngine* jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
+    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
+
+    v8::Isolate* isolate = arguments.GetIsolate();
+    if (converted.size() != 2)
+      return ThrowExceptionInJS(isolate, "_fileSystem.statMany requires 2 parameters");
+    if (!converted[0].IsArray())
+      return ThrowExceptionInJS(isolate,
+                                "First argument to _fileSystem.statMany must be an array");
+    if (!converted[1].IsFunction())
+      return ThrowExceptionInJS(isolate,
+                                "Second argument to _fileSystem.statMany must be a function");
+
+    JsEngine::ScopedWeakValues weakCallbackValue(jsEngine, {converted[1]});
+    std::vector<std::string> fileNames;
+    for (const auto& fileName : converted[0].AsList())
+      fileNames.push_back(fileName.AsString());
+    jsEngine->GetFileSystem().StatMany(
+        fileNames,
+        [jsEngine, weakCallbackValue](const std::vector<IFileSystem::StatResult>& statResults,
+                                      const std::vector<std::string>& errors) {
+          jsEngine->PostCompletion([jsEngine, weakCallbackValue, statResults, errors] {
+            const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
+            JsValueList results;
+            for (size_t i = 0; i < statResults.size(); i++)
+            {
+              auto result = jsEngine->NewObject();
+              result.SetProperty("exists", statResults[i].exists);
+              result.SetProperty("lastModified", statResults[i].lastModified);
+              if (!errors[i].empty())
+                result.SetProperty("error", errors[i]);
+              results.push_back(result);
+            }
+            weakCallbackValue.Values()[0].Call(jsEngine->NewValueArray(results));
+          });
         });
   }
 }
@@ -267,8 +633,14 @@ JsValue& FileSystemJsObject::Setup(JsEngine& jsEngine, JsValue& obj)
   obj.SetProperty("read", jsEngine.NewCallback(::ReadCallback::V8Callback));
   obj.SetProperty("readFromFile", jsEngine.NewCallback(::ReadFromFileCallback::V8Callback));
   obj.SetProperty("write", jsEngine.NewCallback(::WriteCallback));
+  obj.SetProperty("openWriter", jsEngine.NewCallback(::OpenWriterCallback));
+  obj.SetProperty("appendToWriter", jsEngine.NewCallback(::AppendToWriterCallback));
+  obj.SetProperty("commitWriter", jsEngine.NewCallback(::CommitWriterCallback));
+  obj.SetProperty("abortWriter", jsEngine.NewCallback(::AbortWriterCallback));
   obj.SetProperty("move", jsEngine.NewCallback(::MoveCallback));
+  obj.SetProperty("copy", jsEngine.NewCallback(::CopyCallback));
   obj.SetProperty("remove", jsEngine.NewCallback(::RemoveCallback));
   obj.SetProperty("stat", jsEngine.NewCallback(::StatCallback));
+  obj.SetProperty("statMany", jsEngine.NewCallback(::StatManyCallback));
   return obj;
 }
@@ -52,6 +52,11 @@ bool Filter::operator==(const Filter& filter) const
   return *(implementation) == *filter.implementation;
 }
 
+size_t Filter::GetHash() const
+{
+  return implementation ? implementation->GetHash() : 0;
+}
+
 Filter& Filter::operator=(const Filter& filter)
 {
   if (filter.implementation)
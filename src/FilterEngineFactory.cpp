@@ -110,8 +110,8 @@ void FilterEngineFactory::CreateAsync(JsEngine& jsEngine,
   // STL doesn't like that. This is just a workaround, the function in
   // question retrieves the unique_ptr from within and keeps using that
   // or the reminder of the stack.
-  auto wrappedFilterEngine =
-      std::make_shared<std::unique_ptr<DefaultFilterEngine>>(new DefaultFilterEngine(jsEngine));
+  auto wrappedFilterEngine = std::make_shared<std::unique_ptr<DefaultFilterEngine>>(
+      new DefaultFilterEngine(jsEngine, params));
   auto* bareFilterEngine = wrappedFilterEngine->get();
   {
     auto isSubscriptionDownloadAllowedCallback = params.isSubscriptionDownloadAllowedCallback;
@@ -146,6 +146,7 @@ void FilterEngineFactory::CreateAsync(JsEngine& jsEngine,
 
   jsEngine.SetEventCallback("_init",
                             [&jsEngine, wrappedFilterEngine, onCreated](JsValueList&& params) {
+                              jsEngine.ResolveApiFunctions();
                               auto uniqueFilterEngine = std::move(*wrappedFilterEngine);
                               onCreated(std::move(uniqueFilterEngine));
                               jsEngine.RemoveEventCallback("_init");
@@ -168,6 +169,14 @@ void FilterEngineFactory::CreateAsync(JsEngine& jsEngine,
     preconfiguredPrefsObject.SetProperty(PrefNameToString(pref.first), pref.second);
   }
   jsEngine.SetGlobalProperty("_preconfiguredPrefs", preconfiguredPrefsObject);
+  jsEngine.SetGlobalProperty("_binaryFilterStorage", jsEngine.NewValue(params.binaryFilterStorage));
+  jsEngine.SetGlobalProperty("_compressFilterStorage",
+                             jsEngine.NewValue(params.compressFilterStorage));
+  jsEngine.SetGlobalProperty("_lazyDisabledSubscriptions",
+                             jsEngine.NewValue(params.lazyDisabledSubscriptions));
+  jsEngine.SetGlobalProperty("_compactStyleSheets", jsEngine.NewValue(params.compactStyleSheets));
+  const int64_t prefsSaveDelay = params.prefsSaveDelay.count();
+  jsEngine.SetGlobalProperty("_prefsSaveDelay", jsEngine.NewValue(prefsSaveDelay));
 
   const auto& jsFiles = Utils::SplitString(ABP_SCRIPT_FILES, ' ');
   // Load adblockplus scripts
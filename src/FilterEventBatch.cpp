@@ -0,0 +1,94 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "FilterEventBatch.h"
+
+#include "JsContext.h"
+#include "JsEngine.h"
+
+using namespace AdblockPlus;
+
+FilterEventBatch::FilterEventBatch(JsEngine& jsEngine,
+                                   EventObserver* observer,
+                                   std::chrono::milliseconds window)
+    : jsEngine_(jsEngine), observer_(observer), window_(window)
+{
+}
+
+void FilterEventBatch::Add(FilterEvent event, const Filter& filter)
+{
+  if (!observer_)
+    return;
+  if (runs_.empty() || runs_.back().filters.empty() || runs_.back().filterEvent != event)
+  {
+    runs_.emplace_back();
+    runs_.back().filterEvent = event;
+  }
+  runs_.back().filters.push_back(filter);
+  Schedule();
+}
+
+void FilterEventBatch::Add(SubscriptionEvent event, const Subscription& subscription)
+{
+  if (!observer_)
+    return;
+  if (runs_.empty() || runs_.back().subscriptions.empty() ||
+      runs_.back().subscriptionEvent != event)
+  {
+    runs_.emplace_back();
+    runs_.back().subscriptionEvent = event;
+  }
+  runs_.back().subscriptions.push_back(subscription);
+  Schedule();
+}
+
+void FilterEventBatch::Discard()
+{
+  observer_ = nullptr;
+  runs_.clear();
+}
+
+void FilterEventBatch::Schedule()
+{
+  if (scheduled_)
+    return;
+  scheduled_ = true;
+  std::weak_ptr<FilterEventBatch> weakSelf = shared_from_this();
+  jsEngine_.GetTimer().SetTimer(window_, [weakSelf]() {
+    if (auto self = weakSelf.lock())
+      self->Deliver();
+  });
+}
+
+void FilterEventBatch::Deliver()
+{
+  const JsContext context(jsEngine_.GetIsolate(), *jsEngine_.GetContext());
+  scheduled_ = false;
+  std::vector<Run> runs;
+  runs.swap(runs_);
+  for (const auto& run : runs)
+  {
+    // The observer may remove itself meanwhile.
+    if (!observer_)
+      return;
+    if (!run.filters.empty())
+      observer_->OnFilterEvents(run.filterEvent, run.filters);
+    else
+      observer_->OnSubscriptionEvents(run.subscriptionEvent, run.subscriptions);
+  }
+}
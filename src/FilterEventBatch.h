@@ -0,0 +1,86 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <AdblockPlus/IFilterEngine.h>
+
+namespace AdblockPlus
+{
+  class JsEngine;
+
+  /**
+   * Collects the events for an observer which gets them in batches, see
+   * IFilterEngine::EventObserver::IsBatching().
+   *
+   * Consecutive events of the same type are merged into one call, events
+   * are delivered in the order they occurred once `window` has passed since
+   * the first pending one, or after the current JS task for a zero window.
+   *
+   * The methods have to be called with the engine locked, deliveries take
+   * the engine lock too. Instances have to be owned by a `std::shared_ptr`.
+   */
+  class FilterEventBatch : public std::enable_shared_from_this<FilterEventBatch>
+  {
+  public:
+    typedef IFilterEngine::EventObserver EventObserver;
+    typedef IFilterEngine::FilterEvent FilterEvent;
+    typedef IFilterEngine::SubscriptionEvent SubscriptionEvent;
+
+    /**
+     * @param jsEngine Engine whose timer schedules the deliveries.
+     * @param observer Observer receiving the events.
+     * @param window Time to collect events for.
+     */
+    FilterEventBatch(JsEngine& jsEngine,
+                     EventObserver* observer,
+                     std::chrono::milliseconds window);
+
+    void Add(FilterEvent event, const Filter& filter);
+    void Add(SubscriptionEvent event, const Subscription& subscription);
+
+    /**
+     * Drops pending events, nothing is delivered afterwards.
+     */
+    void Discard();
+
+  private:
+    // Run of events of the same type, either filters or subscriptions are
+    // set.
+    struct Run
+    {
+      FilterEvent filterEvent;
+      SubscriptionEvent subscriptionEvent;
+      std::vector<Filter> filters;
+      std::vector<Subscription> subscriptions;
+    };
+
+    void Schedule();
+    void Deliver();
+
+    JsEngine& jsEngine_;
+    EventObserver* observer_;
+    const std::chrono::milliseconds window_;
+    std::vector<Run> runs_;
+    bool scheduled_ = false;
+  };
+}
@@ -0,0 +1,146 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FilterSubscriptionIndex.h"
+
+#include <algorithm>
+
+using namespace AdblockPlus;
+
+void FilterSubscriptionIndex::SetFilters(const std::string& url,
+                                         const std::vector<std::string>& filters)
+{
+  const SubscriptionId id = GetOrCreate(url);
+  auto& entry = subscriptions_[id];
+  for (const auto* filter : entry.filters)
+    Unlink(id, *filter);
+  entry.filters.clear();
+  entry.filters.reserve(filters.size());
+  for (const auto& filter : filters)
+    Link(id, filter);
+}
+
+void FilterSubscriptionIndex::AddFilter(const std::string& url, const std::string& filter)
+{
+  Link(GetOrCreate(url), filter);
+}
+
+void FilterSubscriptionIndex::RemoveFilter(const std::string& url, const std::string& filter)
+{
+  auto id = ids_.find(url);
+  auto it = byFilter_.find(filter);
+  if (id == ids_.end() || it == byFilter_.end())
+    return;
+  auto& filters = subscriptions_[id->second].filters;
+  auto position = std::find(filters.begin(), filters.end(), &it->first);
+  if (position == filters.end())
+    return;
+  filters.erase(position);
+  Unlink(id->second, filter);
+}
+
+void FilterSubscriptionIndex::RemoveSubscription(const std::string& url)
+{
+  auto id = ids_.find(url);
+  if (id == ids_.end())
+    return;
+  auto entry = subscriptions_.find(id->second);
+  for (const auto* filter : entry->second.filters)
+    Unlink(id->second, *filter);
+  subscriptions_.erase(entry);
+  ids_.erase(id);
+}
+
+void FilterSubscriptionIndex::Clear()
+{
+  ids_.clear();
+  subscriptions_.clear();
+  byFilter_.clear();
+}
+
+std::vector<std::string> FilterSubscriptionIndex::Find(const std::string& filter) const
+{
+  std::vector<std::string> urls;
+  auto it = byFilter_.find(filter);
+  if (it == byFilter_.end())
+    return urls;
+  urls.reserve(it->second.size());
+  for (SubscriptionId id : it->second)
+    urls.push_back(subscriptions_.at(id).url);
+  return urls;
+}
+
+size_t FilterSubscriptionIndex::GetSubscriptionCount(const std::string& filter) const
+{
+  auto it = byFilter_.find(filter);
+  return it != byFilter_.end() ? it->second.size() : 0;
+}
+
+void FilterSubscriptionIndex::VisitSubscriptions(const SubscriptionVisitor& visitor) const
+{
+  std::vector<SubscriptionId> ids;
+  ids.reserve(subscriptions_.size());
+  for (const auto& subscription : subscriptions_)
+    ids.push_back(subscription.first);
+  std::sort(ids.begin(), ids.end());
+  for (SubscriptionId id : ids)
+  {
+    const auto& entry = subscriptions_.at(id);
+    visitor(entry.url, entry.filters);
+  }
+}
+
+void FilterSubscriptionIndex::VisitSharedFilters(const SharedFilterVisitor& visitor) const
+{
+  for (const auto& filter : byFilter_)
+  {
+    if (filter.second.size() > 1)
+      visitor(filter.first, filter.second.size());
+  }
+}
+
+FilterSubscriptionIndex::SubscriptionId FilterSubscriptionIndex::GetOrCreate(const std::string& url)
+{
+  auto inserted = ids_.emplace(url, nextId_);
+  if (inserted.second)
+    subscriptions_[nextId_++].url = url;
+  return inserted.first->second;
+}
+
+void FilterSubscriptionIndex::Link(SubscriptionId id, const std::string& filter)
+{
+  auto it = byFilter_.emplace(filter, std::vector<SubscriptionId>()).first;
+  auto& ids = it->second;
+  auto position = std::lower_bound(ids.begin(), ids.end(), id);
+  if (position != ids.end() && *position == id)
+    return;
+  ids.insert(position, id);
+  subscriptions_[id].filters.push_back(&it->first);
+}
+
+void FilterSubscriptionIndex::Unlink(SubscriptionId id, const std::string& filter)
+{
+  auto it = byFilter_.find(filter);
+  if (it == byFilter_.end())
+    return;
+  auto& ids = it->second;
+  auto position = std::lower_bound(ids.begin(), ids.end(), id);
+  if (position != ids.end() && *position == id)
+    ids.erase(position);
+  if (ids.empty())
+    byFilter_.erase(it);
+}
@@ -0,0 +1,136 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace AdblockPlus
+{
+  /**
+   * Subscriptions by the text of the filters they contain, the reverse of
+   * what the filter storage keeps. Lookups return the subscriptions in the
+   * order in which they were set, which is the order of the filter storage
+   * as long as new subscriptions are set after the existing ones.
+   *
+   * The class is not thread safe, the owner is responsible for locking.
+   */
+  class FilterSubscriptionIndex
+  {
+  public:
+    typedef std::function<void(const std::string& url,
+                               const std::vector<const std::string*>& filters)>
+        SubscriptionVisitor;
+    typedef std::function<void(const std::string& filter, size_t subscriptionCount)>
+        SharedFilterVisitor;
+
+    FilterSubscriptionIndex() = default;
+    FilterSubscriptionIndex(FilterSubscriptionIndex&&) = default;
+    FilterSubscriptionIndex& operator=(FilterSubscriptionIndex&&) = default;
+    // Entries point into the map of filters.
+    FilterSubscriptionIndex(const FilterSubscriptionIndex&) = delete;
+    FilterSubscriptionIndex& operator=(const FilterSubscriptionIndex&) = delete;
+
+    /**
+     * Replaces the filters of a subscription, a new subscription goes after
+     * all the others.
+     * @param url Subscription URL.
+     * @param filters Texts of all the filters of the subscription.
+     */
+    void SetFilters(const std::string& url, const std::vector<std::string>& filters);
+
+    /**
+     * Adds a filter to a subscription, the subscription is created if it
+     * doesn't exist yet. Adding a filter twice is a no-op.
+     * @param url Subscription URL.
+     * @param filter Filter text.
+     */
+    void AddFilter(const std::string& url, const std::string& filter);
+
+    /**
+     * Removes a filter from a subscription.
+     * @param url Subscription URL.
+     * @param filter Filter text.
+     */
+    void RemoveFilter(const std::string& url, const std::string& filter);
+
+    /**
+     * Removes a subscription along with its filters.
+     * @param url Subscription URL.
+     */
+    void RemoveSubscription(const std::string& url);
+
+    /**
+     * Removes all subscriptions.
+     */
+    void Clear();
+
+    /**
+     * @param filter Filter text.
+     * @return URLs of the subscriptions which contain the filter.
+     */
+    std::vector<std::string> Find(const std::string& filter) const;
+
+    /**
+     * @param filter Filter text.
+     * @return Number of subscriptions which contain the filter.
+     */
+    size_t GetSubscriptionCount(const std::string& filter) const;
+
+    /**
+     * Calls `visitor` for every subscription, in the order of Find().
+     * @param visitor Receives the URL and the filter texts of a
+     *        subscription, which are only valid during the call.
+     */
+    void VisitSubscriptions(const SubscriptionVisitor& visitor) const;
+
+    /**
+     * Calls `visitor` for every filter which is in more than one
+     * subscription, in no particular order. The index keeps the text of
+     * these filters only once, like for all the others.
+     * @param visitor Receives the filter text and the number of
+     *        subscriptions containing it.
+     */
+    void VisitSharedFilters(const SharedFilterVisitor& visitor) const;
+
+  private:
+    typedef uint32_t SubscriptionId;
+
+    struct SubscriptionEntry
+    {
+      std::string url;
+      // Keys of byFilter_, which are stable as long as the entries exist.
+      std::vector<const std::string*> filters;
+    };
+
+    SubscriptionId GetOrCreate(const std::string& url);
+    void Link(SubscriptionId id, const std::string& filter);
+    void Unlink(SubscriptionId id, const std::string& filter);
+
+    // Ids are never reused, so that sorting by them keeps the order in which
+    // the subscriptions were added.
+    SubscriptionId nextId_ = 0;
+    std::unordered_map<std::string, SubscriptionId> ids_;
+    std::unordered_map<SubscriptionId, SubscriptionEntry> subscriptions_;
+    // Sorted subscription ids by filter text.
+    std::unordered_map<std::string, std::vector<SubscriptionId>> byFilter_;
+  };
+}
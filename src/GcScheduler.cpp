@@ -0,0 +1,135 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "GcScheduler.h"
+
+#include <algorithm>
+
+using namespace AdblockPlus;
+
+GcScheduler::GcScheduler(ITimer& timer,
+                         const CollectCallback& collectCritical,
+                         const CollectCallback& collectIdle,
+                         std::chrono::milliseconds idleDelay,
+                         std::chrono::milliseconds criticalInterval,
+                         const NowCallback& now)
+    : timer_(timer), collectCritical_(collectCritical), collectIdle_(collectIdle),
+      idleDelay_(idleDelay), criticalInterval_(criticalInterval), now_(now),
+      lastActivity_(Clock::time_point::min().time_since_epoch().count()), collected_(true)
+{
+}
+
+void GcScheduler::NotifyActivity()
+{
+  if (idleDelay_ == Clock::duration::zero())
+    return;
+  lastActivity_.store(now_().time_since_epoch().count(), std::memory_order_relaxed);
+  // Only the first request after a collection has to arm the timer.
+  if (collected_.load(std::memory_order_relaxed) && collected_.exchange(false))
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ScheduleCheck(idleDelay_);
+  }
+}
+
+void GcScheduler::RequestCriticalCollection()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = now_();
+    const auto due = GetCriticalDueTime();
+    if (due > now)
+    {
+      criticalPending_ = true;
+      ScheduleCheck(due - now);
+      return;
+    }
+    criticalPending_ = false;
+    hasCollectedCritical_ = true;
+    lastCritical_ = now;
+    collected_ = true;
+  }
+  collectCritical_();
+}
+
+GcScheduler::Clock::time_point GcScheduler::GetCriticalDueTime() const
+{
+  auto due = Clock::time_point::min();
+  if (hasCollectedCritical_)
+    due = lastCritical_ + criticalInterval_;
+  if (idleDelay_ != Clock::duration::zero() && !collected_)
+    due = std::max(due, GetLastActivity() + idleDelay_);
+  return due;
+}
+
+GcScheduler::Clock::time_point GcScheduler::GetLastActivity() const
+{
+  return Clock::time_point(Clock::duration(lastActivity_.load(std::memory_order_relaxed)));
+}
+
+void GcScheduler::ScheduleCheck(Clock::duration delay)
+{
+  // A pending check reschedules itself if it fires too early.
+  if (timerPending_)
+    return;
+  timerPending_ = true;
+  std::weak_ptr<GcScheduler> weakSelf = shared_from_this();
+  timer_.SetTimer(std::chrono::duration_cast<std::chrono::milliseconds>(delay) +
+                      std::chrono::milliseconds(1),
+                  [weakSelf]() {
+                    if (auto self = weakSelf.lock())
+                      self->OnTimer();
+                  });
+}
+
+void GcScheduler::OnTimer()
+{
+  CollectCallback collect;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timerPending_ = false;
+    const auto now = now_();
+    if (criticalPending_)
+    {
+      const auto due = GetCriticalDueTime();
+      if (due > now)
+      {
+        ScheduleCheck(due - now);
+        return;
+      }
+      criticalPending_ = false;
+      hasCollectedCritical_ = true;
+      lastCritical_ = now;
+      collect = collectCritical_;
+    }
+    else if (!collected_)
+    {
+      const auto due = GetLastActivity() + idleDelay_;
+      if (due > now)
+      {
+        ScheduleCheck(due - now);
+        return;
+      }
+      collect = collectIdle_;
+    }
+    else
+      return;
+    collected_ = true;
+  }
+  collect();
+}
@@ -0,0 +1,102 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include <AdblockPlus/ITimer.h>
+
+namespace AdblockPlus
+{
+  /**
+   * Decides when V8 is asked to collect garbage, so that collections happen
+   * between page loads rather than in the middle of them.
+   *
+   * Critical collections, e.g. the ones requested after the filter lists
+   * were saved, happen at most once per `criticalInterval`, requests made
+   * meanwhile are merged into one deferred collection. If `idleDelay` is not
+   * zero, collections are also deferred until no request was matched for
+   * that long, and an idle time collection is done once matching stops.
+   *
+   * The methods are thread safe. The callbacks are invoked without the
+   * scheduler being locked, either by RequestCriticalCollection() or by a
+   * timer. Instances have to be owned by a `std::shared_ptr`.
+   */
+  class GcScheduler : public std::enable_shared_from_this<GcScheduler>
+  {
+  public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<Clock::time_point()> NowCallback;
+    typedef std::function<void()> CollectCallback;
+
+    /**
+     * @param timer Timer used for deferred collections.
+     * @param collectCritical Performs a critical collection.
+     * @param collectIdle Performs an idle time collection.
+     * @param idleDelay Time without matching after which V8 may collect
+     *        garbage, zero for no idle time collections.
+     * @param criticalInterval Minimal time between critical collections.
+     * @param now Source of the current time.
+     */
+    GcScheduler(ITimer& timer,
+                const CollectCallback& collectCritical,
+                const CollectCallback& collectIdle,
+                std::chrono::milliseconds idleDelay,
+                std::chrono::milliseconds criticalInterval,
+                const NowCallback& now = Clock::now);
+
+    /**
+     * Records that a request was matched, cheap enough for every request.
+     */
+    void NotifyActivity();
+
+    /**
+     * Requests a critical collection, performed right away if neither the
+     * interval nor matching activity are in the way.
+     */
+    void RequestCriticalCollection();
+
+  private:
+    Clock::time_point GetCriticalDueTime() const;
+    Clock::time_point GetLastActivity() const;
+    void ScheduleCheck(Clock::duration delay);
+    void OnTimer();
+
+    ITimer& timer_;
+    const CollectCallback collectCritical_;
+    const CollectCallback collectIdle_;
+    const Clock::duration idleDelay_;
+    const Clock::duration criticalInterval_;
+    const NowCallback now_;
+
+    std::atomic<Clock::rep> lastActivity_;
+    // Whether no request was matched since the last collection.
+    std::atomic<bool> collected_;
+
+    mutable std::mutex mutex_;
+    bool timerPending_ = false;
+    bool criticalPending_ = false;
+    bool hasCollectedCritical_ = false;
+    Clock::time_point lastCritical_;
+  };
+}
@@ -25,6 +25,7 @@
 #include "AppInfoJsObject.h"
 #include "ConsoleJsObject.h"
 #include "FileSystemJsObject.h"
+#include "PerformanceJsObject.h"
 #include "ResourceReaderJsObject.h"
 #include "Thread.h"
 #include "Utils.h"
@@ -45,10 +46,11 @@ namespace
       v8::Isolate* isolate = arguments.GetIsolate();
       return Utils::ThrowExceptionInJS(isolate, e.what());
     }
+  }
 
-    // We should actually return the timer ID here, which could be
-    // used via clearTimeout(). But since we don't seem to need
-    // clearTimeout(), we can save that for later.
+  void ClearTimeoutCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  {
+    AdblockPlus::JsEngine::ClearTimer(arguments);
   }
 
   void TriggerEventCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
@@ -69,6 +71,7 @@ namespace
 JsValue& GlobalJsObject::Setup(JsEngine& jsEngine, const AppInfo& appInfo, JsValue& obj)
 {
   obj.SetProperty("setTimeout", jsEngine.NewCallback(::SetTimeoutCallback));
+  obj.SetProperty("clearTimeout", jsEngine.NewCallback(::ClearTimeoutCallback));
   obj.SetProperty("_triggerEvent", jsEngine.NewCallback(::TriggerEventCallback));
   auto value = jsEngine.NewObject();
   obj.SetProperty("_fileSystem", FileSystemJsObject::Setup(jsEngine, value));
@@ -80,5 +83,7 @@ JsValue& GlobalJsObject::Setup(JsEngine& jsEngine, const AppInfo& appInfo, JsVal
   obj.SetProperty("_appInfo", AppInfoJsObject::Setup(appInfo, value));
   value = jsEngine.NewObject();
   obj.SetProperty("_resourceReader", ResourceReaderJsObject::Setup(jsEngine, value));
+  value = jsEngine.NewObject();
+  obj.SetProperty("_performance", PerformanceJsObject::Setup(jsEngine, value));
   return obj;
 }
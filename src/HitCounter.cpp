@@ -0,0 +1,99 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HitCounter.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using namespace AdblockPlus;
+
+HitCounter::HitCounter(ITimer& timer,
+                       const FlushCallback& flush,
+                       std::chrono::milliseconds interval,
+                       const NowCallback& now)
+    : timer_(timer), flush_(flush), interval_(interval), now_(now), enabled_(false),
+      flushScheduled_(false)
+{
+}
+
+void HitCounter::SetEnabled(bool enabled)
+{
+  enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+bool HitCounter::IsEnabled() const
+{
+  return enabled_.load(std::memory_order_relaxed);
+}
+
+void HitCounter::RecordHit(std::shared_ptr<const std::string> filterText)
+{
+  if (!filterText || !IsEnabled())
+    return;
+  hits_.Push(Hit{std::move(filterText), now_()});
+  // Only the first hit after a flush gets past the load.
+  if (!flushScheduled_.load(std::memory_order_relaxed) && !flushScheduled_.exchange(true))
+    ScheduleFlush();
+}
+
+void HitCounter::Flush()
+{
+  std::vector<Hit> hits;
+  std::vector<FilterHits> result;
+  {
+    std::lock_guard<std::mutex> lock(flushMutex_);
+    // Hits recorded from now on schedule another flush.
+    flushScheduled_ = false;
+    if (!hits_.TryPopAll(&hits))
+      return;
+
+    // Copies of a filter usually share the interned text, the JS side adds
+    // up the others.
+    std::unordered_map<const std::string*, size_t> indices;
+    for (auto& hit : hits)
+    {
+      auto inserted = indices.emplace(hit.filterText.get(), result.size());
+      if (inserted.second)
+      {
+        result.push_back(FilterHits{std::move(hit.filterText), 1, hit.time});
+        continue;
+      }
+      auto& filterHits = result[inserted.first->second];
+      ++filterHits.count;
+      filterHits.lastHit = std::max(filterHits.lastHit, hit.time);
+    }
+  }
+  flush_(std::move(result));
+}
+
+// static
+int64_t HitCounter::CurrentTime()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+void HitCounter::ScheduleFlush()
+{
+  std::weak_ptr<HitCounter> weakSelf = shared_from_this();
+  timer_.SetTimer(interval_, [weakSelf]() {
+    if (auto self = weakSelf.lock())
+      self->Flush();
+  });
+}
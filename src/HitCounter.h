@@ -0,0 +1,117 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <AdblockPlus/ITimer.h>
+
+#include "MpscQueue.h"
+
+namespace AdblockPlus
+{
+  /**
+   * Collects filter hits on the matching threads and hands them over in
+   * batches, so that neither the JS engine nor a lock is involved in
+   * matching.
+   *
+   * Hits are pushed onto a lock-free queue keyed by the interned filter
+   * text. The first hit after a flush schedules the next one in `interval`,
+   * which sums up the hits per filter and passes them to the flush
+   * callback on the timer thread.
+   *
+   * The methods are thread safe. Instances have to be owned by a
+   * `std::shared_ptr`.
+   */
+  class HitCounter : public std::enable_shared_from_this<HitCounter>
+  {
+  public:
+    typedef std::function<int64_t()> NowCallback;
+
+    /**
+     * Hits of one filter since the last flush.
+     */
+    struct FilterHits
+    {
+      std::shared_ptr<const std::string> filterText;
+      uint32_t count;
+      /// Time of the last hit in milliseconds since the epoch.
+      int64_t lastHit;
+    };
+
+    typedef std::function<void(std::vector<FilterHits>&&)> FlushCallback;
+
+    /**
+     * @param timer Timer used for the periodic flushes.
+     * @param flush Receives the hits of every flush, never empty.
+     * @param interval Time between the first hit and the flush.
+     * @param now Source of the current time in milliseconds since the epoch.
+     */
+    HitCounter(ITimer& timer,
+               const FlushCallback& flush,
+               std::chrono::milliseconds interval,
+               const NowCallback& now = CurrentTime);
+
+    /**
+     * Hits are only recorded while enabled, which they are not initially.
+     * Disabling keeps the pending hits for the next flush.
+     */
+    void SetEnabled(bool enabled);
+
+    bool IsEnabled() const;
+
+    /**
+     * Records a hit of a filter, cheap enough for every matched request.
+     * @param filterText Interned text of the filter.
+     */
+    void RecordHit(std::shared_ptr<const std::string> filterText);
+
+    /**
+     * Passes the pending hits to the flush callback right away, if there
+     * are any.
+     */
+    void Flush();
+
+  private:
+    struct Hit
+    {
+      std::shared_ptr<const std::string> filterText;
+      int64_t time;
+    };
+
+    static int64_t CurrentTime();
+    void ScheduleFlush();
+
+    ITimer& timer_;
+    const FlushCallback flush_;
+    const std::chrono::milliseconds interval_;
+    const NowCallback now_;
+    std::atomic<bool> enabled_;
+    std::atomic<bool> flushScheduled_;
+    MpscQueue<Hit> hits_;
+    // Serializes the consumers of hits_.
+    std::mutex flushMutex_;
+  };
+}
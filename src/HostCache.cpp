@@ -0,0 +1,88 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HostCache.h"
+
+#include <mutex>
+
+#include <AdblockPlus/URLInfo.h>
+
+#include "LruCache.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  // A page rarely loads from more than a few dozen hosts, this covers the
+  // pages of several tabs.
+  const size_t CACHE_SIZE = 256;
+
+  typedef LruCache<std::string, std::shared_ptr<const HostCache::Host>> Hosts;
+
+  std::mutex cacheMutex;
+  Hosts cache(CACHE_SIZE);
+
+  std::shared_ptr<const HostCache::Host> Convert(const std::string& host)
+  {
+    auto result = std::make_shared<HostCache::Host>();
+    result->valid = URLInfo::HostToASCII(host, &result->hostname);
+    if (!result->valid)
+      return result;
+
+    std::string domain = result->hostname;
+    for (auto& c : domain)
+    {
+      if (c >= 'A' && c <= 'Z')
+        c = static_cast<char>(c - 'A' + 'a');
+    }
+    while (!domain.empty() && domain.back() == '.')
+      domain.pop_back();
+    for (size_t start = 0; start < domain.size();)
+    {
+      result->domains.push_back(domain.substr(start));
+      const size_t dot = domain.find('.', start);
+      if (dot == std::string::npos)
+        break;
+      start = dot + 1;
+    }
+    return result;
+  }
+}
+
+// static
+std::shared_ptr<const HostCache::Host> HostCache::Get(const std::string& host)
+{
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (const auto* cached = cache.Get(host))
+      return *cached;
+  }
+
+  auto result = Convert(host);
+  Hosts::Entries evicted;
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  cache.Put(host, result, &evicted);
+  return result;
+}
+
+// static
+void HostCache::Clear()
+{
+  Hosts::Entries removed;
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  cache.Clear(&removed);
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace AdblockPlus
+{
+  /**
+   * Process-wide bounded cache of the forms of a host name which matching
+   * and element hiding look up, so that the Punycode conversion and the
+   * list of parent domains are computed once for the few hosts of a page,
+   * however many requests and filters they are checked against.
+   *
+   * The methods are thread safe.
+   */
+  class HostCache
+  {
+  public:
+    struct Host
+    {
+      // Whether the host could be converted to ASCII.
+      bool valid = false;
+      // Result of URLInfo::HostToASCII().
+      std::string hostname;
+      // Lower-cased `hostname` without trailing dots, followed by its
+      // parent domains, e.g. `www.example.com`, `example.com`, `com`. Empty
+      // for invalid hosts.
+      std::vector<std::string> domains;
+    };
+
+    /**
+     * Looks up a host, it is converted if it isn't cached.
+     * @param host Host name as it appears in a URL, UTF-8 encoded.
+     * @return Converted host, never nullptr.
+     */
+    static std::shared_ptr<const Host> Get(const std::string& host);
+
+    /**
+     * Drops all cached hosts.
+     */
+    static void Clear();
+  };
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <AdblockPlus/IFileSystem.h>
+
+#include <mutex>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  class BufferingFileWriter : public IFileSystem::IFileWriter
+  {
+  public:
+    BufferingFileWriter(IFileSystem& fileSystem, const std::string& fileName)
+        : fileSystem(fileSystem), fileName(fileName)
+    {
+    }
+
+    void Append(IFileSystem::IOBuffer&& chunk) override
+    {
+      if (content.empty())
+        content = std::move(chunk);
+      else
+        content.insert(content.end(), chunk.begin(), chunk.end());
+    }
+
+    void Commit(const IFileSystem::Callback& callback) override
+    {
+      fileSystem.Write(fileName, content, callback);
+    }
+
+  private:
+    IFileSystem& fileSystem;
+    std::string fileName;
+    IFileSystem::IOBuffer content;
+  };
+}
+
+void IFileSystem::Copy(const std::string& fromFileName,
+                       const std::string& toFileName,
+                       const Callback& callback)
+{
+  Read(
+      fromFileName,
+      [this, toFileName, callback](IOBuffer&& content) { Write(toFileName, content, callback); },
+      [callback](const std::string& error) {
+        if (!error.empty())
+          callback(error);
+      });
+}
+
+std::unique_ptr<IFileSystem::IFileWriter> IFileSystem::OpenWriter(const std::string& fileName)
+{
+  return std::unique_ptr<IFileWriter>(new BufferingFileWriter(*this, fileName));
+}
+
+void IFileSystem::StatMany(const std::vector<std::string>& fileNames,
+                           const StatManyCallback& callback) const
+{
+  struct State
+  {
+    std::mutex mutex;
+    std::vector<StatResult> results;
+    std::vector<std::string> errors;
+    size_t remaining;
+  };
+
+  if (fileNames.empty())
+  {
+    callback(std::vector<StatResult>(), std::vector<std::string>());
+    return;
+  }
+  auto state = std::make_shared<State>();
+  state->results.resize(fileNames.size());
+  state->errors.resize(fileNames.size());
+  state->remaining = fileNames.size();
+  for (size_t i = 0; i < fileNames.size(); i++)
+  {
+    Stat(fileNames[i],
+         [state, i, callback](const StatResult& result, const std::string& error) {
+           {
+             std::lock_guard<std::mutex> lock(state->mutex);
+             state->results[i] = result;
+             state->errors[i] = error;
+             if (--state->remaining > 0)
+               return;
+           }
+           callback(state->results, state->errors);
+         });
+  }
+}
@@ -0,0 +1,64 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <AdblockPlus/ITimer.h>
+
+using namespace AdblockPlus;
+
+// static
+TimerHandle TimerHandle::Create()
+{
+  TimerHandle handle;
+  handle.state = std::make_shared<std::atomic<int>>(PENDING);
+  return handle;
+}
+
+bool TimerHandle::Cancel() const
+{
+  int expected = PENDING;
+  return state && state->compare_exchange_strong(expected, CANCELLED);
+}
+
+bool TimerHandle::IsPending() const
+{
+  return state && state->load() == PENDING;
+}
+
+bool TimerHandle::IsCancelled() const
+{
+  return state && state->load() == CANCELLED;
+}
+
+bool TimerHandle::Fire() const
+{
+  int expected = PENDING;
+  return !state || state->compare_exchange_strong(expected, FIRED);
+}
+
+TimerHandle ITimer::SetCancellableTimer(const std::chrono::milliseconds& timeout,
+                                        const TimerCallback& timerCallback,
+                                        const std::chrono::milliseconds& /* tolerance */)
+{
+  if (!timerCallback)
+    return TimerHandle();
+  TimerHandle handle = TimerHandle::Create();
+  SetTimer(timeout, [handle, timerCallback]() {
+    if (handle.Fire())
+      timerCallback();
+  });
+  return handle;
+}
@@ -0,0 +1,37 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <AdblockPlus/IWebRequest.h>
+
+using namespace AdblockPlus;
+
+void IWebRequest::StreamGET(const std::string& url,
+                            const HeaderList& requestHeaders,
+                            const DataCallback& dataCallback,
+                            const RequestCallback& requestCallback)
+{
+  GET(url, requestHeaders, [dataCallback, requestCallback](const ServerResponse& response) {
+    if (!response.responseText.empty())
+      dataCallback(response.responseText.data(), response.responseText.size());
+    ServerResponse withoutBody;
+    withoutBody.status = response.status;
+    withoutBody.responseHeaders = response.responseHeaders;
+    withoutBody.responseStatus = response.responseStatus;
+    requestCallback(withoutBody);
+  });
+}
@@ -0,0 +1,110 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "InteractivePriority.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+
+#include "ApiCallStats.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  // Number of API calls waiting for the lock by isolate, isolates without
+  // waiting calls don't have an entry.
+  std::mutex waitingMutex;
+  std::condition_variable noneWaiting;
+  std::unordered_map<v8::Isolate*, size_t> waitingCalls;
+
+  thread_local size_t exclusiveScopes = 0;
+}
+
+const std::chrono::milliseconds InteractivePriority::MAX_YIELD(50);
+
+InteractivePriority::InteractivePriority(v8::Isolate* isolate, bool interactive)
+    : isolate(isolate), waiting(false)
+{
+  // A thread holding the lock already doesn't wait for it.
+  if (!interactive || v8::Locker::IsLocked(isolate))
+    return;
+  {
+    std::lock_guard<std::mutex> lock(waitingMutex);
+    ++waitingCalls[isolate];
+  }
+  waiting = true;
+}
+
+InteractivePriority::~InteractivePriority()
+{
+  Acquired();
+}
+
+void InteractivePriority::Acquired()
+{
+  if (!waiting)
+    return;
+  waiting = false;
+  std::lock_guard<std::mutex> lock(waitingMutex);
+  auto it = waitingCalls.find(isolate);
+  if (it != waitingCalls.end() && --it->second == 0)
+  {
+    waitingCalls.erase(it);
+    noneWaiting.notify_all();
+  }
+}
+
+InteractivePriority::ExclusiveScope::ExclusiveScope()
+{
+  ++exclusiveScopes;
+}
+
+InteractivePriority::ExclusiveScope::~ExclusiveScope()
+{
+  --exclusiveScopes;
+}
+
+// static
+bool InteractivePriority::ExclusiveScope::IsActive()
+{
+  return exclusiveScopes != 0;
+}
+
+// static
+bool InteractivePriority::ShouldYield(v8::Isolate* isolate)
+{
+  // API calls don't yield to each other.
+  if (ScopedApiCall::IsActive() || ExclusiveScope::IsActive())
+    return false;
+  std::lock_guard<std::mutex> lock(waitingMutex);
+  return waitingCalls.find(isolate) != waitingCalls.end();
+}
+
+// static
+void InteractivePriority::YieldLock(v8::Isolate* isolate)
+{
+  if (!ShouldYield(isolate))
+    return;
+
+  const v8::Unlocker unlocker(isolate);
+  std::unique_lock<std::mutex> lock(waitingMutex);
+  noneWaiting.wait_for(lock, MAX_YIELD, [isolate]() {
+    return waitingCalls.find(isolate) == waitingCalls.end();
+  });
+}
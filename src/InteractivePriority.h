@@ -0,0 +1,98 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+
+#include <v8.h>
+
+namespace AdblockPlus
+{
+  /**
+   * Gives calls through the public API, i.e. the ones made while a
+   * ScopedApiCall is active, priority over background work in JS, e.g.
+   * the completions of downloads. While such a call waits for the lock of an
+   * isolate, the background work releases the lock at its next safe point
+   * until no call is waiting anymore, for up to MAX_YIELD at a time, so that
+   * the background work still makes progress. Scripts are never interrupted,
+   * the API calls must not see the state of JS halfway through a change.
+   */
+  class InteractivePriority
+  {
+  public:
+    static const std::chrono::milliseconds MAX_YIELD;
+
+    /**
+     * Marks a sequence of calls on the current thread which must not be
+     * interleaved with other threads: the JS code run meanwhile doesn't
+     * yield the lock and the lock is requested with priority.
+     */
+    class ExclusiveScope
+    {
+    public:
+      ExclusiveScope();
+      ~ExclusiveScope();
+      ExclusiveScope(const ExclusiveScope&) = delete;
+      ExclusiveScope& operator=(const ExclusiveScope&) = delete;
+
+      /**
+       * @return `true` if the current thread is in such a sequence.
+       */
+      static bool IsActive();
+    };
+
+    /**
+     * To be created right before locking the isolate.
+     * @param isolate Isolate to lock.
+     * @param interactive Whether the lock is requested by an API call.
+     */
+    InteractivePriority(v8::Isolate* isolate, bool interactive);
+
+    /**
+     * Calls Acquired() unless it was called already.
+     */
+    ~InteractivePriority();
+
+    /**
+     * To be called once the isolate is locked.
+     */
+    void Acquired();
+
+    /**
+     * @param isolate Isolate locked by the current thread.
+     * @return `true` if the current thread is expected to call YieldLock(),
+     *         i.e. it does background work and an API call is waiting.
+     */
+    static bool ShouldYield(v8::Isolate* isolate);
+
+    /**
+     * Releases the lock while ShouldYield() holds, for up to MAX_YIELD. To be
+     * called at safe points only, where no JS code is running on the current
+     * thread, e.g. between completions.
+     * @param isolate Isolate locked by the current thread.
+     */
+    static void YieldLock(v8::Isolate* isolate);
+
+  private:
+    InteractivePriority(const InteractivePriority&) = delete;
+    InteractivePriority& operator=(const InteractivePriority&) = delete;
+
+    v8::Isolate* isolate;
+    bool waiting;
+  };
+}
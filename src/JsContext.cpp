@@ -17,8 +17,20 @@
 
 #include "JsContext.h"
 
+#include "ApiCallStats.h"
+#include "DeferredRelease.h"
+
 AdblockPlus::JsContext::JsContext(v8::Isolate* isolate, const v8::Global<v8::Context>& context)
-    : locker(isolate), isolateScope(isolate), handleScope(isolate),
-      context(v8::Local<v8::Context>::New(isolate, context)), contextScope(this->context)
+    : lockRequested(ScopedApiCall::IsActive() ? std::chrono::steady_clock::now()
+                                              : std::chrono::steady_clock::time_point()),
+      priority(isolate,
+               ScopedApiCall::IsActive() || InteractivePriority::ExclusiveScope::IsActive()),
+      locker(isolate), isolateScope(isolate),
+      handleScope(isolate), context(v8::Local<v8::Context>::New(isolate, context)),
+      contextScope(this->context)
 {
+  priority.Acquired();
+  if (lockRequested != std::chrono::steady_clock::time_point())
+    ScopedApiCall::AddLockWait(std::chrono::steady_clock::now() - lockRequested);
+  DeferredRelease::Drain(isolate);
 }
@@ -17,6 +17,9 @@
 
 #pragma once
 
+#include <chrono>
+
+#include "InteractivePriority.h"
 #include "JsEngine.h"
 
 namespace AdblockPlus
@@ -32,6 +35,9 @@ namespace AdblockPlus
     }
 
   private:
+    // Only taken while a ScopedApiCall is active, to account for lock waits.
+    const std::chrono::steady_clock::time_point lockRequested;
+    InteractivePriority priority;
     const v8::Locker locker;
     const v8::Isolate::Scope isolateScope;
     const v8::HandleScope handleScope;
@@ -16,14 +16,18 @@
  */
 
 #include <AdblockPlus.h>
+#include <algorithm>
 #include <assert.h>
+#include <iterator>
 
 // TODO check whether this can be removed after V8 upgrade
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wnon-virtual-dtor"
 #include <libplatform/libplatform.h>
+#include <v8-profiler.h>
 #pragma clang diagnostic pop
 
+#include "DeferredRelease.h"
 #include "GlobalJsObject.h"
 #include "JsContext.h"
 #include "JsError.h"
@@ -31,6 +35,141 @@
 
 namespace
 {
+  // Larger sources are library files evaluated only once, keeping them as
+  // cache keys would just waste memory.
+  const size_t MAX_COMPILED_SCRIPT_SOURCE_LENGTH = 16 * 1024;
+  const size_t COMPILED_SCRIPT_CACHE_SIZE = 64;
+  // Heap caps of MemoryProfile::LOW_MEMORY, enough for EasyList with
+  // Acceptable Ads and a regional list.
+  const size_t LOW_MEMORY_MAX_OLD_GENERATION_SIZE = 128 * 1024 * 1024;
+  const size_t LOW_MEMORY_MAX_YOUNG_GENERATION_SIZE = 2 * 1024 * 1024;
+  // setTimeout() callbacks may be called up to a tenth of the timeout, but
+  // at most a second, late, so that timers due at about the same time share
+  // a wakeup.
+  const int64_t TIMER_TOLERANCE_DIVISOR = 10;
+  const std::chrono::milliseconds MAX_TIMER_TOLERANCE(1000);
+
+  const char CODE_CACHE_MAGIC[] = {'A', 'B', 'P', 'C'};
+  const uint32_t CODE_CACHE_FORMAT_VERSION = 2;
+
+  // Flattens the call tree into the `nodes` array of a `.cpuprofile`, line
+  // and column numbers are zero-based there.
+  void AppendCpuProfileNode(const v8::CpuProfileNode* node, std::string* json)
+  {
+    if (json->back() != '[')
+      json->push_back(',');
+    json->append("{\"id\":").append(std::to_string(node->GetNodeId()));
+    json->append(",\"callFrame\":{\"functionName\":");
+    AdblockPlus::Utils::AppendJsonString(node->GetFunctionNameStr(), json);
+    json->append(",\"scriptId\":\"").append(std::to_string(node->GetScriptId()));
+    json->append("\",\"url\":");
+    AdblockPlus::Utils::AppendJsonString(node->GetScriptResourceNameStr(), json);
+    json->append(",\"lineNumber\":").append(std::to_string(node->GetLineNumber() - 1));
+    json->append(",\"columnNumber\":").append(std::to_string(node->GetColumnNumber() - 1));
+    json->append("},\"hitCount\":").append(std::to_string(node->GetHitCount()));
+    json->append(",\"children\":[");
+    const int childCount = node->GetChildrenCount();
+    for (int i = 0; i < childCount; ++i)
+    {
+      if (i)
+        json->push_back(',');
+      json->append(std::to_string(node->GetChild(i)->GetNodeId()));
+    }
+    json->append("]}");
+    for (int i = 0; i < childCount; ++i)
+      AppendCpuProfileNode(node->GetChild(i), json);
+  }
+
+  std::string CpuProfileToJson(const v8::CpuProfile& profile)
+  {
+    std::string json = "{\"nodes\":[";
+    AppendCpuProfileNode(profile.GetTopDownRoot(), &json);
+    json.append("],\"startTime\":").append(std::to_string(profile.GetStartTime()));
+    json.append(",\"endTime\":").append(std::to_string(profile.GetEndTime()));
+    const int sampleCount = profile.GetSamplesCount();
+    json.append(",\"samples\":[");
+    for (int i = 0; i < sampleCount; ++i)
+    {
+      if (i)
+        json.push_back(',');
+      json.append(std::to_string(profile.GetSample(i)->GetNodeId()));
+    }
+    json.append("],\"timeDeltas\":[");
+    int64_t lastTimestamp = profile.GetStartTime();
+    for (int i = 0; i < sampleCount; ++i)
+    {
+      if (i)
+        json.push_back(',');
+      const int64_t timestamp = profile.GetSampleTimestamp(i);
+      json.append(std::to_string(timestamp - lastTimestamp));
+      lastTimestamp = timestamp;
+    }
+    json.append("]}");
+    return json;
+  }
+
+  class HeapSnapshotBuffer : public v8::OutputStream
+  {
+  public:
+    void EndOfStream() override
+    {
+    }
+
+    WriteResult WriteAsciiChunk(char* data, int size) override
+    {
+      buffer.insert(buffer.end(), data, data + size);
+      return kContinue;
+    }
+
+    AdblockPlus::IFileSystem::IOBuffer buffer;
+  };
+
+  // FNV-1a, only used to detect changed scripts.
+  uint64_t SourceHash(const std::string& source)
+  {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : source)
+    {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= 0x100000001b3;
+    }
+    return hash;
+  }
+
+  void WriteUInt32(uint32_t value, AdblockPlus::IFileSystem::IOBuffer* data)
+  {
+    for (int shift = 0; shift < 32; shift += 8)
+      data->push_back(static_cast<uint8_t>(value >> shift));
+  }
+
+  void WriteString(const std::string& str, AdblockPlus::IFileSystem::IOBuffer* data)
+  {
+    WriteUInt32(static_cast<uint32_t>(str.size()), data);
+    data->insert(data->end(), str.begin(), str.end());
+  }
+
+  bool ReadUInt32(const AdblockPlus::IFileSystem::IOBuffer& data, size_t* pos, uint32_t* value)
+  {
+    if (data.size() - *pos < 4)
+      return false;
+    *value = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+      *value |= static_cast<uint32_t>(data[(*pos)++]) << shift;
+    return true;
+  }
+
+  bool ReadBuffer(const AdblockPlus::IFileSystem::IOBuffer& data,
+                  size_t* pos,
+                  AdblockPlus::IFileSystem::IOBuffer* buffer)
+  {
+    uint32_t length = 0;
+    if (!ReadUInt32(data, pos, &length) || data.size() - *pos < length)
+      return false;
+    buffer->assign(data.begin() + *pos, data.begin() + *pos + length);
+    *pos += length;
+    return true;
+  }
+
   v8::MaybeLocal<v8::Script>
   CompileScript(v8::Isolate* isolate, const std::string& source, const std::string& filename)
   {
@@ -51,11 +190,47 @@ namespace
       return v8::Script::Compile(isolate->GetCurrentContext(), v8Source);
   }
 
+  // Like CompileScript() but consumes `cachedCode` if it is not empty.
+  v8::MaybeLocal<v8::Script> CompileCachedScript(v8::Isolate* isolate,
+                                                 const std::string& source,
+                                                 const std::string& filename,
+                                                 const AdblockPlus::IFileSystem::IOBuffer& cachedCode,
+                                                 bool* rejected)
+  {
+    using AdblockPlus::Utils::ToV8String;
+    *rejected = cachedCode.empty();
+    if (cachedCode.empty())
+      return CompileScript(isolate, source, filename);
+
+    auto maybeV8Source = ToV8String(isolate, source);
+    auto maybeV8Filename = ToV8String(isolate, filename);
+    if (maybeV8Source.IsEmpty() || maybeV8Filename.IsEmpty())
+      return v8::MaybeLocal<v8::Script>();
+    v8::ScriptOrigin scriptOrigin(maybeV8Filename.ToLocalChecked());
+    // The source takes ownership of the data object but not of the buffer.
+    v8::ScriptCompiler::Source compilerSource(
+        maybeV8Source.ToLocalChecked(),
+        scriptOrigin,
+        new v8::ScriptCompiler::CachedData(cachedCode.data(),
+                                           static_cast<int>(cachedCode.size()),
+                                           v8::ScriptCompiler::CachedData::BufferNotOwned));
+    auto script = v8::ScriptCompiler::Compile(isolate->GetCurrentContext(),
+                                              &compilerSource,
+                                              v8::ScriptCompiler::kConsumeCodeCache);
+    *rejected = compilerSource.GetCachedData()->rejected;
+    return script;
+  }
+
   class V8Initializer
   {
-    V8Initializer() : platform{nullptr}
+    explicit V8Initializer(AdblockPlus::MemoryProfile memoryProfile) : platform{nullptr}
     {
       std::string cmd = "--use_strict";
+      // Lite mode doesn't allocate feedback vectors up front and, like
+      // jitless mode, doesn't optimize, which saves the memory of the
+      // optimized code as well.
+      if (memoryProfile == AdblockPlus::MemoryProfile::LOW_MEMORY)
+        cmd += " --lite_mode --jitless --optimize_for_size";
       v8::V8::SetFlagsFromString(cmd.c_str(), cmd.length());
       platform = v8::platform::NewDefaultPlatform();
       v8::V8::InitializePlatform(platform.get());
@@ -70,11 +245,11 @@ namespace
     std::unique_ptr<v8::Platform> platform;
 
   public:
-    static void Init()
+    static void Init(AdblockPlus::MemoryProfile memoryProfile)
     {
       // it's threadsafe since C++11 and it will be instantiated only once and
       // destroyed at the application exit
-      static V8Initializer initializer;
+      static V8Initializer initializer(memoryProfile);
     }
   };
 
@@ -85,12 +260,29 @@ namespace
   class ScopedV8Isolate : public AdblockPlus::IV8IsolateProvider
   {
   public:
-    ScopedV8Isolate()
+    ScopedV8Isolate(AdblockPlus::JsHeapLimits heapLimits, AdblockPlus::MemoryProfile memoryProfile)
     {
-      V8Initializer::Init();
+      V8Initializer::Init(memoryProfile);
+      if (memoryProfile == AdblockPlus::MemoryProfile::LOW_MEMORY)
+      {
+        if (!heapLimits.maxOldGenerationSize)
+          heapLimits.maxOldGenerationSize = LOW_MEMORY_MAX_OLD_GENERATION_SIZE;
+        if (!heapLimits.maxYoungGenerationSize)
+          heapLimits.maxYoungGenerationSize = LOW_MEMORY_MAX_YOUNG_GENERATION_SIZE;
+      }
       allocator.reset(v8::ArrayBuffer::Allocator::NewDefaultAllocator());
       v8::Isolate::CreateParams isolateParams;
       isolateParams.array_buffer_allocator = allocator.get();
+      auto& constraints = isolateParams.constraints;
+      if (heapLimits.initialOldGenerationSize)
+        constraints.set_initial_old_generation_size_in_bytes(heapLimits.initialOldGenerationSize);
+      if (heapLimits.maxOldGenerationSize)
+        constraints.set_max_old_generation_size_in_bytes(heapLimits.maxOldGenerationSize);
+      if (heapLimits.initialYoungGenerationSize)
+        constraints.set_initial_young_generation_size_in_bytes(
+            heapLimits.initialYoungGenerationSize);
+      if (heapLimits.maxYoungGenerationSize)
+        constraints.set_max_young_generation_size_in_bytes(heapLimits.maxYoungGenerationSize);
       isolate_ = v8::Isolate::New(isolateParams);
     }
 
@@ -126,6 +318,119 @@ void JsEngine::NotifyLowMemory()
   GetIsolate()->MemoryPressureNotification(v8::MemoryPressureLevel::kCritical);
 }
 
+void JsEngine::NotifyMemoryPressure(MemoryPressureLevel level)
+{
+  {
+    const JsContext context(GetIsolate(), *GetContext());
+    GetIsolate()->MemoryPressureNotification(level == MemoryPressureLevel::CRITICAL
+                                                 ? v8::MemoryPressureLevel::kCritical
+                                                 : v8::MemoryPressureLevel::kModerate);
+  }
+  std::lock_guard<std::mutex> lock(memoryPressureObserverMutex_);
+  if (memoryPressureObserver_)
+    memoryPressureObserver_(level);
+}
+
+void JsEngine::EnableDeferredValueRelease()
+{
+  deferredValueRelease_ = true;
+  DeferredRelease::Enable(GetIsolate());
+}
+
+void JsEngine::NotifyIdle(std::chrono::milliseconds budget)
+{
+  const JsContext context(GetIsolate(), *GetContext());
+  // The default V8 platform measures time with a monotonic clock like the
+  // steady clock.
+  typedef std::chrono::duration<double> Seconds;
+  const auto deadline = std::chrono::steady_clock::now().time_since_epoch() + budget;
+  GetIsolate()->IdleNotificationDeadline(std::chrono::duration_cast<Seconds>(deadline).count());
+}
+
+bool JsEngine::StartCpuProfile(const std::string& name)
+{
+  const JsContext context(GetIsolate(), *GetContext());
+  if (cpuProfiler_)
+    return false;
+  cpuProfiler_ = v8::CpuProfiler::New(GetIsolate());
+  cpuProfileName_ = name;
+  cpuProfiler_->StartProfiling(
+      CHECKED_TO_LOCAL(GetIsolate(), Utils::ToV8String(GetIsolate(), name)), true);
+  return true;
+}
+
+void JsEngine::StopCpuProfile(const IFileSystem::Callback& callback)
+{
+  std::string fileName;
+  std::string json;
+  {
+    const JsContext context(GetIsolate(), *GetContext());
+    if (!cpuProfiler_)
+    {
+      callback("No CPU profile is being recorded");
+      return;
+    }
+    auto* profile = cpuProfiler_->StopProfiling(
+        CHECKED_TO_LOCAL(GetIsolate(), Utils::ToV8String(GetIsolate(), cpuProfileName_)));
+    if (profile)
+    {
+      json = CpuProfileToJson(*profile);
+      profile->Delete();
+    }
+    cpuProfiler_->Dispose();
+    cpuProfiler_ = nullptr;
+    fileName = cpuProfileName_ + ".cpuprofile";
+    cpuProfileName_.clear();
+  }
+  GetFileSystem().Write(fileName, IFileSystem::IOBuffer(json.begin(), json.end()), callback);
+}
+
+void JsEngine::TakeHeapSnapshot(const std::string& fileName, const IFileSystem::Callback& callback)
+{
+  HeapSnapshotBuffer snapshotBuffer;
+  {
+    const JsContext context(GetIsolate(), *GetContext());
+    auto* snapshot = GetIsolate()->GetHeapProfiler()->TakeHeapSnapshot();
+    snapshot->Serialize(&snapshotBuffer, v8::HeapSnapshot::kJSON);
+    const_cast<v8::HeapSnapshot*>(snapshot)->Delete();
+  }
+  GetFileSystem().Write(fileName, std::move(snapshotBuffer.buffer), callback);
+}
+
+JsHeapStatistics JsEngine::GetHeapStatistics()
+{
+  const JsContext context(GetIsolate(), *GetContext());
+  auto isolate = GetIsolate();
+  v8::HeapStatistics heapStatistics;
+  isolate->GetHeapStatistics(&heapStatistics);
+  JsHeapStatistics result;
+  result.totalHeapSize = heapStatistics.total_heap_size();
+  result.totalHeapSizeExecutable = heapStatistics.total_heap_size_executable();
+  result.totalPhysicalSize = heapStatistics.total_physical_size();
+  result.totalAvailableSize = heapStatistics.total_available_size();
+  result.usedHeapSize = heapStatistics.used_heap_size();
+  result.heapSizeLimit = heapStatistics.heap_size_limit();
+  result.mallocedMemory = heapStatistics.malloced_memory();
+  result.externalMemory = heapStatistics.external_memory();
+
+  const size_t spaceCount = isolate->NumberOfHeapSpaces();
+  result.spaces.reserve(spaceCount);
+  for (size_t i = 0; i < spaceCount; ++i)
+  {
+    v8::HeapSpaceStatistics spaceStatistics;
+    if (!isolate->GetHeapSpaceStatistics(&spaceStatistics, i))
+      continue;
+    JsHeapSpaceStatistics space;
+    space.name = spaceStatistics.space_name();
+    space.size = spaceStatistics.space_size();
+    space.usedSize = spaceStatistics.space_used_size();
+    space.availableSize = spaceStatistics.space_available_size();
+    space.physicalSize = spaceStatistics.physical_space_size();
+    result.spaces.push_back(std::move(space));
+  }
+  return result;
+}
+
 void JsEngine::ScheduleTimer(const v8::FunctionCallbackInfo<v8::Value>& arguments)
 {
   auto jsEngine = FromArguments(arguments);
@@ -140,14 +445,46 @@ void JsEngine::ScheduleTimer(const v8::FunctionCallbackInfo<v8::Value>& argument
 
   int64_t millis =
       CHECKED_TO_VALUE(arguments[1]->IntegerValue(arguments.GetIsolate()->GetCurrentContext()));
+  millis = std::max<int64_t>(millis, 0);
+
+  // The callback takes the isolate lock before looking the timer up, so it
+  // is registered before it can fire.
+  const uint32_t timerID = jsEngine->nextTimerID_++;
+  auto& pendingTimer = jsEngine->pendingTimers_[timerID];
+  pendingTimer.paramsID = timerParamsID;
+  pendingTimer.handle = jsEngine->GetTimer().SetCancellableTimer(
+      std::chrono::milliseconds(millis),
+      [jsEngine, timerID] {
+        jsEngine->PostCompletion([jsEngine, timerID] { jsEngine->CallTimerTask(timerID); });
+      },
+      std::min(std::chrono::milliseconds(millis / TIMER_TOLERANCE_DIVISOR), MAX_TIMER_TOLERANCE));
+  arguments.GetReturnValue().Set(timerID);
+}
 
-  jsEngine->GetTimer().SetTimer(std::chrono::milliseconds(millis), [jsEngine, timerParamsID] {
-    jsEngine->CallTimerTask(timerParamsID);
-  });
+void JsEngine::ClearTimer(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+{
+  auto jsEngine = FromArguments(arguments);
+  if (arguments.Length() < 1 || !arguments[0]->IsUint32())
+    return;
+  const uint32_t timerID =
+      CHECKED_TO_VALUE(arguments[0]->Uint32Value(arguments.GetIsolate()->GetCurrentContext()));
+  auto it = jsEngine->pendingTimers_.find(timerID);
+  if (it == jsEngine->pendingTimers_.end())
+    return;
+  const PendingTimer pendingTimer = it->second;
+  jsEngine->pendingTimers_.erase(it);
+  pendingTimer.handle.Cancel();
+  jsEngine->TakeJsValues(pendingTimer.paramsID);
 }
 
-void JsEngine::CallTimerTask(const JsWeakValuesID& timerParamsID)
+void JsEngine::CallTimerTask(uint32_t timerID)
 {
+  const JsContext context(GetIsolate(), *GetContext());
+  auto it = pendingTimers_.find(timerID);
+  if (it == pendingTimers_.end())
+    return; // cleared
+  const JsWeakValuesID timerParamsID = it->second.paramsID;
+  pendingTimers_.erase(it);
   auto timerParams = TakeJsValues(timerParamsID);
   JsValue callback = std::move(timerParams[0]);
 
@@ -156,14 +493,113 @@ void JsEngine::CallTimerTask(const JsWeakValuesID& timerParamsID)
   callback.Call(timerParams);
 }
 
+void JsEngine::PostCompletion(const Completion& completion)
+{
+  if (v8::Locker::IsLocked(GetIsolate()))
+  {
+    completion();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(completionsMutex_);
+    pendingCompletions_.push_back(completion);
+    if (deliveringCompletions_)
+      return;
+    deliveringCompletions_ = true;
+  }
+  DeliverCompletions();
+}
+
+void JsEngine::DeliverCompletions()
+{
+  const JsContext context(GetIsolate(), *GetContext());
+  std::vector<Completion> completions;
+  while (true)
+  {
+    {
+      std::lock_guard<std::mutex> lock(completionsMutex_);
+      completions.clear();
+      completions.swap(pendingCompletions_);
+      if (completions.empty())
+      {
+        deliveringCompletions_ = false;
+        return;
+      }
+    }
+    size_t delivered = 0;
+    {
+      // Promises resolved by the completions are settled afterwards, all
+      // at once.
+      const v8::Isolate::SuppressMicrotaskExecutionScope suppressMicrotasks(GetIsolate());
+      while (delivered < completions.size() &&
+             (delivered == 0 || !InteractivePriority::ShouldYield(GetIsolate())))
+      {
+        const auto& completion = completions[delivered++];
+        try
+        {
+          completion();
+        }
+        catch (const std::exception& e)
+        {
+          logSystem(LogSystem::LOG_LEVEL_ERROR,
+                    std::string("Uncaught exception in a completion: ") + e.what(),
+                    "JsEngine");
+        }
+        catch (...)
+        {
+          logSystem(LogSystem::LOG_LEVEL_ERROR, "Unknown exception in a completion", "JsEngine");
+        }
+      }
+    }
+    if (delivered < completions.size())
+    {
+      std::lock_guard<std::mutex> lock(completionsMutex_);
+      pendingCompletions_.insert(
+          pendingCompletions_.begin(), completions.begin() + delivered, completions.end());
+    }
+    GetIsolate()->PerformMicrotaskCheckpoint();
+    // No JS code is running now, so API calls waiting for the lock can't
+    // observe anything halfway.
+    InteractivePriority::YieldLock(GetIsolate());
+  }
+}
+
+uint32_t JsEngine::StoreFileWriter(std::unique_ptr<IFileSystem::IFileWriter> writer)
+{
+  const uint32_t writerID = nextFileWriterID_++;
+  fileWriters_[writerID] = std::move(writer);
+  return writerID;
+}
+
+IFileSystem::IFileWriter* JsEngine::GetFileWriter(uint32_t writerID) const
+{
+  auto it = fileWriters_.find(writerID);
+  return it != fileWriters_.end() ? it->second.get() : nullptr;
+}
+
+std::unique_ptr<IFileSystem::IFileWriter> JsEngine::TakeFileWriter(uint32_t writerID)
+{
+  std::unique_ptr<IFileSystem::IFileWriter> writer;
+  auto it = fileWriters_.find(writerID);
+  if (it != fileWriters_.end())
+  {
+    writer = std::move(it->second);
+    fileWriters_.erase(it);
+  }
+  return writer;
+}
+
 AdblockPlus::JsEngine::JsEngine(const Interfaces& interfaces,
-                                std::unique_ptr<IV8IsolateProvider> isolate)
+                                std::unique_ptr<IV8IsolateProvider> isolate,
+                                size_t compiledScriptCacheSize)
     : timer(interfaces.timer), fileSystem(interfaces.fileSystem), webRequest(interfaces.webRequest),
       logSystem(interfaces.logSystem), resourceReader(interfaces.resourceReader)
 #if !defined(MAKE_ISOLATE_IN_JS_VALUE_WEAK)
       ,
       isolate_(std::move(isolate))
 #endif
+      ,
+      compiledScripts_(compiledScriptCacheSize)
 {
 #if defined(MAKE_ISOLATE_IN_JS_VALUE_WEAK)
   this->isolate_ = std::shared_ptr<IV8IsolateProvider>(isolate.release());
@@ -172,6 +608,19 @@ AdblockPlus::JsEngine::JsEngine(const Interfaces& interfaces,
 
 JsEngine::~JsEngine()
 {
+  if (cpuProfiler_)
+  {
+    const v8::Locker locker(GetIsolate());
+    const v8::Isolate::Scope isolateScope(GetIsolate());
+    cpuProfiler_->Dispose();
+  }
+  if (deferredValueRelease_)
+  {
+    // Values destroyed from now on, e.g. the members, are reset right away.
+    const v8::Locker locker(GetIsolate());
+    const v8::Isolate::Scope isolateScope(GetIsolate());
+    DeferredRelease::Disable(GetIsolate());
+  }
   std::lock_guard<std::mutex> lock(jsWeakValuesListsMutex_);
   for (auto* weakValue : registeredWeakValues_)
     weakValue->Invalidate();
@@ -180,13 +629,18 @@ JsEngine::~JsEngine()
 std::unique_ptr<AdblockPlus::JsEngine>
 AdblockPlus::JsEngine::New(const AppInfo& appInfo,
                            const Interfaces& interfaces,
-                           std::unique_ptr<IV8IsolateProvider> isolate)
+                           std::unique_ptr<IV8IsolateProvider> isolate,
+                           const JsHeapLimits& heapLimits,
+                           MemoryProfile memoryProfile)
 {
   if (!isolate)
   {
-    isolate.reset(new ScopedV8Isolate());
+    isolate.reset(new ScopedV8Isolate(heapLimits, memoryProfile));
   }
-  std::unique_ptr<AdblockPlus::JsEngine> result(new JsEngine(interfaces, std::move(isolate)));
+  const size_t compiledScriptCacheSize =
+      memoryProfile == MemoryProfile::LOW_MEMORY ? 0 : COMPILED_SCRIPT_CACHE_SIZE;
+  std::unique_ptr<AdblockPlus::JsEngine> result(
+      new JsEngine(interfaces, std::move(isolate), compiledScriptCacheSize));
 
   const v8::Locker locker(result->GetIsolate());
   const v8::Isolate::Scope isolateScope(result->GetIsolate());
@@ -211,13 +665,177 @@ AdblockPlus::JsValue AdblockPlus::JsEngine::Evaluate(const std::string& source,
   auto isolate = GetIsolate();
   const JsContext context(isolate, *GetContext());
   const v8::TryCatch tryCatch(isolate);
-  auto script =
-      CHECKED_TO_LOCAL_WITH_TRY_CATCH(isolate, CompileScript(isolate, source, filename), tryCatch);
+  std::string compiledScriptKey;
+  v8::Local<v8::Script> script;
+  if (source.size() <= MAX_COMPILED_SCRIPT_SOURCE_LENGTH)
+  {
+    compiledScriptKey = filename + '\0' + source;
+    if (const auto* unboundScript = compiledScripts_.Get(compiledScriptKey))
+      script = v8::Local<v8::UnboundScript>::New(isolate, *unboundScript)->BindToCurrentContext();
+  }
+  if (script.IsEmpty())
+  {
+    script = CHECKED_TO_LOCAL_WITH_TRY_CATCH(
+        isolate, CompileWithCodeCache(source, filename), tryCatch);
+    if (!compiledScriptKey.empty())
+      compiledScripts_.Put(compiledScriptKey,
+                           v8::Global<v8::UnboundScript>(isolate, script->GetUnboundScript()));
+  }
   auto result =
       CHECKED_TO_LOCAL_WITH_TRY_CATCH(isolate, script->Run(isolate->GetCurrentContext()), tryCatch);
   return JsValue(GetIsolateProviderPtr(), GetContext(), result);
 }
 
+v8::MaybeLocal<v8::Script> JsEngine::CompileWithCodeCache(const std::string& source,
+                                                          const std::string& filename)
+{
+  auto isolate = GetIsolate();
+  auto cachedCode = codeCache_.end();
+  uint64_t sourceHash = 0;
+  if (!filename.empty() && (recordCodeCache_ || !codeCache_.empty()))
+  {
+    sourceHash = SourceHash(source);
+    cachedCode = codeCache_.find(filename);
+    if (cachedCode != codeCache_.end() && cachedCode->second.sourceHash != sourceHash)
+    {
+      codeCache_.erase(cachedCode);
+      cachedCode = codeCache_.end();
+    }
+  }
+  if (cachedCode == codeCache_.end() && !recordCodeCache_)
+    return CompileScript(isolate, source, filename);
+
+  bool rejected = false;
+  auto maybeScript = CompileCachedScript(isolate,
+                                         source,
+                                         filename,
+                                         cachedCode != codeCache_.end() ? cachedCode->second.data
+                                                                        : IFileSystem::IOBuffer(),
+                                         &rejected);
+  v8::Local<v8::Script> script;
+  if (!maybeScript.ToLocal(&script))
+    return maybeScript;
+  if (recordCodeCache_ && rejected && !filename.empty())
+  {
+    std::unique_ptr<v8::ScriptCompiler::CachedData> data(
+        v8::ScriptCompiler::CreateCodeCache(script->GetUnboundScript()));
+    if (data)
+    {
+      auto& entry = codeCache_[filename];
+      entry.sourceHash = sourceHash;
+      entry.data.assign(data->data, data->data + data->length);
+      codeCacheModified_ = true;
+    }
+  }
+  else if (!recordCodeCache_ && cachedCode != codeCache_.end())
+    codeCache_.erase(cachedCode);
+  return maybeScript;
+}
+
+JsValue JsEngine::GetApiFunction(const std::string& name)
+{
+  const JsContext context(GetIsolate(), *GetContext());
+  auto it = apiFunctions_.find(name);
+  if (it != apiFunctions_.end())
+    return it->second;
+
+  JsValue function = Evaluate("API").GetProperty(name);
+  if (!function.IsFunction())
+    throw std::runtime_error("API." + name + " is not a function");
+  return apiFunctions_.emplace(name, std::move(function)).first->second;
+}
+
+void JsEngine::SetCodeCache(CodeCache&& codeCache, bool recordMissing)
+{
+  const JsContext context(GetIsolate(), *GetContext());
+  codeCache_ = std::move(codeCache);
+  recordCodeCache_ = recordMissing;
+  codeCacheModified_ = false;
+}
+
+const JsEngine::CodeCache& JsEngine::GetCodeCache() const
+{
+  return codeCache_;
+}
+
+bool JsEngine::IsCodeCacheModified() const
+{
+  return codeCacheModified_;
+}
+
+// static
+IFileSystem::IOBuffer JsEngine::SerializeCodeCache(const CodeCache& codeCache)
+{
+  IFileSystem::IOBuffer data(std::begin(CODE_CACHE_MAGIC), std::end(CODE_CACHE_MAGIC));
+  WriteUInt32(CODE_CACHE_FORMAT_VERSION, &data);
+  // V8 also rejects data of another build or with other flags, the version
+  // only spares trying.
+  WriteString(v8::V8::GetVersion(), &data);
+  WriteUInt32(static_cast<uint32_t>(codeCache.size()), &data);
+  for (const auto& entry : codeCache)
+  {
+    WriteString(entry.first, &data);
+    WriteUInt32(static_cast<uint32_t>(entry.second.sourceHash), &data);
+    WriteUInt32(static_cast<uint32_t>(entry.second.sourceHash >> 32), &data);
+    WriteUInt32(static_cast<uint32_t>(entry.second.data.size()), &data);
+    data.insert(data.end(), entry.second.data.begin(), entry.second.data.end());
+  }
+  return data;
+}
+
+// static
+bool JsEngine::DeserializeCodeCache(const IFileSystem::IOBuffer& data, CodeCache* codeCache)
+{
+  codeCache->clear();
+  size_t pos = sizeof(CODE_CACHE_MAGIC);
+  uint32_t version = 0;
+  IFileSystem::IOBuffer v8Version;
+  uint32_t count = 0;
+  const std::string currentV8Version = v8::V8::GetVersion();
+  if (data.size() < pos ||
+      !std::equal(std::begin(CODE_CACHE_MAGIC), std::end(CODE_CACHE_MAGIC), data.begin()) ||
+      !ReadUInt32(data, &pos, &version) || version != CODE_CACHE_FORMAT_VERSION ||
+      !ReadBuffer(data, &pos, &v8Version) ||
+      std::string(v8Version.begin(), v8Version.end()) != currentV8Version ||
+      !ReadUInt32(data, &pos, &count))
+    return false;
+
+  bool valid = true;
+  for (uint32_t i = 0; valid && i < count; ++i)
+  {
+    IFileSystem::IOBuffer name;
+    uint32_t hashLow = 0;
+    uint32_t hashHigh = 0;
+    CodeCacheEntry entry;
+    valid = ReadBuffer(data, &pos, &name) && ReadUInt32(data, &pos, &hashLow) &&
+            ReadUInt32(data, &pos, &hashHigh) && ReadBuffer(data, &pos, &entry.data);
+    entry.sourceHash = static_cast<uint64_t>(hashHigh) << 32 | hashLow;
+    if (valid)
+      (*codeCache)[std::string(name.begin(), name.end())] = std::move(entry);
+  }
+  if (valid && pos == data.size())
+    return true;
+  codeCache->clear();
+  return false;
+}
+
+void JsEngine::ResolveApiFunctions()
+{
+  const JsContext context(GetIsolate(), *GetContext());
+  JsValue api = Evaluate("API");
+  for (const auto& name : api.GetOwnPropertyNames())
+  {
+    JsValue property = api.GetProperty(name);
+    if (!property.IsFunction())
+      continue;
+    auto it = apiFunctions_.find(name);
+    if (it != apiFunctions_.end())
+      it->second = std::move(property);
+    else
+      apiFunctions_.emplace(name, std::move(property));
+  }
+}
+
 void AdblockPlus::JsEngine::SetEventCallback(const std::string& eventName,
                                              const AdblockPlus::JsEngine::EventCallback& callback)
 {
@@ -250,6 +868,26 @@ void AdblockPlus::JsEngine::TriggerEvent(const std::string& eventName,
   callback(move(params));
 }
 
+void AdblockPlus::JsEngine::SetResponseBodyObserver(const ResponseBodyObserver& observer)
+{
+  std::atomic_store(&responseBodyObserver_,
+                    observer ? std::make_shared<const ResponseBodyObserver>(observer)
+                             : std::shared_ptr<const ResponseBodyObserver>());
+}
+
+void AdblockPlus::JsEngine::SetMemoryPressureObserver(const MemoryPressureObserver& observer)
+{
+  std::lock_guard<std::mutex> lock(memoryPressureObserverMutex_);
+  memoryPressureObserver_ = observer;
+}
+
+void AdblockPlus::JsEngine::ObserveResponseBody(const std::string& url,
+                                                const std::string& body) const
+{
+  if (auto observer = std::atomic_load(&responseBodyObserver_))
+    (*observer)(url, body);
+}
+
 void AdblockPlus::JsEngine::Gc()
 {
   while (!GetIsolate()->IdleNotificationDeadline(10))
@@ -266,6 +904,33 @@ AdblockPlus::JsValue AdblockPlus::JsEngine::NewValue(const std::string& val)
                  CHECKED_TO_LOCAL(isolate, Utils::ToV8String(isolate, val)));
 }
 
+JsValue JsEngine::NewExternalValue(std::string&& val)
+{
+  auto isolate = GetIsolate();
+  const JsContext context(isolate, *GetContext());
+  return JsValue(GetIsolateProviderPtr(),
+                 GetContext(),
+                 CHECKED_TO_LOCAL(isolate, Utils::ToV8ExternalString(isolate, std::move(val))));
+}
+
+JsValue JsEngine::NewExternalValue(StringBuffer&& val)
+{
+  auto isolate = GetIsolate();
+  const JsContext context(isolate, *GetContext());
+  return JsValue(GetIsolateProviderPtr(),
+                 GetContext(),
+                 CHECKED_TO_LOCAL(isolate, Utils::ToV8ExternalString(isolate, std::move(val))));
+}
+
+JsValue JsEngine::NewExternalValue(std::unique_ptr<IPreloadedFilterResponse> val)
+{
+  auto isolate = GetIsolate();
+  const JsContext context(isolate, *GetContext());
+  return JsValue(GetIsolateProviderPtr(),
+                 GetContext(),
+                 CHECKED_TO_LOCAL(isolate, Utils::ToV8ExternalString(isolate, std::move(val))));
+}
+
 AdblockPlus::JsValue AdblockPlus::JsEngine::NewValue(int64_t val)
 {
   const JsContext context(GetIsolate(), *GetContext());
@@ -307,6 +972,19 @@ JsValue JsEngine::NewArray(const std::vector<std::string>& values)
                  v8::Array::New(isolate, elements.data(), elements.size()));
 }
 
+JsValue JsEngine::NewValueArray(const JsValueList& values)
+{
+  const JsContext context(GetIsolate(), *GetContext());
+  std::vector<v8::Local<v8::Value>> elements;
+  elements.reserve(values.size());
+  for (const auto& cur : values)
+    elements.push_back(cur.UnwrapValue());
+
+  return JsValue(GetIsolateProviderPtr(),
+                 GetContext(),
+                 v8::Array::New(GetIsolate(), elements.data(), elements.size()));
+}
+
 AdblockPlus::JsValue AdblockPlus::JsEngine::NewCallback(const v8::FunctionCallback& callback)
 {
   auto isolate = GetIsolate();
@@ -331,37 +1009,59 @@ AdblockPlus::JsEngine::FromArguments(const v8::FunctionCallbackInfo<v8::Value>&
 
 JsEngine::JsWeakValuesID JsEngine::StoreJsValues(const JsValueList& values)
 {
-  JsWeakValuesLists::iterator it;
+  JsWeakValuesID retValue;
+  JsWeakValuesList* slot;
   {
     std::lock_guard<std::mutex> lock(jsWeakValuesListsMutex_);
-    it = jsWeakValuesLists_.emplace(jsWeakValuesLists_.end());
+    if (freeJsWeakValuesLists_.empty())
+    {
+      retValue.index = jsWeakValuesLists_.size();
+      jsWeakValuesLists_.emplace_back();
+    }
+    else
+    {
+      retValue.index = freeJsWeakValuesLists_.back();
+      freeJsWeakValuesLists_.pop_back();
+    }
+    slot = &jsWeakValuesLists_[retValue.index];
+    retValue.generation = slot->generation;
   }
   {
     JsContext context(GetIsolate(), *GetContext());
+    slot->values.reserve(values.size());
     for (const auto& value : values)
     {
-      it->values.emplace_back(GetIsolate(), value.UnwrapValue());
+      slot->values.emplace_back(GetIsolate(), value.UnwrapValue());
     }
   }
-  JsWeakValuesID retValue;
-  retValue.iterator = it;
   return retValue;
 }
 
+JsEngine::JsWeakValuesList& JsEngine::GetJsValuesSlot(const JsWeakValuesID& id)
+{
+  std::lock_guard<std::mutex> lock(jsWeakValuesListsMutex_);
+  assert(id.index < jsWeakValuesLists_.size());
+  auto& slot = jsWeakValuesLists_[id.index];
+  assert(slot.generation == id.generation);
+  return slot;
+}
+
 JsValueList JsEngine::TakeJsValues(const JsWeakValuesID& id)
 {
   JsValueList retValue;
+  auto& slot = GetJsValuesSlot(id);
+  JsContext context(GetIsolate(), *GetContext());
+  std::vector<v8::Global<v8::Value>> values(std::move(slot.values));
+  slot.values.clear();
+  for (const auto& v8Value : values)
   {
-    JsContext context(GetIsolate(), *GetContext());
-    for (const auto& v8Value : id.iterator->values)
-    {
-      retValue.emplace_back(JsValue(
-          GetIsolateProviderPtr(), GetContext(), v8::Local<v8::Value>::New(GetIsolate(), v8Value)));
-    }
+    retValue.emplace_back(JsValue(
+        GetIsolateProviderPtr(), GetContext(), v8::Local<v8::Value>::New(GetIsolate(), v8Value)));
   }
   {
     std::lock_guard<std::mutex> lock(jsWeakValuesListsMutex_);
-    jsWeakValuesLists_.erase(id.iterator);
+    ++slot.generation;
+    freeJsWeakValuesLists_.push_back(id.index);
   }
   return retValue;
 }
@@ -369,8 +1069,9 @@ JsValueList JsEngine::TakeJsValues(const JsWeakValuesID& id)
 JsValueList JsEngine::GetJsValues(const JsWeakValuesID& id)
 {
   JsValueList retValue;
+  const auto& slot = GetJsValuesSlot(id);
   JsContext context(GetIsolate(), *GetContext());
-  for (const auto& v8Value : id.iterator->values)
+  for (const auto& v8Value : slot.values)
   {
     retValue.emplace_back(JsValue(
         GetIsolateProviderPtr(), GetContext(), v8::Local<v8::Value>::New(GetIsolate(), v8Value)));
@@ -431,17 +1132,20 @@ IV8IsolateProviderPtr JsEngine::GetIsolateProviderPtr() const
 void JsEngine::RegisterScopedWeakValue(ScopedWeakValues::RegisteredWeakValue* value)
 {
   std::lock_guard<std::mutex> lock(jsWeakValuesListsMutex_);
-  assert(std::find(registeredWeakValues_.begin(), registeredWeakValues_.end(), value) ==
-         registeredWeakValues_.end());
+  value->registrationIndex = registeredWeakValues_.size();
   registeredWeakValues_.push_back(value);
 }
 
 void JsEngine::UnregisterScopedWeakValue(ScopedWeakValues::RegisteredWeakValue* value)
 {
   std::lock_guard<std::mutex> lock(jsWeakValuesListsMutex_);
-  auto elem = std::find(registeredWeakValues_.begin(), registeredWeakValues_.end(), value);
-  assert(elem != registeredWeakValues_.end());
-  registeredWeakValues_.erase(elem);
+  const size_t index = value->registrationIndex;
+  assert(index < registeredWeakValues_.size() && registeredWeakValues_[index] == value);
+  // Swap with the last entry so that unregistering doesn't depend on the
+  // number of registered values.
+  registeredWeakValues_[index] = registeredWeakValues_.back();
+  registeredWeakValues_[index]->registrationIndex = index;
+  registeredWeakValues_.pop_back();
 }
 
 JsEngine::ScopedWeakValues::ScopedWeakValues(JsEngine* jsEngine, const JsValueList& values)
@@ -453,7 +1157,7 @@ JsEngine::ScopedWeakValues::~ScopedWeakValues() = default;
 
 JsEngine::ScopedWeakValues::RegisteredWeakValue::RegisteredWeakValue(JsEngine* jsEngine,
                                                                      const JsValueList& values)
-    : engine(jsEngine)
+    : engine(jsEngine), registrationIndex(0)
 {
   engine->RegisterScopedWeakValue(this);
   weakId = engine->StoreJsValues(values);
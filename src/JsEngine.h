@@ -17,9 +17,11 @@
 
 #pragma once
 
+#include <chrono>
+#include <deque>
 #include <functional>
-#include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <stdint.h>
@@ -31,9 +33,18 @@
 #include <AdblockPlus/ITimer.h>
 #include <AdblockPlus/IV8IsolateProvider.h>
 #include <AdblockPlus/IWebRequest.h>
+#include <AdblockPlus/JsHeap.h>
 #include <AdblockPlus/JsValue.h>
 #include <AdblockPlus/LogSystem.h>
 
+#include "LatencyRecorder.h"
+#include "LruCache.h"
+
+namespace v8
+{
+  class CpuProfiler;
+}
+
 namespace AdblockPlus
 {
   class JsEngine;
@@ -49,8 +60,13 @@ namespace AdblockPlus
     {
       ~JsWeakValuesList();
       std::vector<v8::Global<v8::Value>> values;
+      // Incremented whenever the slot is released, so that stale IDs can be
+      // detected.
+      uint32_t generation = 0;
     };
-    typedef std::list<JsWeakValuesList> JsWeakValuesLists;
+    // Slots are recycled through a free list. A deque keeps references to the
+    // slots valid while new ones are appended.
+    typedef std::deque<JsWeakValuesList> JsWeakValuesLists;
 
     /**
      * An opaque structure representing ID of stored JsValueList.
@@ -58,7 +74,8 @@ namespace AdblockPlus
     class JsWeakValuesID
     {
       friend class JsEngine;
-      JsWeakValuesLists::const_iterator iterator;
+      size_t index = 0;
+      uint32_t generation = 0;
     };
 
   public:
@@ -111,8 +128,11 @@ namespace AdblockPlus
         void Invalidate();
 
       private:
+        friend class JsEngine;
         JsEngine* engine;
         JsWeakValuesID weakId;
+        // Position in JsEngine::registeredWeakValues_.
+        size_t registrationIndex;
       };
 
       friend class JsEngine;
@@ -126,11 +146,21 @@ namespace AdblockPlus
      * @param interfaces contains implementation for the interfaces JsEngine uses.
      * @param isolate A provider of v8::Isolate, if the value is nullptr then
      *        a default implementation is used.
+     * @param heapLimits Heap budget of the default isolate, ignored if
+     *        `isolate` is provided.
+     * @param memoryProfile With `MemoryProfile::LOW_MEMORY` the cache of
+     *        compiled scripts is disabled, and unless `isolate` is provided
+     *        unset `heapLimits` are capped and V8 runs in lite mode. V8
+     *        flags are process wide, they are taken from the first engine
+     *        which creates its own isolate.
      * @return New `JsEngine` instance.
      */
-    static std::unique_ptr<JsEngine> New(const AppInfo& appInfo,
-                                         const Interfaces& interfaces,
-                                         std::unique_ptr<IV8IsolateProvider> isolate = nullptr);
+    static std::unique_ptr<JsEngine>
+    New(const AppInfo& appInfo,
+        const Interfaces& interfaces,
+        std::unique_ptr<IV8IsolateProvider> isolate = nullptr,
+        const JsHeapLimits& heapLimits = JsHeapLimits(),
+        MemoryProfile memoryProfile = MemoryProfile::DEFAULT);
 
     /**
      * Registers the callback function for an event.
@@ -153,6 +183,29 @@ namespace AdblockPlus
      */
     void TriggerEvent(const std::string& eventName, JsValueList&& params);
 
+    /**
+     * Callback receiving the body of a successful GET response, see
+     * SetResponseBodyObserver().
+     */
+    typedef std::function<void(const std::string& url, const std::string& body)>
+        ResponseBodyObserver;
+
+    /**
+     * Sets the callback which receives the bodies of successful GET
+     * responses on the thread which downloaded them, before they are passed
+     * to JS. It is called without the engine lock, so it can do work on a
+     * body, e.g. parse a filter list, without blocking the engine.
+     * @param observer Callback, empty to remove it.
+     */
+    void SetResponseBodyObserver(const ResponseBodyObserver& observer);
+
+    /**
+     * Passes a response body to the callback set by SetResponseBodyObserver().
+     * @param url Request URL.
+     * @param body Response body.
+     */
+    void ObserveResponseBody(const std::string& url, const std::string& body) const;
+
     /**
      * Evaluates a JavaScript expression.
      * @param source JavaScript expression to evaluate.
@@ -162,6 +215,85 @@ namespace AdblockPlus
      */
     JsValue Evaluate(const std::string& source, const std::string& filename = "");
 
+    /**
+     * Retrieves a function of the global `API` object, see lib/api.js.
+     * A function is resolved only once, afterwards the persistent handle is
+     * returned, what saves compiling and running a script on every call.
+     * @param name Name of the function, e.g. "checkFilterMatch".
+     * @return The function.
+     * @throws std::runtime_error if `API` has no such function.
+     */
+    JsValue GetApiFunction(const std::string& name);
+
+    /**
+     * V8 code cache entry of an evaluated script.
+     */
+    struct CodeCacheEntry
+    {
+      /**
+       * Hash of the source the data was created for, an entry is only
+       * used for the same source.
+       */
+      uint64_t sourceHash = 0;
+      IFileSystem::IOBuffer data;
+
+      bool operator==(const CodeCacheEntry& entry) const
+      {
+        return sourceHash == entry.sourceHash && data == entry.data;
+      }
+    };
+
+    /**
+     * V8 code cache of evaluated scripts, by file name.
+     */
+    typedef std::map<std::string, CodeCacheEntry> CodeCache;
+
+    /**
+     * Sets the code cache used by Evaluate() for scripts with a file name.
+     * A script whose entry V8 accepts is not parsed and compiled again, the
+     * entry is dropped afterwards unless `recordMissing` is set.
+     * @param codeCache Code cache, e.g. the result of DeserializeCodeCache().
+     * @param recordMissing Whether an entry is to be created for every
+     *        evaluated script which has none, an outdated or a rejected
+     *        one, see GetCodeCache().
+     */
+    void SetCodeCache(CodeCache&& codeCache, bool recordMissing = false);
+
+    /**
+     * @return Current code cache, containing the entries recorded since
+     *         SetCodeCache() was called with `recordMissing`.
+     */
+    const CodeCache& GetCodeCache() const;
+
+    /**
+     * @return `true` if entries were recorded since the last call of
+     *         SetCodeCache(), i.e. the code cache is worth storing.
+     */
+    bool IsCodeCacheModified() const;
+
+    /**
+     * Stores a code cache in a versioned binary format, tagged with the
+     * V8 version.
+     * @param codeCache Code cache to store.
+     * @return Serialized code cache.
+     */
+    static IFileSystem::IOBuffer SerializeCodeCache(const CodeCache& codeCache);
+
+    /**
+     * Restores a code cache stored by SerializeCodeCache().
+     * @param data Serialized code cache.
+     * @param[out] codeCache Receives the restored entries.
+     * @return `false` and no entries if the data is corrupt or was written by
+     *         another version of the format or of V8.
+     */
+    static bool DeserializeCodeCache(const IFileSystem::IOBuffer& data, CodeCache* codeCache);
+
+    /**
+     * Resolves all functions of the global `API` object at once, so that the
+     * subsequent `GetApiFunction()` calls are served from the cache.
+     */
+    void ResolveApiFunctions();
+
     /**
      * Initiates a garbage collection.
      */
@@ -193,6 +325,20 @@ namespace AdblockPlus
 #endif
     //@}
 
+    //@{
+    /**
+     * Creates a string value which refers to the native buffer instead of
+     * copying it into the JavaScript heap, meant for large immutable data
+     * like filter lists. The value takes ownership of the buffer. Short
+     * strings and strings containing non-ASCII characters are copied.
+     * @param val Value to convert, UTF-8 encoded.
+     * @return New `JsValue` instance.
+     */
+    JsValue NewExternalValue(std::string&& val);
+    JsValue NewExternalValue(StringBuffer&& val);
+    JsValue NewExternalValue(std::unique_ptr<IPreloadedFilterResponse> val);
+    //@}
+
     /**
      * Creates a new JavaScript object.
      * @return New `JsValue` instance.
@@ -205,6 +351,12 @@ namespace AdblockPlus
      */
     JsValue NewArray(const std::vector<std::string>& values);
 
+    /**
+     * Creates a new JavaScript array of arbitrary values.
+     * @return New `JsValue` instance.
+     */
+    JsValue NewValueArray(const JsValueList& values);
+
     /**
      * Creates a JavaScript function that invokes a C++ callback.
      * @param callback C++ callback to invoke. The callback receives a
@@ -231,6 +383,13 @@ namespace AdblockPlus
      */
     static void ScheduleTimer(const v8::FunctionCallbackInfo<v8::Value>& arguments);
 
+    /*
+     * Private functionality required to implement timers.
+     * @param arguments `v8::FunctionCallbackInfo` is the arguments received in C++
+     * callback associated for global clearTimeout method.
+     */
+    static void ClearTimer(const v8::FunctionCallbackInfo<v8::Value>& arguments);
+
     /**
      * Private functionality required to implement web requests.
      * @param method `WebRequestMethod` is a request method.
@@ -263,10 +422,84 @@ namespace AdblockPlus
 
     /**
      * Notifies JS engine about critically low memory what should cause a
-     * garbage collection.
+     * garbage collection. Only V8 is told, see NotifyMemoryPressure().
      */
     void NotifyLowMemory();
 
+    /**
+     * Callback releasing native memory, see SetMemoryPressureObserver().
+     */
+    typedef std::function<void(MemoryPressureLevel level)> MemoryPressureObserver;
+
+    /**
+     * Sets the callback which NotifyMemoryPressure() calls after notifying
+     * V8. Once this returns, a previous callback is no longer running.
+     * @param observer Callback, empty to remove it.
+     */
+    void SetMemoryPressureObserver(const MemoryPressureObserver& observer);
+
+    /**
+     * Passes memory pressure reported by the host to V8 and then to the
+     * callback set by SetMemoryPressureObserver().
+     * @param level Memory pressure level.
+     */
+    void NotifyMemoryPressure(MemoryPressureLevel level);
+
+    /**
+     * Lets JsValue objects destroyed by threads which don't hold the lock
+     * of the isolate leave their handles to the next thread entering the
+     * engine instead of waiting for the lock.
+     */
+    void EnableDeferredValueRelease();
+
+    /**
+     * @return Current statistics of the V8 heap, including the ones of every
+     *         heap space.
+     */
+    JsHeapStatistics GetHeapStatistics();
+
+    /**
+     * @return Time from starting a web request of the JS code, e.g. a filter
+     *         list download, until its response arrives.
+     */
+    LatencyHistogram GetWebRequestStats() const
+    {
+      return webRequestTime_.GetSnapshot();
+    }
+
+    /**
+     * Lets V8 use some idle time for garbage collection.
+     * @param budget Time V8 may spend.
+     */
+    void NotifyIdle(std::chrono::milliseconds budget);
+
+    /**
+     * Starts sampling the JavaScript call stacks with the V8 CPU profiler.
+     * @param name Name of the profile, StopCpuProfile() writes it to
+     *        `<name>.cpuprofile`.
+     * @return `false` if a profile is being recorded already.
+     */
+    bool StartCpuProfile(const std::string& name);
+
+    /**
+     * Stops the profile started by StartCpuProfile() and writes it through
+     * the file system in the `.cpuprofile` format of the Chrome DevTools.
+     * @param callback Called with an error message or an empty string once
+     *        the profile is written, with an error right away if no profile
+     *        is being recorded.
+     */
+    void StopCpuProfile(const IFileSystem::Callback& callback);
+
+    /**
+     * Writes a snapshot of the V8 heap through the file system, in the
+     * `.heapsnapshot` format of the Chrome DevTools. Taking it pauses the
+     * engine, for large heaps for seconds.
+     * @param fileName File to write to.
+     * @param callback Called with an error message or an empty string once
+     *        the snapshot is written.
+     */
+    void TakeHeapSnapshot(const std::string& fileName, const IFileSystem::Callback& callback);
+
     ITimer& GetTimer() const
     {
       return timer;
@@ -292,16 +525,63 @@ namespace AdblockPlus
       return resourceReader;
     }
 
+    /**
+     * Keeps a writer opened by `_fileSystem.openWriter()`. The file writer
+     * functions have to be called with the isolate lock held.
+     * @param writer The writer to keep.
+     * @return ID of the writer for the JS code.
+     */
+    uint32_t StoreFileWriter(std::unique_ptr<IFileSystem::IFileWriter> writer);
+
+    /**
+     * @param writerID ID returned by StoreFileWriter().
+     * @return The writer or `nullptr` if there is none with the ID.
+     */
+    IFileSystem::IFileWriter* GetFileWriter(uint32_t writerID) const;
+
+    /**
+     * Gives up a writer kept by StoreFileWriter().
+     * @param writerID ID returned by StoreFileWriter().
+     * @return The writer or `nullptr` if there is none with the ID.
+     */
+    std::unique_ptr<IFileSystem::IFileWriter> TakeFileWriter(uint32_t writerID);
+
+    /**
+     * Callback of a timer, file system or web request operation which calls
+     * into JS, it locks the isolate itself as before.
+     */
+    typedef std::function<void()> Completion;
+
+    /**
+     * Runs a completion with the isolate locked. Completions posted while
+     * another thread is waiting for the lock to run its own are left to
+     * that thread, which runs them together under one lock acquisition and
+     * with one microtask checkpoint, so that promise chains resolved by
+     * many completions don't lock the isolate for each of them. API calls
+     * waiting for the lock get it between completions, see
+     * InteractivePriority. Threads holding the lock already run a
+     * completion right away.
+     * @param completion Completion, exceptions thrown by it are logged if
+     *        it's run along with others.
+     */
+    void PostCompletion(const Completion& completion);
+
   private:
-    void CallTimerTask(const JsWeakValuesID& timerParamsID);
+    void CallTimerTask(uint32_t timerID);
+    void DeliverCompletions();
 
-    JsEngine(const Interfaces& interfaces, std::unique_ptr<IV8IsolateProvider> isolate);
+    JsEngine(const Interfaces& interfaces,
+             std::unique_ptr<IV8IsolateProvider> isolate,
+             size_t compiledScriptCacheSize);
 
     JsValue GetGlobalObject();
+    v8::MaybeLocal<v8::Script> CompileWithCodeCache(const std::string& source,
+                                                    const std::string& filename);
     friend class ScopedWeakValues::RegisteredWeakValue;
     JsWeakValuesID StoreJsValues(const JsValueList& values);
     JsValueList TakeJsValues(const JsWeakValuesID& id);
     JsValueList GetJsValues(const JsWeakValuesID& id);
+    JsWeakValuesList& GetJsValuesSlot(const JsWeakValuesID& id);
     void RegisterScopedWeakValue(ScopedWeakValues::RegisteredWeakValue* value);
     void UnregisterScopedWeakValue(ScopedWeakValues::RegisteredWeakValue* value);
 
@@ -338,8 +618,46 @@ namespace AdblockPlus
     v8::Global<v8::Context> context_;
     EventMap eventCallbacks_;
     std::mutex eventCallbacksMutex_;
+    // Read by the threads of web requests, always use std::atomic_load() and
+    // std::atomic_store().
+    std::shared_ptr<const ResponseBodyObserver> responseBodyObserver_;
+    // Called with the mutex held, so that removing it waits for a running call.
+    MemoryPressureObserver memoryPressureObserver_;
+    std::mutex memoryPressureObserverMutex_;
     JsWeakValuesLists jsWeakValuesLists_;
+    std::vector<size_t> freeJsWeakValuesLists_;
     std::mutex jsWeakValuesListsMutex_;
     std::vector<ScopedWeakValues::RegisteredWeakValue*> registeredWeakValues_;
+    // Guarded by the isolate lock, see JsContext.
+    std::map<std::string, JsValue> apiFunctions_;
+    struct PendingTimer
+    {
+      TimerHandle handle;
+      JsWeakValuesID paramsID;
+    };
+    // Timers set by setTimeout() by their ID, guarded by the isolate lock.
+    std::map<uint32_t, PendingTimer> pendingTimers_;
+    uint32_t nextTimerID_ = 1;
+    // Writers opened by `_fileSystem.openWriter()` by their ID, guarded by
+    // the isolate lock as well.
+    std::map<uint32_t, std::unique_ptr<IFileSystem::IFileWriter>> fileWriters_;
+    uint32_t nextFileWriterID_ = 1;
+    // Guarded by the isolate lock as well.
+    CodeCache codeCache_;
+    bool recordCodeCache_ = false;
+    bool codeCacheModified_ = false;
+    // Recently evaluated small scripts by file name and source, guarded by the
+    // isolate lock as well.
+    LruCache<std::string, v8::Global<v8::UnboundScript>> compiledScripts_;
+    // Only exists while a profile is recorded, guarded by the isolate lock as
+    // well.
+    v8::CpuProfiler* cpuProfiler_ = nullptr;
+    std::mutex completionsMutex_;
+    std::vector<Completion> pendingCompletions_;
+    // Whether a thread is running or about to run the pending completions.
+    bool deliveringCompletions_ = false;
+    bool deferredValueRelease_ = false;
+    std::string cpuProfileName_;
+    LatencyRecorder webRequestTime_;
   };
 }
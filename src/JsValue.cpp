@@ -18,6 +18,7 @@
 #include <AdblockPlus.h>
 #include <vector>
 
+#include "DeferredRelease.h"
 #include "JsContext.h"
 #include "JsError.h"
 #include "Utils.h"
@@ -45,9 +46,12 @@ AdblockPlus::JsValue::~JsValue()
 {
   if (isolate_)
   {
-    if (isolate_->Get())
+    if (v8::Isolate* isolate = isolate_->Get())
     {
-      const JsContext context(isolate_->Get(), *jsContext_);
+      // Threads which don't hold the lock hand the handle over if they may.
+      if (!v8::Locker::IsLocked(isolate) && DeferredRelease::Defer(isolate, &value_))
+        return;
+      const JsContext context(isolate, *jsContext_);
       value_.Reset();
     }
     else
@@ -184,6 +188,98 @@ AdblockPlus::JsValueList AdblockPlus::JsValue::AsList() const
   return result;
 }
 
+std::vector<std::string> AdblockPlus::JsValue::AsStringVector() const
+{
+  if (!IsArray())
+    throw std::runtime_error("Cannot convert a non-array to list");
+
+  const JsContext context(isolate_->Get(), *jsContext_);
+  auto currentContext = isolate_->Get()->GetCurrentContext();
+  v8::Local<v8::Array> array = v8::Local<v8::Array>::Cast(UnwrapValue());
+  uint32_t length = array->Length();
+  std::vector<std::string> result;
+  result.reserve(length);
+  for (uint32_t i = 0; i < length; i++)
+  {
+    const v8::HandleScope handleScope(isolate_->Get());
+    v8::Local<v8::Value> item = CHECKED_TO_LOCAL(isolate_->Get(), array->Get(currentContext, i));
+    result.push_back(Utils::FromV8String(isolate_->Get(), item));
+  }
+  return result;
+}
+
+std::vector<int64_t> AdblockPlus::JsValue::AsInt64Vector() const
+{
+  if (!IsArray())
+    throw std::runtime_error("Cannot convert a non-array to list");
+
+  const JsContext context(isolate_->Get(), *jsContext_);
+  auto currentContext = isolate_->Get()->GetCurrentContext();
+  v8::Local<v8::Array> array = v8::Local<v8::Array>::Cast(UnwrapValue());
+  uint32_t length = array->Length();
+  std::vector<int64_t> result;
+  result.reserve(length);
+  for (uint32_t i = 0; i < length; i++)
+  {
+    const v8::HandleScope handleScope(isolate_->Get());
+    v8::Local<v8::Value> item = CHECKED_TO_LOCAL(isolate_->Get(), array->Get(currentContext, i));
+    result.push_back(CHECKED_TO_VALUE(item->IntegerValue(currentContext)));
+  }
+  return result;
+}
+
+void AdblockPlus::JsValue::VisitObjects(const std::vector<std::string>& properties,
+                                        const FieldVisitor& visitor) const
+{
+  if (!IsArray())
+    throw std::runtime_error("Cannot convert a non-array to list");
+
+  const JsContext context(isolate_->Get(), *jsContext_);
+  auto currentContext = isolate_->Get()->GetCurrentContext();
+  std::vector<v8::Local<v8::String>> keys;
+  keys.reserve(properties.size());
+  for (const auto& property : properties)
+    keys.push_back(CHECKED_TO_LOCAL(isolate_->Get(), Utils::ToV8String(isolate_->Get(), property)));
+
+  v8::Local<v8::Array> array = v8::Local<v8::Array>::Cast(UnwrapValue());
+  uint32_t length = array->Length();
+  for (uint32_t i = 0; i < length; i++)
+  {
+    const v8::HandleScope handleScope(isolate_->Get());
+    v8::Local<v8::Value> item = CHECKED_TO_LOCAL(isolate_->Get(), array->Get(currentContext, i));
+    if (!item->IsObject())
+      throw std::runtime_error("Attempting to get property of a non-object");
+    v8::Local<v8::Object> object = v8::Local<v8::Object>::Cast(item);
+    JsFieldReader fields(isolate_->Get(), currentContext);
+    fields.fields_.reserve(keys.size());
+    for (const auto& key : keys)
+      fields.fields_.push_back(CHECKED_TO_LOCAL(isolate_->Get(), object->Get(currentContext, key)));
+    visitor(fields);
+  }
+}
+
+void AdblockPlus::JsValue::VisitRecords(size_t fieldCount, const FieldVisitor& visitor) const
+{
+  if (!IsArray())
+    throw std::runtime_error("Cannot convert a non-array to list");
+  if (fieldCount == 0)
+    return;
+
+  const JsContext context(isolate_->Get(), *jsContext_);
+  auto currentContext = isolate_->Get()->GetCurrentContext();
+  v8::Local<v8::Array> array = v8::Local<v8::Array>::Cast(UnwrapValue());
+  uint32_t length = array->Length();
+  for (uint32_t start = 0; start + fieldCount <= length; start += fieldCount)
+  {
+    const v8::HandleScope handleScope(isolate_->Get());
+    JsFieldReader fields(isolate_->Get(), currentContext);
+    fields.fields_.reserve(fieldCount);
+    for (uint32_t i = start; i < start + fieldCount; i++)
+      fields.fields_.push_back(CHECKED_TO_LOCAL(isolate_->Get(), array->Get(currentContext, i)));
+    visitor(fields);
+  }
+}
+
 std::vector<std::string> AdblockPlus::JsValue::GetOwnPropertyNames() const
 {
   if (!IsObject())
@@ -193,11 +289,7 @@ std::vector<std::string> AdblockPlus::JsValue::GetOwnPropertyNames() const
   v8::Local<v8::Object> object = v8::Local<v8::Object>::Cast(UnwrapValue());
   auto propertyNames = CHECKED_TO_LOCAL(
       isolate_->Get(), object->GetOwnPropertyNames(isolate_->Get()->GetCurrentContext()));
-  JsValueList properties = JsValue(isolate_, jsContext_, propertyNames).AsList();
-  std::vector<std::string> result;
-  for (const auto& property : properties)
-    result.push_back(property.AsString());
-  return result;
+  return JsValue(isolate_, jsContext_, propertyNames).AsStringVector();
 }
 
 AdblockPlus::JsValue AdblockPlus::JsValue::GetProperty(const std::string& name) const
@@ -337,3 +429,38 @@ JsValue JsValue::Call(std::vector<v8::Local<v8::Value>>& args, v8::Local<v8::Obj
 
   return JsValue(isolate_, jsContext_, result);
 }
+
+AdblockPlus::JsFieldReader::JsFieldReader(v8::Isolate* isolate, v8::Local<v8::Context> context)
+    : isolate_(isolate), context_(context)
+{
+}
+
+size_t AdblockPlus::JsFieldReader::GetFieldCount() const
+{
+  return fields_.size();
+}
+
+bool AdblockPlus::JsFieldReader::IsNull(size_t index) const
+{
+  return fields_.at(index)->IsNull();
+}
+
+std::string AdblockPlus::JsFieldReader::AsString(size_t index) const
+{
+  return Utils::FromV8String(isolate_, fields_.at(index));
+}
+
+int64_t AdblockPlus::JsFieldReader::AsInt(size_t index) const
+{
+  return CHECKED_TO_VALUE(fields_.at(index)->IntegerValue(context_));
+}
+
+bool AdblockPlus::JsFieldReader::AsBool(size_t index) const
+{
+  return fields_.at(index)->BooleanValue(isolate_);
+}
+
+double AdblockPlus::JsFieldReader::AsDouble(size_t index) const
+{
+  return CHECKED_TO_VALUE(fields_.at(index)->NumberValue(context_));
+}
@@ -0,0 +1,81 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LatencyRecorder.h"
+
+#include <algorithm>
+
+using namespace AdblockPlus;
+
+const size_t LatencyHistogram::BUCKET_COUNT;
+
+uint64_t LatencyHistogram::GetCount() const
+{
+  uint64_t count = 0;
+  for (uint64_t bucket : buckets)
+    count += bucket;
+  return count;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double percentile) const
+{
+  const uint64_t count = GetCount();
+  if (count == 0)
+    return 0;
+  const double rank = std::min(std::max(percentile, 0.0), 100.0) * count / 100;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BUCKET_COUNT - 1; ++i)
+  {
+    seen += buckets[i];
+    if (seen > 0 && seen >= rank)
+      return std::min(uint64_t(1) << i, maxMicroseconds);
+  }
+  return maxMicroseconds;
+}
+
+LatencyRecorder::LatencyRecorder() : totalMicroseconds_(0), maxMicroseconds_(0)
+{
+  for (auto& bucket : buckets_)
+    bucket.store(0, std::memory_order_relaxed);
+}
+
+void LatencyRecorder::Record(std::chrono::steady_clock::duration duration)
+{
+  const auto microseconds = static_cast<uint64_t>(
+      std::max(std::chrono::duration_cast<std::chrono::microseconds>(duration).count(),
+               std::chrono::microseconds::rep(0)));
+  size_t bucket = 0;
+  while (bucket < LatencyHistogram::BUCKET_COUNT - 1 && (microseconds >> bucket))
+    ++bucket;
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  totalMicroseconds_.fetch_add(microseconds, std::memory_order_relaxed);
+  uint64_t max = maxMicroseconds_.load(std::memory_order_relaxed);
+  while (microseconds > max &&
+         !maxMicroseconds_.compare_exchange_weak(max, microseconds, std::memory_order_relaxed))
+  {
+  }
+}
+
+LatencyHistogram LatencyRecorder::GetSnapshot() const
+{
+  LatencyHistogram histogram;
+  for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i)
+    histogram.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+  histogram.totalMicroseconds = totalMicroseconds_.load(std::memory_order_relaxed);
+  histogram.maxMicroseconds = maxMicroseconds_.load(std::memory_order_relaxed);
+  return histogram;
+}
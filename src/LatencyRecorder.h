@@ -0,0 +1,46 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <AdblockPlus/LatencyHistogram.h>
+
+namespace AdblockPlus
+{
+  /**
+   * Lock free recorder of a `LatencyHistogram`.
+   */
+  class LatencyRecorder
+  {
+  public:
+    LatencyRecorder();
+    LatencyRecorder(const LatencyRecorder&) = delete;
+    LatencyRecorder& operator=(const LatencyRecorder&) = delete;
+
+    void Record(std::chrono::steady_clock::duration duration);
+    LatencyHistogram GetSnapshot() const;
+
+  private:
+    std::atomic<uint64_t> buckets_[LatencyHistogram::BUCKET_COUNT];
+    std::atomic<uint64_t> totalMicroseconds_;
+    std::atomic<uint64_t> maxMicroseconds_;
+  };
+}
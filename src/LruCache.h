@@ -0,0 +1,134 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <iterator>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace AdblockPlus
+{
+  /**
+   * Bounded map which evicts the least recently used entry first.
+   * Not thread safe.
+   */
+  template<class Key, class Value, class Hash = std::hash<Key>> class LruCache
+  {
+  public:
+    typedef std::list<std::pair<Key, Value>> Entries;
+
+    /**
+     * @param capacity Maximum number of entries, 0 disables the cache.
+     */
+    explicit LruCache(size_t capacity = 0) : capacity(capacity)
+    {
+    }
+
+    size_t Capacity() const
+    {
+      return capacity;
+    }
+
+    size_t Size() const
+    {
+      return index.size();
+    }
+
+    /**
+     * Looks up an entry and marks it as the most recently used one.
+     * @return Pointer to the value, valid until the cache is modified, or
+     *         `nullptr` if there is none.
+     */
+    const Value* Get(const Key& key)
+    {
+      auto it = index.find(key);
+      if (it == index.end())
+        return nullptr;
+      entries.splice(entries.begin(), entries, it->second);
+      return &it->second->second;
+    }
+
+    /**
+     * Inserts or replaces an entry.
+     * @param evicted If not `nullptr`, receives the entries pushed out of the
+     *        cache, so that the caller can destroy them later, e.g. after
+     *        releasing a lock.
+     */
+    void Put(const Key& key, Value value, Entries* evicted = nullptr)
+    {
+      if (capacity == 0)
+        return;
+      auto it = index.find(key);
+      if (it != index.end())
+      {
+        it->second->second = std::move(value);
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+      }
+      while (index.size() >= capacity)
+      {
+        auto last = std::prev(entries.end());
+        index.erase(last->first);
+        if (evicted)
+          evicted->splice(evicted->end(), entries, last);
+        else
+          entries.erase(last);
+      }
+      entries.emplace_front(key, std::move(value));
+      index.emplace(key, entries.begin());
+    }
+
+    /**
+     * Evicts the least recently used entries until at most `size` are left,
+     * the capacity stays as it is.
+     * @param removed If not `nullptr`, receives the evicted entries.
+     */
+    void Trim(size_t size, Entries* removed = nullptr)
+    {
+      while (index.size() > size)
+      {
+        auto last = std::prev(entries.end());
+        index.erase(last->first);
+        if (removed)
+          removed->splice(removed->end(), entries, last);
+        else
+          entries.erase(last);
+      }
+    }
+
+    /**
+     * Removes all entries.
+     * @param removed If not `nullptr`, receives the removed entries.
+     */
+    void Clear(Entries* removed = nullptr)
+    {
+      index.clear();
+      if (removed)
+        removed->splice(removed->end(), entries);
+      else
+        entries.clear();
+    }
+
+  private:
+    size_t capacity;
+    Entries entries;
+    std::unordered_map<Key, typename Entries::iterator, Hash> index;
+  };
+}
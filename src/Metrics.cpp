@@ -0,0 +1,199 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <AdblockPlus/Metrics.h>
+
+#include <sstream>
+#include <utility>
+#include <vector>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  typedef std::vector<std::pair<std::string, std::string>> Labels;
+
+  std::string FormatLabels(const Labels& labels)
+  {
+    if (labels.empty())
+      return "";
+    std::string result = "{";
+    for (const auto& label : labels)
+    {
+      if (result.size() > 1)
+        result += ',';
+      result += label.first + "=\"";
+      for (char c : label.second)
+      {
+        if (c == '\\' || c == '"')
+          result += '\\';
+        if (c == '\n')
+          result += "\\n";
+        else
+          result += c;
+      }
+      result += '"';
+    }
+    return result + '}';
+  }
+
+  // Enough digits for the sums, the bucket bounds still come out short.
+  const int PRECISION = 15;
+
+  class Writer
+  {
+  public:
+    Writer()
+    {
+      out.precision(PRECISION);
+    }
+
+    void Family(const std::string& name, const char* type, const char* unit, const char* help)
+    {
+      out << "# TYPE " << name << " " << type << "\n";
+      if (*unit)
+        out << "# UNIT " << name << " " << unit << "\n";
+      out << "# HELP " << name << " " << help << "\n";
+    }
+
+    template<typename T>
+    void Sample(const std::string& name, const Labels& labels, T value)
+    {
+      out << name << FormatLabels(labels) << " " << value << "\n";
+    }
+
+    void Histogram(const std::string& name, Labels labels, const LatencyHistogram& histogram)
+    {
+      // The last bucket has no upper bound.
+      uint64_t cumulative = 0;
+      labels.emplace_back("le", "");
+      for (size_t i = 0; i + 1 < LatencyHistogram::BUCKET_COUNT; ++i)
+      {
+        cumulative += histogram.buckets[i];
+        std::ostringstream bound;
+        bound.precision(PRECISION);
+        bound << static_cast<double>(uint64_t(1) << i) / 1e6;
+        labels.back().second = bound.str();
+        Sample(name + "_bucket", labels, cumulative);
+      }
+      labels.back().second = "+Inf";
+      Sample(name + "_bucket", labels, histogram.GetCount());
+      labels.pop_back();
+      Sample(name + "_count", labels, histogram.GetCount());
+      Sample(name + "_sum", labels, histogram.totalMicroseconds / 1e6);
+    }
+
+    std::string Finish()
+    {
+      out << "# EOF\n";
+      return out.str();
+    }
+
+  private:
+    std::ostringstream out;
+  };
+}
+
+std::string AdblockPlus::FormatOpenMetrics(const MetricsSnapshot& snapshot)
+{
+  Writer writer;
+  const JsHeapStatistics& heap = snapshot.heap;
+  writer.Family("abp_js_heap_size_bytes", "gauge", "bytes", "Committed size of the V8 heap.");
+  writer.Sample("abp_js_heap_size_bytes", {}, heap.totalHeapSize);
+  writer.Family("abp_js_heap_used_bytes", "gauge", "bytes", "Used size of the V8 heap.");
+  writer.Sample("abp_js_heap_used_bytes", {}, heap.usedHeapSize);
+  writer.Family("abp_js_heap_limit_bytes", "gauge", "bytes", "Size limit of the V8 heap.");
+  writer.Sample("abp_js_heap_limit_bytes", {}, heap.heapSizeLimit);
+  writer.Family("abp_js_heap_physical_bytes", "gauge", "bytes", "Physical size of the V8 heap.");
+  writer.Sample("abp_js_heap_physical_bytes", {}, heap.totalPhysicalSize);
+  writer.Family(
+      "abp_js_external_memory_bytes", "gauge", "bytes", "Memory of external V8 objects.");
+  writer.Sample("abp_js_external_memory_bytes", {}, heap.externalMemory);
+  writer.Family(
+      "abp_js_malloced_memory_bytes", "gauge", "bytes", "Memory allocated by V8 off the heap.");
+  writer.Sample("abp_js_malloced_memory_bytes", {}, heap.mallocedMemory);
+  writer.Family("abp_js_heap_space_used_bytes", "gauge", "bytes", "Used size of a V8 heap space.");
+  for (const auto& space : heap.spaces)
+    writer.Sample("abp_js_heap_space_used_bytes", {{"space", space.name}}, space.usedSize);
+
+  if (snapshot.hasFilterEngine)
+  {
+    const std::pair<const char*, const IFilterEngine::MatchCacheStats*> caches[] = {
+        {"match", &snapshot.matchCache}, {"style_sheet", &snapshot.styleSheetCache}};
+    writer.Family("abp_cache_hits", "counter", "", "Lookups answered by a cache.");
+    for (const auto& cache : caches)
+      writer.Sample("abp_cache_hits_total", {{"cache", cache.first}}, cache.second->hits);
+    writer.Family("abp_cache_misses", "counter", "", "Lookups missed by a cache.");
+    for (const auto& cache : caches)
+      writer.Sample("abp_cache_misses_total", {{"cache", cache.first}}, cache.second->misses);
+    writer.Family("abp_cache_entries", "gauge", "", "Entries of a cache.");
+    for (const auto& cache : caches)
+      writer.Sample("abp_cache_entries", {{"cache", cache.first}}, cache.second->size);
+    writer.Family("abp_cache_capacity", "gauge", "", "Maximum number of entries of a cache.");
+    for (const auto& cache : caches)
+      writer.Sample("abp_cache_capacity", {{"cache", cache.first}}, cache.second->capacity);
+
+    writer.Family("abp_api_calls", "counter", "", "Calls of a filter engine method.");
+    for (const auto& it : snapshot.apiCalls)
+      writer.Sample("abp_api_calls_total", {{"method", it.first}}, it.second.calls);
+    writer.Family("abp_api_call_duration_seconds",
+                  "histogram",
+                  "seconds",
+                  "Time spent in a filter engine method apart from waiting for the JS engine.");
+    for (const auto& it : snapshot.apiCalls)
+      writer.Histogram(
+          "abp_api_call_duration_seconds", {{"method", it.first}}, it.second.execution);
+    writer.Family("abp_api_lock_wait_seconds",
+                  "histogram",
+                  "seconds",
+                  "Time a filter engine method waited for the JS engine.");
+    for (const auto& it : snapshot.apiCalls)
+      writer.Histogram("abp_api_lock_wait_seconds", {{"method", it.first}}, it.second.lockWait);
+  }
+
+  writer.Family("abp_executor_queued_tasks", "gauge", "", "Tasks waiting to be executed.");
+  writer.Sample("abp_executor_queued_tasks", {}, snapshot.executor.queuedTasks);
+  writer.Family("abp_executor_active_threads", "gauge", "", "Threads executing a task.");
+  writer.Sample("abp_executor_active_threads", {}, snapshot.executor.activeThreads);
+  writer.Family("abp_executor_wait_seconds",
+                "histogram",
+                "seconds",
+                "Time from dispatching a task until it starts.");
+  writer.Histogram("abp_executor_wait_seconds", {}, snapshot.executor.waitTime);
+  writer.Family("abp_executor_run_seconds", "histogram", "seconds", "Execution time of a task.");
+  writer.Histogram("abp_executor_run_seconds", {}, snapshot.executor.runTime);
+
+  writer.Family(
+      "abp_timer_pending_timers", "gauge", "", "Timers which are neither fired nor cancelled.");
+  writer.Sample("abp_timer_pending_timers", {}, snapshot.timer.pendingTimers);
+  writer.Family("abp_timer_wakeups", "counter", "", "Wakeups of the timer.");
+  writer.Sample("abp_timer_wakeups_total", {}, snapshot.timer.wakeups);
+  writer.Family("abp_timer_delay_seconds",
+                "histogram",
+                "seconds",
+                "Time from when a timer is due until its callback is called.");
+  writer.Histogram("abp_timer_delay_seconds", {}, snapshot.timer.delay);
+  writer.Family(
+      "abp_timer_run_seconds", "histogram", "seconds", "Execution time of a timer callback.");
+  writer.Histogram("abp_timer_run_seconds", {}, snapshot.timer.runTime);
+
+  writer.Family("abp_web_request_duration_seconds",
+                "histogram",
+                "seconds",
+                "Time until the response of a filter list download or other web request.");
+  writer.Histogram("abp_web_request_duration_seconds", {}, snapshot.webRequests);
+  return writer.Finish();
+}
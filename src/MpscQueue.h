@@ -0,0 +1,158 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace AdblockPlus
+{
+  /**
+   * Unbounded multi-producer single-consumer queue. Producers push without
+   * taking a lock, the consumer takes everything pending at once.
+   *
+   * Pushed values form a stack which the consumer swaps out atomically and
+   * reverses, so there is no ABA problem and no node is reused. A producer
+   * only takes the mutex to wake the consumer up if the queue was empty.
+   */
+  template<typename T> class MpscQueue
+  {
+  public:
+    MpscQueue() : head(nullptr)
+    {
+    }
+
+    ~MpscQueue()
+    {
+      DeleteNodes(head.exchange(nullptr));
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /**
+     * Adds `value` to the end, can be called from any thread.
+     */
+    void Push(const T& value)
+    {
+      PushNode(new Node(value));
+    }
+
+    void Push(T&& value)
+    {
+      PushNode(new Node(std::move(value)));
+    }
+
+    /**
+     * Moves all pending values to the end of `values` in the order in which
+     * they were pushed by each producer. Blocks until there is at least one.
+     * Must only be called by the consumer thread.
+     */
+    void PopAll(std::vector<T>* values)
+    {
+      Node* taken = head.exchange(nullptr, std::memory_order_acquire);
+      if (!taken)
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        conditionVar.wait(lock, [this, &taken]() -> bool {
+          taken = head.exchange(nullptr, std::memory_order_acquire);
+          return taken != nullptr;
+        });
+      }
+      MoveNodes(taken, values);
+    }
+
+    /**
+     * Same as PopAll(), but returns right away if there is nothing pending.
+     * @return `false` if no value was pending.
+     */
+    bool TryPopAll(std::vector<T>* values)
+    {
+      Node* taken = head.exchange(nullptr, std::memory_order_acquire);
+      if (!taken)
+        return false;
+      MoveNodes(taken, values);
+      return true;
+    }
+
+  private:
+    struct Node
+    {
+      template<typename U> explicit Node(U&& value) : value(std::forward<U>(value)), next(nullptr)
+      {
+      }
+
+      T value;
+      Node* next;
+    };
+
+    static void MoveNodes(Node* taken, std::vector<T>* values)
+    {
+      // The stack holds the most recent value first.
+      Node* reversed = nullptr;
+      while (taken)
+      {
+        Node* next = taken->next;
+        taken->next = reversed;
+        reversed = taken;
+        taken = next;
+      }
+      while (reversed)
+      {
+        Node* next = reversed->next;
+        values->push_back(std::move(reversed->value));
+        delete reversed;
+        reversed = next;
+      }
+    }
+
+    void PushNode(Node* node)
+    {
+      Node* previous = head.load(std::memory_order_relaxed);
+      do
+      {
+        node->next = previous;
+      } while (!head.compare_exchange_weak(
+          previous, node, std::memory_order_release, std::memory_order_relaxed));
+      if (previous)
+        return;
+      // The consumer checks the head with the mutex held before waiting.
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+      }
+      conditionVar.notify_one();
+    }
+
+    static void DeleteNodes(Node* node)
+    {
+      while (node)
+      {
+        Node* next = node->next;
+        delete node;
+        node = next;
+      }
+    }
+
+    std::atomic<Node*> head;
+    std::mutex mutex;
+    std::condition_variable conditionVar;
+  };
+}
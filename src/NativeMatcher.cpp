@@ -0,0 +1,1036 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "NativeMatcher.h"
+
+#include <algorithm>
+#include <functional>
+
+#include <AdblockPlus/URLInfo.h>
+
+#include "HostCache.h"
+#include "URLTokenizer.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  typedef IFilterEngine::ContentType ContentType;
+
+  const uint8_t INDEX_MAGIC[] = {'A', 'B', 'P', 'M'};
+  // Increase whenever the format or the semantics of the matcher change.
+  const uint32_t INDEX_VERSION = 1;
+
+  // Typical overhead of a node of std::unordered_map and of the control
+  // block of std::make_shared(), not counting the value itself.
+  const size_t HASH_NODE_OVERHEAD = 2 * sizeof(void*);
+  const size_t SHARED_POINTER_OVERHEAD = 2 * sizeof(void*);
+
+  // Steps a regular expression may take per request before the request is
+  // left to JS, a few times the length of a long URL for a simple one.
+  const size_t REGEXP_BUDGET = 100000;
+
+  // Filters with more content types than this are not listed by type, they
+  // would take a slot in too many lists.
+  const size_t MAX_PARTITIONED_TYPES = 3;
+
+  size_t CountBits(uint32_t value)
+  {
+    size_t count = 0;
+    for (; value; value &= value - 1)
+      ++count;
+    return count;
+  }
+
+  size_t GetAllocatedSize(const std::string& str)
+  {
+    static const size_t inlineCapacity = std::string().capacity();
+    return str.capacity() > inlineCapacity ? str.capacity() + 1 : 0;
+  }
+
+  template<class T> void AppendInteger(T value, std::vector<uint8_t>* data)
+  {
+    for (size_t i = 0; i < sizeof(T); ++i)
+      data->push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+
+  template<class T> bool ReadInteger(const std::vector<uint8_t>& data, size_t* offset, T* value)
+  {
+    if (data.size() - *offset < sizeof(T))
+      return false;
+    *value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+      *value |= static_cast<T>(data[*offset + i]) << (8 * i);
+    *offset += sizeof(T);
+    return true;
+  }
+
+  // RegExpFilter.prototype.contentType, i.e. everything below POPUP.
+  const uint32_t RESOURCE_TYPES = (1u << 24) - 1;
+
+  // Request types which the declarativeNetRequest API of Chrome knows,
+  // WebRTC connections aren't requests there.
+  const uint32_t DECLARATIVE_RESOURCE_TYPES =
+      IFilterEngine::CONTENT_TYPE_OTHER | IFilterEngine::CONTENT_TYPE_SCRIPT |
+      IFilterEngine::CONTENT_TYPE_IMAGE | IFilterEngine::CONTENT_TYPE_STYLESHEET |
+      IFilterEngine::CONTENT_TYPE_OBJECT | IFilterEngine::CONTENT_TYPE_SUBDOCUMENT |
+      IFilterEngine::CONTENT_TYPE_WEBSOCKET | IFilterEngine::CONTENT_TYPE_PING |
+      IFilterEngine::CONTENT_TYPE_XMLHTTPREQUEST | IFilterEngine::CONTENT_TYPE_MEDIA |
+      IFilterEngine::CONTENT_TYPE_FONT;
+
+  // Types which are only ever looked up in the allowlist, see matcher.js.
+  const uint32_t ALLOWLIST_ONLY_TYPES =
+      IFilterEngine::CONTENT_TYPE_DOCUMENT | IFilterEngine::CONTENT_TYPE_ELEMHIDE |
+      IFilterEngine::CONTENT_TYPE_GENERICHIDE | IFilterEngine::CONTENT_TYPE_GENERICBLOCK;
+
+  const struct
+  {
+    const char* name;
+    ContentType type;
+  } CONTENT_TYPE_OPTIONS[] = {{"OTHER", IFilterEngine::CONTENT_TYPE_OTHER},
+                              {"SCRIPT", IFilterEngine::CONTENT_TYPE_SCRIPT},
+                              {"IMAGE", IFilterEngine::CONTENT_TYPE_IMAGE},
+                              {"STYLESHEET", IFilterEngine::CONTENT_TYPE_STYLESHEET},
+                              {"OBJECT", IFilterEngine::CONTENT_TYPE_OBJECT},
+                              {"SUBDOCUMENT", IFilterEngine::CONTENT_TYPE_SUBDOCUMENT},
+                              {"WEBSOCKET", IFilterEngine::CONTENT_TYPE_WEBSOCKET},
+                              {"WEBRTC", IFilterEngine::CONTENT_TYPE_WEBRTC},
+                              {"PING", IFilterEngine::CONTENT_TYPE_PING},
+                              {"XMLHTTPREQUEST", IFilterEngine::CONTENT_TYPE_XMLHTTPREQUEST},
+                              {"MEDIA", IFilterEngine::CONTENT_TYPE_MEDIA},
+                              {"FONT", IFilterEngine::CONTENT_TYPE_FONT},
+                              {"POPUP", IFilterEngine::CONTENT_TYPE_POPUP},
+                              {"DOCUMENT", IFilterEngine::CONTENT_TYPE_DOCUMENT},
+                              {"GENERICBLOCK", IFilterEngine::CONTENT_TYPE_GENERICBLOCK},
+                              {"ELEMHIDE", IFilterEngine::CONTENT_TYPE_ELEMHIDE},
+                              {"GENERICHIDE", IFilterEngine::CONTENT_TYPE_GENERICHIDE}};
+
+  bool IsKeywordChar(char c)
+  {
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '%';
+  }
+
+  bool IsWordChar(char c)
+  {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_';
+  }
+
+  // Everything but a letter, a digit or one of _ - . %, see filterClasses.js.
+  bool IsSeparator(char c)
+  {
+    unsigned char u = static_cast<unsigned char>(c);
+    return u < 0x80 && !IsWordChar(c) && c != '-' && c != '.' && c != '%';
+  }
+
+  bool IsAscii(const std::string& str)
+  {
+    return std::all_of(
+        str.begin(), str.end(), [](char c) { return static_cast<unsigned char>(c) < 0x80; });
+  }
+
+  std::string ToLower(std::string str)
+  {
+    for (auto& c : str)
+    {
+      if (c >= 'A' && c <= 'Z')
+        c = c - 'A' + 'a';
+    }
+    return str;
+  }
+
+  std::string ToUpper(std::string str)
+  {
+    for (auto& c : str)
+    {
+      if (c >= 'a' && c <= 'z')
+        c = c - 'a' + 'A';
+    }
+    return str;
+  }
+
+  // Same as /[a-z0-9%]{2,}|$/g applied to the lower-cased location.
+  std::vector<std::string> ExtractCandidates(const std::string& lowerLocation,
+                                             const std::vector<URLTokenizer::Token>& tokens)
+  {
+    std::vector<std::string> result;
+    result.reserve(tokens.size() + 1);
+    for (const auto& token : tokens)
+      result.push_back(lowerLocation.substr(token.begin, token.length));
+    result.push_back("");
+    return result;
+  }
+
+  // Same as findKeyword() in matcher.js: picks the candidate matched by
+  // /[^a-z0-9%*][a-z0-9%]{2,}(?=[^a-z0-9%*])/g with the fewest filters.
+  std::string FindKeywordWith(const std::string& pattern,
+                              const std::function<size_t(const std::string&)>& count)
+  {
+    std::string lowerPattern = ToLower(pattern);
+    std::string result;
+    size_t resultCount = 0xFFFFFF;
+    for (size_t i = 0; i < lowerPattern.size(); ++i)
+    {
+      char prefix = lowerPattern[i];
+      if (IsKeywordChar(prefix) || prefix == '*')
+        continue;
+      size_t end = i + 1;
+      while (end < lowerPattern.size() && IsKeywordChar(lowerPattern[end]))
+        ++end;
+      if (end - i - 1 < 2 || end == lowerPattern.size() || lowerPattern[end] == '*')
+        continue;
+      std::string candidate = lowerPattern.substr(i + 1, end - i - 1);
+      size_t candidateCount = count(candidate);
+      if (candidateCount < resultCount ||
+          (candidateCount == resultCount && candidate.size() > result.size()))
+      {
+        result = candidate;
+        resultCount = candidateCount;
+      }
+      i = end - 1;
+    }
+    return result;
+  }
+
+  // Validates /\$(~?[\w-]+(?:=[^,]*)?(?:,~?[\w-]+(?:=[^,]*)?)*)$/ on the
+  // part following the dollar sign.
+  bool ParseOptionList(const std::string& source, std::vector<std::string>* options)
+  {
+    std::vector<std::string> result;
+    size_t start = 0;
+    while (true)
+    {
+      size_t end = source.find(',', start);
+      std::string option = source.substr(start, end == std::string::npos ? end : end - start);
+      size_t name = option.empty() || option[0] != '~' ? 0 : 1;
+      size_t nameEnd = name;
+      while (nameEnd < option.size() && (IsWordChar(option[nameEnd]) || option[nameEnd] == '-'))
+        ++nameEnd;
+      if (nameEnd == name || (nameEnd < option.size() && option[nameEnd] != '='))
+        return false;
+      result.push_back(option);
+      if (end == std::string::npos)
+        break;
+      start = end + 1;
+    }
+    *options = std::move(result);
+    return true;
+  }
+
+  void SplitOptions(const std::string& text,
+                    std::string* pattern,
+                    std::vector<std::string>* options)
+  {
+    for (size_t pos = text.find('$'); pos != std::string::npos; pos = text.find('$', pos + 1))
+    {
+      if (ParseOptionList(text.substr(pos + 1), options))
+      {
+        *pattern = text.substr(0, pos);
+        return;
+      }
+    }
+    *pattern = text;
+    options->clear();
+  }
+
+  bool IsRegExpPattern(const std::string& pattern)
+  {
+    return pattern.size() > 2 && pattern.front() == '/' && pattern.back() == '/';
+  }
+
+  // Wildcard match of |pattern| against |str| from |strPos|, '*' stands for
+  // any sequence and '^' for a separator or the end of |str|.
+  bool MatchesPattern(const std::string& pattern,
+                      const std::string& str,
+                      size_t strPos,
+                      bool endAnchor)
+  {
+    size_t p = 0;
+    size_t s = strPos;
+    size_t starP = std::string::npos;
+    size_t starS = 0;
+    while (true)
+    {
+      if (p == pattern.size())
+      {
+        if (!endAnchor || s == str.size())
+          return true;
+      }
+      else if (pattern[p] == '*')
+      {
+        starP = p++;
+        starS = s;
+        continue;
+      }
+      else if (pattern[p] == '^')
+      {
+        if (s == str.size())
+        {
+          ++p;
+          continue;
+        }
+        if (IsSeparator(str[s]))
+        {
+          ++p;
+          ++s;
+          continue;
+        }
+      }
+      else if (s < str.size() && pattern[p] == str[s])
+      {
+        ++p;
+        ++s;
+        continue;
+      }
+
+      if (starP == std::string::npos || starS >= str.size())
+        return false;
+      p = starP + 1;
+      s = ++starS;
+    }
+  }
+}
+
+bool NativeMatcher::Entry::IsGeneric() const
+{
+  return domains.empty() || IsActiveOnDomain({});
+}
+
+bool NativeMatcher::Entry::IsActiveOnDomain(const std::vector<std::string>& docDomains) const
+{
+  if (domains.empty())
+    return true;
+
+  auto lookup = [this](const std::string& domain, bool* included) {
+    for (const auto& item : domains)
+    {
+      if (item.first == domain)
+      {
+        *included = item.second;
+        return true;
+      }
+    }
+    return false;
+  };
+
+  bool included = false;
+  for (const auto& docDomain : docDomains)
+  {
+    if (lookup(docDomain, &included))
+      return included;
+  }
+  lookup("", &included);
+  return included;
+}
+
+bool NativeMatcher::Entry::MatchesLocation(const std::string& location,
+                                           const std::string& lowerLocation,
+                                           bool* undecided) const
+{
+  if (regExp)
+  {
+    const auto result = regExp->Search(location, REGEXP_BUDGET);
+    if (result == NativeRegExp::Result::UNKNOWN)
+      *undecided = true;
+    return result == NativeRegExp::Result::MATCH;
+  }
+
+  const std::string& str = matchCase ? location : lowerLocation;
+  if (anchor != Anchor::DOMAIN)
+    return MatchesPattern(pattern, str, 0, endAnchor);
+
+  // ^[\w\-]+:\/+(?:[^\/]+\.)?
+  size_t pos = 0;
+  while (pos < str.size() && (IsWordChar(str[pos]) || str[pos] == '-'))
+    ++pos;
+  if (pos == 0 || pos == str.size() || str[pos] != ':')
+    return false;
+  ++pos;
+  if (pos == str.size() || str[pos] != '/')
+    return false;
+  while (pos < str.size() && str[pos] == '/')
+  {
+    ++pos;
+    if (MatchesPattern(pattern, str, pos, endAnchor))
+      return true;
+  }
+  for (size_t i = pos + 1; i <= str.size() && str[i - 1] != '/'; ++i)
+  {
+    if (str[i - 1] == '.' && i - 1 > pos && MatchesPattern(pattern, str, i, endAnchor))
+      return true;
+  }
+  return false;
+}
+
+bool NativeMatcher::Partition::Empty() const
+{
+  return anyParty.empty() && thirdPartyOnly.empty();
+}
+
+// static
+bool NativeMatcher::Index::IsPartitionedByType(const Entry& entry)
+{
+  return CountBits(entry.contentType) <= MAX_PARTITIONED_TYPES;
+}
+
+// static
+NativeMatcher::Bucket& NativeMatcher::Index::Unshare(std::shared_ptr<Bucket>* bucket)
+{
+  if (!*bucket)
+    *bucket = std::make_shared<Bucket>();
+  else if (bucket->use_count() > 1)
+    *bucket = std::make_shared<Bucket>(**bucket);
+  return **bucket;
+}
+
+void NativeMatcher::Index::Add(const std::string& keyword, const Entry* entry)
+{
+  auto add = [entry](Partition* partition) {
+    (entry->thirdParty == ThirdParty::REQUIRED ? partition->thirdPartyOnly : partition->anyParty)
+        .push_back(entry);
+  };
+
+  Bucket& bucket = Unshare(&byKeyword[keyword]);
+  ++bucket.size;
+  if (!IsPartitionedByType(*entry))
+    return add(&bucket.anyType);
+
+  for (uint32_t types = entry->contentType; types; types &= types - 1)
+  {
+    const uint32_t type = types & ~(types - 1);
+    auto typed = std::find_if(bucket.byType.begin(),
+                              bucket.byType.end(),
+                              [type](const std::pair<uint32_t, Partition>& partition) {
+                                return partition.first == type;
+                              });
+    if (typed == bucket.byType.end())
+      typed = bucket.byType.emplace(bucket.byType.end(), type, Partition());
+    add(&typed->second);
+  }
+}
+
+void NativeMatcher::Index::Remove(const std::string& keyword, const Entry* entry)
+{
+  auto remove = [entry](Partition* partition) {
+    auto& entries =
+        entry->thirdParty == ThirdParty::REQUIRED ? partition->thirdPartyOnly : partition->anyParty;
+    entries.erase(std::find(entries.begin(), entries.end(), entry));
+  };
+
+  auto* shared = byKeyword.FindMutable(keyword);
+  if ((*shared)->size == 1)
+  {
+    byKeyword.Erase(keyword);
+    return;
+  }
+  Bucket& bucket = Unshare(shared);
+  --bucket.size;
+  if (!IsPartitionedByType(*entry))
+    return remove(&bucket.anyType);
+
+  auto& byType = bucket.byType;
+  for (auto typed = byType.begin(); typed != byType.end();)
+  {
+    if ((typed->first & entry->contentType) == 0)
+    {
+      ++typed;
+      continue;
+    }
+    remove(&typed->second);
+    typed = typed->second.Empty() ? byType.erase(typed) : typed + 1;
+  }
+}
+
+std::string NativeMatcher::Index::FindKeyword(const std::string& pattern) const
+{
+  return FindKeywordWith(pattern, [this](const std::string& candidate) -> size_t {
+    const auto* bucket = byKeyword.Find(candidate);
+    return bucket ? (*bucket)->size : 0;
+  });
+}
+
+const NativeMatcher::Entry* NativeMatcher::Index::FindMatch(
+    const std::vector<std::string>& candidates,
+    const std::string& location,
+    const std::string& lowerLocation,
+    uint32_t contentTypeMask,
+    const std::vector<std::string>& docDomains,
+    bool specificOnly,
+    bool firstParty,
+    bool* undecided) const
+{
+  // Returns `true` once the lookup is decided, with `hit` set on a match.
+  const Entry* hit = nullptr;
+  auto scan = [&](const std::vector<const Entry*>& entries) {
+    for (const Entry* entry : entries)
+    {
+      if ((entry->contentType & contentTypeMask) == 0)
+        continue;
+      if (specificOnly && entry->IsGeneric())
+        continue;
+      if (!entry->IsActiveOnDomain(docDomains))
+        continue;
+      bool tooExpensive = false;
+      if (!entry->MatchesLocation(location, lowerLocation, &tooExpensive))
+      {
+        if (!tooExpensive)
+          continue;
+        *undecided = true;
+        return true;
+      }
+      if (!firstParty && entry->thirdParty != ThirdParty::ANY)
+        *undecided = true;
+      else
+        hit = entry;
+      return true;
+    }
+    return false;
+  };
+  auto scanPartition = [&](const Partition& partition) {
+    return scan(partition.anyParty) || (!firstParty && scan(partition.thirdPartyOnly));
+  };
+
+  for (const auto& candidate : candidates)
+  {
+    const auto* bucket = byKeyword.Find(candidate);
+    if (!bucket)
+      continue;
+    if (scanPartition((*bucket)->anyType))
+      return hit;
+    for (const auto& typed : (*bucket)->byType)
+    {
+      if ((typed.first & contentTypeMask) != 0 && scanPartition(typed.second))
+        return hit;
+    }
+  }
+  return nullptr;
+}
+
+// static
+std::unique_ptr<NativeMatcher::Entry>
+NativeMatcher::Parse(const std::string& text, bool* allowing, std::string* pattern)
+{
+  *allowing = text.compare(0, 2, "@@") == 0;
+  std::vector<std::string> options;
+  SplitOptions(*allowing ? text.substr(2) : text, pattern, &options);
+  // Like in JS, regular expressions have no keyword.
+  std::string regExpSource;
+  if (IsRegExpPattern(*pattern))
+  {
+    regExpSource = pattern->substr(1, pattern->size() - 2);
+    pattern->clear();
+  }
+
+  std::unique_ptr<Entry> entry(new Entry());
+  entry->text = std::make_shared<const std::string>(text);
+  bool hasContentType = false;
+  for (const auto& option : options)
+  {
+    size_t separator = option.find('=');
+    bool inverse = option[0] == '~';
+    std::string name = option.substr(inverse ? 1 : 0,
+                                     separator == std::string::npos
+                                         ? std::string::npos
+                                         : separator - (inverse ? 1 : 0));
+    std::string upperName = ToUpper(name);
+    size_t dash = upperName.find('-');
+    if (dash != std::string::npos)
+      upperName[dash] = '_';
+
+    auto type = std::find_if(std::begin(CONTENT_TYPE_OPTIONS),
+                             std::end(CONTENT_TYPE_OPTIONS),
+                             [&upperName](const decltype(CONTENT_TYPE_OPTIONS[0])& item) {
+                               return upperName == item.name;
+                             });
+    if (type != std::end(CONTENT_TYPE_OPTIONS))
+    {
+      if (!hasContentType)
+        entry->contentType = inverse ? RESOURCE_TYPES : 0;
+      hasContentType = true;
+      if (inverse)
+        entry->contentType &= ~static_cast<uint32_t>(type->type);
+      else
+        entry->contentType |= static_cast<uint32_t>(type->type);
+    }
+    else if (upperName == "MATCH_CASE")
+      entry->matchCase = !inverse;
+    else if (upperName == "COLLAPSE")
+      continue;
+    else if (upperName == "THIRD_PARTY")
+      entry->thirdParty = inverse ? ThirdParty::EXCLUDED : ThirdParty::REQUIRED;
+    else if (upperName == "DOMAIN" && !inverse && separator != std::string::npos)
+    {
+      bool hasIncludes = false;
+      std::string list = ToLower(option.substr(separator + 1));
+      size_t start = 0;
+      while (start <= list.size())
+      {
+        size_t end = std::min(list.find('|', start), list.size());
+        std::string domain = list.substr(start, end - start);
+        start = end + 1;
+        if (domain.empty())
+          continue;
+        bool included = domain[0] != '~';
+        if (!included)
+          domain.erase(0, 1);
+        hasIncludes = hasIncludes || included;
+        entry->domains.emplace_back(domain, included);
+      }
+      entry->domains.emplace_back("", !hasIncludes);
+    }
+    else
+      return nullptr;
+  }
+  if (!hasContentType)
+    entry->contentType = RESOURCE_TYPES;
+  if (!regExpSource.empty())
+  {
+    entry->regExp = NativeRegExp::Compile(regExpSource, !entry->matchCase);
+    if (!entry->regExp)
+      return nullptr;
+    return entry;
+  }
+  if (!entry->matchCase && !IsAscii(*pattern))
+    return nullptr;
+
+  // Same transformations as filterToRegExp() in patterns.js.
+  std::string body = *pattern;
+  body.erase(std::unique(body.begin(),
+                         body.end(),
+                         [](char a, char b) { return a == '*' && b == '*'; }),
+             body.end());
+  if (body.size() >= 2 && body.compare(body.size() - 2, 2, "^|") == 0)
+    body.pop_back();
+  if (body.compare(0, 2, "||") == 0)
+  {
+    entry->anchor = Anchor::DOMAIN;
+    body.erase(0, 2);
+  }
+  else if (body.compare(0, 1, "|") == 0)
+  {
+    entry->anchor = Anchor::START;
+    body.erase(0, 1);
+  }
+  if (!body.empty() && body.back() == '|')
+  {
+    entry->endAnchor = true;
+    body.pop_back();
+  }
+  if (entry->anchor == Anchor::NONE && body.compare(0, 1, "*") != 0)
+    body.insert(0, "*");
+  entry->pattern = entry->matchCase ? body : ToLower(body);
+  return entry;
+}
+
+std::string NativeMatcher::FindFallbackKeyword(const std::string& pattern) const
+{
+  return FindKeywordWith(pattern, [this](const std::string& candidate) -> size_t {
+    const size_t* count = fallbackKeywords_.Find(candidate);
+    return count ? *count : 0;
+  });
+}
+
+// static
+void NativeMatcher::Prepare(const std::string& text,
+                            PreparedFilters* prepared,
+                            NativeFilterPool* pool)
+{
+  if (text.empty() || prepared->count(text))
+    return;
+  PreparedFilter filter;
+  if (pool)
+    pool->Get(text, &filter);
+  else
+    filter.entry = Parse(text, &filter.allowing, &filter.pattern);
+  prepared->emplace(text, std::move(filter));
+}
+
+void NativeMatcher::Add(const std::string& text)
+{
+  if (text.empty() || filters_.Contains(text))
+    return;
+
+  bool allowing = false;
+  std::string pattern;
+  std::shared_ptr<const Entry> entry = Parse(text, &allowing, &pattern);
+  Insert(text, std::move(entry), allowing, pattern);
+}
+
+void NativeMatcher::Add(const std::string& text, NativeFilterPool* pool)
+{
+  if (!pool)
+    return Add(text);
+  if (text.empty() || filters_.Contains(text))
+    return;
+
+  PreparedFilter filter;
+  pool->Get(text, &filter);
+  Insert(text, std::move(filter.entry), filter.allowing, filter.pattern);
+}
+
+void NativeMatcher::Add(const std::string& text,
+                        const PreparedFilters& prepared,
+                        NativeFilterPool* pool)
+{
+  auto it = prepared.find(text);
+  if (it == prepared.end())
+    return Add(text, pool);
+  if (filters_.Contains(text))
+    return;
+  Insert(text, it->second.entry, it->second.allowing, it->second.pattern);
+}
+
+void NativeMatcher::Insert(const std::string& text,
+                           std::shared_ptr<const Entry> entry,
+                           bool allowing,
+                           const std::string& pattern)
+{
+  if (!entry)
+  {
+    std::string keyword = FindFallbackKeyword(pattern);
+    ++fallbackKeywords_[keyword];
+    ++fallbackCount_;
+    auto fallbackText = std::make_shared<const std::string>(text);
+    const std::string& key = *fallbackText;
+    filters_.Emplace(
+        key, Location{Kind::FALLBACK, std::move(keyword), std::move(fallbackText), nullptr});
+    return;
+  }
+
+  Index& index = allowing ? allowing_ : blocking_;
+  std::string keyword = index.FindKeyword(pattern);
+  index.Add(keyword, entry.get());
+  auto sharedText = entry->text;
+  const std::string& key = *sharedText;
+  filters_.Emplace(key,
+                   Location{allowing ? Kind::ALLOWING : Kind::BLOCKING,
+                            std::move(keyword),
+                            std::move(sharedText),
+                            std::move(entry)});
+}
+
+void NativeMatcher::Remove(const std::string& text)
+{
+  const Location* location = filters_.Find(text);
+  if (!location)
+    return;
+
+  if (location->kind == Kind::FALLBACK)
+  {
+    size_t* count = fallbackKeywords_.FindMutable(location->keyword);
+    if (--*count == 0)
+      fallbackKeywords_.Erase(location->keyword);
+    --fallbackCount_;
+  }
+  else
+  {
+    Index& index = location->kind == Kind::ALLOWING ? allowing_ : blocking_;
+    index.Remove(location->keyword, location->entry.get());
+  }
+  // The key refers to the text of the location.
+  const auto sharedText = location->text;
+  filters_.Erase(*sharedText);
+}
+
+void NativeMatcher::Clear()
+{
+  blocking_.byKeyword.Clear();
+  allowing_.byKeyword.Clear();
+  fallbackKeywords_.Clear();
+  filters_.Clear();
+  fallbackCount_ = 0;
+}
+
+void NativeMatcher::DelegateAll()
+{
+  delegateAll_ = true;
+}
+
+std::vector<NativeMatcher::DeclarativeRule> NativeMatcher::GetDeclarativeRules() const
+{
+  std::vector<const Location*> locations;
+  locations.reserve(filters_.Size());
+  bool hasGenericBlock = false;
+  filters_.ForEach([&locations, &hasGenericBlock](const std::string&, const Location& location) {
+    locations.push_back(&location);
+    if (location.kind == Kind::ALLOWING &&
+        (location.entry->contentType & IFilterEngine::CONTENT_TYPE_GENERICBLOCK) != 0)
+      hasGenericBlock = true;
+  });
+
+  std::vector<DeclarativeRule> rules;
+  for (const Location* filter : locations)
+  {
+    const Location& location = *filter;
+    const Entry* entry = location.entry.get();
+    if (location.kind == Kind::FALLBACK || entry->regExp)
+      continue;
+
+    DeclarativeRule rule;
+    rule.allowing = location.kind == Kind::ALLOWING;
+    rule.document =
+        rule.allowing && (entry->contentType & IFilterEngine::CONTENT_TYPE_DOCUMENT) != 0;
+    if (!rule.document)
+    {
+      if (!rule.allowing && hasGenericBlock && entry->IsGeneric())
+        continue;
+      const uint32_t types = entry->contentType & DECLARATIVE_RESOURCE_TYPES;
+      if (!types)
+        continue;
+      if ((entry->contentType & RESOURCE_TYPES) != RESOURCE_TYPES)
+        rule.contentType = types;
+    }
+
+    bool valid = true;
+    for (const auto& domain : entry->domains)
+    {
+      if (domain.first.empty())
+        continue;
+      std::string asciiDomain;
+      valid = valid && URLInfo::HostToASCII(domain.first, &asciiDomain);
+      (domain.second ? rule.includedDomains : rule.excludedDomains).push_back(asciiDomain);
+    }
+    if (!valid || !IsAscii(entry->pattern))
+      continue;
+
+    if (entry->anchor == Anchor::DOMAIN)
+      rule.urlFilter = "||";
+    else if (entry->anchor == Anchor::START)
+      rule.urlFilter = "|";
+    // Unanchored patterns start with a wildcard, which urlFilter implies.
+    const std::string& pattern = entry->pattern;
+    const size_t start = entry->anchor == Anchor::NONE
+                             ? std::min(pattern.find_first_not_of('*'), pattern.size())
+                             : 0;
+    rule.urlFilter.append(pattern, start, std::string::npos);
+    if (entry->endAnchor)
+      rule.urlFilter.push_back('|');
+    rule.filterText = location.text;
+    rule.matchCase = entry->matchCase;
+    rule.thirdPartyOnly = entry->thirdParty == ThirdParty::REQUIRED;
+    rule.firstPartyOnly = entry->thirdParty == ThirdParty::EXCLUDED;
+    rules.push_back(std::move(rule));
+  }
+  std::sort(
+      rules.begin(), rules.end(), [](const DeclarativeRule& a, const DeclarativeRule& b) {
+        return *a.filterText < *b.filterText;
+      });
+  return rules;
+}
+
+std::shared_ptr<const std::string> NativeMatcher::Intern(const std::string& text) const
+{
+  if (const Location* location = filters_.Find(text))
+    return location->text;
+  return std::make_shared<const std::string>(text);
+}
+
+size_t NativeMatcher::GetFilterCount() const
+{
+  return filters_.Size();
+}
+
+std::vector<uint8_t> NativeMatcher::Serialize(uint64_t checksum) const
+{
+  std::vector<uint8_t> data(INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+  AppendInteger<uint32_t>(INDEX_VERSION, &data);
+  AppendInteger<uint64_t>(checksum, &data);
+  AppendInteger<uint32_t>(static_cast<uint32_t>(filters_.Size()), &data);
+  filters_.ForEach([&data](const std::string& text, const Location&) {
+    AppendInteger<uint32_t>(static_cast<uint32_t>(text.size()), &data);
+    data.insert(data.end(), text.begin(), text.end());
+  });
+  return data;
+}
+
+bool NativeMatcher::Deserialize(const std::vector<uint8_t>& data,
+                                uint64_t checksum,
+                                NativeFilterPool* pool)
+{
+  Clear();
+  size_t offset = sizeof(INDEX_MAGIC);
+  uint32_t version = 0;
+  uint64_t storedChecksum = 0;
+  uint32_t count = 0;
+  if (data.size() < offset || !std::equal(INDEX_MAGIC, INDEX_MAGIC + offset, data.begin()) ||
+      !ReadInteger(data, &offset, &version) || version != INDEX_VERSION ||
+      !ReadInteger(data, &offset, &storedChecksum) || storedChecksum != checksum ||
+      !ReadInteger(data, &offset, &count))
+    return false;
+
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    uint32_t length = 0;
+    if (!ReadInteger(data, &offset, &length) || data.size() - offset < length)
+    {
+      Clear();
+      return false;
+    }
+    Add(std::string(data.begin() + offset, data.begin() + offset + length), pool);
+    offset += length;
+  }
+  return offset == data.size();
+}
+
+size_t NativeMatcher::GetFallbackFilterCount() const
+{
+  return fallbackCount_;
+}
+
+size_t NativeMatcher::GetMemoryUsage(const std::string& text) const
+{
+  const Location* found = filters_.Find(text);
+  if (!found)
+    return 0;
+
+  const Location& location = *found;
+  size_t size = HASH_NODE_OVERHEAD + sizeof(LocationsByText::Shard::value_type) +
+                GetAllocatedSize(location.keyword) +
+                SHARED_POINTER_OVERHEAD + sizeof(*location.text) + GetAllocatedSize(*location.text);
+  if (location.kind == Kind::FALLBACK)
+    return size;
+
+  const Entry& entry = *location.entry;
+  const size_t slots = Index::IsPartitionedByType(entry) ? CountBits(entry.contentType) : 1;
+  size += slots * sizeof(const Entry*) + SHARED_POINTER_OVERHEAD + sizeof(entry) +
+          GetAllocatedSize(entry.pattern) + entry.domains.capacity() * sizeof(entry.domains[0]);
+  for (const auto& domain : entry.domains)
+    size += GetAllocatedSize(domain.first);
+  if (entry.regExp)
+    size += entry.regExp->GetMemoryUsage();
+  return size;
+}
+
+NativeMatcher::Result NativeMatcher::Match(const std::string& url,
+                                           IFilterEngine::ContentTypeMask contentTypeMask,
+                                           const std::string& documentUrl,
+                                           bool specificOnly,
+                                           std::shared_ptr<const std::string>* filterText) const
+{
+  if (delegateAll_)
+    return Result::UNKNOWN;
+
+  // JS lower-cases and punycode-encodes non-ASCII input, leave that to it.
+  std::string lowerUrl;
+  std::vector<URLTokenizer::Token> tokens;
+  if (!URLTokenizer::Tokenize(url, &lowerUrl, &tokens) || !IsAscii(documentUrl))
+    return Result::UNKNOWN;
+
+  // getURLInfo() in api.js gives up on URLs without scheme or host.
+  size_t schemeEnd = url.find(':');
+  if (schemeEnd == std::string::npos ||
+      (url.compare(schemeEnd + 1, 2, "//") == 0 ? schemeEnd + 3 : schemeEnd + 1) == url.size())
+    return Result::NO_MATCH;
+
+  const auto candidates = ExtractCandidates(lowerUrl, tokens);
+  for (const auto& candidate : candidates)
+  {
+    if (fallbackKeywords_.Contains(candidate))
+      return Result::UNKNOWN;
+  }
+
+  const auto docHost = HostCache::Get(URLInfo::ExtractHost(documentUrl));
+  const auto& docDomains = docHost->domains;
+
+  // isThirdParty() in JS is only known to be false for identical hosts,
+  // anything else takes the public suffix list.
+  const std::string requestHost = URLInfo::ExtractHost(url);
+  const bool firstParty = !requestHost.empty() && requestHost == URLInfo::ExtractHost(documentUrl);
+  bool undecided = false;
+
+  const uint32_t typeMask = static_cast<uint32_t>(contentTypeMask);
+  const Entry* blockingHit = nullptr;
+  if ((typeMask & ~ALLOWLIST_ONLY_TYPES) != 0)
+    blockingHit = blocking_.FindMatch(
+        candidates, url, lowerUrl, typeMask, docDomains, specificOnly, firstParty, &undecided);
+
+  const Entry* allowingHit = nullptr;
+  if (!undecided && (blockingHit || (typeMask & ALLOWLIST_ONLY_TYPES) != 0))
+    allowingHit = allowing_.FindMatch(
+        candidates, url, lowerUrl, typeMask, docDomains, false, firstParty, &undecided);
+  if (undecided)
+    return Result::UNKNOWN;
+
+  const Entry* hit = allowingHit ? allowingHit : blockingHit;
+  if (!hit)
+    return Result::NO_MATCH;
+  if (filterText)
+    *filterText = hit->text;
+  return Result::MATCH;
+}
+
+void NativeFilterPool::Get(const std::string& text, NativeMatcher::PreparedFilter* prepared)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = slots_.find(text);
+    if (it != slots_.end())
+    {
+      if (auto entry = it->second.entry.lock())
+      {
+        prepared->entry = std::move(entry);
+        prepared->allowing = it->second.allowing;
+        prepared->pattern = it->second.pattern;
+        return;
+      }
+    }
+  }
+
+  // Parsed without the lock, another thread might be faster.
+  std::shared_ptr<const NativeMatcher::Entry> parsed =
+      NativeMatcher::Parse(text, &prepared->allowing, &prepared->pattern);
+  prepared->entry = parsed;
+  if (!parsed)
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = slots_.find(text);
+  if (it != slots_.end())
+  {
+    if (auto entry = it->second.entry.lock())
+    {
+      prepared->entry = std::move(entry);
+      return;
+    }
+    slots_.erase(it);
+  }
+  if (slots_.size() >= sweepThreshold_)
+    Sweep();
+  const std::string& key = *parsed->text;
+  slots_.emplace(key, Slot{parsed->text, parsed, prepared->allowing, prepared->pattern});
+}
+
+size_t NativeFilterPool::GetFilterCount() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::count_if(slots_.begin(), slots_.end(), [](const Slots::value_type& slot) {
+    return !slot.second.entry.expired();
+  });
+}
+
+void NativeFilterPool::Sweep()
+{
+  for (auto it = slots_.begin(); it != slots_.end();)
+  {
+    if (it->second.entry.expired())
+      it = slots_.erase(it);
+    else
+      ++it;
+  }
+  // Amortizes the sweeps over the insertions.
+  sweepThreshold_ = std::max<size_t>(2 * slots_.size(), 1024);
+}
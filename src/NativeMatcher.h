@@ -0,0 +1,407 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <AdblockPlus/IFilterEngine.h>
+
+#include "CopyOnWriteMap.h"
+#include "NativeRegExp.h"
+
+namespace AdblockPlus
+{
+  class NativeFilterPool;
+
+  /**
+   * Keyword index of simple blocking and allowlisting filters which can be
+   * evaluated without entering V8.
+   *
+   * It mirrors the semantics of the `defaultMatcher` of adblockpluscore for
+   * plain, wildcard and anchored patterns with content type, `domain=`,
+   * `match-case` and `collapse` options. The `third-party` option is only
+   * evaluated for requests to the host of the document, for other requests
+   * it takes the public suffix list, so a filter with that option which
+   * matches otherwise yields `Result::UNKNOWN`. Regular expressions are
+   * evaluated by NativeRegExp if it supports them, within a budget of steps
+   * per filter. Everything else (other regular expressions, `sitekey`,
+   * `csp`, `rewrite`, ...) is only remembered by keyword, and a request
+   * which could be matched by such a filter yields `Result::UNKNOWN` too,
+   * so that the caller asks the JS matcher instead.
+   *
+   * The class is not thread safe, the owner is responsible for locking.
+   * Copies share the parsed filters and the index, so an immutable snapshot
+   * can be taken and queried concurrently while the original keeps being
+   * updated. Taking one copies a few hundred pointers, an update afterwards
+   * copies a fraction of the index, see CopyOnWriteMap.
+   */
+  class NativeMatcher
+  {
+    friend class NativeFilterPool;
+    struct Entry;
+
+  public:
+    enum class Result
+    {
+      NO_MATCH,
+      MATCH,
+      UNKNOWN
+    };
+
+    /**
+     * Filter parsed ahead of adding it, see Prepare().
+     */
+    class PreparedFilter
+    {
+      friend class NativeMatcher;
+      friend class NativeFilterPool;
+
+      std::shared_ptr<const Entry> entry;
+      bool allowing = false;
+      std::string pattern;
+    };
+
+    /**
+     * Prepared filters by text.
+     */
+    typedef std::unordered_map<std::string, PreparedFilter> PreparedFilters;
+
+    /**
+     * Filter in the terms of the `declarativeNetRequest` API of Chrome, see
+     * GetDeclarativeRules().
+     */
+    struct DeclarativeRule
+    {
+      std::shared_ptr<const std::string> filterText;
+      bool allowing = false;
+      // Allowlists everything on the matching documents, `$document`.
+      bool document = false;
+      // In the syntax of `urlFilter`, empty to match all URLs.
+      std::string urlFilter;
+      bool matchCase = false;
+      // Request types the filter applies to, 0 for all of them.
+      uint32_t contentType = 0;
+      bool thirdPartyOnly = false;
+      bool firstPartyOnly = false;
+      // ASCII forms of the domains of the `domain` option.
+      std::vector<std::string> includedDomains;
+      std::vector<std::string> excludedDomains;
+    };
+
+    /**
+     * Parses a filter so that adding it later only has to index it. Unlike
+     * everything else this needs no lock, so it can be done on the thread
+     * which downloaded a filter list.
+     * @param text Normalized filter text.
+     * @param[out] prepared Receives the parsed filter.
+     */
+    static void Prepare(const std::string& text,
+                        PreparedFilters* prepared,
+                        NativeFilterPool* pool = nullptr);
+
+    /**
+     * Adds an active URL filter. Adding the same text twice is a no-op.
+     * @param text Normalized filter text, e.g. `||example.com^$image`.
+     */
+    void Add(const std::string& text);
+
+    /**
+     * Same as Add(text), but takes the parsed filter from `pool`, so that
+     * it is shared with the other matchers using the pool.
+     * @param text Normalized filter text.
+     * @param pool Pool to take the filter from, none to parse it.
+     */
+    void Add(const std::string& text, NativeFilterPool* pool);
+
+    /**
+     * Same as Add(text, pool), but takes the parsed filter from `prepared`
+     * if it is there.
+     * @param text Normalized filter text.
+     * @param prepared Filters parsed by Prepare().
+     * @param pool Pool for the filters which weren't prepared.
+     */
+    void Add(const std::string& text,
+             const PreparedFilters& prepared,
+             NativeFilterPool* pool = nullptr);
+
+    /**
+     * Removes a previously added filter.
+     * @param text Normalized filter text.
+     */
+    void Remove(const std::string& text);
+
+    /**
+     * Removes all filters.
+     */
+    void Clear();
+
+    /**
+     * Makes every lookup yield `Result::UNKNOWN`, for a matcher which stands
+     * in while the actual one is being built.
+     */
+    void DelegateAll();
+
+    /**
+     * @return Number of filters which were added, including the ones
+     *         delegated to the JS matcher.
+     */
+    size_t GetFilterCount() const;
+
+    /**
+     * @return Number of filters which cannot be evaluated natively.
+     */
+    size_t GetFallbackFilterCount() const;
+
+    /**
+     * Estimates the memory held by a filter, including its share of the
+     * index but not the buckets themselves.
+     * @param text Normalized filter text.
+     * @return Size in bytes, 0 if the filter wasn't added.
+     */
+    size_t GetMemoryUsage(const std::string& text) const;
+
+    /**
+     * Stores the added filters in a versioned binary format.
+     * @param checksum Checksum of the filter lists which the filters were
+     *        taken from, to be verified by Deserialize().
+     * @return Serialized filters.
+     */
+    std::vector<uint8_t> Serialize(uint64_t checksum) const;
+
+    /**
+     * Replaces all filters with the ones stored by Serialize().
+     * @param data Serialized filters.
+     * @param checksum Expected checksum of the filter lists.
+     * @param pool Pool to take the filters from, see Add(text, pool).
+     * @return `false` and no filters if the data is corrupt, was written by
+     *         another version or for other filter lists.
+     */
+    bool Deserialize(const std::vector<uint8_t>& data,
+                     uint64_t checksum,
+                     NativeFilterPool* pool = nullptr);
+
+    /**
+     * @return Shared copy of a filter text, the one stored in the index if the
+     *         filter was added.
+     */
+    std::shared_ptr<const std::string> Intern(const std::string& text) const;
+
+    /**
+     * Converts the filters which a browser can match in its network stack,
+     * ordered by filter text. Filters delegated to JS are left out, and so
+     * are generic blocking filters if a `$genericblock` filter could turn
+     * them off. Regular expressions, `$popup` and element hiding
+     * exceptions have no counterpart either.
+     * @return Rules, `contentType` only contains request types with an
+     *         equivalent among the resource types of the API.
+     */
+    std::vector<DeclarativeRule> GetDeclarativeRules() const;
+
+    /**
+     * Looks up a filter matching the request, see IFilterEngine::Matches().
+     * Requests carrying a sitekey are handled too, filters with a `sitekey`
+     * option are among the delegated ones.
+     * @param url Request URL.
+     * @param contentTypeMask Content type mask of the request.
+     * @param documentUrl URL of the document which issued the request.
+     * @param specificOnly Whether generic blocking filters are to be skipped.
+     * @param[out] filterText Text of the matching filter, set only if
+     *             `Result::MATCH` is returned.
+     * @return `Result::UNKNOWN` if the JS matcher has to be asked.
+     */
+    Result Match(const std::string& url,
+                 IFilterEngine::ContentTypeMask contentTypeMask,
+                 const std::string& documentUrl,
+                 bool specificOnly,
+                 std::shared_ptr<const std::string>* filterText) const;
+
+  private:
+    enum class Anchor
+    {
+      NONE,
+      START,
+      DOMAIN
+    };
+
+    enum class ThirdParty
+    {
+      ANY,
+      REQUIRED,
+      EXCLUDED
+    };
+
+    struct Entry
+    {
+      std::shared_ptr<const std::string> text;
+      // Lower-cased unless `matchCase`, starts with '*' for unanchored ones.
+      std::string pattern;
+      Anchor anchor = Anchor::NONE;
+      bool endAnchor = false;
+      bool matchCase = false;
+      ThirdParty thirdParty = ThirdParty::ANY;
+      uint32_t contentType = 0;
+      // Domain -> included, the empty domain stands for all the others.
+      std::vector<std::pair<std::string, bool>> domains;
+      // Set for regular expressions, `pattern` is empty then.
+      std::unique_ptr<const NativeRegExp> regExp;
+
+      bool IsGeneric() const;
+      // Takes the document host and its parent domains, see HostCache.
+      bool IsActiveOnDomain(const std::vector<std::string>& docDomains) const;
+      // Sets `undecided` if a regular expression exceeds its budget.
+      bool MatchesLocation(const std::string& location,
+                           const std::string& lowerLocation,
+                           bool* undecided) const;
+    };
+
+    // Entries of a bucket in insertion order, the ones with the
+    // `third-party` option apart as first-party requests skip them. The
+    // entries are owned by `filters_`.
+    struct Partition
+    {
+      std::vector<const Entry*> anyParty;
+      std::vector<const Entry*> thirdPartyOnly;
+
+      bool Empty() const;
+    };
+
+    // Filters which apply to a few content types only are listed for each
+    // of these types, so that a request rarely looks at filters for other
+    // types. The others are checked against the content type as usual.
+    struct Bucket
+    {
+      Partition anyType;
+      std::vector<std::pair<uint32_t, Partition>> byType;
+      size_t size = 0;
+    };
+
+    struct Index
+    {
+      // Buckets are shared by the copies of the index until they are
+      // modified, see Unshare().
+      CopyOnWriteMap<std::string, std::shared_ptr<Bucket>> byKeyword;
+
+      static bool IsPartitionedByType(const Entry& entry);
+      static Bucket& Unshare(std::shared_ptr<Bucket>* bucket);
+      void Add(const std::string& keyword, const Entry* entry);
+      void Remove(const std::string& keyword, const Entry* entry);
+      std::string FindKeyword(const std::string& pattern) const;
+      const Entry* FindMatch(const std::vector<std::string>& candidates,
+                             const std::string& location,
+                             const std::string& lowerLocation,
+                             uint32_t contentTypeMask,
+                             const std::vector<std::string>& docDomains,
+                             bool specificOnly,
+                             bool firstParty,
+                             bool* undecided) const;
+    };
+
+    enum class Kind
+    {
+      BLOCKING,
+      ALLOWING,
+      FALLBACK
+    };
+
+    struct Location
+    {
+      Kind kind;
+      std::string keyword;
+      std::shared_ptr<const std::string> text;
+      std::shared_ptr<const Entry> entry;
+    };
+
+    // Keys reference the text of their location, so that a filter text is
+    // stored once, however it is looked up.
+    typedef CopyOnWriteMap<std::reference_wrapper<const std::string>,
+                           Location,
+                           std::hash<std::string>,
+                           std::equal_to<std::string>>
+        LocationsByText;
+
+    static std::unique_ptr<Entry>
+    Parse(const std::string& text, bool* allowing, std::string* pattern);
+    std::string FindFallbackKeyword(const std::string& pattern) const;
+    void Insert(const std::string& text,
+                std::shared_ptr<const Entry> entry,
+                bool allowing,
+                const std::string& pattern);
+
+    Index blocking_;
+    Index allowing_;
+    CopyOnWriteMap<std::string, size_t> fallbackKeywords_;
+    LocationsByText filters_;
+    size_t fallbackCount_ = 0;
+    bool delegateAll_ = false;
+  };
+
+  /**
+   * Parsed filters shared by the matchers of several filter engines, e.g.
+   * of the profiles of a browser, so that the filter lists which they have
+   * in common are parsed and stored once. A filter stays in the pool as long
+   * as a matcher holds it. Filters which cannot be evaluated natively
+   * aren't shared, they only take their text.
+   *
+   * The class is thread safe.
+   */
+  class NativeFilterPool
+  {
+  public:
+    /**
+     * Looks up a filter, it is parsed if no matcher holds it.
+     * @param text Normalized filter text.
+     * @param[out] prepared Receives the parsed filter.
+     */
+    void Get(const std::string& text, NativeMatcher::PreparedFilter* prepared);
+
+    /**
+     * @return Number of shared filters which a matcher holds.
+     */
+    size_t GetFilterCount() const;
+
+  private:
+    struct Slot
+    {
+      // Referenced by the key, kept until the slot is swept.
+      std::shared_ptr<const std::string> text;
+      std::weak_ptr<const NativeMatcher::Entry> entry;
+      bool allowing;
+      std::string pattern;
+    };
+
+    typedef std::unordered_map<std::reference_wrapper<const std::string>,
+                               Slot,
+                               std::hash<std::string>,
+                               std::equal_to<std::string>>
+        Slots;
+
+    // Drops the slots of filters which no matcher holds anymore.
+    void Sweep();
+
+    mutable std::mutex mutex_;
+    Slots slots_;
+    size_t sweepThreshold_ = 0;
+  };
+}
@@ -0,0 +1,647 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "NativeRegExp.h"
+
+#include <limits>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  // Expressions compiling to more instructions are left to JS, this mostly
+  // applies to large counted repetitions.
+  const size_t MAX_PROGRAM_SIZE = 10000;
+  const uint32_t UNBOUNDED = std::numeric_limits<uint32_t>::max();
+  const size_t NOT_VISITED = std::numeric_limits<size_t>::max();
+
+  bool IsWordChar(char c)
+  {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_';
+  }
+
+  bool IsDigit(char c)
+  {
+    return c >= '0' && c <= '9';
+  }
+
+  char ToLower(char c)
+  {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+  }
+
+  int HexValue(char c)
+  {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
+  }
+}
+
+class NativeRegExp::Parser
+{
+public:
+  Parser(const std::string& source, NativeRegExp* regExp) : source_(source), regExp_(*regExp)
+  {
+  }
+
+  bool Compile()
+  {
+    std::unique_ptr<Node> root = ParseAlternation();
+    if (!root || pos_ != source_.size() || !Emit(*root))
+      return false;
+    regExp_.program_.push_back({Op::MATCH, 0, 0, 0});
+    return true;
+  }
+
+private:
+  struct Node
+  {
+    enum class Type
+    {
+      EMPTY,
+      CHAR,
+      CLASS,
+      ASSERTION,
+      CONCAT,
+      ALTERNATION,
+      REPEAT
+    };
+
+    explicit Node(Type nodeType, uint32_t nodeArg = 0) : type(nodeType), arg(nodeArg)
+    {
+    }
+
+    Type type;
+    // Character, index of the class or Op of the assertion.
+    uint32_t arg;
+    std::vector<std::unique_ptr<Node>> children;
+    uint32_t min = 0;
+    uint32_t max = 0;
+  };
+
+  typedef std::unique_ptr<Node> NodePtr;
+
+  const std::string& source_;
+  NativeRegExp& regExp_;
+  size_t pos_ = 0;
+
+  bool AtEnd() const
+  {
+    return pos_ == source_.size();
+  }
+
+  NodePtr MakeClass(CharClass charClass)
+  {
+    if (regExp_.ignoreCase_)
+    {
+      for (char c = 'a'; c <= 'z'; ++c)
+      {
+        const char upper = static_cast<char>(c - 'a' + 'A');
+        if (charClass[c] || charClass[upper])
+          charClass.set(c).set(upper);
+      }
+    }
+    regExp_.classes_.push_back(charClass);
+    return NodePtr(new Node(Node::Type::CLASS, regExp_.classes_.size() - 1));
+  }
+
+  static bool AddClassEscape(char c, CharClass* charClass)
+  {
+    CharClass escape;
+    switch (c)
+    {
+    case 'd':
+    case 'D':
+      for (char digit = '0'; digit <= '9'; ++digit)
+        escape.set(digit);
+      break;
+    case 'w':
+    case 'W':
+      for (int i = 0; i < 128; ++i)
+        escape[i] = IsWordChar(static_cast<char>(i));
+      break;
+    case 's':
+    case 'S':
+      for (char space : {' ', '\t', '\n', '\v', '\f', '\r'})
+        escape.set(space);
+      break;
+    default:
+      return false;
+    }
+    if (c >= 'A' && c <= 'Z')
+      escape.flip();
+    *charClass |= escape;
+    return true;
+  }
+
+  bool ParseHex(size_t digits, char* result)
+  {
+    if (source_.size() - pos_ < digits)
+      return false;
+    int value = 0;
+    for (size_t i = 0; i < digits; ++i)
+    {
+      const int digit = HexValue(source_[pos_ + i]);
+      if (digit < 0)
+        return false;
+      value = value * 16 + digit;
+    }
+    if (value >= 128)
+      return false;
+    pos_ += digits;
+    *result = static_cast<char>(value);
+    return true;
+  }
+
+  // Parses the escape after a backslash which stands for a character.
+  bool ParseCharEscape(bool inClass, char* result)
+  {
+    const char c = source_[pos_++];
+    switch (c)
+    {
+    case 'n':
+      *result = '\n';
+      return true;
+    case 'r':
+      *result = '\r';
+      return true;
+    case 't':
+      *result = '\t';
+      return true;
+    case 'f':
+      *result = '\f';
+      return true;
+    case 'v':
+      *result = '\v';
+      return true;
+    case 'b':
+      *result = '\b';
+      return inClass;
+    case '0':
+      *result = '\0';
+      return AtEnd() || !IsDigit(source_[pos_]);
+    case 'x':
+      return ParseHex(2, result);
+    case 'u':
+      return ParseHex(4, result);
+    default:
+      // Back references, \c, \k, \p and identity escapes of letters.
+      if (IsWordChar(c) || static_cast<unsigned char>(c) >= 0x80)
+        return false;
+      *result = c;
+      return true;
+    }
+  }
+
+  NodePtr ParseClass()
+  {
+    CharClass charClass;
+    const bool negated = !AtEnd() && source_[pos_] == '^';
+    if (negated)
+      ++pos_;
+    while (!AtEnd() && source_[pos_] != ']')
+    {
+      char low = 0;
+      bool isSet = false;
+      if (!ParseClassAtom(&charClass, &low, &isSet))
+        return nullptr;
+      if (source_.size() - pos_ < 2 || source_[pos_] != '-' || source_[pos_ + 1] == ']')
+      {
+        if (!isSet)
+          charClass.set(low);
+        continue;
+      }
+
+      ++pos_;
+      char high = 0;
+      bool highIsSet = false;
+      if (isSet || !ParseClassAtom(&charClass, &high, &highIsSet) || highIsSet || low > high)
+        return nullptr;
+      for (int c = low; c <= high; ++c)
+        charClass.set(c);
+    }
+    if (AtEnd())
+      return nullptr;
+    ++pos_;
+    if (negated)
+    {
+      // Fold the case first, so that [^a] doesn't match `A` either.
+      NodePtr positive = MakeClass(charClass);
+      CharClass& folded = regExp_.classes_[positive->arg];
+      folded.flip();
+      return positive;
+    }
+    return MakeClass(charClass);
+  }
+
+  bool ParseClassAtom(CharClass* charClass, char* c, bool* isSet)
+  {
+    *isSet = false;
+    *c = source_[pos_++];
+    if (static_cast<unsigned char>(*c) >= 0x80)
+      return false;
+    if (*c != '\\')
+      return true;
+    if (AtEnd())
+      return false;
+    if (AddClassEscape(source_[pos_], charClass))
+    {
+      ++pos_;
+      *isSet = true;
+      return true;
+    }
+    if (source_[pos_] == '-')
+    {
+      ++pos_;
+      *c = '-';
+      return true;
+    }
+    return ParseCharEscape(true, c);
+  }
+
+  NodePtr ParseAtom()
+  {
+    const char c = source_[pos_++];
+    switch (c)
+    {
+    case '^':
+      return NodePtr(new Node(Node::Type::ASSERTION, static_cast<uint32_t>(Op::LINE_START)));
+    case '$':
+      return NodePtr(new Node(Node::Type::ASSERTION, static_cast<uint32_t>(Op::LINE_END)));
+    case '.':
+    {
+      CharClass any;
+      any.set();
+      any.reset('\n').reset('\r');
+      return MakeClass(any);
+    }
+    case '(':
+    {
+      if (!AtEnd() && source_[pos_] == '?')
+      {
+        // Only non-capturing groups, no lookarounds or named groups.
+        if (source_.size() - pos_ < 2 || source_[pos_ + 1] != ':')
+          return nullptr;
+        pos_ += 2;
+      }
+      NodePtr group = ParseAlternation();
+      if (!group || AtEnd() || source_[pos_] != ')')
+        return nullptr;
+      ++pos_;
+      return group;
+    }
+    case '[':
+      return ParseClass();
+    case '\\':
+    {
+      if (AtEnd())
+        return nullptr;
+      const char escape = source_[pos_];
+      if (escape == 'b' || escape == 'B')
+      {
+        ++pos_;
+        return NodePtr(new Node(
+            Node::Type::ASSERTION,
+            static_cast<uint32_t>(escape == 'b' ? Op::WORD_BOUNDARY : Op::NOT_WORD_BOUNDARY)));
+      }
+      CharClass charClass;
+      if (AddClassEscape(escape, &charClass))
+      {
+        ++pos_;
+        return MakeClass(charClass);
+      }
+      char result = 0;
+      if (!ParseCharEscape(false, &result))
+        return nullptr;
+      return MakeChar(result);
+    }
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+      return nullptr;
+    default:
+      if (static_cast<unsigned char>(c) >= 0x80)
+        return nullptr;
+      return MakeChar(c);
+    }
+  }
+
+  NodePtr MakeChar(char c)
+  {
+    return NodePtr(new Node(Node::Type::CHAR,
+                            static_cast<unsigned char>(regExp_.ignoreCase_ ? ToLower(c) : c)));
+  }
+
+  bool ParseNumber(uint32_t* number)
+  {
+    if (AtEnd() || !IsDigit(source_[pos_]))
+      return false;
+    uint64_t value = 0;
+    while (!AtEnd() && IsDigit(source_[pos_]))
+    {
+      value = std::min<uint64_t>(value * 10 + (source_[pos_++] - '0'), UNBOUNDED - 1);
+    }
+    *number = static_cast<uint32_t>(value);
+    return true;
+  }
+
+  // Parses a quantifier if there is one, `false` on invalid ones.
+  bool ParseQuantifier(bool* present, uint32_t* min, uint32_t* max)
+  {
+    *present = !AtEnd();
+    switch (*present ? source_[pos_] : '\0')
+    {
+    case '*':
+      *min = 0;
+      *max = UNBOUNDED;
+      ++pos_;
+      break;
+    case '+':
+      *min = 1;
+      *max = UNBOUNDED;
+      ++pos_;
+      break;
+    case '?':
+      *min = 0;
+      *max = 1;
+      ++pos_;
+      break;
+    case '{':
+      ++pos_;
+      if (!ParseNumber(min))
+        return false;
+      *max = *min;
+      if (!AtEnd() && source_[pos_] == ',')
+      {
+        ++pos_;
+        if (!ParseNumber(max))
+          *max = UNBOUNDED;
+      }
+      if (AtEnd() || source_[pos_] != '}' || *min > *max)
+        return false;
+      ++pos_;
+      break;
+    default:
+      *present = false;
+      return true;
+    }
+    // Laziness doesn't change whether there is a match.
+    if (!AtEnd() && source_[pos_] == '?')
+      ++pos_;
+    return true;
+  }
+
+  NodePtr ParseTerm()
+  {
+    NodePtr atom = ParseAtom();
+    if (!atom)
+      return nullptr;
+    bool present = false;
+    uint32_t min = 0;
+    uint32_t max = 0;
+    if (!ParseQuantifier(&present, &min, &max) ||
+        (present && atom->type == Node::Type::ASSERTION))
+      return nullptr;
+    if (!present)
+      return atom;
+    NodePtr repeat(new Node(Node::Type::REPEAT));
+    repeat->min = min;
+    repeat->max = max;
+    repeat->children.push_back(std::move(atom));
+    return repeat;
+  }
+
+  NodePtr ParseAlternation()
+  {
+    NodePtr alternation(new Node(Node::Type::ALTERNATION));
+    while (true)
+    {
+      NodePtr concat(new Node(Node::Type::CONCAT));
+      while (!AtEnd() && source_[pos_] != '|' && source_[pos_] != ')')
+      {
+        NodePtr term = ParseTerm();
+        if (!term)
+          return nullptr;
+        concat->children.push_back(std::move(term));
+      }
+      alternation->children.push_back(std::move(concat));
+      if (AtEnd() || source_[pos_] != '|')
+        break;
+      ++pos_;
+    }
+    return alternation;
+  }
+
+  uint32_t Append(Op op, uint32_t arg = 0)
+  {
+    regExp_.program_.push_back({op, arg, 0, 0});
+    return static_cast<uint32_t>(regExp_.program_.size() - 1);
+  }
+
+  uint32_t Next() const
+  {
+    return static_cast<uint32_t>(regExp_.program_.size());
+  }
+
+  bool Emit(const Node& node)
+  {
+    auto& program = regExp_.program_;
+    switch (node.type)
+    {
+    case Node::Type::EMPTY:
+      break;
+    case Node::Type::CHAR:
+      Append(Op::CHAR, node.arg);
+      break;
+    case Node::Type::CLASS:
+      Append(Op::CLASS, node.arg);
+      break;
+    case Node::Type::ASSERTION:
+      Append(static_cast<Op>(node.arg));
+      break;
+    case Node::Type::CONCAT:
+      for (const auto& child : node.children)
+      {
+        if (!Emit(*child))
+          return false;
+      }
+      break;
+    case Node::Type::ALTERNATION:
+    {
+      std::vector<uint32_t> jumps;
+      for (size_t i = 0; i + 1 < node.children.size(); ++i)
+      {
+        const uint32_t split = Append(Op::SPLIT);
+        program[split].next = Next();
+        if (!Emit(*node.children[i]))
+          return false;
+        jumps.push_back(Append(Op::JUMP));
+        program[split].alternative = Next();
+      }
+      if (!Emit(*node.children.back()))
+        return false;
+      for (uint32_t jump : jumps)
+        program[jump].next = Next();
+      break;
+    }
+    case Node::Type::REPEAT:
+    {
+      const Node& child = *node.children.front();
+      for (uint32_t i = 0; i < node.min; ++i)
+      {
+        if (!Emit(child))
+          return false;
+      }
+      if (node.max == UNBOUNDED)
+      {
+        const uint32_t split = Append(Op::SPLIT);
+        program[split].next = Next();
+        if (!Emit(child))
+          return false;
+        program[Append(Op::JUMP)].next = split;
+        program[split].alternative = Next();
+        break;
+      }
+      std::vector<uint32_t> splits;
+      for (uint32_t i = node.min; i < node.max; ++i)
+      {
+        const uint32_t split = Append(Op::SPLIT);
+        program[split].next = Next();
+        splits.push_back(split);
+        if (!Emit(child))
+          return false;
+      }
+      for (uint32_t split : splits)
+        program[split].alternative = Next();
+      break;
+    }
+    }
+    return program.size() <= MAX_PROGRAM_SIZE;
+  }
+};
+
+// static
+std::unique_ptr<NativeRegExp> NativeRegExp::Compile(const std::string& source, bool ignoreCase)
+{
+  std::unique_ptr<NativeRegExp> regExp(new NativeRegExp());
+  regExp->ignoreCase_ = ignoreCase;
+  if (!Parser(source, regExp.get()).Compile())
+    return nullptr;
+  regExp->program_.shrink_to_fit();
+  regExp->classes_.shrink_to_fit();
+  return regExp;
+}
+
+NativeRegExp::Result NativeRegExp::Search(const std::string& str, size_t budget) const
+{
+  // Pike VM: all threads advance in lockstep, each instruction is visited
+  // at most once per position, so the run time is linear in the input.
+  std::vector<uint32_t> current;
+  std::vector<uint32_t> next;
+  std::vector<uint32_t> stack;
+  std::vector<size_t> visited(program_.size(), NOT_VISITED);
+  size_t steps = 0;
+
+  auto isWordAt = [&str](size_t pos) { return pos < str.size() && IsWordChar(str[pos]); };
+  // Follows the empty transitions from `pc`, `true` if a match is reached.
+  auto addThread = [&](std::vector<uint32_t>* list, uint32_t pc, size_t pos) {
+    stack.push_back(pc);
+    while (!stack.empty())
+    {
+      pc = stack.back();
+      stack.pop_back();
+      if (visited[pc] == pos)
+        continue;
+      visited[pc] = pos;
+      ++steps;
+      const Instruction& instruction = program_[pc];
+      switch (instruction.op)
+      {
+      case Op::JUMP:
+        stack.push_back(instruction.next);
+        break;
+      case Op::SPLIT:
+        stack.push_back(instruction.alternative);
+        stack.push_back(instruction.next);
+        break;
+      case Op::LINE_START:
+        if (pos == 0)
+          stack.push_back(pc + 1);
+        break;
+      case Op::LINE_END:
+        if (pos == str.size())
+          stack.push_back(pc + 1);
+        break;
+      case Op::WORD_BOUNDARY:
+      case Op::NOT_WORD_BOUNDARY:
+      {
+        const bool boundary = (pos > 0 && isWordAt(pos - 1)) != isWordAt(pos);
+        if (boundary == (instruction.op == Op::WORD_BOUNDARY))
+          stack.push_back(pc + 1);
+        break;
+      }
+      case Op::MATCH:
+        stack.clear();
+        return true;
+      default:
+        list->push_back(pc);
+      }
+    }
+    return false;
+  };
+
+  const bool anchored = program_.front().op == Op::LINE_START;
+  for (size_t pos = 0;; ++pos)
+  {
+    if (anchored && pos > 0 && current.empty())
+      return Result::NO_MATCH;
+    if (addThread(&current, 0, pos))
+      return Result::MATCH;
+    if (pos == str.size())
+      return Result::NO_MATCH;
+
+    next.clear();
+    const char c = ignoreCase_ ? ToLower(str[pos]) : str[pos];
+    const auto index = static_cast<unsigned char>(c);
+    for (uint32_t pc : current)
+    {
+      const Instruction& instruction = program_[pc];
+      const bool matches =
+          index < 128 && (instruction.op == Op::CHAR ? instruction.arg == index
+                                                     : classes_[instruction.arg][index]);
+      if (matches && addThread(&next, pc + 1, pos + 1))
+        return Result::MATCH;
+    }
+    steps += current.size();
+    if (steps > budget)
+      return Result::UNKNOWN;
+    current.swap(next);
+  }
+}
+
+size_t NativeRegExp::GetMemoryUsage() const
+{
+  return sizeof(*this) + program_.capacity() * sizeof(Instruction) +
+         classes_.capacity() * sizeof(CharClass);
+}
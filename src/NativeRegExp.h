@@ -0,0 +1,105 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace AdblockPlus
+{
+  /**
+   * Linear time engine for the regular expressions of filters like
+   * `/banner\d+/`, so that they can be evaluated without entering V8.
+   *
+   * The supported syntax is the part of JS regular expressions which a
+   * Thompson NFA can handle for ASCII input: characters, escapes, classes,
+   * groups, alternatives, greedy and lazy quantifiers and the `^`, `$`,
+   * `\b` and `\B` assertions. Expressions with anything else, e.g. back
+   * references or lookarounds, are rejected and left to JS.
+   */
+  class NativeRegExp
+  {
+  public:
+    enum class Result
+    {
+      NO_MATCH,
+      MATCH,
+      UNKNOWN
+    };
+
+    /**
+     * Compiles a regular expression.
+     * @param source Source of the expression, without the slashes.
+     * @param ignoreCase Same as the `i` flag.
+     * @return `nullptr` if the expression isn't supported or invalid.
+     */
+    static std::unique_ptr<NativeRegExp> Compile(const std::string& source, bool ignoreCase);
+
+    /**
+     * Looks for a match anywhere in `str`, like `RegExp.prototype.test()`.
+     * @param str ASCII string to search.
+     * @param budget Maximum number of NFA steps to take, the run time is
+     *        proportional to it.
+     * @return `Result::UNKNOWN` if the budget has been exceeded.
+     */
+    Result Search(const std::string& str, size_t budget) const;
+
+    /**
+     * @return Size of the compiled program in bytes.
+     */
+    size_t GetMemoryUsage() const;
+
+  private:
+    class Parser;
+
+    enum class Op : uint8_t
+    {
+      CHAR,
+      CLASS,
+      SPLIT,
+      JUMP,
+      LINE_START,
+      LINE_END,
+      WORD_BOUNDARY,
+      NOT_WORD_BOUNDARY,
+      MATCH
+    };
+
+    struct Instruction
+    {
+      Op op;
+      // Character of CHAR, index of the class of CLASS.
+      uint32_t arg;
+      // Targets of SPLIT and JUMP.
+      uint32_t next;
+      uint32_t alternative;
+    };
+
+    typedef std::bitset<128> CharClass;
+
+    NativeRegExp() = default;
+
+    bool ignoreCase_ = false;
+    std::vector<Instruction> program_;
+    std::vector<CharClass> classes_;
+  };
+}
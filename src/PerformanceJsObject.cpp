@@ -0,0 +1,56 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PerformanceJsObject.h"
+
+#include <chrono>
+
+#include <AdblockPlus/JsValue.h>
+#include <AdblockPlus/LogSystem.h>
+
+#include "Utils.h"
+
+namespace
+{
+  void NowCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  {
+    const std::chrono::duration<double, std::milli> now =
+        std::chrono::steady_clock::now().time_since_epoch();
+    arguments.GetReturnValue().Set(now.count());
+  }
+
+  void MeasureCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  {
+    AdblockPlus::JsEngine* jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
+    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
+    if (converted.size() != 3)
+    {
+      return AdblockPlus::Utils::ThrowExceptionInJS(
+          arguments.GetIsolate(), "_performance.measure requires 3 parameters");
+    }
+    jsEngine->GetLogSystem().OnPerformanceMeasure(
+        converted[0].AsString(), converted[1].AsDouble(), converted[2].AsDouble());
+  }
+}
+
+AdblockPlus::JsValue& AdblockPlus::PerformanceJsObject::Setup(AdblockPlus::JsEngine& jsEngine,
+                                                              AdblockPlus::JsValue& obj)
+{
+  obj.SetProperty("now", jsEngine.NewCallback(::NowCallback));
+  obj.SetProperty("measure", jsEngine.NewCallback(::MeasureCallback));
+  return obj;
+}
@@ -17,7 +17,12 @@
 
 #include <AdblockPlus/PlatformFactory.h>
 
+#include <iterator>
+#include <string>
+#include <vector>
+
 #include "AsyncExecutor.h"
+#include "AsyncLogSystem.h"
 #include "DefaultFileSystem.h"
 #include "DefaultLogSystem.h"
 #include "DefaultPlatform.h"
@@ -27,6 +32,14 @@
 
 using namespace AdblockPlus;
 
+namespace
+{
+  // Read by the scripts and the native matcher while the filter engine is
+  // being created.
+  const char* STARTUP_FILES[] = {"prefs.json", "patterns.ini", "patterns.ini.matcher"};
+  const char* CODE_CACHE_FILE = "v8codecache.bin";
+}
+
 std::unique_ptr<Platform> PlatformFactory::CreatePlatform(CreationParameters&& parameters)
 {
   if (!parameters.executor)
@@ -42,17 +55,48 @@ std::unique_ptr<Platform> PlatformFactory::CreatePlatform(CreationParameters&& p
   }
   if (!parameters.fileSystem)
   {
-    parameters.fileSystem.reset(new DefaultFileSystem(
+    // File systems of the host are left alone, they might not be able to
+    // read ahead.
+    auto fileSystem = std::make_unique<DefaultFileSystem>(
         *parameters.executor,
-        std::unique_ptr<DefaultFileSystemSync>(new DefaultFileSystemSync(parameters.basePath))));
+        std::unique_ptr<DefaultFileSystemSync>(new DefaultFileSystemSync(parameters.basePath)));
+    std::vector<std::string> startupFiles(std::begin(STARTUP_FILES), std::end(STARTUP_FILES));
+    if (parameters.persistentCodeCache)
+      startupFiles.push_back(CODE_CACHE_FILE);
+    fileSystem->Prefetch(startupFiles);
+    parameters.fileSystem = std::move(fileSystem);
   }
   if (!parameters.resourceReader)
     parameters.resourceReader.reset(new DefaultResourceReader());
 
-  return std::make_unique<DefaultPlatform>(std::move(parameters));
+  const bool backgroundInitialization = parameters.backgroundInitialization;
+  const AppInfo appInfo = parameters.appInfo;
+  const FilterEngineFactory::CreationParameters filterEngineParameters =
+      parameters.filterEngineParameters;
+  auto platform = std::make_unique<DefaultPlatform>(std::move(parameters));
+  if (backgroundInitialization)
+    platform->InitializeInBackground(appInfo, filterEngineParameters);
+  return std::unique_ptr<Platform>(std::move(platform));
 }
 
 std::unique_ptr<IExecutor> PlatformFactory::CreateExecutor()
 {
   return std::unique_ptr<IExecutor>(new OptionalAsyncExecutor());
 }
+
+std::unique_ptr<IExecutor> PlatformFactory::CreateExecutor(size_t maxConcurrency)
+{
+  return std::unique_ptr<IExecutor>(new ThreadPoolExecutor(maxConcurrency));
+}
+
+std::unique_ptr<IExecutor> PlatformFactory::CreateExecutor(size_t maxConcurrency,
+                                                           const ThreadOptions& threadOptions)
+{
+  return std::unique_ptr<IExecutor>(
+      new ThreadPoolExecutor(maxConcurrency, std::chrono::seconds(10), threadOptions));
+}
+
+LogSystemPtr PlatformFactory::CreateAsyncLogSystem(LogSystemPtr logSystem, size_t bufferSize)
+{
+  return LogSystemPtr(new AsyncLogSystem(std::move(logSystem), bufferSize));
+}
@@ -17,40 +17,93 @@
 
 #include <AdblockPlus/ReferrerMapping.h>
 
+#include <algorithm>
+
 using namespace AdblockPlus;
 
-ReferrerMapping::ReferrerMapping(const int maxCachedUrls) : maxCachedUrls(maxCachedUrls)
+ReferrerMapping::ReferrerMapping(const int maxCachedUrls, bool threadSafe)
+    : maxCachedUrls(static_cast<size_t>(std::max(maxCachedUrls, 0))), threadSafe(threadSafe),
+      emptyString(std::make_shared<const std::string>())
+{
+}
+
+ReferrerMapping::SharedString ReferrerMapping::Intern(const std::string& str) const
 {
+  if (str.empty())
+    return emptyString;
+  auto it = mapping.find(&str);
+  if (it != mapping.end())
+    return it->second->url;
+  // Subresources of a page are usually requested one after another.
+  if (newest && *newest->referrer == str)
+    return newest->referrer;
+  return std::make_shared<const std::string>(str);
+}
+
+void ReferrerMapping::Unlink(Entry* entry)
+{
+  (entry->older ? entry->older->newer : oldest) = entry->newer;
+  (entry->newer ? entry->newer->older : newest) = entry->older;
+  entry->older = entry->newer = nullptr;
+}
+
+void ReferrerMapping::Append(Entry* entry)
+{
+  entry->older = newest;
+  (newest ? newest->newer : oldest) = entry;
+  newest = entry;
 }
 
 void ReferrerMapping::Add(const std::string& url, const std::string& referrer)
 {
-  if (mapping.find(url) != mapping.end())
-    cachedUrls.remove(url);
-  cachedUrls.push_back(url);
-  mapping[url] = referrer;
+  std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+  if (threadSafe)
+    lock.lock();
 
-  const int urlsToPop = cachedUrls.size() - maxCachedUrls;
-  for (int i = 0; i < urlsToPop; i++)
+  auto it = mapping.find(&url);
+  if (it != mapping.end())
   {
-    const std::string poppedUrl = cachedUrls.front();
-    cachedUrls.pop_front();
-    mapping.erase(poppedUrl);
+    Entry* entry = it->second.get();
+    entry->referrer = Intern(referrer);
+    Unlink(entry);
+    Append(entry);
+    return;
   }
+
+  while (oldest && mapping.size() >= maxCachedUrls)
+  {
+    Entry* evicted = oldest;
+    Unlink(evicted);
+    mapping.erase(mapping.find(evicted->url.get()));
+  }
+  if (maxCachedUrls == 0)
+    return;
+
+  std::unique_ptr<Entry> entry(new Entry());
+  entry->url = std::make_shared<const std::string>(url);
+  entry->referrer = Intern(referrer);
+  Append(entry.get());
+  const std::string* key = entry->url.get();
+  mapping.emplace(key, std::move(entry));
 }
 
 std::vector<std::string> ReferrerMapping::BuildReferrerChain(const std::string& url) const
 {
+  std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+  if (threadSafe)
+    lock.lock();
+
   std::vector<std::string> referrerChain;
   // We need to limit the chain length to ensure we don't block indefinitely
   // if there's a referrer loop.
   const int maxChainLength = 10;
-  std::map<std::string, std::string>::const_iterator currentEntry = mapping.find(url);
+  auto currentEntry = mapping.find(&url);
   for (int i = 0; i < maxChainLength && currentEntry != mapping.end(); i++)
   {
-    const std::string& currentUrl = currentEntry->second;
-    referrerChain.insert(referrerChain.begin(), currentUrl);
-    currentEntry = mapping.find(currentUrl);
+    const SharedString& currentUrl = currentEntry->second->referrer;
+    referrerChain.push_back(*currentUrl);
+    currentEntry = mapping.find(currentUrl.get());
   }
+  std::reverse(referrerChain.begin(), referrerChain.end());
   return referrerChain;
 }
@@ -25,6 +25,7 @@
 using namespace AdblockPlus;
 
 const std::string kMethodName = "readPreloadedFilterList";
+const std::string kInstallMethodName = "installPrecompiledFilterStorage";
 
 namespace ReadPreloadedFilterListCallback
 {
@@ -59,7 +60,7 @@ namespace ReadPreloadedFilterListCallback
               auto result = jsEngine->NewObject();
               result.SetProperty("exists", exists);
               if (exists)
-                result.SetProperty("content", response->content(), response->size());
+                result.SetProperty("content", jsEngine->NewExternalValue(std::move(response)));
               weakCallbackValue.Values()[0].Call(result);
             });
       }
@@ -81,10 +82,102 @@ namespace ReadPreloadedFilterListCallback
   }
 }
 
+namespace InstallPrecompiledFilterStorageCallback
+{
+  const char* PATTERNS_FILE = "patterns.ini";
+  const char* MATCHER_INDEX_FILE = "patterns.ini.matcher";
+
+  typedef std::function<void(bool installed, const std::string& error)> DoneCallback;
+
+  IFileSystem::IOBuffer ToBuffer(const IPreloadedFilterResponse& response)
+  {
+    const auto* data = reinterpret_cast<const uint8_t*>(response.content());
+    return IFileSystem::IOBuffer(data, data + response.size());
+  }
+
+  void WriteFiles(JsEngine* jsEngine,
+                  std::shared_ptr<IPreloadedFilterResponse> patterns,
+                  const DoneCallback& doneCallback)
+  {
+    jsEngine->GetResourceReader().ReadPrecompiledFilterStorage(
+        MATCHER_INDEX_FILE,
+        [jsEngine, patterns, doneCallback](std::unique_ptr<IPreloadedFilterResponse> index) {
+          // patterns.ini goes last, so that an interrupted installation is
+          // repeated on the next start.
+          auto writePatterns = [jsEngine, patterns, doneCallback](const std::string& error) {
+            if (!error.empty())
+              return doneCallback(false, error);
+            jsEngine->GetFileSystem().Write(
+                PATTERNS_FILE, ToBuffer(*patterns), [doneCallback](const std::string& writeError) {
+                  doneCallback(writeError.empty(), writeError);
+                });
+          };
+          // Without the index the native matcher is built from the filters.
+          if (!index->exists())
+            return writePatterns("");
+          jsEngine->GetFileSystem().Write(MATCHER_INDEX_FILE, ToBuffer(*index), writePatterns);
+        });
+  }
+
+  void V8Callback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  {
+    try
+    {
+      AdblockPlus::JsEngine* jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
+      AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
+
+      if (converted.size() != 2u)
+        throw std::runtime_error(kInstallMethodName + ": requires exactly 2 arguments");
+
+      if (!converted[0].IsFunction())
+        throw std::runtime_error(kInstallMethodName + ": First argument must be a function");
+
+      if (!converted[1].IsFunction())
+        throw std::runtime_error(kInstallMethodName + ": Second argument must be a function");
+
+      JsEngine::ScopedWeakValues weakCallbackValues(jsEngine, {converted[0], converted[1]});
+      DoneCallback doneCallback = [jsEngine, weakCallbackValues](bool installed,
+                                                                 const std::string& error) {
+        const JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
+        if (error.empty())
+          weakCallbackValues.Values()[0].Call(jsEngine->NewValue(installed));
+        else
+          weakCallbackValues.Values()[1].Call(jsEngine->NewValue(error));
+      };
+
+      jsEngine->GetResourceReader().ReadPrecompiledFilterStorage(
+          PATTERNS_FILE,
+          [jsEngine, doneCallback](std::unique_ptr<IPreloadedFilterResponse> response) {
+            if (!response->exists())
+              return doneCallback(false, "");
+
+            std::shared_ptr<IPreloadedFilterResponse> patterns(std::move(response));
+            jsEngine->GetFileSystem().Stat(
+                PATTERNS_FILE,
+                [jsEngine, patterns, doneCallback](const IFileSystem::StatResult& stat,
+                                                   const std::string& error) {
+                  if (!error.empty())
+                    return doneCallback(false, error);
+                  // Never replace the filters of the user.
+                  if (stat.exists)
+                    return doneCallback(false, "");
+                  WriteFiles(jsEngine, patterns, doneCallback);
+                });
+          });
+    }
+    catch (const std::exception& e)
+    {
+      return Utils::ThrowExceptionInJS(arguments.GetIsolate(), e.what());
+    }
+  }
+}
+
 AdblockPlus::JsValue& ResourceReaderJsObject::Setup(AdblockPlus::JsEngine& jsEngine,
                                                     AdblockPlus::JsValue& obj)
 {
   obj.SetProperty(kMethodName, jsEngine.NewCallback(::ReadPreloadedFilterListCallback::V8Callback));
+  obj.SetProperty(kInstallMethodName,
+                  jsEngine.NewCallback(::InstallPrecompiledFilterStorageCallback::V8Callback));
 
   return obj;
 }
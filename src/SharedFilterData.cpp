@@ -0,0 +1,261 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <AdblockPlus/SharedFilterData.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <AdblockPlus/URLInfo.h>
+
+#include "NativeMatcher.h"
+#include "SharedFilterDataWriter.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  const uint8_t MAGIC[] = {'A', 'B', 'P', 'S', 'H', 'A', 'R', 'E'};
+  const uint32_t VERSION = 1;
+  // Six integers per domain.
+  const size_t DOMAIN_ENTRY_SIZE = 6 * sizeof(uint32_t);
+  // Matches the checksum which Attach() passes.
+  const uint64_t MATCHER_CHECKSUM = 0;
+
+  void AppendInteger(uint32_t value, std::vector<uint8_t>* data)
+  {
+    for (size_t i = 0; i < sizeof(value); ++i)
+      data->push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+
+  void SetInteger(uint32_t value, size_t offset, std::vector<uint8_t>* data)
+  {
+    for (size_t i = 0; i < sizeof(value); ++i)
+      (*data)[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+
+  // Doesn't require any alignment, the host decides where the data is.
+  bool ReadInteger(const uint8_t* data, size_t size, size_t* offset, uint32_t* value)
+  {
+    if (size < *offset || size - *offset < sizeof(*value))
+      return false;
+    *value = 0;
+    for (size_t i = 0; i < sizeof(*value); ++i)
+      *value |= static_cast<uint32_t>(data[*offset + i]) << (8 * i);
+    *offset += sizeof(*value);
+    return true;
+  }
+
+  bool IsInRange(uint32_t offset, uint32_t length, size_t size)
+  {
+    return offset <= size && length <= size - offset;
+  }
+
+  // Lower-cased host without trailing dots, see ContentFilterDomains.
+  std::string GetHost(const std::string& domain)
+  {
+    std::string host =
+        domain.find(':') != std::string::npos ? URLInfo::ExtractHost(domain) : domain;
+    std::transform(host.begin(), host.end(), host.begin(), [](char c) {
+      return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    });
+    const size_t end = host.find_last_not_of('.');
+    host.erase(end == std::string::npos ? 0 : end + 1);
+    return host;
+  }
+}
+
+std::vector<uint8_t>
+AdblockPlus::WriteSharedFilterData(const NativeMatcher& matcher,
+                                   const std::vector<std::string>& elementHiding)
+{
+  if (elementHiding.size() < 2 || (elementHiding.size() - 2) % 3)
+    throw std::invalid_argument("Invalid element hiding data");
+
+  std::vector<uint8_t> data(MAGIC, MAGIC + sizeof(MAGIC));
+  AppendInteger(VERSION, &data);
+  const std::vector<uint8_t> matcherData = matcher.Serialize(MATCHER_CHECKSUM);
+  AppendInteger(static_cast<uint32_t>(matcherData.size()), &data);
+  data.insert(data.end(), matcherData.begin(), matcherData.end());
+
+  // Lookups do a binary search by domain.
+  std::vector<size_t> domains;
+  for (size_t i = 2; i < elementHiding.size(); i += 3)
+    domains.push_back(i);
+  std::sort(domains.begin(), domains.end(), [&elementHiding](size_t a, size_t b) {
+    return elementHiding[a] < elementHiding[b];
+  });
+
+  // The offsets of the strings are filled in once they are appended.
+  const size_t genericPosition = data.size();
+  data.resize(data.size() + 4 * sizeof(uint32_t));
+  AppendInteger(static_cast<uint32_t>(domains.size()), &data);
+  const size_t tablePosition = data.size();
+  data.resize(data.size() + domains.size() * DOMAIN_ENTRY_SIZE);
+
+  auto appendString = [&data](const std::string& str, size_t position) {
+    if (data.size() + str.size() > UINT32_MAX)
+      throw std::length_error("Shared filter data too large");
+    SetInteger(static_cast<uint32_t>(data.size()), position, &data);
+    SetInteger(static_cast<uint32_t>(str.size()), position + sizeof(uint32_t), &data);
+    data.insert(data.end(), str.begin(), str.end());
+  };
+  appendString(elementHiding[0], genericPosition);
+  appendString(elementHiding[1], genericPosition + 2 * sizeof(uint32_t));
+  for (size_t i = 0; i < domains.size(); ++i)
+  {
+    const size_t position = tablePosition + i * DOMAIN_ENTRY_SIZE;
+    for (size_t j = 0; j < 3; ++j)
+      appendString(elementHiding[domains[i] + j], position + j * 2 * sizeof(uint32_t));
+  }
+  return data;
+}
+
+SharedFilterData::SharedFilterData()
+    : matcher_(new NativeMatcher()), data_(nullptr), size_(0), genericOffset_(0),
+      genericLength_(0), defaultOffset_(0), defaultLength_(0), domainCount_(0),
+      domainTableOffset_(0)
+{
+}
+
+SharedFilterData::~SharedFilterData()
+{
+}
+
+// static
+std::unique_ptr<SharedFilterData> SharedFilterData::Attach(const uint8_t* data, size_t size)
+{
+  std::unique_ptr<SharedFilterData> result(new SharedFilterData());
+  size_t offset = sizeof(MAGIC);
+  uint32_t version = 0;
+  uint32_t matcherSize = 0;
+  if (!data || size < offset || !std::equal(MAGIC, MAGIC + offset, data) ||
+      !ReadInteger(data, size, &offset, &version) || version != VERSION ||
+      !ReadInteger(data, size, &offset, &matcherSize) || !IsInRange(offset, matcherSize, size))
+    return nullptr;
+  if (!result->matcher_->Deserialize(
+          std::vector<uint8_t>(data + offset, data + offset + matcherSize), MATCHER_CHECKSUM))
+    return nullptr;
+  offset += matcherSize;
+
+  if (!ReadInteger(data, size, &offset, &result->genericOffset_) ||
+      !ReadInteger(data, size, &offset, &result->genericLength_) ||
+      !ReadInteger(data, size, &offset, &result->defaultOffset_) ||
+      !ReadInteger(data, size, &offset, &result->defaultLength_) ||
+      !ReadInteger(data, size, &offset, &result->domainCount_) ||
+      !IsInRange(result->genericOffset_, result->genericLength_, size) ||
+      !IsInRange(result->defaultOffset_, result->defaultLength_, size) ||
+      (size - offset) / DOMAIN_ENTRY_SIZE < result->domainCount_)
+    return nullptr;
+  result->data_ = data;
+  result->size_ = size;
+  result->domainTableOffset_ = offset;
+  for (uint32_t i = 0; i < result->domainCount_; ++i)
+  {
+    const DomainEntry entry = result->ReadDomainEntry(i);
+    if (!IsInRange(entry.domainOffset, entry.domainLength, size) ||
+        !IsInRange(entry.domainStyleSheetOffset, entry.domainStyleSheetLength, size) ||
+        !IsInRange(entry.specificStyleSheetOffset, entry.specificStyleSheetLength, size))
+      return nullptr;
+  }
+  return result;
+}
+
+SharedFilterData::Result SharedFilterData::Match(const std::string& url,
+                                                 IFilterEngine::ContentTypeMask contentTypeMask,
+                                                 const std::string& documentUrl,
+                                                 bool specificOnly,
+                                                 std::string* filterText) const
+{
+  std::shared_ptr<const std::string> text;
+  switch (matcher_->Match(url, contentTypeMask, documentUrl, specificOnly, &text))
+  {
+  case NativeMatcher::Result::MATCH:
+    *filterText = *text;
+    return Result::MATCH;
+  case NativeMatcher::Result::UNKNOWN:
+    return Result::UNKNOWN;
+  case NativeMatcher::Result::NO_MATCH:
+    break;
+  }
+  return Result::NO_MATCH;
+}
+
+std::string SharedFilterData::GetElementHidingStyleSheet(const std::string& domain,
+                                                         bool specificOnly) const
+{
+  DomainEntry entry;
+  const bool found = FindDomain(GetHost(domain), &entry);
+  if (specificOnly)
+    return found ? ReadString(entry.specificStyleSheetOffset, entry.specificStyleSheetLength)
+                 : std::string();
+  std::string result = ReadString(genericOffset_, genericLength_);
+  result += found ? ReadString(entry.domainStyleSheetOffset, entry.domainStyleSheetLength)
+                  : ReadString(defaultOffset_, defaultLength_);
+  return result;
+}
+
+SharedFilterData::DomainEntry SharedFilterData::ReadDomainEntry(uint32_t index) const
+{
+  size_t offset = domainTableOffset_ + index * DOMAIN_ENTRY_SIZE;
+  DomainEntry entry;
+  for (uint32_t* value : {&entry.domainOffset,
+                          &entry.domainLength,
+                          &entry.domainStyleSheetOffset,
+                          &entry.domainStyleSheetLength,
+                          &entry.specificStyleSheetOffset,
+                          &entry.specificStyleSheetLength})
+    ReadInteger(data_, size_, &offset, value);
+  return entry;
+}
+
+bool SharedFilterData::FindDomain(const std::string& host, DomainEntry* entry) const
+{
+  // Every domain which any element hiding filter mentions has an entry, so
+  // the filters which apply on a host are the ones of its longest listed
+  // parent domain.
+  for (size_t start = 0; start < host.size();)
+  {
+    const char* domain = host.c_str() + start;
+    const size_t length = host.size() - start;
+    uint32_t low = 0;
+    uint32_t high = domainCount_;
+    while (low < high)
+    {
+      const uint32_t middle = low + (high - low) / 2;
+      *entry = ReadDomainEntry(middle);
+      const int comparison = std::memcmp(
+          data_ + entry->domainOffset, domain, std::min<size_t>(entry->domainLength, length));
+      if (comparison == 0 && entry->domainLength == length)
+        return true;
+      if (comparison < 0 || (comparison == 0 && entry->domainLength < length))
+        low = middle + 1;
+      else
+        high = middle;
+    }
+    const size_t dot = host.find('.', start);
+    if (dot == std::string::npos)
+      break;
+    start = dot + 1;
+  }
+  return false;
+}
+
+std::string SharedFilterData::ReadString(uint32_t offset, uint32_t length) const
+{
+  return std::string(reinterpret_cast<const char*>(data_) + offset, length);
+}
@@ -0,0 +1,38 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "NativeMatcher.h"
+
+namespace AdblockPlus
+{
+  /**
+   * Writes the data read by SharedFilterData::Attach().
+   * @param matcher URL filters.
+   * @param elementHiding Generic style sheet, domain specific style sheet
+   *        for domains without filters of their own, followed by triples of
+   *        domain, its domain specific style sheet and the one for
+   *        `specificOnly`, see "API.getSharedElementHiding".
+   * @return Serialized data.
+   */
+  std::vector<uint8_t> WriteSharedFilterData(const NativeMatcher& matcher,
+                                             const std::vector<std::string>& elementHiding);
+}
@@ -0,0 +1,471 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SignatureVerifier.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  typedef std::vector<uint8_t> Bytes;
+  // Little-endian 32-bit limbs.
+  typedef std::vector<uint32_t> BigNum;
+
+  const uint8_t DER_INTEGER = 0x02;
+  const uint8_t DER_BIT_STRING = 0x03;
+  const uint8_t DER_OCTET_STRING = 0x04;
+  const uint8_t DER_NULL = 0x05;
+  const uint8_t DER_OID = 0x06;
+  const uint8_t DER_SEQUENCE = 0x30;
+  // 1.3.14.3.2.26
+  const uint8_t SHA1_OID[] = {0x2B, 0x0E, 0x03, 0x02, 0x1A};
+  const size_t SHA1_SIZE = 20;
+  // In bytes, sitekeys have 512 bits but any sensible key is accepted.
+  const size_t MAX_MODULUS_SIZE = 512;
+
+  // Same as atob(): whitespace is skipped, anything else is an error.
+  bool DecodeBase64(const std::string& str, Bytes* result)
+  {
+    uint32_t buffer = 0;
+    int bits = 0;
+    size_t padding = 0;
+    for (char c : str)
+    {
+      uint32_t value;
+      if (c >= 'A' && c <= 'Z')
+        value = c - 'A';
+      else if (c >= 'a' && c <= 'z')
+        value = c - 'a' + 26;
+      else if (c >= '0' && c <= '9')
+        value = c - '0' + 52;
+      else if (c == '+')
+        value = 62;
+      else if (c == '/')
+        value = 63;
+      else if (c == '=')
+      {
+        ++padding;
+        continue;
+      }
+      else if (c == ' ' || c == '\t' || c == '\n' || c == '\f' || c == '\r')
+        continue;
+      else
+        return false;
+      if (padding)
+        return false;
+      buffer = (buffer << 6) | value;
+      bits += 6;
+      if (bits >= 8)
+      {
+        bits -= 8;
+        result->push_back(static_cast<uint8_t>(buffer >> bits));
+      }
+    }
+    return bits != 6 && padding <= 2;
+  }
+
+  class DerReader
+  {
+  public:
+    DerReader(const uint8_t* data, size_t size) : data(data), size(size)
+    {
+    }
+
+    // Reads the next element, which must have the tag.
+    bool Read(uint8_t tag, DerReader* content)
+    {
+      if (size < 2 || data[0] != tag)
+        return false;
+      size_t length = data[1];
+      size_t header = 2;
+      if (length & 0x80)
+      {
+        const size_t lengthBytes = length & 0x7F;
+        if (lengthBytes == 0 || lengthBytes > 4 || size < 2 + lengthBytes)
+          return false;
+        length = 0;
+        for (size_t i = 0; i < lengthBytes; ++i)
+          length = (length << 8) | data[2 + i];
+        header += lengthBytes;
+      }
+      if (length > size - header)
+        return false;
+      *content = DerReader(data + header, length);
+      data += header + length;
+      size -= header + length;
+      return true;
+    }
+
+    bool Peek(uint8_t tag) const
+    {
+      return size && data[0] == tag;
+    }
+
+    bool Equals(const uint8_t* other, size_t otherSize) const
+    {
+      return size == otherSize && std::equal(data, data + size, other);
+    }
+
+    const uint8_t* data;
+    size_t size;
+  };
+
+  BigNum ToBigNum(const uint8_t* data, size_t size)
+  {
+    while (size && !*data)
+    {
+      ++data;
+      --size;
+    }
+    BigNum result((size + 3) / 4, 0);
+    for (size_t i = 0; i < size; ++i)
+      result[i / 4] |= static_cast<uint32_t>(data[size - 1 - i]) << (8 * (i % 4));
+    return result;
+  }
+
+  int Compare(const BigNum& a, const BigNum& b)
+  {
+    for (size_t i = a.size(); i-- > 0;)
+    {
+      if (a[i] != b[i])
+        return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+  }
+
+  // a - b modulo 2^(32 * a.size())
+  void Subtract(BigNum* a, const BigNum& b)
+  {
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < a->size(); ++i)
+    {
+      const uint64_t difference = static_cast<uint64_t>((*a)[i]) - b[i] - borrow;
+      (*a)[i] = static_cast<uint32_t>(difference);
+      borrow = (difference >> 32) & 1;
+    }
+  }
+
+  // Arithmetic modulo an odd number in Montgomery form, with R = 2^(32 * k).
+  class Montgomery
+  {
+  public:
+    explicit Montgomery(const BigNum& modulus) : n(modulus)
+    {
+      // Inverse of n[0] modulo 2^32 by Newton's iteration.
+      uint32_t inverse = n[0];
+      for (int i = 0; i < 5; ++i)
+        inverse *= 2 - n[0] * inverse;
+      n0inv = 0 - inverse;
+
+      // R^2 mod n by doubling one 64 * k times.
+      r2.assign(n.size(), 0);
+      r2[0] = 1;
+      for (size_t i = 0; i < 64 * n.size(); ++i)
+      {
+        uint32_t carry = 0;
+        for (auto& limb : r2)
+        {
+          const uint32_t next = limb >> 31;
+          limb = (limb << 1) | carry;
+          carry = next;
+        }
+        if (carry || Compare(r2, n) >= 0)
+          Subtract(&r2, n);
+      }
+    }
+
+    // a * b / R mod n
+    BigNum Multiply(const BigNum& a, const BigNum& b) const
+    {
+      const size_t k = n.size();
+      std::vector<uint32_t> t(k + 2, 0);
+      for (size_t i = 0; i < k; ++i)
+      {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < k; ++j)
+        {
+          const uint64_t sum = t[j] + static_cast<uint64_t>(a[j]) * b[i] + carry;
+          t[j] = static_cast<uint32_t>(sum);
+          carry = sum >> 32;
+        }
+        uint64_t sum = t[k] + carry;
+        t[k] = static_cast<uint32_t>(sum);
+        t[k + 1] = static_cast<uint32_t>(sum >> 32);
+
+        const uint32_t m = t[0] * n0inv;
+        carry = (t[0] + static_cast<uint64_t>(m) * n[0]) >> 32;
+        for (size_t j = 1; j < k; ++j)
+        {
+          sum = t[j] + static_cast<uint64_t>(m) * n[j] + carry;
+          t[j - 1] = static_cast<uint32_t>(sum);
+          carry = sum >> 32;
+        }
+        sum = t[k] + carry;
+        t[k - 1] = static_cast<uint32_t>(sum);
+        t[k] = t[k + 1] + static_cast<uint32_t>(sum >> 32);
+        t[k + 1] = 0;
+      }
+      BigNum result(t.begin(), t.begin() + k);
+      if (t[k] || Compare(result, n) >= 0)
+        Subtract(&result, n);
+      return result;
+    }
+
+    // base^exponent mod n, base must be less than n.
+    BigNum Power(const BigNum& base, const BigNum& exponent) const
+    {
+      BigNum one(n.size(), 0);
+      one[0] = 1;
+      const BigNum x = Multiply(base, r2);
+      BigNum result = Multiply(one, r2);
+      for (size_t i = exponent.size() * 32; i-- > 0;)
+      {
+        result = Multiply(result, result);
+        if ((exponent[i / 32] >> (i % 32)) & 1)
+          result = Multiply(result, x);
+      }
+      return Multiply(result, one);
+    }
+
+  private:
+    BigNum n;
+    BigNum r2;
+    uint32_t n0inv;
+  };
+
+  class Sha1
+  {
+  public:
+    Sha1() : h{0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0}
+    {
+    }
+
+    void Update(uint8_t byte)
+    {
+      block[length++ % 64] = byte;
+      if (length % 64 == 0)
+        ProcessBlock();
+    }
+
+    Bytes Finish()
+    {
+      const uint64_t bitLength = length * 8;
+      Update(0x80);
+      while (length % 64 != 56)
+        Update(0);
+      for (int i = 7; i >= 0; --i)
+        Update(static_cast<uint8_t>(bitLength >> (8 * i)));
+      Bytes digest;
+      for (uint32_t word : h)
+      {
+        for (int i = 3; i >= 0; --i)
+          digest.push_back(static_cast<uint8_t>(word >> (8 * i)));
+      }
+      return digest;
+    }
+
+  private:
+    static uint32_t Rotate(uint32_t value, int bits)
+    {
+      return (value << bits) | (value >> (32 - bits));
+    }
+
+    void ProcessBlock()
+    {
+      uint32_t w[80];
+      for (int i = 0; i < 16; ++i)
+      {
+        w[i] = static_cast<uint32_t>(block[4 * i]) << 24 |
+               static_cast<uint32_t>(block[4 * i + 1]) << 16 |
+               static_cast<uint32_t>(block[4 * i + 2]) << 8 | block[4 * i + 3];
+      }
+      for (int i = 16; i < 80; ++i)
+        w[i] = Rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+      uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+      for (int i = 0; i < 80; ++i)
+      {
+        uint32_t f, k;
+        if (i < 20)
+        {
+          f = (b & c) | (~b & d);
+          k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+          f = b ^ c ^ d;
+          k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+          f = (b & c) | (b & d) | (c & d);
+          k = 0x8F1BBCDC;
+        }
+        else
+        {
+          f = b ^ c ^ d;
+          k = 0xCA62C1D6;
+        }
+        const uint32_t temp = Rotate(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = Rotate(b, 30);
+        b = a;
+        a = temp;
+      }
+      h[0] += a;
+      h[1] += b;
+      h[2] += c;
+      h[3] += d;
+      h[4] += e;
+    }
+
+    uint32_t h[5];
+    uint8_t block[64];
+    uint64_t length = 0;
+  };
+
+  // Hashes what Rusha gets from the JS string: the low byte of each UTF-16
+  // code unit, with invalid UTF-8 sequences decoded as U+FFFD like V8 does.
+  Bytes HashData(const std::string& data)
+  {
+    Sha1 sha1;
+    for (size_t i = 0; i < data.size();)
+    {
+      const auto lead = static_cast<unsigned char>(data[i++]);
+      if (lead < 0x80)
+      {
+        sha1.Update(lead);
+        continue;
+      }
+      size_t length = 0;
+      uint32_t codePoint = 0xFFFD;
+      uint32_t minimum = 0;
+      if ((lead & 0xE0) == 0xC0)
+      {
+        length = 1;
+        codePoint = lead & 0x1F;
+        minimum = 0x80;
+      }
+      else if ((lead & 0xF0) == 0xE0)
+      {
+        length = 2;
+        codePoint = lead & 0x0F;
+        minimum = 0x800;
+      }
+      else if ((lead & 0xF8) == 0xF0)
+      {
+        length = 3;
+        codePoint = lead & 0x07;
+        minimum = 0x10000;
+      }
+      size_t consumed = 0;
+      while (consumed < length && i < data.size() &&
+             (static_cast<unsigned char>(data[i]) & 0xC0) == 0x80)
+      {
+        codePoint = (codePoint << 6) | (static_cast<unsigned char>(data[i++]) & 0x3F);
+        ++consumed;
+      }
+      if (consumed < length || codePoint < minimum || codePoint > 0x10FFFF ||
+          (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+        codePoint = 0xFFFD;
+      if (codePoint >= 0x10000)
+      {
+        codePoint -= 0x10000;
+        sha1.Update(static_cast<uint8_t>(0xD800 | (codePoint >> 10)));
+        sha1.Update(static_cast<uint8_t>(0xDC00 | (codePoint & 0x3FF)));
+      }
+      else
+        sha1.Update(static_cast<uint8_t>(codePoint));
+    }
+    return sha1.Finish();
+  }
+
+  bool ReadPublicKey(const Bytes& key, BigNum* modulus, BigNum* exponent)
+  {
+    DerReader reader(key.data(), key.size());
+    DerReader publicKeyInfo(nullptr, 0), algorithm(nullptr, 0), bits(nullptr, 0);
+    DerReader rsaKey(nullptr, 0), n(nullptr, 0), e(nullptr, 0);
+    if (!reader.Read(DER_SEQUENCE, &publicKeyInfo) ||
+        !publicKeyInfo.Read(DER_SEQUENCE, &algorithm) ||
+        !publicKeyInfo.Read(DER_BIT_STRING, &bits) || bits.size < 1 || bits.data[0] != 0)
+      return false;
+    DerReader bitsContent(bits.data + 1, bits.size - 1);
+    if (!bitsContent.Read(DER_SEQUENCE, &rsaKey) || !rsaKey.Read(DER_INTEGER, &n) ||
+        !rsaKey.Read(DER_INTEGER, &e))
+      return false;
+    *modulus = ToBigNum(n.data, n.size);
+    *exponent = ToBigNum(e.data, e.size);
+    return !modulus->empty() && modulus->size() * 4 <= MAX_MODULUS_SIZE && ((*modulus)[0] & 1) &&
+           !exponent->empty();
+  }
+
+  bool CheckPadding(const BigNum& message, const Bytes& digest)
+  {
+    // Big-endian without the leading zero byte: 01 FF .. FF 00 DigestInfo
+    Bytes bytes;
+    for (size_t i = message.size() * 4; i-- > 0;)
+    {
+      const auto byte = static_cast<uint8_t>(message[i / 4] >> (8 * (i % 4)));
+      if (byte || !bytes.empty())
+        bytes.push_back(byte);
+    }
+    size_t pos = 0;
+    if (bytes.empty() || bytes[pos++] != 0x01)
+      return false;
+    while (pos < bytes.size() && bytes[pos] == 0xFF)
+      ++pos;
+    if (pos == bytes.size() || bytes[pos++] != 0x00)
+      return false;
+
+    DerReader reader(bytes.data() + pos, bytes.size() - pos);
+    DerReader digestInfo(nullptr, 0), algorithm(nullptr, 0), oid(nullptr, 0);
+    DerReader hash(nullptr, 0), parameters(nullptr, 0);
+    if (!reader.Read(DER_SEQUENCE, &digestInfo) || !digestInfo.Read(DER_SEQUENCE, &algorithm) ||
+        !algorithm.Read(DER_OID, &oid) || !oid.Equals(SHA1_OID, sizeof(SHA1_OID)))
+      return false;
+    if (algorithm.Peek(DER_NULL) && !algorithm.Read(DER_NULL, &parameters))
+      return false;
+    return digestInfo.Read(DER_OCTET_STRING, &hash) && hash.size == SHA1_SIZE &&
+           hash.Equals(digest.data(), digest.size());
+  }
+}
+
+bool SignatureVerifier::Verify(const std::string& publicKey,
+                               const std::string& signature,
+                               const std::string& data)
+{
+  Bytes keyBytes, signatureBytes;
+  BigNum modulus, exponent;
+  if (!DecodeBase64(publicKey, &keyBytes) || !DecodeBase64(signature, &signatureBytes) ||
+      !ReadPublicKey(keyBytes, &modulus, &exponent))
+    return false;
+
+  BigNum value = ToBigNum(signatureBytes.data(), signatureBytes.size());
+  if (value.empty() || value.size() > modulus.size())
+    return false;
+  value.resize(modulus.size(), 0);
+  if (Compare(value, modulus) >= 0)
+    return false;
+
+  const Montgomery montgomery(modulus);
+  return CheckPadding(montgomery.Power(value, exponent), HashData(data));
+}
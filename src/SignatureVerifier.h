@@ -0,0 +1,41 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace AdblockPlus
+{
+  namespace SignatureVerifier
+  {
+    /**
+     * Verifies an RSA signature with SHA-1 and PKCS #1 v1.5 padding, natively
+     * and with the same results as `verifySignature()` of the `rsa` module
+     * in adblockpluscore.
+     * @param publicKey Base64 encoded DER structure of the public key.
+     * @param signature Base64 encoded signature.
+     * @param data UTF-8 encoded data which was signed. Like the JS code does
+     *        it, only the low bytes of its UTF-16 code units are hashed.
+     * @return `true` if the signature is valid, `false` if it isn't or if
+     *         either the key or the signature can't be decoded.
+     */
+    bool Verify(const std::string& publicKey,
+                const std::string& signature,
+                const std::string& data);
+  }
+}
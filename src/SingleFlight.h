@@ -0,0 +1,114 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace AdblockPlus
+{
+  /**
+   * Synchronous calls by key, so that threads making a call while an equal
+   * one is running wait for it and share its result instead of computing it
+   * again, the counterpart of CoalescedCalls for synchronous calls.
+   *
+   * The key has to identify the state which the result depends on too, e.g.
+   * by a generation counter, callers with another key compute their own.
+   */
+  template<class Result> class SingleFlight
+  {
+  public:
+    /**
+     * Returns the result of the running call with the key, or calls
+     * `compute` if there is none. An exception thrown by `compute` is
+     * thrown to all callers waiting for it.
+     */
+    template<class Compute> Result Do(const std::string& key, Compute compute)
+    {
+      std::shared_ptr<Flight> flight;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto& running = flights[key];
+        if (running)
+        {
+          flight = running;
+          ++waits;
+          done.wait(lock, [&flight]() { return flight->done; });
+          if (flight->error)
+            std::rethrow_exception(flight->error);
+          return flight->result;
+        }
+        running = flight = std::make_shared<Flight>();
+      }
+
+      try
+      {
+        Result result = compute();
+        Complete(key, *flight, &result, nullptr);
+        return result;
+      }
+      catch (...)
+      {
+        Complete(key, *flight, nullptr, std::current_exception());
+        throw;
+      }
+    }
+
+    /**
+     * @return Number of calls which waited for an equal one so far.
+     */
+    size_t GetWaitCount() const
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return waits;
+    }
+
+  private:
+    struct Flight
+    {
+      bool done = false;
+      Result result;
+      std::exception_ptr error;
+    };
+
+    void Complete(const std::string& key,
+                  Flight& flight,
+                  const Result* result,
+                  std::exception_ptr error)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        flight.done = true;
+        if (result)
+          flight.result = *result;
+        flight.error = error;
+        flights.erase(key);
+      }
+      done.notify_all();
+    }
+
+    mutable std::mutex mutex;
+    std::condition_variable done;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights;
+    size_t waits = 0;
+  };
+}
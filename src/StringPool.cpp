@@ -0,0 +1,71 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StringPool.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  // Document hosts and sitekeys of the pages of several tabs.
+  const size_t SHARED_POOL_SIZE = 4096;
+}
+
+const StringPool::Id StringPool::EMPTY;
+
+StringPool::StringPool(size_t capacity) : capacity_(capacity)
+{
+}
+
+// static
+StringPool& StringPool::Shared()
+{
+  static StringPool pool(SHARED_POOL_SIZE);
+  return pool;
+}
+
+StringPool::Id StringPool::Intern(const std::string& str)
+{
+  if (str.empty())
+    return EMPTY;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = ids_.find(str);
+  if (it != ids_.end())
+    return it->second;
+  // Strings interned again get new IDs, the old ones stay unused.
+  if (ids_.size() >= capacity_)
+    ids_.clear();
+  const Id id = nextId_;
+  if (++nextId_ == EMPTY)
+    ++nextId_;
+  if (capacity_ != 0)
+    ids_.emplace(str, id);
+  return id;
+}
+
+size_t StringPool::Size() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return ids_.size();
+}
+
+void StringPool::Clear()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  ids_.clear();
+}
@@ -0,0 +1,85 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace AdblockPlus
+{
+  /**
+   * Hands out compact IDs for strings, so that keys which would otherwise
+   * hold many copies of the same few strings, e.g. the document hosts and
+   * sitekeys of cached match results, store and compare 32-bit integers.
+   *
+   * The pool holds up to `capacity` strings and starts over once it is full
+   * or cleared. IDs are not handed out again until 2^32 strings have been
+   * interned, so keys holding the IDs of dropped strings merely stop
+   * matching the same strings interned again.
+   *
+   * The methods are thread safe.
+   */
+  class StringPool
+  {
+  public:
+    typedef uint32_t Id;
+
+    /**
+     * ID of the empty string, which is never stored.
+     */
+    static const Id EMPTY = 0;
+
+    /**
+     * @param capacity Number of strings to hold at most.
+     */
+    explicit StringPool(size_t capacity);
+
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    /**
+     * @return Pool shared by the filter engines of the process.
+     */
+    static StringPool& Shared();
+
+    /**
+     * Looks up the ID of a string, the string is added if it isn't there.
+     * @param str String to intern.
+     * @return ID which only `str` has, `EMPTY` for the empty string.
+     */
+    Id Intern(const std::string& str);
+
+    /**
+     * @return Number of strings held.
+     */
+    size_t Size() const;
+
+    /**
+     * Drops all strings, e.g. on memory pressure.
+     */
+    void Clear();
+
+  private:
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Id> ids_;
+    Id nextId_ = EMPTY + 1;
+  };
+}
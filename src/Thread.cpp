@@ -18,6 +18,13 @@
 #ifndef WIN32
 #include <unistd.h>
 #endif
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#elif defined(__APPLE__)
+#include <pthread/qos.h>
+#endif
 
 #include "Thread.h"
 
@@ -30,4 +37,57 @@ void AdblockPlus::Sleep(int millis)
 #else
   usleep(millis * 1000);
 #endif
-}
\ No newline at end of file
+}
+
+bool AdblockPlus::ApplyThreadOptions(const ThreadOptions& options)
+{
+  bool applied = true;
+#if defined(WIN32)
+  if (options.priority != ThreadOptions::Priority::DEFAULT)
+  {
+    const int priority = options.priority == ThreadOptions::Priority::INTERACTIVE
+                             ? THREAD_PRIORITY_ABOVE_NORMAL
+                             : THREAD_PRIORITY_BELOW_NORMAL;
+    applied &= SetThreadPriority(GetCurrentThread(), priority) != 0;
+  }
+  if (!options.cpus.empty())
+  {
+    DWORD_PTR mask = 0;
+    for (size_t cpu : options.cpus)
+    {
+      if (cpu < sizeof(mask) * 8)
+        mask |= static_cast<DWORD_PTR>(1) << cpu;
+    }
+    applied &= mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+  }
+#elif defined(__linux__)
+  // The nice value of a thread only applies to the thread itself on Linux.
+  if (options.priority != ThreadOptions::Priority::DEFAULT)
+  {
+    const int nice = options.priority == ThreadOptions::Priority::INTERACTIVE ? -4 : 10;
+    applied &= setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), nice) == 0;
+  }
+  if (!options.cpus.empty())
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t cpu : options.cpus)
+    {
+      if (cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &set);
+    }
+    applied &= CPU_COUNT(&set) != 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+  }
+#elif defined(__APPLE__)
+  if (options.priority != ThreadOptions::Priority::DEFAULT)
+  {
+    const qos_class_t qos = options.priority == ThreadOptions::Priority::INTERACTIVE
+                                ? QOS_CLASS_USER_INTERACTIVE
+                                : QOS_CLASS_UTILITY;
+    applied &= pthread_set_qos_class_self_np(qos, 0) == 0;
+  }
+#else
+  applied = options.priority == ThreadOptions::Priority::DEFAULT && options.cpus.empty();
+#endif
+  return applied;
+}
@@ -22,6 +22,8 @@
 #include <mutex>
 #include <string>
 
+#include <AdblockPlus/ThreadOptions.h>
+
 #ifdef WIN32
 #include <windows.h>
 #else
@@ -74,4 +76,10 @@ namespace AdblockPlus
   };
 
   void Sleep(int millis);
+
+  /**
+   * Applies the options to the calling thread.
+   * @return `false` if the system refused any of them.
+   */
+  bool ApplyThreadOptions(const ThreadOptions& options);
 }
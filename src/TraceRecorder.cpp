@@ -0,0 +1,168 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "Utils.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  // Records are passed to the file system in chunks of about that size.
+  const size_t CHUNK_SIZE = 16 * 1024;
+
+  void AppendJsonList(const std::vector<std::string>& values, std::string* json)
+  {
+    json->push_back('[');
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+      if (i != 0)
+        json->push_back(',');
+      Utils::AppendJsonString(values[i], json);
+    }
+    json->push_back(']');
+  }
+
+  void AppendField(const char* name, const std::string& value, std::string* json)
+  {
+    json->append(",\"").append(name).append("\":");
+    Utils::AppendJsonString(value, json);
+  }
+
+  void AppendField(const char* name, int64_t value, std::string* json)
+  {
+    json->append(",\"").append(name).append("\":").append(std::to_string(value));
+  }
+}
+
+TraceRecorder::TraceRecorder(IFileSystem& fileSystem, const Options& options, const Clock& clock)
+    : options(options), clock(clock), writer(fileSystem.OpenWriter(options.fileName)),
+      random(std::random_device()()),
+      sample(std::min(std::max(options.samplingRatio, 0.0), 1.0))
+{
+}
+
+void TraceRecorder::RecordFilterMatch(const std::string& url,
+                                      IFilterEngine::ContentTypeMask contentTypeMask,
+                                      const std::vector<std::string>& documentUrls,
+                                      const std::string& siteKey,
+                                      bool blocked)
+{
+  if (!Admit())
+    return;
+  // The fields are sorted by name, like Chromium writes them.
+  std::string record = "{\"_fn\":\"check-filter-match\",\"_res\":";
+  record.append(blocked ? "true" : "false");
+  AppendField("adblock_resource_type", contentTypeMask, &record);
+  AppendField("initiator_url", documentUrls.empty() ? "" : documentUrls.front(), &record);
+  AppendField("process_id", 0, &record);
+  record.append(",\"referrers\":");
+  AppendJsonList(documentUrls, &record);
+  AppendField("render_frame_id", 0, &record);
+  AppendField("request_url", url, &record);
+  AppendField("resource_type", 0, &record);
+  AppendField("sitekey", siteKey, &record);
+  record.append("}\n");
+  Append(std::move(record));
+}
+
+void TraceRecorder::RecordPopup(const std::string& url, const std::string& opener, bool blocked)
+{
+  if (!Admit())
+    return;
+  std::string record = "{\"_fn\":\"block-popup\",\"_res\":";
+  record.append(blocked ? "true" : "false");
+  AppendField("opener", opener, &record);
+  AppendField("url", url, &record);
+  record.append("}\n");
+  Append(std::move(record));
+}
+
+void TraceRecorder::RecordElementHiding(const std::string& url,
+                                        const std::vector<std::string>& documentUrls,
+                                        const std::string& siteKey)
+{
+  if (!Admit())
+    return;
+  std::string record = "{\"_fn\":\"generate-js-css\"";
+  AppendField("frame_id", 0, &record);
+  AppendField("gurl", url, &record);
+  AppendField("process_id", 0, &record);
+  record.append(",\"referrers\":");
+  AppendJsonList(documentUrls, &record);
+  AppendField("sitekey", siteKey, &record);
+  record.append("}\n");
+  Append(std::move(record));
+}
+
+void TraceRecorder::Commit(const IFileSystem::Callback& callback)
+{
+  std::unique_ptr<IFileSystem::IFileWriter> committed;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    committed = std::move(writer);
+    if (committed && !pending.empty())
+      committed->Append(IFileSystem::IOBuffer(pending.begin(), pending.end()));
+    pending.clear();
+  }
+  if (!committed)
+  {
+    if (callback)
+      callback("");
+    return;
+  }
+  // An empty callback wouldn't tell the writer to commit.
+  committed->Commit(callback ? callback : [](const std::string&) {});
+}
+
+bool TraceRecorder::Admit()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!writer || (options.maxRecords != 0 && recordCount >= options.maxRecords))
+    return false;
+  if (options.maxRecordsPerSecond != 0)
+  {
+    const auto now = clock();
+    if (windowCount == 0 || now - windowStart >= std::chrono::seconds(1))
+    {
+      windowStart = now;
+      windowCount = 0;
+    }
+    if (windowCount >= options.maxRecordsPerSecond)
+      return false;
+  }
+  if (options.samplingRatio < 1.0 && !sample(random))
+    return false;
+  ++windowCount;
+  ++recordCount;
+  return true;
+}
+
+void TraceRecorder::Append(std::string&& record)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!writer)
+    return;
+  pending.append(record);
+  if (pending.size() < CHUNK_SIZE)
+    return;
+  writer->Append(IFileSystem::IOBuffer(pending.begin(), pending.end()));
+  pending.clear();
+}
@@ -0,0 +1,111 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <AdblockPlus/IFileSystem.h>
+#include <AdblockPlus/IFilterEngine.h>
+
+namespace AdblockPlus
+{
+  /**
+   * Writes samples of the calls into the filter engine in the format of the
+   * `data/rec_*.log` files, see IFilterEngine::StartTraceRecording(). The
+   * records are passed to the file system in chunks as they come, the file
+   * is only replaced on Commit().
+   *
+   * The class is thread safe.
+   */
+  class TraceRecorder
+  {
+  public:
+    typedef IFilterEngine::TraceRecordingOptions Options;
+    typedef std::function<std::chrono::steady_clock::time_point()> Clock;
+
+    /**
+     * @param fileSystem File system to write to, it has to outlive the
+     *        recorder.
+     * @param options Where to write and how many calls to record.
+     * @param clock Time source of the rate limit.
+     */
+    TraceRecorder(IFileSystem& fileSystem,
+                  const Options& options,
+                  const Clock& clock = std::chrono::steady_clock::now);
+
+    /**
+     * Records a `check-filter-match` call.
+     * @param url Request URL.
+     * @param contentTypeMask Content type mask of the request.
+     * @param documentUrls Chain of document URLs, starting with the frame.
+     * @param siteKey Sitekey of the frame.
+     * @param blocked Whether the request was blocked.
+     */
+    void RecordFilterMatch(const std::string& url,
+                           IFilterEngine::ContentTypeMask contentTypeMask,
+                           const std::vector<std::string>& documentUrls,
+                           const std::string& siteKey,
+                           bool blocked);
+
+    /**
+     * Records a `block-popup` call.
+     * @param url Popup URL.
+     * @param opener URL of the document which opened the popup.
+     * @param blocked Whether the popup was blocked.
+     */
+    void RecordPopup(const std::string& url, const std::string& opener, bool blocked);
+
+    /**
+     * Records a `generate-js-css` call.
+     * @param url Document URL.
+     * @param documentUrls Chain of document URLs, starting with the frame.
+     * @param siteKey Sitekey of the frame.
+     */
+    void RecordElementHiding(const std::string& url,
+                             const std::vector<std::string>& documentUrls,
+                             const std::string& siteKey);
+
+    /**
+     * Writes the file, later records are dropped.
+     * @param callback Called once the file is written, with an error message
+     *        or an empty string.
+     */
+    void Commit(const IFileSystem::Callback& callback);
+
+  private:
+    bool Admit();
+    void Append(std::string&& record);
+
+    const Options options;
+    const Clock clock;
+    std::mutex mutex;
+    std::unique_ptr<IFileSystem::IFileWriter> writer;
+    std::string pending;
+    size_t recordCount = 0;
+    std::chrono::steady_clock::time_point windowStart;
+    size_t windowCount = 0;
+    std::minstd_rand random;
+    std::bernoulli_distribution sample;
+  };
+}
@@ -0,0 +1,375 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <AdblockPlus/URLInfo.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "HostCache.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  const uint32_t MAX_INT = 0x7FFFFFFF;
+  const uint32_t BASE = 36;
+  const uint32_t T_MIN = 1;
+  const uint32_t T_MAX = 26;
+  const uint32_t SKEW = 38;
+  const uint32_t DAMP = 700;
+  const uint32_t INITIAL_BIAS = 72;
+  const uint32_t INITIAL_N = 0x80;
+  const uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+  // Port of the URI constructor in uri.js.
+  bool FindHost(const std::string& url, size_t* schemeEnd, size_t* hostStart, size_t* hostEnd)
+  {
+    *schemeEnd = url.find(':');
+    if (*schemeEnd == std::string::npos)
+      return false;
+
+    size_t hostPortStart =
+        url.compare(*schemeEnd + 1, 2, "//") == 0 ? *schemeEnd + 3 : *schemeEnd + 1;
+    if (hostPortStart >= url.size())
+      return false;
+
+    size_t hostPortEnd = url.find('/', hostPortStart);
+    if (hostPortEnd == std::string::npos)
+      hostPortEnd = std::min(std::min(url.find('?', hostPortStart), url.find('#', hostPortStart)),
+                             url.size());
+
+    size_t authEnd = url.find('@', hostPortStart);
+    if (authEnd != std::string::npos && authEnd < hostPortEnd)
+      hostPortStart = authEnd + 1;
+
+    *hostStart = hostPortStart;
+    *hostEnd = url.find(']', hostPortStart + 1);
+    if (hostPortStart < url.size() && url[hostPortStart] == '[' &&
+        *hostEnd != std::string::npos && *hostEnd < hostPortEnd)
+    {
+      // The host is an IPv6 literal
+      *hostStart = hostPortStart + 1;
+    }
+    else
+    {
+      *hostEnd = url.find(':', *hostStart);
+      if (*hostEnd == std::string::npos || *hostEnd >= hostPortEnd)
+        *hostEnd = hostPortEnd;
+    }
+    return true;
+  }
+
+  // Decodes UTF-8 like V8 does it when creating a string, invalid sequences
+  // become U+FFFD.
+  std::vector<uint32_t> DecodeUtf8(const std::string& str)
+  {
+    std::vector<uint32_t> codePoints;
+    codePoints.reserve(str.size());
+    for (size_t i = 0; i < str.size();)
+    {
+      const auto lead = static_cast<unsigned char>(str[i++]);
+      size_t length = 0;
+      uint32_t codePoint = 0;
+      uint32_t minimum = 0;
+      if (lead < 0x80)
+      {
+        codePoints.push_back(lead);
+        continue;
+      }
+      else if ((lead & 0xE0) == 0xC0)
+      {
+        length = 1;
+        codePoint = lead & 0x1F;
+        minimum = 0x80;
+      }
+      else if ((lead & 0xF0) == 0xE0)
+      {
+        length = 2;
+        codePoint = lead & 0x0F;
+        minimum = 0x800;
+      }
+      else if ((lead & 0xF8) == 0xF0)
+      {
+        length = 3;
+        codePoint = lead & 0x07;
+        minimum = 0x10000;
+      }
+      else
+      {
+        codePoints.push_back(REPLACEMENT_CHARACTER);
+        continue;
+      }
+
+      size_t consumed = 0;
+      while (consumed < length && i < str.size() &&
+             (static_cast<unsigned char>(str[i]) & 0xC0) == 0x80)
+      {
+        codePoint = (codePoint << 6) | (static_cast<unsigned char>(str[i++]) & 0x3F);
+        ++consumed;
+      }
+      if (consumed < length || codePoint < minimum || codePoint > 0x10FFFF ||
+          (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+        codePoint = REPLACEMENT_CHARACTER;
+      codePoints.push_back(codePoint);
+    }
+    return codePoints;
+  }
+
+  void AppendUtf8(uint32_t codePoint, std::string* str)
+  {
+    if (codePoint < 0x80)
+      str->push_back(static_cast<char>(codePoint));
+    else if (codePoint < 0x800)
+    {
+      str->push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+      str->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+    else if (codePoint < 0x10000)
+    {
+      str->push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+      str->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+      str->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+    else
+    {
+      str->push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+      str->push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+      str->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+      str->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+  }
+
+  char DigitToBasic(uint32_t digit)
+  {
+    return static_cast<char>(digit < 26 ? 'a' + digit : '0' + digit - 26);
+  }
+
+  uint32_t Adapt(uint32_t delta, uint32_t numPoints, bool firstTime)
+  {
+    uint32_t k = 0;
+    delta = firstTime ? delta / DAMP : delta >> 1;
+    delta += delta / numPoints;
+    for (; delta > (BASE - T_MIN) * T_MAX >> 1; k += BASE)
+      delta /= BASE - T_MIN;
+    return k + (BASE - T_MIN + 1) * delta / (delta + SKEW);
+  }
+
+  // Port of encode() in punycode.js.
+  bool EncodePunycode(const std::vector<uint32_t>& input, std::string* output)
+  {
+    uint32_t n = INITIAL_N;
+    uint32_t delta = 0;
+    uint32_t bias = INITIAL_BIAS;
+
+    uint32_t basicLength = 0;
+    for (uint32_t codePoint : input)
+    {
+      if (codePoint < 0x80)
+      {
+        output->push_back(static_cast<char>(codePoint));
+        ++basicLength;
+      }
+    }
+    uint32_t handledCount = basicLength;
+    if (basicLength)
+      output->push_back('-');
+
+    while (handledCount < input.size())
+    {
+      uint32_t m = MAX_INT;
+      for (uint32_t codePoint : input)
+      {
+        if (codePoint >= n && codePoint < m)
+          m = codePoint;
+      }
+
+      const uint32_t handledCountPlusOne = handledCount + 1;
+      if (m - n > (MAX_INT - delta) / handledCountPlusOne)
+        return false;
+      delta += (m - n) * handledCountPlusOne;
+      n = m;
+
+      for (uint32_t codePoint : input)
+      {
+        if (codePoint < n && ++delta > MAX_INT)
+          return false;
+        if (codePoint != n)
+          continue;
+
+        uint32_t q = delta;
+        for (uint32_t k = BASE;; k += BASE)
+        {
+          const uint32_t t = k <= bias ? T_MIN : (k >= bias + T_MAX ? T_MAX : k - bias);
+          if (q < t)
+            break;
+          output->push_back(DigitToBasic(t + (q - t) % (BASE - t)));
+          q = (q - t) / (BASE - t);
+        }
+        output->push_back(DigitToBasic(q));
+        bias = Adapt(delta, handledCountPlusOne, handledCount == basicLength);
+        delta = 0;
+        ++handledCount;
+      }
+
+      ++delta;
+      ++n;
+    }
+    return true;
+  }
+
+  bool IsSeparator(uint32_t codePoint)
+  {
+    // RFC 3490 separators
+    return codePoint == '.' || codePoint == 0x3002 || codePoint == 0xFF0E || codePoint == 0xFF61;
+  }
+
+  // Port of toASCII() in punycode.js.
+  bool LabelsToASCII(const std::vector<uint32_t>& codePoints,
+                     size_t begin,
+                     size_t end,
+                     std::string* result)
+  {
+    size_t labelStart = begin;
+    for (size_t i = begin; i <= end; ++i)
+    {
+      if (i < end && !IsSeparator(codePoints[i]))
+        continue;
+
+      std::vector<uint32_t> label(codePoints.begin() + labelStart, codePoints.begin() + i);
+      if (std::any_of(label.begin(), label.end(), [](uint32_t c) { return c > 0x7E; }))
+      {
+        result->append("xn--");
+        if (!EncodePunycode(label, result))
+          return false;
+      }
+      else
+      {
+        for (uint32_t codePoint : label)
+          result->push_back(static_cast<char>(codePoint));
+      }
+      if (i < end)
+        result->push_back('.');
+      labelStart = i + 1;
+    }
+    return true;
+  }
+
+  bool IsAscii(const std::string& str)
+  {
+    return std::all_of(
+        str.begin(), str.end(), [](char c) { return static_cast<unsigned char>(c) < 0x80; });
+  }
+}
+
+URLInfo::URLInfo() : valid(false)
+{
+}
+
+// static
+URLInfo URLInfo::Parse(const std::string& url)
+{
+  URLInfo info;
+  size_t schemeEnd, hostStart, hostEnd;
+  if (!FindHost(url, &schemeEnd, &hostStart, &hostEnd))
+    return info;
+
+  info.host = url.substr(hostStart, hostEnd - hostStart);
+  const auto cachedHost = HostCache::Get(info.host);
+  if (!cachedHost->valid)
+  {
+    info.host.clear();
+    return info;
+  }
+  info.hostname = cachedHost->hostname;
+  info.href = url;
+  info.protocol = url.substr(0, schemeEnd + 1);
+  for (auto& c : info.protocol)
+  {
+    if (c >= 'A' && c <= 'Z')
+      c = static_cast<char>(c - 'A' + 'a');
+  }
+  info.valid = true;
+  return info;
+}
+
+// static
+std::string URLInfo::ExtractHost(const std::string& url)
+{
+  size_t schemeEnd, hostStart, hostEnd;
+  if (!FindHost(url, &schemeEnd, &hostStart, &hostEnd))
+    return "";
+  return url.substr(hostStart, hostEnd - hostStart);
+}
+
+// static
+bool URLInfo::HostToASCII(const std::string& host, std::string* asciiHost)
+{
+  asciiHost->clear();
+  if (IsAscii(host))
+  {
+    *asciiHost = host;
+    return true;
+  }
+
+  const auto codePoints = DecodeUtf8(host);
+  // Like punycode.js, leave the part up to an `@` alone and drop everything
+  // after a second one.
+  size_t begin = 0;
+  size_t end = codePoints.size();
+  auto at = std::find(codePoints.begin(), codePoints.end(), '@');
+  if (at != codePoints.end())
+  {
+    for (auto it = codePoints.begin(); it != at; ++it)
+      AppendUtf8(*it, asciiHost);
+    asciiHost->push_back('@');
+    begin = at - codePoints.begin() + 1;
+    end = std::find(at + 1, codePoints.end(), '@') - codePoints.begin();
+  }
+  if (!LabelsToASCII(codePoints, begin, end, asciiHost))
+  {
+    asciiHost->clear();
+    return false;
+  }
+  return true;
+}
+
+bool URLInfo::IsValid() const
+{
+  return valid;
+}
+
+const std::string& URLInfo::GetHref() const
+{
+  return href;
+}
+
+const std::string& URLInfo::GetProtocol() const
+{
+  return protocol;
+}
+
+const std::string& URLInfo::GetHost() const
+{
+  return host;
+}
+
+const std::string& URLInfo::GetHostname() const
+{
+  return hostname;
+}
@@ -0,0 +1,203 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "URLTokenizer.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define URL_TOKENIZER_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define URL_TOKENIZER_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace AdblockPlus;
+
+namespace
+{
+  const size_t BLOCK_SIZE = 16;
+  const size_t NO_TOKEN = std::string::npos;
+
+  bool IsKeywordChar(char c)
+  {
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '%';
+  }
+
+  unsigned CountTrailingZeros(uint32_t value)
+  {
+#ifdef _MSC_VER
+    unsigned long index = 0;
+    _BitScanForward(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(value));
+#endif
+  }
+
+  // Lower-cases up to BLOCK_SIZE characters from `in` to `out`, bit `i` of
+  // the result is set if `out[i]` is a keyword character.
+  uint32_t ClassifyScalar(const char* in, char* out, size_t size, bool* nonAscii)
+  {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+      char c = in[i];
+      if (static_cast<unsigned char>(c) >= 0x80)
+        *nonAscii = true;
+      else if (c >= 'A' && c <= 'Z')
+        c = static_cast<char>(c - 'A' + 'a');
+      out[i] = c;
+      if (IsKeywordChar(c))
+        mask |= 1u << i;
+    }
+    return mask;
+  }
+
+#if defined(URL_TOKENIZER_SSE2)
+  // Signed comparisons, so that non-ASCII characters are never in range.
+  __m128i InRange(__m128i chars, char low, char high)
+  {
+    return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(static_cast<char>(low - 1))),
+                         _mm_cmplt_epi8(chars, _mm_set1_epi8(static_cast<char>(high + 1))));
+  }
+
+  uint32_t ClassifyBlock(const char* in, char* out, bool* nonAscii)
+  {
+    const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    const __m128i lower =
+        _mm_or_si128(chars, _mm_and_si128(InRange(chars, 'A', 'Z'), _mm_set1_epi8(0x20)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), lower);
+    if (_mm_movemask_epi8(chars))
+      *nonAscii = true;
+    const __m128i keyword =
+        _mm_or_si128(_mm_or_si128(InRange(lower, 'a', 'z'), InRange(lower, '0', '9')),
+                     _mm_cmpeq_epi8(lower, _mm_set1_epi8('%')));
+    return static_cast<uint32_t>(_mm_movemask_epi8(keyword));
+  }
+#elif defined(URL_TOKENIZER_NEON)
+  uint8x16_t InRange(uint8x16_t chars, uint8_t low, uint8_t high)
+  {
+    return vandq_u8(vcgeq_u8(chars, vdupq_n_u8(low)), vcleq_u8(chars, vdupq_n_u8(high)));
+  }
+
+  // There is no movemask, the lanes are weighted and summed up instead.
+  uint32_t MoveMask(uint8x16_t lanes)
+  {
+    static const uint8_t weights[] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t bits = vandq_u8(lanes, vld1q_u8(weights));
+    return static_cast<uint32_t>(vaddv_u8(vget_low_u8(bits))) |
+           static_cast<uint32_t>(vaddv_u8(vget_high_u8(bits))) << 8;
+  }
+
+  uint32_t ClassifyBlock(const char* in, char* out, bool* nonAscii)
+  {
+    const uint8x16_t chars = vld1q_u8(reinterpret_cast<const uint8_t*>(in));
+    const uint8x16_t lower =
+        vorrq_u8(chars, vandq_u8(InRange(chars, 'A', 'Z'), vdupq_n_u8(0x20)));
+    vst1q_u8(reinterpret_cast<uint8_t*>(out), lower);
+    if (vmaxvq_u8(chars) >= 0x80)
+      *nonAscii = true;
+    const uint8x16_t keyword =
+        vorrq_u8(vorrq_u8(InRange(lower, 'a', 'z'), InRange(lower, '0', '9')),
+                 vceqq_u8(lower, vdupq_n_u8('%')));
+    return MoveMask(keyword);
+  }
+#endif
+
+  void EndToken(size_t begin, size_t end, std::vector<URLTokenizer::Token>* tokens)
+  {
+    if (end - begin >= 2)
+      tokens->push_back({begin, end - begin});
+  }
+
+  // Walks the runs of set bits of a block starting at `offset`, `tokenBegin`
+  // is the start of the token continuing from the previous block.
+  void AppendTokens(uint32_t mask,
+                    size_t offset,
+                    size_t size,
+                    size_t* tokenBegin,
+                    std::vector<URLTokenizer::Token>* tokens)
+  {
+    const uint32_t all = (1u << size) - 1;
+    size_t pos = 0;
+    while (pos < size)
+    {
+      const uint32_t rest = (*tokenBegin == NO_TOKEN ? mask : ~mask & all) >> pos;
+      if (!rest)
+        return;
+      pos += CountTrailingZeros(rest);
+      if (*tokenBegin == NO_TOKEN)
+        *tokenBegin = offset + pos;
+      else
+      {
+        EndToken(*tokenBegin, offset + pos, tokens);
+        *tokenBegin = NO_TOKEN;
+      }
+    }
+  }
+
+  bool Tokenize(const std::string& url,
+                std::string* lowerUrl,
+                std::vector<URLTokenizer::Token>* tokens,
+                bool vectorized)
+  {
+    lowerUrl->resize(url.size());
+    tokens->clear();
+    bool nonAscii = false;
+    size_t tokenBegin = NO_TOKEN;
+    size_t i = 0;
+#if defined(URL_TOKENIZER_SSE2) || defined(URL_TOKENIZER_NEON)
+    for (; vectorized && i + BLOCK_SIZE <= url.size(); i += BLOCK_SIZE)
+    {
+      const uint32_t mask = ClassifyBlock(&url[i], &(*lowerUrl)[i], &nonAscii);
+      AppendTokens(mask, i, BLOCK_SIZE, &tokenBegin, tokens);
+    }
+#endif
+    for (; i < url.size(); i += BLOCK_SIZE)
+    {
+      const size_t size = std::min(BLOCK_SIZE, url.size() - i);
+      const uint32_t mask = ClassifyScalar(&url[i], &(*lowerUrl)[i], size, &nonAscii);
+      AppendTokens(mask, i, size, &tokenBegin, tokens);
+    }
+    if (tokenBegin != NO_TOKEN)
+      EndToken(tokenBegin, url.size(), tokens);
+    return !nonAscii;
+  }
+}
+
+// static
+bool URLTokenizer::Tokenize(const std::string& url,
+                            std::string* lowerUrl,
+                            std::vector<Token>* tokens)
+{
+  return ::Tokenize(url, lowerUrl, tokens, true);
+}
+
+// static
+bool URLTokenizer::TokenizeScalar(const std::string& url,
+                                  std::string* lowerUrl,
+                                  std::vector<Token>* tokens)
+{
+  return ::Tokenize(url, lowerUrl, tokens, false);
+}
@@ -0,0 +1,60 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace AdblockPlus
+{
+  /**
+   * Splits a URL into the keyword candidates of the native matcher, the
+   * runs of `[a-z0-9%]` of the lower-cased URL, in one pass which also
+   * lower-cases it. Blocks of 16 characters are classified with SSE2 or
+   * NEON where available.
+   */
+  class URLTokenizer
+  {
+  public:
+    /**
+     * Run of keyword characters.
+     */
+    struct Token
+    {
+      size_t begin;
+      size_t length;
+    };
+
+    /**
+     * Lower-cases the ASCII letters of a URL and finds its tokens.
+     * @param url URL to split.
+     * @param[out] lowerUrl Receives the lower-cased URL.
+     * @param[out] tokens Receives the tokens of at least two characters.
+     * @return `false` if the URL contains non-ASCII characters, the output is
+     *         incomplete then.
+     */
+    static bool Tokenize(const std::string& url, std::string* lowerUrl, std::vector<Token>* tokens);
+
+    /**
+     * Same as Tokenize() without vector instructions.
+     */
+    static bool
+    TokenizeScalar(const std::string& url, std::string* lowerUrl, std::vector<Token>* tokens);
+  };
+}
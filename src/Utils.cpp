@@ -15,6 +15,8 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cstdio>
 #include <stdexcept>
 
 #ifdef _WIN32
@@ -26,6 +28,54 @@
 
 using namespace AdblockPlus;
 
+namespace
+{
+  // Below that size copying is cheaper than the external resource.
+  const size_t MIN_EXTERNAL_STRING_LENGTH = 1024;
+
+  bool IsAscii(const char* data, size_t length)
+  {
+    return std::all_of(
+        data, data + length, [](char c) { return static_cast<unsigned char>(c) < 0x80; });
+  }
+
+  template<typename Owner>
+  class ExternalOneByteString : public v8::String::ExternalOneByteStringResource
+  {
+  public:
+    ExternalOneByteString(Owner&& owner, const char* data, size_t length)
+        : owner_(std::move(owner)), data_(data), length_(length)
+    {
+    }
+
+    const char* data() const override
+    {
+      return data_;
+    }
+
+    size_t length() const override
+    {
+      return length_;
+    }
+
+  private:
+    Owner owner_;
+    const char* data_;
+    size_t length_;
+  };
+
+  // `data` has to stay valid when `owner` is moved.
+  template<typename Owner>
+  v8::MaybeLocal<v8::String>
+  NewExternalString(v8::Isolate* isolate, Owner&& owner, const char* data, size_t length)
+  {
+    if (length < MIN_EXTERNAL_STRING_LENGTH || !IsAscii(data, length))
+      return v8::String::NewFromUtf8(isolate, data, v8::NewStringType::kNormal, length);
+    return v8::String::NewExternalOneByte(
+        isolate, new ExternalOneByteString<Owner>(std::move(owner), data, length));
+  }
+}
+
 void Utils::CheckTryCatch(v8::Isolate* isolate, const v8::TryCatch& tryCatch)
 {
   if (tryCatch.HasCaught())
@@ -58,9 +108,39 @@ v8::MaybeLocal<v8::String> Utils::ToV8String(v8::Isolate* isolate, const std::st
 
 v8::MaybeLocal<v8::String> Utils::StringBufferToV8String(v8::Isolate* isolate,
                                                          const StringBuffer& str)
+{
+  return StringBufferToV8String(isolate, str.data(), str.size());
+}
+
+v8::MaybeLocal<v8::String>
+Utils::StringBufferToV8String(v8::Isolate* isolate, const uint8_t* bytes, size_t size)
 {
   return v8::String::NewFromUtf8(
-      isolate, reinterpret_cast<const char*>(str.data()), v8::NewStringType::kNormal, str.size());
+      isolate, reinterpret_cast<const char*>(bytes), v8::NewStringType::kNormal, size);
+}
+
+v8::MaybeLocal<v8::String> Utils::ToV8ExternalString(v8::Isolate* isolate, std::string&& str)
+{
+  // Moving a std::string can move a short buffer, so it lives on the heap.
+  std::unique_ptr<std::string> owner(new std::string(std::move(str)));
+  const char* data = owner->data();
+  const size_t length = owner->size();
+  return NewExternalString(isolate, std::move(owner), data, length);
+}
+
+v8::MaybeLocal<v8::String> Utils::ToV8ExternalString(v8::Isolate* isolate, StringBuffer&& bytes)
+{
+  const char* data = reinterpret_cast<const char*>(bytes.data());
+  const size_t length = bytes.size();
+  return NewExternalString(isolate, std::move(bytes), data, length);
+}
+
+v8::MaybeLocal<v8::String>
+Utils::ToV8ExternalString(v8::Isolate* isolate, std::unique_ptr<IPreloadedFilterResponse> response)
+{
+  const char* data = response->content();
+  const size_t length = response->size();
+  return NewExternalString(isolate, std::move(response), data, length);
 }
 
 void Utils::ThrowExceptionInJS(v8::Isolate* isolate, const std::string& str)
@@ -147,3 +227,30 @@ std::vector<std::string> Utils::SplitString(const std::string& value, const char
 
   return elems;
 }
+
+void Utils::AppendJsonString(const std::string& value, std::string* json)
+{
+  json->push_back('"');
+  for (char c : value)
+  {
+    switch (c)
+    {
+    case '"':
+      json->append("\\\"");
+      break;
+    case '\\':
+      json->append("\\\\");
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20)
+      {
+        char escaped[7];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+        json->append(escaped);
+      }
+      else
+        json->push_back(c);
+    }
+  }
+  json->push_back('"');
+}
@@ -20,9 +20,11 @@
 #include <algorithm>
 #include <cctype>
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include <AdblockPlus/IResourceReader.h>
 #include <AdblockPlus/JsValue.h>
 
 #include "JsError.h"
@@ -77,6 +79,17 @@ namespace AdblockPlus
     v8::MaybeLocal<v8::String> ToV8String(v8::Isolate* isolate, const std::string& str);
     v8::MaybeLocal<v8::String> StringBufferToV8String(v8::Isolate* isolate,
                                                       const StringBuffer& bytes);
+    v8::MaybeLocal<v8::String>
+    StringBufferToV8String(v8::Isolate* isolate, const uint8_t* bytes, size_t size);
+
+    // Create strings which refer to the buffer instead of copying it. V8
+    // owns the buffer afterwards and frees it with the string. Only ASCII can
+    // be kept as it is, short strings and strings with other characters are
+    // copied.
+    v8::MaybeLocal<v8::String> ToV8ExternalString(v8::Isolate* isolate, std::string&& str);
+    v8::MaybeLocal<v8::String> ToV8ExternalString(v8::Isolate* isolate, StringBuffer&& bytes);
+    v8::MaybeLocal<v8::String>
+    ToV8ExternalString(v8::Isolate* isolate, std::unique_ptr<IPreloadedFilterResponse> response);
     void ThrowExceptionInJS(v8::Isolate* isolate, const std::string& str);
 
     // Code for templated function has to be in a header file, can't be in .cpp
@@ -97,6 +110,8 @@ namespace AdblockPlus
       return trimmed;
     }
     std::vector<std::string> SplitString(const std::string& value, const char delim);
+    // Appends the value as a quoted JSON string.
+    void AppendJsonString(const std::string& value, std::string* json);
 #ifdef _WIN32
     std::wstring ToUtf16String(const std::string& str);
     std::string ToUtf8String(const std::wstring& str);
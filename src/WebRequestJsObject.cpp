@@ -17,6 +17,7 @@
 
 #include "WebRequestJsObject.h"
 
+#include <algorithm>
 #include <map>
 
 #include <AdblockPlus/IWebRequest.h>
@@ -27,11 +28,56 @@
 
 using namespace AdblockPlus;
 
+namespace
+{
+  // Moves the lines completed by `data` to `lines` and keeps the rest in
+  // `partialLine`. Empty lines are dropped, like splitting at /[\r\n]+/ does.
+  void SplitLines(const char* data,
+                  size_t size,
+                  std::string* partialLine,
+                  std::vector<std::string>* lines)
+  {
+    const char* end = data + size;
+    while (data < end)
+    {
+      const char* lineEnd =
+          std::find_if(data, end, [](char c) { return c == '\r' || c == '\n'; });
+      partialLine->append(data, lineEnd);
+      if (lineEnd == end)
+        break;
+      if (!partialLine->empty())
+      {
+        lines->push_back(std::move(*partialLine));
+        partialLine->clear();
+      }
+      data = lineEnd + 1;
+    }
+  }
+
+  AdblockPlus::JsValue NewResultObject(AdblockPlus::JsEngine* jsEngine,
+                                       const ServerResponse& response)
+  {
+    auto resultObject = jsEngine->NewObject();
+    resultObject.SetProperty("status", response.status);
+    resultObject.SetProperty("responseStatus", response.responseStatus);
+
+    auto headersObject = jsEngine->NewObject();
+    for (const auto& header : response.responseHeaders)
+    {
+      headersObject.SetProperty(header.first, header.second);
+    }
+    resultObject.SetProperty("responseHeaders", headersObject);
+    return resultObject;
+  }
+}
+
 void JsEngine::ScheduleWebRequest(WebRequestMethod method, const v8::FunctionCallbackInfo<v8::Value>& arguments)
 {
   AdblockPlus::JsEngine* jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
   AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
-  if (converted.size() != 3u)
+  // GET takes an optional listener for the lines of the body.
+  const bool hasLineListener = method == WebRequestMethod::kGet && converted.size() == 4u;
+  if (converted.size() != 3u && !hasLineListener)
     throw std::runtime_error("Web request requires exactly 3 arguments");
 
   auto url = converted[0].AsString();
@@ -55,31 +101,84 @@ void JsEngine::ScheduleWebRequest(WebRequestMethod method, const v8::FunctionCal
 
   if (!converted[2].IsFunction())
     throw std::runtime_error("Third argument to the web request must be a function");
+  if (hasLineListener && !converted[3].IsFunction())
+    throw std::runtime_error("Fourth argument to the web request must be a function");
 
-  JsEngine::ScopedWeakValues weakCallbackValue(jsEngine, {converted[2]});
-  auto reuqestCallback = [jsEngine, weakCallbackValue](const ServerResponse& response) {
-    AdblockPlus::JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
-    auto resultObject = jsEngine->NewObject();
-    resultObject.SetProperty("status", response.status);
-    resultObject.SetProperty("responseStatus", response.responseStatus);
-    resultObject.SetProperty("responseText", response.responseText);
-
-    auto headersObject = jsEngine->NewObject();
-    for (const auto& header : response.responseHeaders)
-    {
-      headersObject.SetProperty(header.first, header.second);
-    }
-    resultObject.SetProperty("responseHeaders", headersObject);
+  const auto startedAt = std::chrono::steady_clock::now();
+  if (method == WebRequestMethod::kHead)
+  {
+    JsEngine::ScopedWeakValues weakCallbackValue(jsEngine, {converted[2]});
+    jsEngine->GetWebRequest().HEAD(
+        url, headers, [jsEngine, weakCallbackValue, startedAt](const ServerResponse& response) {
+          jsEngine->webRequestTime_.Record(std::chrono::steady_clock::now() - startedAt);
+          jsEngine->PostCompletion([jsEngine, weakCallbackValue, response] {
+            AdblockPlus::JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
+            auto resultObject = NewResultObject(jsEngine, response);
+            resultObject.SetProperty("responseText", response.responseText);
+            weakCallbackValue.Values()[0].Call(resultObject);
+          });
+        });
+    return;
+  }
+  if (method != WebRequestMethod::kGet)
+    throw std::runtime_error("Unknown web request method");
 
-    weakCallbackValue.Values()[0].Call(resultObject);
-  };
+  if (hasLineListener)
+  {
+    // The lines are passed on as they arrive, so that JS can process them while
+    // the rest of the body is still being downloaded. The body isn't kept.
+    JsEngine::ScopedWeakValues weakCallbackValues(jsEngine, {converted[2], converted[3]});
+    auto partialLine = std::make_shared<std::string>();
+    jsEngine->GetWebRequest().StreamGET(
+        url,
+        headers,
+        [jsEngine, weakCallbackValues, partialLine](const char* data, size_t size) {
+          std::vector<std::string> lines;
+          SplitLines(data, size, partialLine.get(), &lines);
+          if (lines.empty())
+            return;
+          jsEngine->PostCompletion([jsEngine, weakCallbackValues, lines] {
+            AdblockPlus::JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
+            weakCallbackValues.Values()[1].Call(jsEngine->NewArray(lines));
+          });
+        },
+        [jsEngine, weakCallbackValues, partialLine, startedAt](const ServerResponse& response) {
+          jsEngine->webRequestTime_.Record(std::chrono::steady_clock::now() - startedAt);
+          // Posted after the chunks, which are delivered in order.
+          jsEngine->PostCompletion([jsEngine, weakCallbackValues, partialLine, response] {
+            AdblockPlus::JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
+            const auto callbacks = weakCallbackValues.Values();
+            if (!partialLine->empty())
+              callbacks[1].Call(jsEngine->NewArray({*partialLine}));
+            auto resultObject = NewResultObject(jsEngine, response);
+            resultObject.SetProperty("responseText", "");
+            callbacks[0].Call(resultObject);
+          });
+        });
+    return;
+  }
 
-  if (method == WebRequestMethod::kGet)
-    jsEngine->GetWebRequest().GET(url, headers, reuqestCallback);
-  else if (method == WebRequestMethod::kHead)
-    jsEngine->GetWebRequest().HEAD(url, headers, reuqestCallback);
-  else
-    throw std::runtime_error("Unknown web request method");
+  // The body is collected in a single buffer which the JS string refers to,
+  // instead of being copied into the JS heap once it is complete.
+  JsEngine::ScopedWeakValues weakCallbackValue(jsEngine, {converted[2]});
+  auto responseText = std::make_shared<std::string>();
+  jsEngine->GetWebRequest().StreamGET(
+      url,
+      headers,
+      [responseText](const char* data, size_t size) { responseText->append(data, size); },
+      [jsEngine, weakCallbackValue, responseText, url, startedAt](
+          const ServerResponse& response) {
+        jsEngine->webRequestTime_.Record(std::chrono::steady_clock::now() - startedAt);
+        if (response.status == IWebRequest::NS_OK && response.responseStatus == 200)
+          jsEngine->ObserveResponseBody(url, *responseText);
+        jsEngine->PostCompletion([jsEngine, weakCallbackValue, responseText, response] {
+          AdblockPlus::JsContext context(jsEngine->GetIsolate(), *jsEngine->GetContext());
+          auto resultObject = NewResultObject(jsEngine, response);
+          resultObject.SetProperty("responseText",
+                                   jsEngine->NewExternalValue(std::move(*responseText)));
+          weakCallbackValue.Values()[0].Call(resultObject);
+        });
+      });
 }
 
 namespace
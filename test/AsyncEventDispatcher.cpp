@@ -0,0 +1,146 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "../src/AsyncEventDispatcher.h"
+
+#include <chrono>
+#include <future>
+#include <gtest/gtest.h>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  typedef IFilterEngine::FilterEvent FilterEvent;
+
+  // Blocks in the first notification until Release() is called.
+  class GatedObserver : public IFilterEngine::AsyncEventObserver
+  {
+  public:
+    void OnFilterEvent(FilterEvent, const IFilterEngine::FilterInfo& filter) override
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      started = true;
+      changed.notify_all();
+      changed.wait(lock, [this]() { return released; });
+      texts.push_back(filter.text);
+      changed.notify_all();
+    }
+
+    void WaitUntilStarted()
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [this]() { return started; });
+    }
+
+    void Release()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      released = true;
+      changed.notify_all();
+    }
+
+    std::vector<std::string> WaitForTexts(size_t count)
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait_for(lock, std::chrono::seconds(5), [this, count]() {
+        return texts.size() >= count;
+      });
+      return texts;
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool started = false;
+    bool released = false;
+    std::vector<std::string> texts;
+  };
+
+  class AsyncEventDispatcherTest : public ::testing::Test
+  {
+  protected:
+    GatedObserver observer;
+
+    std::unique_ptr<AsyncEventDispatcher> Create(size_t queueSize,
+                                                 IFilterEngine::OverflowPolicy policy)
+    {
+      IFilterEngine::AsyncObserverOptions options;
+      options.queueSize = queueSize;
+      options.overflowPolicy = policy;
+      std::unique_ptr<AsyncEventDispatcher> dispatcher(
+          new AsyncEventDispatcher(&observer, options));
+      Post(*dispatcher, "a");
+      observer.WaitUntilStarted();
+      return dispatcher;
+    }
+
+    static void Post(AsyncEventDispatcher& dispatcher, const std::string& text)
+    {
+      IFilterEngine::FilterInfo filter;
+      filter.text = text;
+      filter.type = Filter::Type::TYPE_BLOCKING;
+      dispatcher.Post(FilterEvent::FILTER_ADDED, std::move(filter));
+    }
+  };
+}
+
+TEST_F(AsyncEventDispatcherTest, DropPolicyDropsNewEvents)
+{
+  auto dispatcher = Create(2, IFilterEngine::OverflowPolicy::DROP);
+  Post(*dispatcher, "b");
+  Post(*dispatcher, "c");
+  Post(*dispatcher, "d");
+  observer.Release();
+  EXPECT_EQ(std::vector<std::string>({"a", "b", "c"}), observer.WaitForTexts(3));
+}
+
+TEST_F(AsyncEventDispatcherTest, CoalescePolicyMergesEvents)
+{
+  auto dispatcher = Create(2, IFilterEngine::OverflowPolicy::COALESCE);
+  Post(*dispatcher, "b");
+  Post(*dispatcher, "c");
+  Post(*dispatcher, "b");
+  Post(*dispatcher, "d");
+  observer.Release();
+  EXPECT_EQ(std::vector<std::string>({"a", "c", "d"}), observer.WaitForTexts(3));
+}
+
+TEST_F(AsyncEventDispatcherTest, BlockPolicyWaitsForTheObserver)
+{
+  auto dispatcher = Create(1, IFilterEngine::OverflowPolicy::BLOCK);
+  Post(*dispatcher, "b");
+  auto posted = std::async(std::launch::async, [&dispatcher]() { Post(*dispatcher, "c"); });
+  EXPECT_EQ(std::future_status::timeout, posted.wait_for(std::chrono::milliseconds(50)));
+  observer.Release();
+  posted.wait();
+  EXPECT_EQ(std::vector<std::string>({"a", "b", "c"}), observer.WaitForTexts(3));
+}
+
+TEST_F(AsyncEventDispatcherTest, StopDropsQueuedEvents)
+{
+  auto dispatcher = Create(10, IFilterEngine::OverflowPolicy::DROP);
+  Post(*dispatcher, "b");
+  auto stopped = std::async(std::launch::async, [&dispatcher]() { dispatcher->Stop(); });
+  EXPECT_EQ(std::future_status::timeout, stopped.wait_for(std::chrono::milliseconds(50)))
+      << "waits for the event being delivered";
+  observer.Release();
+  stopped.wait();
+  Post(*dispatcher, "c");
+  EXPECT_EQ(std::vector<std::string>({"a"}), observer.WaitForTexts(1));
+}
@@ -16,10 +16,20 @@
  */
 
 #include "../src/AsyncExecutor.h"
+#include "../src/SynchronizedCollection.h"
 
+#include <algorithm>
+#include <atomic>
 #include <future>
 #include <gtest/gtest.h>
 
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 using namespace AdblockPlus;
 
 // For present gtest does not provide public API to have value- and type-
@@ -231,4 +241,280 @@ namespace
   {
     MultithreadedCallsTest();
   }
+
+  TEST(ThreadPoolExecutor, DestructorFinishesDispatchedTasks)
+  {
+    std::atomic<int> executed(0);
+    {
+      ThreadPoolExecutor executor(3);
+      AsyncExecutor producers;
+      for (int producer = 0; producer < 10; ++producer)
+      {
+        producers.Dispatch([&executor, &executed] {
+          for (int task = 0; task < 100; ++task)
+            executor.Dispatch([&executed] { ++executed; });
+        });
+      }
+    }
+    EXPECT_EQ(1000, executed);
+  }
+
+  TEST(ThreadPoolExecutor, CanBeDestroyedFromWithinATask)
+  {
+    std::unique_ptr<ThreadPoolExecutor> executor(new ThreadPoolExecutor(1));
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future();
+    // The detached thread might still be in set_value() when the test ends.
+    auto finished = std::make_shared<std::promise<void>>();
+    executor->Dispatch([&executor, opened] {
+      opened.wait();
+      executor.reset();
+    });
+    executor->Dispatch([finished] { finished->set_value(); });
+    gate.set_value();
+    EXPECT_EQ(std::future_status::ready, finished->get_future().wait_for(std::chrono::seconds(5)))
+        << "the tasks which were queued before are still executed";
+    EXPECT_FALSE(executor);
+  }
+
+  TEST(ThreadPoolExecutor, LimitsConcurrency)
+  {
+    ThreadPoolExecutor executor(2);
+    std::mutex mutex;
+    std::condition_variable released;
+    bool release = false;
+    std::atomic<int> running(0);
+    std::atomic<int> maxRunning(0);
+    std::atomic<int> finished(0);
+    for (int i = 0; i < 6; ++i)
+    {
+      executor.Dispatch([&] {
+        int current = ++running;
+        int max = maxRunning;
+        while (current > max && !maxRunning.compare_exchange_weak(max, current))
+        {
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        released.wait(lock, [&] { return release; });
+        --running;
+        ++finished;
+      });
+    }
+    EXPECT_EQ(2u, executor.GetThreadCount());
+    while (running < 2)
+      std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(2, maxRunning);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      release = true;
+    }
+    released.notify_all();
+    while (finished < 6)
+      std::this_thread::yield();
+    EXPECT_EQ(2, maxRunning);
+    EXPECT_EQ(2u, executor.GetThreadCount());
+
+    executor.Stop();
+    EXPECT_EQ(0u, executor.GetThreadCount());
+    executor.Dispatch([&] { ++finished; });
+    EXPECT_EQ(0u, executor.GetThreadCount());
+    EXPECT_EQ(6, finished);
+  }
+
+  TEST(ThreadPoolExecutor, ReusesAndReleasesThreads)
+  {
+    ThreadPoolExecutor executor(4, std::chrono::milliseconds(50));
+    std::promise<std::thread::id> first;
+    executor.Dispatch([&] { first.set_value(std::this_thread::get_id()); });
+    const auto firstThread = first.get_future().get();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    std::promise<std::thread::id> second;
+    executor.Dispatch([&] { second.set_value(std::this_thread::get_id()); });
+    EXPECT_EQ(firstThread, second.get_future().get());
+    EXPECT_EQ(1u, executor.GetThreadCount());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_EQ(0u, executor.GetThreadCount());
+    std::promise<void> third;
+    executor.Dispatch([&] { third.set_value(); });
+    EXPECT_EQ(std::future_status::ready, third.get_future().wait_for(std::chrono::seconds(5)));
+  }
+
+  TEST(ThreadPoolExecutor, CriticalTasksJumpAheadOfQueuedOnes)
+  {
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future();
+    std::vector<std::string> order;
+    {
+      ThreadPoolExecutor executor(1);
+      executor.Dispatch([opened] { opened.wait(); });
+      executor.Dispatch([&order] { order.push_back("network"); },
+                        IExecutor::TaskClass::NETWORK);
+      executor.Dispatch([&order] { order.push_back("background"); },
+                        IExecutor::TaskClass::BACKGROUND);
+      executor.Dispatch([&order] { order.push_back("unclassified"); });
+      executor.Dispatch([&order] { order.push_back("critical"); }, IExecutor::TaskClass::CRITICAL);
+      gate.set_value();
+    }
+    EXPECT_EQ((std::vector<std::string>{"critical", "background", "unclassified", "network"}),
+              order);
+  }
+
+  TEST(ThreadPoolExecutor, NetworkTasksLeaveAThreadForOthers)
+  {
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future();
+    ThreadPoolExecutor executor(2);
+    std::atomic<int> downloads(0);
+    for (int i = 0; i < 3; ++i)
+    {
+      executor.Dispatch(
+          [opened, &downloads] {
+            ++downloads;
+            opened.wait();
+          },
+          IExecutor::TaskClass::NETWORK);
+    }
+    while (downloads == 0)
+      std::this_thread::yield();
+    std::promise<void> read;
+    executor.Dispatch([&read] { read.set_value(); }, IExecutor::TaskClass::CRITICAL);
+    EXPECT_EQ(std::future_status::ready, read.get_future().wait_for(std::chrono::seconds(5)));
+    EXPECT_EQ(1, downloads);
+    gate.set_value();
+  }
+
+  TEST(ThreadPoolExecutor, ReportsQueueStats)
+  {
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future();
+    std::promise<void> started;
+    ThreadPoolExecutor executor(1);
+    executor.Dispatch([opened, &started] {
+      started.set_value();
+      opened.wait();
+    });
+    started.get_future().wait();
+    executor.Dispatch([] {});
+    executor.Dispatch([] {}, IExecutor::TaskClass::NETWORK);
+
+    auto stats = executor.GetStats();
+    EXPECT_EQ(2u, stats.queuedTasks);
+    EXPECT_EQ(1u, stats.activeThreads);
+    EXPECT_EQ(1u, stats.waitTime.GetCount());
+    EXPECT_EQ(0u, stats.runTime.GetCount());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gate.set_value();
+    do
+    {
+      std::this_thread::yield();
+      stats = executor.GetStats();
+    } while (stats.runTime.GetCount() < 3 || stats.activeThreads != 0);
+    EXPECT_EQ(0u, stats.queuedTasks);
+    EXPECT_EQ(3u, stats.waitTime.GetCount());
+    EXPECT_LE(20000u, stats.waitTime.maxMicroseconds) << "waited behind the first task";
+    EXPECT_LE(20000u, stats.runTime.maxMicroseconds);
+  }
+
+#ifdef __linux__
+  TEST(ThreadPoolExecutor, AppliesThreadOptions)
+  {
+    ThreadOptions options;
+    options.priority = ThreadOptions::Priority::BACKGROUND;
+    options.cpus.push_back(0);
+    std::promise<std::pair<int, bool>> applied;
+    {
+      ThreadPoolExecutor executor(1, std::chrono::seconds(10), options);
+      executor.Dispatch([&applied] {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        sched_getaffinity(0, sizeof(set), &set);
+        applied.set_value(
+            {getpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid))),
+             CPU_COUNT(&set) == 1 && CPU_ISSET(0, &set)});
+      });
+    }
+    const auto result = applied.get_future().get();
+    EXPECT_LE(10, result.first) << "the nice value is raised, unless it was higher already";
+    EXPECT_TRUE(result.second);
+  }
+#endif
+
+  TEST(OptionalAsyncExecutor, ReportsStatsUntilStopped)
+  {
+    OptionalAsyncExecutor executor;
+    executor.Dispatch([] {});
+    while (executor.GetStats().runTime.GetCount() == 0)
+      std::this_thread::yield();
+    EXPECT_EQ(1u, executor.GetStats().waitTime.GetCount());
+    executor.Stop();
+    EXPECT_EQ(0u, executor.GetStats().runTime.GetCount());
+  }
+
+  TEST(CancellationToken, DropsCallsOnceCancelled)
+  {
+    int calls = 0;
+    const CancellationToken never;
+    EXPECT_TRUE(never.Run([&calls] { ++calls; }));
+    never.Cancel();
+    EXPECT_FALSE(never.IsCancelled());
+
+    const auto token = CancellationToken::Create();
+    const auto copy = token;
+    EXPECT_TRUE(copy.Run([&calls] { ++calls; }));
+    EXPECT_THROW(copy.Run([] { throw std::runtime_error("error"); }), std::runtime_error);
+    token.Cancel();
+    EXPECT_TRUE(copy.IsCancelled());
+    EXPECT_FALSE(copy.Run([&calls] { ++calls; }));
+    EXPECT_EQ(2, calls);
+  }
+
+  TEST(CancellationToken, CancelWaitsForRunningCalls)
+  {
+    const auto token = CancellationToken::Create();
+    std::promise<void> entered;
+    std::atomic<bool> finished(false);
+    auto running = std::async(std::launch::async, [&] {
+      token.Run([&] {
+        entered.set_value();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        finished = true;
+      });
+    });
+    entered.get_future().wait();
+    token.Cancel();
+    EXPECT_TRUE(finished);
+  }
+
+  TEST(OptionalAsyncExecutor, StopWithinAbandonsHangingTasks)
+  {
+    auto gate = std::make_shared<std::promise<void>>();
+    std::shared_future<void> opened = gate->get_future();
+    auto delivered = std::make_shared<std::atomic<bool>>(false);
+    auto taskFinished = std::make_shared<std::promise<void>>();
+    std::future<void> finished = taskFinished->get_future();
+    std::promise<void> started;
+    {
+      OptionalAsyncExecutor executor;
+      auto cancellation = executor.GetCancellationToken();
+      executor.Dispatch([opened, delivered, taskFinished, cancellation, &started] {
+        started.set_value();
+        opened.wait();
+        cancellation.Run([delivered] { *delivered = true; });
+        taskFinished->set_value();
+      });
+      started.get_future().wait();
+      const auto stopping = std::chrono::steady_clock::now();
+      executor.StopWithin(std::chrono::milliseconds(50));
+      EXPECT_GT(std::chrono::seconds(5), std::chrono::steady_clock::now() - stopping);
+      EXPECT_TRUE(cancellation.IsCancelled());
+      executor.Dispatch([delivered] { *delivered = true; });
+    }
+    gate->set_value();
+    EXPECT_EQ(std::future_status::ready, finished.wait_for(std::chrono::seconds(5)));
+    EXPECT_FALSE(*delivered);
+  }
 }
@@ -0,0 +1,101 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <AdblockPlus/PlatformFactory.h>
+
+#include <gtest/gtest.h>
+#include <mutex>
+#include <vector>
+
+#include "../src/Thread.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  struct Message
+  {
+    LogSystem::LogLevel logLevel;
+    std::string message;
+  };
+
+  class RecordingLogSystem : public LogSystem
+  {
+  public:
+    RecordingLogSystem(std::vector<Message>* messages, Sync* unblock = nullptr)
+        : messages(messages), unblock(unblock)
+    {
+    }
+
+    void operator()(LogLevel logLevel, const std::string& message, const std::string& source)
+    {
+      if (unblock)
+      {
+        unblock->Wait();
+        unblock = nullptr;
+      }
+      messages->push_back(Message{logLevel, message});
+    }
+
+    LogLevel GetMinLogLevel() const override
+    {
+      return LOG_LEVEL_INFO;
+    }
+
+  private:
+    std::vector<Message>* messages;
+    Sync* unblock;
+  };
+}
+
+TEST(AsyncLogSystemTest, MessagesAreWrittenInOrder)
+{
+  std::vector<Message> messages;
+  {
+    auto logSystem =
+        PlatformFactory::CreateAsyncLogSystem(std::make_unique<RecordingLogSystem>(&messages));
+    EXPECT_EQ(LogSystem::LOG_LEVEL_INFO, logSystem->GetMinLogLevel());
+    (*logSystem)(LogSystem::LOG_LEVEL_INFO, "foo", "");
+    (*logSystem)(LogSystem::LOG_LEVEL_LOG, "dropped by level", "");
+    (*logSystem)(LogSystem::LOG_LEVEL_ERROR, "bar", "");
+  }
+  ASSERT_EQ(2u, messages.size()) << "pending messages are written on destruction";
+  EXPECT_EQ(LogSystem::LOG_LEVEL_INFO, messages[0].logLevel);
+  EXPECT_EQ("foo", messages[0].message);
+  EXPECT_EQ(LogSystem::LOG_LEVEL_ERROR, messages[1].logLevel);
+  EXPECT_EQ("bar", messages[1].message);
+}
+
+TEST(AsyncLogSystemTest, OldestMessagesAreDroppedIfTheBufferIsFull)
+{
+  std::vector<Message> messages;
+  Sync unblock;
+  {
+    auto logSystem = PlatformFactory::CreateAsyncLogSystem(
+        std::make_unique<RecordingLogSystem>(&messages, &unblock), 2);
+    // Blocks the writer, it may or may not have taken the first message.
+    (*logSystem)(LogSystem::LOG_LEVEL_INFO, "first", "");
+    Sleep(50);
+    for (int i = 0; i < 5; ++i)
+      (*logSystem)(LogSystem::LOG_LEVEL_INFO, std::to_string(i), "");
+    unblock.Set();
+  }
+  ASSERT_LE(3u, messages.size());
+  EXPECT_EQ(LogSystem::LOG_LEVEL_WARN, messages[messages.size() - 3].logLevel);
+  EXPECT_NE(std::string::npos, messages[messages.size() - 3].message.find("dropped"));
+  EXPECT_EQ("3", messages[messages.size() - 2].message);
+  EXPECT_EQ("4", messages.back().message);
+}
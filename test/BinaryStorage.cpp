@@ -0,0 +1,193 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/BinaryStorage.h"
+
+#include <gtest/gtest.h>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  class CollectingWriter : public IFileSystem::IFileWriter
+  {
+  public:
+    explicit CollectingWriter(IFileSystem::IOBuffer* content) : content(content)
+    {
+    }
+
+    void Append(IFileSystem::IOBuffer&& chunk) override
+    {
+      content->insert(content->end(), chunk.begin(), chunk.end());
+    }
+
+    void Commit(const IFileSystem::Callback& callback) override
+    {
+      callback("");
+    }
+
+  private:
+    IFileSystem::IOBuffer* content;
+  };
+
+  const std::string PATTERNS = "# Adblock Plus preferences\n"
+                               "version=5\n"
+                               "\n"
+                               "[Subscription]\n"
+                               "url=https://easylist.example/list.txt\n"
+                               "title=EasyList\n"
+                               "\n"
+                               "[Subscription filters]\n"
+                               "||ads.example.com^\n"
+                               "foo=bar\n"
+                               "/banner/*$domain=example.org\n"
+                               "\n"
+                               "[Subscription]\n"
+                               "url=~user~12345\n"
+                               "disabled=true\n"
+                               "\n"
+                               "[Subscription filters]\n"
+                               "||ads.example.com^\n"
+                               "\n"
+                               "[Filter]\n"
+                               "text=||ads.example.com^\n"
+                               "hitCount=3\n";
+
+  IFileSystem::IOBuffer Encode(const std::vector<std::string>& chunks)
+  {
+    IFileSystem::IOBuffer content;
+    auto writer = BinaryStorage::CreateWriter(
+        std::unique_ptr<IFileSystem::IFileWriter>(new CollectingWriter(&content)));
+    for (const auto& chunk : chunks)
+      writer->Append(IFileSystem::IOBuffer(chunk.begin(), chunk.end()));
+    std::string error = "<not committed>";
+    writer->Commit([&error](const std::string& commitError) { error = commitError; });
+    EXPECT_EQ("", error);
+    return content;
+  }
+
+  std::vector<std::string> ReadLines(BinaryStorage::Reader& reader)
+  {
+    std::vector<std::string> lines;
+    const char* line = nullptr;
+    size_t length = 0;
+    while (reader.ReadLine(&line, &length))
+      lines.emplace_back(line, length);
+    return lines;
+  }
+
+  std::vector<std::string> NonEmptyLines(const std::string& text)
+  {
+    std::vector<std::string> lines;
+    std::string line;
+    for (char c : text)
+    {
+      if (c != '\n' && c != '\r')
+        line.push_back(c);
+      else if (!line.empty())
+      {
+        lines.push_back(line);
+        line.clear();
+      }
+    }
+    if (!line.empty())
+      lines.push_back(line);
+    return lines;
+  }
+}
+
+TEST(BinaryStorageTest, RoundTrip)
+{
+  const auto content = Encode({PATTERNS});
+  ASSERT_TRUE(BinaryStorage::IsBinaryStorage(content.data(), content.size()));
+  EXPECT_FALSE(BinaryStorage::IsBinaryStorage(
+      reinterpret_cast<const uint8_t*>(PATTERNS.data()), PATTERNS.size()));
+  EXPECT_LT(content.size(), PATTERNS.size()) << "repeated filters are stored once";
+
+  BinaryStorage::Reader reader(content.data(), content.size());
+  ASSERT_TRUE(reader.IsValid());
+  EXPECT_EQ(NonEmptyLines(PATTERNS), ReadLines(reader));
+  EXPECT_TRUE(reader.IsValid());
+}
+
+TEST(BinaryStorageTest, LinesSplitAcrossChunks)
+{
+  std::vector<std::string> chunks;
+  for (size_t i = 0; i < PATTERNS.size(); i += 7)
+    chunks.push_back(PATTERNS.substr(i, 7));
+  EXPECT_EQ(Encode({PATTERNS}), Encode(chunks));
+
+  const auto content = Encode({"no line break\r\nat the end"});
+  BinaryStorage::Reader reader(content.data(), content.size());
+  EXPECT_EQ((std::vector<std::string>{"no line break", "at the end"}), ReadLines(reader));
+}
+
+TEST(BinaryStorageTest, Sections)
+{
+  const auto content = Encode({PATTERNS});
+  BinaryStorage::Reader reader(content.data(), content.size());
+  ASSERT_TRUE(reader.IsValid());
+  const auto& sections = reader.GetSections();
+  ASSERT_EQ(5u, sections.size());
+  EXPECT_EQ("[Subscription]", sections[0].header);
+  EXPECT_EQ("https://easylist.example/list.txt", sections[0].url);
+  EXPECT_FALSE(sections[0].disabled);
+  EXPECT_EQ("[Subscription filters]", sections[1].header);
+  EXPECT_EQ("https://easylist.example/list.txt", sections[1].url);
+  EXPECT_EQ("~user~12345", sections[2].url);
+  EXPECT_TRUE(sections[2].disabled);
+  EXPECT_TRUE(sections[3].disabled);
+  EXPECT_EQ("[Filter]", sections[4].header);
+  EXPECT_EQ("", sections[4].url);
+
+  ASSERT_TRUE(reader.SeekToSubscription("~user~12345"));
+  EXPECT_EQ((std::vector<std::string>{"[Subscription]",
+                                      "url=~user~12345",
+                                      "disabled=true",
+                                      "[Subscription filters]",
+                                      "||ads.example.com^"}),
+            ReadLines(reader));
+  EXPECT_FALSE(reader.SeekToSubscription("https://unknown.example/"));
+}
+
+TEST(BinaryStorageTest, EmptyFile)
+{
+  const auto content = Encode({});
+  BinaryStorage::Reader reader(content.data(), content.size());
+  ASSERT_TRUE(reader.IsValid());
+  EXPECT_TRUE(ReadLines(reader).empty());
+  EXPECT_TRUE(reader.GetSections().empty());
+}
+
+TEST(BinaryStorageTest, CorruptContent)
+{
+  const auto content = Encode({PATTERNS});
+  for (size_t size = 0; size < content.size(); size++)
+  {
+    BinaryStorage::Reader reader(content.data(), size);
+    EXPECT_FALSE(reader.IsValid());
+  }
+
+  // Whatever the damage, reading stays within the content.
+  for (size_t i = 0; i < content.size(); i++)
+  {
+    auto damaged = content;
+    damaged[i] ^= 0x5A;
+    BinaryStorage::Reader reader(damaged.data(), damaged.size());
+    ReadLines(reader);
+  }
+}
@@ -0,0 +1,135 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "../src/CacheWarmer.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  class ManualTimer : public ITimer
+  {
+  public:
+    std::vector<std::pair<std::chrono::milliseconds, TimerCallback>> tasks;
+
+    void SetTimer(const std::chrono::milliseconds& timeout,
+                  const TimerCallback& timerCallback) override
+    {
+      tasks.emplace_back(timeout, timerCallback);
+    }
+  };
+
+  class CacheWarmerTest : public ::testing::Test
+  {
+  protected:
+    ManualTimer timer;
+    CacheWarmer::Clock::time_point now = CacheWarmer::Clock::time_point(std::chrono::hours(1));
+    std::vector<std::vector<std::string>> warmUps;
+    std::vector<std::string> saves;
+    std::shared_ptr<CacheWarmer> warmer;
+
+    void SetUp() override
+    {
+      CreateWarmer(2);
+    }
+
+    void CreateWarmer(size_t domainCount)
+    {
+      warmer = std::make_shared<CacheWarmer>(
+          timer,
+          [this](const std::vector<std::string>& hosts) { warmUps.push_back(hosts); },
+          [this](const std::string& ranking) { saves.push_back(ranking); },
+          domainCount,
+          std::chrono::milliseconds(5000),
+          [this]() { return now; });
+    }
+
+    void RunTimer()
+    {
+      ASSERT_EQ(1u, timer.tasks.size());
+      auto task = timer.tasks.front();
+      timer.tasks.clear();
+      task.second();
+    }
+  };
+}
+
+TEST_F(CacheWarmerTest, HostsAreRankedByVisits)
+{
+  for (const char* host : {"b.com", "a.com", "c.com", "a.com", "c.com", "a.com", ""})
+    warmer->RecordVisit(host);
+  EXPECT_EQ(std::vector<std::string>({"a.com", "c.com"}), warmer->GetTopDomains());
+
+  warmer->RecordVisit("b.com");
+  EXPECT_EQ(std::vector<std::string>({"a.com", "b.com"}), warmer->GetTopDomains())
+      << "ties are broken alphabetically";
+}
+
+TEST_F(CacheWarmerTest, WarmUpWaitsForIdleTime)
+{
+  warmer->RecordVisit("a.com");
+  warmer->RecordVisit("b.com");
+  warmer->RecordVisit("b.com");
+  warmer->RequestWarmUp();
+  ASSERT_EQ(1u, timer.tasks.size()) << "checks are merged";
+  EXPECT_EQ(std::chrono::milliseconds(5001), timer.tasks.front().first);
+
+  const auto start = now;
+  now = start + std::chrono::seconds(3);
+  warmer->NotifyActivity();
+  now = start + std::chrono::milliseconds(5001);
+  RunTimer();
+  EXPECT_TRUE(warmUps.empty());
+  EXPECT_TRUE(saves.empty());
+  ASSERT_EQ(1u, timer.tasks.size());
+  EXPECT_EQ(std::chrono::milliseconds(3000), timer.tasks.front().first);
+
+  now = start + std::chrono::seconds(8);
+  RunTimer();
+  EXPECT_EQ(std::vector<std::vector<std::string>>({{"b.com", "a.com"}}), warmUps);
+  EXPECT_EQ(std::vector<std::string>({"2 b.com\n1 a.com\n"}), saves);
+  EXPECT_TRUE(timer.tasks.empty());
+
+  warmer->RecordVisit("a.com");
+  RunTimer();
+  EXPECT_EQ(1u, warmUps.size()) << "visits alone don't warm up";
+  EXPECT_EQ("2 a.com\n2 b.com\n", saves.back());
+}
+
+TEST_F(CacheWarmerTest, LoadRestoresTheRanking)
+{
+  warmer->Load("3 a.com\ninvalid\n-2 b.com\n1 c.com\n\n7\n");
+  EXPECT_EQ(std::vector<std::string>({"a.com", "c.com"}), warmer->GetTopDomains());
+  RunTimer();
+  EXPECT_EQ(std::vector<std::vector<std::string>>({{"a.com", "c.com"}}), warmUps);
+  EXPECT_TRUE(saves.empty()) << "nothing changed";
+}
+
+TEST_F(CacheWarmerTest, RarelyVisitedHostsMakeRoom)
+{
+  CreateWarmer(1);
+  for (int i = 0; i < 4; ++i)
+    warmer->RecordVisit("a.com");
+  for (const char* host : {"b.com", "c.com", "d.com", "e.com"})
+    warmer->RecordVisit(host);
+  RunTimer();
+  EXPECT_EQ(std::vector<std::string>({"2 a.com\n1 e.com\n"}), saves);
+}
@@ -0,0 +1,140 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/Compression.h"
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  class CollectingWriter : public IFileSystem::IFileWriter
+  {
+  public:
+    explicit CollectingWriter(IFileSystem::IOBuffer* content) : content(content)
+    {
+    }
+
+    void Append(IFileSystem::IOBuffer&& chunk) override
+    {
+      content->insert(content->end(), chunk.begin(), chunk.end());
+    }
+
+    void Commit(const IFileSystem::Callback& callback) override
+    {
+      callback("");
+    }
+
+  private:
+    IFileSystem::IOBuffer* content;
+  };
+
+  IFileSystem::IOBuffer Compress(const std::string& text, size_t chunkSize)
+  {
+    IFileSystem::IOBuffer content;
+    auto writer = Compression::CreateWriter(
+        std::unique_ptr<IFileSystem::IFileWriter>(new CollectingWriter(&content)));
+    for (size_t i = 0; i < text.size(); i += chunkSize)
+    {
+      const auto chunk = text.substr(i, chunkSize);
+      writer->Append(IFileSystem::IOBuffer(chunk.begin(), chunk.end()));
+    }
+    std::string error = "<not committed>";
+    writer->Commit([&error](const std::string& commitError) { error = commitError; });
+    EXPECT_EQ("", error);
+    return content;
+  }
+
+  std::string Decompress(const IFileSystem::IOBuffer& content, bool* valid)
+  {
+    Compression::Inflater inflater(content.data(), content.size());
+    std::string text;
+    const uint8_t* chunk = nullptr;
+    size_t size = 0;
+    while (inflater.Read(&chunk, &size))
+    {
+      EXPECT_LT(0u, size);
+      text.append(reinterpret_cast<const char*>(chunk), size);
+    }
+    *valid = inflater.IsValid();
+    return text;
+  }
+
+  std::string Filters(size_t count)
+  {
+    std::string text = "[Subscription filters]\n";
+    for (size_t i = 0; i < count; i++)
+      text += "||ads" + std::to_string(i) + ".example.com^$third-party\n";
+    return text;
+  }
+}
+
+TEST(CompressionTest, IsCompressed)
+{
+  const std::string text = "[Subscription]\n";
+  EXPECT_FALSE(Compression::IsCompressed(reinterpret_cast<const uint8_t*>(text.data()),
+                                         text.size()));
+  const uint8_t gzip[] = {0x1F, 0x8B, 0x08};
+  EXPECT_TRUE(Compression::IsCompressed(gzip, sizeof(gzip)));
+  EXPECT_FALSE(Compression::IsCompressed(gzip, 1));
+}
+
+#ifdef HAVE_ZLIB
+TEST(CompressionTest, RoundTrip)
+{
+  ASSERT_TRUE(Compression::IsSupported());
+  const auto text = Filters(20000);
+  for (size_t chunkSize : {size_t(1000), size_t(64 * 1024), text.size()})
+  {
+    const auto content = Compress(text, chunkSize);
+    EXPECT_TRUE(Compression::IsCompressed(content.data(), content.size()));
+    EXPECT_LT(content.size() * 5, text.size());
+    bool valid = false;
+    EXPECT_EQ(text, Decompress(content, &valid));
+    EXPECT_TRUE(valid);
+  }
+
+  bool valid = false;
+  EXPECT_EQ("", Decompress(Compress("", 1), &valid));
+  EXPECT_TRUE(valid);
+}
+
+TEST(CompressionTest, CorruptContent)
+{
+  const auto content = Compress(Filters(1000), 1000);
+  bool valid = true;
+  Decompress(IFileSystem::IOBuffer(content.begin(), content.end() - 100), &valid);
+  EXPECT_FALSE(valid) << "truncated";
+
+  auto damaged = content;
+  damaged[damaged.size() / 2] ^= 0x5A;
+  valid = true;
+  Decompress(damaged, &valid);
+  EXPECT_FALSE(valid);
+}
+#else
+TEST(CompressionTest, NotSupported)
+{
+  EXPECT_FALSE(Compression::IsSupported());
+  const uint8_t gzip[] = {0x1F, 0x8B, 0x08};
+  Compression::Inflater inflater(gzip, sizeof(gzip));
+  EXPECT_FALSE(inflater.IsValid());
+}
+#endif
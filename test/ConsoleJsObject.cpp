@@ -27,6 +27,10 @@ namespace
     AdblockPlus::LogSystem::LogLevel lastLogLevel;
     std::string lastMessage;
     std::string lastSource;
+    std::string lastMeasureName;
+    double lastMeasureStartTime = 0;
+    double lastMeasureDuration = 0;
+    LogLevel minLogLevel = LOG_LEVEL_TRACE;
 
     void operator()(AdblockPlus::LogSystem::LogLevel logLevel,
                     const std::string& message,
@@ -36,6 +40,18 @@ namespace
       lastMessage = message;
       lastSource = source;
     }
+
+    LogLevel GetMinLogLevel() const override
+    {
+      return minLogLevel;
+    }
+
+    void OnPerformanceMeasure(const std::string& name, double startTime, double duration) override
+    {
+      lastMeasureName = name;
+      lastMeasureStartTime = startTime;
+      lastMeasureDuration = duration;
+    }
   };
 
   class ConsoleJsObjectTest : public BaseJsTest
@@ -111,3 +127,34 @@ TEST_F(ConsoleJsObjectTest, ConsoleTraceCall)
             mockLogSystem->lastMessage);
   ASSERT_EQ("", mockLogSystem->lastSource);
 }
+
+TEST_F(ConsoleJsObjectTest, MessagesBelowMinLogLevelAreNotFormatted)
+{
+  mockLogSystem->minLogLevel = AdblockPlus::LogSystem::LOG_LEVEL_WARN;
+  GetJsEngine().Evaluate("var formatted = false;"
+                         "var arg = {toString() { formatted = true; return 'arg'; }};"
+                         "console.log(arg); console.info(arg); console.trace();");
+  EXPECT_FALSE(GetJsEngine().Evaluate("formatted").AsBool());
+  EXPECT_EQ("", mockLogSystem->lastMessage);
+
+  GetJsEngine().Evaluate("console.warn(arg)");
+  EXPECT_TRUE(GetJsEngine().Evaluate("formatted").AsBool());
+  EXPECT_EQ(AdblockPlus::LogSystem::LOG_LEVEL_WARN, mockLogSystem->lastLogLevel);
+  EXPECT_EQ("arg", mockLogSystem->lastMessage);
+}
+
+TEST_F(ConsoleJsObjectTest, PerformanceMeasureIsForwarded)
+{
+  GetJsEngine().Evaluate("_performance.measure('lib.js', 12.5, 3.25)");
+  EXPECT_EQ("lib.js", mockLogSystem->lastMeasureName);
+  EXPECT_EQ(12.5, mockLogSystem->lastMeasureStartTime);
+  EXPECT_EQ(3.25, mockLogSystem->lastMeasureDuration);
+  EXPECT_ANY_THROW(GetJsEngine().Evaluate("_performance.measure('lib.js')"));
+}
+
+TEST_F(ConsoleJsObjectTest, PerformanceClockIsMonotonic)
+{
+  GetJsEngine().Evaluate("let start = _performance.now()");
+  EXPECT_TRUE(GetJsEngine().Evaluate("_performance.now() >= start").AsBool());
+  EXPECT_TRUE(GetJsEngine().Evaluate("typeof start == 'number' && start > 0").AsBool());
+}
@@ -0,0 +1,86 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../src/ContentFilterDomains.h"
+
+#include <gtest/gtest.h>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  typedef ContentFilterDomains::Type Type;
+}
+
+TEST(ContentFilterDomainsTest, MatchesHostAndParentDomains)
+{
+  ContentFilterDomains domains;
+  domains.SetDomains(Type::ELEMHIDE, {"example.com", "Foo.Org"});
+  EXPECT_TRUE(domains.MayApply(Type::ELEMHIDE, "example.com"));
+  EXPECT_TRUE(domains.MayApply(Type::ELEMHIDE, "www.example.com"));
+  EXPECT_TRUE(domains.MayApply(Type::ELEMHIDE, "WWW.EXAMPLE.COM."));
+  EXPECT_TRUE(domains.MayApply(Type::ELEMHIDE, "foo.org"));
+  EXPECT_FALSE(domains.MayApply(Type::ELEMHIDE, "example.org"));
+  EXPECT_FALSE(domains.MayApply(Type::ELEMHIDE, "notexample.com"));
+  EXPECT_FALSE(domains.MayApply(Type::ELEMHIDE, "com"));
+
+  // Other types keep their own domains.
+  EXPECT_FALSE(domains.MayApply(Type::EMULATION, "example.com"));
+  domains.SetDomains(Type::SNIPPET, {"example.org"});
+  EXPECT_TRUE(domains.MayApply(Type::SNIPPET, "example.org"));
+  EXPECT_FALSE(domains.MayApply(Type::SNIPPET, "example.com"));
+
+  domains.SetDomains(Type::ELEMHIDE, {});
+  EXPECT_FALSE(domains.MayApply(Type::ELEMHIDE, "example.com"));
+}
+
+TEST(ContentFilterDomainsTest, UnrestrictedFiltersApplyEverywhere)
+{
+  ContentFilterDomains domains;
+  domains.SetDomains(Type::SNIPPET, {"example.com", "*"});
+  EXPECT_TRUE(domains.MayApply(Type::SNIPPET, "example.org"));
+  EXPECT_FALSE(domains.MayApply(Type::ELEMHIDE, "example.org"));
+}
+
+TEST(ContentFilterDomainsTest, UnusualHostsAreLeftToJs)
+{
+  ContentFilterDomains domains;
+  domains.SetDomains(Type::ELEMHIDE, {"example.com"});
+  EXPECT_TRUE(domains.MayApply(Type::ELEMHIDE, ""));
+  EXPECT_TRUE(domains.MayApply(Type::ELEMHIDE, "127.0.0.1"));
+  EXPECT_TRUE(domains.MayApply(Type::ELEMHIDE, "0x7f.1"));
+  EXPECT_TRUE(domains.MayApply(Type::ELEMHIDE, "::1"));
+  EXPECT_TRUE(domains.MayApply(Type::ELEMHIDE, "b\xC3\xBC" "cher.de"));
+  EXPECT_TRUE(domains.MayApply(Type::ELEMHIDE, "ex%61mple.org"));
+}
+
+TEST(ContentFilterDomainsTest, FewFalsePositives)
+{
+  std::vector<std::string> filterDomains;
+  for (int i = 0; i < 10000; ++i)
+    filterDomains.push_back("site" + std::to_string(i) + ".com");
+  ContentFilterDomains domains;
+  domains.SetDomains(Type::ELEMHIDE, filterDomains);
+
+  int falsePositives = 0;
+  for (int i = 0; i < 10000; ++i)
+  {
+    ASSERT_TRUE(domains.MayApply(Type::ELEMHIDE, "www.site" + std::to_string(i) + ".com"));
+    if (domains.MayApply(Type::ELEMHIDE, "other" + std::to_string(i) + ".org"))
+      ++falsePositives;
+  }
+  EXPECT_LT(falsePositives, 100);
+}
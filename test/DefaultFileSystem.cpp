@@ -155,6 +155,202 @@ TEST_F(DefaultFileSystemTest, WriteReadRemove)
   EXPECT_TRUE(hasRemoveRun);
 }
 
+TEST_F(DefaultFileSystemTest, WriteReadViewRemove)
+{
+  std::string viewContent = "<not read>";
+  std::shared_ptr<const void> owner;
+  auto readView = [this, &viewContent, &owner]() {
+    fileSystem->ReadView(
+        testFileName,
+        [&viewContent, &owner](const IFileSystem::ContentView& content) {
+          viewContent.assign(reinterpret_cast<const char*>(content.data), content.size);
+          owner = content.owner;
+        },
+        [&viewContent](const std::string& error) {
+          EXPECT_FALSE(error.empty());
+          viewContent = "<error>";
+        });
+    PumpTask();
+  };
+
+  readView();
+  EXPECT_EQ("<error>", viewContent);
+
+  WriteString("foo\nbar");
+  readView();
+  EXPECT_EQ("foo\nbar", viewContent);
+  ASSERT_TRUE(owner);
+
+#ifndef _WIN32
+  // The view stays valid when the file is replaced.
+  const auto* data = static_cast<const char*>(owner.get());
+  const std::string newTestFileName = testFileName + "-new";
+  fileSystem->Write(newTestFileName, IFileSystem::IOBuffer(3, 'x'), [](const std::string&) {});
+  PumpTask();
+  fileSystem->Move(newTestFileName, testFileName, [](const std::string& error) {
+    EXPECT_TRUE(error.empty()) << error;
+  });
+  PumpTask();
+  EXPECT_EQ("foo\nbar", std::string(data, 7));
+#endif
+  owner.reset();
+
+  WriteString("");
+  readView();
+  EXPECT_EQ("", viewContent);
+
+  fileSystem->Remove(testFileName, [](const std::string& error) { EXPECT_TRUE(error.empty()); });
+  PumpTask();
+}
+
+TEST_F(DefaultFileSystemTest, WritesWaitingForTheSameFileAreMerged)
+{
+  std::vector<std::string> errors;
+  auto write = [this, &errors](const std::string& content) {
+    fileSystem->Write(testFileName,
+                      IFileSystem::IOBuffer(content.cbegin(), content.cend()),
+                      [&errors](const std::string& error) { errors.push_back(error); });
+  };
+  write("foo");
+  write("bar");
+  write("baz");
+  PumpTask();
+  EXPECT_EQ(std::vector<std::string>(3), errors);
+
+  std::string content;
+  auto read = [this, &content]() {
+    fileSystem->Read(
+        testFileName,
+        [&content](IFileSystem::IOBuffer&& data) { content.assign(data.cbegin(), data.cend()); },
+        [](const std::string& error) { FAIL() << error; });
+  };
+  read();
+  PumpTask();
+  EXPECT_EQ("baz", content);
+
+  // Another operation on the file is a barrier.
+  write("foo");
+  read();
+  write("bar");
+  ASSERT_EQ(3u, fileSystemTasks.size());
+  for (; !fileSystemTasks.empty(); fileSystemTasks.pop_front())
+    fileSystemTasks.front()();
+  EXPECT_EQ("foo", content);
+
+  fileSystem->Remove(testFileName, [](const std::string& error) { EXPECT_TRUE(error.empty()); });
+  PumpTask();
+}
+
+TEST_F(DefaultFileSystemTest, WriteInPieces)
+{
+  WriteString("old");
+  std::string content;
+  auto read = [this, &content]() {
+    fileSystem->Read(
+        testFileName,
+        [&content](IFileSystem::IOBuffer&& data) { content.assign(data.cbegin(), data.cend()); },
+        [](const std::string& error) { FAIL() << error; });
+    PumpTask();
+  };
+
+  {
+    auto writer = fileSystem->OpenWriter(testFileName);
+    writer->Append(IFileSystem::IOBuffer{'f', 'o', 'o'});
+    PumpTask();
+    // The file is left alone if the writer isn't committed.
+  }
+  read();
+  EXPECT_EQ("old", content);
+
+  auto writer = fileSystem->OpenWriter(testFileName);
+  writer->Append(IFileSystem::IOBuffer{'f', 'o', 'o'});
+  writer->Append(IFileSystem::IOBuffer{'b', 'a', 'r'});
+  std::string commitError = "<not committed>";
+  writer->Commit([&commitError](const std::string& error) { commitError = error; });
+  writer.reset();
+  ASSERT_EQ(3u, fileSystemTasks.size());
+  // Each task writes whatever has been appended so far.
+  fileSystemTasks.front()();
+  fileSystemTasks.pop_front();
+  EXPECT_EQ("", commitError);
+  for (; !fileSystemTasks.empty(); fileSystemTasks.pop_front())
+    fileSystemTasks.front()();
+  read();
+  EXPECT_EQ("foobar", content);
+
+  fileSystem->Remove(testFileName, [](const std::string& error) { EXPECT_TRUE(error.empty()); });
+  PumpTask();
+}
+
+TEST_F(DefaultFileSystemTest, ConcurrentWritesOfTheSameFileDontMix)
+{
+  DefaultFileSystemSync fileSystemSync("");
+  {
+    const std::string first = "first content";
+    const std::string second = "second";
+    DefaultFileSystemSync::FileWriter firstWriter(testFileName);
+    DefaultFileSystemSync::FileWriter secondWriter(testFileName);
+    firstWriter.Append(reinterpret_cast<const uint8_t*>(first.data()), first.size());
+    secondWriter.Append(reinterpret_cast<const uint8_t*>(second.data()), second.size());
+    firstWriter.Commit();
+    const auto content = fileSystemSync.Read(testFileName);
+    EXPECT_EQ(first, std::string(content.cbegin(), content.cend()));
+    secondWriter.Commit();
+  }
+  const auto content = fileSystemSync.Read(testFileName);
+  EXPECT_EQ("second", std::string(content.cbegin(), content.cend()));
+  fileSystemSync.Remove(testFileName);
+}
+
+TEST_F(DefaultFileSystemTest, WriteCopyReadRemove)
+{
+  // Larger than the buffer used when the kernel cannot copy the file.
+  std::string content;
+  for (int i = 0; content.size() < 200 * 1024; i++)
+    content += "line " + std::to_string(i) + "\n";
+  WriteString(content);
+
+  const std::string copyFileName = testFileName + "-copy";
+  std::string copyError = "<not copied>";
+  fileSystem->Copy(testFileName, copyFileName, [&copyError](const std::string& error) {
+    copyError = error;
+  });
+  PumpTask();
+  EXPECT_EQ("", copyError);
+
+  std::string copyContent;
+  fileSystem->Read(
+      copyFileName,
+      [&copyContent](IFileSystem::IOBuffer&& data) {
+        copyContent.assign(data.cbegin(), data.cend());
+      },
+      [](const std::string& error) { FAIL() << error; });
+  PumpTask();
+  EXPECT_EQ(content, copyContent);
+
+  for (const auto& fileName : {testFileName, copyFileName})
+  {
+    fileSystem->Remove(fileName, [](const std::string& error) { EXPECT_TRUE(error.empty()); });
+    PumpTask();
+  }
+
+  fileSystem->Copy(testFileName, copyFileName, [&copyError](const std::string& error) {
+    copyError = error;
+  });
+  PumpTask();
+  EXPECT_NE("", copyError);
+}
+
+TEST_F(DefaultFileSystemTest, WriteToMissingDirectoryFails)
+{
+  std::string writeError;
+  fileSystem->Write("libadblockplus-missing-directory" SLASH_STRING "file",
+                    IFileSystem::IOBuffer(3, 'x'),
+                    [&writeError](const std::string& error) { writeError = error; });
+  PumpTask();
+  EXPECT_FALSE(writeError.empty());
+}
+
 TEST_F(DefaultFileSystemTest, StatWorkingDirectory)
 {
   bool hasStatRun = false;
@@ -244,6 +440,178 @@ TEST_F(DefaultFileSystemTest, WriteMoveStatRemove)
   EXPECT_TRUE(hasStatRemovedFileRun);
 }
 
+TEST_F(DefaultFileSystemTest, StatIsCachedUntilTheFileChanges)
+{
+  WriteString("foo");
+
+  IFileSystem::StatResult firstResult;
+  fileSystem->Stat(testFileName,
+                   [&firstResult](const IFileSystem::StatResult& result, const std::string& error) {
+                     EXPECT_TRUE(error.empty()) << error;
+                     firstResult = result;
+                   });
+  PumpTask();
+  ASSERT_TRUE(firstResult.exists);
+
+  bool hasCachedStatRun = false;
+  fileSystem->Stat(testFileName,
+                   [&](const IFileSystem::StatResult& result, const std::string& error) {
+                     EXPECT_TRUE(error.empty()) << error;
+                     EXPECT_TRUE(result.exists);
+                     EXPECT_EQ(firstResult.lastModified, result.lastModified);
+                     hasCachedStatRun = true;
+                   });
+  EXPECT_TRUE(hasCachedStatRun) << "answered without a task";
+  EXPECT_TRUE(fileSystemTasks.empty());
+
+  bool hasRemoveRun = false;
+  fileSystem->Remove(testFileName, [&hasRemoveRun](const std::string& error) {
+    EXPECT_TRUE(error.empty()) << error;
+    hasRemoveRun = true;
+  });
+  PumpTask();
+  EXPECT_TRUE(hasRemoveRun);
+
+  bool hasStatRemovedFileRun = false;
+  fileSystem->Stat(
+      testFileName,
+      [&hasStatRemovedFileRun](const IFileSystem::StatResult& result, const std::string& error) {
+        EXPECT_TRUE(error.empty()) << error;
+        EXPECT_FALSE(result.exists);
+        hasStatRemovedFileRun = true;
+      });
+  EXPECT_FALSE(hasStatRemovedFileRun);
+  PumpTask();
+  EXPECT_TRUE(hasStatRemovedFileRun);
+}
+
+TEST_F(DefaultFileSystemTest, StatMany)
+{
+  WriteString("foo");
+
+  const std::string missingFileName = testFileName + "-missing";
+  std::vector<IFileSystem::StatResult> statResults;
+  std::vector<std::string> statErrors;
+  bool hasStatManyRun = false;
+  auto statMany = [&] {
+    hasStatManyRun = false;
+    fileSystem->StatMany({testFileName, missingFileName, "."},
+                         [&](const std::vector<IFileSystem::StatResult>& results,
+                             const std::vector<std::string>& errors) {
+                           statResults = results;
+                           statErrors = errors;
+                           hasStatManyRun = true;
+                         });
+  };
+
+  statMany();
+  EXPECT_FALSE(hasStatManyRun);
+  PumpTask();
+  ASSERT_TRUE(hasStatManyRun);
+  ASSERT_EQ(3u, statResults.size());
+  ASSERT_EQ(3u, statErrors.size());
+  EXPECT_TRUE(statResults[0].exists);
+  EXPECT_FALSE(statResults[1].exists);
+  EXPECT_TRUE(statResults[2].exists) << "the working directory";
+  EXPECT_EQ(std::vector<std::string>(3), statErrors);
+
+  statMany();
+  EXPECT_TRUE(hasStatManyRun) << "all the results are cached";
+  EXPECT_TRUE(statResults[0].exists);
+
+  bool hasRemoveRun = false;
+  fileSystem->Remove(testFileName, [&hasRemoveRun](const std::string& error) {
+    EXPECT_TRUE(error.empty()) << error;
+    hasRemoveRun = true;
+  });
+  PumpTask();
+  EXPECT_TRUE(hasRemoveRun);
+
+  statMany();
+  EXPECT_FALSE(hasStatManyRun);
+  PumpTask();
+  ASSERT_TRUE(hasStatManyRun);
+  EXPECT_FALSE(statResults[0].exists);
+  EXPECT_FALSE(statResults[1].exists);
+  EXPECT_TRUE(statResults[2].exists);
+}
+
+TEST_F(DefaultFileSystemTest, ReadReturnsPrefetchedContent)
+{
+  WriteString("foo");
+  static_cast<DefaultFileSystem&>(*fileSystem).Prefetch({testFileName});
+
+  std::string content = "<not read>";
+  fileSystem->Read(
+      testFileName,
+      [&content](IFileSystem::IOBuffer&& buffer) {
+        content.assign(buffer.cbegin(), buffer.cend());
+      },
+      [](const std::string& error) { FAIL() << error; });
+  EXPECT_EQ(1u, fileSystemTasks.size()) << "waits for the prefetch task";
+  PumpTask();
+  EXPECT_EQ("foo", content);
+
+  // Only the first read is served from the prefetched content.
+  content = "<not read>";
+  fileSystem->Read(
+      testFileName,
+      [&content](IFileSystem::IOBuffer&& buffer) {
+        content.assign(buffer.cbegin(), buffer.cend());
+      },
+      [](const std::string& error) { FAIL() << error; });
+  PumpTask();
+  EXPECT_EQ("foo", content);
+
+  bool hasRemoveRun = false;
+  fileSystem->Remove(testFileName, [&hasRemoveRun](const std::string& error) {
+    EXPECT_TRUE(error.empty()) << error;
+    hasRemoveRun = true;
+  });
+  PumpTask();
+  EXPECT_TRUE(hasRemoveRun);
+}
+
+TEST_F(DefaultFileSystemTest, PrefetchedContentIsDroppedOnWrite)
+{
+  WriteString("foo");
+  static_cast<DefaultFileSystem&>(*fileSystem).Prefetch({testFileName});
+  PumpTask();
+  WriteString("bar");
+
+  std::string content = "<not read>";
+  fileSystem->ReadView(
+      testFileName,
+      [&content](const IFileSystem::ContentView& view) {
+        content.assign(view.data, view.data + view.size);
+      },
+      [](const std::string& error) { FAIL() << error; });
+  PumpTask();
+  EXPECT_EQ("bar", content);
+
+  bool hasRemoveRun = false;
+  fileSystem->Remove(testFileName, [&hasRemoveRun](const std::string& error) {
+    EXPECT_TRUE(error.empty()) << error;
+    hasRemoveRun = true;
+  });
+  PumpTask();
+  EXPECT_TRUE(hasRemoveRun);
+
+  static_cast<DefaultFileSystem&>(*fileSystem).Prefetch({testFileName});
+  PumpTask();
+  bool hasErrorRun = false;
+  fileSystem->Read(
+      testFileName,
+      [](IFileSystem::IOBuffer&&) { FAIL() << "the file was removed"; },
+      [&hasErrorRun](const std::string& error) {
+        EXPECT_FALSE(error.empty());
+        hasErrorRun = true;
+      });
+  EXPECT_FALSE(hasErrorRun);
+  PumpTask();
+  EXPECT_TRUE(hasErrorRun);
+}
+
 TEST_F(DefaultFileSystemTest, ResetAfterCallbackScheduled)
 {
   AdblockPlus::AppInfo appInfo;
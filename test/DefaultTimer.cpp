@@ -0,0 +1,135 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/DefaultTimer.h"
+
+#include <future>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  typedef std::chrono::steady_clock Clock;
+
+  class QueuedTimer : public ITimer
+  {
+  public:
+    void SetTimer(const std::chrono::milliseconds&, const TimerCallback& callback) override
+    {
+      callbacks.push_back(callback);
+    }
+
+    std::vector<TimerCallback> callbacks;
+  };
+}
+
+TEST(DefaultTimerTest, CallsCallbacksInOrder)
+{
+  DefaultTimer timer;
+  std::promise<void> done;
+  std::vector<int> order;
+  timer.SetTimer(std::chrono::milliseconds(30), [&] {
+    order.push_back(2);
+    done.set_value();
+  });
+  timer.SetTimer(std::chrono::milliseconds(10), [&] { order.push_back(1); });
+  ASSERT_EQ(std::future_status::ready, done.get_future().wait_for(std::chrono::seconds(5)));
+  EXPECT_EQ((std::vector<int>{1, 2}), order);
+}
+
+TEST(DefaultTimerTest, CancelledTimersDoNotFire)
+{
+  DefaultTimer timer;
+  std::promise<void> done;
+  bool cancelledFired = false;
+  auto handle =
+      timer.SetCancellableTimer(std::chrono::milliseconds(10), [&] { cancelledFired = true; }, {});
+  EXPECT_TRUE(handle.IsPending());
+  EXPECT_TRUE(handle.Cancel());
+  EXPECT_FALSE(handle.Cancel());
+  EXPECT_TRUE(handle.IsCancelled());
+  auto fired = timer.SetCancellableTimer(
+      std::chrono::milliseconds(30), [&] { done.set_value(); }, {});
+  ASSERT_EQ(std::future_status::ready, done.get_future().wait_for(std::chrono::seconds(5)));
+  EXPECT_FALSE(cancelledFired);
+  EXPECT_FALSE(fired.IsPending());
+  EXPECT_FALSE(fired.IsCancelled());
+  EXPECT_FALSE(fired.Cancel()) << "has fired already";
+}
+
+TEST(DefaultTimerTest, TimersWithinToleranceShareAWakeup)
+{
+  DefaultTimer timer;
+  std::promise<void> done;
+  Clock::time_point tolerantFiredAt;
+  Clock::time_point strictFiredAt;
+  const auto start = Clock::now();
+  timer.SetCancellableTimer(std::chrono::milliseconds(10),
+                            [&] { tolerantFiredAt = Clock::now(); },
+                            std::chrono::milliseconds(1000));
+  timer.SetCancellableTimer(std::chrono::milliseconds(100),
+                            [&] {
+                              strictFiredAt = Clock::now();
+                              done.set_value();
+                            },
+                            std::chrono::milliseconds(0));
+  ASSERT_EQ(std::future_status::ready, done.get_future().wait_for(std::chrono::seconds(5)));
+  EXPECT_LE(std::chrono::milliseconds(100), tolerantFiredAt - start)
+      << "should wait for the strict timer";
+  EXPECT_LE(tolerantFiredAt, strictFiredAt);
+  EXPECT_GT(std::chrono::milliseconds(50), strictFiredAt - tolerantFiredAt);
+}
+
+TEST(DefaultTimerTest, DefaultCancellableTimerWrapsSetTimer)
+{
+  QueuedTimer timer;
+  int fired = 0;
+  auto cancelled =
+      timer.SetCancellableTimer(std::chrono::milliseconds(0), [&fired] { fired += 1; });
+  timer.SetCancellableTimer(std::chrono::milliseconds(0), [&fired] { fired += 10; });
+  EXPECT_FALSE(timer.SetCancellableTimer(std::chrono::milliseconds(0), nullptr).IsPending());
+  ASSERT_EQ(2u, timer.callbacks.size());
+  cancelled.Cancel();
+  for (const auto& callback : timer.callbacks)
+    callback();
+  EXPECT_EQ(10, fired);
+}
+
+TEST(DefaultTimerTest, ReportsStats)
+{
+  DefaultTimer timer;
+  std::promise<void> done;
+  auto cancelled = timer.SetCancellableTimer(std::chrono::hours(1), [] {}, {});
+  timer.SetCancellableTimer(std::chrono::hours(1), [] {}, {});
+  timer.SetCancellableTimer(std::chrono::milliseconds(10), [] {}, std::chrono::milliseconds(50));
+  timer.SetTimer(std::chrono::milliseconds(10), [&done] { done.set_value(); });
+  cancelled.Cancel();
+  EXPECT_EQ(3u, timer.GetStats().pendingTimers);
+
+  ASSERT_EQ(std::future_status::ready, done.get_future().wait_for(std::chrono::seconds(5)));
+  ITimer::Stats stats;
+  do
+  {
+    std::this_thread::yield();
+    stats = timer.GetStats();
+  } while (stats.runTime.GetCount() < 2);
+  EXPECT_EQ(1u, stats.pendingTimers);
+  EXPECT_EQ(1u, stats.wakeups);
+  EXPECT_EQ(2u, stats.delay.GetCount());
+}
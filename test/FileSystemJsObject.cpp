@@ -17,6 +17,7 @@
 
 #include <sstream>
 
+#include "../src/Compression.h"
 #include "../src/Thread.h"
 #include "BaseJsTest.h"
 
@@ -188,6 +189,31 @@ TEST_F(FileSystemJsObjectTest, WriteError)
   ASSERT_NE("", GetJsEngine().Evaluate("error").AsString());
 }
 
+TEST_F(FileSystemJsObjectTest, WriteInPieces)
+{
+  GetJsEngine().Evaluate(R"js(
+let error = true;
+let writer = _fileSystem.openWriter('foo');
+_fileSystem.appendToWriter(writer, 'ba');
+_fileSystem.appendToWriter(writer, 'r');
+_fileSystem.commitWriter(writer, function(e) {error = e});
+)js");
+  ASSERT_EQ("foo", mockFileSystem->lastWrittenFile);
+  ASSERT_EQ((AdblockPlus::IFileSystem::IOBuffer{'b', 'a', 'r'}),
+            mockFileSystem->lastWrittenContent);
+  ASSERT_TRUE(GetJsEngine().Evaluate("error").IsUndefined());
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("_fileSystem.appendToWriter(writer, 'baz')"))
+      << "the writer is gone after committing";
+
+  GetJsEngine().Evaluate(R"js(
+writer = _fileSystem.openWriter('bar');
+_fileSystem.appendToWriter(writer, 'baz');
+_fileSystem.abortWriter(writer);
+)js");
+  ASSERT_EQ("foo", mockFileSystem->lastWrittenFile);
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("_fileSystem.commitWriter(writer, () => {})"));
+}
+
 TEST_F(FileSystemJsObjectTest, Move)
 {
   GetJsEngine().Evaluate(
@@ -210,6 +236,30 @@ TEST_F(FileSystemJsObjectTest, MoveError)
   ASSERT_FALSE(GetJsEngine().Evaluate("error").IsUndefined());
 }
 
+TEST_F(FileSystemJsObjectTest, Copy)
+{
+  mockFileSystem->contentToRead = AdblockPlus::IFileSystem::IOBuffer{'b', 'a', 'r'};
+  GetJsEngine().Evaluate(
+      "let error = true; _fileSystem.copy('foo', 'bar', function(e) {error = e})");
+  ASSERT_EQ("bar", mockFileSystem->lastWrittenFile);
+  ASSERT_EQ(mockFileSystem->contentToRead, mockFileSystem->lastWrittenContent);
+  ASSERT_TRUE(GetJsEngine().Evaluate("error").IsUndefined());
+}
+
+TEST_F(FileSystemJsObjectTest, CopyIllegalArguments)
+{
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("_fileSystem.copy()"));
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("_fileSystem.copy('', '', '')"));
+}
+
+TEST_F(FileSystemJsObjectTest, CopyError)
+{
+  mockFileSystem->success = false;
+  GetJsEngine().Evaluate(
+      "let error = true; _fileSystem.copy('foo', 'bar', function(e) {error = e})");
+  ASSERT_NE("", GetJsEngine().Evaluate("error").AsString());
+}
+
 TEST_F(FileSystemJsObjectTest, Remove)
 {
   GetJsEngine().Evaluate("let error = true; _fileSystem.remove('foo', function(e) {error = e})");
@@ -397,6 +447,138 @@ _fileSystem.readFromFile("foo",
   EXPECT_EQ("Error: my-error at undefined:8", error);
 }
 
+TEST_F(FileSystemJsObject_ReadFromFileTest, LinesInBatches)
+{
+  std::string content = "1\n2\r\n\n3\n4\n5\n";
+  mockFileSystem->contentToRead.assign(content.begin(), content.end());
+
+  auto& jsEngine = GetJsEngine();
+  jsEngine.Evaluate(R"js(
+let batches = [];
+let done = false;
+_fileSystem.readFromFile("foo",
+  (lines) => batches.push(lines.join(",")),
+  () => done = true,
+  (error) => {},
+  2);
+)js");
+  EXPECT_TRUE(jsEngine.Evaluate("done").AsBool());
+  EXPECT_EQ("1,2|3,4|5", jsEngine.Evaluate("batches.join('|')").AsString());
+
+  mockFileSystem->contentToRead.clear();
+  jsEngine.Evaluate(R"js(
+batches = [];
+_fileSystem.readFromFile("foo", (lines) => batches.push(lines.length), () => {}, () => {}, 2);
+)js");
+  EXPECT_EQ("1", jsEngine.Evaluate("batches.join('|')").AsString());
+
+  ASSERT_ANY_THROW(
+      jsEngine.Evaluate("_fileSystem.readFromFile('foo', () => {}, () => {}, () => {}, 0)"));
+}
+
+TEST_F(FileSystemJsObject_ReadFromFileTest, FiltersOfDisabledSubscriptionsAreDeferred)
+{
+  std::string content = "[Subscription]\n"
+                        "url=https://a.example/list.txt\n"
+                        "disabled=true\n"
+                        "[Subscription filters]\n"
+                        "||a.example^\n"
+                        "\\[b]\n"
+                        "[Subscription]\n"
+                        "url=https://b.example/list.txt\n"
+                        "[Subscription filters]\n"
+                        "||b.example^\n";
+  mockFileSystem->contentToRead.assign(content.begin(), content.end());
+
+  auto& jsEngine = GetJsEngine();
+  jsEngine.Evaluate(R"js(
+let lines = [];
+let deferred = null;
+_fileSystem.readFromFile("foo",
+  (batch) => lines.push(...batch),
+  (result) => deferred = result,
+  (error) => {},
+  100,
+  true);
+)js");
+  EXPECT_EQ("[Subscription]|url=https://a.example/list.txt|disabled=true|"
+            "[Subscription]|url=https://b.example/list.txt|[Subscription filters]|||b.example^",
+            jsEngine.Evaluate("lines.join('|')").AsString());
+  EXPECT_EQ("[\"https://a.example/list.txt\"]",
+            jsEngine.Evaluate("JSON.stringify(Object.keys(deferred))").AsString());
+  EXPECT_EQ("||a.example^\n\\[b]\n",
+            jsEngine.Evaluate("deferred['https://a.example/list.txt']").AsString());
+}
+
+TEST_F(FileSystemJsObject_ReadFromFileTest, BinaryStorage)
+{
+  auto& jsEngine = GetJsEngine();
+  jsEngine.Evaluate(R"js(
+let writer = _fileSystem.openWriter('foo', true);
+_fileSystem.appendToWriter(writer, '[Subscription]\nurl=~user~1\n\n[Subscription filters]\n');
+_fileSystem.appendToWriter(writer, '||example.com^\n');
+_fileSystem.commitWriter(writer, () => {});
+)js");
+  ASSERT_EQ("foo", mockFileSystem->lastWrittenFile);
+  ASSERT_EQ('\0', mockFileSystem->lastWrittenContent.at(0)) << "not written as text";
+
+  mockFileSystem->contentToRead = mockFileSystem->lastWrittenContent;
+  jsEngine.Evaluate(R"js(
+let lines = [];
+let result = "";
+_fileSystem.readFromFile('foo', line => lines.push(line), () => result = "done",
+                         error => result = error);
+)js");
+  EXPECT_EQ("done", jsEngine.Evaluate("result").AsString());
+  EXPECT_EQ("[Subscription]|url=~user~1|[Subscription filters]|||example.com^",
+            jsEngine.Evaluate("lines.join('|')").AsString());
+
+  mockFileSystem->contentToRead.resize(mockFileSystem->contentToRead.size() - 1);
+  jsEngine.Evaluate(R"js(
+lines = [];
+_fileSystem.readFromFile('foo', line => lines.push(line), () => result = "done",
+                         error => result = error);
+)js");
+  EXPECT_EQ("Corrupt binary filter storage", jsEngine.Evaluate("result").AsString());
+  EXPECT_EQ(0, jsEngine.Evaluate("lines.length").AsInt());
+}
+
+TEST_F(FileSystemJsObject_ReadFromFileTest, CompressedStorage)
+{
+  if (!AdblockPlus::Compression::IsSupported())
+    return;
+  auto& jsEngine = GetJsEngine();
+  jsEngine.Evaluate(R"js(
+let expected = [];
+for (let i = 0; i < 20000; i++)
+  expected.push("||ads" + i + ".example.com^");
+let lines = [];
+let result = "";
+function save(binary)
+{
+  let writer = _fileSystem.openWriter('foo', binary, true);
+  _fileSystem.appendToWriter(writer, expected.join('\n') + '\n');
+  _fileSystem.commitWriter(writer, () => {});
+}
+)js");
+  for (const std::string binary : {"false", "true"})
+  {
+    jsEngine.Evaluate("save(" + binary + ")");
+    ASSERT_EQ("foo", mockFileSystem->lastWrittenFile);
+    const auto& content = mockFileSystem->lastWrittenContent;
+    ASSERT_TRUE(AdblockPlus::Compression::IsCompressed(content.data(), content.size()));
+
+    mockFileSystem->contentToRead = content;
+    jsEngine.Evaluate(R"js(
+lines = [];
+_fileSystem.readFromFile('foo', batch => lines.push(...batch), () => result = "done",
+                         error => result = error, 1000);
+)js");
+    EXPECT_EQ("done", jsEngine.Evaluate("result").AsString());
+    EXPECT_TRUE(jsEngine.Evaluate("lines.join('|') == expected.join('|')").AsBool()) << binary;
+  }
+}
+
 TEST_F(FileSystemJsObjectTest, MoveNonExistingFile)
 {
   mockFileSystem->success = false;
@@ -419,3 +601,37 @@ TEST_F(FileSystemJsObjectTest, MoveNonExistingFile)
   EXPECT_EQ("Unable to move foo to bar", jsEngine.Evaluate("hasError").AsString());
   EXPECT_TRUE(jsEngine.Evaluate("isNextHandlerCalled").AsBool());
 }
+
+TEST_F(FileSystemJsObjectTest, WriteToFile)
+{
+  auto& jsEngine = GetJsEngine();
+  const std::vector<std::string> jsFiles = {"compat.js", "io.js"};
+  for (int i = 0; !jsSources[i].empty(); i += 2)
+  {
+    if (jsFiles.end() != std::find(jsFiles.begin(), jsFiles.end(), jsSources[i]))
+    {
+      jsEngine.Evaluate(jsSources[i + 1], jsSources[i]);
+    }
+  }
+  jsEngine.Evaluate(R"js(
+    let isDone = false;
+    function* lines(count)
+    {
+      for (let i = 0; i < count; i++)
+        yield "line " + i;
+    }
+    require("io").IO.writeToFile("foo", lines(20000)).then(() => isDone = true);
+  )js");
+  EXPECT_TRUE(jsEngine.Evaluate("isDone").AsBool());
+  std::string expected;
+  for (int i = 0; i < 20000; i++)
+    expected += "line " + std::to_string(i) + "\n";
+  EXPECT_EQ("foo", mockFileSystem->lastWrittenFile);
+  EXPECT_EQ(expected,
+            std::string(mockFileSystem->lastWrittenContent.begin(),
+                        mockFileSystem->lastWrittenContent.end()));
+
+  jsEngine.Evaluate(R"js(require("io").IO.writeToFile("bar", []))js");
+  EXPECT_EQ("bar", mockFileSystem->lastWrittenFile);
+  EXPECT_EQ(AdblockPlus::IFileSystem::IOBuffer{'\n'}, mockFileSystem->lastWrittenContent);
+}
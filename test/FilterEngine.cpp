@@ -15,8 +15,11 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
 #include <condition_variable>
+#include <future>
 #include <thread>
+#include <unordered_map>
 
 #include "FilterEngineTest.h"
 
@@ -258,6 +261,28 @@ TEST_F(FilterEngineTest, FilterCreation)
   ASSERT_EQ(filter6, filter7);
 }
 
+TEST_F(FilterEngineTest, FiltersAreHashable)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto filter = filterEngine.GetFilter("||example.com^");
+  auto same = filterEngine.GetFilter("  ||example.com^  ");
+  auto other = filterEngine.GetFilter("example.com##.ad");
+  EXPECT_EQ(filter.GetHash(), same.GetHash());
+  EXPECT_EQ(std::hash<Filter>()(filter), filter.GetHash());
+  EXPECT_EQ(0u, Filter().GetHash());
+
+  std::unordered_map<Filter, int> counts;
+  ++counts[filter];
+  ++counts[same];
+  ++counts[other];
+  ++counts[Filter(other)];
+  ASSERT_EQ(2u, counts.size());
+  EXPECT_EQ(2, counts[filter]);
+  EXPECT_EQ(2, counts[other]);
+  EXPECT_EQ(Filter::Type::TYPE_ELEMHIDE, counts.find(other)->first.GetType());
+  EXPECT_EQ("||example.com^", counts.find(same)->first.GetRaw());
+}
+
 TEST_F(FilterEngineTest, AddRemoveFilters)
 {
   auto& filterEngine = GetFilterEngine();
@@ -276,6 +301,200 @@ TEST_F(FilterEngineTest, AddRemoveFilters)
   ASSERT_EQ(0u, filterEngine.GetListedFilters().size());
 }
 
+TEST_F(FilterEngineTest, AddRemoveFiltersInOneUpdate)
+{
+  auto& filterEngine = GetFilterEngine();
+  FakeFilterEventObserver observer;
+  filterEngine.AddEventObserver(&observer);
+
+  filterEngine.AddFilters({filterEngine.GetFilter("adbanner.gif"),
+                           filterEngine.GetFilter("@@notbanner.gif"),
+                           Filter(),
+                           filterEngine.GetFilter("example.org##.ad")});
+  EXPECT_EQ(3u, filterEngine.GetListedFilterCount());
+  ASSERT_EQ(3u, observer.filterEvents.size());
+  EXPECT_EQ(IFilterEngine::FilterEvent::FILTER_ADDED, observer.filterEvents[2]);
+  ASSERT_NE(nullptr, observer.lastFilter);
+  EXPECT_EQ("example.org##.ad", observer.lastFilter->GetRaw());
+  EXPECT_TRUE(filterEngine.Matches("http://example.org/adbanner.gif",
+                                   IFilterEngine::CONTENT_TYPE_IMAGE,
+                                   "")
+                  .IsValid());
+
+  observer.Reset();
+  filterEngine.BeginUpdate();
+  filterEngine.BeginUpdate();
+  filterEngine.RemoveFilters({filterEngine.GetFilter("adbanner.gif")});
+  filterEngine.AddFilter(filterEngine.GetFilter("foo"));
+  filterEngine.CommitUpdate();
+  EXPECT_TRUE(observer.filterEvents.empty());
+  filterEngine.CommitUpdate();
+  ASSERT_EQ(2u, observer.filterEvents.size());
+  EXPECT_EQ(IFilterEngine::FilterEvent::FILTER_REMOVED, observer.filterEvents[0]);
+  EXPECT_EQ(IFilterEngine::FilterEvent::FILTER_ADDED, observer.filterEvents[1]);
+  EXPECT_EQ(3u, filterEngine.GetListedFilterCount());
+  EXPECT_FALSE(filterEngine.Matches("http://example.org/adbanner.gif",
+                                    IFilterEngine::CONTENT_TYPE_IMAGE,
+                                    "")
+                   .IsValid());
+
+  // A commit without an update is ignored.
+  filterEngine.CommitUpdate();
+  filterEngine.RemoveEventObserver(&observer);
+}
+
+TEST_F(FilterEngineTest, EngineSessionKeepsOtherThreadsOut)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("adbanner.gif"));
+  filterEngine.AddFilter(filterEngine.GetFilter("##.ad"));
+
+  std::atomic<bool> added(false);
+  std::thread other;
+  {
+    auto session = filterEngine.CreateEngineSession();
+    other = std::thread([&filterEngine, &added]() {
+      filterEngine.AddFilter(filterEngine.GetFilter("@@||example.org^$document"));
+      added = true;
+    });
+    // The calls of one frame, made under the same lock.
+    EXPECT_TRUE(filterEngine.Matches("http://example.org/adbanner.gif",
+                                     IFilterEngine::CONTENT_TYPE_IMAGE,
+                                     "http://example.org/")
+                    .IsValid());
+    EXPECT_FALSE(filterEngine.IsContentAllowlisted(
+        "http://example.org/", IFilterEngine::CONTENT_TYPE_DOCUMENT, {}));
+    EXPECT_FALSE(filterEngine.GetElementHidingStyleSheet("example.org").empty());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(added) << "the other thread waits for the session";
+  }
+  other.join();
+  EXPECT_TRUE(added);
+  EXPECT_TRUE(filterEngine.IsContentAllowlisted(
+      "http://example.org/", IFilterEngine::CONTENT_TYPE_DOCUMENT, {}));
+}
+
+TEST_F(FilterEngineTest, ListedFiltersCountPagesAndVisitor)
+{
+  auto& filterEngine = GetFilterEngine();
+  EXPECT_EQ(0u, filterEngine.GetListedFilterCount());
+  EXPECT_TRUE(filterEngine.GetListedFilters(0, 10).empty());
+
+  filterEngine.AddFilter(filterEngine.GetFilter("foo"));
+  filterEngine.AddFilter(filterEngine.GetFilter("@@bar"));
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org##.ad"));
+  ASSERT_EQ(3u, filterEngine.GetListedFilterCount());
+
+  auto all = filterEngine.GetListedFilters();
+  auto page = filterEngine.GetListedFilters(1, 10);
+  ASSERT_EQ(2u, page.size());
+  EXPECT_EQ(all[1].GetRaw(), page[0].text);
+  EXPECT_EQ(all[1].GetType(), page[0].type);
+  EXPECT_EQ(all[2].GetRaw(), page[1].text);
+  EXPECT_EQ(all[2].GetType(), page[1].type);
+  ASSERT_EQ(1u, filterEngine.GetListedFilters(0, 1).size());
+  EXPECT_EQ(all[0].GetRaw(), filterEngine.GetListedFilters(0, 1)[0].text);
+  EXPECT_TRUE(filterEngine.GetListedFilters(3, 10).empty());
+
+  std::vector<std::string> visited;
+  filterEngine.VisitListedFilters([&visited](const IFilterEngine::FilterInfo& filter) {
+    visited.push_back(filter.text);
+    return visited.size() < 2;
+  });
+  ASSERT_EQ(2u, visited.size());
+  EXPECT_EQ(all[0].GetRaw(), visited[0]);
+  EXPECT_EQ(all[1].GetRaw(), visited[1]);
+
+  filterEngine.RemoveFilter(all[0]);
+  EXPECT_EQ(2u, filterEngine.GetListedFilterCount());
+}
+
+TEST_F(FilterEngineTest, ListedSubscriptionsCountPagesAndVisitor)
+{
+  auto& filterEngine = GetFilterEngine();
+  const size_t initialCount = filterEngine.GetListedSubscriptionCount();
+  EXPECT_EQ(filterEngine.GetListedSubscriptions().size(), initialCount);
+  auto subscription = filterEngine.GetSubscription("https://foo/");
+  filterEngine.AddSubscription(subscription);
+  ASSERT_EQ(initialCount + 1, filterEngine.GetListedSubscriptionCount());
+
+  auto page = filterEngine.GetListedSubscriptions(initialCount, 10);
+  ASSERT_EQ(1u, page.size());
+  EXPECT_EQ("https://foo/", page[0].url);
+  EXPECT_EQ(subscription.GetTitle(), page[0].title);
+
+  size_t visited = 0;
+  filterEngine.VisitListedSubscriptions([&visited](const IFilterEngine::SubscriptionInfo&) {
+    ++visited;
+    return true;
+  });
+  EXPECT_EQ(initialCount + 1, visited);
+
+  auto available = filterEngine.FetchAvailableSubscriptions();
+  ASSERT_EQ(available.size(), filterEngine.GetAvailableSubscriptionCount());
+  ASSERT_FALSE(available.empty());
+  auto availablePage = filterEngine.FetchAvailableSubscriptions(0, 1);
+  ASSERT_EQ(1u, availablePage.size());
+  EXPECT_EQ(available[0].GetUrl(), availablePage[0].url);
+  EXPECT_EQ(available[0].GetTitle(), availablePage[0].title);
+  std::vector<std::string> urls;
+  filterEngine.VisitAvailableSubscriptions(
+      [&urls](const IFilterEngine::SubscriptionInfo& info) {
+        urls.push_back(info.url);
+        return true;
+      });
+  ASSERT_EQ(available.size(), urls.size());
+  EXPECT_EQ(available.back().GetUrl(), urls.back());
+}
+
+TEST_F(FilterEngineTest, SubscriptionInfoMatchesGetters)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto subscription = filterEngine.GetSubscription("https://foo/");
+  filterEngine.AddSubscription(subscription);
+  subscription.SetDisabled(true);
+
+  const auto info = filterEngine.GetSubscriptionInfo(subscription);
+  EXPECT_EQ(subscription.GetUrl(), info.url);
+  EXPECT_EQ(subscription.GetTitle(), info.title);
+  EXPECT_EQ(subscription.GetHomepage(), info.homepage);
+  EXPECT_EQ(subscription.GetAuthor(), info.author);
+  EXPECT_EQ(subscription.GetLanguages(), info.languages);
+  EXPECT_EQ(subscription.GetFilterCount(), info.filterCount);
+  EXPECT_EQ(subscription.GetSynchronizationStatus(), info.synchronizationStatus);
+  EXPECT_EQ(subscription.GetLastDownloadAttemptTime(), info.lastDownloadAttemptTime);
+  EXPECT_EQ(subscription.GetLastDownloadSuccessTime(), info.lastDownloadSuccessTime);
+  EXPECT_EQ(subscription.GetVersion(), info.version);
+  EXPECT_TRUE(info.disabled);
+  EXPECT_EQ(subscription.IsUpdating(), info.updating);
+  EXPECT_EQ(subscription.IsAA(), info.aa);
+
+  auto available = filterEngine.FetchAvailableSubscriptions();
+  ASSERT_FALSE(available.empty());
+  const auto availableInfo = filterEngine.FetchAvailableSubscriptions(0, 1);
+  ASSERT_EQ(1u, availableInfo.size());
+  EXPECT_EQ(available[0].GetHomepage(), availableInfo[0].homepage);
+  EXPECT_EQ(available[0].GetLanguages(), availableInfo[0].languages);
+}
+
+TEST_F(FilterEngineTest, RecommendationsMatchAvailableSubscriptions)
+{
+  auto& filterEngine = GetFilterEngine();
+  const auto available = filterEngine.FetchAvailableSubscriptions();
+  const auto recommendations = filterEngine.GetRecommendations();
+  ASSERT_EQ(available.size(), recommendations->size());
+  for (size_t i = 0; i < available.size(); ++i)
+  {
+    EXPECT_EQ(available[i].GetUrl(), (*recommendations)[i].url);
+    EXPECT_EQ(available[i].GetTitle(), (*recommendations)[i].title);
+    EXPECT_EQ(available[i].GetHomepage(), (*recommendations)[i].homepage);
+    EXPECT_EQ(available[i].GetLanguages(), (*recommendations)[i].languages);
+    EXPECT_FALSE((*recommendations)[i].type.empty());
+  }
+  // The list is read once.
+  EXPECT_EQ(recommendations, filterEngine.GetRecommendations());
+}
+
 TEST_F(FilterEngineTest, AddedSubscriptionIsEnabled)
 {
   auto subscription = GetFilterEngine().GetSubscription("https://foo/");
@@ -449,6 +668,88 @@ TEST_F(FilterEngineTest, Matches)
   ASSERT_EQ(AdblockPlus::Filter::Type::TYPE_BLOCKING, match12.GetType());
 }
 
+TEST_F(FilterEngineTest, MatchesBatch)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("adbanner.gif"));
+  filterEngine.AddFilter(filterEngine.GetFilter("notbanner.gif"));
+  filterEngine.AddFilter(filterEngine.GetFilter("@@notbanner.gif"));
+  filterEngine.AddFilter(filterEngine.GetFilter("combanner.gif$domain=example.com"));
+
+  EXPECT_TRUE(filterEngine.MatchesBatch({}).empty());
+
+  std::vector<IFilterEngine::MatchRequest> requests = {
+      {"http://example.org/foobar.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "", "", false},
+      {"http://example.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "", "", false},
+      {"http://example.org/notbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "", "", false},
+      {"", IFilterEngine::CONTENT_TYPE_IMAGE, "", "", false},
+      {"http://example.org/combanner.gif",
+       IFilterEngine::CONTENT_TYPE_IMAGE,
+       "http://example.com/",
+       "",
+       false},
+      {"http://example.org/combanner.gif",
+       IFilterEngine::CONTENT_TYPE_IMAGE,
+       "http://example.org/",
+       "",
+       false}};
+
+  auto matches = filterEngine.MatchesBatch(requests);
+  ASSERT_EQ(requests.size(), matches.size());
+  EXPECT_FALSE(matches[0].IsValid());
+  ASSERT_TRUE(matches[1].IsValid());
+  EXPECT_EQ("adbanner.gif", matches[1].GetRaw());
+  ASSERT_TRUE(matches[2].IsValid());
+  EXPECT_EQ(Filter::Type::TYPE_EXCEPTION, matches[2].GetType());
+  EXPECT_FALSE(matches[3].IsValid());
+  ASSERT_TRUE(matches[4].IsValid());
+  EXPECT_EQ("combanner.gif$domain=example.com", matches[4].GetRaw());
+  EXPECT_FALSE(matches[5].IsValid());
+
+  for (size_t i = 0; i < requests.size(); ++i)
+  {
+    const auto& request = requests[i];
+    EXPECT_EQ(matches[i],
+              filterEngine.Matches(request.url,
+                                   request.contentTypeMask,
+                                   request.documentUrl,
+                                   request.siteKey,
+                                   request.specificOnly))
+        << request.url;
+  }
+}
+
+TEST_F(FilterEngineTest, MatchesFollowsFilterChanges)
+{
+  auto& filterEngine = GetFilterEngine();
+  const std::string url = "http://ads.example.com/banner1.gif";
+  EXPECT_FALSE(filterEngine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, "").IsValid());
+
+  auto filter = filterEngine.GetFilter("||example.com^$image");
+  filterEngine.AddFilter(filter);
+  EXPECT_EQ(filter, filterEngine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, ""));
+  EXPECT_FALSE(filterEngine.Matches(url, IFilterEngine::CONTENT_TYPE_SCRIPT, "").IsValid());
+
+  auto exception = filterEngine.GetFilter("@@||ads.example.com/banner");
+  filterEngine.AddFilter(exception);
+  EXPECT_EQ(exception, filterEngine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, ""));
+  filterEngine.RemoveFilter(exception);
+  EXPECT_EQ(filter, filterEngine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, ""));
+
+  filterEngine.RemoveFilter(filter);
+  EXPECT_FALSE(filterEngine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, "").IsValid());
+
+  // Regular expressions are left to the JS matcher.
+  auto regexp = filterEngine.GetFilter("/banner\\d+\\.gif/");
+  filterEngine.AddFilter(regexp);
+  EXPECT_EQ(regexp, filterEngine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, ""));
+  EXPECT_FALSE(filterEngine
+                   .Matches("http://ads.example.com/banner.gif",
+                            IFilterEngine::CONTENT_TYPE_IMAGE,
+                            "")
+                   .IsValid());
+}
+
 TEST_F(FilterEngineTest, GenericblockHierarchy)
 {
   auto& filterEngine = GetFilterEngine();
@@ -917,6 +1218,83 @@ TEST_F(FilterEngineTest, AddRemoveSubsciptionEventCallback)
   EXPECT_EQ(0u, observer.subscriptionEvents.size());
 }
 
+TEST_F(FilterEngineTest, ObserverOnlyGetsSelectedEvents)
+{
+  struct RemovedFilterObserver : FakeFilterEventObserver
+  {
+    uint32_t GetFilterEventMask() const override
+    {
+      return EventMask(IFilterEngine::FilterEvent::FILTER_REMOVED);
+    }
+
+    uint32_t GetSubscriptionEventMask() const override
+    {
+      return 0;
+    }
+  };
+
+  auto& filterEngine = GetFilterEngine();
+  RemovedFilterObserver observer;
+  filterEngine.AddEventObserver(&observer);
+  filterEngine.AddFilter(filterEngine.GetFilter("foo"));
+  filterEngine.AddSubscription(filterEngine.GetSubscription("https://foo/"));
+  EXPECT_EQ(0u, observer.filterEvents.size());
+  EXPECT_EQ(0u, observer.subscriptionEvents.size());
+  filterEngine.RemoveFilter(filterEngine.GetFilter("foo"));
+  ASSERT_EQ(1u, observer.filterEvents.size());
+  EXPECT_EQ(IFilterEngine::FilterEvent::FILTER_REMOVED, observer.filterEvents[0]);
+  ASSERT_NE(nullptr, observer.lastFilter);
+  EXPECT_EQ("foo", observer.lastFilter->GetRaw());
+  filterEngine.RemoveEventObserver(&observer);
+}
+
+TEST_F(FilterEngineTest, ObserverCanRemoveItselfWhenNotified)
+{
+  auto& filterEngine = GetFilterEngine();
+  int timesCalled = 0;
+  std::unique_ptr<WrappingFilterEventObserver> observer;
+  observer.reset(new WrappingFilterEventObserver(
+      [&timesCalled, &filterEngine, &observer](IFilterEngine::FilterEvent, const Filter&) {
+        timesCalled++;
+        filterEngine.RemoveEventObserver(observer.get());
+      }));
+  filterEngine.AddEventObserver(observer.get());
+  filterEngine.AddFilter(filterEngine.GetFilter("foo"));
+  filterEngine.RemoveFilter(filterEngine.GetFilter("foo"));
+  EXPECT_EQ(1, timesCalled);
+}
+
+TEST_F(FilterEngineTest, AsyncObserverGetsSnapshots)
+{
+  struct SnapshotObserver : IFilterEngine::AsyncEventObserver
+  {
+    void OnFilterEvent(IFilterEngine::FilterEvent event,
+                       const IFilterEngine::FilterInfo& filter) override
+    {
+      if (event == IFilterEngine::FilterEvent::FILTER_ADDED)
+        added.set_value(filter);
+    }
+
+    uint32_t GetSubscriptionEventMask() const override
+    {
+      return 0;
+    }
+
+    std::promise<IFilterEngine::FilterInfo> added;
+  };
+
+  auto& filterEngine = GetFilterEngine();
+  SnapshotObserver observer;
+  auto added = observer.added.get_future();
+  filterEngine.AddAsyncEventObserver(&observer);
+  filterEngine.AddFilter(filterEngine.GetFilter("@@exception"));
+  ASSERT_EQ(std::future_status::ready, added.wait_for(std::chrono::seconds(5)));
+  const auto filter = added.get();
+  EXPECT_EQ("@@exception", filter.text);
+  EXPECT_EQ(Filter::Type::TYPE_EXCEPTION, filter.type);
+  filterEngine.RemoveAsyncEventObserver(&observer);
+}
+
 TEST_F(FilterEngineTest, DocumentAllowlisting)
 {
   auto& filterEngine = GetFilterEngine();
@@ -1154,6 +1532,180 @@ TEST_F(FilterEngineTest, ElementHidingStyleSheetGenerichide)
   EXPECT_EQ(".testcase-generichide-notgeneric {display: none !important;}\n", sheetSpecificOnly);
 }
 
+TEST_F(FilterEngineTest, ElementHidingStyleSheetCacheFollowsFilterChanges)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto genericFilter = filterEngine.GetFilter("##.generic");
+  filterEngine.AddFilter(genericFilter);
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org##.specific"));
+
+  const std::string both =
+      ".generic {display: none !important;}\n.specific {display: none !important;}\n";
+  EXPECT_EQ(both, filterEngine.GetElementHidingStyleSheet("http://example.org/a"));
+  // Same host, served from the cache.
+  EXPECT_EQ(both, filterEngine.GetElementHidingStyleSheet("http://example.org/b"));
+  EXPECT_EQ(both, filterEngine.GetElementHidingStyleSheet("example.org"));
+  EXPECT_EQ(".specific {display: none !important;}\n",
+            filterEngine.GetElementHidingStyleSheet("http://example.org/", true));
+
+  filterEngine.RemoveFilter(genericFilter);
+  EXPECT_EQ(".specific {display: none !important;}\n",
+            filterEngine.GetElementHidingStyleSheet("http://example.org/a"));
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org##.other"));
+  EXPECT_EQ(".specific {display: none !important;}\n.other {display: none !important;}\n",
+            filterEngine.GetElementHidingStyleSheet("http://example.org/a"));
+}
+
+TEST_F(FilterEngineTest, ElementHidingStyleSheetCacheStats)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org##.specific"));
+  auto stats = filterEngine.GetStyleSheetCacheStats();
+  EXPECT_EQ(0u, stats.hits);
+  EXPECT_EQ(0u, stats.misses);
+  EXPECT_EQ(16u, stats.capacity);
+
+  filterEngine.GetElementHidingStyleSheet("http://example.org/a");
+  filterEngine.GetElementHidingStyleSheet("http://example.org/b");
+  filterEngine.GetElementHidingStyleSheet("http://example.org/", true);
+  stats = filterEngine.GetStyleSheetCacheStats();
+  EXPECT_EQ(1u, stats.hits);
+  EXPECT_EQ(2u, stats.misses);
+  EXPECT_EQ(2u, stats.size);
+
+  // Any filter change flushes the cache, the counters are kept.
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org##.other"));
+  stats = filterEngine.GetStyleSheetCacheStats();
+  EXPECT_EQ(0u, stats.size);
+  EXPECT_EQ(1u, stats.hits);
+}
+
+TEST_F(FilterEngineTest, MemoryPressureShrinksCaches)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org##.specific"));
+  filterEngine.AddFilter(filterEngine.GetFilter("adbanner.gif"));
+  for (int i = 0; i < 8; ++i)
+  {
+    const std::string host = "http://host" + std::to_string(i) + ".example.org/";
+    filterEngine.GetElementHidingStyleSheet(host);
+    filterEngine.Matches(host + "adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, host);
+  }
+  EXPECT_EQ(8u, filterEngine.GetStyleSheetCacheStats().size);
+  const size_t matches = filterEngine.GetMatchCacheStats().size;
+  EXPECT_LT(0u, matches);
+
+  platform->NotifyMemoryPressure(MemoryPressureLevel::MODERATE);
+  EXPECT_EQ(4u, filterEngine.GetStyleSheetCacheStats().size);
+  EXPECT_GE(filterEngine.GetMatchCacheStats().capacity / 4,
+            filterEngine.GetMatchCacheStats().size);
+  // The most recently used entry is kept.
+  const size_t hits = filterEngine.GetStyleSheetCacheStats().hits;
+  filterEngine.GetElementHidingStyleSheet("http://host7.example.org/");
+  EXPECT_EQ(hits + 1, filterEngine.GetStyleSheetCacheStats().hits);
+
+  platform->NotifyMemoryPressure(MemoryPressureLevel::CRITICAL);
+  EXPECT_EQ(0u, filterEngine.GetStyleSheetCacheStats().size);
+  EXPECT_EQ(0u, filterEngine.GetMatchCacheStats().size);
+  // Everything still works and the caches fill again.
+  EXPECT_EQ(".specific {display: none !important;}\n",
+            filterEngine.GetElementHidingStyleSheet("http://example.org/"));
+  EXPECT_TRUE(filterEngine
+                  .Matches("http://example.org/adbanner.gif",
+                           IFilterEngine::CONTENT_TYPE_IMAGE,
+                           "http://example.org/")
+                  .IsValid());
+  EXPECT_EQ(1u, filterEngine.GetStyleSheetCacheStats().size);
+}
+
+TEST_F(FilterEngineTest, SpecificContentFollowsFilterDomains)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto library = filterEngine.RegisterSnippetLibrary("(isolated)", "(injected)", {"(list)"});
+  filterEngine.AddFilter(filterEngine.GetFilter("##.generic"));
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org##.specific"));
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org#?#div:-abp-has(.ad)"));
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org#$#log Hello"));
+
+  EXPECT_EQ(".specific {display: none !important;}\n",
+            filterEngine.GetElementHidingStyleSheet("http://www.example.org/", true));
+  EXPECT_EQ(1u, filterEngine.GetElementHidingEmulationSelectors("http://www.example.org/").size());
+  EXPECT_NE("", filterEngine.GetSnippetScript("https://www.example.org/", library));
+  EXPECT_EQ("", filterEngine.GetElementHidingStyleSheet("http://example.com/", true));
+  EXPECT_EQ(".generic {display: none !important;}\n",
+            filterEngine.GetElementHidingStyleSheet("http://example.com/"));
+  EXPECT_TRUE(filterEngine.GetElementHidingEmulationSelectors("http://example.com/").empty());
+  EXPECT_EQ("", filterEngine.GetSnippetScript("https://example.com/", library));
+
+  // Filters for more domains are picked up right away.
+  filterEngine.AddFilter(filterEngine.GetFilter("foo.org,example.com##.added"));
+  filterEngine.AddFilter(filterEngine.GetFilter("example.com#$#log World"));
+  EXPECT_EQ(".added {display: none !important;}\n",
+            filterEngine.GetElementHidingStyleSheet("http://example.com/", true));
+  EXPECT_EQ(".added {display: none !important;}\n",
+            filterEngine.GetElementHidingDomainStyleSheet("foo.org", true));
+  EXPECT_NE(std::string::npos,
+            filterEngine.GetSnippetScript("https://example.com/", library).find("World"));
+  EXPECT_TRUE(filterEngine.GetElementHidingEmulationSelectors("http://example.com/").empty());
+}
+
+TEST_F(FilterEngineTest, ElementHidingGenericAndDomainStyleSheets)
+{
+  auto& filterEngine = GetFilterEngine();
+  uint64_t version = 0;
+  EXPECT_EQ("", filterEngine.GetElementHidingGenericStyleSheet(&version));
+  const uint64_t emptyVersion = version;
+
+  filterEngine.AddFilter(filterEngine.GetFilter("##.generic"));
+  filterEngine.AddFilter(filterEngine.GetFilter("##.excepted"));
+  filterEngine.AddFilter(filterEngine.GetFilter("other.org#@#.excepted"));
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org##.specific"));
+
+  EXPECT_EQ(".generic {display: none !important;}\n",
+            filterEngine.GetElementHidingGenericStyleSheet(&version));
+  EXPECT_NE(emptyVersion, version);
+  EXPECT_EQ(version, filterEngine.GetElementHidingGenericStyleSheetVersion());
+  EXPECT_EQ(".specific {display: none !important;}\n.excepted {display: none !important;}\n",
+            filterEngine.GetElementHidingDomainStyleSheet("http://example.org/"));
+  EXPECT_EQ("", filterEngine.GetElementHidingDomainStyleSheet("http://other.org/"));
+  EXPECT_EQ(".specific {display: none !important;}\n",
+            filterEngine.GetElementHidingDomainStyleSheet("http://example.org/", true));
+
+  // A change which leaves the generic part alone keeps its version.
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org##.other"));
+  EXPECT_EQ(version, filterEngine.GetElementHidingGenericStyleSheetVersion());
+  EXPECT_EQ(".specific {display: none !important;}\n.other {display: none !important;}\n"
+            ".excepted {display: none !important;}\n",
+            filterEngine.GetElementHidingDomainStyleSheet("http://example.org/"));
+
+  filterEngine.AddFilter(filterEngine.GetFilter("##.another"));
+  EXPECT_NE(version, filterEngine.GetElementHidingGenericStyleSheetVersion());
+  EXPECT_EQ(".generic {display: none !important;}\n.another {display: none !important;}\n",
+            filterEngine.GetElementHidingGenericStyleSheet());
+}
+
+TEST_F(FilterEngineTest, SharedStyleSheetsComeFromTheCache)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("##.generic"));
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org##.specific"));
+
+  auto sheet = filterEngine.GetElementHidingStyleSheetShared("http://example.org/a");
+  ASSERT_TRUE(sheet);
+  EXPECT_EQ(filterEngine.GetElementHidingStyleSheet("http://example.org/a"), *sheet);
+  EXPECT_EQ(sheet, filterEngine.GetElementHidingStyleSheetShared("http://example.org/b"));
+  auto generic = filterEngine.GetElementHidingGenericStyleSheetShared();
+  EXPECT_EQ(generic, filterEngine.GetElementHidingGenericStyleSheetShared());
+  auto domain = filterEngine.GetElementHidingDomainStyleSheetShared("http://example.org/");
+  EXPECT_EQ(domain, filterEngine.GetElementHidingDomainStyleSheetShared("http://example.org/"));
+  EXPECT_EQ(".specific {display: none !important;}\n", *domain);
+
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org##.other"));
+  auto updated = filterEngine.GetElementHidingStyleSheetShared("http://example.org/a");
+  EXPECT_NE(sheet, updated);
+  EXPECT_NE(*sheet, *updated) << "the previous result stays intact";
+}
+
 TEST_F(FilterEngineTest, ElementHidingStyleSheetListJustDomain)
 {
   auto& filterEngine = GetFilterEngine();
@@ -1280,6 +1832,27 @@ TEST_F(FilterEngineTest, ElementHidingEmulationSelectorsList)
   ASSERT_EQ(0u, sels3.size());
 }
 
+TEST_F(FilterEngineTest, ElementHidingEmulationSelectorsCacheFollowsFilterChanges)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto filter = filterEngine.GetFilter("example.org#?#div:-abp-has(>img)");
+  filterEngine.AddFilter(filter);
+
+  auto sels = filterEngine.GetElementHidingEmulationSelectorsShared("http://example.org/a");
+  ASSERT_EQ(1u, sels->size());
+  EXPECT_EQ("div:-abp-has(>img)", (*sels)[0].selector);
+  EXPECT_EQ("example.org#?#div:-abp-has(>img)", (*sels)[0].text);
+  EXPECT_EQ(sels, filterEngine.GetElementHidingEmulationSelectorsShared("example.org"));
+
+  filterEngine.AddFilter(filterEngine.GetFilter("example.org#?#span:-abp-contains(Ad)"));
+  ASSERT_EQ(2u, filterEngine.GetElementHidingEmulationSelectors("http://example.org/a").size());
+  filterEngine.RemoveFilter(filter);
+  auto updated = filterEngine.GetElementHidingEmulationSelectors("http://example.org/a");
+  ASSERT_EQ(1u, updated.size());
+  EXPECT_EQ("span:-abp-contains(Ad)", updated[0].selector);
+  EXPECT_EQ(1u, sels->size()) << "the previous result stays intact";
+}
+
 TEST_F(FilterEngineTest, ElementHidingEmulationSelectorsListSingleDomain)
 {
   auto& filterEngine = GetFilterEngine();
@@ -1557,6 +2130,30 @@ TEST_F(FilterEngineTest, ComposeFilterSuggestionsForObjectElement)
   EXPECT_EQ("||test.com/page/data1", res[0]);
 }
 
+TEST_F(FilterEngineTest, ComposeFilterSuggestionsBatch)
+{
+  auto& filterEngine = GetFilterEngine();
+  TestElement byClass(
+      {{"_url", "https://test.com/page"}, {"_name", "img"}, {"class", "-img   _glyph"}});
+  TestElement byUrls({{"_url", "https://test.com/page"},
+                      {"_name", "img"},
+                      {"srcset", "https://www.static.test.com/icon1.png x1, /ui/icon2.png x2"},
+                      {"style", "width:109px;\nheight:40px"}});
+  TestElement nothing({{"_url", "https://test.com/page"}, {"_name", "div"}});
+  TestElement invalidBase({{"_url", ""}, {"_name", "img"}, {"src", "/icon1.png"}});
+
+  auto res =
+      filterEngine.ComposeFilterSuggestionsBatch({&byClass, &byUrls, &nothing, &invalidBase});
+  ASSERT_EQ(4u, res.size());
+  EXPECT_EQ(filterEngine.ComposeFilterSuggestions(&byClass), res[0]);
+  EXPECT_EQ(std::vector<std::string>({"||static.test.com/icon1.png", "||test.com/ui/icon2.png"}),
+            res[1]);
+  EXPECT_TRUE(res[2].empty());
+  EXPECT_TRUE(res[3].empty());
+
+  EXPECT_TRUE(filterEngine.ComposeFilterSuggestionsBatch({}).empty());
+}
+
 TEST_F(FilterEngineTest, ComposeFilterSuggestionsForObjectElementData)
 {
   auto& filterEngine = GetFilterEngine();
@@ -1628,6 +2225,730 @@ TEST_F(FilterEngineWithInMemoryFS, DisableSubscriptionsAutoSelectOnFirstRun)
   EXPECT_FALSE(filterEngine.IsAAEnabled());
 }
 
+TEST_F(FilterEngineWithInMemoryFS, CodeCacheIsPersisted)
+{
+  FilterEngineFactory::CreationParameters createParams;
+  createParams.preconfiguredPrefs.booleanPrefs.emplace(
+      FilterEngineFactory::BooleanPrefName::FirstRunSubscriptionAutoselect, false);
+  auto readCodeCache = [this]() {
+    IFileSystem::IOBuffer data;
+    platform->GetFileSystem().Read(
+        "v8codecache.bin",
+        [&data](IFileSystem::IOBuffer&& content) { data = std::move(content); },
+        [](const std::string&) {});
+    return data;
+  };
+
+  {
+    PlatformFactory::CreationParameters params;
+    params.persistentCodeCache = true;
+    InitPlatformAndAppInfo(std::move(params));
+  }
+  CreateFilterEngine(createParams);
+  const auto data = readCodeCache();
+  JsEngine::CodeCache codeCache;
+  ASSERT_TRUE(JsEngine::DeserializeCodeCache(data, &codeCache));
+  EXPECT_EQ(1u, codeCache.count("api.js"));
+  EXPECT_TRUE(GetJsEngine().GetCodeCache().empty()) << "the entries are dropped after loading";
+
+  // The next start consumes the stored entries and leaves the file alone.
+  {
+    PlatformFactory::CreationParameters params;
+    params.persistentCodeCache = true;
+    auto fileSystem = std::make_unique<InMemoryFileSystem>();
+    fileSystem->Write("v8codecache.bin", data, [](const std::string&) {});
+    params.fileSystem = std::move(fileSystem);
+    InitPlatformAndAppInfo(std::move(params));
+  }
+  CreateFilterEngine(createParams);
+  EXPECT_EQ(data, readCodeCache());
+  EXPECT_TRUE(GetJsEngine().GetCodeCache().empty());
+}
+
+TEST_F(FilterEngineWithInMemoryFS, BatchingObserverGetsRunsOfEvents)
+{
+  struct BatchingObserver : IFilterEngine::EventObserver
+  {
+    void OnFilterEvent(IFilterEngine::FilterEvent, const Filter&) override
+    {
+      ++singleEvents;
+    }
+
+    void OnFilterEvents(IFilterEngine::FilterEvent event,
+                        const std::vector<Filter>& filters) override
+    {
+      std::vector<std::string> texts;
+      for (const auto& filter : filters)
+        texts.push_back(filter.GetRaw());
+      batches.emplace_back(event, texts);
+    }
+
+    bool IsBatching() const override
+    {
+      return true;
+    }
+
+    uint32_t GetFilterEventMask() const override
+    {
+      return EventMask(IFilterEngine::FilterEvent::FILTER_ADDED) |
+             EventMask(IFilterEngine::FilterEvent::FILTER_REMOVED);
+    }
+
+    int singleEvents = 0;
+    std::vector<std::pair<IFilterEngine::FilterEvent, std::vector<std::string>>> batches;
+  };
+
+  DelayedTimer::SharedTasks timerTasks;
+  {
+    PlatformFactory::CreationParameters params;
+    params.timer = DelayedTimer::New(timerTasks);
+    InitPlatformAndAppInfo(std::move(params));
+  }
+  auto& filterEngine = CreateFilterEngine();
+  BatchingObserver observer;
+  filterEngine.AddEventObserver(&observer);
+  filterEngine.AddFilter(filterEngine.GetFilter("foo"));
+  filterEngine.AddFilter(filterEngine.GetFilter("bar"));
+  filterEngine.RemoveFilter(filterEngine.GetFilter("foo"));
+  EXPECT_TRUE(observer.batches.empty());
+
+  DelayedTimer::ProcessImmediateTimers(timerTasks);
+  EXPECT_EQ(0, observer.singleEvents);
+  ASSERT_EQ(2u, observer.batches.size());
+  EXPECT_EQ(IFilterEngine::FilterEvent::FILTER_ADDED, observer.batches[0].first);
+  EXPECT_EQ(std::vector<std::string>({"foo", "bar"}), observer.batches[0].second);
+  EXPECT_EQ(IFilterEngine::FilterEvent::FILTER_REMOVED, observer.batches[1].first);
+  EXPECT_EQ(std::vector<std::string>({"foo"}), observer.batches[1].second);
+
+  filterEngine.AddFilter(filterEngine.GetFilter("baz"));
+  filterEngine.RemoveEventObserver(&observer);
+  DelayedTimer::ProcessImmediateTimers(timerTasks);
+  EXPECT_EQ(2u, observer.batches.size()) << "pending events are dropped";
+}
+
+TEST_F(FilterEngineWithInMemoryFS, PrefsAreSavedAfterTheDelay)
+{
+  struct CountingFileSystem : InMemoryFileSystem
+  {
+    explicit CountingFileSystem(int* prefsWrites) : prefsWrites(prefsWrites)
+    {
+    }
+
+    void Write(const std::string& fileName,
+               const IOBuffer& data,
+               const Callback& callback) override
+    {
+      if (fileName == "prefs.json")
+        ++*prefsWrites;
+      InMemoryFileSystem::Write(fileName, data, callback);
+    }
+
+    int* prefsWrites;
+  };
+
+  DelayedTimer::SharedTasks timerTasks;
+  int prefsWrites = 0;
+  {
+    PlatformFactory::CreationParameters params;
+    params.timer = DelayedTimer::New(timerTasks);
+    params.fileSystem.reset(new CountingFileSystem(&prefsWrites));
+    InitPlatformAndAppInfo(std::move(params));
+  }
+  FilterEngineFactory::CreationParameters createParams;
+  createParams.prefsSaveDelay = std::chrono::milliseconds(500);
+  CreateFilterEngine(createParams);
+  DelayedTimer::ProcessImmediateTimers(timerTasks);
+  const int initialWrites = prefsWrites;
+
+  auto& jsEngine = GetJsEngine();
+  jsEngine.Evaluate("require('prefs').Prefs.savestats = true");
+  jsEngine.Evaluate("require('prefs').Prefs.patternsbackups = 3");
+  jsEngine.Evaluate("require('prefs').Prefs.patternsbackups = 7");
+  EXPECT_EQ(initialWrites, prefsWrites);
+
+  auto saveTimer = std::find_if(
+      timerTasks->begin(), timerTasks->end(), [](const DelayedTimerTask& task) {
+        return task.timeout == std::chrono::milliseconds(500);
+      });
+  ASSERT_NE(timerTasks->end(), saveTimer);
+  auto callback = saveTimer->callback;
+  timerTasks->erase(saveTimer);
+  callback();
+  EXPECT_EQ(initialWrites + 1, prefsWrites) << "the changes are saved at once";
+
+  jsEngine.Evaluate("require('prefs').Prefs.patternsbackups = 9");
+  EXPECT_EQ(initialWrites + 1, prefsWrites);
+  platform.reset();
+  EXPECT_EQ(initialWrites + 2, prefsWrites) << "pending changes are saved on shutdown";
+}
+
+TEST_F(FilterEngineWithInMemoryFS, MatchCache)
+{
+  InitPlatformAndAppInfo();
+  FilterEngineFactory::CreationParameters createParams;
+  createParams.preconfiguredPrefs.booleanPrefs.emplace(
+      FilterEngineFactory::BooleanPrefName::FirstRunSubscriptionAutoselect, false);
+  createParams.matchCacheSize = 2;
+  auto& filterEngine = CreateFilterEngine(createParams);
+  auto stats = filterEngine.GetMatchCacheStats();
+  EXPECT_EQ(0u, stats.hits);
+  EXPECT_EQ(0u, stats.misses);
+  EXPECT_EQ(0u, stats.size);
+  EXPECT_EQ(2u, stats.capacity);
+
+  auto filter = filterEngine.GetFilter("adbanner.gif");
+  filterEngine.AddFilter(filter);
+  const std::string url = "http://example.org/adbanner.gif";
+  EXPECT_EQ(filter, filterEngine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, ""));
+  EXPECT_EQ(filter, filterEngine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, ""));
+  // Only the host of the document is relevant.
+  EXPECT_EQ(filter,
+            filterEngine.Matches(
+                url, IFilterEngine::CONTENT_TYPE_IMAGE, "http://example.com/a", "", false));
+  EXPECT_EQ(filter,
+            filterEngine.Matches(
+                url, IFilterEngine::CONTENT_TYPE_IMAGE, "http://example.com/b", "", false));
+  EXPECT_FALSE(
+      filterEngine.Matches(url, IFilterEngine::CONTENT_TYPE_OTHER, "http://example.com/", "", true)
+          .IsValid());
+  stats = filterEngine.GetMatchCacheStats();
+  EXPECT_EQ(2u, stats.hits);
+  EXPECT_EQ(3u, stats.misses);
+  EXPECT_EQ(2u, stats.size);
+
+  // Any filter change flushes the cache.
+  filterEngine.RemoveFilter(filter);
+  EXPECT_EQ(0u, filterEngine.GetMatchCacheStats().size);
+  EXPECT_FALSE(filterEngine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, "").IsValid());
+  EXPECT_EQ(4u, filterEngine.GetMatchCacheStats().misses);
+}
+
+TEST_F(FilterEngineWithInMemoryFS, TryGetFilterEngineDoesNotCreateIt)
+{
+  InitPlatformAndAppInfo();
+  EXPECT_EQ(nullptr, platform->TryGetFilterEngine());
+  auto& filterEngine = CreateFilterEngine();
+  EXPECT_EQ(&filterEngine, platform->TryGetFilterEngine());
+}
+
+TEST_F(FilterEngineWithInMemoryFS, BackgroundInitialization)
+{
+  PlatformFactory::CreationParameters platformParams;
+  platformParams.logSystem.reset(new DefaultLogSystem());
+  platformParams.timer.reset(new NoopTimer());
+  platformParams.fileSystem.reset(new InMemoryFileSystem());
+  platformParams.webRequest.reset(new NoopWebRequest());
+  platformParams.resourceReader.reset(new DefaultResourceReader());
+  platformParams.backgroundInitialization = true;
+  platformParams.filterEngineParameters.preconfiguredPrefs.booleanPrefs.emplace(
+      FilterEngineFactory::BooleanPrefName::FirstRunSubscriptionAutoselect, false);
+  platform = PlatformFactory::CreatePlatform(std::move(platformParams));
+
+  std::promise<const IFilterEngine*> ready;
+  platform->AddFilterEngineReadyCallback(
+      [&ready](const IFilterEngine& filterEngine) { ready.set_value(&filterEngine); });
+  const IFilterEngine* filterEngine = ready.get_future().get();
+  EXPECT_EQ(filterEngine, platform->TryGetFilterEngine());
+  EXPECT_EQ(filterEngine, &platform->GetFilterEngine());
+
+  // Once it is ready, callbacks are called right away.
+  const IFilterEngine* readyEngine = nullptr;
+  platform->AddFilterEngineReadyCallback(
+      [&readyEngine](const IFilterEngine& engine) { readyEngine = &engine; });
+  EXPECT_EQ(filterEngine, readyEngine);
+}
+
+TEST_F(FilterEngineWithInMemoryFS, LowMemoryProfileCapsHeapAndCaches)
+{
+  PlatformFactory::CreationParameters platformParams;
+  platformParams.memoryProfile = MemoryProfile::LOW_MEMORY;
+  InitPlatformAndAppInfo(std::move(platformParams));
+  EXPECT_LE(GetJsEngine().GetHeapStatistics().heapSizeLimit, 192u * 1024 * 1024);
+
+  FilterEngineFactory::CreationParameters createParams;
+  createParams.preconfiguredPrefs.booleanPrefs.emplace(
+      FilterEngineFactory::BooleanPrefName::FirstRunSubscriptionAutoselect, false);
+  createParams.matchCacheSize = 1000;
+  auto& filterEngine = CreateFilterEngine(createParams);
+  EXPECT_EQ(64u, filterEngine.GetMatchCacheStats().capacity);
+  EXPECT_EQ(2u, filterEngine.GetStyleSheetCacheStats().capacity);
+
+  auto filter = filterEngine.GetFilter("adbanner.gif");
+  filterEngine.AddFilter(filter);
+  EXPECT_EQ(filter,
+            filterEngine.Matches(
+                "http://example.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, ""));
+}
+
+TEST_F(FilterEngineTest, FilterHitsAreCountedWhileStatsAreSaved)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto& jsEngine = GetJsEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("adbanner.gif"));
+  const std::string hitCount =
+      "(() => { let {filterState} = require('filterState');"
+      "  return typeof filterState.getHitCount == 'function' ?"
+      "    filterState.getHitCount('adbanner.gif') :"
+      "    require('filterClasses').Filter.fromText('adbanner.gif').hitCount; })()";
+
+  filterEngine.Matches("http://example.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  filterEngine.FlushFilterHits();
+  EXPECT_EQ(0, jsEngine.Evaluate(hitCount).AsInt());
+
+  jsEngine.Evaluate("require('prefs').Prefs.savestats = true");
+  filterEngine.Matches("http://example.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  filterEngine.GetMatchResult(
+      "http://example.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  filterEngine.Matches("http://example.org/other.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  EXPECT_EQ(0, jsEngine.Evaluate(hitCount).AsInt()) << "the hits are added in batches";
+  filterEngine.FlushFilterHits();
+  EXPECT_EQ(2, jsEngine.Evaluate(hitCount).AsInt());
+}
+
+TEST_F(FilterEngineTest, MatchCacheIsDisabledByDefault)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("adbanner.gif"));
+  filterEngine.Matches(
+      "http://example.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  auto stats = filterEngine.GetMatchCacheStats();
+  EXPECT_EQ(0u, stats.hits);
+  EXPECT_EQ(0u, stats.misses);
+  EXPECT_EQ(0u, stats.capacity);
+}
+
+TEST_F(FilterEngineTest, PerformanceStatsCountOuterCalls)
+{
+  auto& filterEngine = GetFilterEngine();
+  EXPECT_TRUE(filterEngine.GetPerformanceStats().empty());
+  filterEngine.AddFilter(filterEngine.GetFilter("adbanner.gif"));
+  filterEngine.Matches("http://example.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  filterEngine.Matches("http://example.org/other.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  filterEngine.GetElementHidingDomainStyleSheet("example.org", true);
+
+  auto stats = filterEngine.GetPerformanceStats();
+  ASSERT_EQ(1u, stats.count("Matches"));
+  EXPECT_EQ(2u, stats["Matches"].calls);
+  EXPECT_EQ(2u, stats["Matches"].execution.GetCount());
+  EXPECT_EQ(2u, stats["Matches"].lockWait.GetCount());
+  EXPECT_EQ(1u, stats["GetElementHidingDomainStyleSheet"].calls);
+  EXPECT_EQ(0u, stats.count("GetElementHidingStyleSheet")) << "nested call";
+  EXPECT_EQ(0u, stats.count("GetSnippetScript"));
+}
+
+TEST(LatencyHistogramTest, Percentiles)
+{
+  IFilterEngine::LatencyHistogram histogram{};
+  EXPECT_EQ(0u, histogram.GetPercentile(50));
+  histogram.buckets[0] = 2;
+  histogram.buckets[4] = 7;
+  histogram.buckets[10] = 1;
+  histogram.maxMicroseconds = 700;
+  EXPECT_EQ(10u, histogram.GetCount());
+  EXPECT_EQ(1u, histogram.GetPercentile(10));
+  EXPECT_EQ(16u, histogram.GetPercentile(50));
+  EXPECT_EQ(16u, histogram.GetPercentile(90));
+  EXPECT_EQ(700u, histogram.GetPercentile(99)) << "bounded by the maximum";
+  EXPECT_EQ(700u, histogram.GetPercentile(100));
+}
+
+TEST_F(FilterEngineWithInMemoryFS, AllowlistingFrameChainWithMatchCache)
+{
+  InitPlatformAndAppInfo();
+  FilterEngineFactory::CreationParameters createParams;
+  createParams.preconfiguredPrefs.booleanPrefs.emplace(
+      FilterEngineFactory::BooleanPrefName::FirstRunSubscriptionAutoselect, false);
+  createParams.matchCacheSize = 16;
+  auto& filterEngine = CreateFilterEngine(createParams);
+  // The first one is matched natively, the second one needs JS.
+  filterEngine.AddFilter(filterEngine.GetFilter("@@||native.com^$document"));
+  filterEngine.AddFilter(filterEngine.GetFilter("@@||thirdparty.com^$document,third-party"));
+
+  const std::vector<std::string> nativeChain = {
+      "http://a.org/", "http://b.org/", "http://native.com/", "http://top.org/"};
+  const std::vector<std::string> jsChain = {
+      "http://a.org/", "http://b.org/", "http://thirdparty.com/", "http://top.org/"};
+  const std::vector<std::string> noMatchChain = {"http://a.org/", "", "http://top.org/"};
+  size_t misses = 0;
+  for (int i = 0; i < 2; ++i)
+  {
+    misses = filterEngine.GetMatchCacheStats().misses;
+    EXPECT_TRUE(filterEngine.IsContentAllowlisted(
+        "http://ads.org/", IFilterEngine::CONTENT_TYPE_DOCUMENT, nativeChain));
+    EXPECT_TRUE(filterEngine.IsContentAllowlisted(
+        "http://ads.org/", IFilterEngine::CONTENT_TYPE_DOCUMENT, jsChain));
+    EXPECT_FALSE(filterEngine.IsContentAllowlisted(
+        "http://ads.org/", IFilterEngine::CONTENT_TYPE_DOCUMENT, noMatchChain));
+    EXPECT_FALSE(filterEngine.IsContentAllowlisted(
+        "http://ads.org/", IFilterEngine::CONTENT_TYPE_ELEMHIDE, jsChain));
+  }
+  // The second round is answered by the cache only, including the frames
+  // which were checked in JS.
+  auto stats = filterEngine.GetMatchCacheStats();
+  EXPECT_EQ(misses, stats.misses);
+  EXPECT_EQ(stats.misses, stats.size);
+
+  // The top-level frame is its own parent, so it isn't third-party.
+  EXPECT_FALSE(filterEngine.IsContentAllowlisted(
+      "http://ads.org/", IFilterEngine::CONTENT_TYPE_DOCUMENT, {"http://thirdparty.com/"}));
+}
+
+TEST_F(FilterEngineTest, GetMatchResult)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("adbanner.gif"));
+  filterEngine.AddFilter(filterEngine.GetFilter("notbanner.gif"));
+  filterEngine.AddFilter(filterEngine.GetFilter("@@notbanner.gif"));
+  filterEngine.AddFilter(filterEngine.GetFilter("/regex\\d+banner/"));
+
+  auto result = filterEngine.GetMatchResult(
+      "http://example.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  EXPECT_TRUE(result.IsMatched());
+  EXPECT_EQ(IFilterEngine::MatchResult::BLOCKED, result.decision);
+  EXPECT_EQ(Filter::Type::TYPE_BLOCKING, result.type);
+  ASSERT_TRUE(result.filterText);
+  EXPECT_EQ("adbanner.gif", *result.filterText);
+  EXPECT_EQ(filterEngine.Matches(
+                "http://example.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, ""),
+            filterEngine.GetFilter(*result.filterText));
+
+  result = filterEngine.GetMatchResult(
+      "http://example.org/notbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  EXPECT_EQ(IFilterEngine::MatchResult::ALLOWLISTED, result.decision);
+  EXPECT_EQ(Filter::Type::TYPE_EXCEPTION, result.type);
+  ASSERT_TRUE(result.filterText);
+  EXPECT_EQ("@@notbanner.gif", *result.filterText);
+
+  result = filterEngine.GetMatchResult(
+      "http://example.org/regex42banner", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  EXPECT_EQ(IFilterEngine::MatchResult::BLOCKED, result.decision);
+  ASSERT_TRUE(result.filterText);
+  EXPECT_EQ("/regex\\d+banner/", *result.filterText);
+
+  result = filterEngine.GetMatchResult(
+      "http://example.org/foobar.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  EXPECT_FALSE(result.IsMatched());
+  EXPECT_EQ(Filter::Type::TYPE_INVALID, result.type);
+  EXPECT_FALSE(result.filterText);
+
+  EXPECT_FALSE(
+      filterEngine.GetMatchResult("", IFilterEngine::CONTENT_TYPE_IMAGE, "").IsMatched());
+}
+
+TEST_F(FilterEngineTest, CheckPopup)
+{
+  typedef IFilterEngine::PopupBlockResult PopupBlockResult;
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("||popup.com^$popup"));
+  filterEngine.AddFilter(filterEngine.GetFilter("@@||popup.com/allowed^$popup"));
+  filterEngine.AddFilter(filterEngine.GetFilter("||banner.com^"));
+  filterEngine.AddFilter(filterEngine.GetFilter("@@||allowed.org^$document"));
+
+  const std::vector<std::string> opener{"http://example.org/"};
+  EXPECT_EQ(PopupBlockResult::BLOCK_RULE, filterEngine.CheckPopup("http://popup.com/", opener));
+  EXPECT_EQ(PopupBlockResult::ALLOW_RULE,
+            filterEngine.CheckPopup("http://popup.com/allowed/", opener));
+  EXPECT_EQ(PopupBlockResult::NO_RULE, filterEngine.CheckPopup("http://banner.com/", opener))
+      << "only $popup filters apply";
+  EXPECT_EQ(PopupBlockResult::NO_RULE, filterEngine.CheckPopup("", opener));
+
+  auto frame = filterEngine.CreateFrameContext({"http://www.allowed.org/", "http://example.org/"});
+  EXPECT_EQ(PopupBlockResult::DISABLED, filterEngine.CheckPopup("http://popup.com/", *frame));
+  EXPECT_EQ(PopupBlockResult::DISABLED,
+            filterEngine.CheckPopup("http://popup.com/", {"http://allowed.org/"}));
+  EXPECT_EQ(6u, filterEngine.GetPerformanceStats().at("CheckPopup").calls);
+  EXPECT_EQ(0u, filterEngine.GetPerformanceStats().at("GetMatchResult").calls);
+}
+
+TEST_F(FilterEngineTest, MatchesWithFrameContext)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("adbanner.gif"));
+  filterEngine.AddFilter(filterEngine.GetFilter("specificbanner.gif$domain=example.com"));
+  filterEngine.AddFilter(filterEngine.GetFilter("@@||allowlisted.org^$document"));
+  filterEngine.AddFilter(filterEngine.GetFilter("@@||example.com^$genericblock"));
+
+  auto topLevel = filterEngine.CreateFrameContext({});
+  EXPECT_TRUE(topLevel->GetDocumentUrls().empty());
+  EXPECT_EQ("adbanner.gif",
+            filterEngine
+                .Matches(
+                    "http://ads.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, *topLevel)
+                .GetRaw());
+
+  auto allowlisted = filterEngine.CreateFrameContext({"http://allowlisted.org/"});
+  auto filter = filterEngine.Matches(
+      "http://ads.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, *allowlisted);
+  EXPECT_EQ("@@||allowlisted.org^$document", filter.GetRaw());
+  auto result = filterEngine.GetMatchResult(
+      "http://ads.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, *allowlisted);
+  EXPECT_EQ(IFilterEngine::MatchResult::ALLOWLISTED, result.decision);
+
+  auto genericblock =
+      filterEngine.CreateFrameContext({"http://example.com/frame.html", "http://example.com/"});
+  EXPECT_FALSE(filterEngine
+                   .Matches("http://ads.org/adbanner.gif",
+                            IFilterEngine::CONTENT_TYPE_IMAGE,
+                            *genericblock)
+                   .IsValid());
+  result = filterEngine.GetMatchResult(
+      "http://ads.org/specificbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, *genericblock);
+  EXPECT_EQ(IFilterEngine::MatchResult::BLOCKED, result.decision);
+
+  // The allowlisting of the frame is looked up again once filters change.
+  filterEngine.RemoveFilter(filterEngine.GetFilter("@@||allowlisted.org^$document"));
+  EXPECT_EQ("adbanner.gif",
+            filterEngine
+                .Matches("http://ads.org/adbanner.gif",
+                         IFilterEngine::CONTENT_TYPE_IMAGE,
+                         *allowlisted)
+                .GetRaw());
+}
+
+TEST_F(FilterEngineTest, AsyncCalls)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("adbanner.gif"));
+  filterEngine.AddFilter(filterEngine.GetFilter("@@||example.org^$document"));
+  filterEngine.AddFilter(filterEngine.GetFilter("example.com###ad"));
+
+  // Keep the thread of the engine busy, so that the calls below are queued.
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  filterEngine.GetElementHidingStyleSheetAsync(
+      "http://busy.org/", false, [released](const std::shared_ptr<const std::string>&) {
+        released.wait();
+      });
+
+  const IFilterEngine::MatchRequest request{
+      "http://ads.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "", "", false};
+  std::promise<IFilterEngine::MatchResult> firstMatch;
+  std::promise<IFilterEngine::MatchResult> secondMatch;
+  filterEngine.MatchesAsync(request, [&firstMatch](const IFilterEngine::MatchResult& result) {
+    firstMatch.set_value(result);
+  });
+  filterEngine.MatchesAsync(request, [&secondMatch](const IFilterEngine::MatchResult& result) {
+    secondMatch.set_value(result);
+  });
+  std::promise<bool> allowlisted;
+  filterEngine.IsContentAllowlistedAsync(
+      "http://example.org/",
+      IFilterEngine::CONTENT_TYPE_DOCUMENT,
+      {"http://example.org/"},
+      "",
+      [&allowlisted](bool value) { allowlisted.set_value(value); });
+  std::promise<std::string> styleSheet;
+  filterEngine.GetElementHidingStyleSheetAsync(
+      "http://example.com/page",
+      false,
+      [&styleSheet](const std::shared_ptr<const std::string>& css) { styleSheet.set_value(*css); });
+  release.set_value();
+
+  auto result = firstMatch.get_future().get();
+  EXPECT_EQ(IFilterEngine::MatchResult::BLOCKED, result.decision);
+  ASSERT_TRUE(result.filterText);
+  EXPECT_EQ("adbanner.gif", *result.filterText);
+  EXPECT_EQ(result.filterText, secondMatch.get_future().get().filterText);
+  EXPECT_TRUE(allowlisted.get_future().get());
+  EXPECT_NE(std::string::npos, styleSheet.get_future().get().find("#ad"));
+  EXPECT_EQ(1u, filterEngine.GetPerformanceStats().at("GetMatchResult").calls)
+      << "equal queued requests are matched once";
+}
+
+TEST_F(FilterEngineTest, PrepareForDocumentFillsTheCaches)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("example.com###ad"));
+  filterEngine.AddFilter(filterEngine.GetFilter("@@||allowed.org^$document"));
+
+  auto frame = filterEngine.PrepareForDocument("http://example.com/page");
+  auto allowlistedFrame = filterEngine.PrepareForDocument("http://allowed.org/");
+  // The calls are executed in order, so this one completes last.
+  std::promise<bool> done;
+  filterEngine.IsContentAllowlistedAsync("http://example.com/",
+                                         IFilterEngine::CONTENT_TYPE_DOCUMENT,
+                                         {"http://example.com/"},
+                                         "",
+                                         [&done](bool value) { done.set_value(value); });
+  EXPECT_FALSE(done.get_future().get());
+  EXPECT_EQ(1u, filterEngine.GetPerformanceStats().at("GetElementHidingStyleSheet").calls)
+      << "allowlisted documents are not prepared";
+
+  const auto stats = filterEngine.GetStyleSheetCacheStats();
+  EXPECT_NE(std::string::npos,
+            filterEngine.GetElementHidingStyleSheet("http://example.com/other").find("#ad"));
+  EXPECT_EQ(stats.hits + 1, filterEngine.GetStyleSheetCacheStats().hits);
+  EXPECT_EQ(stats.misses, filterEngine.GetStyleSheetCacheStats().misses);
+
+  EXPECT_FALSE(filterEngine
+                   .GetMatchResult("http://example.com/ad.png",
+                                   IFilterEngine::CONTENT_TYPE_IMAGE,
+                                   *frame)
+                   .IsMatched());
+  EXPECT_EQ(IFilterEngine::MatchResult::ALLOWLISTED,
+            filterEngine
+                .GetMatchResult("http://allowed.org/ad.png",
+                                IFilterEngine::CONTENT_TYPE_IMAGE,
+                                *allowlistedFrame)
+                .decision);
+}
+
+TEST_F(FilterEngineTest, DeclarativeNetRequestRules)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("||example.com^$image"));
+  filterEngine.AddFilter(filterEngine.GetFilter("@@||example.com/allowed^$domain=foo.com"));
+  filterEngine.AddFilter(filterEngine.GetFilter("/ads\\d+/"));
+
+  const std::string blocking = "{\"id\":2,\"priority\":1,\"action\":{\"type\":\"block\"},"
+                               "\"condition\":{\"isUrlFilterCaseSensitive\":false,"
+                               "\"urlFilter\":\"||example.com^\",\"resourceTypes\":[\"image\"]}}";
+  const std::string allowing = "{\"id\":1,\"priority\":2,\"action\":{\"type\":\"allow\"},"
+                               "\"condition\":{\"isUrlFilterCaseSensitive\":false,"
+                               "\"urlFilter\":\"||example.com/allowed^\","
+                               "\"initiatorDomains\":[\"foo.com\"]}}";
+  const std::string rules = filterEngine.GetDeclarativeNetRequestRules();
+  EXPECT_EQ("[" + allowing + "," + blocking + "]", rules);
+  EXPECT_EQ(rules, filterEngine.GetDeclarativeNetRequestRules());
+
+  // The remaining filters keep their IDs, new ones get unused ones.
+  filterEngine.RemoveFilter(filterEngine.GetFilter("@@||example.com/allowed^$domain=foo.com"));
+  filterEngine.AddFilter(filterEngine.GetFilter("||example.org^$script"));
+  EXPECT_EQ("[" + blocking +
+                ",{\"id\":3,\"priority\":1,\"action\":{\"type\":\"block\"},"
+                "\"condition\":{\"isUrlFilterCaseSensitive\":false,"
+                "\"urlFilter\":\"||example.org^\",\"resourceTypes\":[\"script\"]}}]",
+            filterEngine.GetDeclarativeNetRequestRules());
+}
+
+TEST_F(FilterEngineTest, ConcurrentMatchResults)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.AddFilter(filterEngine.GetFilter("adbanner.gif"));
+  filterEngine.AddFilter(filterEngine.GetFilter("@@notbanner.gif"));
+  // Warm up the snapshot of the native matcher.
+  filterEngine.GetMatchResult("http://example.org/", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+
+  std::vector<std::thread> threads;
+  std::vector<int> failures(4);
+  for (size_t i = 0; i < failures.size(); ++i)
+  {
+    threads.emplace_back([&filterEngine, &failures, i]() {
+      for (int j = 0; j < 500; ++j)
+      {
+        auto blocked = filterEngine.GetMatchResult(
+            "http://example.org/adbanner.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+        auto notMatched = filterEngine.GetMatchResult(
+            "http://example.org/foo.gif", IFilterEngine::CONTENT_TYPE_IMAGE, "");
+        if (blocked.decision != IFilterEngine::MatchResult::BLOCKED || notMatched.IsMatched())
+          ++failures[i];
+      }
+    });
+  }
+  // Filter changes while the threads are running replace the snapshot.
+  auto filter = filterEngine.GetFilter("||changing.org^");
+  for (int j = 0; j < 20; ++j)
+  {
+    filterEngine.AddFilter(filter);
+    filterEngine.RemoveFilter(filter);
+  }
+  for (auto& thread : threads)
+    thread.join();
+  for (int count : failures)
+    EXPECT_EQ(0, count);
+  EXPECT_FALSE(
+      filterEngine.GetMatchResult("http://changing.org/", IFilterEngine::CONTENT_TYPE_IMAGE, "")
+          .IsMatched());
+}
+
+TEST_F(FilterEngineWithInMemoryFS, MatchResultsShareTheMatchCache)
+{
+  InitPlatformAndAppInfo();
+  FilterEngineFactory::CreationParameters createParams;
+  createParams.preconfiguredPrefs.booleanPrefs.emplace(
+      FilterEngineFactory::BooleanPrefName::FirstRunSubscriptionAutoselect, false);
+  createParams.matchCacheSize = 4;
+  auto& filterEngine = CreateFilterEngine(createParams);
+  filterEngine.AddFilter(filterEngine.GetFilter("adbanner.gif"));
+
+  const std::string url = "http://example.org/adbanner.gif";
+  auto result = filterEngine.GetMatchResult(url, IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  EXPECT_EQ(IFilterEngine::MatchResult::BLOCKED, result.decision);
+  auto filter = filterEngine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  EXPECT_EQ("adbanner.gif", filter.GetRaw());
+  result = filterEngine.GetMatchResult(url, IFilterEngine::CONTENT_TYPE_IMAGE, "");
+  EXPECT_EQ(IFilterEngine::MatchResult::BLOCKED, result.decision);
+  auto stats = filterEngine.GetMatchCacheStats();
+  EXPECT_EQ(2u, stats.hits);
+  EXPECT_EQ(1u, stats.misses);
+}
+
+TEST_F(FilterEngineWithInMemoryFS, ThreadMatchCacheIsInvalidatedByFilterChanges)
+{
+  InitPlatformAndAppInfo();
+  FilterEngineFactory::CreationParameters createParams;
+  createParams.preconfiguredPrefs.booleanPrefs.emplace(
+      FilterEngineFactory::BooleanPrefName::FirstRunSubscriptionAutoselect, false);
+  createParams.matchCacheSize = 4;
+  auto& filterEngine = CreateFilterEngine(createParams);
+  auto filter = filterEngine.GetFilter("adbanner.gif");
+  filterEngine.AddFilter(filter);
+
+  const std::string url = "http://example.org/adbanner.gif";
+  for (int i = 0; i < 2; i++)
+  {
+    EXPECT_EQ(IFilterEngine::MatchResult::BLOCKED,
+              filterEngine.GetMatchResult(url, IFilterEngine::CONTENT_TYPE_IMAGE, "").decision);
+  }
+  EXPECT_EQ(1u, filterEngine.GetMatchCacheStats().hits);
+
+  // Another thread starts with an empty cache of its own.
+  std::thread([&filterEngine, &url] {
+    EXPECT_EQ(IFilterEngine::MatchResult::BLOCKED,
+              filterEngine.GetMatchResult(url, IFilterEngine::CONTENT_TYPE_IMAGE, "").decision);
+  }).join();
+  EXPECT_EQ(2u, filterEngine.GetMatchCacheStats().hits);
+
+  filterEngine.RemoveFilter(filter);
+  EXPECT_EQ(IFilterEngine::MatchResult::NO_MATCH,
+            filterEngine.GetMatchResult(url, IFilterEngine::CONTENT_TYPE_IMAGE, "").decision);
+}
+
+TEST_F(FilterEngineWithInMemoryFS, CompactStyleSheets)
+{
+  InitPlatformAndAppInfo();
+  FilterEngineFactory::CreationParameters createParams;
+  createParams.preconfiguredPrefs.booleanPrefs.emplace(
+      FilterEngineFactory::BooleanPrefName::FirstRunSubscriptionAutoselect, false);
+  createParams.compactStyleSheets = true;
+  auto& filterEngine = CreateFilterEngine(createParams);
+  for (const char* text : {"##.ad",
+                           "example.org##div.ad",
+                           "example.org###dup",
+                           "~foo.example.org,example.org###dup",
+                           "example.org##.box > .ad",
+                           "example.org##.x"})
+    filterEngine.AddFilter(filterEngine.GetFilter(text));
+
+  const std::string sheet =
+      ".ad{display:none!important}#dup{display:none!important}.x{display:none!important}";
+  EXPECT_EQ(sheet, filterEngine.GetElementHidingStyleSheet("http://example.org"));
+  const std::string domainSheet = "#dup{display:none!important}.x{display:none!important}";
+  EXPECT_EQ(domainSheet, filterEngine.GetElementHidingDomainStyleSheet("http://example.org"))
+      << "the generic style sheet covers div.ad";
+  const std::string genericSheet = ".ad{display:none!important}";
+  EXPECT_EQ(genericSheet, filterEngine.GetElementHidingGenericStyleSheet());
+
+  // The regular form has a rule of 29 more bytes for every listed selector.
+  const size_t regularSize = std::string(".ad" "div.ad" "#dup" "#dup" ".box > .ad" ".x").size() +
+                             std::string("div.ad" "#dup" "#dup" ".box > .ad" ".x").size() +
+                             std::string(".ad").size() + (6 + 5 + 1) * 29;
+  const auto stats = filterEngine.GetCompactStyleSheetStats();
+  EXPECT_EQ(3u, stats.styleSheetCount);
+  EXPECT_EQ(sheet.size() + domainSheet.size() + genericSheet.size(), stats.size);
+  EXPECT_EQ(regularSize - stats.size, stats.savedSize);
+}
+
 namespace AA_ApiTest
 {
   const std::string kOtherSubscriptionUrl = "https://non-existing-subscription.txt";
@@ -2033,6 +3354,151 @@ TEST_F(FilterEngineIsSubscriptionDownloadAllowedTest,
   EXPECT_EQ(testConnection, capturedConnectionTypes[0].second);
 }
 
+TEST_F(FilterEngineIsSubscriptionDownloadAllowedTest, UnchangedSubscriptionIsNotDownloadedAgain)
+{
+  ::CreateFilterEngine(*platform, createParams);
+  isFilterEngineCreated = true;
+  const std::string subscriptionUrl = "https://example";
+  auto subscription = GetFilterEngine().GetSubscription(subscriptionUrl);
+
+  auto update = [&](const ServerResponse& response) {
+    subscription.UpdateFilters();
+    DelayedTimer::ProcessImmediateTimers(timerTasks);
+    for (const auto& isSubscriptionDownloadAllowedCallback : isSubscriptionDownloadAllowedCallbacks)
+      isSubscriptionDownloadAllowedCallback(true);
+    isSubscriptionDownloadAllowedCallbacks.clear();
+
+    auto ii_webRequest = std::find_if(webRequestTasks->begin(),
+                                      webRequestTasks->end(),
+                                      [&subscriptionUrl](const DelayedWebRequest::Task& task) {
+                                        return Utils::BeginsWith(task.url, subscriptionUrl);
+                                      });
+    if (ii_webRequest == webRequestTasks->end())
+    {
+      ADD_FAILURE() << "No request for " << subscriptionUrl;
+      return HeaderList();
+    }
+    const auto requestHeaders = ii_webRequest->headers;
+    ii_webRequest->requestCallback(response);
+    webRequestTasks->erase(ii_webRequest);
+    return requestHeaders;
+  };
+
+  ServerResponse listResponse;
+  listResponse.status = IWebRequest::NS_OK;
+  listResponse.responseStatus = 200;
+  listResponse.responseText = "[Adblock Plus 2.0]\n! Expires: 1 day\n||example.com";
+  const std::string lastModified = "Wed, 21 Oct 2015 07:28:00 GMT";
+  listResponse.responseHeaders = {{"etag", "\"v1\""}, {"last-modified", lastModified}};
+  auto requestHeaders = update(listResponse);
+  EXPECT_TRUE(std::none_of(requestHeaders.begin(),
+                           requestHeaders.end(),
+                           [](const HeaderList::value_type& header) {
+                             return header.first == "If-None-Match";
+                           }));
+  EXPECT_EQ("synchronize_ok", subscription.GetSynchronizationStatus());
+  EXPECT_EQ(1, subscription.GetFilterCount());
+  const int lastDownload = subscription.GetLastDownloadSuccessTime();
+
+  ServerResponse notModifiedResponse;
+  notModifiedResponse.status = IWebRequest::NS_OK;
+  notModifiedResponse.responseStatus = 304;
+  requestHeaders = update(notModifiedResponse);
+  EXPECT_NE(requestHeaders.end(),
+            std::find(requestHeaders.begin(),
+                      requestHeaders.end(),
+                      HeaderList::value_type("If-None-Match", "\"v1\"")));
+  EXPECT_NE(requestHeaders.end(),
+            std::find(requestHeaders.begin(),
+                      requestHeaders.end(),
+                      HeaderList::value_type("If-Modified-Since", lastModified)));
+  EXPECT_EQ("synchronize_ok", subscription.GetSynchronizationStatus());
+  EXPECT_EQ(1, subscription.GetFilterCount());
+  EXPECT_EQ(lastDownload, subscription.GetLastDownloadSuccessTime()) << "the filters are kept";
+}
+
+TEST_F(FilterEngineIsSubscriptionDownloadAllowedTest, SubscriptionIsUpdatedFromDiff)
+{
+  ::CreateFilterEngine(*platform, createParams);
+  isFilterEngineCreated = true;
+  const std::string subscriptionUrl = "https://example/list.txt";
+  auto subscription = GetFilterEngine().GetSubscription(subscriptionUrl);
+
+  auto update = [&](const std::string& expectedUrl, const ServerResponse& response) {
+    subscription.UpdateFilters();
+    DelayedTimer::ProcessImmediateTimers(timerTasks);
+    for (const auto& isSubscriptionDownloadAllowedCallback : isSubscriptionDownloadAllowedCallbacks)
+      isSubscriptionDownloadAllowedCallback(true);
+    isSubscriptionDownloadAllowedCallbacks.clear();
+
+    auto ii_webRequest = std::find_if(webRequestTasks->begin(),
+                                      webRequestTasks->end(),
+                                      [&expectedUrl](const DelayedWebRequest::Task& task) {
+                                        return Utils::BeginsWith(task.url, expectedUrl);
+                                      });
+    if (ii_webRequest == webRequestTasks->end())
+    {
+      ADD_FAILURE() << "No request for " << expectedUrl;
+      return;
+    }
+    ii_webRequest->requestCallback(response);
+    webRequestTasks->erase(ii_webRequest);
+  };
+
+  ServerResponse listResponse;
+  listResponse.status = IWebRequest::NS_OK;
+  listResponse.responseStatus = 200;
+  listResponse.responseText = "[Adblock Plus 2.0]\n! Version: 1\n"
+                              "! Diff-URL: https://example/diff/%VERSION%.json\n"
+                              "||a.com\n||b.com";
+  update(subscriptionUrl, listResponse);
+  EXPECT_EQ("synchronize_ok", subscription.GetSynchronizationStatus());
+  EXPECT_EQ(2, subscription.GetFilterCount());
+
+  ServerResponse diffResponse;
+  diffResponse.status = IWebRequest::NS_OK;
+  diffResponse.responseStatus = 200;
+  diffResponse.responseText =
+      R"({"version": "2", "added": ["||c.com", "||d.com"], "removed": ["||b.com"]})";
+  update("https://example/diff/1.json", diffResponse);
+  EXPECT_EQ("synchronize_ok", subscription.GetSynchronizationStatus());
+  EXPECT_EQ(3, subscription.GetFilterCount());
+  EXPECT_TRUE(
+      GetFilterEngine().Matches("http://c.com/", IFilterEngine::CONTENT_TYPE_IMAGE, "").IsValid());
+  EXPECT_FALSE(
+      GetFilterEngine().Matches("http://b.com/", IFilterEngine::CONTENT_TYPE_IMAGE, "").IsValid());
+
+  ServerResponse missingDiffResponse;
+  missingDiffResponse.status = IWebRequest::NS_OK;
+  missingDiffResponse.responseStatus = 404;
+  update("https://example/diff/2.json", missingDiffResponse);
+  update(subscriptionUrl, listResponse);
+  EXPECT_EQ(2, subscription.GetFilterCount()) << "falls back to the full list";
+}
+
+TEST_F(FilterEngineIsSubscriptionDownloadAllowedTest, DownloadsFromOneHostAreLimited)
+{
+  ::CreateFilterEngine(*platform, createParams);
+  isFilterEngineCreated = true;
+  for (const auto& path : {"/1", "/2", "/3"})
+    GetFilterEngine().GetSubscription("https://example" + std::string(path)).UpdateFilters();
+  DelayedTimer::ProcessImmediateTimers(timerTasks);
+  ASSERT_EQ(2u, isSubscriptionDownloadAllowedCallbacks.size());
+  for (const auto& isSubscriptionDownloadAllowedCallback : isSubscriptionDownloadAllowedCallbacks)
+    isSubscriptionDownloadAllowedCallback(true);
+  isSubscriptionDownloadAllowedCallbacks.clear();
+  ASSERT_EQ(2u, webRequestTasks->size());
+
+  ServerResponse response;
+  response.status = IWebRequest::NS_OK;
+  response.responseStatus = 200;
+  response.responseText = "[Adblock Plus 2.0]\n||example.com";
+  webRequestTasks->front().requestCallback(response);
+  webRequestTasks->erase(webRequestTasks->begin());
+  DelayedTimer::ProcessImmediateTimers(timerTasks);
+  EXPECT_EQ(1u, isSubscriptionDownloadAllowedCallbacks.size()) << "the third download starts";
+}
+
 class FilterEngineSubscriptionsByFilterTest : public FilterEngineConfigurableTest
 {
 public:
@@ -2086,6 +3552,107 @@ TEST_F(FilterEngineSubscriptionsByFilterTest, MultipleSubscriptions)
   EXPECT_EQ(testUrl2, subscriptions[1].GetUrl());
 }
 
+TEST_F(FilterEngineSubscriptionsByFilterTest, SubscriptionUrlsFollowFilterChanges)
+{
+  auto& engine =
+      ConfigureEngine(AutoselectState::Disabled, SynchronizationState::Enabled, AAState::Enabled);
+  engine.AddFilter(engine.GetFilter("foo"));
+  auto urls = engine.GetSubscriptionUrlsFromFilter("foo");
+  ASSERT_EQ(1u, urls.size());
+  const std::string userUrl = urls[0];
+
+  // The index is built by now, it has to be updated by the events.
+  engine.AddFilter(engine.GetFilter("bar"));
+  EXPECT_EQ(std::vector<std::string>{userUrl}, engine.GetSubscriptionUrlsFromFilter("bar"));
+  engine.RemoveFilter(engine.GetFilter("foo"));
+  EXPECT_TRUE(engine.GetSubscriptionUrlsFromFilter("foo").empty());
+
+  std::string testUrl = "https://foo.bar";
+  engine.AddSubscription(engine.GetSubscription(testUrl));
+  urls = engine.GetSubscriptionUrlsFromFilter(kTestFilter);
+  ASSERT_EQ(1u, urls.size());
+  EXPECT_EQ(testUrl, urls[0]);
+  engine.RemoveSubscription(engine.GetSubscription(testUrl));
+  EXPECT_TRUE(engine.GetSubscriptionUrlsFromFilter(kTestFilter).empty());
+}
+
+TEST_F(FilterEngineSubscriptionsByFilterTest, SubscriptionMemoryUsage)
+{
+  auto& engine =
+      ConfigureEngine(AutoselectState::Disabled, SynchronizationState::Enabled, AAState::Enabled);
+  engine.AddFilter(engine.GetFilter("||example.com^$domain=example.org|example.net"));
+  engine.AddFilter(engine.GetFilter("/banner\\d+/"));
+  std::string testUrl = "https://foo.bar";
+  engine.AddSubscription(engine.GetSubscription(testUrl));
+
+  const auto usages = engine.GetSubscriptionMemoryUsage();
+  ASSERT_EQ(2u, usages.size());
+  const auto& user = usages[0];
+  const auto& list = usages[1];
+  EXPECT_EQ(testUrl, list.url);
+  EXPECT_EQ(1u, list.filterCount);
+  EXPECT_EQ(2u, user.filterCount);
+  EXPECT_GT(list.jsHeapSize, 0u);
+  EXPECT_GT(user.jsHeapSize, list.jsHeapSize);
+  EXPECT_GT(list.nativeSize, 0u);
+  EXPECT_GT(user.nativeSize, list.nativeSize);
+
+  // The filters of a disabled subscription are only kept in JS.
+  engine.GetSubscription(testUrl).SetDisabled(true);
+  EXPECT_EQ(0u, engine.GetSubscriptionMemoryUsage()[1].nativeSize);
+}
+
+TEST_F(FilterEngineSubscriptionsByFilterTest, FilterDeduplicationStats)
+{
+  auto& engine =
+      ConfigureEngine(AutoselectState::Disabled, SynchronizationState::Enabled, AAState::Enabled);
+  engine.AddFilter(engine.GetFilter("||example.com^"));
+  EXPECT_EQ(0u, engine.GetFilterDeduplicationStats().sharedFilterCount);
+
+  engine.AddSubscription(engine.GetSubscription("https://foo.bar"));
+  engine.AddSubscription(engine.GetSubscription("https://bar.foo"));
+  engine.AddFilter(engine.GetFilter(kTestFilter));
+  auto stats = engine.GetFilterDeduplicationStats();
+  EXPECT_EQ(1u, stats.sharedFilterCount);
+  EXPECT_EQ(2u, stats.duplicateCount);
+  EXPECT_GT(stats.jsHeapSize, 0u);
+  EXPECT_GT(stats.nativeSize, 0u);
+
+  // What a subscription takes shrinks along with the duplicates.
+  const auto usages = engine.GetSubscriptionMemoryUsage();
+  ASSERT_EQ(3u, usages.size());
+  EXPECT_EQ(usages[1].jsHeapSize, usages[2].jsHeapSize);
+
+  engine.RemoveSubscription(engine.GetSubscription("https://bar.foo"));
+  stats = engine.GetFilterDeduplicationStats();
+  EXPECT_EQ(1u, stats.sharedFilterCount);
+  EXPECT_EQ(1u, stats.duplicateCount);
+}
+
+TEST_F(FilterEngineSubscriptionsByFilterTest, MatchesWhileNativeMatcherIsRebuilt)
+{
+  auto& engine =
+      ConfigureEngine(AutoselectState::Disabled, SynchronizationState::Enabled, AAState::Enabled);
+  std::string testUrl = "https://foo.bar";
+  engine.AddSubscription(engine.GetSubscription(testUrl));
+  const std::string url = "https://bar.com/ad.gif";
+  EXPECT_TRUE(engine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, "").IsValid());
+
+  // Toggles take effect right away, JS answers until the rebuild is done.
+  engine.GetSubscription(testUrl).SetDisabled(true);
+  EXPECT_FALSE(engine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, "").IsValid());
+  engine.GetSubscription(testUrl).SetDisabled(false);
+  EXPECT_TRUE(engine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, "").IsValid());
+
+  // The rules are converted from the current native matcher.
+  EXPECT_NE(std::string::npos, engine.GetDeclarativeNetRequestRules().find(kTestFilter));
+  EXPECT_TRUE(engine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, "").IsValid());
+
+  engine.RemoveSubscription(engine.GetSubscription(testUrl));
+  EXPECT_FALSE(engine.Matches(url, IFilterEngine::CONTENT_TYPE_IMAGE, "").IsValid());
+  EXPECT_EQ(std::string::npos, engine.GetDeclarativeNetRequestRules().find(kTestFilter));
+}
+
 bool CheckSynchronizerStatus(AdblockPlus::JsEngine& engine)
 {
   return engine.Evaluate("require('synchronizer').synchronizer._started").AsBool();
@@ -2204,6 +3771,35 @@ TEST_F(FilterEngineTest, GetSnippetScriptEmpty)
   EXPECT_EQ("", script);
 }
 
+TEST_F(FilterEngineTest, GetSnippetScriptWithRegisteredLibrary)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto library = filterEngine.RegisterSnippetLibrary("(isolated)", "(injected)", {"(list)"});
+  EXPECT_EQ("", filterEngine.GetSnippetScript("https://test.com/path", library));
+
+  filterEngine.AddFilter(filterEngine.GetFilter("test.com#$#log Hello"));
+  auto script = filterEngine.GetSnippetScriptShared("https://test.com/path", library);
+  EXPECT_EQ(filterEngine.GetSnippetScript(
+                "https://test.com/path", "(isolated)", "(injected)", {"(list)"}),
+            *script);
+  EXPECT_EQ(script, filterEngine.GetSnippetScriptShared("https://test.com/other", library));
+  EXPECT_EQ("", filterEngine.GetSnippetScript("https://example.com/", library));
+
+  // Other filters leave the cached script alone.
+  filterEngine.AddFilter(filterEngine.GetFilter("||example.com^"));
+  EXPECT_EQ(script, filterEngine.GetSnippetScriptShared("https://test.com/path", library));
+  filterEngine.AddFilter(filterEngine.GetFilter("test.com#$#log World"));
+  auto updated = filterEngine.GetSnippetScriptShared("https://test.com/path", library);
+  EXPECT_NE(*script, *updated);
+  EXPECT_NE(std::string::npos, updated->find("World"));
+
+  filterEngine.UnregisterSnippetLibrary(library);
+  EXPECT_THROW(filterEngine.GetSnippetScript("https://test.com/path", library),
+               std::invalid_argument);
+  EXPECT_THROW(filterEngine.GetSnippetScript("https://test.com/path", library + 1),
+               std::invalid_argument);
+}
+
 TEST_F(FilterEngineTest, GetSnippetScriptBasic)
 {
   auto& filterEngine = GetFilterEngine();
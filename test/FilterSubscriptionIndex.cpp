@@ -0,0 +1,117 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/FilterSubscriptionIndex.h"
+
+#include <map>
+
+#include <gtest/gtest.h>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  typedef std::vector<std::string> Urls;
+}
+
+TEST(FilterSubscriptionIndexTest, FindsSubscriptionsInOrder)
+{
+  FilterSubscriptionIndex index;
+  EXPECT_TRUE(index.Find("foo").empty());
+
+  index.SetFilters("https://second/", {"foo", "bar", "foo"});
+  index.SetFilters("https://first/", {"foo"});
+  index.AddFilter("~user~", "foo");
+  EXPECT_EQ(Urls({"https://second/", "https://first/", "~user~"}), index.Find("foo"));
+  EXPECT_EQ(Urls({"https://second/"}), index.Find("bar"));
+
+  // Setting the filters again keeps the position.
+  index.SetFilters("https://second/", {"bar", "baz"});
+  EXPECT_EQ(Urls({"https://first/", "~user~"}), index.Find("foo"));
+  index.SetFilters("https://second/", {"foo"});
+  EXPECT_EQ(Urls({"https://second/", "https://first/", "~user~"}), index.Find("foo"));
+  EXPECT_TRUE(index.Find("bar").empty());
+
+  // Added again after being removed, it goes last.
+  index.RemoveSubscription("https://second/");
+  index.SetFilters("https://second/", {"foo"});
+  EXPECT_EQ(Urls({"https://first/", "~user~", "https://second/"}), index.Find("foo"));
+}
+
+TEST(FilterSubscriptionIndexTest, AddAndRemoveFilters)
+{
+  FilterSubscriptionIndex index;
+  index.AddFilter("~user~", "foo");
+  index.AddFilter("~user~", "foo");
+  index.AddFilter("~user~", "bar");
+  EXPECT_EQ(Urls({"~user~"}), index.Find("foo"));
+
+  index.RemoveFilter("~user~", "foo");
+  EXPECT_TRUE(index.Find("foo").empty());
+  EXPECT_EQ(Urls({"~user~"}), index.Find("bar"));
+  index.RemoveFilter("~user~", "foo");
+  index.RemoveFilter("https://unknown/", "bar");
+  EXPECT_EQ(Urls({"~user~"}), index.Find("bar"));
+
+  index.RemoveSubscription("~user~");
+  EXPECT_TRUE(index.Find("bar").empty());
+  index.AddFilter("~user~", "bar");
+  index.Clear();
+  EXPECT_TRUE(index.Find("bar").empty());
+}
+
+TEST(FilterSubscriptionIndexTest, VisitsSubscriptionsInOrder)
+{
+  FilterSubscriptionIndex index;
+  index.SetFilters("https://second/", {"foo", "bar"});
+  index.SetFilters("https://first/", {"foo"});
+  EXPECT_EQ(2u, index.GetSubscriptionCount("foo"));
+  EXPECT_EQ(1u, index.GetSubscriptionCount("bar"));
+  EXPECT_EQ(0u, index.GetSubscriptionCount("baz"));
+
+  Urls urls;
+  std::vector<std::string> filters;
+  index.VisitSubscriptions(
+      [&urls, &filters](const std::string& url, const std::vector<const std::string*>& texts) {
+        urls.push_back(url);
+        for (const auto* text : texts)
+          filters.push_back(*text);
+      });
+  EXPECT_EQ(Urls({"https://second/", "https://first/"}), urls);
+  EXPECT_EQ(std::vector<std::string>({"foo", "bar", "foo"}), filters);
+}
+
+TEST(FilterSubscriptionIndexTest, VisitsSharedFilters)
+{
+  FilterSubscriptionIndex index;
+  index.SetFilters("https://first/", {"foo", "bar", "baz"});
+  index.SetFilters("https://second/", {"foo", "bar"});
+  index.SetFilters("https://third/", {"foo"});
+
+  std::map<std::string, size_t> shared;
+  index.VisitSharedFilters([&shared](const std::string& filter, size_t subscriptionCount) {
+    shared[filter] = subscriptionCount;
+  });
+  EXPECT_EQ((std::map<std::string, size_t>{{"bar", 2}, {"foo", 3}}), shared);
+
+  index.RemoveSubscription("https://second/");
+  shared.clear();
+  index.VisitSharedFilters([&shared](const std::string& filter, size_t subscriptionCount) {
+    shared[filter] = subscriptionCount;
+  });
+  EXPECT_EQ((std::map<std::string, size_t>{{"foo", 2}}), shared);
+}
@@ -0,0 +1,137 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "../src/GcScheduler.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  class ManualTimer : public ITimer
+  {
+  public:
+    explicit ManualTimer(const GcScheduler::Clock::time_point& now) : now(now)
+    {
+    }
+
+    std::vector<std::pair<GcScheduler::Clock::time_point, TimerCallback>> tasks;
+
+    void SetTimer(const std::chrono::milliseconds& timeout,
+                  const TimerCallback& timerCallback) override
+    {
+      tasks.emplace_back(now + timeout, timerCallback);
+    }
+
+  private:
+    const GcScheduler::Clock::time_point& now;
+  };
+
+  class GcSchedulerTest : public ::testing::Test
+  {
+  protected:
+    GcScheduler::Clock::time_point now = GcScheduler::Clock::time_point(std::chrono::hours(1));
+    ManualTimer timer{now};
+    int criticalCount = 0;
+    int idleCount = 0;
+
+    std::shared_ptr<GcScheduler> Create(std::chrono::milliseconds idleDelay,
+                                        std::chrono::milliseconds criticalInterval)
+    {
+      return std::make_shared<GcScheduler>(
+          timer,
+          [this]() { ++criticalCount; },
+          [this]() { ++idleCount; },
+          idleDelay,
+          criticalInterval,
+          [this]() { return now; });
+    }
+
+    // Advances the clock to the due time of the only pending task and runs it.
+    void RunTimer()
+    {
+      ASSERT_EQ(1u, timer.tasks.size());
+      auto task = timer.tasks.front();
+      timer.tasks.clear();
+      now = std::max(now, task.first);
+      task.second();
+    }
+  };
+}
+
+TEST_F(GcSchedulerTest, CriticalCollectionsAreRateLimited)
+{
+  auto scheduler = Create(std::chrono::milliseconds::zero(), std::chrono::seconds(10));
+  scheduler->NotifyActivity();
+  EXPECT_TRUE(timer.tasks.empty()) << "idle time collections are disabled";
+
+  scheduler->RequestCriticalCollection();
+  EXPECT_EQ(1, criticalCount);
+  EXPECT_TRUE(timer.tasks.empty());
+
+  now += std::chrono::seconds(3);
+  scheduler->RequestCriticalCollection();
+  scheduler->RequestCriticalCollection();
+  EXPECT_EQ(1, criticalCount);
+  RunTimer();
+  EXPECT_EQ(2, criticalCount) << "deferred requests are merged";
+  EXPECT_TRUE(timer.tasks.empty());
+  EXPECT_EQ(0, idleCount);
+}
+
+TEST_F(GcSchedulerTest, CollectionsWaitForIdleTime)
+{
+  auto scheduler = Create(std::chrono::milliseconds(500), std::chrono::milliseconds::zero());
+  scheduler->NotifyActivity();
+  ASSERT_EQ(1u, timer.tasks.size());
+  scheduler->NotifyActivity();
+  EXPECT_EQ(1u, timer.tasks.size()) << "one pending check is enough";
+
+  now += std::chrono::milliseconds(200);
+  scheduler->NotifyActivity();
+  scheduler->RequestCriticalCollection();
+  EXPECT_EQ(0, criticalCount) << "requests are being matched";
+  now += std::chrono::milliseconds(200);
+  scheduler->NotifyActivity();
+  RunTimer();
+  EXPECT_EQ(0, criticalCount) << "the last request was matched 101 ms ago";
+  RunTimer();
+  EXPECT_EQ(1, criticalCount);
+  EXPECT_EQ(0, idleCount) << "covered by the critical collection";
+  EXPECT_TRUE(timer.tasks.empty());
+
+  scheduler->NotifyActivity();
+  RunTimer();
+  EXPECT_EQ(1, idleCount);
+  EXPECT_TRUE(timer.tasks.empty());
+
+  scheduler->RequestCriticalCollection();
+  EXPECT_EQ(2, criticalCount) << "nothing was matched since the last collection";
+}
+
+TEST_F(GcSchedulerTest, PendingTimersDontOutliveTheScheduler)
+{
+  auto scheduler = Create(std::chrono::milliseconds(500), std::chrono::milliseconds::zero());
+  scheduler->NotifyActivity();
+  scheduler.reset();
+  RunTimer();
+  EXPECT_EQ(0, idleCount);
+}
@@ -63,3 +63,16 @@ TEST_F(GlobalJsObjectTest, SetMultipleTimeouts)
   AdblockPlus::Sleep(200);
   ASSERT_EQ("1,2", GetJsEngine().Evaluate("foo").AsString());
 }
+
+TEST_F(GlobalJsObjectTest, ClearTimeout)
+{
+  GetJsEngine().Evaluate("let foo = []");
+  GetJsEngine().Evaluate("var timeout = setTimeout(function() {foo.push('1');}, 100)");
+  GetJsEngine().Evaluate("setTimeout(function() {foo.push('2');}, 150)");
+  ASSERT_TRUE(GetJsEngine().Evaluate("timeout").IsNumber());
+  GetJsEngine().Evaluate("clearTimeout(timeout)");
+  GetJsEngine().Evaluate("clearTimeout(timeout)");
+  GetJsEngine().Evaluate("clearTimeout(); clearTimeout(12345); clearTimeout('foo')");
+  AdblockPlus::Sleep(200);
+  ASSERT_EQ("2", GetJsEngine().Evaluate("foo").AsString());
+}
@@ -1,12 +1,88 @@
+#include <algorithm>
+#include <cctype>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <future>
 #include <gtest/gtest.h>
+#include <iomanip>
+#include <map>
+#include <mutex>
 #include <numeric>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <AdblockPlus/URLInfo.h>
 
 #include "../src/DefaultFileSystem.h"
+#include "../src/JsContext.h"
 #include "../src/JsError.h"
 #include "BaseJsTest.h"
 
+extern std::string jsSources[];
+
+namespace
+{
+  const std::vector<std::string> RECORDINGS = {
+      "data/rec_abudhabi_dubizzle_com.log",
+      "data/rec_allegro_pl.log",
+      "data/rec_chron_com.log",
+      "data/rec_cn_hao123_com.log",
+      "data/rec_en_wikipedia_org.log",
+      "data/rec_laodong_vn.log",
+      "data/rec_news_mail_ru.log",
+      "data/rec_search_yahoo_com.log",
+      "data/rec_shopee_vn.log",
+      "data/rec_shortorial_com.log",
+      "data/rec_thethao247_vn.log",
+      "data/rec_vk_com.log",
+      "data/rec_vnexpress_net.log",
+      "data/rec_vtv_vn.log",
+      "data/rec_web_de.log",
+      "data/rec_www_1tv_ge.log",
+      "data/rec_www_24h_com_vn.log",
+      "data/rec_www_amazon_com.log",
+      "data/rec_www_aparat_com.log",
+      "data/rec_www_baidu_com.log",
+      "data/rec_www_bbc_com.log",
+      "data/rec_www_bedienungsanleitu_ng.log",
+      "data/rec_www_bing_com.log",
+      "data/rec_www_boston_com.log",
+      "data/rec_www_dailymail_co_uk.log",
+      "data/rec_www_ebay_com.log",
+      "data/rec_www_flipkart_com.log",
+      "data/rec_www_forbes_com.log",
+      "data/rec_www_google_com.log",
+      "data/rec_www_imdb_com.log",
+      "data/rec_www_indiatimes_com.log",
+      "data/rec_www_libero_it.log",
+      "data/rec_www_manoramaonline_com.log",
+      "data/rec_www_myauto_ge.log",
+      "data/rec_www_ndtv_com.log",
+      "data/rec_www_olx_ro.log",
+      "data/rec_www_online2pdf_com.log",
+      "data/rec_www_quora_com.log",
+      "data/rec_www_reddit_com.log",
+      "data/rec_www_repubblica_it.log",
+      "data/rec_www_sapo_pt.log",
+      "data/rec_www_techradar_com.log",
+      "data/rec_www_tomsguide_com.log",
+      "data/rec_www_trustedreviews_com.log",
+      "data/rec_www_twitch_tv.log",
+      "data/rec_www_wp_pl.log",
+      "data/rec_www_xvideos_com.log",
+      "data/rec_www_youtube_com.log",
+      "data/rec_yandex_com.log"};
+}
+
 class ReadOnlyFileSystem : public AdblockPlus::DefaultFileSystem
 {
 public:
@@ -34,14 +110,6 @@ public:
   }
 };
 
-enum class PopupBlockResult
-{
-  NO_RULE,
-  BLOCK_RULE,
-  ALLOW_RULE,
-  DISABLED
-};
-
 class ElapsedTime
 {
 public:
@@ -60,6 +128,65 @@ private:
   std::chrono::steady_clock::time_point start;
 };
 
+// CPU time the calling thread spent, unlike ElapsedTime it doesn't count the
+// time the thread waited, e.g. for a lock or for being scheduled. Work which
+// a call hands over to another thread isn't counted either.
+class ThreadCpuTime
+{
+public:
+  ThreadCpuTime() : start(Now())
+  {
+  }
+
+  double Microseconds() const
+  {
+    return Now() - start;
+  }
+
+private:
+  static double Now()
+  {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+    // In units of 100 nanoseconds.
+    auto toMicroseconds = [](const FILETIME& time) {
+      return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 10.0;
+    };
+    return toMicroseconds(kernel) + toMicroseconds(user);
+#else
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+#endif
+  }
+
+  double start;
+};
+
+// Wall and CPU time of a call, in microseconds.
+struct CallTime
+{
+  double wall = 0;
+  double cpu = 0;
+};
+
+class CallTimer
+{
+public:
+  CallTime Stop() const
+  {
+    CallTime time;
+    time.cpu = cpu.Microseconds();
+    time.wall = wall.Microseconds();
+    return time;
+  }
+
+private:
+  ElapsedTime wall;
+  ThreadCpuTime cpu;
+};
+
 struct CallStats
 {
   void Add(double elapsedTime)
@@ -78,6 +205,25 @@ struct CallStats
                          : measurements[size / 2];
   }
 
+  // Nearest-rank percentile, e.g. 99.9 for the value which 99.9% of the
+  // measurements don't exceed.
+  double Percentile(double percentile)
+  {
+    const size_t size = measurements.size();
+    if (size == 0)
+      return 0;
+
+    std::sort(measurements.begin(), measurements.end());
+    const auto rank = static_cast<size_t>(std::ceil(percentile / 100 * size));
+    return measurements[std::min(std::max(rank, size_t(1)), size) - 1];
+  }
+
+  double Max()
+  {
+    return measurements.empty() ? 0
+                                : *std::max_element(measurements.begin(), measurements.end());
+  }
+
   double Mean()
   {
     const size_t size = measurements.size();
@@ -94,8 +240,8 @@ struct CallStats
       return 0;
 
     const double mean = Mean();
-    const double sumOfSquaredDeviations =
-        std::accumulate(measurements.begin(), measurements.end(), 0, [mean](double sum, double b) {
+    const double sumOfSquaredDeviations = std::accumulate(
+        measurements.begin(), measurements.end(), 0.0, [mean](double sum, double b) {
           return (b - mean) * (b - mean) + sum;
         });
     return std::sqrt(sumOfSquaredDeviations / (size - 1));
@@ -117,8 +263,22 @@ class HarnessTest : public ::testing::Test
 protected:
   std::unique_ptr<AdblockPlus::Platform> platform;
   std::map<std::string, CallStats> stats;
+  // Calls per second by number of threads, see MatchConcurrently().
+  std::map<size_t, double> throughput;
 
   void SetUp() override
+  {
+    AdblockPlus::PlatformFactory::CreationParameters params;
+    params.executor = AdblockPlus::PlatformFactory::CreateExecutor();
+    params.fileSystem.reset(new ReadOnlyFileSystem(*params.executor, "data"));
+    params.webRequest.reset(new NoopWebRequest());
+
+    platform = AdblockPlus::PlatformFactory::CreatePlatform(std::move(params));
+    platform->SetUp(CreateAppInfo());
+    platform->CreateFilterEngineAsync(CreateEngineParams());
+  }
+
+  static AdblockPlus::AppInfo CreateAppInfo()
   {
     AdblockPlus::AppInfo appInfo;
     appInfo.version = "1.0";
@@ -126,19 +286,16 @@ protected:
     appInfo.application = "standalone";
     appInfo.applicationVersion = "1.0";
     appInfo.locale = "en-US";
+    return appInfo;
+  }
 
-    AdblockPlus::PlatformFactory::CreationParameters params;
-    params.executor = AdblockPlus::PlatformFactory::CreateExecutor();
-    params.fileSystem.reset(new ReadOnlyFileSystem(*params.executor, "data"));
-    params.webRequest.reset(new NoopWebRequest());
-
+  // The subscriptions are the ones in data/patterns.ini, none are added.
+  static AdblockPlus::FilterEngineFactory::CreationParameters CreateEngineParams()
+  {
     AdblockPlus::FilterEngineFactory::CreationParameters engineParams;
     engineParams.preconfiguredPrefs.booleanPrefs
         [AdblockPlus::FilterEngineFactory::BooleanPrefName::FirstRunSubscriptionAutoselect] = false;
-
-    platform = AdblockPlus::PlatformFactory::CreatePlatform(std::move(params));
-    platform->SetUp(appInfo);
-    platform->CreateFilterEngineAsync(engineParams);
+    return engineParams;
   }
 
   AdblockPlus::JsEngine& GetJsEngine()
@@ -151,31 +308,165 @@ protected:
     return platform->GetFilterEngine();
   }
 
-  void MatchFromFile(const std::string& file)
+  // Calls of a recording, parsed up front so that replaying them doesn't
+  // enter the JS engine for anything but the call itself.
+  struct RecordedCall
   {
+    std::string fn;
+    std::string url;
+    std::string opener;
+    std::vector<std::string> documentUrls;
+    std::string sitekey;
+    AdblockPlus::IFilterEngine::ContentTypeMask contentTypeMask = 0;
+    int64_t processId = 0;
+    int64_t frameId = 0;
+    int64_t result = 0;
+  };
+
+  typedef std::vector<RecordedCall> Recording;
+
+  Recording ReadRecording(const std::string& file)
+  {
+    Recording recording;
     std::ifstream stream(file);
     std::string line;
-    ASSERT_TRUE(stream.is_open());
+    EXPECT_TRUE(stream.is_open()) << "Cannot read " << file;
 
     while (std::getline(stream, line))
       if (!line.empty())
-        MatchRecorded(line);
+        recording.push_back(ParseRecorded(line));
+    return recording;
   }
 
-  void MatchRecorded(const std::string& json)
+  RecordedCall ParseRecorded(const std::string& json)
   {
     auto& engine = GetJsEngine();
     AdblockPlus::JsValue callInfo =
         engine.Evaluate("str => JSON.parse(str)").Call(engine.NewValue(json));
 
-    std::string fn = callInfo.GetProperty("_fn").AsString();
+    RecordedCall call;
+    call.fn = callInfo.GetProperty("_fn").AsString();
+    if (call.fn == "check-filter-match")
+    {
+      call.url = callInfo.GetProperty("request_url").AsString();
+      call.documentUrls = ToList(callInfo.GetProperty("referrers"));
+      call.sitekey = callInfo.GetProperty("sitekey").AsString();
+      call.contentTypeMask = static_cast<AdblockPlus::IFilterEngine::ContentTypeMask>(
+          callInfo.GetProperty("adblock_resource_type").AsInt());
+      call.result = callInfo.GetProperty("_res").AsInt();
+    }
+    else if (call.fn == "block-popup")
+    {
+      call.url = callInfo.GetProperty("url").AsString();
+      call.opener = callInfo.GetProperty("opener").AsString();
+      call.result = callInfo.GetProperty("_res").AsInt();
+    }
+    else if (call.fn == "generate-js-css")
+    {
+      call.url = callInfo.GetProperty("gurl").AsString();
+      call.processId = callInfo.GetProperty("process_id").AsInt();
+      call.frameId = callInfo.GetProperty("frame_id").AsInt();
+      call.documentUrls = ToList(callInfo.GetProperty("referrers"));
+      call.sitekey = callInfo.GetProperty("sitekey").AsString();
+    }
+    return call;
+  }
+
+  void MatchFromFile(const std::string& file)
+  {
+    for (const auto& call : ReadRecording(file))
+      MatchRecorded(call, &stats);
+  }
 
-    if (fn == "check-filter-match")
-      stats[fn].Add(CheckFilterMatch(callInfo));
-    else if (fn == "block-popup")
-      stats[fn].Add(BlockPopup(callInfo));
-    else if (fn == "generate-js-css")
-      stats[fn].Add(GenerateJsCss(callInfo));
+  // Adds the wall time of the call to its statistics, `false` for calls
+  // which aren't replayed.
+  bool MatchRecorded(const RecordedCall& call,
+                     std::map<std::string, CallStats>* callStats,
+                     CallTime* time = nullptr) const
+  {
+    CallTime lasted;
+    if (call.fn == "check-filter-match")
+      lasted = CheckFilterMatch(call);
+    else if (call.fn == "block-popup")
+      lasted = BlockPopup(call);
+    else if (call.fn == "generate-js-css")
+      lasted = GenerateJsCss(call);
+    else
+      return false;
+    (*callStats)[call.fn].Add(lasted.wall);
+    if (time)
+      *time = lasted;
+    return true;
+  }
+
+  // Replays a recording `repetitions` times in a row. Besides the wall time
+  // under the call names, the CPU time is stored under the call names
+  // followed by `/cpu`, and the total times of each replay under
+  // `site/<site>` and `site/<site>/cpu`.
+  void MatchRepeatedly(const std::string& site, const Recording& recording, int repetitions)
+  {
+    for (int i = 0; i < repetitions; ++i)
+    {
+      CallTime total;
+      for (const auto& call : recording)
+      {
+        CallTime time;
+        if (!MatchRecorded(call, &stats, &time))
+          continue;
+        stats[call.fn + "/cpu"].Add(time.cpu);
+        total.wall += time.wall;
+        total.cpu += time.cpu;
+      }
+      stats["site/" + site].Add(total.wall);
+      stats["site/" + site + "/cpu"].Add(total.cpu);
+    }
+  }
+
+  // Name of the site of a recording, e.g. `www_bbc_com`.
+  static std::string GetSiteName(const std::string& file)
+  {
+    std::string name = file.substr(file.rfind('/') + 1);
+    if (name.compare(0, 4, "rec_") == 0)
+      name.erase(0, 4);
+    const size_t extension = name.rfind('.');
+    return extension == std::string::npos ? name : name.substr(0, extension);
+  }
+
+  // Replays the recordings on that many threads at once, each of them
+  // taking every n-th recording. The statistics are stored under the call
+  // names followed by the thread count, e.g. `check-filter-match/4`.
+  void MatchConcurrently(const std::vector<Recording>& recordings, size_t threadCount)
+  {
+    const std::string suffix = "/" + std::to_string(threadCount);
+    std::vector<std::map<std::string, CallStats>> threadStats(threadCount);
+    std::vector<std::thread> threads;
+    ElapsedTime timer;
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+      threads.emplace_back([this, &recordings, &threadStats, threadCount, i]() {
+        for (size_t j = i; j < recordings.size(); j += threadCount)
+        {
+          for (const auto& call : recordings[j])
+            MatchRecorded(call, &threadStats[i]);
+        }
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+    const double elapsed = timer.Microseconds();
+
+    size_t callCount = 0;
+    for (const auto& callStats : threadStats)
+    {
+      for (const auto& it : callStats)
+      {
+        auto& measurements = stats[it.first + suffix].measurements;
+        measurements.insert(
+            measurements.end(), it.second.measurements.begin(), it.second.measurements.end());
+        callCount += it.second.measurements.size();
+      }
+    }
+    throughput[threadCount] = elapsed > 0 ? callCount / elapsed * 1000000 : 0;
   }
 
   std::vector<std::string> ToList(const AdblockPlus::JsValue& value) const
@@ -188,18 +479,16 @@ protected:
     return res;
   }
 
-  double GenerateJsCss(const AdblockPlus::JsValue& info) const
+  CallTime GenerateJsCss(const RecordedCall& call) const
   {
     auto& engine = GetFilterEngine();
-    auto url = info.GetProperty("gurl").AsString();
-    auto process_id = info.GetProperty("process_id").AsInt();
-    auto frame_id = info.GetProperty("frame_id").AsInt();
-    auto documentUrls = ToList(info.GetProperty("referrers"));
-    auto sitekey = info.GetProperty("sitekey").AsString();
-    double lasted = 0;
+    const auto& url = call.url;
+    const auto& documentUrls = call.documentUrls;
+    const auto& sitekey = call.sitekey;
+    CallTime lasted;
 
     {
-      ElapsedTime timer;
+      CallTimer timer;
 
       if (url.rfind("http:", 0) == 0 || url.rfind("https:", 0) == 0)
       {
@@ -208,7 +497,7 @@ protected:
             !engine.IsContentAllowlisted(
                 url, AdblockPlus::IFilterEngine::CONTENT_TYPE_ELEMHIDE, documentUrls, sitekey))
         {
-          if (process_id >= 0 && frame_id >= 0)
+          if (call.processId >= 0 && call.frameId >= 0)
           {
             engine.GetElementHidingEmulationSelectors(url);
             engine.GetElementHidingStyleSheet(
@@ -219,45 +508,45 @@ protected:
         }
       }
 
-      lasted = timer.Microseconds();
+      lasted = timer.Stop();
     }
 
     return lasted;
   }
 
-  double BlockPopup(const AdblockPlus::JsValue& info) const
+  CallTime BlockPopup(const RecordedCall& call) const
   {
     auto& engine = GetFilterEngine();
-    auto url = info.GetProperty("url").AsString();
-    auto opener = info.GetProperty("opener").AsString();
-    double lasted = 0;
+    bool decision = false;
+    CallTime lasted;
 
     {
-      ElapsedTime timer;
+      CallTimer timer;
 
-      AdblockPlus::Filter filter =
-          engine.Matches(url, AdblockPlus::IFilterEngine::ContentType::CONTENT_TYPE_POPUP, opener);
-      lasted = timer.Microseconds();
+      const auto result = engine.CheckPopup(call.url,
+                                            call.opener.empty()
+                                                ? std::vector<std::string>()
+                                                : std::vector<std::string>{call.opener});
+      decision = result == AdblockPlus::IFilterEngine::PopupBlockResult::BLOCK_RULE;
+      lasted = timer.Stop();
     }
 
-    EXPECT_EQ(info.GetProperty("_res").AsInt(), static_cast<int>(lasted));
+    EXPECT_EQ(call.result, decision);
     return lasted;
   }
 
-  double CheckFilterMatch(const AdblockPlus::JsValue& info) const
+  CallTime CheckFilterMatch(const RecordedCall& call) const
   {
     auto& engine = GetFilterEngine();
-    auto url = info.GetProperty("request_url").AsString();
-    auto documentUrls = ToList(info.GetProperty("referrers"));
-    auto sitekey = info.GetProperty("sitekey").AsString();
-    AdblockPlus::IFilterEngine::ContentType contentTypeMask =
-        static_cast<AdblockPlus::IFilterEngine::ContentType>(
-            info.GetProperty("adblock_resource_type").AsInt());
+    const auto& url = call.url;
+    const auto& documentUrls = call.documentUrls;
+    const auto& sitekey = call.sitekey;
+    const auto contentTypeMask = call.contentTypeMask;
     bool decision = false;
-    double lasted = 0;
+    CallTime lasted;
 
     {
-      ElapsedTime timer;
+      CallTimer timer;
       bool specificOnly = false;
       AdblockPlus::Filter filter;
 
@@ -286,81 +575,1040 @@ protected:
         decision = false;
       }
 
-      lasted = timer.Microseconds();
+      lasted = timer.Stop();
     }
 
-    EXPECT_EQ(info.GetProperty("_res").AsInt(), decision);
+    EXPECT_EQ(call.result, decision);
     return lasted;
   }
 
-  void ReportPerformance()
+  // Statistics of one call type, in microseconds.
+  struct Summary
   {
-    std::cout << std::left << std::fixed << std::setprecision(3) << std::setw(20) << "Name"
-              << " ; Median(us) ; StdDev(us) ; StdErr(us) ;      Count" << std::endl;
+    std::string name;
+    size_t count;
+    double mean;
+    double stdErr;
+    double stdDev;
+    double median;
+    double p90;
+    double p99;
+    double p999;
+    double max;
+  };
 
+  std::vector<Summary> Summarize()
+  {
+    std::vector<Summary> summaries;
     for (auto& it : stats)
     {
-      const std::string& name = it.first;
       CallStats& cbStats = it.second;
-      std::cout << std::left << std::setw(20) << name << " ; " << std::right << std::setw(10)
-                << cbStats.Median() << " ; " << std::setw(10) << cbStats.StdDeviation() << " ; "
-                << std::setw(10) << cbStats.StdError() << " ; " << std::setw(10)
-                << cbStats.measurements.size() << std::endl;
+      summaries.push_back({it.first,
+                           cbStats.measurements.size(),
+                           cbStats.Mean(),
+                           cbStats.StdError(),
+                           cbStats.StdDeviation(),
+                           cbStats.Median(),
+                           cbStats.Percentile(90),
+                           cbStats.Percentile(99),
+                           cbStats.Percentile(99.9),
+                           cbStats.Max()});
     }
+    return summaries;
+  }
+
+  // Prints the table, then writes the results to the file which the
+  // HARNESS_RESULTS environment variable names, as CSV if its name ends with
+  // `.csv` and as JSON otherwise. If HARNESS_BASELINE names a JSON file
+  // written that way before, the results are compared against it.
+  void ReportPerformance()
+  {
+    const auto summaries = Summarize();
+    std::cout << std::left << std::fixed << std::setprecision(3) << std::setw(20) << "Name"
+              << " ; Median(us) ;   Mean(us) ; StdErr(us) ;    P90(us) ;    P99(us) ;  P99.9(us) ;"
+                 "    Max(us) ;      Count"
+              << std::endl;
+    for (const auto& summary : summaries)
+    {
+      std::cout << std::left << std::setw(20) << summary.name << std::right;
+      for (double value : {summary.median,
+                           summary.mean,
+                           summary.stdErr,
+                           summary.p90,
+                           summary.p99,
+                           summary.p999,
+                           summary.max})
+        std::cout << " ; " << std::setw(10) << value;
+      std::cout << " ; " << std::setw(10) << summary.count << std::endl;
+    }
+    for (const auto& it : throughput)
+      std::cout << "Throughput on " << it.first << (it.first == 1 ? " thread" : " threads") << ": "
+                << it.second << " calls/s" << std::endl;
+
+    if (const char* results = std::getenv("HARNESS_RESULTS"))
+      WriteResults(results, summaries);
+    if (const char* baseline = std::getenv("HARNESS_BASELINE"))
+      CompareWithBaseline(baseline, summaries);
+  }
+
+  static void WriteResults(const std::string& file, const std::vector<Summary>& summaries)
+  {
+    std::ofstream stream(file);
+    ASSERT_TRUE(stream.is_open()) << "Cannot write " << file;
+    stream << std::fixed << std::setprecision(3);
+    const bool csv = file.size() >= 4 && file.compare(file.size() - 4, 4, ".csv") == 0;
+    if (csv)
+      stream << "name,count,mean,stdErr,stdDev,median,p90,p99,p99.9,max\n";
+    else
+      stream << "{";
+    for (size_t i = 0; i < summaries.size(); ++i)
+    {
+      const auto& s = summaries[i];
+      if (csv)
+      {
+        stream << s.name << ',' << s.count << ',' << s.mean << ',' << s.stdErr << ',' << s.stdDev
+               << ',' << s.median << ',' << s.p90 << ',' << s.p99 << ',' << s.p999 << ','
+               << s.max << "\n";
+        continue;
+      }
+      // Call type names need no escaping.
+      stream << (i == 0 ? "\n" : ",\n") << "  \"" << s.name << "\": {\"count\": " << s.count
+             << ", \"mean\": " << s.mean << ", \"stdErr\": " << s.stdErr
+             << ", \"stdDev\": " << s.stdDev << ", \"median\": " << s.median
+             << ", \"p90\": " << s.p90 << ", \"p99\": " << s.p99 << ", \"p99.9\": " << s.p999
+             << ", \"max\": " << s.max << "}";
+    }
+    if (!csv)
+      stream << "\n}\n";
+  }
+
+  // A call type regressed if its mean grew by more than REGRESSION_THRESHOLD
+  // and by more than REGRESSION_Z_SCORE standard errors of the difference,
+  // i.e. the slowdown is both relevant and not noise at a 99.9% level.
+  void CompareWithBaseline(const std::string& file, const std::vector<Summary>& summaries)
+  {
+    const double REGRESSION_THRESHOLD = 0.05;
+    const double REGRESSION_Z_SCORE = 3.09;
+
+    std::ifstream stream(file);
+    ASSERT_TRUE(stream.is_open()) << "Cannot read " << file;
+    std::stringstream content;
+    content << stream.rdbuf();
+    auto& engine = GetJsEngine();
+    AdblockPlus::JsValue baseline =
+        engine.Evaluate("str => JSON.parse(str)").Call(engine.NewValue(content.str()));
+
+    std::cout << std::endl
+              << "Compared to " << file << std::endl
+              << std::left << std::setw(20) << "Name"
+              << " ;    Mean(%) ;  Median(%) ;     P99(%) ;          z ; Verdict" << std::endl;
+    for (const auto& summary : summaries)
+    {
+      AdblockPlus::JsValue base = baseline.GetProperty(summary.name);
+      std::cout << std::left << std::setw(20) << summary.name << std::right;
+      if (!base.IsObject())
+      {
+        std::cout << " ; not in baseline" << std::endl;
+        continue;
+      }
+
+      const double baseMean = base.GetProperty("mean").AsDouble();
+      const double baseStdErr = base.GetProperty("stdErr").AsDouble();
+      const double stdErrOfDifference =
+          std::sqrt(summary.stdErr * summary.stdErr + baseStdErr * baseStdErr);
+      const double z = stdErrOfDifference > 0 ? (summary.mean - baseMean) / stdErrOfDifference : 0;
+      const bool regressed =
+          z > REGRESSION_Z_SCORE && summary.mean > baseMean * (1 + REGRESSION_THRESHOLD);
+      const bool improved =
+          z < -REGRESSION_Z_SCORE && summary.mean < baseMean * (1 - REGRESSION_THRESHOLD);
+      for (const auto& value : {std::make_pair(summary.mean, baseMean),
+                                std::make_pair(summary.median,
+                                               base.GetProperty("median").AsDouble()),
+                                std::make_pair(summary.p99, base.GetProperty("p99").AsDouble())})
+        std::cout << " ; " << std::setw(10) << RelativeChange(value.first, value.second);
+      std::cout << " ; " << std::setw(10) << z << " ; "
+                << (regressed ? "REGRESSION" : improved ? "improvement" : "no significant change")
+                << std::endl;
+      EXPECT_FALSE(regressed) << summary.name << " got slower, mean " << summary.mean
+                              << "us instead of " << baseMean << "us";
+    }
+  }
+
+  static double RelativeChange(double value, double baseValue)
+  {
+    return baseValue != 0 ? (value - baseValue) / baseValue * 100 : 0;
+  }
+};
+
+// Reports how long reading a file took, until the done callback returned,
+// i.e. including the processing of the content by the JS code.
+class TimedReadFileSystem : public ReadOnlyFileSystem
+{
+public:
+  typedef std::function<void(const std::string& fileName, double elapsed)> ReadTimeCallback;
+
+  TimedReadFileSystem(AdblockPlus::IExecutor& executor,
+                      const std::string& basePath,
+                      const ReadTimeCallback& onRead)
+      : ReadOnlyFileSystem(executor, basePath), onRead(onRead)
+  {
+  }
+
+  void Read(const std::string& fileName,
+            const ReadCallback& doneCallback,
+            const Callback& errorCallback) const override
+  {
+    ElapsedTime timer;
+    ReadOnlyFileSystem::Read(
+        fileName,
+        [this, fileName, timer, doneCallback](IOBuffer&& content) {
+          doneCallback(std::move(content));
+          onRead(fileName, timer.Microseconds());
+        },
+        errorCallback);
+  }
+
+  void ReadView(const std::string& fileName,
+                const ReadViewCallback& doneCallback,
+                const Callback& errorCallback) const override
+  {
+    ElapsedTime timer;
+    ReadOnlyFileSystem::ReadView(
+        fileName,
+        [this, fileName, timer, doneCallback](const ContentView& content) {
+          doneCallback(content);
+          onRead(fileName, timer.Microseconds());
+        },
+        errorCallback);
+  }
+
+private:
+  ReadTimeCallback onRead;
+};
+
+// Measures the phases of creating a filter engine instead of replaying
+// recordings, every run creates its own platform.
+class StartupHarnessTest : public HarnessTest
+{
+protected:
+  void SetUp() override
+  {
+  }
+
+  // Creates a platform and a filter engine, storing the time of each phase
+  // under `prefix` followed by the phase name: `JsEngine::New`, the name of
+  // every evaluated script, `prefs.json`, `patterns.ini`, `_init` for the
+  // time from FilterEngineFactory::CreateAsync() to the engine being ready
+  // and `total`. The scripts are evaluated with `codeCache`, which receives
+  // the code cache recorded on the way.
+  void MeasureStartup(const std::string& prefix, AdblockPlus::JsEngine::CodeCache* codeCache)
+  {
+    platform.reset();
+    ElapsedTime total;
+    std::mutex readTimesMutex;
+    std::map<std::string, double> readTimes;
+    AdblockPlus::PlatformFactory::CreationParameters params;
+    params.executor = AdblockPlus::PlatformFactory::CreateExecutor();
+    params.fileSystem.reset(new TimedReadFileSystem(
+        *params.executor, "data", [&](const std::string& fileName, double elapsed) {
+          std::lock_guard<std::mutex> lock(readTimesMutex);
+          readTimes[fileName] += elapsed;
+        }));
+    params.webRequest.reset(new NoopWebRequest());
+    platform = AdblockPlus::PlatformFactory::CreatePlatform(std::move(params));
+    {
+      ElapsedTime timer;
+      platform->SetUp(CreateAppInfo());
+      stats[prefix + "JsEngine::New"].Add(timer.Microseconds());
+    }
+
+    auto& jsEngine = GetJsEngine();
+    jsEngine.SetCodeCache(std::move(*codeCache), true);
+    auto created = std::make_shared<std::promise<std::unique_ptr<AdblockPlus::IFilterEngine>>>();
+    auto initTime = std::make_shared<double>();
+    ElapsedTime sinceCreation;
+    AdblockPlus::FilterEngineFactory::CreateAsync(
+        jsEngine,
+        [this, &jsEngine, &prefix](const std::string& fileName) {
+          for (int i = 0; !jsSources[i].empty(); i += 2)
+          {
+            if (jsSources[i] != fileName)
+              continue;
+            ElapsedTime timer;
+            jsEngine.Evaluate(jsSources[i + 1], jsSources[i]);
+            stats[prefix + fileName].Add(timer.Microseconds());
+          }
+        },
+        [created, initTime, sinceCreation](std::unique_ptr<AdblockPlus::IFilterEngine> engine) {
+          *initTime = sinceCreation.Microseconds();
+          created->set_value(std::move(engine));
+        },
+        CreateEngineParams());
+
+    auto filterEngine = created->get_future().get();
+    stats[prefix + "_init"].Add(*initTime);
+    stats[prefix + "total"].Add(total.Microseconds());
+    {
+      std::lock_guard<std::mutex> lock(readTimesMutex);
+      for (const auto& fileName : {"prefs.json", "patterns.ini"})
+        stats[prefix + fileName].Add(readTimes[fileName]);
+    }
+    {
+      const AdblockPlus::JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+      *codeCache = jsEngine.GetCodeCache();
+    }
+    // The platform is kept for ReportPerformance(), the engine has to go
+    // before it.
+    filterEngine.reset();
+  }
+};
+
+// Generates a filter list resembling EasyList in its mix of filter types and
+// in the distribution of keywords: every host of a `||host^` filter is
+// unique, the path components and element hiding domains are drawn from a
+// Zipf distribution, so that some keywords are shared by many filters and
+// their number grows with the size of the list. Lists of the same size are
+// identical across runs, and so are GetRequests() and GetDomainUrls() for
+// every size, the part of them matching filters growing with the list.
+class SyntheticFilterList
+{
+public:
+  explicit SyntheticFilterList(size_t filterCount) : filterCount(filterCount)
+  {
+  }
+
+  // patterns.ini with one subscription of `filterCount` filters.
+  std::string GetPatterns() const
+  {
+    std::mt19937 random(SEED);
+    std::stringstream patterns;
+    patterns << "# Adblock Plus preferences\nversion=5\n[Subscription]\n"
+             << "url=https://example.com/synthetic" << filterCount << ".txt\n"
+             << "title=Synthetic\nlastDownload=1612423783\ndownloadStatus=synchronize_ok\n"
+             << "[Subscription filters]\n";
+    for (size_t i = 0; i < filterCount; ++i)
+    {
+      // Drawn up front, the order in which operands are evaluated is
+      // unspecified.
+      const std::string site = GetSite(NextZipf(&random));
+      const std::string word = GetWord(NextZipf(&random));
+      const std::string secondWord = GetWord(NextZipf(&random));
+      const size_t type = i % 20;
+      if (type < 9)
+      {
+        patterns << "||" << GetHost(i) << "^";
+        if (type == 0)
+          patterns << "$third-party";
+        else if (type == 1)
+          patterns << "$script,domain=" << site;
+      }
+      else if (type < 12)
+        patterns << "/" << word << "/" << secondWord << i << ".$image";
+      else if (type == 12)
+        patterns << "@@||" << GetHost(i) << "^$image";
+      else if (type < 15)
+        patterns << "##." << word << "-" << i;
+      else if (type == 15)
+        patterns << site << "#@#." << word << "-" << i;
+      else
+        patterns << site << "##." << word << "-" << i;
+      patterns << "\n";
+    }
+    return patterns.str();
+  }
+
+  // Request URLs with the document URL which issued them: hosts of the
+  // largest generated lists and paths built from the same vocabulary.
+  static std::vector<std::pair<std::string, std::string>> GetRequests(size_t count)
+  {
+    std::mt19937 random(SEED + 1);
+    std::uniform_int_distribution<size_t> hosts(0, MAX_FILTER_COUNT);
+    std::vector<std::pair<std::string, std::string>> requests;
+    for (size_t i = 0; i < count; ++i)
+    {
+      const size_t host = hosts(random);
+      const std::string word = GetWord(NextZipf(&random));
+      const std::string secondWord = GetWord(NextZipf(&random));
+      const std::string site = GetSite(NextZipf(&random));
+      requests.emplace_back(i % 2 == 0 ? "https://" + GetHost(host) + "/ad.js"
+                                       : "https://cdn.example.com/" + word + "/" + secondWord +
+                                             std::to_string(host) + ".png",
+                            "https://" + site + "/");
+    }
+    return requests;
+  }
+
+  // Distinct document URLs, most of them with element hiding filters.
+  static std::vector<std::string> GetDomainUrls(size_t count)
+  {
+    std::vector<std::string> urls;
+    for (size_t i = 0; i < count; ++i)
+      urls.push_back("https://" + GetSite(i) + "/");
+    return urls;
+  }
+
+private:
+  static const unsigned SEED = 20210204;
+  static const size_t VOCABULARY_SIZE = 500;
+  static const size_t MAX_FILTER_COUNT = 500000;
+
+  size_t filterCount;
+
+  // Rank in [0, VOCABULARY_SIZE) with a probability proportional to
+  // 1 / (rank + 1).
+  static size_t NextZipf(std::mt19937* random)
+  {
+    static const std::vector<double> cumulative = []() {
+      std::vector<double> weights;
+      double sum = 0;
+      for (size_t rank = 1; rank <= VOCABULARY_SIZE; ++rank)
+        weights.push_back(sum += 1.0 / rank);
+      return weights;
+    }();
+    std::uniform_real_distribution<double> distribution(0, cumulative.back());
+    const auto it = std::upper_bound(cumulative.begin(), cumulative.end(), distribution(*random));
+    return std::min<size_t>(it - cumulative.begin(), VOCABULARY_SIZE - 1);
+  }
+
+  static std::string GetWord(size_t rank)
+  {
+    static const char* const WORDS[] = {
+        "ads", "banner", "track", "pixel", "sponsor", "promo", "popup", "analytics", "beacon"};
+    const size_t wordCount = sizeof(WORDS) / sizeof(WORDS[0]);
+    return rank < wordCount ? WORDS[rank] : WORDS[rank % wordCount] + std::to_string(rank);
+  }
+
+  static std::string GetHost(size_t index)
+  {
+    static const char* const TLDS[] = {"com", "net", "org", "de", "ru", "io"};
+    return "ad" + std::to_string(index) + "-" + GetWord(index % VOCABULARY_SIZE) + "." +
+           TLDS[index % (sizeof(TLDS) / sizeof(TLDS[0]))];
+  }
+
+  static std::string GetSite(size_t rank)
+  {
+    return "site" + std::to_string(rank) + ".example";
+  }
+};
+
+// Measures the memory taken by the filter engine with different filter lists,
+// every configuration gets its own platform.
+class MemoryHarnessTest : public HarnessTest
+{
+protected:
+  // Memory in use at some point, in bytes.
+  struct MemoryUsage
+  {
+    std::string name;
+    size_t usedHeapSize;
+    size_t externalMemory;
+    size_t mallocedMemory;
+    size_t rss;
+  };
+
+  std::vector<MemoryUsage> usages;
+
+  void SetUp() override
+  {
+  }
+
+  void TearDown() override
+  {
+    platform.reset();
+    std::remove(PATTERNS_FILE);
+  }
+
+  // patterns.ini with the subscriptions of the data folder up to the one
+  // with the given URL, e.g. just EasyList.
+  static std::string ReadPatterns(const std::string& lastUrl = "")
+  {
+    std::ifstream stream("data/patterns.ini");
+    EXPECT_TRUE(stream.is_open()) << "Cannot read data/patterns.ini";
+    std::string patterns;
+    std::string line;
+    bool last = false;
+    while (std::getline(stream, line))
+    {
+      if (last && line == "[Subscription]")
+        break;
+      if (!lastUrl.empty() && line == "url=" + lastUrl)
+        last = true;
+      patterns += line + "\n";
+    }
+    return patterns;
+  }
+
+  // Creates a platform and waits for its filter engine to load those filter
+  // lists.
+  void LoadPatterns(const std::string& patterns)
+  {
+    platform.reset();
+    std::ofstream(PATTERNS_FILE, std::ios_base::binary | std::ios_base::trunc) << patterns;
+
+    AdblockPlus::PlatformFactory::CreationParameters params;
+    params.executor = AdblockPlus::PlatformFactory::CreateExecutor();
+    params.fileSystem.reset(new ReadOnlyFileSystem(*params.executor, "."));
+    params.webRequest.reset(new NoopWebRequest());
+    platform = AdblockPlus::PlatformFactory::CreatePlatform(std::move(params));
+    platform->SetUp(CreateAppInfo());
+    platform->CreateFilterEngineAsync(CreateEngineParams());
+    GetFilterEngine();
+  }
+
+  // Creates a filter engine with those filter lists and records the memory
+  // usage under the name followed by `/loaded`, and once more after a full
+  // garbage collection followed by `/gc`.
+  void MeasureMemory(const std::string& name, const std::string& patterns)
+  {
+    LoadPatterns(patterns);
+    RecordMemoryUsage(name);
+  }
+
+  void RecordMemoryUsage(const std::string& name)
+  {
+    usages.push_back(GetMemoryUsage(name + "/loaded"));
+    GetJsEngine().NotifyLowMemory();
+    usages.push_back(GetMemoryUsage(name + "/gc"));
+  }
+
+  MemoryUsage GetMemoryUsage(const std::string& name)
+  {
+    const auto heap = GetJsEngine().GetHeapStatistics();
+    return {name, heap.usedHeapSize, heap.externalMemory, heap.mallocedMemory, GetRss()};
+  }
+
+  // Resident set size of the process, only known on Linux.
+  static size_t GetRss()
+  {
+    std::ifstream stream("/proc/self/status");
+    std::string line;
+    while (std::getline(stream, line))
+    {
+      if (line.compare(0, 6, "VmRSS:") == 0)
+        return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+    }
+    return 0;
+  }
+
+  // Prints the table and writes the results to HARNESS_RESULTS like
+  // ReportPerformance() does. Compared to HARNESS_BASELINE, a configuration
+  // regressed if the V8 heap and external memory after the garbage
+  // collection grew by more than REGRESSION_THRESHOLD.
+  void ReportMemory()
+  {
+    PrintMemory();
+    if (const char* results = std::getenv("HARNESS_RESULTS"))
+      WriteMemoryResults(results);
+    if (const char* baseline = std::getenv("HARNESS_BASELINE"))
+      CompareMemoryWithBaseline(baseline);
+  }
+
+  void PrintMemory() const
+  {
+    std::cout << std::left << std::setw(24) << "Name"
+              << " ;   Heap(KB) ; External(KB) ; Malloced(KB) ;    RSS(KB)" << std::endl;
+    for (const auto& usage : usages)
+      std::cout << std::left << std::setw(24) << usage.name << std::right << " ; "
+                << std::setw(10) << usage.usedHeapSize / 1024 << " ; " << std::setw(12)
+                << usage.externalMemory / 1024 << " ; " << std::setw(12)
+                << usage.mallocedMemory / 1024 << " ; " << std::setw(10) << usage.rss / 1024
+                << std::endl;
+  }
+
+  void WriteMemoryResults(const std::string& file) const
+  {
+    std::ofstream stream(file);
+    ASSERT_TRUE(stream.is_open()) << "Cannot write " << file;
+    const bool csv = file.size() >= 4 && file.compare(file.size() - 4, 4, ".csv") == 0;
+    if (csv)
+      stream << "name,usedHeapSize,externalMemory,mallocedMemory,rss\n";
+    else
+      stream << "{";
+    for (size_t i = 0; i < usages.size(); ++i)
+    {
+      const auto& u = usages[i];
+      if (csv)
+      {
+        stream << u.name << ',' << u.usedHeapSize << ',' << u.externalMemory << ','
+               << u.mallocedMemory << ',' << u.rss << "\n";
+        continue;
+      }
+      // Configuration names need no escaping.
+      stream << (i == 0 ? "\n" : ",\n") << "  \"" << u.name
+             << "\": {\"usedHeapSize\": " << u.usedHeapSize
+             << ", \"externalMemory\": " << u.externalMemory
+             << ", \"mallocedMemory\": " << u.mallocedMemory << ", \"rss\": " << u.rss << "}";
+    }
+    if (!csv)
+      stream << "\n}\n";
+  }
+
+  void CompareMemoryWithBaseline(const std::string& file)
+  {
+    const double REGRESSION_THRESHOLD = 0.05;
+
+    std::ifstream stream(file);
+    ASSERT_TRUE(stream.is_open()) << "Cannot read " << file;
+    std::stringstream content;
+    content << stream.rdbuf();
+    auto& engine = GetJsEngine();
+    AdblockPlus::JsValue baseline =
+        engine.Evaluate("str => JSON.parse(str)").Call(engine.NewValue(content.str()));
+
+    std::cout << std::endl
+              << "Compared to " << file << std::endl
+              << std::left << std::setw(24) << "Name"
+              << " ;    Heap(%) ; External(%) ;     RSS(%)" << std::endl;
+    for (const auto& usage : usages)
+    {
+      AdblockPlus::JsValue base = baseline.GetProperty(usage.name);
+      std::cout << std::left << std::setw(24) << usage.name << std::right;
+      if (!base.IsObject())
+      {
+        std::cout << " ; not in baseline" << std::endl;
+        continue;
+      }
+
+      const double baseHeap = base.GetProperty("usedHeapSize").AsDouble();
+      const double baseExternal = base.GetProperty("externalMemory").AsDouble();
+      std::cout << std::fixed << std::setprecision(3) << " ; " << std::setw(10)
+                << RelativeChange(usage.usedHeapSize, baseHeap) << " ; " << std::setw(11)
+                << RelativeChange(usage.externalMemory, baseExternal) << " ; " << std::setw(10)
+                << RelativeChange(usage.rss, base.GetProperty("rss").AsDouble()) << std::endl;
+      const double total = static_cast<double>(usage.usedHeapSize + usage.externalMemory);
+      const double baseTotal = baseHeap + baseExternal;
+      if (usage.name.size() >= 3 && usage.name.compare(usage.name.size() - 3, 3, "/gc") == 0)
+      {
+        EXPECT_LE(total, baseTotal * (1 + REGRESSION_THRESHOLD))
+            << usage.name << " takes more memory, " << total << " bytes instead of " << baseTotal;
+      }
+    }
+  }
+
+  static const char* const PATTERNS_FILE;
+};
+
+const char* const MemoryHarnessTest::PATTERNS_FILE = "patterns.ini";
+
+// Measures how loading, matching and element hiding scale with the size of the
+// filter list, see SyntheticFilterList.
+class ScalingHarnessTest : public MemoryHarnessTest
+{
+protected:
+  // Stores the load time, the time of every Matches() call and of every
+  // GetElementHidingStyleSheet() call under the name followed by `/load`,
+  // `/matches` and `/stylesheet`. Every request and domain is passed once,
+  // so that the caches of the engine don't hide the costs.
+  void MeasureScaling(const std::string& name, const SyntheticFilterList& list)
+  {
+    const std::string patterns = list.GetPatterns();
+    {
+      ElapsedTime timer;
+      LoadPatterns(patterns);
+      stats[name + "/load"].Add(timer.Microseconds());
+    }
+    RecordMemoryUsage(name);
+
+    auto& engine = GetFilterEngine();
+    for (const auto& request : SyntheticFilterList::GetRequests(REQUEST_COUNT))
+    {
+      const auto contentType = request.first.back() == 's'
+                                   ? AdblockPlus::IFilterEngine::CONTENT_TYPE_SCRIPT
+                                   : AdblockPlus::IFilterEngine::CONTENT_TYPE_IMAGE;
+      ElapsedTime timer;
+      engine.Matches(request.first, contentType, request.second);
+      stats[name + "/matches"].Add(timer.Microseconds());
+    }
+    for (const auto& url : SyntheticFilterList::GetDomainUrls(DOMAIN_COUNT))
+    {
+      ElapsedTime timer;
+      engine.GetElementHidingStyleSheet(url, true);
+      stats[name + "/stylesheet"].Add(timer.Microseconds());
+    }
+  }
+
+  static const size_t REQUEST_COUNT = 2000;
+  static const size_t DOMAIN_COUNT = 200;
+};
+
+// Measures the primitives of the JS bridge which DefaultFilterEngine is built
+// on, with a JS engine but no filter engine.
+class JsBridgeHarnessTest : public HarnessTest
+{
+protected:
+  // A single call takes less than the resolution of the timer, so the calls
+  // are timed in batches, each of them adding the mean time per call.
+  static const int BATCH_SIZE = 1000;
+  static const int BATCH_COUNT = 50;
+
+  void SetUp() override
+  {
+    AdblockPlus::PlatformFactory::CreationParameters params;
+    params.executor = AdblockPlus::PlatformFactory::CreateExecutor();
+    params.fileSystem.reset(new ReadOnlyFileSystem(*params.executor, "data"));
+    params.webRequest.reset(new NoopWebRequest());
+    platform = AdblockPlus::PlatformFactory::CreatePlatform(std::move(params));
+    platform->SetUp(CreateAppInfo());
+  }
+
+  template<typename Operation> void Measure(const std::string& name, Operation operation)
+  {
+    // Lets V8 optimize the code involved before the measurement.
+    for (int i = 0; i < BATCH_SIZE; ++i)
+      operation();
+    for (int batch = 0; batch < BATCH_COUNT; ++batch)
+    {
+      ElapsedTime timer;
+      for (int i = 0; i < BATCH_SIZE; ++i)
+        operation();
+      stats[name].Add(timer.Microseconds() / BATCH_SIZE);
+    }
+  }
+};
+
+// Measures the element hiding results of the sites in data/sites.txt, on
+// an engine with the default style sheet cache and on one without any.
+class ElementHidingHarnessTest : public HarnessTest
+{
+protected:
+  // Calls on the engine without the cache, and cache hits, are timed in
+  // batches, e.g. a hit takes less than the resolution of the timer.
+  static const int BATCH_SIZE = 20;
+
+  struct DomainResult
+  {
+    std::string domain;
+    bool specificOnly;
+    size_t styleSheetSize;
+    size_t selectorCount;
+    size_t emulationSelectorCount;
+    // Mean time per call in microseconds.
+    double uncached;
+    double firstCached;
+    double cached;
+  };
+
+  std::unique_ptr<AdblockPlus::Platform> uncachedPlatform;
+  std::vector<DomainResult> results;
+
+  void SetUp() override
+  {
+    HarnessTest::SetUp();
+
+    AdblockPlus::PlatformFactory::CreationParameters params;
+    params.executor = AdblockPlus::PlatformFactory::CreateExecutor();
+    params.fileSystem.reset(new ReadOnlyFileSystem(*params.executor, "data"));
+    params.webRequest.reset(new NoopWebRequest());
+    uncachedPlatform = AdblockPlus::PlatformFactory::CreatePlatform(std::move(params));
+    uncachedPlatform->SetUp(CreateAppInfo());
+    auto engineParams = CreateEngineParams();
+    engineParams.styleSheetCacheSize = 0;
+    uncachedPlatform->CreateFilterEngineAsync(engineParams);
+  }
+
+  // The hosts of the URLs which data/update.sh records.
+  static std::vector<std::string> ReadDomains()
+  {
+    std::ifstream stream("data/sites.txt");
+    EXPECT_TRUE(stream.is_open()) << "Cannot read data/sites.txt";
+    std::vector<std::string> domains;
+    std::string url;
+    while (std::getline(stream, url))
+    {
+      std::string host = AdblockPlus::URLInfo::ExtractHost(url);
+      if (!host.empty())
+        domains.push_back(std::move(host));
+    }
+    return domains;
+  }
+
+  // Selectors of the rules of a style sheet, the ones of a rule separated
+  // by commas outside of parentheses, brackets and strings.
+  static size_t CountSelectors(const std::string& styleSheet)
+  {
+    size_t count = 0;
+    int depth = 0;
+    char quote = 0;
+    bool inSelector = false;
+    for (size_t i = 0; i < styleSheet.size(); ++i)
+    {
+      const char c = styleSheet[i];
+      if (quote)
+      {
+        if (c == '\\')
+          ++i;
+        else if (c == quote)
+          quote = 0;
+      }
+      else if (c == '"' || c == '\'')
+        quote = c;
+      else if (c == '(' || c == '[')
+        ++depth;
+      else if (c == ')' || c == ']')
+        --depth;
+      else if (depth == 0 && c == '{')
+      {
+        count += inSelector ? 1 : 0;
+        inSelector = false;
+        i = styleSheet.find('}', i);
+        if (i == std::string::npos)
+          break;
+        continue;
+      }
+      else if (depth == 0 && c == ',')
+      {
+        count += inSelector ? 1 : 0;
+        inSelector = false;
+        continue;
+      }
+      if (!std::isspace(static_cast<unsigned char>(c)))
+        inSelector = true;
+    }
+    return count;
+  }
+
+  // The time of all calls which a frame takes, the style sheet and the
+  // element hiding emulation selectors.
+  static double GenerateBatch(const AdblockPlus::IFilterEngine& engine,
+                              const std::string& url,
+                              bool specificOnly,
+                              int count)
+  {
+    ElapsedTime timer;
+    for (int i = 0; i < count; ++i)
+    {
+      engine.GetElementHidingStyleSheet(url, specificOnly);
+      engine.GetElementHidingEmulationSelectors(url);
+    }
+    return timer.Microseconds() / count;
+  }
+
+  void MeasureDomain(const std::string& domain, bool specificOnly)
+  {
+    const std::string url = "https://" + domain + "/";
+    const auto& cachedEngine = GetFilterEngine();
+    const auto& uncachedEngine = uncachedPlatform->GetFilterEngine();
+
+    DomainResult result;
+    result.domain = domain;
+    result.specificOnly = specificOnly;
+    const std::string styleSheet = uncachedEngine.GetElementHidingStyleSheet(url, specificOnly);
+    result.styleSheetSize = styleSheet.size();
+    result.selectorCount = CountSelectors(styleSheet);
+    result.emulationSelectorCount = uncachedEngine.GetElementHidingEmulationSelectors(url).size();
+    result.uncached = GenerateBatch(uncachedEngine, url, specificOnly, BATCH_SIZE);
+    result.firstCached = GenerateBatch(cachedEngine, url, specificOnly, 1);
+    result.cached = GenerateBatch(cachedEngine, url, specificOnly, BATCH_SIZE);
+    EXPECT_EQ(styleSheet, cachedEngine.GetElementHidingStyleSheet(url, specificOnly));
+
+    const std::string prefix = specificOnly ? "elemhide/specific/" : "elemhide/";
+    stats[prefix + "uncached"].Add(result.uncached);
+    stats[prefix + "first-cached"].Add(result.firstCached);
+    stats[prefix + "cached"].Add(result.cached);
+    results.push_back(result);
+  }
+
+  void PrintDomains() const
+  {
+    std::cout << std::left << std::fixed << std::setprecision(3) << std::setw(28) << "Domain"
+              << " ; Specific ;  Size(B) ;  Selectors ; Emulation ; Uncached(us) ;"
+                 " First(us) ; Cached(us)"
+              << std::endl;
+    for (const auto& result : results)
+    {
+      std::cout << std::left << std::setw(28) << result.domain << std::right << " ; "
+                << std::setw(8) << (result.specificOnly ? "yes" : "no") << " ; " << std::setw(8)
+                << result.styleSheetSize << " ; " << std::setw(10) << result.selectorCount
+                << " ; " << std::setw(9) << result.emulationSelectorCount << " ; "
+                << std::setw(12) << result.uncached << " ; " << std::setw(9)
+                << result.firstCached << " ; " << std::setw(10) << result.cached << std::endl;
+    }
+    std::cout << std::endl;
   }
 };
 
 TEST_F(HarnessTest, AllSites)
 {
-  MatchFromFile("data/rec_abudhabi_dubizzle_com.log");
-  MatchFromFile("data/rec_allegro_pl.log");
-  MatchFromFile("data/rec_chron_com.log");
-  MatchFromFile("data/rec_cn_hao123_com.log");
-  MatchFromFile("data/rec_en_wikipedia_org.log");
-  MatchFromFile("data/rec_laodong_vn.log");
-  MatchFromFile("data/rec_news_mail_ru.log");
-  MatchFromFile("data/rec_search_yahoo_com.log");
-  MatchFromFile("data/rec_shopee_vn.log");
-  MatchFromFile("data/rec_shortorial_com.log");
-  MatchFromFile("data/rec_thethao247_vn.log");
-  MatchFromFile("data/rec_vk_com.log");
-  MatchFromFile("data/rec_vnexpress_net.log");
-  MatchFromFile("data/rec_vtv_vn.log");
-  MatchFromFile("data/rec_web_de.log");
-  MatchFromFile("data/rec_www_1tv_ge.log");
-  MatchFromFile("data/rec_www_24h_com_vn.log");
-  MatchFromFile("data/rec_www_amazon_com.log");
-  MatchFromFile("data/rec_www_aparat_com.log");
-  MatchFromFile("data/rec_www_baidu_com.log");
-  MatchFromFile("data/rec_www_bbc_com.log");
-  MatchFromFile("data/rec_www_bedienungsanleitu_ng.log");
-  MatchFromFile("data/rec_www_bing_com.log");
-  MatchFromFile("data/rec_www_boston_com.log");
-  MatchFromFile("data/rec_www_dailymail_co_uk.log");
-  MatchFromFile("data/rec_www_ebay_com.log");
-  MatchFromFile("data/rec_www_flipkart_com.log");
-  MatchFromFile("data/rec_www_forbes_com.log");
-  MatchFromFile("data/rec_www_google_com.log");
-  MatchFromFile("data/rec_www_imdb_com.log");
-  MatchFromFile("data/rec_www_indiatimes_com.log");
-  MatchFromFile("data/rec_www_libero_it.log");
-  MatchFromFile("data/rec_www_manoramaonline_com.log");
-  MatchFromFile("data/rec_www_myauto_ge.log");
-  MatchFromFile("data/rec_www_ndtv_com.log");
-  MatchFromFile("data/rec_www_olx_ro.log");
-  MatchFromFile("data/rec_www_online2pdf_com.log");
-  MatchFromFile("data/rec_www_quora_com.log");
-  MatchFromFile("data/rec_www_reddit_com.log");
-  MatchFromFile("data/rec_www_repubblica_it.log");
-  MatchFromFile("data/rec_www_sapo_pt.log");
-  MatchFromFile("data/rec_www_techradar_com.log");
-  MatchFromFile("data/rec_www_tomsguide_com.log");
-  MatchFromFile("data/rec_www_trustedreviews_com.log");
-  MatchFromFile("data/rec_www_twitch_tv.log");
-  MatchFromFile("data/rec_www_wp_pl.log");
-  MatchFromFile("data/rec_www_xvideos_com.log");
-  MatchFromFile("data/rec_www_youtube_com.log");
-  MatchFromFile("data/rec_yandex_com.log");
+  for (const auto& file : RECORDINGS)
+    MatchFromFile(file);
+
+  ReportPerformance();
+}
+
+// Replays all recordings HARNESS_WARMUP times, 1 by default, without
+// measuring anything, so that the JIT and the caches are warm. Then each
+// recording is replayed HARNESS_REPETITIONS times in a row, 5 by default,
+// and the results include the thread CPU time and the totals of each site.
+TEST_F(HarnessTest, AllSitesRepeated)
+{
+  int warmup = 1;
+  if (const char* value = std::getenv("HARNESS_WARMUP"))
+    warmup = std::max(std::atoi(value), 0);
+  int repetitions = 5;
+  if (const char* value = std::getenv("HARNESS_REPETITIONS"))
+    repetitions = std::max(std::atoi(value), 1);
+
+  std::vector<Recording> recordings;
+  for (const auto& file : RECORDINGS)
+    recordings.push_back(ReadRecording(file));
+
+  std::map<std::string, CallStats> warmupStats;
+  for (int i = 0; i < warmup; ++i)
+  {
+    for (const auto& recording : recordings)
+    {
+      for (const auto& call : recording)
+        MatchRecorded(call, &warmupStats);
+    }
+  }
+  for (size_t i = 0; i < recordings.size(); ++i)
+    MatchRepeatedly(GetSiteName(RECORDINGS[i]), recordings[i], repetitions);
+
+  ReportPerformance();
+}
+
+// Replays the recordings on one thread and then on HARNESS_THREADS threads,
+// by default one per core but at least two, to measure lock contention.
+TEST_F(HarnessTest, AllSitesConcurrent)
+{
+  std::vector<Recording> recordings;
+  for (const auto& file : RECORDINGS)
+    recordings.push_back(ReadRecording(file));
+
+  size_t threadCount = std::max(std::thread::hardware_concurrency(), 2u);
+  if (const char* threads = std::getenv("HARNESS_THREADS"))
+    threadCount = std::max(std::atoi(threads), 1);
+
+  MatchConcurrently(recordings, 1);
+  if (threadCount > 1)
+    MatchConcurrently(recordings, threadCount);
+
+  ReportPerformance();
+}
+
+// Starts once without a code cache, as on the first launch of an
+// application, and then HARNESS_STARTUP_RUNS times, 10 by default, with the
+// code cache recorded by the previous run. Only the first start in a process
+// initializes V8, so run the test on its own for meaningful cold numbers.
+TEST_F(StartupHarnessTest, Startup)
+{
+  int runs = 10;
+  if (const char* value = std::getenv("HARNESS_STARTUP_RUNS"))
+    runs = std::max(std::atoi(value), 1);
+
+  AdblockPlus::JsEngine::CodeCache codeCache;
+  MeasureStartup("cold/", &codeCache);
+  for (int i = 0; i < runs; ++i)
+    MeasureStartup("warm/", &codeCache);
+
+  ReportPerformance();
+}
+
+// Loads EasyList, EasyList with the acceptable ads exceptions, the
+// patterns.ini files which HARNESS_MEMORY_PATTERNS lists separated by
+// spaces (e.g. taken from a device with regional lists), and synthetic lists
+// of 10k, 100k and 500k filters.
+TEST_F(MemoryHarnessTest, SubscriptionConfigurations)
+{
+  MeasureMemory("easylist",
+                ReadPatterns("https://easylist-downloads.adblockplus.org/easylist.txt"));
+  MeasureMemory("easylist+aa", ReadPatterns());
+  if (const char* files = std::getenv("HARNESS_MEMORY_PATTERNS"))
+  {
+    std::istringstream list(files);
+    std::string file;
+    while (list >> file)
+    {
+      std::ifstream stream(file);
+      ASSERT_TRUE(stream.is_open()) << "Cannot read " << file;
+      std::stringstream content;
+      content << stream.rdbuf();
+      MeasureMemory(file, content.str());
+    }
+  }
+  for (size_t filterCount : {10000, 100000, 500000})
+    MeasureMemory("synthetic-" + std::to_string(filterCount / 1000) + "k",
+                  SyntheticFilterList(filterCount).GetPatterns());
+
+  ReportMemory();
+}
+
+// Every JsValue call locks the engine on its own, as it happens in
+// DefaultFilterEngine, so the locking is part of the measured costs.
+TEST_F(JsBridgeHarnessTest, Primitives)
+{
+  auto& engine = GetJsEngine();
+  for (size_t length : {16, 1024, 65536})
+  {
+    const std::string str(length, 'a');
+    const std::string suffix = "/" + std::to_string(length);
+    Measure("NewValue" + suffix, [&]() { engine.NewValue(str); });
+    const AdblockPlus::JsValue value = engine.NewValue(str);
+    Measure("AsString" + suffix, [&]() { value.AsString(); });
+  }
+
+  for (size_t length : {10, 1000})
+  {
+    const AdblockPlus::JsValue list =
+        engine.NewArray(std::vector<std::string>(length, "||example.com^"));
+    Measure("AsList/" + std::to_string(length), [&]() { list.AsList(); });
+  }
+
+  const AdblockPlus::JsValue object = engine.Evaluate("({text: 'example', type: 'blocking'})");
+  Measure("GetProperty", [&]() { object.GetProperty("type"); });
+
+  const AdblockPlus::JsValue function = engine.Evaluate("(...args) => args.length");
+  for (int argCount = 0; argCount <= 5; ++argCount)
+  {
+    const AdblockPlus::JsValueList args(argCount, engine.NewValue("https://example.com/"));
+    Measure("Call/" + std::to_string(argCount), [&]() { function.Call(args); });
+  }
+
+  Measure("Evaluate", [&]() { engine.Evaluate("1 + 1"); });
+
+  // Stores the values in the engine and takes them back, see
+  // JsEngine::StoreJsValues() and JsEngine::TakeJsValues().
+  for (size_t count : {1, 5})
+  {
+    const AdblockPlus::JsValueList values(count, object);
+    Measure("WeakValues/" + std::to_string(count), [&]() {
+      AdblockPlus::JsEngine::ScopedWeakValues weakValues(&engine, values);
+      weakValues.Values();
+    });
+  }
+
+  ReportPerformance();
+}
+
+// The sizes are zero-padded for the results to be listed in order, e.g.
+// `010k/matches`.
+TEST_F(ScalingHarnessTest, GrowingFilterLists)
+{
+  for (size_t filterCount : {1000, 10000, 100000, 500000})
+  {
+    std::stringstream name;
+    name << std::setw(3) << std::setfill('0') << filterCount / 1000 << "k";
+    MeasureScaling(name.str(), SyntheticFilterList(filterCount));
+  }
+
+  ReportPerformance();
+  std::cout << std::endl;
+  PrintMemory();
+}
+
+// The style sheet of every site in data/sites.txt, with and without
+// `specificOnly`: its size, selectors and element hiding emulation selectors,
+// and how long generating it takes without a cache, on the first call with
+// the default cache and on the calls after that. The aggregated timings go to
+// HARNESS_RESULTS like the ones of the other tests.
+TEST_F(ElementHidingHarnessTest, StyleSheetsPerDomain)
+{
+  for (const auto& domain : ReadDomains())
+  {
+    for (bool specificOnly : {false, true})
+      MeasureDomain(domain, specificOnly);
+  }
 
+  PrintDomains();
   ReportPerformance();
 }
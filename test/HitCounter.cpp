@@ -0,0 +1,114 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../src/HitCounter.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  class ManualTimer : public ITimer
+  {
+  public:
+    std::vector<std::pair<std::chrono::milliseconds, TimerCallback>> tasks;
+
+    void SetTimer(const std::chrono::milliseconds& timeout,
+                  const TimerCallback& timerCallback) override
+    {
+      tasks.emplace_back(timeout, timerCallback);
+    }
+  };
+
+  class HitCounterTest : public ::testing::Test
+  {
+  protected:
+    ManualTimer timer;
+    int64_t now = 1000;
+    std::vector<std::vector<HitCounter::FilterHits>> flushes;
+    std::shared_ptr<HitCounter> counter = std::make_shared<HitCounter>(
+        timer,
+        [this](std::vector<HitCounter::FilterHits>&& hits) { flushes.push_back(std::move(hits)); },
+        std::chrono::milliseconds(5000),
+        [this]() { return now; });
+    std::shared_ptr<const std::string> foo = std::make_shared<std::string>("foo");
+    std::shared_ptr<const std::string> bar = std::make_shared<std::string>("bar");
+
+    void RunTimer()
+    {
+      ASSERT_EQ(1u, timer.tasks.size());
+      auto task = timer.tasks.front();
+      timer.tasks.clear();
+      task.second();
+    }
+  };
+}
+
+TEST_F(HitCounterTest, HitsAreIgnoredUnlessEnabled)
+{
+  EXPECT_FALSE(counter->IsEnabled());
+  counter->RecordHit(foo);
+  EXPECT_TRUE(timer.tasks.empty());
+  counter->Flush();
+  EXPECT_TRUE(flushes.empty());
+}
+
+TEST_F(HitCounterTest, HitsAreSummedUpPerFilter)
+{
+  counter->SetEnabled(true);
+  counter->RecordHit(foo);
+  now = 3000;
+  counter->RecordHit(bar);
+  now = 2000;
+  counter->RecordHit(foo);
+  ASSERT_EQ(1u, timer.tasks.size()) << "only the first hit schedules a flush";
+  EXPECT_EQ(std::chrono::milliseconds(5000), timer.tasks.front().first);
+  EXPECT_TRUE(flushes.empty());
+
+  RunTimer();
+  ASSERT_EQ(1u, flushes.size());
+  ASSERT_EQ(2u, flushes[0].size());
+  EXPECT_EQ(foo, flushes[0][0].filterText);
+  EXPECT_EQ(2u, flushes[0][0].count);
+  EXPECT_EQ(2000, flushes[0][0].lastHit);
+  EXPECT_EQ(bar, flushes[0][1].filterText);
+  EXPECT_EQ(1u, flushes[0][1].count);
+  EXPECT_EQ(3000, flushes[0][1].lastHit);
+
+  counter->RecordHit(bar);
+  EXPECT_EQ(1u, timer.tasks.size()) << "the next hit schedules another flush";
+}
+
+TEST_F(HitCounterTest, FlushRunsOnlyWithPendingHits)
+{
+  counter->SetEnabled(true);
+  counter->RecordHit(foo);
+  counter->Flush();
+  EXPECT_EQ(1u, flushes.size());
+  RunTimer();
+  EXPECT_EQ(1u, flushes.size());
+}
+
+TEST_F(HitCounterTest, ScheduledFlushIsSkippedAfterDestruction)
+{
+  counter->SetEnabled(true);
+  counter->RecordHit(foo);
+  counter.reset();
+  RunTimer();
+  EXPECT_TRUE(flushes.empty());
+}
@@ -0,0 +1,47 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/HostCache.h"
+
+#include <gtest/gtest.h>
+
+using namespace AdblockPlus;
+
+TEST(HostCacheTest, ConvertsHostAndListsParentDomains)
+{
+  auto host = HostCache::Get("WWW.B\xc3\xbc" "cher.DE.");
+  ASSERT_TRUE(host->valid);
+  EXPECT_EQ("WWW.xn--Bcher-kva.DE.", host->hostname);
+  EXPECT_EQ(std::vector<std::string>({"www.xn--bcher-kva.de", "xn--bcher-kva.de", "de"}),
+            host->domains);
+
+  host = HostCache::Get("");
+  EXPECT_TRUE(host->valid);
+  EXPECT_TRUE(host->domains.empty());
+}
+
+TEST(HostCacheTest, CachedHostsAreReused)
+{
+  auto host = HostCache::Get("example.com");
+  EXPECT_EQ(host, HostCache::Get("example.com"));
+  EXPECT_NE(host, HostCache::Get("Example.com"));
+
+  HostCache::Clear();
+  auto converted = HostCache::Get("example.com");
+  EXPECT_NE(host, converted);
+  EXPECT_EQ(host->domains, converted->domains);
+}
@@ -15,8 +15,16 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "../src/ApiCallStats.h"
+#include "../src/JsContext.h"
 #include "BaseJsTest.h"
 
 using namespace AdblockPlus;
@@ -63,6 +71,26 @@ TEST_F(JsEngineTest, ValueCreation)
   ASSERT_EQ(0u, value.GetOwnPropertyNames().size());
 }
 
+TEST_F(JsEngineTest, ExternalValueCreation)
+{
+  const std::string ascii(100000, 'a');
+  auto value = GetJsEngine().NewExternalValue(std::string(ascii));
+  ASSERT_TRUE(value.IsString());
+  EXPECT_EQ(ascii, value.AsString());
+  GetJsEngine().SetGlobalProperty("external", value);
+  EXPECT_EQ(100000, GetJsEngine().Evaluate("external.length").AsInt());
+  EXPECT_EQ("aab", GetJsEngine().Evaluate("external.slice(-2) + 'b'").AsString());
+
+  const std::string utf8 = ascii + "\xc3\xa4";
+  value = GetJsEngine().NewExternalValue(StringBuffer(utf8.begin(), utf8.end()));
+  EXPECT_EQ(utf8, value.AsString()) << "non-ASCII strings are copied";
+
+  value = GetJsEngine().NewExternalValue(
+      std::unique_ptr<IPreloadedFilterResponse>(new StringPreloadedFilterResponse(ascii)));
+  EXPECT_EQ(ascii, value.AsString());
+  EXPECT_EQ("", GetJsEngine().NewExternalValue(std::string()).AsString());
+}
+
 TEST_F(JsEngineTest, ArrayCreation)
 {
   auto value = GetJsEngine().NewArray({"foo", "bar"});
@@ -183,6 +211,137 @@ TEST_F(JsEngineTest, GlobalPropertyTest)
   ASSERT_EQ(foo.AsString(), "bar");
 }
 
+TEST_F(JsEngineTest, ApiFunctionsAreCached)
+{
+  auto& jsEngine = GetJsEngine();
+  jsEngine.Evaluate("var API = {foo() { return 1; }, bar: 42}");
+  EXPECT_EQ(1, jsEngine.GetApiFunction("foo").Call().AsInt());
+  EXPECT_THROW(jsEngine.GetApiFunction("bar"), std::runtime_error);
+  EXPECT_THROW(jsEngine.GetApiFunction("baz"), std::runtime_error);
+
+  // The cached handle is used until the functions are resolved again.
+  jsEngine.Evaluate("API.foo = function() { return 2; }");
+  EXPECT_EQ(1, jsEngine.GetApiFunction("foo").Call().AsInt());
+  jsEngine.ResolveApiFunctions();
+  EXPECT_EQ(2, jsEngine.GetApiFunction("foo").Call().AsInt());
+}
+
+TEST_F(JsEngineTest, HeapStatistics)
+{
+  const auto before = GetJsEngine().GetHeapStatistics();
+  EXPECT_GT(before.totalHeapSize, 0u);
+  EXPECT_GT(before.usedHeapSize, 0u);
+  EXPECT_LE(before.usedHeapSize, before.totalHeapSize);
+  EXPECT_GE(before.heapSizeLimit, before.totalHeapSize);
+  ASSERT_FALSE(before.spaces.empty());
+  for (const auto& space : before.spaces)
+  {
+    EXPECT_FALSE(space.name.empty());
+    EXPECT_LE(space.usedSize, space.size);
+  }
+
+  GetJsEngine().Evaluate("this.buffer = new ArrayBuffer(1024 * 1024)");
+  EXPECT_GE(GetJsEngine().GetHeapStatistics().externalMemory, 1024u * 1024u);
+}
+
+TEST(JsEngineHeapLimitsTest, HeapLimitsAreApplied)
+{
+  auto params = ThrowingPlatformCreationParameters();
+  params.heapLimits.maxOldGenerationSize = 64 * 1024 * 1024;
+  params.heapLimits.maxYoungGenerationSize = 4 * 1024 * 1024;
+  auto platform = PlatformFactory::CreatePlatform(std::move(params));
+  auto& jsEngine = static_cast<DefaultPlatform*>(platform.get())->GetJsEngine();
+  const auto limited = jsEngine.GetHeapStatistics().heapSizeLimit;
+
+  auto defaultPlatform = PlatformFactory::CreatePlatform(ThrowingPlatformCreationParameters());
+  auto& defaultJsEngine = static_cast<DefaultPlatform*>(defaultPlatform.get())->GetJsEngine();
+  EXPECT_LT(limited, defaultJsEngine.GetHeapStatistics().heapSizeLimit);
+  EXPECT_LE(limited, 128u * 1024 * 1024);
+}
+
+TEST_F(JsEngineTest, RepeatedlyEvaluatedScriptsRunEveryTime)
+{
+  auto& jsEngine = GetJsEngine();
+  const std::string source = "this.counter = (this.counter || 0) + 1";
+  EXPECT_EQ(1, jsEngine.Evaluate(source).AsInt());
+  EXPECT_EQ(2, jsEngine.Evaluate(source).AsInt());
+  EXPECT_EQ(3, jsEngine.Evaluate(source, "counter.js").AsInt());
+  EXPECT_EQ(4, jsEngine.Evaluate(source, "counter.js").AsInt());
+  for (int i = 0; i < 2; ++i)
+  {
+    EXPECT_THROW(jsEngine.Evaluate("doesnotexist()"), std::runtime_error);
+    EXPECT_THROW(jsEngine.Evaluate("'foo'bar'"), std::runtime_error);
+  }
+}
+
+TEST_F(JsEngineTest, CodeCacheIsRecordedAndConsumed)
+{
+  const std::string source = "var answer = (function() { return 42; })(); answer";
+  auto& jsEngine = GetJsEngine();
+  jsEngine.SetCodeCache(JsEngine::CodeCache(), true);
+  EXPECT_EQ(42, jsEngine.Evaluate(source, "answer.js").AsInt());
+  jsEngine.Evaluate("1 + 1");
+  ASSERT_EQ(1u, jsEngine.GetCodeCache().size()) << "scripts without a file name are skipped";
+  EXPECT_FALSE(jsEngine.GetCodeCache().at("answer.js").data.empty());
+
+  const auto data = JsEngine::SerializeCodeCache(jsEngine.GetCodeCache());
+  JsEngine::CodeCache restored;
+  ASSERT_TRUE(JsEngine::DeserializeCodeCache(data, &restored));
+  EXPECT_EQ(jsEngine.GetCodeCache(), restored);
+  EXPECT_FALSE(JsEngine::DeserializeCodeCache(
+      IFileSystem::IOBuffer(data.begin(), data.end() - 1), &restored));
+  EXPECT_TRUE(restored.empty());
+  EXPECT_FALSE(JsEngine::DeserializeCodeCache(IFileSystem::IOBuffer(), &restored));
+
+  auto params = ThrowingPlatformCreationParameters();
+  params.codeCache = data;
+  platform = PlatformFactory::CreatePlatform(std::move(params));
+  auto& cachedJsEngine = GetJsEngine();
+  ASSERT_EQ(1u, cachedJsEngine.GetCodeCache().size());
+  EXPECT_EQ(42, cachedJsEngine.Evaluate(source, "answer.js").AsInt());
+  EXPECT_TRUE(cachedJsEngine.GetCodeCache().empty()) << "consumed entries are dropped";
+}
+
+TEST(JsEngineProfilerTest, CpuProfileAndHeapSnapshotAreWritten)
+{
+  auto params = ThrowingPlatformCreationParameters();
+  auto* fileSystem = new InMemoryFileSystem();
+  params.fileSystem.reset(fileSystem);
+  auto platform = PlatformFactory::CreatePlatform(std::move(params));
+  auto& jsEngine = static_cast<DefaultPlatform*>(platform.get())->GetJsEngine();
+  auto readFile = [fileSystem](const std::string& fileName) {
+    std::string content;
+    fileSystem->Read(fileName,
+                     [&content](IFileSystem::IOBuffer&& data) {
+                       content.assign(data.begin(), data.end());
+                     },
+                     [](const std::string& error) { FAIL() << error; });
+    return content;
+  };
+
+  std::string error = "not called";
+  jsEngine.StopCpuProfile([&error](const std::string& result) { error = result; });
+  EXPECT_FALSE(error.empty()) << "no profile is being recorded";
+
+  ASSERT_TRUE(jsEngine.StartCpuProfile("test"));
+  EXPECT_FALSE(jsEngine.StartCpuProfile("other"));
+  jsEngine.Evaluate("for (var i = 0, s = 0; i < 100000; i++) s += i;");
+  error = "not called";
+  jsEngine.StopCpuProfile([&error](const std::string& result) { error = result; });
+  EXPECT_EQ("", error);
+  const std::string profile = readFile("test.cpuprofile");
+  EXPECT_EQ(0u, profile.find("{\"nodes\":[{\"id\":"));
+  EXPECT_NE(std::string::npos, profile.find("\"timeDeltas\":["));
+  EXPECT_TRUE(jsEngine.StartCpuProfile("again")) << "the profiler is released on stop";
+  jsEngine.StopCpuProfile([](const std::string&) {});
+
+  error = "not called";
+  jsEngine.TakeHeapSnapshot("test.heapsnapshot",
+                            [&error](const std::string& result) { error = result; });
+  EXPECT_EQ("", error);
+  EXPECT_EQ(0u, readFile("test.heapsnapshot").find("{\"snapshot\":"));
+}
+
 #if UINTPTR_MAX == UINT32_MAX // detection of 32-bit platform
 static_assert(sizeof(intptr_t) == 4, "It should be 32bit platform");
 TEST_F(JsEngineTest, 32bitsOnly_MemoryLeak_NoLeak)
@@ -205,3 +364,80 @@ TEST_F(JsEngineTest, DISABLED_32bitsOnly_MemoryLeak_NoLeak)
     JsEngine::New(AppInfo(), interfaces);
   }
 }
+
+TEST_F(JsEngineTest, ApiCallsDontInterruptScripts)
+{
+  auto& jsEngine = GetJsEngine();
+  jsEngine.Evaluate("var halfway = false;");
+  std::promise<void> started;
+  jsEngine.SetEventCallback("started", [&started](JsValueList&&) { started.set_value(); });
+  std::thread background([&jsEngine]() {
+    jsEngine.Evaluate("halfway = true; _triggerEvent('started'); "
+                      "let end = Date.now() + 300; while (Date.now() < end) {} halfway = false;");
+  });
+  started.get_future().wait();
+
+  ApiCallRecorder recorder;
+  {
+    const ScopedApiCall apiCall(recorder);
+    EXPECT_FALSE(jsEngine.Evaluate("halfway").AsBool());
+  }
+  background.join();
+}
+
+TEST_F(JsEngineTest, ApiCallsGetTheLockBetweenCompletions)
+{
+  auto& jsEngine = GetJsEngine();
+  jsEngine.Evaluate("var order = [];");
+  std::promise<void> started;
+  std::thread background([&jsEngine, &started]() {
+    jsEngine.PostCompletion([&started]() {
+      started.set_value();
+      std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    });
+  });
+  started.get_future().wait();
+  // Left to the background thread, which is delivering completions.
+  jsEngine.PostCompletion([&jsEngine]() { jsEngine.Evaluate("order.push('completion')"); });
+
+  ApiCallRecorder recorder;
+  {
+    const ScopedApiCall apiCall(recorder);
+    jsEngine.Evaluate("order.push('api')");
+  }
+  background.join();
+  EXPECT_EQ("api,completion", jsEngine.Evaluate("order.join()").AsString());
+}
+
+TEST_F(JsEngineTest, CompletionsWaitingForTheLockAreDeliveredTogether)
+{
+  auto& jsEngine = GetJsEngine();
+  jsEngine.Evaluate("var settled = [];");
+  std::atomic<int> returned(0);
+  int delivered = 0;
+  std::vector<std::thread> threads;
+  {
+    const JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+    for (int i = 0; i < 3; i++)
+    {
+      threads.emplace_back([&jsEngine, &returned, &delivered, i] {
+        jsEngine.PostCompletion([&jsEngine, &delivered, i] {
+          jsEngine.Evaluate("Promise.resolve(" + std::to_string(i) +
+                            ").then(value => settled.push(value))");
+          ++delivered;
+        });
+        ++returned;
+      });
+    }
+    // Only the thread which runs the completions waits for the lock.
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (returned < 2 && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::yield();
+    EXPECT_EQ(2, returned);
+    EXPECT_EQ(0, delivered);
+  }
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_EQ(3, delivered);
+  EXPECT_EQ(3, jsEngine.Evaluate("settled.length").AsInt());
+}
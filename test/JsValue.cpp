@@ -15,6 +15,10 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <memory>
+#include <thread>
+
+#include "../src/JsContext.h"
 #include "BaseJsTest.h"
 
 namespace
@@ -184,6 +188,50 @@ TEST_F(JsValueTest, ArrayValue)
   ASSERT_ANY_THROW(value.Call());
 }
 
+TEST_F(JsValueTest, TypedArrayConversions)
+{
+  auto strings = GetJsEngine().Evaluate("['foo', 5, null]");
+  EXPECT_EQ(std::vector<std::string>({"foo", "5", "null"}), strings.AsStringVector());
+  auto numbers = GetJsEngine().Evaluate("[5, -8, '12', 1.5]");
+  EXPECT_EQ(std::vector<int64_t>({5, -8, 12, 1}), numbers.AsInt64Vector());
+  EXPECT_TRUE(GetJsEngine().Evaluate("[]").AsStringVector().empty());
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("'foo'").AsStringVector());
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("({})").AsInt64Vector());
+}
+
+TEST_F(JsValueTest, ObjectsAndRecordsAreMapped)
+{
+  struct Entry
+  {
+    std::string name;
+    int64_t count;
+    bool enabled;
+  };
+
+  auto objects = GetJsEngine().Evaluate("[{name: 'a', count: 2, enabled: true}, {name: 'b'}]");
+  const auto entries = objects.MapObjects<Entry>(
+      {"name", "count", "enabled"},
+      [](const AdblockPlus::JsFieldReader& fields) {
+        EXPECT_EQ(3u, fields.GetFieldCount());
+        return Entry{fields.AsString(0), fields.AsInt(1), fields.AsBool(2)};
+      });
+  ASSERT_EQ(2u, entries.size());
+  EXPECT_EQ("a", entries[0].name);
+  EXPECT_EQ(2, entries[0].count);
+  EXPECT_TRUE(entries[0].enabled);
+  EXPECT_EQ("b", entries[1].name);
+  EXPECT_FALSE(entries[1].enabled);
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("[1]").VisitObjects(
+      {"name"}, [](const AdblockPlus::JsFieldReader&) {}));
+
+  std::vector<std::string> records;
+  GetJsEngine().Evaluate("['a', 1, 'b', 2, 'c']").VisitRecords(
+      2, [&records](const AdblockPlus::JsFieldReader& fields) {
+        records.push_back(fields.AsString(0) + "=" + std::to_string(fields.AsInt(1)));
+      });
+  EXPECT_EQ(std::vector<std::string>({"a=1", "b=2"}), records);
+}
+
 TEST_F(JsValueTest, FunctionValue)
 {
   auto value =
@@ -226,6 +274,21 @@ TEST_F(JsValueTest, ThrowingConversion)
   ASSERT_ANY_THROW(value.AsInt());
 }
 
+TEST_F(JsValueTest, DeferredReleaseDoesNotWaitForTheEngine)
+{
+  auto& jsEngine = GetJsEngine();
+  jsEngine.EnableDeferredValueRelease();
+  std::unique_ptr<AdblockPlus::JsValue> value(
+      new AdblockPlus::JsValue(jsEngine.Evaluate("({foo: 'bar'})")));
+  {
+    const AdblockPlus::JsContext context(jsEngine.GetIsolate(), *jsEngine.GetContext());
+    // The thread would wait for the lock held here otherwise.
+    std::thread([&value] { value.reset(); }).join();
+  }
+  // Released by the next call.
+  ASSERT_EQ(2, jsEngine.Evaluate("1 + 1").AsInt());
+}
+
 #if defined(MAKE_ISOLATE_IN_JS_VALUE_WEAK)
 TEST_F(JsValueTest, JsValueGoesAwayAfterEngineWithoutCrash)
 {
@@ -0,0 +1,131 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <AdblockPlus/Metrics.h>
+
+#include <gtest/gtest.h>
+
+#include "BaseJsTest.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  class CountingMetricsObserver : public MetricsObserver
+  {
+  public:
+    std::vector<MetricsSnapshot> snapshots;
+
+    void OnMetrics(const MetricsSnapshot& snapshot) override
+    {
+      snapshots.push_back(snapshot);
+    }
+  };
+
+  class MetricsTest : public BaseJsTest
+  {
+  protected:
+    DelayedTimer::SharedTasks timerTasks;
+
+    void SetUp() override
+    {
+      ThrowingPlatformCreationParameters platformParams;
+      platformParams.timer = DelayedTimer::New(timerTasks);
+      platform = PlatformFactory::CreatePlatform(std::move(platformParams));
+    }
+
+    void RunTimer()
+    {
+      ASSERT_EQ(1u, timerTasks->size());
+      auto task = timerTasks->front();
+      timerTasks->clear();
+      task.callback();
+    }
+  };
+}
+
+TEST_F(MetricsTest, ObserverReceivesSnapshotsPeriodically)
+{
+  GetJsEngine();
+  auto observer = std::make_shared<CountingMetricsObserver>();
+  platform->SetMetricsObserver(observer, std::chrono::seconds(10));
+  ASSERT_EQ(1u, timerTasks->size());
+  EXPECT_EQ(std::chrono::seconds(10), timerTasks->front().timeout);
+
+  RunTimer();
+  ASSERT_EQ(1u, observer->snapshots.size());
+  EXPECT_GT(observer->snapshots[0].timestamp, 0);
+  EXPECT_GT(observer->snapshots[0].heap.usedHeapSize, 0u);
+  EXPECT_FALSE(observer->snapshots[0].hasFilterEngine);
+
+  RunTimer();
+  EXPECT_EQ(2u, observer->snapshots.size());
+
+  platform->SetMetricsObserver(nullptr, std::chrono::seconds(10));
+  for (const auto& task : *timerTasks)
+    task.callback();
+  EXPECT_EQ(2u, observer->snapshots.size()) << "the reports stop";
+}
+
+TEST_F(MetricsTest, ReportsStopWithThePlatform)
+{
+  auto observer = std::make_shared<CountingMetricsObserver>();
+  platform->SetMetricsObserver(observer, std::chrono::seconds(10));
+  ASSERT_EQ(1u, timerTasks->size());
+  auto task = timerTasks->front();
+  platform.reset();
+  task.callback();
+  EXPECT_TRUE(observer->snapshots.empty());
+}
+
+TEST(OpenMetricsTest, Format)
+{
+  MetricsSnapshot snapshot;
+  snapshot.heap.usedHeapSize = 1024;
+  snapshot.hasFilterEngine = true;
+  snapshot.matchCache.hits = 3;
+  snapshot.apiCalls["Matches"].calls = 2;
+  snapshot.apiCalls["Matches"].execution.buckets[0] = 1;
+  snapshot.apiCalls["Matches"].execution.buckets[3] = 1;
+  snapshot.apiCalls["Matches"].execution.totalMicroseconds = 5;
+  const std::string text = FormatOpenMetrics(snapshot);
+
+  EXPECT_NE(std::string::npos, text.find("# TYPE abp_js_heap_used_bytes gauge\n")) << text;
+  EXPECT_NE(std::string::npos, text.find("# UNIT abp_js_heap_used_bytes bytes\n"));
+  EXPECT_NE(std::string::npos, text.find("\nabp_js_heap_used_bytes 1024\n"));
+  EXPECT_NE(std::string::npos, text.find("# TYPE abp_cache_hits counter\n"));
+  EXPECT_NE(std::string::npos, text.find("\nabp_cache_hits_total{cache=\"match\"} 3\n"));
+  EXPECT_NE(std::string::npos, text.find("\nabp_api_calls_total{method=\"Matches\"} 2\n"));
+  const std::string bucket = "\nabp_api_call_duration_seconds_bucket{method=\"Matches\",le=";
+  EXPECT_NE(std::string::npos, text.find(bucket + "\"1e-06\"} 1\n"));
+  EXPECT_NE(std::string::npos, text.find(bucket + "\"4e-06\"} 1\n"));
+  EXPECT_NE(std::string::npos, text.find(bucket + "\"8e-06\"} 2\n"));
+  EXPECT_NE(std::string::npos, text.find(bucket + "\"+Inf\"} 2\n"));
+  EXPECT_NE(std::string::npos,
+            text.find("\nabp_api_call_duration_seconds_count{method=\"Matches\"} 2\n"));
+  EXPECT_NE(std::string::npos,
+            text.find("\nabp_api_call_duration_seconds_sum{method=\"Matches\"} 5e-06\n"));
+  EXPECT_NE(std::string::npos, text.find("\nabp_timer_wakeups_total 0\n"));
+  EXPECT_EQ(text.size() - 6, text.rfind("# EOF\n"));
+}
+
+TEST(OpenMetricsTest, FilterEngineMetricsAreOmittedWithoutFilterEngine)
+{
+  const std::string text = FormatOpenMetrics(MetricsSnapshot());
+  EXPECT_EQ(std::string::npos, text.find("abp_cache_hits"));
+  EXPECT_EQ(std::string::npos, text.find("abp_api_calls"));
+  EXPECT_NE(std::string::npos, text.find("abp_executor_queued_tasks 0\n"));
+}
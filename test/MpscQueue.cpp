@@ -0,0 +1,97 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/MpscQueue.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+
+using namespace AdblockPlus;
+
+TEST(MpscQueueTest, PopAllTakesEverythingInOrder)
+{
+  MpscQueue<std::unique_ptr<int>> queue;
+  for (int i = 0; i < 5; ++i)
+    queue.Push(std::make_unique<int>(i));
+  std::vector<std::unique_ptr<int>> values;
+  queue.PopAll(&values);
+  ASSERT_EQ(5u, values.size());
+  for (int i = 0; i < 5; ++i)
+    EXPECT_EQ(i, *values[i]);
+
+  queue.Push(std::make_unique<int>(5));
+  queue.PopAll(&values);
+  ASSERT_EQ(6u, values.size()) << "appends to the passed values";
+  EXPECT_EQ(5, *values.back());
+}
+
+TEST(MpscQueueTest, TryPopAllReturnsIfEmpty)
+{
+  MpscQueue<int> queue;
+  std::vector<int> values;
+  EXPECT_FALSE(queue.TryPopAll(&values));
+  EXPECT_TRUE(values.empty());
+
+  queue.Push(1);
+  queue.Push(2);
+  EXPECT_TRUE(queue.TryPopAll(&values));
+  EXPECT_EQ(std::vector<int>({1, 2}), values);
+  EXPECT_FALSE(queue.TryPopAll(&values));
+}
+
+TEST(MpscQueueTest, KeepsTheOrderOfEachProducer)
+{
+  const int producers = 4;
+  const int valuesPerProducer = 10000;
+  MpscQueue<std::pair<int, int>> queue;
+  std::vector<std::thread> threads;
+  for (int producer = 0; producer < producers; ++producer)
+  {
+    threads.emplace_back([&queue, producer] {
+      for (int i = 0; i < valuesPerProducer; ++i)
+        queue.Push(std::make_pair(producer, i));
+    });
+  }
+
+  std::vector<int> next(producers, 0);
+  std::vector<std::pair<int, int>> values;
+  size_t received = 0;
+  while (received < producers * valuesPerProducer)
+  {
+    values.clear();
+    queue.PopAll(&values);
+    for (const auto& value : values)
+      EXPECT_EQ(next[value.first]++, value.second);
+    received += values.size();
+  }
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_EQ(std::vector<int>(producers, valuesPerProducer), next);
+}
+
+TEST(MpscQueueTest, DestructorReleasesPendingValues)
+{
+  auto value = std::make_shared<int>(1);
+  {
+    MpscQueue<std::shared_ptr<int>> queue;
+    queue.Push(value);
+    queue.Push(value);
+    EXPECT_EQ(3, value.use_count());
+  }
+  EXPECT_EQ(1, value.use_count());
+}
@@ -0,0 +1,467 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/NativeMatcher.h"
+
+#include <gtest/gtest.h>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  class NativeMatcherTest : public ::testing::Test
+  {
+  protected:
+    NativeMatcher matcher;
+
+    std::string Match(const std::string& url,
+                      IFilterEngine::ContentTypeMask contentTypeMask =
+                          IFilterEngine::CONTENT_TYPE_IMAGE,
+                      const std::string& documentUrl = "",
+                      bool specificOnly = false)
+    {
+      std::shared_ptr<const std::string> filterText;
+      switch (matcher.Match(url, contentTypeMask, documentUrl, specificOnly, &filterText))
+      {
+      case NativeMatcher::Result::MATCH:
+        return *filterText;
+      case NativeMatcher::Result::NO_MATCH:
+        return "";
+      case NativeMatcher::Result::UNKNOWN:
+        return "<unknown>";
+      }
+      return "";
+    }
+  };
+}
+
+TEST_F(NativeMatcherTest, PlainPatterns)
+{
+  matcher.Add("adbanner.gif");
+  matcher.Add("/ads/*.png");
+  EXPECT_EQ("adbanner.gif", Match("http://example.org/adbanner.gif"));
+  EXPECT_EQ("adbanner.gif", Match("http://example.org/ADBANNER.GIF"));
+  EXPECT_EQ("", Match("http://example.org/foobar.gif"));
+  EXPECT_EQ("/ads/*.png", Match("http://example.org/ads/foo/bar.png"));
+  EXPECT_EQ("", Match("http://example.org/ads.png"));
+  EXPECT_EQ("", Match("")) << "invalid URL";
+  EXPECT_EQ("", Match("adbanner.gif")) << "invalid URL";
+}
+
+TEST_F(NativeMatcherTest, Anchors)
+{
+  matcher.Add("||example.com^");
+  matcher.Add("|https://start.");
+  matcher.Add(".swf|");
+  EXPECT_EQ("||example.com^", Match("http://example.com/ad.png"));
+  EXPECT_EQ("||example.com^", Match("https://ads.example.com:8080/"));
+  EXPECT_EQ("||example.com^", Match("http://example.com"));
+  EXPECT_EQ("", Match("http://notexample.com/"));
+  EXPECT_EQ("", Match("http://example.company/"));
+  EXPECT_EQ("", Match("http://foo.org/?example.com/"));
+  EXPECT_EQ("|https://start.", Match("https://start.example.org/"));
+  EXPECT_EQ("", Match("http://foo.org/?https://start."));
+  EXPECT_EQ(".swf|", Match("http://foo.org/movie.swf"));
+  EXPECT_EQ("", Match("http://foo.org/movie.swf?x"));
+}
+
+TEST_F(NativeMatcherTest, ContentTypesAndDomains)
+{
+  matcher.Add("scriptbanner$script,image");
+  matcher.Add("tracker$~image");
+  matcher.Add("combanner$domain=example.com|~sub.example.com");
+  EXPECT_EQ("scriptbanner$script,image", Match("http://foo.org/scriptbanner.js"));
+  EXPECT_EQ("", Match("http://foo.org/scriptbanner.js", IFilterEngine::CONTENT_TYPE_OBJECT));
+  EXPECT_EQ("tracker$~image", Match("http://foo.org/tracker", IFilterEngine::CONTENT_TYPE_SCRIPT));
+  EXPECT_EQ("", Match("http://foo.org/tracker"));
+  EXPECT_EQ("", Match("http://foo.org/tracker", IFilterEngine::CONTENT_TYPE_POPUP));
+  EXPECT_EQ("", Match("http://foo.org/tracker", 0));
+  EXPECT_EQ("combanner$domain=example.com|~sub.example.com",
+            Match("http://foo.org/combanner",
+                  IFilterEngine::CONTENT_TYPE_IMAGE,
+                  "http://www.EXAMPLE.com./"));
+  EXPECT_EQ("",
+            Match("http://foo.org/combanner",
+                  IFilterEngine::CONTENT_TYPE_IMAGE,
+                  "http://a.sub.example.com/"));
+  EXPECT_EQ("", Match("http://foo.org/combanner"));
+}
+
+TEST_F(NativeMatcherTest, AllowlistingAndSpecificOnly)
+{
+  matcher.Add("banner");
+  matcher.Add("specific$domain=example.com");
+  matcher.Add("@@notbanner");
+  matcher.Add("@@||example.com^$document");
+  EXPECT_EQ("@@notbanner", Match("http://foo.org/notbanner.png"));
+  EXPECT_EQ("", Match("http://foo.org/notbanner.png", 0));
+  EXPECT_EQ("@@||example.com^$document",
+            Match("http://example.com/", IFilterEngine::CONTENT_TYPE_DOCUMENT));
+  EXPECT_EQ("", Match("http://foo.org/banner", IFilterEngine::CONTENT_TYPE_IMAGE, "", true));
+  EXPECT_EQ("specific$domain=example.com",
+            Match("http://foo.org/specific",
+                  IFilterEngine::CONTENT_TYPE_IMAGE,
+                  "http://example.com/",
+                  true));
+}
+
+TEST_F(NativeMatcherTest, UnsupportedFiltersFallBack)
+{
+  matcher.Add("adbanner.gif");
+  matcher.Add("/foo(?=\\d)/");
+  EXPECT_EQ(2u, matcher.GetFilterCount());
+  EXPECT_EQ(1u, matcher.GetFallbackFilterCount());
+  EXPECT_EQ("<unknown>", Match("http://example.org/adbanner.gif"))
+      << "a regular expression could match anything";
+
+  matcher.Remove("/foo(?=\\d)/");
+  matcher.Add("/tpbanner.gif$third-party");
+  matcher.Add("||adserver.net^$sitekey=foo");
+  EXPECT_EQ("adbanner.gif", Match("http://example.org/adbanner.gif"));
+  EXPECT_EQ("<unknown>", Match("http://ads.example.org/tpbanner.gif"));
+
+  matcher.Remove("/tpbanner.gif$third-party");
+  matcher.Remove("||adserver.net^$sitekey=foo");
+  EXPECT_EQ(1u, matcher.GetFilterCount());
+  EXPECT_EQ(0u, matcher.GetFallbackFilterCount());
+  EXPECT_EQ("", Match("http://ads.example.org/tpbanner.gif"));
+
+  EXPECT_EQ("<unknown>", Match("http://example.org/\xc3\xa4.gif"));
+}
+
+TEST_F(NativeMatcherTest, DelegateAll)
+{
+  matcher.Add("adbanner.gif");
+  matcher.DelegateAll();
+  EXPECT_EQ("<unknown>", Match("http://example.org/adbanner.gif"));
+  EXPECT_EQ("<unknown>", Match("http://example.org/foobar.gif"));
+  EXPECT_EQ("<unknown>", Match("adbanner.gif"));
+  EXPECT_EQ(1u, matcher.GetFilterCount());
+}
+
+TEST_F(NativeMatcherTest, ThirdPartyIsOnlyDecidedForTheDocumentHost)
+{
+  matcher.Add("||ads.example.com^$third-party");
+  matcher.Add("/firstparty/*$~third-party");
+  EXPECT_EQ(0u, matcher.GetFallbackFilterCount());
+  EXPECT_EQ("",
+            Match("http://ads.example.com/banner.png",
+                  IFilterEngine::CONTENT_TYPE_IMAGE,
+                  "http://ads.example.com/"));
+  EXPECT_EQ("<unknown>",
+            Match("http://ads.example.com/banner.png",
+                  IFilterEngine::CONTENT_TYPE_IMAGE,
+                  "http://www.example.com/"))
+      << "takes the public suffix list";
+  EXPECT_EQ("<unknown>", Match("http://ads.example.com/banner.png"));
+  EXPECT_EQ("/firstparty/*$~third-party",
+            Match("http://example.org/firstparty/ad.png",
+                  IFilterEngine::CONTENT_TYPE_IMAGE,
+                  "https://example.org/page"));
+  EXPECT_EQ("<unknown>",
+            Match("http://example.org/firstparty/ad.png",
+                  IFilterEngine::CONTENT_TYPE_IMAGE,
+                  "https://www.example.org/page"));
+  EXPECT_EQ("", Match("http://example.org/other.png", IFilterEngine::CONTENT_TYPE_IMAGE, ""));
+}
+
+TEST_F(NativeMatcherTest, AddRemoveAndClear)
+{
+  matcher.Add("||example.com^");
+  matcher.Add("||example.com^");
+  EXPECT_EQ(1u, matcher.GetFilterCount());
+  matcher.Remove("||example.com^");
+  EXPECT_EQ("", Match("http://example.com/"));
+  matcher.Remove("||example.com^");
+
+  matcher.Add("||example.com^");
+  std::shared_ptr<const std::string> filterText;
+  ASSERT_EQ(
+      NativeMatcher::Result::MATCH,
+      matcher.Match(
+          "http://example.com/", IFilterEngine::CONTENT_TYPE_IMAGE, "", false, &filterText));
+  EXPECT_EQ(filterText, matcher.Intern("||example.com^")) << "shares the stored text";
+  matcher.Add("/foo(?=\\d)/");
+  EXPECT_EQ("/foo(?=\\d)/", *matcher.Intern("/foo(?=\\d)/"));
+  EXPECT_EQ("unknown", *matcher.Intern("unknown"));
+  matcher.Clear();
+  EXPECT_EQ(0u, matcher.GetFilterCount());
+  EXPECT_EQ("", Match("http://example.com/"));
+}
+
+TEST_F(NativeMatcherTest, CopiesAreIndependent)
+{
+  matcher.Add("adbanner.gif");
+  const NativeMatcher snapshot(matcher);
+  matcher.Remove("adbanner.gif");
+  matcher.Add("||example.com^");
+  std::shared_ptr<const std::string> filterText;
+  EXPECT_EQ(NativeMatcher::Result::MATCH,
+            snapshot.Match("http://example.org/adbanner.gif",
+                           IFilterEngine::CONTENT_TYPE_IMAGE,
+                           "",
+                           false,
+                           &filterText));
+  EXPECT_EQ(NativeMatcher::Result::NO_MATCH,
+            snapshot.Match(
+                "http://example.com/", IFilterEngine::CONTENT_TYPE_IMAGE, "", false, &filterText));
+  EXPECT_EQ("", Match("http://example.org/adbanner.gif"));
+  EXPECT_EQ("||example.com^", Match("http://example.com/"));
+}
+
+TEST_F(NativeMatcherTest, RegularExpressions)
+{
+  matcher.Add("/banner\\d+\\.gif/$image");
+  matcher.Add("@@/^https?:\\/\\/allowed\\./$match-case");
+  EXPECT_EQ(0u, matcher.GetFallbackFilterCount());
+  EXPECT_EQ("/banner\\d+\\.gif/$image", Match("http://example.org/BANNER12.gif"));
+  EXPECT_EQ("", Match("http://example.org/banner.gif"));
+  EXPECT_EQ("", Match("http://example.org/banner12.gif", IFilterEngine::CONTENT_TYPE_SCRIPT));
+  EXPECT_EQ("@@/^https?:\\/\\/allowed\\./$match-case",
+            Match("https://allowed.example.org/banner1.gif"));
+  EXPECT_EQ("/banner\\d+\\.gif/$image", Match("https://ALLOWED.example.org/banner1.gif"));
+
+  matcher.Add("/(a|aa)+$/");
+  EXPECT_EQ("<unknown>", Match("http://example.org/" + std::string(100000, 'a') + "b"))
+      << "exceeds the budget";
+}
+
+TEST_F(NativeMatcherTest, FiltersAreListedByContentType)
+{
+  matcher.Add("||ads.example.com^$script,stylesheet");
+  matcher.Add("||ads.example.com^$image,third-party");
+  EXPECT_EQ("||ads.example.com^$script,stylesheet",
+            Match("http://ads.example.com/a.css", IFilterEngine::CONTENT_TYPE_STYLESHEET));
+  EXPECT_EQ("||ads.example.com^$script,stylesheet",
+            Match("http://ads.example.com/",
+                  static_cast<IFilterEngine::ContentTypeMask>(
+                      IFilterEngine::CONTENT_TYPE_SCRIPT | IFilterEngine::CONTENT_TYPE_IMAGE),
+                  "http://ads.example.com/"));
+  EXPECT_EQ("",
+            Match("http://ads.example.com/a.png",
+                  IFilterEngine::CONTENT_TYPE_IMAGE,
+                  "http://ads.example.com/"))
+      << "third-party filters are skipped for first-party requests";
+
+  matcher.Add("||ads.example.com^$~script");
+  EXPECT_EQ("||ads.example.com^$~script",
+            Match("http://ads.example.com/a.png",
+                  IFilterEngine::CONTENT_TYPE_IMAGE,
+                  "http://ads.example.com/"));
+
+  matcher.Remove("||ads.example.com^$script,stylesheet");
+  EXPECT_EQ("", Match("http://ads.example.com/a.js", IFilterEngine::CONTENT_TYPE_SCRIPT));
+  EXPECT_EQ("||ads.example.com^$~script",
+            Match("http://ads.example.com/a.css", IFilterEngine::CONTENT_TYPE_STYLESHEET));
+  matcher.Remove("||ads.example.com^$~script");
+  EXPECT_EQ("<unknown>", Match("http://ads.example.com/a.png"));
+  EXPECT_EQ("", Match("http://ads.example.com/a.css", IFilterEngine::CONTENT_TYPE_STYLESHEET));
+  matcher.Remove("||ads.example.com^$image,third-party");
+  EXPECT_EQ(0u, matcher.GetFilterCount());
+  EXPECT_EQ("", Match("http://ads.example.com/a.png"));
+}
+
+TEST_F(NativeMatcherTest, MemoryUsage)
+{
+  EXPECT_EQ(0u, matcher.GetMemoryUsage("adbanner.gif"));
+  matcher.Add("adbanner.gif");
+  matcher.Add("||example.com^$domain=example.org|example.net|example.info");
+  matcher.Add("/banner\\d+/");
+  const size_t plain = matcher.GetMemoryUsage("adbanner.gif");
+  EXPECT_GT(plain, 0u);
+  EXPECT_GT(matcher.GetMemoryUsage("||example.com^$domain=example.org|example.net|example.info"),
+            plain);
+  EXPECT_GT(matcher.GetMemoryUsage("/banner\\d+/"), 0u);
+  matcher.Remove("adbanner.gif");
+  EXPECT_EQ(0u, matcher.GetMemoryUsage("adbanner.gif"));
+}
+
+TEST_F(NativeMatcherTest, PreparedFilters)
+{
+  NativeMatcher::PreparedFilters prepared;
+  NativeMatcher::Prepare("||example.com^$image", &prepared);
+  NativeMatcher::Prepare("@@||example.com/allowed^", &prepared);
+  NativeMatcher::Prepare("/foo(?=\\d)/", &prepared);
+  NativeMatcher::Prepare("||example.com^$image", &prepared);
+  EXPECT_EQ(3u, prepared.size());
+
+  matcher.Add("||example.com^$image", prepared);
+  matcher.Add("@@||example.com/allowed^", prepared);
+  matcher.Add("/foo(?=\\d)/", prepared);
+  matcher.Add("adbanner.gif", prepared);
+  EXPECT_EQ(4u, matcher.GetFilterCount());
+  EXPECT_EQ(1u, matcher.GetFallbackFilterCount());
+  EXPECT_EQ("<unknown>", Match("http://example.org/foo1"));
+  matcher.Remove("/foo(?=\\d)/");
+  EXPECT_EQ("||example.com^$image", Match("http://example.com/ad.png"));
+  EXPECT_EQ("@@||example.com/allowed^", Match("http://example.com/allowed/ad.png"));
+  EXPECT_EQ("adbanner.gif", Match("http://example.org/adbanner.gif"));
+
+  NativeMatcher other;
+  other.Add("||example.com^$image", prepared);
+  matcher.Remove("||example.com^$image");
+  EXPECT_EQ("", Match("http://example.com/ad.png"));
+  std::shared_ptr<const std::string> filterText;
+  EXPECT_EQ(NativeMatcher::Result::MATCH,
+            other.Match("http://example.com/ad.png",
+                        IFilterEngine::CONTENT_TYPE_IMAGE,
+                        "",
+                        false,
+                        &filterText))
+      << "a prepared filter can be added to several matchers";
+}
+
+TEST_F(NativeMatcherTest, SerializeAndDeserialize)
+{
+  matcher.Add("adbanner.gif");
+  matcher.Add("@@||example.com^$document");
+  matcher.Add("/foo(?=\\d)/");
+  const auto data = matcher.Serialize(42);
+
+  NativeMatcher restored;
+  ASSERT_TRUE(restored.Deserialize(data, 42));
+  EXPECT_EQ(3u, restored.GetFilterCount());
+  EXPECT_EQ(1u, restored.GetFallbackFilterCount());
+  EXPECT_EQ("/foo(?=\\d)/", *restored.Intern("/foo(?=\\d)/"));
+
+  EXPECT_FALSE(restored.Deserialize(data, 43)) << "checksum mismatch";
+  EXPECT_EQ(0u, restored.GetFilterCount());
+  EXPECT_FALSE(restored.Deserialize(std::vector<uint8_t>(data.begin(), data.end() - 1), 42));
+  EXPECT_EQ(0u, restored.GetFilterCount());
+  EXPECT_FALSE(restored.Deserialize(std::vector<uint8_t>(), 42));
+  auto corrupt = data;
+  corrupt[0] = 'X';
+  EXPECT_FALSE(restored.Deserialize(corrupt, 42));
+
+  ASSERT_TRUE(restored.Deserialize(NativeMatcher().Serialize(7), 7));
+  EXPECT_EQ(0u, restored.GetFilterCount());
+}
+
+TEST_F(NativeMatcherTest, PooledFiltersAreShared)
+{
+  NativeFilterPool pool;
+  std::unique_ptr<NativeMatcher> other(new NativeMatcher());
+  matcher.Add("||example.com^$image", &pool);
+  matcher.Add("/foo(?=\\d)/", &pool);
+  other->Add("||example.com^$image", &pool);
+  other->Add("/foo(?=\\d)/", &pool);
+  EXPECT_EQ(1u, pool.GetFilterCount()) << "fallback filters aren't pooled";
+  EXPECT_EQ(matcher.Intern("||example.com^$image"), other->Intern("||example.com^$image"));
+  EXPECT_NE(matcher.Intern("/foo(?=\\d)/"), other->Intern("/foo(?=\\d)/"));
+  matcher.Remove("/foo(?=\\d)/");
+  other->Remove("/foo(?=\\d)/");
+
+  matcher.Remove("||example.com^$image");
+  EXPECT_EQ("", Match("http://example.com/ad.png"));
+  EXPECT_EQ(1u, pool.GetFilterCount());
+  std::shared_ptr<const std::string> filterText;
+  EXPECT_EQ(NativeMatcher::Result::MATCH,
+            other->Match("http://example.com/ad.png",
+                         IFilterEngine::CONTENT_TYPE_IMAGE,
+                         "",
+                         false,
+                         &filterText));
+
+  const auto data = other->Serialize(42);
+  other.reset();
+  EXPECT_EQ(0u, pool.GetFilterCount());
+
+  NativeMatcher restored;
+  ASSERT_TRUE(restored.Deserialize(data, 42, &pool));
+  matcher.Add("||example.com^$image", &pool);
+  EXPECT_EQ(1u, pool.GetFilterCount());
+  EXPECT_EQ(matcher.Intern("||example.com^$image"), restored.Intern("||example.com^$image"));
+  EXPECT_EQ("||example.com^$image", Match("http://example.com/ad.png"));
+}
+
+TEST_F(NativeMatcherTest, DeclarativeRules)
+{
+  matcher.Add("||example.com^$image,third-party");
+  matcher.Add("@@|https://example.com/allowed|$domain=foo.com|~bar.foo.com");
+  matcher.Add("@@||trusted.org^$document");
+  matcher.Add("ad$match-case");
+  matcher.Add("||example.com^$popup");
+  matcher.Add("/ads\\d+/");
+  matcher.Add("foo$sitekey=abc");
+
+  const auto rules = matcher.GetDeclarativeRules();
+  ASSERT_EQ(4u, rules.size());
+
+  EXPECT_EQ("@@|https://example.com/allowed|$domain=foo.com|~bar.foo.com", *rules[0].filterText);
+  EXPECT_TRUE(rules[0].allowing);
+  EXPECT_FALSE(rules[0].document);
+  EXPECT_EQ("|https://example.com/allowed|", rules[0].urlFilter);
+  EXPECT_EQ(0u, rules[0].contentType);
+  EXPECT_EQ(std::vector<std::string>{"foo.com"}, rules[0].includedDomains);
+  EXPECT_EQ(std::vector<std::string>{"bar.foo.com"}, rules[0].excludedDomains);
+
+  EXPECT_EQ("@@||trusted.org^$document", *rules[1].filterText);
+  EXPECT_TRUE(rules[1].document);
+  EXPECT_EQ("||trusted.org^", rules[1].urlFilter);
+
+  EXPECT_EQ("ad$match-case", *rules[2].filterText);
+  EXPECT_FALSE(rules[2].allowing);
+  EXPECT_TRUE(rules[2].matchCase);
+  EXPECT_EQ("ad", rules[2].urlFilter);
+
+  EXPECT_EQ("||example.com^$image,third-party", *rules[3].filterText);
+  EXPECT_EQ("||example.com^", rules[3].urlFilter);
+  EXPECT_EQ(static_cast<uint32_t>(IFilterEngine::CONTENT_TYPE_IMAGE), rules[3].contentType);
+  EXPECT_TRUE(rules[3].thirdPartyOnly);
+  EXPECT_FALSE(rules[3].firstPartyOnly);
+
+  matcher.Add("@@||example.org^$genericblock");
+  const auto withGenericBlock = matcher.GetDeclarativeRules();
+  ASSERT_EQ(2u, withGenericBlock.size()) << "generic blocking filters are left out";
+  EXPECT_TRUE(withGenericBlock[0].allowing);
+  EXPECT_TRUE(withGenericBlock[1].allowing);
+}
+
+TEST_F(NativeMatcherTest, CopiesAreUnaffectedByLaterChanges)
+{
+  matcher.Add("||example.com^$image");
+  matcher.Add("adbanner.gif");
+  const NativeMatcher snapshot(matcher);
+
+  matcher.Remove("||example.com^$image");
+  matcher.Add("@@adbanner.gif");
+  matcher.Add("||example.org^");
+  EXPECT_EQ("", Match("http://example.com/ad.png"));
+  EXPECT_EQ("@@adbanner.gif", Match("http://example.net/adbanner.gif"));
+  EXPECT_EQ("||example.org^", Match("http://example.org/"));
+
+  std::shared_ptr<const std::string> filterText;
+  EXPECT_EQ(NativeMatcher::Result::MATCH,
+            snapshot.Match("http://example.com/ad.png",
+                           IFilterEngine::CONTENT_TYPE_IMAGE,
+                           "",
+                           false,
+                           &filterText));
+  EXPECT_EQ("||example.com^$image", *filterText);
+  EXPECT_EQ(NativeMatcher::Result::MATCH,
+            snapshot.Match("http://example.net/adbanner.gif",
+                           IFilterEngine::CONTENT_TYPE_IMAGE,
+                           "",
+                           false,
+                           &filterText));
+  EXPECT_EQ("adbanner.gif", *filterText);
+  EXPECT_EQ(NativeMatcher::Result::NO_MATCH,
+            snapshot.Match(
+                "http://example.org/", IFilterEngine::CONTENT_TYPE_IMAGE, "", false, &filterText));
+  EXPECT_EQ(2u, snapshot.GetFilterCount());
+  EXPECT_EQ(3u, matcher.GetFilterCount());
+}
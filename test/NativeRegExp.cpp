@@ -0,0 +1,109 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/NativeRegExp.h"
+
+#include <gtest/gtest.h>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  const size_t BUDGET = 1000000;
+
+  NativeRegExp::Result Search(const std::string& source,
+                              const std::string& str,
+                              bool ignoreCase = false)
+  {
+    auto regExp = NativeRegExp::Compile(source, ignoreCase);
+    EXPECT_TRUE(regExp) << source;
+    return regExp ? regExp->Search(str, BUDGET) : NativeRegExp::Result::UNKNOWN;
+  }
+
+  bool Matches(const std::string& source, const std::string& str, bool ignoreCase = false)
+  {
+    return Search(source, str, ignoreCase) == NativeRegExp::Result::MATCH;
+  }
+}
+
+TEST(NativeRegExpTest, CharactersAndClasses)
+{
+  EXPECT_TRUE(Matches("banner", "http://example.org/banner.gif"));
+  EXPECT_FALSE(Matches("banner", "http://example.org/BANNER.gif"));
+  EXPECT_TRUE(Matches("banner", "http://example.org/BANNER.gif", true));
+  EXPECT_TRUE(Matches("ad\\d{2,3}\\.", "/ad123.png"));
+  EXPECT_FALSE(Matches("ad\\d{2,3}\\.", "/ad1.png"));
+  EXPECT_FALSE(Matches("ad\\d{2,3}\\.", "/ad1234.png"));
+  EXPECT_TRUE(Matches("[a-c]+x", "zzbcax"));
+  EXPECT_FALSE(Matches("[^a-c]x", "ax"));
+  EXPECT_FALSE(Matches("[^a-c]x", "Ax", true)) << "case is folded before negating";
+  EXPECT_TRUE(Matches("[A-C]x", "bx", true));
+  EXPECT_TRUE(Matches("[\\w-]+\\.js", "/my-script.js"));
+  EXPECT_TRUE(Matches("a.c", "abc"));
+  EXPECT_FALSE(Matches("a.c", "a\nc"));
+  EXPECT_TRUE(Matches("\\x41\\u0042", "AB"));
+  EXPECT_FALSE(Matches("[]]", "]")) << "an empty class matches nothing";
+  EXPECT_TRUE(Matches("a[^]b", "a\nb"));
+  EXPECT_FALSE(Matches("\\S", " \t"));
+}
+
+TEST(NativeRegExpTest, GroupsAlternativesAndAssertions)
+{
+  EXPECT_TRUE(Matches("^https?://(www\\.)?example\\.(com|org)/", "https://www.example.org/"));
+  EXPECT_FALSE(Matches("^https?://(www\\.)?example\\.(com|org)/", "ftp://example.org/"));
+  EXPECT_TRUE(Matches("(?:ad|banner)s?$", "/banners"));
+  EXPECT_FALSE(Matches("(?:ad|banner)s?$", "/banners/x"));
+  EXPECT_TRUE(Matches("\\bads\\b", "/ads/"));
+  EXPECT_FALSE(Matches("\\bads\\b", "/loads/"));
+  EXPECT_TRUE(Matches("ads\\B", "/adsx"));
+  EXPECT_TRUE(Matches("a*?b+?", "b"));
+  EXPECT_TRUE(Matches("(a*)*b", "aaab"));
+  EXPECT_TRUE(Matches("", "anything"));
+  EXPECT_TRUE(Matches("x|", "y"));
+}
+
+TEST(NativeRegExpTest, UnsupportedSyntaxIsRejected)
+{
+  for (const char* source : {"(a)\\1",
+                             "a(?=b)",
+                             "a(?!b)",
+                             "(?<=a)b",
+                             "(?<name>a)",
+                             "\\p{L}",
+                             "\\cJ",
+                             "a{1",
+                             "*a",
+                             "a**",
+                             "(a",
+                             "a)",
+                             "[a",
+                             "[z-a]",
+                             "^*",
+                             "\xc3\xa4",
+                             "a{100000}"})
+    EXPECT_FALSE(NativeRegExp::Compile(source, false)) << source;
+}
+
+TEST(NativeRegExpTest, BudgetIsEnforced)
+{
+  auto regExp = NativeRegExp::Compile("(a|aa)+$", false);
+  ASSERT_TRUE(regExp);
+  const std::string str = std::string(10000, 'a') + "b";
+  EXPECT_EQ(NativeRegExp::Result::NO_MATCH, regExp->Search(str, 10000000));
+  EXPECT_EQ(NativeRegExp::Result::UNKNOWN, regExp->Search(str, 1000));
+  EXPECT_GT(regExp->GetMemoryUsage(), 0u);
+}
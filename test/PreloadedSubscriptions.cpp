@@ -16,6 +16,8 @@
  */
 
 #include <chrono>
+#include <cstdio>
+#include <fstream>
 
 #include "FilterEngineTest.h"
 
@@ -39,6 +41,24 @@ public:
   Implementation impl;
 };
 
+class PrecompiledResourceLoader : public WrappingResourceLoader
+{
+public:
+  PrecompiledResourceLoader(Implementation callback, std::string patterns)
+      : WrappingResourceLoader(callback), patterns(std::move(patterns))
+  {
+  }
+
+  void ReadPrecompiledFilterStorage(const std::string& fileName,
+                                    const ReadCallback& doneCallback) const override
+  {
+    doneCallback(std::make_unique<StringPreloadedFilterResponse>(
+        fileName == "patterns.ini" ? patterns : std::string()));
+  }
+
+  std::string patterns;
+};
+
 class FilterEnginePreloadedSubscriptionsTest : public FilterEngineConfigurableTest
 {
 protected:
@@ -156,3 +176,62 @@ TEST_F(FilterEnginePreloadedSubscriptionsTest, Expires)
   // processExpirationInterval will set hard expiration to 2 x period
   EXPECT_NEAR(2 * period, hardExpiration, 1);
 }
+
+TEST_F(FilterEnginePreloadedSubscriptionsTest, PrecompiledFilterStorageIsInstalled)
+{
+  std::string url = "https://test.com/subscription.txt";
+  std::string patterns = "# Adblock Plus preferences\n"
+                         "version=5\n"
+                         "[Subscription]\n"
+                         "url=" +
+                         url +
+                         "\n"
+                         "[Subscription filters]\n"
+                         "||example.com\n"
+                         "||example.org\n";
+  resourceLoaderCounter = 0;
+  PlatformFactory::CreationParameters params;
+  params.resourceReader.reset(new PrecompiledResourceLoader(
+      [this](const std::string&) -> std::string {
+        ++resourceLoaderCounter;
+        return "[Adblock Plus 2.0]\n||example.com";
+      },
+      patterns));
+  auto& engine = FilterEngineConfigurableTest::ConfigureEngine(AutoselectState::Disabled,
+                                                                SynchronizationState::Disabled,
+                                                                AAState::Enabled,
+                                                                std::move(params));
+
+  const auto listed = engine.GetListedSubscriptions();
+  ASSERT_EQ(1u, listed.size());
+  EXPECT_EQ(url, listed[0].GetUrl());
+  EXPECT_EQ(2, listed[0].GetFilterCount());
+  Subscription subscription = engine.GetSubscription(url);
+  engine.AddSubscription(subscription);
+  EXPECT_EQ(0, resourceLoaderCounter) << "the precompiled filters are kept";
+  EXPECT_EQ(2, subscription.GetFilterCount());
+}
+
+TEST(MappedPreloadedFilterResponseTest, MapsTheFile)
+{
+  const std::string path = "MappedPreloadedFilterResponseTest.txt";
+  const std::string content = "[Adblock Plus 2.0]\n||example.com";
+  std::ofstream(path, std::ios_base::binary) << content;
+  {
+    MappedPreloadedFilterResponse response(path);
+    EXPECT_TRUE(response.exists());
+    ASSERT_EQ(content.size(), response.size());
+    EXPECT_EQ(content, std::string(response.content(), response.size()));
+  }
+
+  std::ofstream(path, std::ios_base::binary | std::ios_base::trunc);
+  {
+    MappedPreloadedFilterResponse response(path);
+    EXPECT_FALSE(response.exists());
+    EXPECT_EQ(0u, response.size());
+    EXPECT_STREQ("", response.content());
+  }
+
+  std::remove(path.c_str());
+  EXPECT_THROW(MappedPreloadedFilterResponse{path}, std::runtime_error);
+}
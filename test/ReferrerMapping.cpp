@@ -15,6 +15,8 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <thread>
+
 #include <AdblockPlus.h>
 #include <gtest/gtest.h>
 
@@ -79,3 +81,49 @@ TEST(ReferrerMappingTest, CacheOnlyFiveUrls)
   ASSERT_EQ("sixth", referrerChain[3]);
   ASSERT_EQ("seventh", referrerChain[4]);
 }
+
+TEST(ReferrerMappingTest, AddingAgainMakesUrlTheNewestOne)
+{
+  AdblockPlus::ReferrerMapping referrerMapping(3);
+  referrerMapping.Add("second", "first");
+  referrerMapping.Add("third", "second");
+  referrerMapping.Add("second", "zeroth");
+  referrerMapping.Add("fourth", "third");
+  referrerMapping.Add("fifth", "fourth");
+  std::vector<std::string> referrerChain = referrerMapping.BuildReferrerChain("fifth");
+  ASSERT_EQ(2u, referrerChain.size());
+  ASSERT_EQ("third", referrerChain[0]);
+  ASSERT_EQ("fourth", referrerChain[1]);
+  referrerChain = referrerMapping.BuildReferrerChain("second");
+  ASSERT_EQ(1u, referrerChain.size());
+  ASSERT_EQ("zeroth", referrerChain[0]);
+}
+
+TEST(ReferrerMappingTest, ReferrerLoopIsCut)
+{
+  AdblockPlus::ReferrerMapping referrerMapping;
+  referrerMapping.Add("first", "second");
+  referrerMapping.Add("second", "first");
+  std::vector<std::string> referrerChain = referrerMapping.BuildReferrerChain("first");
+  ASSERT_EQ(10u, referrerChain.size());
+  ASSERT_EQ("second", referrerChain[9]);
+  ASSERT_EQ("first", referrerChain[8]);
+}
+
+TEST(ReferrerMappingTest, ThreadSafeMapping)
+{
+  AdblockPlus::ReferrerMapping referrerMapping(100, true);
+  referrerMapping.Add("page", "");
+  std::thread adder([&referrerMapping]() {
+    for (int i = 0; i < 1000; i++)
+      referrerMapping.Add("request" + std::to_string(i % 50), "page");
+  });
+  for (int i = 0; i < 1000; i++)
+  {
+    std::vector<std::string> referrerChain =
+        referrerMapping.BuildReferrerChain("request" + std::to_string(i % 50));
+    ASSERT_TRUE(referrerChain.empty() || referrerChain.back() == "page");
+  }
+  adder.join();
+  ASSERT_EQ(2u, referrerMapping.BuildReferrerChain("request0").size());
+}
@@ -0,0 +1,118 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <AdblockPlus/SharedFilterData.h>
+
+#include "../src/SharedFilterDataWriter.h"
+#include "FilterEngineTest.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  std::unique_ptr<SharedFilterData> Attach(const std::vector<uint8_t>& data)
+  {
+    return SharedFilterData::Attach(data.data(), data.size());
+  }
+}
+
+TEST(SharedFilterDataTest, StyleSheetsOfParentDomains)
+{
+  NativeMatcher matcher;
+  matcher.Add("||example.org/ad.gif");
+  const auto data = WriteSharedFilterData(matcher,
+                                          {"generic;",
+                                           "default;",
+                                           "sub.example.com",
+                                           "sub;",
+                                           "sub-specific;",
+                                           "example.com",
+                                           "example;",
+                                           "example-specific;"});
+  auto shared = Attach(data);
+  ASSERT_TRUE(shared);
+
+  EXPECT_EQ("generic;default;", shared->GetElementHidingStyleSheet("other.net"));
+  EXPECT_EQ("", shared->GetElementHidingStyleSheet("other.net", true));
+  EXPECT_EQ("generic;example;", shared->GetElementHidingStyleSheet("example.com"));
+  EXPECT_EQ("generic;example;", shared->GetElementHidingStyleSheet("www.Example.com."));
+  EXPECT_EQ("generic;sub;", shared->GetElementHidingStyleSheet("https://a.sub.example.com/"));
+  EXPECT_EQ("example-specific;", shared->GetElementHidingStyleSheet("example.com", true));
+  EXPECT_EQ("generic;default;", shared->GetElementHidingStyleSheet("com"));
+
+  std::string filterText;
+  EXPECT_EQ(SharedFilterData::Result::MATCH,
+            shared->Match("http://example.org/ad.gif",
+                          IFilterEngine::CONTENT_TYPE_IMAGE,
+                          "",
+                          false,
+                          &filterText));
+  EXPECT_EQ("||example.org/ad.gif", filterText);
+  EXPECT_EQ(SharedFilterData::Result::NO_MATCH,
+            shared->Match("http://example.org/other.gif",
+                          IFilterEngine::CONTENT_TYPE_IMAGE,
+                          "",
+                          false,
+                          &filterText));
+}
+
+TEST(SharedFilterDataTest, CorruptDataIsRejected)
+{
+  NativeMatcher matcher;
+  auto data = WriteSharedFilterData(matcher, {"generic;", "default;", "example.com", "a", "b"});
+  EXPECT_TRUE(Attach(data));
+  EXPECT_FALSE(SharedFilterData::Attach(nullptr, 0));
+  for (size_t size : {size_t(0), size_t(8), data.size() / 2, data.size() - 1})
+    EXPECT_FALSE(SharedFilterData::Attach(data.data(), size)) << size;
+  data[8] = 2;
+  EXPECT_FALSE(Attach(data)) << "another version";
+}
+
+TEST_F(FilterEngineTest, SharedFilterDataAnswersLikeTheEngine)
+{
+  auto& filterEngine = GetFilterEngine();
+  for (const auto& text : {"##.generic",
+                           "##.conditional",
+                           "example.com#@#.conditional",
+                           "example.com,~sub.example.com##.specific",
+                           "||example.org/ad.gif"})
+    filterEngine.AddFilter(filterEngine.GetFilter(text));
+  auto shared = Attach(filterEngine.SerializeSharedFilterData());
+  ASSERT_TRUE(shared);
+
+  for (const std::string domain :
+       {"other.net", "example.com", "www.example.com", "sub.example.com"})
+  {
+    for (bool specificOnly : {false, true})
+    {
+      const std::string expected = filterEngine.GetElementHidingStyleSheet(domain, specificOnly);
+      const std::string actual = shared->GetElementHidingStyleSheet(domain, specificOnly);
+      for (const std::string selector : {".generic", ".conditional", ".specific"})
+        EXPECT_EQ(expected.find(selector) != std::string::npos,
+                  actual.find(selector) != std::string::npos)
+            << domain << " " << specificOnly << " " << selector;
+    }
+  }
+
+  std::string filterText;
+  EXPECT_EQ(SharedFilterData::Result::MATCH,
+            shared->Match("http://example.org/ad.gif",
+                          IFilterEngine::CONTENT_TYPE_IMAGE,
+                          "",
+                          false,
+                          &filterText));
+  EXPECT_EQ("||example.org/ad.gif", filterText);
+}
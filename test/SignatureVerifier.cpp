@@ -0,0 +1,69 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/SignatureVerifier.h"
+
+#include <gtest/gtest.h>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  const std::string publicKey = "MFwwDQYJKoZIhvcNAQEBBQADSwAwSAJBANnylWw2vLY4hUn9w06zQKbhKBfvjFUC"
+                                "sdFlb6TdQhxb9RXWXuI4t31c+o8fYOv/s8q1LGP"
+                                "ga3DE1L/tHU4LENMCAwEAAQ==";
+  const std::string signature =
+      "nLH8Vbc1rzmy0Q+Xg+bvm43IEO42h8rq5D9C0WCn/Y3ykgAoV4npzm7eMlqBSwZBLA/0DuuVsfTJT9MOVaurcA==";
+  const std::string uri = "/info/"
+                          "Liquidit%C3%A4t.html?ses="
+                          "Y3JlPTEzNTUyNDE2OTImdGNpZD13d3cuYWZmaWxpbmV0LXZlcnplaWNobmlzLmRlNTB"
+                          "jNjAwNzIyNTlkNjQuNDA2MjE2MTImZmtpPTcyOTU2NiZ0YXNrPXNlYXJjaCZkb21haW49Y"
+                          "WZmaWxpbmV0LXZlcnplaWNobmlzL"
+                          "mRlJnM9ZGZmM2U5MTEzZGNhMWYyMWEwNDcmbGFuZ3VhZ2U9ZGUmYV9pZD0yJmtleXdvcmQ"
+                          "9TGlxdWlkaXQlQzMlQTR0JnBvcz0"
+                          "yJmt3cz03Jmt3c2k9OA==&token=AG06ipCV1LptGtY_"
+                          "9gFnr0vBTPy4O0YTvwoTCObJ3N3ckrQCFYIA3wod2TwAjxgAIABQv5"
+                          "WiAlCH8qgOUJGr9g9QmuuEG1CDnK0pUPbRrk5QhqDgkQNxP4Qqhz9xZe4";
+  const std::string host = "www.affilinet-verzeichnis.de";
+  const std::string userAgent = "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.21 (KHTML, like "
+                                "Gecko) Chrome/25.0.1349.2 Safari/537.21";
+
+  std::string Data(const std::string& signedUri, const std::string& signedHost)
+  {
+    return signedUri + '\0' + signedHost + '\0' + userAgent;
+  }
+}
+
+TEST(SignatureVerifierTest, ValidSignature)
+{
+  EXPECT_TRUE(SignatureVerifier::Verify(publicKey, signature, Data(uri, host)));
+}
+
+TEST(SignatureVerifierTest, InvalidSignatures)
+{
+  EXPECT_FALSE(SignatureVerifier::Verify("", "", ""));
+  EXPECT_FALSE(SignatureVerifier::Verify(publicKey, signature, Data(host, uri)));
+  EXPECT_FALSE(SignatureVerifier::Verify(publicKey, signature, Data(uri, host) + "x"));
+  EXPECT_FALSE(SignatureVerifier::Verify("publicKey", signature, Data(uri, host)));
+  EXPECT_FALSE(SignatureVerifier::Verify(publicKey, "signature", Data(uri, host)));
+  EXPECT_FALSE(SignatureVerifier::Verify(signature, publicKey, Data(uri, host)));
+  EXPECT_FALSE(SignatureVerifier::Verify(publicKey, "n!" + signature, Data(uri, host)));
+
+  std::string modified = signature;
+  modified[10] = modified[10] == 'A' ? 'B' : 'A';
+  EXPECT_FALSE(SignatureVerifier::Verify(publicKey, modified, Data(uri, host)));
+}
@@ -0,0 +1,102 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "../src/SingleFlight.h"
+
+#include <atomic>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  const size_t WAITERS = 4;
+
+  // Starts the leader, whose call blocks until the waiters are waiting, then
+  // the waiters.
+  template<class Call> void RunConcurrently(Call call)
+  {
+    std::atomic<bool> leading(false);
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]() { call(&leading); });
+    while (!leading)
+      std::this_thread::yield();
+    for (size_t i = 0; i < WAITERS; ++i)
+      threads.emplace_back([&]() { call(nullptr); });
+    for (auto& thread : threads)
+      thread.join();
+  }
+}
+
+TEST(SingleFlightTest, ConcurrentCallsShareTheResult)
+{
+  SingleFlight<int> flights;
+  std::atomic<int> computed(0);
+  std::atomic<int> sum(0);
+  RunConcurrently([&](std::atomic<bool>* leading) {
+    sum += flights.Do("key", [&]() {
+      ++computed;
+      *leading = true;
+      while (flights.GetWaitCount() < WAITERS)
+        std::this_thread::yield();
+      return 42;
+    });
+  });
+  EXPECT_EQ(1, computed);
+  EXPECT_EQ(42 * static_cast<int>(WAITERS + 1), sum);
+  EXPECT_EQ(WAITERS, flights.GetWaitCount());
+
+  EXPECT_EQ(1, flights.Do("key", []() { return 1; })) << "completed calls aren't reused";
+}
+
+TEST(SingleFlightTest, ConcurrentCallsShareTheException)
+{
+  SingleFlight<int> flights;
+  std::atomic<int> computed(0);
+  std::atomic<int> failed(0);
+  RunConcurrently([&](std::atomic<bool>* leading) {
+    try
+    {
+      flights.Do("key", [&]() -> int {
+        ++computed;
+        *leading = true;
+        while (flights.GetWaitCount() < WAITERS)
+          std::this_thread::yield();
+        throw std::runtime_error("failed");
+      });
+    }
+    catch (const std::runtime_error&)
+    {
+      ++failed;
+    }
+  });
+  EXPECT_EQ(1, computed);
+  EXPECT_EQ(static_cast<int>(WAITERS + 1), failed);
+  EXPECT_EQ(2, flights.Do("key", []() { return 2; }));
+}
+
+TEST(SingleFlightTest, OtherKeysComputeTheirOwn)
+{
+  SingleFlight<int> flights;
+  int outer = flights.Do("a", [&]() { return flights.Do("b", []() { return 1; }) + 1; });
+  EXPECT_EQ(2, outer);
+  EXPECT_EQ(0u, flights.GetWaitCount());
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/StringPool.h"
+
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace AdblockPlus;
+
+TEST(StringPoolTest, EqualStringsShareAnId)
+{
+  StringPool pool(16);
+  const auto id = pool.Intern("example.com");
+  EXPECT_NE(StringPool::EMPTY, id);
+  EXPECT_EQ(id, pool.Intern("example.com"));
+  EXPECT_NE(id, pool.Intern("example.org"));
+  EXPECT_EQ(StringPool::EMPTY, pool.Intern(""));
+  EXPECT_EQ(2u, pool.Size());
+}
+
+TEST(StringPoolTest, IdsAreNotReusedWhenStartingOver)
+{
+  StringPool pool(2);
+  const auto first = pool.Intern("a");
+  const auto second = pool.Intern("b");
+  const auto third = pool.Intern("c");
+  EXPECT_EQ(1u, pool.Size());
+  EXPECT_EQ(third, pool.Intern("c"));
+  EXPECT_NE(first, pool.Intern("a"));
+
+  pool.Clear();
+  EXPECT_EQ(0u, pool.Size());
+  const auto again = pool.Intern("b");
+  EXPECT_NE(second, again);
+  EXPECT_NE(third, again);
+}
+
+TEST(StringPoolTest, ConcurrentInterning)
+{
+  StringPool pool(64);
+  std::vector<std::vector<StringPool::Id>> ids(4);
+  std::vector<std::thread> threads;
+  for (auto& threadIds : ids)
+    threads.emplace_back([&pool, &threadIds]() {
+      for (int i = 0; i < 32; ++i)
+        threadIds.push_back(pool.Intern("host" + std::to_string(i)));
+    });
+  for (auto& thread : threads)
+    thread.join();
+
+  for (const auto& threadIds : ids)
+    EXPECT_EQ(ids[0], threadIds);
+  EXPECT_EQ(32u, std::set<StringPool::Id>(ids[0].begin(), ids[0].end()).size());
+}
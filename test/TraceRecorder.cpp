@@ -0,0 +1,209 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../src/TraceRecorder.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <map>
+#include <sstream>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  // Keeps the committed file in memory, everything but OpenWriter() fails.
+  class CollectingFileSystem : public IFileSystem
+  {
+  public:
+    class Writer : public IFileWriter
+    {
+    public:
+      Writer(CollectingFileSystem& fileSystem, const std::string& fileName)
+          : fileSystem(fileSystem), fileName(fileName)
+      {
+      }
+
+      void Append(IOBuffer&& chunk) override
+      {
+        ++fileSystem.chunks;
+        content.append(chunk.begin(), chunk.end());
+      }
+
+      void Commit(const Callback& callback) override
+      {
+        fileSystem.files[fileName] = content;
+        callback("");
+      }
+
+    private:
+      CollectingFileSystem& fileSystem;
+      std::string fileName;
+      std::string content;
+    };
+
+    std::unique_ptr<IFileWriter> OpenWriter(const std::string& fileName) override
+    {
+      return std::unique_ptr<IFileWriter>(new Writer(*this, fileName));
+    }
+
+    void Read(const std::string& fileName,
+              const ReadCallback& callback,
+              const Callback& errorCallback) const override
+    {
+      errorCallback("Unexpected read");
+    }
+
+    void Write(const std::string& fileName, const IOBuffer& data, const Callback& callback) override
+    {
+      callback("Unexpected write");
+    }
+
+    void Move(const std::string& fromFileName,
+              const std::string& toFileName,
+              const Callback& callback) override
+    {
+      callback("Unexpected move");
+    }
+
+    void Remove(const std::string& fileName, const Callback& callback) override
+    {
+      callback("Unexpected remove");
+    }
+
+    void Stat(const std::string& fileName, const StatCallback& callback) const override
+    {
+      callback(StatResult(), "Unexpected stat");
+    }
+
+    std::map<std::string, std::string> files;
+    size_t chunks = 0;
+  };
+
+  std::vector<std::string> Commit(TraceRecorder& recorder,
+                                  CollectingFileSystem& fileSystem,
+                                  const std::string& fileName = "adblock_trace.log")
+  {
+    std::string error = "not called";
+    recorder.Commit([&error](const std::string& result) { error = result; });
+    EXPECT_EQ("", error);
+    std::vector<std::string> lines;
+    std::istringstream stream(fileSystem.files[fileName]);
+    for (std::string line; std::getline(stream, line);)
+      lines.push_back(line);
+    return lines;
+  }
+}
+
+TEST(TraceRecorderTest, WritesRecordsInHarnessFormat)
+{
+  CollectingFileSystem fileSystem;
+  TraceRecorder::Options options;
+  options.fileName = "trace.log";
+  TraceRecorder recorder(fileSystem, options);
+  recorder.RecordFilterMatch("https://ads.example/a\"b",
+                             IFilterEngine::CONTENT_TYPE_IMAGE,
+                             {"https://example.com/frame", "https://example.com/"},
+                             "key",
+                             true);
+  recorder.RecordPopup("https://popup.example/", "https://example.com/", false);
+  recorder.RecordElementHiding("https://example.com/", {"https://example.com/"}, "");
+  EXPECT_TRUE(fileSystem.files.empty());
+
+  const auto lines = Commit(recorder, fileSystem, "trace.log");
+  ASSERT_EQ(3u, lines.size());
+  EXPECT_EQ("{\"_fn\":\"check-filter-match\",\"_res\":true,\"adblock_resource_type\":" +
+                std::to_string(IFilterEngine::CONTENT_TYPE_IMAGE) +
+                ",\"initiator_url\":\"https://example.com/frame\",\"process_id\":0,"
+                "\"referrers\":[\"https://example.com/frame\",\"https://example.com/\"],"
+                "\"render_frame_id\":0,\"request_url\":\"https://ads.example/a\\\"b\","
+                "\"resource_type\":0,\"sitekey\":\"key\"}",
+            lines[0]);
+  EXPECT_EQ("{\"_fn\":\"block-popup\",\"_res\":false,\"opener\":\"https://example.com/\","
+            "\"url\":\"https://popup.example/\"}",
+            lines[1]);
+  EXPECT_EQ("{\"_fn\":\"generate-js-css\",\"frame_id\":0,\"gurl\":\"https://example.com/\","
+            "\"process_id\":0,\"referrers\":[\"https://example.com/\"],\"sitekey\":\"\"}",
+            lines[2]);
+
+  // Nothing is recorded after the commit.
+  recorder.RecordPopup("https://popup.example/", "", true);
+  EXPECT_EQ(lines, Commit(recorder, fileSystem, "trace.log"));
+}
+
+TEST(TraceRecorderTest, EscapesControlCharacters)
+{
+  CollectingFileSystem fileSystem;
+  TraceRecorder recorder(fileSystem, TraceRecorder::Options());
+  recorder.RecordPopup("https://popup.example/\\\x01", "", false);
+  const auto lines = Commit(recorder, fileSystem);
+  ASSERT_EQ(1u, lines.size());
+  EXPECT_NE(std::string::npos, lines[0].find("\"url\":\"https://popup.example/\\\\\\u0001\""));
+}
+
+TEST(TraceRecorderTest, LimitsTheRate)
+{
+  CollectingFileSystem fileSystem;
+  TraceRecorder::Options options;
+  options.maxRecordsPerSecond = 2;
+  options.maxRecords = 5;
+  auto now = std::chrono::steady_clock::now();
+  TraceRecorder recorder(fileSystem, options, [&now]() { return now; });
+
+  for (int second = 0; second < 4; ++second)
+  {
+    for (int i = 0; i < 3; ++i)
+      recorder.RecordPopup("https://popup.example/" + std::to_string(second * 10 + i), "", false);
+    now += std::chrono::milliseconds(1500);
+  }
+
+  const auto lines = Commit(recorder, fileSystem);
+  ASSERT_EQ(5u, lines.size());
+  for (const auto& id : {"/0\"", "/1\"", "/10\"", "/11\"", "/20\""})
+  {
+    EXPECT_TRUE(std::any_of(lines.begin(), lines.end(), [id](const std::string& line) {
+      return line.find(id) != std::string::npos;
+    })) << id;
+  }
+}
+
+TEST(TraceRecorderTest, SamplesCalls)
+{
+  CollectingFileSystem fileSystem;
+  TraceRecorder::Options options;
+  options.samplingRatio = 0.1;
+  options.maxRecordsPerSecond = 0;
+  options.maxRecords = 0;
+  TraceRecorder recorder(fileSystem, options);
+  for (int i = 0; i < 10000; ++i)
+    recorder.RecordElementHiding("https://example.com/", {"https://example.com/"}, "");
+
+  const auto lines = Commit(recorder, fileSystem);
+  EXPECT_GT(lines.size(), 700u);
+  EXPECT_LT(lines.size(), 1300u);
+  // Records are passed on in chunks while recording.
+  EXPECT_GT(fileSystem.chunks, 1u);
+}
+
+TEST(TraceRecorderTest, SamplingRatioZeroRecordsNothing)
+{
+  CollectingFileSystem fileSystem;
+  TraceRecorder::Options options;
+  options.samplingRatio = 0;
+  TraceRecorder recorder(fileSystem, options);
+  recorder.RecordPopup("https://popup.example/", "", false);
+  EXPECT_TRUE(Commit(recorder, fileSystem).empty());
+}
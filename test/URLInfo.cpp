@@ -0,0 +1,82 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <AdblockPlus/URLInfo.h>
+
+#include <gtest/gtest.h>
+
+using namespace AdblockPlus;
+
+TEST(URLInfoTest, Parse)
+{
+  auto info = URLInfo::Parse("HTTPS://user:pw@Example.com:8080/foo?bar#baz");
+  ASSERT_TRUE(info.IsValid());
+  EXPECT_EQ("HTTPS://user:pw@Example.com:8080/foo?bar#baz", info.GetHref());
+  EXPECT_EQ("https:", info.GetProtocol());
+  EXPECT_EQ("Example.com", info.GetHost());
+  EXPECT_EQ("Example.com", info.GetHostname());
+
+  info = URLInfo::Parse("http://www.b\xc3\xbc" "cher.de/");
+  ASSERT_TRUE(info.IsValid());
+  EXPECT_EQ("www.b\xc3\xbc" "cher.de", info.GetHost());
+  EXPECT_EQ("www.xn--bcher-kva.de", info.GetHostname());
+
+  info = URLInfo::Parse("data:text/plain,foo");
+  ASSERT_TRUE(info.IsValid());
+  EXPECT_EQ("data:", info.GetProtocol());
+  EXPECT_EQ("text", info.GetHost());
+
+  EXPECT_FALSE(URLInfo::Parse("").IsValid());
+  EXPECT_FALSE(URLInfo::Parse("example.com").IsValid());
+  EXPECT_FALSE(URLInfo::Parse("http://").IsValid());
+  EXPECT_TRUE(URLInfo::Parse("http:///foo").IsValid()) << "matches URI in uri.js";
+  EXPECT_TRUE(URLInfo().GetHref().empty());
+  EXPECT_FALSE(URLInfo().IsValid());
+}
+
+TEST(URLInfoTest, ExtractHost)
+{
+  EXPECT_EQ("example.com", URLInfo::ExtractHost("http://example.com/foo"));
+  EXPECT_EQ("example.com", URLInfo::ExtractHost("http://user:pw@example.com:8080?x"));
+  EXPECT_EQ("example.com", URLInfo::ExtractHost("http://example.com#x"));
+  EXPECT_EQ("::1", URLInfo::ExtractHost("http://[::1]:80/"));
+  EXPECT_EQ("b\xc3\xbc" "cher.de", URLInfo::ExtractHost("http://b\xc3\xbc" "cher.de/"));
+  EXPECT_EQ("", URLInfo::ExtractHost("http://"));
+  EXPECT_EQ("", URLInfo::ExtractHost("example.com"));
+  EXPECT_EQ("", URLInfo::ExtractHost(""));
+}
+
+TEST(URLInfoTest, HostToASCII)
+{
+  std::string ascii;
+  ASSERT_TRUE(URLInfo::HostToASCII("example.com", &ascii));
+  EXPECT_EQ("example.com", ascii);
+  ASSERT_TRUE(URLInfo::HostToASCII("m\xc3\xbcnchen.de", &ascii));
+  EXPECT_EQ("xn--mnchen-3ya.de", ascii);
+  // 例え.テスト
+  ASSERT_TRUE(URLInfo::HostToASCII(
+      "\xe4\xbe\x8b\xe3\x81\x88.\xe3\x83\x86\xe3\x82\xb9\xe3\x83\x88", &ascii));
+  EXPECT_EQ("xn--r8jz45g.xn--zckzah", ascii);
+  // Ideographic full stop as separator.
+  ASSERT_TRUE(URLInfo::HostToASCII("b\xc3\xbc" "cher\xe3\x80\x82" "de", &ascii));
+  EXPECT_EQ("xn--bcher-kva.de", ascii);
+  // Characters beyond the BMP.
+  ASSERT_TRUE(URLInfo::HostToASCII("\xf0\x9f\x92\xa9.la", &ascii));
+  EXPECT_EQ("xn--ls8h.la", ascii);
+  ASSERT_TRUE(URLInfo::HostToASCII("", &ascii));
+  EXPECT_EQ("", ascii);
+}
@@ -0,0 +1,96 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/URLTokenizer.h"
+
+#include <gtest/gtest.h>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  std::vector<std::string> Tokenize(const std::string& url, std::string* lowerUrl = nullptr)
+  {
+    std::string lower;
+    std::vector<URLTokenizer::Token> tokens;
+    EXPECT_TRUE(URLTokenizer::Tokenize(url, &lower, &tokens));
+    std::vector<std::string> result;
+    for (const auto& token : tokens)
+      result.push_back(lower.substr(token.begin, token.length));
+    if (lowerUrl)
+      *lowerUrl = lower;
+    return result;
+  }
+}
+
+TEST(URLTokenizerTest, SplitsAtNonKeywordCharacters)
+{
+  std::string lowerUrl;
+  EXPECT_EQ(std::vector<std::string>({"https", "ads", "example", "com", "banner", "gif"}),
+            Tokenize("HTTPS://Ads.Example.COM/Banner.gif", &lowerUrl));
+  EXPECT_EQ("https://ads.example.com/banner.gif", lowerUrl);
+  EXPECT_EQ(std::vector<std::string>({"http", "a%20b", "xy"}), Tokenize("http://a%20b/x_y/xy?"));
+  EXPECT_EQ(std::vector<std::string>(), Tokenize(""));
+  EXPECT_EQ(std::vector<std::string>(), Tokenize("a/b/c"));
+}
+
+TEST(URLTokenizerTest, TokensSpanBlocks)
+{
+  const std::string longToken(40, 'A');
+  const std::string url = "http://example.com/" + longToken + "/x?1=" + longToken;
+  std::string lowerUrl;
+  const std::string lowerToken(40, 'a');
+  EXPECT_EQ(std::vector<std::string>({"http", "example", "com", lowerToken, lowerToken}),
+            Tokenize(url, &lowerUrl));
+  EXPECT_EQ("http://example.com/" + lowerToken + "/x?1=" + lowerToken, lowerUrl);
+}
+
+TEST(URLTokenizerTest, DetectsNonAsciiCharacters)
+{
+  std::string lowerUrl;
+  std::vector<URLTokenizer::Token> tokens;
+  EXPECT_FALSE(URLTokenizer::Tokenize("http://example.org/\xc3\xa4.gif", &lowerUrl, &tokens));
+  EXPECT_FALSE(URLTokenizer::Tokenize(
+      "http://example.org/a/long/path/\xc3\xa4/and/more.gif", &lowerUrl, &tokens));
+  EXPECT_FALSE(URLTokenizer::TokenizeScalar("\xc3\xa4", &lowerUrl, &tokens));
+}
+
+TEST(URLTokenizerTest, VectorizedAndScalarResultsAreEqual)
+{
+  const std::string alphabet = "aZ09%/._-?=&:\x7f\x80\xff@[`{";
+  uint32_t seed = 1;
+  for (size_t length = 0; length < 100; ++length)
+  {
+    std::string url;
+    for (size_t i = 0; i < length; ++i)
+    {
+      seed = seed * 1103515245 + 12345;
+      url.push_back(alphabet[(seed >> 16) % alphabet.size()]);
+    }
+    std::string lower, scalarLower;
+    std::vector<URLTokenizer::Token> tokens, scalarTokens;
+    EXPECT_EQ(URLTokenizer::TokenizeScalar(url, &scalarLower, &scalarTokens),
+              URLTokenizer::Tokenize(url, &lower, &tokens));
+    EXPECT_EQ(scalarLower, lower);
+    ASSERT_EQ(scalarTokens.size(), tokens.size()) << url;
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+      EXPECT_EQ(scalarTokens[i].begin, tokens[i].begin);
+      EXPECT_EQ(scalarTokens[i].length, tokens[i].length);
+    }
+  }
+}
@@ -18,7 +18,9 @@
 #include <atomic>
 #include <mutex>
 #include <sstream>
+#include <thread>
 
+#include "../src/AsyncExecutor.h"
 #include "../src/DefaultResourceReader.h"
 #include "../src/DefaultWebRequest.h"
 #include "../src/Thread.h"
@@ -28,6 +30,59 @@ using namespace AdblockPlus;
 
 namespace
 {
+  class HangingWebRequestSync : public IWebRequestSync
+  {
+  public:
+    ServerResponse GET(const std::string& url, const HeaderList& requestHeaders) const override
+    {
+      return GET(url, requestHeaders, CancellationToken());
+    }
+
+    ServerResponse HEAD(const std::string& url, const HeaderList& requestHeaders) const override
+    {
+      return GET(url, requestHeaders, CancellationToken());
+    }
+
+    ServerResponse GET(const std::string& url,
+                       const HeaderList& requestHeaders,
+                       const CancellationToken& cancellation) const override
+    {
+      started = true;
+      while (!cancellation.IsCancelled())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      ServerResponse response;
+      response.status = IWebRequest::NS_ERROR_NET_INTERRUPT;
+      response.responseStatus = 0;
+      return response;
+    }
+
+    ServerResponse HEAD(const std::string& url,
+                        const HeaderList& requestHeaders,
+                        const CancellationToken& cancellation) const override
+    {
+      return GET(url, requestHeaders, cancellation);
+    }
+
+    mutable std::atomic<bool> started{false};
+  };
+
+  class ChunkedWebRequestSync : public DefaultWebRequestSync
+  {
+  public:
+    ServerResponse StreamGET(const std::string& url,
+                             const HeaderList& requestHeaders,
+                             const CancellationToken& cancellation,
+                             const IWebRequest::DataCallback& dataCallback) const override
+    {
+      for (const std::string chunk : {"a\r\nb", "c\n\nd"})
+        dataCallback(chunk.data(), chunk.size());
+      ServerResponse response;
+      response.status = IWebRequest::NS_OK;
+      response.responseStatus = 200;
+      return response;
+    }
+  };
+
   class BaseWebRequestTest : public BaseJsTest
   {
   protected:
@@ -56,8 +111,12 @@ namespace
   {
     WebRequestPtr CreateWebRequest() override
     {
-      return WebRequestPtr(
-          new DefaultWebRequest(executor, WebRequestSyncPtr(new DefaultWebRequestSync())));
+      return WebRequestPtr(new DefaultWebRequest(executor, CreateWebRequestSync()));
+    }
+
+    virtual WebRequestSyncPtr CreateWebRequestSync()
+    {
+      return WebRequestSyncPtr(new DefaultWebRequestSync());
     }
 
     std::list<std::function<void()>> webRequestTasks;
@@ -82,6 +141,14 @@ namespace
     }
   };
 
+  class ChunkedWebRequestTest : public DefaultWebRequestTest
+  {
+    WebRequestSyncPtr CreateWebRequestSync() override
+    {
+      return WebRequestSyncPtr(new ChunkedWebRequestSync());
+    }
+  };
+
   class MockWebRequestTest : public BaseWebRequestTest
   {
     WebRequestPtr CreateWebRequest() override
@@ -201,6 +268,20 @@ TEST_F(MockWebRequestTest, SuccessfulRequestGET)
             jsEngine.Evaluate("JSON.stringify(foo.responseHeaders)").AsString());
 }
 
+TEST_F(MockWebRequestTest, LinesOfGETArePassedToTheListener)
+{
+  auto& jsEngine = GetJsEngine();
+  jsEngine.Evaluate("let foo; let lines = [];"
+                    "_webRequest.GET('http://example.com/', {X: 'Y'}, function(result) "
+                    "{foo = result;}, function(batch) {lines.push(batch);})");
+  ProcessPendingWebRequests();
+  ASSERT_EQ(IWebRequest::NS_OK, jsEngine.Evaluate("foo.status").AsInt());
+  ASSERT_EQ(123, jsEngine.Evaluate("foo.responseStatus").AsInt());
+  EXPECT_EQ("", jsEngine.Evaluate("foo.responseText").AsString());
+  EXPECT_EQ("[[\"http://example.com/\",\"X\"],[\"Y\"]]",
+            jsEngine.Evaluate("JSON.stringify(lines)").AsString());
+}
+
 TEST_F(MockWebRequestTest, SuccessfulRequestHEAD)
 {
   auto& jsEngine = GetJsEngine();
@@ -241,6 +322,25 @@ TEST_F(DefaultWebRequestTest, DummyWebRequestHEAD)
   ASSERT_EQ("{}", jsEngine.Evaluate("JSON.stringify(foo.responseHeaders)").AsString());
 }
 
+TEST_F(ChunkedWebRequestTest, LinesAreSplitAcrossChunks)
+{
+  auto& jsEngine = GetJsEngine();
+  jsEngine.Evaluate("let foo; let lines = [];"
+                    "_webRequest.GET('http://example.com/', {}, function(result) {foo = result;}, "
+                    "function(batch) {lines.push(batch);})");
+  WaitForVariable("foo", jsEngine);
+  ASSERT_EQ(IWebRequest::NS_OK, jsEngine.Evaluate("foo.status").AsInt());
+  EXPECT_EQ("", jsEngine.Evaluate("foo.responseText").AsString());
+  EXPECT_EQ("[[\"a\"],[\"bc\"],[\"d\"]]",
+            jsEngine.Evaluate("JSON.stringify(lines)").AsString());
+
+  jsEngine.Evaluate("let bar; _webRequest.GET('http://example.com/', {}, function(result) "
+                    "{bar = result;})");
+  WaitForVariable("bar", jsEngine);
+  EXPECT_EQ("a\r\nbc\n\nd", jsEngine.Evaluate("bar.responseText").AsString())
+      << "the chunks are collected";
+}
+
 TEST_F(DefaultWebRequestTest, DummyXMLHttpRequestGET)
 {
   auto& jsEngine = GetJsEngine();
@@ -412,3 +512,21 @@ TEST_F(MockWebRequestAndLogSystemTest, RequestHeaderValidation)
     EXPECT_FALSE(headers.cend() == headers.find("Security"));
   }
 }
+
+TEST(DefaultWebRequestShutdownTest, StoppingCancelsRunningRequests)
+{
+  OptionalAsyncExecutor executor;
+  auto* syncImpl = new HangingWebRequestSync();
+  DefaultWebRequest webRequest(executor, WebRequestSyncPtr(syncImpl));
+  std::atomic<bool> called(false);
+  webRequest.GET("http://example.com/", HeaderList(), [&called](const ServerResponse&) {
+    called = true;
+  });
+  while (!syncImpl->started)
+    std::this_thread::yield();
+  const auto stopping = std::chrono::steady_clock::now();
+  executor.StopWithin(std::chrono::seconds(10));
+  EXPECT_GT(std::chrono::seconds(5), std::chrono::steady_clock::now() - stopping)
+      << "the request gives up once cancelled";
+  EXPECT_FALSE(called);
+}
@@ -11,21 +11,43 @@
       '<(libv8_include_dir)'
     ],
     'sources': [
+      'test/AsyncEventDispatcher.cpp',
       'test/AsyncExecutor.cpp',
+      'test/AsyncLogSystem.cpp',
       'test/BaseJsTest.h',
       'test/BaseJsTest.cpp',
+      'test/BinaryStorage.cpp',
+      'test/CacheWarmer.cpp',
+      'test/Compression.cpp',
       'test/AppInfoJsObject.cpp',
       'test/ConsoleJsObject.cpp',
+      'test/ContentFilterDomains.cpp',
       'test/DefaultFileSystem.cpp',
+      'test/DefaultTimer.cpp',
       'test/FileSystemJsObject.cpp',
       'test/FilterEngineTest.h',
       'test/FilterEngine.cpp',
+      'test/FilterSubscriptionIndex.cpp',
+      'test/GcScheduler.cpp',
       'test/GlobalJsObject.cpp',
       'test/HarnessTest.cpp',
+      'test/HitCounter.cpp',
+      'test/HostCache.cpp',
       'test/JsEngine.cpp',
       'test/JsValue.cpp',
+      'test/Metrics.cpp',
+      'test/MpscQueue.cpp',
+      'test/NativeMatcher.cpp',
+      'test/NativeRegExp.cpp',
       'test/PreloadedSubscriptions.cpp',
       'test/ReferrerMapping.cpp',
+      'test/SharedFilterData.cpp',
+      'test/SignatureVerifier.cpp',
+      'test/SingleFlight.cpp',
+      'test/StringPool.cpp',
+      'test/TraceRecorder.cpp',
+      'test/URLInfo.cpp',
+      'test/URLTokenizer.cpp',
       'test/Utils.cpp',
       'test/WebRequest.cpp'
     ],